@@ -0,0 +1,459 @@
+#pragma once
+
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <vector>
+#include "../operators/relu_kernels.h"
+
+// Runs the CPU kernels of the sample outside of a WinML session. A TensorView stands in for IMLOperatorTensor, and
+// kernels are created by name from a registry, so the benchmark driver can run any of them against synthetic tensors
+// of any shape and type, time them and check them against a reference. Nothing in here depends on WinML; the WinML
+// operators themselves are registered by operator_kernels.h on Windows.
+namespace KernelHarness
+{
+    // Same values as MLOperatorTensorDataType, so a view can be handed to a WinML operator as is.
+    enum class TensorDataType : uint32_t
+    {
+        Undefined = 0,
+        Float = 1,
+        UInt8 = 2,
+        Int8 = 3,
+        UInt16 = 4,
+        Int16 = 5,
+        Int32 = 6,
+        Int64 = 7,
+        Bool = 9,
+        Float16 = 10,
+        Double = 11,
+        UInt32 = 12,
+        UInt64 = 13,
+    };
+
+    struct TensorTypeInfo
+    {
+        TensorDataType Type;
+        const char* Name;
+        size_t ElementSize;
+    };
+
+    const TensorTypeInfo TensorTypes[] = {
+        { TensorDataType::Float, "float", 4 },    { TensorDataType::Float16, "float16", 2 },
+        { TensorDataType::Double, "double", 8 },  { TensorDataType::UInt8, "uint8", 1 },
+        { TensorDataType::Int8, "int8", 1 },      { TensorDataType::UInt16, "uint16", 2 },
+        { TensorDataType::Int16, "int16", 2 },    { TensorDataType::Int32, "int32", 4 },
+        { TensorDataType::UInt32, "uint32", 4 },  { TensorDataType::Int64, "int64", 8 },
+        { TensorDataType::UInt64, "uint64", 8 },  { TensorDataType::Bool, "bool", 1 },
+    };
+
+    inline const TensorTypeInfo& GetTypeInfo(TensorDataType type)
+    {
+        for (const auto& info : TensorTypes)
+        {
+            if (info.Type == type)
+            {
+                return info;
+            }
+        }
+        throw std::invalid_argument("Unsupported tensor data type " + std::to_string(static_cast<uint32_t>(type)));
+    }
+
+    inline const char* GetTypeName(TensorDataType type) { return GetTypeInfo(type).Name; }
+
+    inline TensorDataType ParseTypeName(const std::string& name)
+    {
+        for (const auto& info : TensorTypes)
+        {
+            if (name == info.Name)
+            {
+                return info.Type;
+            }
+        }
+        throw std::invalid_argument("Unknown tensor data type: " + name);
+    }
+
+    // A CPU tensor that the view does not own.
+    struct TensorView
+    {
+        TensorDataType Type = TensorDataType::Undefined;
+        std::vector<uint32_t> Shape;
+        void* Data = nullptr;
+
+        size_t GetElementCount() const
+        {
+            size_t count = 1;
+            for (uint32_t dimension : Shape)
+            {
+                count *= dimension;
+            }
+            return count;
+        }
+
+        size_t GetByteSize() const { return GetElementCount() * GetTypeInfo(Type).ElementSize; }
+
+        template <typename T> T* As() const { return static_cast<T*>(Data); }
+    };
+
+    // Owns the storage of a tensor, aligned to a cache line like the buffers WinML hands to an operator.
+    class TensorBuffer
+    {
+    public:
+        static const size_t Alignment = 64;
+
+        TensorBuffer(TensorDataType type, std::vector<uint32_t> shape)
+        {
+            m_view.Type = type;
+            m_view.Shape = std::move(shape);
+            m_storage.resize(m_view.GetByteSize() + Alignment);
+            uintptr_t address = reinterpret_cast<uintptr_t>(m_storage.data());
+            m_view.Data = m_storage.data() + (Alignment - address % Alignment) % Alignment;
+        }
+
+        const TensorView& GetView() const { return m_view; }
+
+    private:
+        std::vector<uint8_t> m_storage;
+        TensorView m_view;
+    };
+
+    // Fills a tensor with values from a fixed seed: standard normal values for the floating point types, so about
+    // half of them are negative, and random bits for the other types.
+    inline void FillRandom(const TensorView& tensor, uint32_t seed)
+    {
+        std::mt19937 generator(seed);
+        std::normal_distribution<float> normal;
+        size_t count = tensor.GetElementCount();
+        switch (tensor.Type)
+        {
+            case TensorDataType::Float:
+                std::generate(tensor.As<float>(), tensor.As<float>() + count, [&]() { return normal(generator); });
+                break;
+            case TensorDataType::Double:
+                std::generate(tensor.As<double>(), tensor.As<double>() + count, [&]() { return normal(generator); });
+                break;
+            case TensorDataType::Float16:
+                for (size_t i = 0; i < count; ++i)
+                {
+                    tensor.As<uint16_t>()[i] = ReluKernels::FloatToHalf(normal(generator));
+                }
+                break;
+            case TensorDataType::Bool:
+                for (size_t i = 0; i < count; ++i)
+                {
+                    tensor.As<uint8_t>()[i] = generator() & 1;
+                }
+                break;
+            default:
+                for (size_t i = 0; i < tensor.GetByteSize(); ++i)
+                {
+                    tensor.As<uint8_t>()[i] = static_cast<uint8_t>(generator());
+                }
+                break;
+        }
+    }
+
+    // Element i of a tensor as a double, for comparisons.
+    inline double GetElement(const TensorView& tensor, size_t i)
+    {
+        switch (tensor.Type)
+        {
+            case TensorDataType::Float:
+                return tensor.As<float>()[i];
+            case TensorDataType::Double:
+                return tensor.As<double>()[i];
+            case TensorDataType::Float16:
+                return ReluKernels::HalfToFloat(tensor.As<uint16_t>()[i]);
+            case TensorDataType::UInt8:
+            case TensorDataType::Bool:
+                return tensor.As<uint8_t>()[i];
+            case TensorDataType::Int8:
+                return tensor.As<int8_t>()[i];
+            case TensorDataType::UInt16:
+                return tensor.As<uint16_t>()[i];
+            case TensorDataType::Int16:
+                return tensor.As<int16_t>()[i];
+            case TensorDataType::Int32:
+                return tensor.As<int32_t>()[i];
+            case TensorDataType::UInt32:
+                return tensor.As<uint32_t>()[i];
+            case TensorDataType::Int64:
+                return static_cast<double>(tensor.As<int64_t>()[i]);
+            case TensorDataType::UInt64:
+                return static_cast<double>(tensor.As<uint64_t>()[i]);
+            default:
+                throw std::invalid_argument("Unsupported tensor data type");
+        }
+    }
+
+    // Options a kernel is created with. Each kernel reads the ones it uses.
+    struct KernelOptions
+    {
+        ReluKernels::KernelThreadPool* Pool = nullptr; // null runs the kernel on the calling thread
+        ReluKernels::SimdLevel Level = ReluKernels::GetSimdLevel();
+        float Mean = 0;              // NoisyRelu "mean" attribute
+        float StandardDeviation = 1; // NoisyRelu "variance" attribute, which is used as the standard deviation
+        uint64_t Seed = 0;           // NoisyRelu noise key
+    };
+
+    class CpuKernel
+    {
+    public:
+        virtual ~CpuKernel() = default;
+
+        // Computes output from input. Both have the same shape and type, as for the operators of the sample.
+        virtual void Compute(const TensorView& input, const TensorView& output) = 0;
+    };
+
+    struct KernelRegistration
+    {
+        std::string Name;
+        std::vector<TensorDataType> Types;
+        std::function<std::unique_ptr<CpuKernel>(const KernelOptions&)> Create;
+        // The output is checked against the scalar, single threaded output of this kernel (the kernel itself if
+        // empty) with the same seed.
+        std::string ReferenceName;
+        // Largest relative difference to the reference that passes, or a negative value for a kernel whose output
+        // cannot be reproduced, e.g. one that seeds its own random generator.
+        double Tolerance = 0;
+        // False for kernels that ignore the thread pool and SIMD level, which are run once per configuration.
+        bool IsConfigurable = true;
+
+        bool Supports(TensorDataType type) const
+        {
+            return std::find(Types.begin(), Types.end(), type) != Types.end();
+        }
+    };
+
+    class KernelRegistry
+    {
+    public:
+        void Register(KernelRegistration registration) { m_kernels.push_back(std::move(registration)); }
+
+        const std::vector<KernelRegistration>& GetKernels() const { return m_kernels; }
+
+        // Kernel with the given name, ignoring case.
+        const KernelRegistration& Find(const std::string& name) const
+        {
+            auto equalIgnoringCase = [](char a, char b) {
+                return std::tolower(static_cast<unsigned char>(a)) == std::tolower(static_cast<unsigned char>(b));
+            };
+            for (const auto& kernel : m_kernels)
+            {
+                if (kernel.Name.size() == name.size() &&
+                    std::equal(name.begin(), name.end(), kernel.Name.begin(), equalIgnoringCase))
+                {
+                    return kernel;
+                }
+            }
+            throw std::invalid_argument("Unknown kernel: " + name);
+        }
+
+    private:
+        std::vector<KernelRegistration> m_kernels;
+    };
+
+    // Calls f with a null pointer of the element type of a float, double or float16 tensor.
+    template <typename F> void DispatchFloatType(TensorDataType type, F&& f)
+    {
+        switch (type)
+        {
+            case TensorDataType::Float:
+                f(static_cast<float*>(nullptr));
+                break;
+            case TensorDataType::Double:
+                f(static_cast<double*>(nullptr));
+                break;
+            case TensorDataType::Float16:
+                f(static_cast<ReluKernels::Float16*>(nullptr));
+                break;
+            default:
+                throw std::invalid_argument(std::string("Kernel does not support ") + GetTypeName(type));
+        }
+    }
+
+    // The kernel of CpuReluOperator.
+    class ReluKernel : public CpuKernel
+    {
+    public:
+        explicit ReluKernel(const KernelOptions& options) : m_options(options) {}
+
+        void Compute(const TensorView& input, const TensorView& output) override
+        {
+            DispatchFloatType(input.Type, [&](auto* type) {
+                using T = std::remove_pointer_t<decltype(type)>;
+                ReluKernels::Relu(input.As<const T>(), output.As<T>(), input.GetElementCount(), m_options.Pool,
+                                  m_options.Level);
+            });
+        }
+
+    private:
+        KernelOptions m_options;
+    };
+
+    // The kernel of NoisyReluOperator, with its own noise stream like an operator instance.
+    class NoisyReluKernel : public CpuKernel
+    {
+    public:
+        explicit NoisyReluKernel(const KernelOptions& options) : m_options(options), m_noiseStream(options.Seed) {}
+
+        void Compute(const TensorView& input, const TensorView& output) override
+        {
+            ReluKernels::NoiseParameters parameters{ m_options.Mean, m_options.StandardDeviation };
+            DispatchFloatType(input.Type, [&](auto* type) {
+                using T = std::remove_pointer_t<decltype(type)>;
+                ReluKernels::NoisyRelu(input.As<const T>(), output.As<T>(), input.GetElementCount(), m_noiseStream,
+                                       parameters, m_options.Pool, m_options.Level);
+            });
+        }
+
+    private:
+        KernelOptions m_options;
+        ReluKernels::NoiseStream m_noiseStream;
+    };
+
+    // The pass through of DebugOperator, which copies its input to its output. The copy is split across the thread
+    // pool like the other kernels, so it also serves as the memory bandwidth the other kernels can be compared to.
+    // Writing the tensor to a file uses the Windows storage APIs and is only measured through the WinML operator.
+    class DebugKernel : public CpuKernel
+    {
+    public:
+        explicit DebugKernel(const KernelOptions& options) : m_options(options) {}
+
+        void Compute(const TensorView& input, const TensorView& output) override
+        {
+            const uint8_t* source = input.As<const uint8_t>();
+            uint8_t* destination = output.As<uint8_t>();
+            ReluKernels::ForEachRange(input.GetByteSize(), m_options.Pool, [=](size_t begin, size_t end) {
+                std::memcpy(destination + begin, source + begin, end - begin);
+            });
+        }
+
+    private:
+        KernelOptions m_options;
+    };
+
+    template <typename K> std::unique_ptr<CpuKernel> CreateKernel(const KernelOptions& options)
+    {
+        return std::make_unique<K>(options);
+    }
+
+    // Registers the portable kernels of the Relu, NoisyRelu and Debug operators.
+    inline void RegisterSampleKernels(KernelRegistry& registry)
+    {
+        const std::vector<TensorDataType> floatTypes = { TensorDataType::Float, TensorDataType::Double,
+                                                         TensorDataType::Float16 };
+        std::vector<TensorDataType> allTypes;
+        for (const auto& info : TensorTypes)
+        {
+            allTypes.push_back(info.Type);
+        }
+
+        registry.Register({ "Relu", floatTypes, CreateKernel<ReluKernel>, "", 0 });
+        // SIMD levels may differ by the rounding of a fused multiply and add, and float16 by the rounding of the result
+        registry.Register({ "NoisyRelu", floatTypes, CreateKernel<NoisyReluKernel>, "", 1e-3 });
+        registry.Register({ "Debug", allTypes, CreateKernel<DebugKernel>, "", 0 });
+    }
+
+    struct VerifyResult
+    {
+        bool Passed = true;
+        size_t Mismatches = 0;
+        size_t FirstMismatch = 0;
+        double Expected = 0;
+        double Actual = 0;
+    };
+
+    // Compares two tensors of the same shape and type. Values match if both are nan, or if they differ by at most
+    // tolerance relative to the larger of 1 and the expected value.
+    inline VerifyResult CompareTensors(const TensorView& expected, const TensorView& actual, double tolerance)
+    {
+        VerifyResult result;
+        size_t count = expected.GetElementCount();
+        if (tolerance == 0)
+        {
+            if (std::memcmp(expected.Data, actual.Data, expected.GetByteSize()) == 0)
+            {
+                return result;
+            }
+        }
+        for (size_t i = 0; i < count; ++i)
+        {
+            double a = GetElement(expected, i);
+            double b = GetElement(actual, i);
+            bool match = (std::isnan(a) && std::isnan(b)) ||
+                         std::fabs(a - b) <= tolerance * (std::max)(1.0, std::fabs(a));
+            if (!match)
+            {
+                if (result.Mismatches == 0)
+                {
+                    result.FirstMismatch = i;
+                    result.Expected = a;
+                    result.Actual = b;
+                }
+                ++result.Mismatches;
+            }
+        }
+        result.Passed = result.Mismatches == 0;
+        return result;
+    }
+
+    struct TimingResult
+    {
+        uint32_t Iterations = 0;
+        double MedianMs = 0;
+        double MinMs = 0;
+        double MeanMs = 0;
+        double GigabytesPerSecond = 0; // bytes read plus bytes written, at the median time
+        double ElementsPerSecond = 0;  // at the median time
+    };
+
+    // Runs warmup untimed computes, then times iterations computes one by one.
+    inline TimingResult TimeKernel(CpuKernel& kernel, const TensorView& input, const TensorView& output,
+                                   uint32_t warmup, uint32_t iterations)
+    {
+        for (uint32_t i = 0; i < warmup; ++i)
+        {
+            kernel.Compute(input, output);
+        }
+        std::vector<double> times;
+        times.reserve(iterations);
+        for (uint32_t i = 0; i < iterations; ++i)
+        {
+            auto start = std::chrono::steady_clock::now();
+            kernel.Compute(input, output);
+            auto elapsed = std::chrono::steady_clock::now() - start;
+            times.push_back(std::chrono::duration<double, std::milli>(elapsed).count());
+        }
+
+        TimingResult result;
+        result.Iterations = iterations;
+        if (times.empty())
+        {
+            return result;
+        }
+        std::sort(times.begin(), times.end());
+        result.MedianMs = times.size() % 2 == 1 ? times[times.size() / 2]
+                                                : (times[times.size() / 2 - 1] + times[times.size() / 2]) / 2;
+        result.MinMs = times.front();
+        for (double time : times)
+        {
+            result.MeanMs += time / times.size();
+        }
+        if (result.MedianMs > 0)
+        {
+            double bytes = static_cast<double>(input.GetByteSize() + output.GetByteSize());
+            result.GigabytesPerSecond = bytes / (result.MedianMs * 1e6);
+            result.ElementsPerSecond = static_cast<double>(input.GetElementCount()) * 1000.0 / result.MedianMs;
+        }
+        return result;
+    }
+} // namespace KernelHarness
@@ -0,0 +1,480 @@
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include "kernel_harness.h"
+#if defined(CUSTOM_OPERATOR_BENCHMARK_WINML)
+#include "operator_kernels.h"
+#endif
+
+using namespace KernelHarness;
+using ReluKernels::KernelThreadPool;
+using ReluKernels::SimdLevel;
+
+struct BenchmarkArgs
+{
+    std::vector<std::string> Kernels;
+    std::vector<TensorDataType> Types = { TensorDataType::Float };
+    std::vector<std::vector<uint32_t>> Shapes;
+    std::vector<unsigned int> ThreadCounts;
+    std::vector<SimdLevel> Levels = { ReluKernels::GetSimdLevel() };
+    uint32_t Iterations = 100;
+    uint32_t Warmup = 10;
+    bool Verify = false;
+    bool List = false;
+    bool Help = false;
+    std::string CsvPath;
+};
+
+static void PrintUsage()
+{
+    std::cout << "custom-operator-benchmark [options]" << std::endl;
+    std::cout << "  -Kernel <names>    : comma separated kernels to run, or all (default)" << std::endl;
+    std::cout << "  -Type <types>      : comma separated tensor types (float, float16, double, ...), or all. "
+                 "Default: float"
+              << std::endl;
+    std::cout << "  -Shape <shape>     : tensor shape such as 1x3x224x224. Can be given more than once. "
+                 "Default: 1x3x224x224 and 8x64x56x56"
+              << std::endl;
+    std::cout << "  -Threads <counts>  : comma separated thread counts. Default: 1, 2, 4, ... up to the hardware "
+                 "thread count"
+              << std::endl;
+    std::cout << "  -Simd <levels>     : comma separated SIMD levels (scalar, sse2, avx2, avx512, neon), auto for "
+                 "the widest one (default) or all for every level the CPU supports"
+              << std::endl;
+    std::cout << "  -Iterations <n>    : timed computes per configuration (default 100)" << std::endl;
+    std::cout << "  -Warmup <n>        : untimed computes before timing (default 10)" << std::endl;
+    std::cout << "  -Verify            : check every configuration against the scalar single threaded kernel and "
+                 "exit with 1 on a mismatch"
+              << std::endl;
+    std::cout << "  -Csv <path>        : also write the results to a CSV file" << std::endl;
+    std::cout << "  -List              : list the registered kernels and their types" << std::endl;
+    std::cout << "  -Help              : print this message" << std::endl;
+}
+
+static std::vector<std::string> Split(const std::string& value, char separator)
+{
+    std::vector<std::string> parts;
+    std::stringstream stream(value);
+    std::string part;
+    while (std::getline(stream, part, separator))
+    {
+        if (!part.empty())
+        {
+            parts.push_back(part);
+        }
+    }
+    return parts;
+}
+
+static std::string ToLower(std::string value)
+{
+    for (char& c : value)
+    {
+        c = static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+    }
+    return value;
+}
+
+static uint32_t ParseNumber(const std::string& value)
+{
+    size_t end = 0;
+    unsigned long number = std::stoul(value, &end);
+    if (end != value.size())
+    {
+        throw std::invalid_argument("Not a number: " + value);
+    }
+    return static_cast<uint32_t>(number);
+}
+
+// Every SIMD level this build and CPU can run, from scalar up to the widest.
+static std::vector<SimdLevel> GetSupportedLevels()
+{
+    std::vector<SimdLevel> levels = { SimdLevel::Scalar };
+    SimdLevel widest = ReluKernels::GetSimdLevel();
+    for (SimdLevel level : { SimdLevel::SSE2, SimdLevel::AVX2, SimdLevel::AVX512 })
+    {
+        if (widest != SimdLevel::Scalar && widest != SimdLevel::NEON && level <= widest)
+        {
+            levels.push_back(level);
+        }
+    }
+    if (widest == SimdLevel::NEON)
+    {
+        levels.push_back(SimdLevel::NEON);
+    }
+    return levels;
+}
+
+static std::vector<SimdLevel> ParseLevels(const std::string& value)
+{
+    std::vector<SimdLevel> supported = GetSupportedLevels();
+    if (ToLower(value) == "auto")
+    {
+        return { ReluKernels::GetSimdLevel() };
+    }
+    if (ToLower(value) == "all")
+    {
+        return supported;
+    }
+    std::vector<SimdLevel> levels;
+    for (const auto& name : Split(value, ','))
+    {
+        bool found = false;
+        for (SimdLevel level : supported)
+        {
+            if (ToLower(ReluKernels::SimdLevelName(level)) == ToLower(name))
+            {
+                levels.push_back(level);
+                found = true;
+            }
+        }
+        if (!found)
+        {
+            throw std::invalid_argument("SIMD level not supported on this CPU: " + name);
+        }
+    }
+    return levels;
+}
+
+static std::vector<uint32_t> ParseShape(const std::string& value)
+{
+    std::vector<uint32_t> shape;
+    for (const auto& dimension : Split(ToLower(value), 'x'))
+    {
+        shape.push_back(ParseNumber(dimension));
+    }
+    if (shape.empty())
+    {
+        throw std::invalid_argument("Empty tensor shape");
+    }
+    return shape;
+}
+
+static BenchmarkArgs ParseArgs(int argc, char* argv[])
+{
+    BenchmarkArgs args;
+    for (int i = 1; i < argc; ++i)
+    {
+        std::string name = ToLower(argv[i]);
+        bool hasValue = i + 1 < argc;
+        if (name == "-kernel" && hasValue)
+        {
+            std::string value = argv[++i];
+            if (ToLower(value) != "all")
+            {
+                args.Kernels = Split(value, ',');
+            }
+        }
+        else if (name == "-type" && hasValue)
+        {
+            std::string value = ToLower(argv[++i]);
+            args.Types.clear();
+            if (value == "all")
+            {
+                for (const auto& info : TensorTypes)
+                {
+                    args.Types.push_back(info.Type);
+                }
+            }
+            else
+            {
+                for (const auto& type : Split(value, ','))
+                {
+                    args.Types.push_back(ParseTypeName(type));
+                }
+            }
+        }
+        else if (name == "-shape" && hasValue)
+        {
+            args.Shapes.push_back(ParseShape(argv[++i]));
+        }
+        else if (name == "-threads" && hasValue)
+        {
+            for (const auto& count : Split(argv[++i], ','))
+            {
+                args.ThreadCounts.push_back((std::max)(ParseNumber(count), 1u));
+            }
+        }
+        else if (name == "-simd" && hasValue)
+        {
+            args.Levels = ParseLevels(argv[++i]);
+        }
+        else if (name == "-iterations" && hasValue)
+        {
+            args.Iterations = ParseNumber(argv[++i]);
+        }
+        else if (name == "-warmup" && hasValue)
+        {
+            args.Warmup = ParseNumber(argv[++i]);
+        }
+        else if (name == "-csv" && hasValue)
+        {
+            args.CsvPath = argv[++i];
+        }
+        else if (name == "-verify")
+        {
+            args.Verify = true;
+        }
+        else if (name == "-list")
+        {
+            args.List = true;
+        }
+        else if (name == "-help" || name == "-?")
+        {
+            args.Help = true;
+        }
+        else
+        {
+            throw std::invalid_argument("Unknown or incomplete option: " + std::string(argv[i]));
+        }
+    }
+
+    if (args.Shapes.empty())
+    {
+        args.Shapes = { { 1, 3, 224, 224 }, { 8, 64, 56, 56 } };
+    }
+    if (args.ThreadCounts.empty())
+    {
+        unsigned int hardwareThreads = (std::max)(std::thread::hardware_concurrency(), 1u);
+        for (unsigned int count = 1; count < hardwareThreads; count *= 2)
+        {
+            args.ThreadCounts.push_back(count);
+        }
+        args.ThreadCounts.push_back(hardwareThreads);
+    }
+    return args;
+}
+
+static std::string FormatShape(const std::vector<uint32_t>& shape)
+{
+    std::string text;
+    for (size_t i = 0; i < shape.size(); ++i)
+    {
+        text += (i == 0 ? "" : "x") + std::to_string(shape[i]);
+    }
+    return text;
+}
+
+struct ResultRow
+{
+    std::string Kernel;
+    TensorDataType Type;
+    std::vector<uint32_t> Shape;
+    std::string Simd;
+    unsigned int Threads;
+    TimingResult Timing;
+    double Speedup; // median time of the first thread count over this one
+    std::string Verified;
+};
+
+static void PrintHeader()
+{
+    std::cout << std::left << std::setw(18) << "Kernel" << std::setw(9) << "Type" << std::setw(16) << "Shape"
+              << std::setw(8) << "SIMD" << std::right << std::setw(8) << "Threads" << std::setw(12) << "Median ms"
+              << std::setw(12) << "Min ms" << std::setw(10) << "GB/s" << std::setw(12) << "Gelem/s" << std::setw(9)
+              << "Speedup" << "  Verified" << std::endl;
+}
+
+static void PrintRow(const ResultRow& row)
+{
+    std::cout << std::left << std::setw(18) << row.Kernel << std::setw(9) << GetTypeName(row.Type) << std::setw(16)
+              << FormatShape(row.Shape) << std::setw(8) << row.Simd << std::right << std::setw(8) << row.Threads
+              << std::fixed << std::setprecision(4) << std::setw(12) << row.Timing.MedianMs << std::setw(12)
+              << row.Timing.MinMs << std::setprecision(2) << std::setw(10) << row.Timing.GigabytesPerSecond
+              << std::setw(12) << row.Timing.ElementsPerSecond / 1e9 << std::setw(9) << row.Speedup << "  "
+              << row.Verified << std::defaultfloat << std::endl;
+}
+
+static void WriteCsv(const std::string& path, const std::vector<ResultRow>& rows)
+{
+    std::ofstream csv(path);
+    if (!csv)
+    {
+        throw std::runtime_error("Could not open " + path);
+    }
+    csv << "kernel,type,shape,elements,simd,threads,iterations,median_ms,min_ms,mean_ms,gb_per_s,elements_per_s,"
+           "speedup,verified\n";
+    csv << std::setprecision(9);
+    for (const auto& row : rows)
+    {
+        size_t elements = 1;
+        for (uint32_t dimension : row.Shape)
+        {
+            elements *= dimension;
+        }
+        csv << row.Kernel << ',' << GetTypeName(row.Type) << ',' << FormatShape(row.Shape) << ',' << elements << ','
+            << row.Simd << ',' << row.Threads << ',' << row.Timing.Iterations << ',' << row.Timing.MedianMs << ','
+            << row.Timing.MinMs << ',' << row.Timing.MeanMs << ',' << row.Timing.GigabytesPerSecond << ','
+            << row.Timing.ElementsPerSecond << ',' << row.Speedup << ',' << row.Verified << '\n';
+    }
+}
+
+// Checks the first output of kernel against its reference. Returns "yes", "no" or "-" if it cannot be checked.
+static std::string VerifyOutput(const KernelRegistry& registry, const KernelRegistration& registration,
+                                const TensorView& input, const TensorView& output, const KernelOptions& options)
+{
+    if (registration.Tolerance < 0)
+    {
+        return "-";
+    }
+    const KernelRegistration& reference =
+        registration.ReferenceName.empty() ? registration : registry.Find(registration.ReferenceName);
+    KernelOptions referenceOptions = options;
+    referenceOptions.Pool = nullptr;
+    referenceOptions.Level = SimdLevel::Scalar;
+    TensorBuffer expected(input.Type, input.Shape);
+    reference.Create(referenceOptions)->Compute(input, expected.GetView());
+
+    VerifyResult result = CompareTensors(expected.GetView(), output, registration.Tolerance);
+    if (!result.Passed)
+    {
+        std::cerr << registration.Name << ": " << result.Mismatches << " mismatches, first at element "
+                  << result.FirstMismatch << ": expected " << result.Expected << ", got " << result.Actual
+                  << std::endl;
+        return "no";
+    }
+    return "yes";
+}
+
+int main(int argc, char* argv[])
+{
+    BenchmarkArgs args;
+    KernelRegistry registry;
+    try
+    {
+        args = ParseArgs(argc, argv);
+        RegisterSampleKernels(registry);
+#if defined(CUSTOM_OPERATOR_BENCHMARK_WINML)
+        winrt::init_apartment();
+        RegisterOperatorKernels(registry);
+#endif
+        if (args.Kernels.empty())
+        {
+            for (const auto& kernel : registry.GetKernels())
+            {
+                args.Kernels.push_back(kernel.Name);
+            }
+        }
+        for (const auto& name : args.Kernels)
+        {
+            registry.Find(name);
+        }
+    }
+    catch (const std::exception& e)
+    {
+        std::cerr << e.what() << std::endl;
+        PrintUsage();
+        return 2;
+    }
+
+    if (args.Help)
+    {
+        PrintUsage();
+        return 0;
+    }
+    if (args.List)
+    {
+        for (const auto& kernel : registry.GetKernels())
+        {
+            std::cout << kernel.Name << ":";
+            for (TensorDataType type : kernel.Types)
+            {
+                std::cout << " " << GetTypeName(type);
+            }
+            std::cout << std::endl;
+        }
+        return 0;
+    }
+
+    std::cout << "Widest SIMD level: " << ReluKernels::SimdLevelName(ReluKernels::GetSimdLevel())
+              << ", hardware threads: " << std::thread::hardware_concurrency() << std::endl;
+
+    // One pool per thread count, created up front so their threads are running before anything is timed
+    std::vector<std::unique_ptr<KernelThreadPool>> pools;
+    for (unsigned int threads : args.ThreadCounts)
+    {
+        pools.push_back(threads > 1 ? std::make_unique<KernelThreadPool>(threads - 1) : nullptr);
+    }
+
+    std::vector<ResultRow> rows;
+    bool allVerified = true;
+    try
+    {
+        PrintHeader();
+        for (const auto& name : args.Kernels)
+        {
+            const KernelRegistration& registration = registry.Find(name);
+            for (TensorDataType type : args.Types)
+            {
+                if (!registration.Supports(type))
+                {
+                    continue;
+                }
+                for (const auto& shape : args.Shapes)
+                {
+                    TensorBuffer input(type, shape);
+                    TensorBuffer output(type, shape);
+                    FillRandom(input.GetView(), 1);
+
+                    std::vector<SimdLevel> levels =
+                        registration.IsConfigurable ? args.Levels : std::vector<SimdLevel>{ SimdLevel::Scalar };
+                    size_t numThreadCounts = registration.IsConfigurable ? args.ThreadCounts.size() : 1;
+                    for (SimdLevel level : levels)
+                    {
+                        double firstMedian = 0;
+                        for (size_t t = 0; t < numThreadCounts; ++t)
+                        {
+                            KernelOptions options;
+                            options.Pool = pools[t].get();
+                            options.Level = level;
+                            options.Seed = 1;
+                            auto kernel = registration.Create(options);
+
+                            ResultRow row;
+                            row.Kernel = registration.Name;
+                            row.Type = type;
+                            row.Shape = shape;
+                            row.Simd = registration.IsConfigurable ? ReluKernels::SimdLevelName(level) : "-";
+                            row.Threads = registration.IsConfigurable ? args.ThreadCounts[t] : 0;
+                            row.Verified = "-";
+                            if (args.Verify)
+                            {
+                                kernel->Compute(input.GetView(), output.GetView());
+                                row.Verified =
+                                    VerifyOutput(registry, registration, input.GetView(), output.GetView(), options);
+                                allVerified = allVerified && row.Verified != "no";
+                            }
+                            row.Timing =
+                                TimeKernel(*kernel, input.GetView(), output.GetView(), args.Warmup, args.Iterations);
+                            firstMedian = t == 0 ? row.Timing.MedianMs : firstMedian;
+                            row.Speedup = row.Timing.MedianMs > 0 ? firstMedian / row.Timing.MedianMs : 0;
+                            PrintRow(row);
+                            rows.push_back(row);
+                        }
+                    }
+                }
+            }
+        }
+        if (!args.CsvPath.empty())
+        {
+            WriteCsv(args.CsvPath, rows);
+        }
+    }
+    catch (const std::exception& e)
+    {
+        std::cerr << e.what() << std::endl;
+        return 2;
+    }
+
+    if (!allVerified)
+    {
+        std::cerr << "Verification failed" << std::endl;
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,158 @@
+#pragma once
+
+#include "../pch.h"
+#include "../operators/relu.h"
+#include "../operators/relu_cpu.h"
+#include "../operators/noisyrelu_cpu.h"
+#include "../operators/debug_cpu.h"
+#include "kernel_harness.h"
+
+// Windows only: runs the WinML operators of the sample (CpuReluOperator, NoisyReluOperator and DebugOperator) as they
+// are, through IMLOperatorKernel::Compute, by implementing IMLOperatorTensor and IMLOperatorKernelContext over tensor
+// views. This measures what WinML runs, including the checks and dispatch of the operator, next to the portable
+// kernels.
+namespace KernelHarness
+{
+    struct TensorViewTensor : winrt::implements<TensorViewTensor, IMLOperatorTensor>
+    {
+        TensorView m_view;
+
+        TensorViewTensor(const TensorView& view) :
+            m_view(view)
+        {}
+
+        STDMETHOD_(uint32_t, GetDimensionCount)() const noexcept override
+        {
+            return static_cast<uint32_t>(m_view.Shape.size());
+        }
+
+        STDMETHOD(GetShape)(uint32_t dimensionCount, uint32_t* dimensions) const noexcept override
+        {
+            if (dimensionCount != m_view.Shape.size())
+            {
+                return E_INVALIDARG;
+            }
+            std::copy(m_view.Shape.begin(), m_view.Shape.end(), dimensions);
+            return S_OK;
+        }
+
+        STDMETHOD_(MLOperatorTensorDataType, GetTensorDataType)() const noexcept override
+        {
+            return static_cast<MLOperatorTensorDataType>(m_view.Type);
+        }
+
+        STDMETHOD_(bool, IsCpuData)() const noexcept override { return true; }
+
+        STDMETHOD_(bool, IsDataInterface)() const noexcept override { return false; }
+
+        STDMETHOD_(void*, GetData)() noexcept override { return m_view.Data; }
+
+        STDMETHOD_(void, GetDataInterface)(IUnknown** dataInterface) noexcept override { *dataInterface = nullptr; }
+    };
+
+    // Context of one Compute call with a single input and a single output.
+    struct TensorViewKernelContext : winrt::implements<TensorViewKernelContext, IMLOperatorKernelContext>
+    {
+        winrt::com_ptr<IMLOperatorTensor> m_input;
+        winrt::com_ptr<IMLOperatorTensor> m_output;
+
+        TensorViewKernelContext(const TensorView& input, const TensorView& output) :
+            m_input(winrt::make<TensorViewTensor>(input).as<IMLOperatorTensor>()),
+            m_output(winrt::make<TensorViewTensor>(output).as<IMLOperatorTensor>())
+        {}
+
+        STDMETHOD(GetInputTensor)(uint32_t inputIndex, IMLOperatorTensor** tensor) const noexcept override
+        {
+            *tensor = nullptr;
+            if (inputIndex != 0)
+            {
+                return E_INVALIDARG;
+            }
+            m_input.copy_to(tensor);
+            return S_OK;
+        }
+
+        STDMETHOD(GetOutputTensor)(
+            uint32_t outputIndex,
+            uint32_t /*dimensionCount*/,
+            const uint32_t* /*dimensionSizes*/,
+            IMLOperatorTensor** tensor) noexcept override
+        {
+            // The output of the harness is preallocated with the shape of the input
+            return GetOutputTensor(outputIndex, tensor);
+        }
+
+        STDMETHOD(GetOutputTensor)(uint32_t outputIndex, IMLOperatorTensor** tensor) noexcept override
+        {
+            *tensor = nullptr;
+            if (outputIndex != 0)
+            {
+                return E_INVALIDARG;
+            }
+            m_output.copy_to(tensor);
+            return S_OK;
+        }
+
+        STDMETHOD(AllocateTemporaryData)(size_t /*size*/, IUnknown** data) const noexcept override
+        {
+            *data = nullptr;
+            return E_NOTIMPL;
+        }
+
+        STDMETHOD_(void, GetExecutionInterface)(IUnknown** executionObject) const noexcept override
+        {
+            *executionObject = nullptr;
+        }
+    };
+
+    class OperatorKernel : public CpuKernel
+    {
+    public:
+        explicit OperatorKernel(winrt::com_ptr<IMLOperatorKernel> kernel) : m_kernel(std::move(kernel)) {}
+
+        void Compute(const TensorView& input, const TensorView& output) override
+        {
+            auto context = winrt::make<TensorViewKernelContext>(input, output).as<IMLOperatorKernelContext>();
+            winrt::check_hresult(m_kernel->Compute(context.get()));
+        }
+
+    private:
+        winrt::com_ptr<IMLOperatorKernel> m_kernel;
+    };
+
+    // Registers the WinML operators. They run on the shared kernel thread pool at the widest SIMD level whatever the
+    // options say, and are checked against the portable kernels.
+    inline void RegisterOperatorKernels(KernelRegistry& registry)
+    {
+        const std::vector<TensorDataType> floatTypes = { TensorDataType::Float, TensorDataType::Double,
+                                                         TensorDataType::Float16 };
+        const std::vector<TensorDataType> debugTypes = { TensorDataType::Float, TensorDataType::Double,
+                                                         TensorDataType::Float16, TensorDataType::UInt8,
+                                                         TensorDataType::Int32, TensorDataType::Int64 };
+
+        KernelRegistration relu{ "CpuReluOperator", floatTypes, [](const KernelOptions&) {
+            return std::make_unique<OperatorKernel>(winrt::make<CpuReluOperator>().as<IMLOperatorKernel>());
+        } };
+        relu.ReferenceName = "Relu";
+        relu.IsConfigurable = false;
+        registry.Register(relu);
+
+        // Seeds its own noise, so its output cannot be checked
+        KernelRegistration noisyRelu{ "NoisyReluOperator", floatTypes, [](const KernelOptions& options) {
+            return std::make_unique<OperatorKernel>(
+                winrt::make<NoisyReluOperator>(options.Mean, options.StandardDeviation).as<IMLOperatorKernel>());
+        } };
+        noisyRelu.Tolerance = -1;
+        noisyRelu.IsConfigurable = false;
+        registry.Register(noisyRelu);
+
+        // Includes writing every tensor to a text file in the current directory
+        KernelRegistration debug{ "DebugOperator", debugTypes, [](const KernelOptions&) {
+            return std::make_unique<OperatorKernel>(
+                winrt::make<DebugOperator>(L"benchmark_debug.txt", L"text").as<IMLOperatorKernel>());
+        } };
+        debug.ReferenceName = "Debug";
+        debug.IsConfigurable = false;
+        registry.Register(debug);
+    }
+} // namespace KernelHarness
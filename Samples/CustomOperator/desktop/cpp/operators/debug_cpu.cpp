@@ -2,6 +2,7 @@
 
 #include "../pch.h"
 #include "debug_cpu.h"
+#include "relu_kernels.h"
 
 using namespace winrt;
 using namespace Windows::Foundation;
@@ -19,6 +20,18 @@ static const int WIDTH = 3;
 static const int NUM_DIMENSIONS = 4;
 static const int TARGET_OPSET = 7;
 
+// The value an element is written out as: halfs are widened to float, everything else is written as it is
+template <typename T>
+T ElementValue(T value)
+{
+    return value;
+}
+
+inline float ElementValue(ReluKernels::Float16 value)
+{
+    return ReluKernels::HalfToFloat(value.Bits);
+}
+
 HRESULT DebugShapeInferrer::InferOutputShapes (IMLOperatorShapeInferenceContext* context) noexcept
 {
     try
@@ -51,7 +64,7 @@ void WriteToPng(vector<uint32_t> inputDims, T* inputData, uint32_t size, hstring
     // currently if data values increase beyond the capacity of a byte then information will be lost
     vector<uint8_t> byteCopy;
     for (int i = 0; i < size; i++) {
-        byteCopy.push_back( static_cast<uint8_t>(inputData[i]));
+        byteCopy.push_back( static_cast<uint8_t>(ElementValue(inputData[i])));
     }
 
     // Get current directory
@@ -110,7 +123,7 @@ void WriteToText(vector<uint32_t> inputDims, T* inputData, uint32_t size, hstrin
     outputFile << (int)dataType;
     outputFile << "\ndata: ";
     for (int i = 0; i < size; i++) {
-        outputFile << inputData[i];
+        outputFile << ElementValue(inputData[i]);
         outputFile << ", ";
     }
     outputFile.close();
@@ -134,7 +147,7 @@ void ComputeInternal(IMLOperatorTensor* pInputTensor, IMLOperatorTensor* pOutput
     }
     // only useful if the debug output is used for some reason 
     // (not necessary since debug output can be consumed by no nodes without changing model execution
-    memcpy(outputData, inputData, size);
+    memcpy(outputData, inputData, size * sizeof(T));
 
 }
 
@@ -188,9 +201,11 @@ HRESULT DebugOperator::Compute(IMLOperatorKernelContext* context)
 
                 switch (type) {
                     case MLOperatorTensorDataType::Float:
-                    case MLOperatorTensorDataType::Float16:
                         ComputeInternal<float>(inputTensor.get(), outputTensor.get(), inputDataSize, inputDims, m_filePath, m_fileType);
                         break;
+                    case MLOperatorTensorDataType::Float16:
+                        ComputeInternal<ReluKernels::Float16>(inputTensor.get(), outputTensor.get(), inputDataSize, inputDims, m_filePath, m_fileType);
+                        break;
                     case MLOperatorTensorDataType::Bool:
                         ComputeInternal<bool>(inputTensor.get(), outputTensor.get(), inputDataSize, inputDims, m_filePath, m_fileType);
                         break;
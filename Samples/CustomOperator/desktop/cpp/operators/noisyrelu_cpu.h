@@ -1,6 +1,7 @@
 #pragma once
 
 #include "MLOperatorAuthor.h"
+#include "relu_kernels.h"
 
 struct NoisyReluShapeInferrer : winrt::implements<NoisyReluShapeInferrer, IMLOperatorShapeInferrer>
 {
@@ -29,9 +30,14 @@ struct NoisyReluOperator: winrt::implements<NoisyReluOperator, IMLOperatorKernel
     float m_mean;
     float m_variance;
 
+    // Philox key and counter of this instance. The key is seeded once, and every Compute call reserves its own
+    // range of counters, so simultaneous calls draw different noise without sharing generator state.
+    ReluKernels::NoiseStream m_noiseStream;
+
     NoisyReluOperator(float mean, float variance) :
         m_mean(mean),
-        m_variance(variance)
+        m_variance(variance),
+        m_noiseStream(ReluKernels::GenerateSeed())
     {}
 
     // Computes the outputs of the kernel.  This may be called multiple times
@@ -92,6 +98,15 @@ struct NoisyReluOperator: winrt::implements<NoisyReluOperator, IMLOperatorKernel
                     ComputeInternal<double>(inputTensor.get(), outputTensor.get(), inputDataSize);
                 }
             }
+            else if (outputTensor->GetTensorDataType() == MLOperatorTensorDataType::Float16 &&
+                inputTensor->GetTensorDataType() == MLOperatorTensorDataType::Float16)
+            {
+                // For cpu data
+                if (outputTensor->IsCpuData() && inputTensor->IsCpuData())
+                {
+                    ComputeInternal<ReluKernels::Float16>(inputTensor.get(), outputTensor.get(), inputDataSize);
+                }
+            }
 
             return S_OK;
         }
@@ -101,21 +116,17 @@ struct NoisyReluOperator: winrt::implements<NoisyReluOperator, IMLOperatorKernel
         }
     }
 
-    template <typename T, typename U = T>
+    template <typename T>
     void ComputeInternal(IMLOperatorTensor* pInputTensor, IMLOperatorTensor* pOutputTensor, uint32_t size)
     {
-        // Create a normal distribution
-        std::normal_distribution<> dist{ m_mean, m_variance };
-        std::random_device rd{};
-        std::mt19937 gen{ rd() };
-
-        auto inputData = static_cast<T*>(pInputTensor->GetData());
-        auto outputData = static_cast<U*>(pOutputTensor->GetData());
-
-        for (uint32_t i = 0; i < size; i++)
-        {
-            outputData[i] = static_cast<U>(std::max<T>(0, static_cast<T>(inputData[i] + dist(gen))));
-        }
+        auto inputData = static_cast<const T*>(pInputTensor->GetData());
+        auto outputData = static_cast<T*>(pOutputTensor->GetData());
+
+        // The "variance" attribute has always been used as the standard deviation of the noise, which is kept so
+        // existing models get the same distribution.
+        ReluKernels::NoiseParameters parameters{ m_mean, m_variance };
+        ReluKernels::NoisyRelu(
+            inputData, outputData, size, m_noiseStream, parameters, &ReluKernels::KernelThreadPool::GetDefault());
     }
 };
 
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <MLOperatorAuthor.h>
+#include "relu_kernels.h"
 
 
 struct CpuReluOperator: winrt::implements<CpuReluOperator, IMLOperatorKernel>
@@ -68,6 +69,15 @@ struct CpuReluOperator: winrt::implements<CpuReluOperator, IMLOperatorKernel>
                     ComputeInternal<double>(inputTensor.get(), outputTensor.get(), inputDataSize);
                 }
             }
+            else if (outputTensor->GetTensorDataType() == MLOperatorTensorDataType::Float16 &&
+                     inputTensor->GetTensorDataType() == MLOperatorTensorDataType::Float16)
+            {
+                // For cpu data
+                if (outputTensor->IsCpuData() && inputTensor->IsCpuData())
+                {
+                    ComputeInternal<ReluKernels::Float16>(inputTensor.get(), outputTensor.get(), inputDataSize);
+                }
+            }
         }
         catch (...)
         {
@@ -77,16 +87,15 @@ struct CpuReluOperator: winrt::implements<CpuReluOperator, IMLOperatorKernel>
         return S_OK;
     }
 
-    template <typename T, typename U = T>
+    template <typename T>
     void ComputeInternal(IMLOperatorTensor* pInputTensor, IMLOperatorTensor* pOutputTensor, uint32_t size)
     {
-        auto inputData = static_cast<T*>(pInputTensor->GetData());
-        auto outputData = static_cast<U*>(pOutputTensor->GetData());
+        auto inputData = static_cast<const T*>(pInputTensor->GetData());
+        auto outputData = static_cast<T*>(pOutputTensor->GetData());
 
-        for (uint32_t i = 0; i < size; i++)
-        {
-            outputData[i] = static_cast<U>(std::max<T>(0, inputData[i]));
-        }
+        // The kernel picks the widest SIMD instruction set of the CPU, and splits large tensors across the
+        // threads of the shared kernel thread pool.
+        ReluKernels::Relu(inputData, outputData, size, &ReluKernels::KernelThreadPool::GetDefault());
     }
 };
 
@@ -0,0 +1,1404 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <mutex>
+#include <random>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+#if defined(_M_X64) || defined(__x86_64__)
+#define RELU_KERNELS_X64
+#if defined(__GNUC__) && !defined(__clang__)
+// GCC 12's unmasked AVX-512 intrinsics pass an uninitialized vector as the unused passthrough operand, and
+// -Wmaybe-uninitialized reports it inside the header wherever they are inlined (GCC bug 105593)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+#include <immintrin.h>
+#pragma GCC diagnostic pop
+#else
+#include <immintrin.h>
+#endif
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+#elif defined(_M_ARM64) || defined(__aarch64__)
+#define RELU_KERNELS_NEON
+#include <arm_neon.h>
+#endif
+
+#if defined(RELU_KERNELS_X64) && (defined(__GNUC__) || defined(__clang__))
+#define RELU_KERNELS_TARGET_AVX2 __attribute__((target("avx2,f16c")))
+#define RELU_KERNELS_TARGET_AVX512 __attribute__((target("avx512f")))
+#else
+#define RELU_KERNELS_TARGET_AVX2
+#define RELU_KERNELS_TARGET_AVX512
+#endif
+
+// Relu and NoisyRelu kernels of the CPU operators (relu_cpu.h, noisyrelu_cpu.h) for float, double and float16 tensors.
+//
+// Every kernel has a scalar version plus SSE2, AVX2, AVX-512 and NEON versions that are picked at runtime, and large
+// tensors are split into ranges that run on a small thread pool. The noise of NoisyRelu comes from Philox4x32-10, a
+// counter based generator: the noise of an element is a pure function of the generator key and the element's counter,
+// so it can be computed for any number of elements at once, in any order and on any thread. The thread count never
+// changes the output, and the SIMD levels differ at most by the rounding of a multiply and add the compiler fuses
+// (GCC does so for AVX-512 unless built with -ffp-contract=off). Nothing in here depends on WinML.
+namespace ReluKernels
+{
+    enum class SimdLevel
+    {
+        Scalar,
+        SSE2,
+        AVX2, // with F16C
+        AVX512,
+        NEON,
+    };
+
+    inline const char* SimdLevelName(SimdLevel level)
+    {
+        switch (level)
+        {
+            case SimdLevel::SSE2:
+                return "SSE2";
+            case SimdLevel::AVX2:
+                return "AVX2";
+            case SimdLevel::AVX512:
+                return "AVX512";
+            case SimdLevel::NEON:
+                return "NEON";
+            default:
+                return "Scalar";
+        }
+    }
+
+    // Widest instruction set supported by both this build and the CPU it is running on.
+    inline SimdLevel GetSimdLevel()
+    {
+        static const SimdLevel level = []() {
+#if defined(RELU_KERNELS_X64)
+#if defined(_MSC_VER)
+            int info[4];
+            __cpuid(info, 0);
+            if (info[0] < 7)
+            {
+                return SimdLevel::SSE2;
+            }
+            __cpuid(info, 1);
+            const int osxsaveAvxAndF16C = (1 << 27) | (1 << 28) | (1 << 29);
+            if ((info[2] & osxsaveAvxAndF16C) != osxsaveAvxAndF16C || (_xgetbv(0) & 6) != 6)
+            {
+                return SimdLevel::SSE2;
+            }
+            __cpuidex(info, 7, 0);
+            if ((info[1] & (1 << 5)) == 0)
+            {
+                return SimdLevel::SSE2;
+            }
+            // AVX-512 also needs the OS to save the opmask and upper ZMM registers
+            return (info[1] & (1 << 16)) != 0 && (_xgetbv(0) & 0xE6) == 0xE6 ? SimdLevel::AVX512 : SimdLevel::AVX2;
+#else
+            if (!__builtin_cpu_supports("avx2") || !__builtin_cpu_supports("f16c"))
+            {
+                return SimdLevel::SSE2;
+            }
+            return __builtin_cpu_supports("avx512f") ? SimdLevel::AVX512 : SimdLevel::AVX2;
+#endif
+#elif defined(RELU_KERNELS_NEON)
+            return SimdLevel::NEON;
+#else
+            return SimdLevel::Scalar;
+#endif
+        }();
+        return level;
+    }
+
+    // IEEE half precision value stored as its bits, the element type of a MLOperatorTensorDataType::Float16 tensor.
+    struct Float16
+    {
+        uint16_t Bits;
+    };
+
+    inline float HalfToFloat(uint16_t half)
+    {
+        uint32_t sign = static_cast<uint32_t>(half & 0x8000) << 16;
+        uint32_t exponent = (half >> 10) & 0x1F;
+        uint32_t mantissa = half & 0x3FF;
+        uint32_t bits;
+        if (exponent == 0x1F)
+        {
+            bits = sign | 0x7F800000 | (mantissa << 13); // infinity or nan
+        }
+        else if (exponent != 0)
+        {
+            bits = sign | ((exponent + 112) << 23) | (mantissa << 13);
+        }
+        else if (mantissa == 0)
+        {
+            bits = sign;
+        }
+        else
+        {
+            // Subnormal half, normal float
+            exponent = 113;
+            while ((mantissa & 0x400) == 0)
+            {
+                mantissa <<= 1;
+                --exponent;
+            }
+            bits = sign | (exponent << 23) | ((mantissa & 0x3FF) << 13);
+        }
+        float value;
+        std::memcpy(&value, &bits, sizeof(value));
+        return value;
+    }
+
+    // Rounds to nearest even, like the F16C and NEON conversion instructions, so every SIMD level gives the same half.
+    inline uint16_t FloatToHalf(float value)
+    {
+        uint32_t bits;
+        std::memcpy(&bits, &value, sizeof(bits));
+        uint16_t sign = static_cast<uint16_t>((bits >> 16) & 0x8000);
+        uint32_t magnitude = bits & 0x7FFFFFFF;
+        if (magnitude >= 0x7F800000)
+        {
+            // Infinity, or a nan that keeps its top payload bits and is made quiet
+            return sign | 0x7C00 | (magnitude > 0x7F800000 ? 0x200 | ((magnitude >> 13) & 0x3FF) : 0);
+        }
+        if (magnitude >= 0x477FF000)
+        {
+            return sign | 0x7C00; // 65520 and up round to infinity
+        }
+        if (magnitude >= 0x38800000)
+        {
+            uint32_t rounded = magnitude + 0xFFF + ((magnitude >> 13) & 1);
+            return sign | static_cast<uint16_t>((rounded - 0x38000000) >> 13);
+        }
+        if (magnitude <= 0x33000000)
+        {
+            return sign; // 2^-25 and below round to zero
+        }
+        // Subnormal half: the value in units of 2^-24, rounded to nearest even
+        uint32_t mantissa = (magnitude & 0x7FFFFF) | 0x800000;
+        uint32_t shift = 126 - (magnitude >> 23);
+        uint32_t result = mantissa >> shift;
+        uint32_t remainder = mantissa & ((1u << shift) - 1);
+        uint32_t halfway = 1u << (shift - 1);
+        if (remainder > halfway || (remainder == halfway && (result & 1) != 0))
+        {
+            ++result;
+        }
+        return sign | static_cast<uint16_t>(result);
+    }
+
+    // A fixed set of worker threads that run the ranges of a kernel together with the calling thread. Ranges are
+    // handed out through an atomic counter, so a worker that is descheduled does not hold up the others.
+    class KernelThreadPool
+    {
+    public:
+        explicit KernelThreadPool(unsigned int numWorkers)
+        {
+            for (unsigned int i = 0; i < numWorkers; ++i)
+            {
+                m_workers.emplace_back([this]() { WorkerLoop(); });
+            }
+        }
+
+        ~KernelThreadPool()
+        {
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                m_stop = true;
+            }
+            m_wake.notify_all();
+            for (auto& worker : m_workers)
+            {
+                worker.join();
+            }
+        }
+
+        KernelThreadPool(const KernelThreadPool&) = delete;
+        KernelThreadPool& operator=(const KernelThreadPool&) = delete;
+
+        // Threads that run the ranges of a call, including the calling thread.
+        size_t GetThreadCount() const { return m_workers.size() + 1; }
+
+        // Pool shared by the operators, with one thread per hardware thread.
+        static KernelThreadPool& GetDefault()
+        {
+            static KernelThreadPool pool((std::max)(std::thread::hardware_concurrency(), 1u) - 1);
+            return pool;
+        }
+
+        // Calls body(begin, end) for ranges that cover [0, count) and returns once all of them are done. Every range
+        // but the last holds a multiple of alignment elements and at least minRangeSize. A call made while the pool is
+        // busy with another call runs on the calling thread alone, rather than waiting for the pool.
+        void ParallelFor(size_t count, size_t minRangeSize, size_t alignment,
+                         const std::function<void(size_t, size_t)>& body)
+        {
+            size_t numRanges = (std::min)(count / (std::max)(minRangeSize, size_t(1)), GetThreadCount());
+            std::unique_lock<std::mutex> busy(m_busy, std::try_to_lock);
+            if (numRanges <= 1 || !busy.owns_lock())
+            {
+                body(0, count);
+                return;
+            }
+            size_t rangeSize = (count + numRanges - 1) / numRanges;
+            rangeSize = (rangeSize + alignment - 1) / alignment * alignment;
+
+            Job job;
+            job.Body = &body;
+            job.Count = count;
+            job.RangeSize = rangeSize;
+            job.NumRanges = (count + rangeSize - 1) / rangeSize;
+            job.Pending = job.NumRanges;
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                m_job = &job;
+                ++m_generation;
+            }
+            m_wake.notify_all();
+            RunRanges(job);
+
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_done.wait(lock, [&job]() { return job.Pending == 0 && job.Users == 0; });
+            m_job = nullptr;
+        }
+
+    private:
+        struct Job
+        {
+            const std::function<void(size_t, size_t)>* Body;
+            size_t Count;
+            size_t RangeSize;
+            size_t NumRanges;
+            std::atomic<size_t> NextRange{ 0 };
+            std::atomic<size_t> Pending{ 0 };
+            unsigned int Users = 0; // workers inside RunRanges, guarded by m_mutex
+        };
+
+        void RunRanges(Job& job)
+        {
+            size_t range;
+            while ((range = job.NextRange.fetch_add(1)) < job.NumRanges)
+            {
+                size_t begin = range * job.RangeSize;
+                (*job.Body)(begin, (std::min)(begin + job.RangeSize, job.Count));
+                if (job.Pending.fetch_sub(1) == 1)
+                {
+                    std::lock_guard<std::mutex> lock(m_mutex);
+                    m_done.notify_all();
+                }
+            }
+        }
+
+        void WorkerLoop()
+        {
+            uint64_t seenGeneration = 0;
+            std::unique_lock<std::mutex> lock(m_mutex);
+            while (true)
+            {
+                m_wake.wait(lock, [&]() { return m_stop || m_generation != seenGeneration; });
+                if (m_stop)
+                {
+                    return;
+                }
+                seenGeneration = m_generation;
+                Job* job = m_job;
+                if (job == nullptr)
+                {
+                    continue; // woke up after the job was finished by the other threads
+                }
+                ++job->Users;
+                lock.unlock();
+                RunRanges(*job);
+                lock.lock();
+                if (--job->Users == 0)
+                {
+                    m_done.notify_all();
+                }
+            }
+        }
+
+        std::vector<std::thread> m_workers;
+        std::mutex m_busy; // held by the thread whose call the workers are running
+        std::mutex m_mutex;
+        std::condition_variable m_wake;
+        std::condition_variable m_done;
+        Job* m_job = nullptr;
+        uint64_t m_generation = 0;
+        bool m_stop = false;
+    };
+
+    // Tensors smaller than this run on the calling thread, since waking the pool would cost more than it saves.
+    const size_t MinParallelCount = 256 * 1024;
+    // Smallest range handed to a thread, and the alignment of ranges (one noise group, see below).
+    const size_t MinRangeSize = 64 * 1024;
+    const size_t RangeAlignment = 64;
+
+    inline void ForEachRange(size_t count, KernelThreadPool* pool, const std::function<void(size_t, size_t)>& body)
+    {
+        if (pool == nullptr || count < MinParallelCount)
+        {
+            body(0, count);
+        }
+        else
+        {
+            pool->ParallelFor(count, MinRangeSize, RangeAlignment, body);
+        }
+    }
+
+    // Relu kernels: output = max(0, input), so -0 and nan give 0 like std::max<T>(0, input). The SIMD kernels
+    // return the number of elements they handled and the caller finishes the rest with the scalar kernel.
+
+    template <typename T> inline void ReluScalar(const T* input, T* output, size_t count)
+    {
+        for (size_t i = 0; i < count; ++i)
+        {
+            output[i] = (std::max<T>)(0, input[i]);
+        }
+    }
+
+    // A half is kept if its bits are in [+0, +infinity] and zeroed otherwise (negative values and nans).
+    inline void ReluScalar(const Float16* input, Float16* output, size_t count)
+    {
+        for (size_t i = 0; i < count; ++i)
+        {
+            output[i].Bits = input[i].Bits <= 0x7C00 ? input[i].Bits : 0;
+        }
+    }
+
+#if defined(RELU_KERNELS_X64)
+    inline size_t ReluSse2(const float* input, float* output, size_t count)
+    {
+        const __m128 zero = _mm_setzero_ps();
+        size_t i = 0;
+        for (; i + 8 <= count; i += 8)
+        {
+            // maxps returns its second operand if either one is nan
+            _mm_storeu_ps(output + i, _mm_max_ps(_mm_loadu_ps(input + i), zero));
+            _mm_storeu_ps(output + i + 4, _mm_max_ps(_mm_loadu_ps(input + i + 4), zero));
+        }
+        return i;
+    }
+
+    inline size_t ReluSse2(const double* input, double* output, size_t count)
+    {
+        const __m128d zero = _mm_setzero_pd();
+        size_t i = 0;
+        for (; i + 4 <= count; i += 4)
+        {
+            _mm_storeu_pd(output + i, _mm_max_pd(_mm_loadu_pd(input + i), zero));
+            _mm_storeu_pd(output + i + 2, _mm_max_pd(_mm_loadu_pd(input + i + 2), zero));
+        }
+        return i;
+    }
+
+    inline size_t ReluSse2(const Float16* input, Float16* output, size_t count)
+    {
+        const __m128i zero = _mm_setzero_si128();
+        const __m128i infinity = _mm_set1_epi16(0x7C00);
+        size_t i = 0;
+        for (; i + 8 <= count; i += 8)
+        {
+            __m128i bits = _mm_loadu_si128(reinterpret_cast<const __m128i*>(input + i));
+            __m128i dropped = _mm_or_si128(_mm_cmplt_epi16(bits, zero), _mm_cmpgt_epi16(bits, infinity));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(output + i), _mm_andnot_si128(dropped, bits));
+        }
+        return i;
+    }
+
+    RELU_KERNELS_TARGET_AVX2 inline size_t ReluAvx2(const float* input, float* output, size_t count)
+    {
+        const __m256 zero = _mm256_setzero_ps();
+        size_t i = 0;
+        for (; i + 16 <= count; i += 16)
+        {
+            _mm256_storeu_ps(output + i, _mm256_max_ps(_mm256_loadu_ps(input + i), zero));
+            _mm256_storeu_ps(output + i + 8, _mm256_max_ps(_mm256_loadu_ps(input + i + 8), zero));
+        }
+        return i;
+    }
+
+    RELU_KERNELS_TARGET_AVX2 inline size_t ReluAvx2(const double* input, double* output, size_t count)
+    {
+        const __m256d zero = _mm256_setzero_pd();
+        size_t i = 0;
+        for (; i + 8 <= count; i += 8)
+        {
+            _mm256_storeu_pd(output + i, _mm256_max_pd(_mm256_loadu_pd(input + i), zero));
+            _mm256_storeu_pd(output + i + 4, _mm256_max_pd(_mm256_loadu_pd(input + i + 4), zero));
+        }
+        return i;
+    }
+
+    RELU_KERNELS_TARGET_AVX2 inline size_t ReluAvx2(const Float16* input, Float16* output, size_t count)
+    {
+        const __m256i zero = _mm256_setzero_si256();
+        const __m256i infinity = _mm256_set1_epi16(0x7C00);
+        size_t i = 0;
+        for (; i + 16 <= count; i += 16)
+        {
+            __m256i bits = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(input + i));
+            __m256i dropped = _mm256_or_si256(_mm256_cmpgt_epi16(zero, bits), _mm256_cmpgt_epi16(bits, infinity));
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(output + i), _mm256_andnot_si256(dropped, bits));
+        }
+        return i;
+    }
+
+    RELU_KERNELS_TARGET_AVX512 inline size_t ReluAvx512(const float* input, float* output, size_t count)
+    {
+        const __m512 zero = _mm512_setzero_ps();
+        size_t i = 0;
+        for (; i + 32 <= count; i += 32)
+        {
+            _mm512_storeu_ps(output + i, _mm512_max_ps(_mm512_loadu_ps(input + i), zero));
+            _mm512_storeu_ps(output + i + 16, _mm512_max_ps(_mm512_loadu_ps(input + i + 16), zero));
+        }
+        return i;
+    }
+
+    RELU_KERNELS_TARGET_AVX512 inline size_t ReluAvx512(const double* input, double* output, size_t count)
+    {
+        const __m512d zero = _mm512_setzero_pd();
+        size_t i = 0;
+        for (; i + 16 <= count; i += 16)
+        {
+            _mm512_storeu_pd(output + i, _mm512_max_pd(_mm512_loadu_pd(input + i), zero));
+            _mm512_storeu_pd(output + i + 8, _mm512_max_pd(_mm512_loadu_pd(input + i + 8), zero));
+        }
+        return i;
+    }
+#endif
+
+#if defined(RELU_KERNELS_NEON)
+    inline size_t ReluNeon(const float* input, float* output, size_t count)
+    {
+        const float32x4_t zero = vdupq_n_f32(0);
+        size_t i = 0;
+        for (; i + 4 <= count; i += 4)
+        {
+            // The compare is false for -0 and nan, which clears them to +0
+            float32x4_t values = vld1q_f32(input + i);
+            uint32x4_t kept = vandq_u32(vcgtq_f32(values, zero), vreinterpretq_u32_f32(values));
+            vst1q_f32(output + i, vreinterpretq_f32_u32(kept));
+        }
+        return i;
+    }
+
+    inline size_t ReluNeon(const double* input, double* output, size_t count)
+    {
+        const float64x2_t zero = vdupq_n_f64(0);
+        size_t i = 0;
+        for (; i + 2 <= count; i += 2)
+        {
+            float64x2_t values = vld1q_f64(input + i);
+            uint64x2_t kept = vandq_u64(vcgtq_f64(values, zero), vreinterpretq_u64_f64(values));
+            vst1q_f64(output + i, vreinterpretq_f64_u64(kept));
+        }
+        return i;
+    }
+
+    inline size_t ReluNeon(const Float16* input, Float16* output, size_t count)
+    {
+        const uint16x8_t infinity = vdupq_n_u16(0x7C00);
+        size_t i = 0;
+        for (; i + 8 <= count; i += 8)
+        {
+            uint16x8_t bits = vld1q_u16(&input[i].Bits);
+            vst1q_u16(&output[i].Bits, vandq_u16(vcleq_u16(bits, infinity), bits));
+        }
+        return i;
+    }
+#endif
+
+    // Relu of count elements on the calling thread.
+    template <typename T> inline void ReluKernel(const T* input, T* output, size_t count, SimdLevel level)
+    {
+        size_t done = 0;
+        switch (level)
+        {
+#if defined(RELU_KERNELS_X64)
+            case SimdLevel::AVX512:
+                if constexpr (std::is_same<T, Float16>::value)
+                {
+                    done = ReluAvx2(input, output, count); // 16 bit compares need AVX-512BW, AVX2 is as fast here
+                }
+                else
+                {
+                    done = ReluAvx512(input, output, count);
+                }
+                break;
+            case SimdLevel::AVX2:
+                done = ReluAvx2(input, output, count);
+                break;
+            case SimdLevel::SSE2:
+                done = ReluSse2(input, output, count);
+                break;
+#elif defined(RELU_KERNELS_NEON)
+            case SimdLevel::NEON:
+                done = ReluNeon(input, output, count);
+                break;
+#endif
+            default:
+                break;
+        }
+        ReluScalar(input + done, output + done, count - done);
+    }
+
+    // Relu of a float, double or Float16 tensor, split across the threads of pool if it is large. Input and output
+    // may be the same buffer.
+    template <typename T>
+    inline void Relu(const T* input, T* output, size_t count, KernelThreadPool* pool = nullptr,
+                     SimdLevel level = GetSimdLevel())
+    {
+        ForEachRange(count, pool, [=](size_t begin, size_t end) {
+            ReluKernel(input + begin, output + begin, end - begin, level);
+        });
+    }
+
+    // Philox4x32-10 (Salmon et al., "Parallel random numbers: as easy as 1, 2, 3"): ten rounds of two 32x32 bit
+    // multiplies turn a 128 bit counter and a 64 bit key into four random 32 bit words.
+    struct PhiloxKey
+    {
+        uint32_t K0;
+        uint32_t K1;
+    };
+
+    const uint32_t PhiloxM0 = 0xD2511F53;
+    const uint32_t PhiloxM1 = 0xCD9E8D57;
+    const uint32_t PhiloxW0 = 0x9E3779B9;
+    const uint32_t PhiloxW1 = 0xBB67AE85;
+    const int PhiloxRounds = 10;
+
+    inline void Philox4x32(uint32_t counter[4], PhiloxKey key)
+    {
+        uint32_t k0 = key.K0;
+        uint32_t k1 = key.K1;
+        for (int round = 0; round < PhiloxRounds; ++round)
+        {
+            uint64_t product0 = static_cast<uint64_t>(PhiloxM0) * counter[0];
+            uint64_t product1 = static_cast<uint64_t>(PhiloxM1) * counter[2];
+            uint32_t c1 = counter[1];
+            counter[0] = static_cast<uint32_t>(product1 >> 32) ^ c1 ^ k0;
+            counter[1] = static_cast<uint32_t>(product1);
+            counter[2] = static_cast<uint32_t>(product0 >> 32) ^ counter[3] ^ k1;
+            counter[3] = static_cast<uint32_t>(product0);
+            k0 += PhiloxW0;
+            k1 += PhiloxW1;
+        }
+    }
+
+    // Layout of the noise: elements are generated in groups of 64, and group g uses the 16 Philox blocks (counters)
+    // firstBlock + 16 g + j. Block j gives the four words of elements j, 16 + j, 32 + j and 48 + j of the group, so a
+    // SIMD kernel of 4, 8 or 16 lanes computes contiguous elements with one block per lane and needs no shuffles.
+    const size_t GroupSize = 64;
+    const size_t BlocksPerGroup = 16;
+
+    inline size_t GetGroupCount(size_t count) { return (count + GroupSize - 1) / GroupSize; }
+
+    struct NoiseParameters
+    {
+        float Mean;
+        float StandardDeviation;
+    };
+
+    // Polynomials for log on [sqrt(1/2) - 1, sqrt(2) - 1] and for sin and cos on [-pi/4, pi/4] (Cephes logf, sinf,
+    // cosf). The noise is computed with these and the same sequence of float adds and multiplies at every SIMD level,
+    // rather than with the C runtime, so all levels give the same noise up to fused multiply and adds.
+    const float SqrtHalf = 0.707106781186547524f;
+    const float LogP[] = { 7.0376836292E-2f,  -1.1514610310E-1f, 1.1676998740E-1f,
+                           -1.2420140846E-1f, 1.4249322787E-1f,  -1.6668057665E-1f,
+                           2.0000714765E-1f,  -2.4999993993E-1f, 3.3333331174E-1f };
+    const float LogQ1 = -2.12194440E-4f;
+    const float LogQ2 = 0.693359375f;
+    const float SinP[] = { -1.9515295891E-4f, 8.3321608736E-3f, -1.6666654611E-1f };
+    const float CosP[] = { 2.443315711809948E-5f, -1.388731625493765E-3f, 4.166664568298827E-2f };
+    const float Exp2Minus23 = 1.0f / 8388608.0f;
+    const float PiOver2 = 1.57079632679489662f;
+
+    // Box-Muller: turns the random words bits0 and bits1 into two independent normal values. The radius comes from
+    // u = (top 23 bits of bits0 + 1) / 2^23 in (0, 1], and the angle from the top 2 bits of bits1 (the quadrant) plus
+    // the next 23 bits (an offset in [-pi/4, pi/4)), so sin and cos only need their polynomials on [-pi/4, pi/4].
+    inline void BoxMullerScalar(uint32_t bits0, uint32_t bits1, NoiseParameters parameters, float& z0, float& z1)
+    {
+        float u = static_cast<float>(static_cast<int32_t>((bits0 >> 9) + 1)) * Exp2Minus23;
+        uint32_t uBits;
+        std::memcpy(&uBits, &u, sizeof(uBits));
+        int32_t exponent = static_cast<int32_t>(uBits >> 23) - 126;
+        uint32_t mBits = (uBits & 0x007FFFFF) | 0x3F000000;
+        float m;
+        std::memcpy(&m, &mBits, sizeof(m));
+        bool small = m < SqrtHalf;
+        exponent -= small ? 1 : 0;
+        float x = (m - 1.0f) + (small ? m : 0.0f);
+        float e = static_cast<float>(exponent);
+        float xx = x * x;
+        float y = LogP[0];
+        for (int i = 1; i < 9; ++i)
+        {
+            y = y * x + LogP[i];
+        }
+        y = (y * x) * xx;
+        y = y + e * LogQ1;
+        y = y - xx * 0.5f;
+        float logU = (x + y) + e * LogQ2;
+        float radius = std::sqrt(logU * -2.0f) * parameters.StandardDeviation;
+
+        uint32_t quadrant = bits1 >> 30;
+        float phi = (static_cast<float>(static_cast<int32_t>((bits1 >> 7) & 0x7FFFFF)) * Exp2Minus23 - 0.5f) * PiOver2;
+        float phi2 = phi * phi;
+        float sinPhi = ((((SinP[0] * phi2 + SinP[1]) * phi2 + SinP[2]) * phi2) * phi) + phi;
+        float cosPhi = ((((CosP[0] * phi2 + CosP[1]) * phi2 + CosP[2]) * phi2) * phi2 - phi2 * 0.5f) + 1.0f;
+
+        // Rotate (cos, sin) of the offset by the quadrant
+        bool swap = (quadrant & 1) != 0;
+        float cosTheta = swap ? sinPhi : cosPhi;
+        float sinTheta = swap ? cosPhi : sinPhi;
+        cosTheta = ((quadrant ^ (quadrant >> 1)) & 1) != 0 ? -cosTheta : cosTheta;
+        sinTheta = (quadrant >> 1) != 0 ? -sinTheta : sinTheta;
+        z0 = radius * cosTheta + parameters.Mean;
+        z1 = radius * sinTheta + parameters.Mean;
+    }
+
+    // Writes the noise of numGroups groups, starting at block firstBlock, to noise[0, numGroups * GroupSize).
+    inline void GenerateNoiseScalar(uint64_t firstBlock, PhiloxKey key, size_t numGroups, NoiseParameters parameters,
+                                    float* noise)
+    {
+        for (size_t group = 0; group < numGroups; ++group)
+        {
+            uint64_t block = firstBlock + group * BlocksPerGroup;
+            float* groupNoise = noise + group * GroupSize;
+            for (uint32_t lane = 0; lane < BlocksPerGroup; ++lane)
+            {
+                uint32_t counter[4] = { static_cast<uint32_t>(block) + lane, static_cast<uint32_t>(block >> 32), 0, 0 };
+                Philox4x32(counter, key);
+                BoxMullerScalar(counter[0], counter[1], parameters, groupNoise[lane], groupNoise[16 + lane]);
+                BoxMullerScalar(counter[2], counter[3], parameters, groupNoise[32 + lane], groupNoise[48 + lane]);
+            }
+        }
+    }
+
+    // output = max(0, input + noise), with the noise added in the precision of T.
+    template <typename T>
+    inline void AddNoiseReluScalar(const T* input, const float* noise, T* output, size_t count)
+    {
+        for (size_t i = 0; i < count; ++i)
+        {
+            output[i] = (std::max<T>)(0, input[i] + static_cast<T>(noise[i]));
+        }
+    }
+
+    inline void AddNoiseReluScalar(const Float16* input, const float* noise, Float16* output, size_t count)
+    {
+        for (size_t i = 0; i < count; ++i)
+        {
+            output[i].Bits = FloatToHalf((std::max)(0.0f, HalfToFloat(input[i].Bits) + noise[i]));
+        }
+    }
+
+#if defined(RELU_KERNELS_X64)
+    inline void MultiplySse2(__m128i a, __m128i multiplier, __m128i& high, __m128i& low)
+    {
+        const __m128i low32 = _mm_set1_epi64x(0xFFFFFFFF);
+        __m128i even = _mm_mul_epu32(a, multiplier);
+        __m128i odd = _mm_mul_epu32(_mm_srli_epi64(a, 32), multiplier);
+        low = _mm_or_si128(_mm_and_si128(even, low32), _mm_slli_epi64(odd, 32));
+        high = _mm_or_si128(_mm_srli_epi64(even, 32), _mm_andnot_si128(low32, odd));
+    }
+
+    inline void PhiloxSse2(__m128i counter[4], PhiloxKey key)
+    {
+        const __m128i m0 = _mm_set1_epi32(static_cast<int>(PhiloxM0));
+        const __m128i m1 = _mm_set1_epi32(static_cast<int>(PhiloxM1));
+        uint32_t k0 = key.K0;
+        uint32_t k1 = key.K1;
+        for (int round = 0; round < PhiloxRounds; ++round)
+        {
+            __m128i high0, low0, high1, low1;
+            MultiplySse2(counter[0], m0, high0, low0);
+            MultiplySse2(counter[2], m1, high1, low1);
+            counter[0] = _mm_xor_si128(_mm_xor_si128(high1, counter[1]), _mm_set1_epi32(static_cast<int>(k0)));
+            counter[1] = low1;
+            counter[2] = _mm_xor_si128(_mm_xor_si128(high0, counter[3]), _mm_set1_epi32(static_cast<int>(k1)));
+            counter[3] = low0;
+            k0 += PhiloxW0;
+            k1 += PhiloxW1;
+        }
+    }
+
+    inline __m128 SelectSse2(__m128 mask, __m128 a, __m128 b)
+    {
+        return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b));
+    }
+
+    inline void BoxMullerSse2(__m128i bits0, __m128i bits1, NoiseParameters parameters, __m128& z0, __m128& z1)
+    {
+        const __m128i one = _mm_set1_epi32(1);
+        const __m128 scale = _mm_set1_ps(Exp2Minus23);
+        const __m128 half = _mm_set1_ps(0.5f);
+
+        __m128 u = _mm_mul_ps(_mm_cvtepi32_ps(_mm_add_epi32(_mm_srli_epi32(bits0, 9), one)), scale);
+        __m128i uBits = _mm_castps_si128(u);
+        __m128i exponent = _mm_sub_epi32(_mm_srli_epi32(uBits, 23), _mm_set1_epi32(126));
+        __m128 m = _mm_castsi128_ps(
+            _mm_or_si128(_mm_and_si128(uBits, _mm_set1_epi32(0x007FFFFF)), _mm_set1_epi32(0x3F000000)));
+        __m128 small = _mm_cmplt_ps(m, _mm_set1_ps(SqrtHalf));
+        exponent = _mm_add_epi32(exponent, _mm_castps_si128(small));
+        __m128 x = _mm_add_ps(_mm_sub_ps(m, _mm_set1_ps(1.0f)), _mm_and_ps(small, m));
+        __m128 e = _mm_cvtepi32_ps(exponent);
+        __m128 xx = _mm_mul_ps(x, x);
+        __m128 y = _mm_set1_ps(LogP[0]);
+        for (int i = 1; i < 9; ++i)
+        {
+            y = _mm_add_ps(_mm_mul_ps(y, x), _mm_set1_ps(LogP[i]));
+        }
+        y = _mm_mul_ps(_mm_mul_ps(y, x), xx);
+        y = _mm_add_ps(y, _mm_mul_ps(e, _mm_set1_ps(LogQ1)));
+        y = _mm_sub_ps(y, _mm_mul_ps(xx, half));
+        __m128 logU = _mm_add_ps(_mm_add_ps(x, y), _mm_mul_ps(e, _mm_set1_ps(LogQ2)));
+        __m128 radius = _mm_mul_ps(_mm_sqrt_ps(_mm_mul_ps(logU, _mm_set1_ps(-2.0f))),
+                                   _mm_set1_ps(parameters.StandardDeviation));
+
+        __m128i quadrant = _mm_srli_epi32(bits1, 30);
+        __m128 offset = _mm_cvtepi32_ps(_mm_and_si128(_mm_srli_epi32(bits1, 7), _mm_set1_epi32(0x7FFFFF)));
+        __m128 phi = _mm_mul_ps(_mm_sub_ps(_mm_mul_ps(offset, scale), half), _mm_set1_ps(PiOver2));
+        __m128 phi2 = _mm_mul_ps(phi, phi);
+        __m128 sinPhi = _mm_set1_ps(SinP[0]);
+        sinPhi = _mm_add_ps(_mm_mul_ps(sinPhi, phi2), _mm_set1_ps(SinP[1]));
+        sinPhi = _mm_add_ps(_mm_mul_ps(sinPhi, phi2), _mm_set1_ps(SinP[2]));
+        sinPhi = _mm_add_ps(_mm_mul_ps(_mm_mul_ps(sinPhi, phi2), phi), phi);
+        __m128 cosPhi = _mm_set1_ps(CosP[0]);
+        cosPhi = _mm_add_ps(_mm_mul_ps(cosPhi, phi2), _mm_set1_ps(CosP[1]));
+        cosPhi = _mm_add_ps(_mm_mul_ps(cosPhi, phi2), _mm_set1_ps(CosP[2]));
+        cosPhi = _mm_add_ps(_mm_sub_ps(_mm_mul_ps(_mm_mul_ps(cosPhi, phi2), phi2), _mm_mul_ps(phi2, half)),
+                            _mm_set1_ps(1.0f));
+
+        __m128 swap = _mm_castsi128_ps(_mm_cmpeq_epi32(_mm_and_si128(quadrant, one), one));
+        __m128 cosTheta = SelectSse2(swap, sinPhi, cosPhi);
+        __m128 sinTheta = SelectSse2(swap, cosPhi, sinPhi);
+        __m128i cosSign = _mm_slli_epi32(_mm_and_si128(_mm_xor_si128(quadrant, _mm_srli_epi32(quadrant, 1)), one), 31);
+        __m128i sinSign = _mm_slli_epi32(_mm_srli_epi32(quadrant, 1), 31);
+        cosTheta = _mm_xor_ps(cosTheta, _mm_castsi128_ps(cosSign));
+        sinTheta = _mm_xor_ps(sinTheta, _mm_castsi128_ps(sinSign));
+        z0 = _mm_add_ps(_mm_mul_ps(radius, cosTheta), _mm_set1_ps(parameters.Mean));
+        z1 = _mm_add_ps(_mm_mul_ps(radius, sinTheta), _mm_set1_ps(parameters.Mean));
+    }
+
+    inline void GenerateNoiseSse2(uint64_t firstBlock, PhiloxKey key, size_t numGroups, NoiseParameters parameters,
+                                  float* noise)
+    {
+        const __m128i lanes = _mm_setr_epi32(0, 1, 2, 3);
+        for (size_t group = 0; group < numGroups; ++group)
+        {
+            uint64_t block = firstBlock + group * BlocksPerGroup;
+            float* groupNoise = noise + group * GroupSize;
+            for (uint32_t lane = 0; lane < BlocksPerGroup; lane += 4)
+            {
+                __m128i counter[4] = {
+                    _mm_add_epi32(_mm_set1_epi32(static_cast<int>(static_cast<uint32_t>(block) + lane)), lanes),
+                    _mm_set1_epi32(static_cast<int>(block >> 32)), _mm_setzero_si128(), _mm_setzero_si128()
+                };
+                PhiloxSse2(counter, key);
+                __m128 z0, z1, z2, z3;
+                BoxMullerSse2(counter[0], counter[1], parameters, z0, z1);
+                BoxMullerSse2(counter[2], counter[3], parameters, z2, z3);
+                _mm_storeu_ps(groupNoise + lane, z0);
+                _mm_storeu_ps(groupNoise + 16 + lane, z1);
+                _mm_storeu_ps(groupNoise + 32 + lane, z2);
+                _mm_storeu_ps(groupNoise + 48 + lane, z3);
+            }
+        }
+    }
+
+    inline size_t AddNoiseReluSse2(const float* input, const float* noise, float* output, size_t count)
+    {
+        const __m128 zero = _mm_setzero_ps();
+        size_t i = 0;
+        for (; i + 4 <= count; i += 4)
+        {
+            __m128 values = _mm_add_ps(_mm_loadu_ps(input + i), _mm_loadu_ps(noise + i));
+            _mm_storeu_ps(output + i, _mm_max_ps(values, zero));
+        }
+        return i;
+    }
+
+    inline size_t AddNoiseReluSse2(const double* input, const float* noise, double* output, size_t count)
+    {
+        const __m128d zero = _mm_setzero_pd();
+        size_t i = 0;
+        for (; i + 4 <= count; i += 4)
+        {
+            __m128 noise4 = _mm_loadu_ps(noise + i);
+            __m128d low = _mm_add_pd(_mm_loadu_pd(input + i), _mm_cvtps_pd(noise4));
+            __m128d high = _mm_add_pd(_mm_loadu_pd(input + i + 2), _mm_cvtps_pd(_mm_movehl_ps(noise4, noise4)));
+            _mm_storeu_pd(output + i, _mm_max_pd(low, zero));
+            _mm_storeu_pd(output + i + 2, _mm_max_pd(high, zero));
+        }
+        return i;
+    }
+
+    inline size_t AddNoiseReluSse2(const Float16*, const float*, Float16*, size_t)
+    {
+        return 0; // no half conversions before F16C
+    }
+
+    RELU_KERNELS_TARGET_AVX2 inline void MultiplyAvx2(__m256i a, __m256i multiplier, __m256i& high, __m256i& low)
+    {
+        const __m256i low32 = _mm256_set1_epi64x(0xFFFFFFFF);
+        __m256i even = _mm256_mul_epu32(a, multiplier);
+        __m256i odd = _mm256_mul_epu32(_mm256_srli_epi64(a, 32), multiplier);
+        low = _mm256_or_si256(_mm256_and_si256(even, low32), _mm256_slli_epi64(odd, 32));
+        high = _mm256_or_si256(_mm256_srli_epi64(even, 32), _mm256_andnot_si256(low32, odd));
+    }
+
+    RELU_KERNELS_TARGET_AVX2 inline void PhiloxAvx2(__m256i counter[4], PhiloxKey key)
+    {
+        const __m256i m0 = _mm256_set1_epi32(static_cast<int>(PhiloxM0));
+        const __m256i m1 = _mm256_set1_epi32(static_cast<int>(PhiloxM1));
+        uint32_t k0 = key.K0;
+        uint32_t k1 = key.K1;
+        for (int round = 0; round < PhiloxRounds; ++round)
+        {
+            __m256i high0, low0, high1, low1;
+            MultiplyAvx2(counter[0], m0, high0, low0);
+            MultiplyAvx2(counter[2], m1, high1, low1);
+            counter[0] = _mm256_xor_si256(_mm256_xor_si256(high1, counter[1]), _mm256_set1_epi32(static_cast<int>(k0)));
+            counter[1] = low1;
+            counter[2] = _mm256_xor_si256(_mm256_xor_si256(high0, counter[3]), _mm256_set1_epi32(static_cast<int>(k1)));
+            counter[3] = low0;
+            k0 += PhiloxW0;
+            k1 += PhiloxW1;
+        }
+    }
+
+    RELU_KERNELS_TARGET_AVX2 inline void BoxMullerAvx2(__m256i bits0, __m256i bits1, NoiseParameters parameters,
+                                                       __m256& z0, __m256& z1)
+    {
+        const __m256i one = _mm256_set1_epi32(1);
+        const __m256 scale = _mm256_set1_ps(Exp2Minus23);
+        const __m256 half = _mm256_set1_ps(0.5f);
+
+        __m256 u = _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_add_epi32(_mm256_srli_epi32(bits0, 9), one)), scale);
+        __m256i uBits = _mm256_castps_si256(u);
+        __m256i exponent = _mm256_sub_epi32(_mm256_srli_epi32(uBits, 23), _mm256_set1_epi32(126));
+        __m256 m = _mm256_castsi256_ps(
+            _mm256_or_si256(_mm256_and_si256(uBits, _mm256_set1_epi32(0x007FFFFF)), _mm256_set1_epi32(0x3F000000)));
+        __m256 small = _mm256_cmp_ps(m, _mm256_set1_ps(SqrtHalf), _CMP_LT_OQ);
+        exponent = _mm256_add_epi32(exponent, _mm256_castps_si256(small));
+        __m256 x = _mm256_add_ps(_mm256_sub_ps(m, _mm256_set1_ps(1.0f)), _mm256_and_ps(small, m));
+        __m256 e = _mm256_cvtepi32_ps(exponent);
+        __m256 xx = _mm256_mul_ps(x, x);
+        __m256 y = _mm256_set1_ps(LogP[0]);
+        for (int i = 1; i < 9; ++i)
+        {
+            y = _mm256_add_ps(_mm256_mul_ps(y, x), _mm256_set1_ps(LogP[i]));
+        }
+        y = _mm256_mul_ps(_mm256_mul_ps(y, x), xx);
+        y = _mm256_add_ps(y, _mm256_mul_ps(e, _mm256_set1_ps(LogQ1)));
+        y = _mm256_sub_ps(y, _mm256_mul_ps(xx, half));
+        __m256 logU = _mm256_add_ps(_mm256_add_ps(x, y), _mm256_mul_ps(e, _mm256_set1_ps(LogQ2)));
+        __m256 radius = _mm256_mul_ps(_mm256_sqrt_ps(_mm256_mul_ps(logU, _mm256_set1_ps(-2.0f))),
+                                      _mm256_set1_ps(parameters.StandardDeviation));
+
+        __m256i quadrant = _mm256_srli_epi32(bits1, 30);
+        __m256 offset = _mm256_cvtepi32_ps(_mm256_and_si256(_mm256_srli_epi32(bits1, 7), _mm256_set1_epi32(0x7FFFFF)));
+        __m256 phi = _mm256_mul_ps(_mm256_sub_ps(_mm256_mul_ps(offset, scale), half), _mm256_set1_ps(PiOver2));
+        __m256 phi2 = _mm256_mul_ps(phi, phi);
+        __m256 sinPhi = _mm256_set1_ps(SinP[0]);
+        sinPhi = _mm256_add_ps(_mm256_mul_ps(sinPhi, phi2), _mm256_set1_ps(SinP[1]));
+        sinPhi = _mm256_add_ps(_mm256_mul_ps(sinPhi, phi2), _mm256_set1_ps(SinP[2]));
+        sinPhi = _mm256_add_ps(_mm256_mul_ps(_mm256_mul_ps(sinPhi, phi2), phi), phi);
+        __m256 cosPhi = _mm256_set1_ps(CosP[0]);
+        cosPhi = _mm256_add_ps(_mm256_mul_ps(cosPhi, phi2), _mm256_set1_ps(CosP[1]));
+        cosPhi = _mm256_add_ps(_mm256_mul_ps(cosPhi, phi2), _mm256_set1_ps(CosP[2]));
+        cosPhi = _mm256_add_ps(
+            _mm256_sub_ps(_mm256_mul_ps(_mm256_mul_ps(cosPhi, phi2), phi2), _mm256_mul_ps(phi2, half)),
+            _mm256_set1_ps(1.0f));
+
+        __m256 swap = _mm256_castsi256_ps(_mm256_cmpeq_epi32(_mm256_and_si256(quadrant, one), one));
+        __m256 cosTheta = _mm256_blendv_ps(cosPhi, sinPhi, swap);
+        __m256 sinTheta = _mm256_blendv_ps(sinPhi, cosPhi, swap);
+        __m256i cosSign =
+            _mm256_slli_epi32(_mm256_and_si256(_mm256_xor_si256(quadrant, _mm256_srli_epi32(quadrant, 1)), one), 31);
+        __m256i sinSign = _mm256_slli_epi32(_mm256_srli_epi32(quadrant, 1), 31);
+        cosTheta = _mm256_xor_ps(cosTheta, _mm256_castsi256_ps(cosSign));
+        sinTheta = _mm256_xor_ps(sinTheta, _mm256_castsi256_ps(sinSign));
+        z0 = _mm256_add_ps(_mm256_mul_ps(radius, cosTheta), _mm256_set1_ps(parameters.Mean));
+        z1 = _mm256_add_ps(_mm256_mul_ps(radius, sinTheta), _mm256_set1_ps(parameters.Mean));
+    }
+
+    RELU_KERNELS_TARGET_AVX2 inline void GenerateNoiseAvx2(uint64_t firstBlock, PhiloxKey key, size_t numGroups,
+                                                           NoiseParameters parameters, float* noise)
+    {
+        const __m256i lanes = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+        for (size_t group = 0; group < numGroups; ++group)
+        {
+            uint64_t block = firstBlock + group * BlocksPerGroup;
+            float* groupNoise = noise + group * GroupSize;
+            for (uint32_t lane = 0; lane < BlocksPerGroup; lane += 8)
+            {
+                __m256i counter[4] = {
+                    _mm256_add_epi32(_mm256_set1_epi32(static_cast<int>(static_cast<uint32_t>(block) + lane)), lanes),
+                    _mm256_set1_epi32(static_cast<int>(block >> 32)), _mm256_setzero_si256(), _mm256_setzero_si256()
+                };
+                PhiloxAvx2(counter, key);
+                __m256 z0, z1, z2, z3;
+                BoxMullerAvx2(counter[0], counter[1], parameters, z0, z1);
+                BoxMullerAvx2(counter[2], counter[3], parameters, z2, z3);
+                _mm256_storeu_ps(groupNoise + lane, z0);
+                _mm256_storeu_ps(groupNoise + 16 + lane, z1);
+                _mm256_storeu_ps(groupNoise + 32 + lane, z2);
+                _mm256_storeu_ps(groupNoise + 48 + lane, z3);
+            }
+        }
+    }
+
+    RELU_KERNELS_TARGET_AVX2 inline size_t AddNoiseReluAvx2(const float* input, const float* noise, float* output,
+                                                            size_t count)
+    {
+        const __m256 zero = _mm256_setzero_ps();
+        size_t i = 0;
+        for (; i + 8 <= count; i += 8)
+        {
+            __m256 values = _mm256_add_ps(_mm256_loadu_ps(input + i), _mm256_loadu_ps(noise + i));
+            _mm256_storeu_ps(output + i, _mm256_max_ps(values, zero));
+        }
+        return i;
+    }
+
+    RELU_KERNELS_TARGET_AVX2 inline size_t AddNoiseReluAvx2(const double* input, const float* noise, double* output,
+                                                            size_t count)
+    {
+        const __m256d zero = _mm256_setzero_pd();
+        size_t i = 0;
+        for (; i + 4 <= count; i += 4)
+        {
+            __m256d values = _mm256_add_pd(_mm256_loadu_pd(input + i), _mm256_cvtps_pd(_mm_loadu_ps(noise + i)));
+            _mm256_storeu_pd(output + i, _mm256_max_pd(values, zero));
+        }
+        return i;
+    }
+
+    RELU_KERNELS_TARGET_AVX2 inline size_t AddNoiseReluAvx2(const Float16* input, const float* noise, Float16* output,
+                                                            size_t count)
+    {
+        const __m256 zero = _mm256_setzero_ps();
+        size_t i = 0;
+        for (; i + 8 <= count; i += 8)
+        {
+            __m256 values = _mm256_cvtph_ps(_mm_loadu_si128(reinterpret_cast<const __m128i*>(input + i)));
+            values = _mm256_max_ps(_mm256_add_ps(values, _mm256_loadu_ps(noise + i)), zero);
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(output + i),
+                             _mm256_cvtps_ph(values, _MM_FROUND_TO_NEAREST_INT));
+        }
+        return i;
+    }
+
+    RELU_KERNELS_TARGET_AVX512 inline void MultiplyAvx512(__m512i a, __m512i multiplier, __m512i& high, __m512i& low)
+    {
+        const __m512i low32 = _mm512_set1_epi64(0xFFFFFFFF);
+        __m512i even = _mm512_mul_epu32(a, multiplier);
+        __m512i odd = _mm512_mul_epu32(_mm512_srli_epi64(a, 32), multiplier);
+        low = _mm512_or_si512(_mm512_and_si512(even, low32), _mm512_slli_epi64(odd, 32));
+        high = _mm512_or_si512(_mm512_srli_epi64(even, 32), _mm512_andnot_si512(low32, odd));
+    }
+
+    RELU_KERNELS_TARGET_AVX512 inline void PhiloxAvx512(__m512i counter[4], PhiloxKey key)
+    {
+        const __m512i m0 = _mm512_set1_epi32(static_cast<int>(PhiloxM0));
+        const __m512i m1 = _mm512_set1_epi32(static_cast<int>(PhiloxM1));
+        uint32_t k0 = key.K0;
+        uint32_t k1 = key.K1;
+        for (int round = 0; round < PhiloxRounds; ++round)
+        {
+            __m512i high0, low0, high1, low1;
+            MultiplyAvx512(counter[0], m0, high0, low0);
+            MultiplyAvx512(counter[2], m1, high1, low1);
+            counter[0] = _mm512_xor_si512(_mm512_xor_si512(high1, counter[1]), _mm512_set1_epi32(static_cast<int>(k0)));
+            counter[1] = low1;
+            counter[2] = _mm512_xor_si512(_mm512_xor_si512(high0, counter[3]), _mm512_set1_epi32(static_cast<int>(k1)));
+            counter[3] = low0;
+            k0 += PhiloxW0;
+            k1 += PhiloxW1;
+        }
+    }
+
+    // AVX-512F has no float logic instructions (those are AVX-512DQ), so masks and signs are applied with integer ones.
+    RELU_KERNELS_TARGET_AVX512 inline void BoxMullerAvx512(__m512i bits0, __m512i bits1, NoiseParameters parameters,
+                                                           __m512& z0, __m512& z1)
+    {
+        const __m512i one = _mm512_set1_epi32(1);
+        const __m512 scale = _mm512_set1_ps(Exp2Minus23);
+        const __m512 half = _mm512_set1_ps(0.5f);
+
+        __m512 u = _mm512_mul_ps(_mm512_cvtepi32_ps(_mm512_add_epi32(_mm512_srli_epi32(bits0, 9), one)), scale);
+        __m512i uBits = _mm512_castps_si512(u);
+        __m512i exponent = _mm512_sub_epi32(_mm512_srli_epi32(uBits, 23), _mm512_set1_epi32(126));
+        __m512 m = _mm512_castsi512_ps(
+            _mm512_or_si512(_mm512_and_si512(uBits, _mm512_set1_epi32(0x007FFFFF)), _mm512_set1_epi32(0x3F000000)));
+        __mmask16 small = _mm512_cmp_ps_mask(m, _mm512_set1_ps(SqrtHalf), _CMP_LT_OQ);
+        exponent = _mm512_mask_sub_epi32(exponent, small, exponent, one);
+        __m512 x = _mm512_add_ps(_mm512_sub_ps(m, _mm512_set1_ps(1.0f)), _mm512_maskz_mov_ps(small, m));
+        __m512 e = _mm512_cvtepi32_ps(exponent);
+        __m512 xx = _mm512_mul_ps(x, x);
+        __m512 y = _mm512_set1_ps(LogP[0]);
+        for (int i = 1; i < 9; ++i)
+        {
+            y = _mm512_add_ps(_mm512_mul_ps(y, x), _mm512_set1_ps(LogP[i]));
+        }
+        y = _mm512_mul_ps(_mm512_mul_ps(y, x), xx);
+        y = _mm512_add_ps(y, _mm512_mul_ps(e, _mm512_set1_ps(LogQ1)));
+        y = _mm512_sub_ps(y, _mm512_mul_ps(xx, half));
+        __m512 logU = _mm512_add_ps(_mm512_add_ps(x, y), _mm512_mul_ps(e, _mm512_set1_ps(LogQ2)));
+        __m512 radius = _mm512_mul_ps(_mm512_sqrt_ps(_mm512_mul_ps(logU, _mm512_set1_ps(-2.0f))),
+                                      _mm512_set1_ps(parameters.StandardDeviation));
+
+        __m512i quadrant = _mm512_srli_epi32(bits1, 30);
+        __m512 offset = _mm512_cvtepi32_ps(_mm512_and_si512(_mm512_srli_epi32(bits1, 7), _mm512_set1_epi32(0x7FFFFF)));
+        __m512 phi = _mm512_mul_ps(_mm512_sub_ps(_mm512_mul_ps(offset, scale), half), _mm512_set1_ps(PiOver2));
+        __m512 phi2 = _mm512_mul_ps(phi, phi);
+        __m512 sinPhi = _mm512_set1_ps(SinP[0]);
+        sinPhi = _mm512_add_ps(_mm512_mul_ps(sinPhi, phi2), _mm512_set1_ps(SinP[1]));
+        sinPhi = _mm512_add_ps(_mm512_mul_ps(sinPhi, phi2), _mm512_set1_ps(SinP[2]));
+        sinPhi = _mm512_add_ps(_mm512_mul_ps(_mm512_mul_ps(sinPhi, phi2), phi), phi);
+        __m512 cosPhi = _mm512_set1_ps(CosP[0]);
+        cosPhi = _mm512_add_ps(_mm512_mul_ps(cosPhi, phi2), _mm512_set1_ps(CosP[1]));
+        cosPhi = _mm512_add_ps(_mm512_mul_ps(cosPhi, phi2), _mm512_set1_ps(CosP[2]));
+        cosPhi = _mm512_add_ps(
+            _mm512_sub_ps(_mm512_mul_ps(_mm512_mul_ps(cosPhi, phi2), phi2), _mm512_mul_ps(phi2, half)),
+            _mm512_set1_ps(1.0f));
+
+        __mmask16 swap = _mm512_test_epi32_mask(quadrant, one);
+        __m512i cosTheta = _mm512_castps_si512(_mm512_mask_blend_ps(swap, cosPhi, sinPhi));
+        __m512i sinTheta = _mm512_castps_si512(_mm512_mask_blend_ps(swap, sinPhi, cosPhi));
+        __m512i cosSign =
+            _mm512_slli_epi32(_mm512_and_si512(_mm512_xor_si512(quadrant, _mm512_srli_epi32(quadrant, 1)), one), 31);
+        __m512i sinSign = _mm512_slli_epi32(_mm512_srli_epi32(quadrant, 1), 31);
+        __m512 cosSigned = _mm512_castsi512_ps(_mm512_xor_si512(cosTheta, cosSign));
+        __m512 sinSigned = _mm512_castsi512_ps(_mm512_xor_si512(sinTheta, sinSign));
+        z0 = _mm512_add_ps(_mm512_mul_ps(radius, cosSigned), _mm512_set1_ps(parameters.Mean));
+        z1 = _mm512_add_ps(_mm512_mul_ps(radius, sinSigned), _mm512_set1_ps(parameters.Mean));
+    }
+
+    // One group per iteration, with the 16 blocks of the group in the 16 lanes.
+    RELU_KERNELS_TARGET_AVX512 inline void GenerateNoiseAvx512(uint64_t firstBlock, PhiloxKey key, size_t numGroups,
+                                                               NoiseParameters parameters, float* noise)
+    {
+        const __m512i lanes = _mm512_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15);
+        for (size_t group = 0; group < numGroups; ++group)
+        {
+            uint64_t block = firstBlock + group * BlocksPerGroup;
+            float* groupNoise = noise + group * GroupSize;
+            __m512i counter[4] = {
+                _mm512_add_epi32(_mm512_set1_epi32(static_cast<int>(block)), lanes),
+                _mm512_set1_epi32(static_cast<int>(block >> 32)), _mm512_setzero_si512(), _mm512_setzero_si512()
+            };
+            PhiloxAvx512(counter, key);
+            __m512 z0, z1, z2, z3;
+            BoxMullerAvx512(counter[0], counter[1], parameters, z0, z1);
+            BoxMullerAvx512(counter[2], counter[3], parameters, z2, z3);
+            _mm512_storeu_ps(groupNoise, z0);
+            _mm512_storeu_ps(groupNoise + 16, z1);
+            _mm512_storeu_ps(groupNoise + 32, z2);
+            _mm512_storeu_ps(groupNoise + 48, z3);
+        }
+    }
+
+    RELU_KERNELS_TARGET_AVX512 inline size_t AddNoiseReluAvx512(const float* input, const float* noise, float* output,
+                                                                size_t count)
+    {
+        const __m512 zero = _mm512_setzero_ps();
+        size_t i = 0;
+        for (; i + 16 <= count; i += 16)
+        {
+            __m512 values = _mm512_add_ps(_mm512_loadu_ps(input + i), _mm512_loadu_ps(noise + i));
+            _mm512_storeu_ps(output + i, _mm512_max_ps(values, zero));
+        }
+        return i;
+    }
+
+    RELU_KERNELS_TARGET_AVX512 inline size_t AddNoiseReluAvx512(const double* input, const float* noise,
+                                                                double* output, size_t count)
+    {
+        const __m512d zero = _mm512_setzero_pd();
+        size_t i = 0;
+        for (; i + 8 <= count; i += 8)
+        {
+            __m512d values = _mm512_add_pd(_mm512_loadu_pd(input + i), _mm512_cvtps_pd(_mm256_loadu_ps(noise + i)));
+            _mm512_storeu_pd(output + i, _mm512_max_pd(values, zero));
+        }
+        return i;
+    }
+#endif
+
+#if defined(RELU_KERNELS_NEON)
+    inline void MultiplyNeon(uint32x4_t a, uint32_t multiplier, uint32x4_t& high, uint32x4_t& low)
+    {
+        uint64x2_t productLow = vmull_u32(vget_low_u32(a), vdup_n_u32(multiplier));
+        uint64x2_t productHigh = vmull_u32(vget_high_u32(a), vdup_n_u32(multiplier));
+        low = vmulq_u32(a, vdupq_n_u32(multiplier));
+        high = vcombine_u32(vshrn_n_u64(productLow, 32), vshrn_n_u64(productHigh, 32));
+    }
+
+    inline void PhiloxNeon(uint32x4_t counter[4], PhiloxKey key)
+    {
+        uint32_t k0 = key.K0;
+        uint32_t k1 = key.K1;
+        for (int round = 0; round < PhiloxRounds; ++round)
+        {
+            uint32x4_t high0, low0, high1, low1;
+            MultiplyNeon(counter[0], PhiloxM0, high0, low0);
+            MultiplyNeon(counter[2], PhiloxM1, high1, low1);
+            counter[0] = veorq_u32(veorq_u32(high1, counter[1]), vdupq_n_u32(k0));
+            counter[1] = low1;
+            counter[2] = veorq_u32(veorq_u32(high0, counter[3]), vdupq_n_u32(k1));
+            counter[3] = low0;
+            k0 += PhiloxW0;
+            k1 += PhiloxW1;
+        }
+    }
+
+    inline void BoxMullerNeon(uint32x4_t bits0, uint32x4_t bits1, NoiseParameters parameters, float32x4_t& z0,
+                              float32x4_t& z1)
+    {
+        const uint32x4_t one = vdupq_n_u32(1);
+        const float32x4_t scale = vdupq_n_f32(Exp2Minus23);
+        const float32x4_t half = vdupq_n_f32(0.5f);
+
+        float32x4_t u = vmulq_f32(vcvtq_f32_u32(vaddq_u32(vshrq_n_u32(bits0, 9), one)), scale);
+        uint32x4_t uBits = vreinterpretq_u32_f32(u);
+        int32x4_t exponent = vsubq_s32(vreinterpretq_s32_u32(vshrq_n_u32(uBits, 23)), vdupq_n_s32(126));
+        float32x4_t m = vreinterpretq_f32_u32(
+            vorrq_u32(vandq_u32(uBits, vdupq_n_u32(0x007FFFFF)), vdupq_n_u32(0x3F000000)));
+        uint32x4_t small = vcltq_f32(m, vdupq_n_f32(SqrtHalf));
+        exponent = vaddq_s32(exponent, vreinterpretq_s32_u32(small));
+        float32x4_t x = vaddq_f32(vsubq_f32(m, vdupq_n_f32(1.0f)),
+                                  vreinterpretq_f32_u32(vandq_u32(small, vreinterpretq_u32_f32(m))));
+        float32x4_t e = vcvtq_f32_s32(exponent);
+        float32x4_t xx = vmulq_f32(x, x);
+        float32x4_t y = vdupq_n_f32(LogP[0]);
+        for (int i = 1; i < 9; ++i)
+        {
+            y = vaddq_f32(vmulq_f32(y, x), vdupq_n_f32(LogP[i]));
+        }
+        y = vmulq_f32(vmulq_f32(y, x), xx);
+        y = vaddq_f32(y, vmulq_f32(e, vdupq_n_f32(LogQ1)));
+        y = vsubq_f32(y, vmulq_f32(xx, half));
+        float32x4_t logU = vaddq_f32(vaddq_f32(x, y), vmulq_f32(e, vdupq_n_f32(LogQ2)));
+        float32x4_t radius =
+            vmulq_f32(vsqrtq_f32(vmulq_f32(logU, vdupq_n_f32(-2.0f))), vdupq_n_f32(parameters.StandardDeviation));
+
+        uint32x4_t quadrant = vshrq_n_u32(bits1, 30);
+        float32x4_t offset = vcvtq_f32_u32(vandq_u32(vshrq_n_u32(bits1, 7), vdupq_n_u32(0x7FFFFF)));
+        float32x4_t phi = vmulq_f32(vsubq_f32(vmulq_f32(offset, scale), half), vdupq_n_f32(PiOver2));
+        float32x4_t phi2 = vmulq_f32(phi, phi);
+        float32x4_t sinPhi = vdupq_n_f32(SinP[0]);
+        sinPhi = vaddq_f32(vmulq_f32(sinPhi, phi2), vdupq_n_f32(SinP[1]));
+        sinPhi = vaddq_f32(vmulq_f32(sinPhi, phi2), vdupq_n_f32(SinP[2]));
+        sinPhi = vaddq_f32(vmulq_f32(vmulq_f32(sinPhi, phi2), phi), phi);
+        float32x4_t cosPhi = vdupq_n_f32(CosP[0]);
+        cosPhi = vaddq_f32(vmulq_f32(cosPhi, phi2), vdupq_n_f32(CosP[1]));
+        cosPhi = vaddq_f32(vmulq_f32(cosPhi, phi2), vdupq_n_f32(CosP[2]));
+        cosPhi = vaddq_f32(vsubq_f32(vmulq_f32(vmulq_f32(cosPhi, phi2), phi2), vmulq_f32(phi2, half)),
+                           vdupq_n_f32(1.0f));
+
+        uint32x4_t swap = vtstq_u32(quadrant, one);
+        uint32x4_t cosTheta = vreinterpretq_u32_f32(vbslq_f32(swap, sinPhi, cosPhi));
+        uint32x4_t sinTheta = vreinterpretq_u32_f32(vbslq_f32(swap, cosPhi, sinPhi));
+        uint32x4_t cosSign = vshlq_n_u32(vandq_u32(veorq_u32(quadrant, vshrq_n_u32(quadrant, 1)), one), 31);
+        uint32x4_t sinSign = vshlq_n_u32(vshrq_n_u32(quadrant, 1), 31);
+        float32x4_t cosSigned = vreinterpretq_f32_u32(veorq_u32(cosTheta, cosSign));
+        float32x4_t sinSigned = vreinterpretq_f32_u32(veorq_u32(sinTheta, sinSign));
+        z0 = vaddq_f32(vmulq_f32(radius, cosSigned), vdupq_n_f32(parameters.Mean));
+        z1 = vaddq_f32(vmulq_f32(radius, sinSigned), vdupq_n_f32(parameters.Mean));
+    }
+
+    inline void GenerateNoiseNeon(uint64_t firstBlock, PhiloxKey key, size_t numGroups, NoiseParameters parameters,
+                                  float* noise)
+    {
+        const uint32_t laneOffsets[4] = { 0, 1, 2, 3 };
+        const uint32x4_t lanes = vld1q_u32(laneOffsets);
+        for (size_t group = 0; group < numGroups; ++group)
+        {
+            uint64_t block = firstBlock + group * BlocksPerGroup;
+            float* groupNoise = noise + group * GroupSize;
+            for (uint32_t lane = 0; lane < BlocksPerGroup; lane += 4)
+            {
+                uint32x4_t counter[4] = { vaddq_u32(vdupq_n_u32(static_cast<uint32_t>(block) + lane), lanes),
+                                          vdupq_n_u32(static_cast<uint32_t>(block >> 32)), vdupq_n_u32(0),
+                                          vdupq_n_u32(0) };
+                PhiloxNeon(counter, key);
+                float32x4_t z0, z1, z2, z3;
+                BoxMullerNeon(counter[0], counter[1], parameters, z0, z1);
+                BoxMullerNeon(counter[2], counter[3], parameters, z2, z3);
+                vst1q_f32(groupNoise + lane, z0);
+                vst1q_f32(groupNoise + 16 + lane, z1);
+                vst1q_f32(groupNoise + 32 + lane, z2);
+                vst1q_f32(groupNoise + 48 + lane, z3);
+            }
+        }
+    }
+
+    inline size_t AddNoiseReluNeon(const float* input, const float* noise, float* output, size_t count)
+    {
+        const float32x4_t zero = vdupq_n_f32(0);
+        size_t i = 0;
+        for (; i + 4 <= count; i += 4)
+        {
+            float32x4_t values = vaddq_f32(vld1q_f32(input + i), vld1q_f32(noise + i));
+            uint32x4_t kept = vandq_u32(vcgtq_f32(values, zero), vreinterpretq_u32_f32(values));
+            vst1q_f32(output + i, vreinterpretq_f32_u32(kept));
+        }
+        return i;
+    }
+
+    inline size_t AddNoiseReluNeon(const double* input, const float* noise, double* output, size_t count)
+    {
+        const float64x2_t zero = vdupq_n_f64(0);
+        size_t i = 0;
+        for (; i + 2 <= count; i += 2)
+        {
+            float64x2_t values = vaddq_f64(vld1q_f64(input + i), vcvt_f64_f32(vld1_f32(noise + i)));
+            uint64x2_t kept = vandq_u64(vcgtq_f64(values, zero), vreinterpretq_u64_f64(values));
+            vst1q_f64(output + i, vreinterpretq_f64_u64(kept));
+        }
+        return i;
+    }
+
+#if defined(__GNUC__) || defined(__clang__)
+    inline size_t AddNoiseReluNeon(const Float16* input, const float* noise, Float16* output, size_t count)
+    {
+        const float32x4_t zero = vdupq_n_f32(0);
+        size_t i = 0;
+        for (; i + 4 <= count; i += 4)
+        {
+            float32x4_t values = vcvt_f32_f16(vreinterpret_f16_u16(vld1_u16(&input[i].Bits)));
+            values = vaddq_f32(values, vld1q_f32(noise + i));
+            uint32x4_t kept = vandq_u32(vcgtq_f32(values, zero), vreinterpretq_u32_f32(values));
+            vst1_u16(&output[i].Bits, vreinterpret_u16_f16(vcvt_f16_f32(vreinterpretq_f32_u32(kept))));
+        }
+        return i;
+    }
+#else
+    inline size_t AddNoiseReluNeon(const Float16*, const float*, Float16*, size_t) { return 0; }
+#endif
+#endif
+
+    inline void GenerateNoise(uint64_t firstBlock, PhiloxKey key, size_t numGroups, NoiseParameters parameters,
+                              float* noise, SimdLevel level)
+    {
+        switch (level)
+        {
+#if defined(RELU_KERNELS_X64)
+            case SimdLevel::AVX512:
+                GenerateNoiseAvx512(firstBlock, key, numGroups, parameters, noise);
+                break;
+            case SimdLevel::AVX2:
+                GenerateNoiseAvx2(firstBlock, key, numGroups, parameters, noise);
+                break;
+            case SimdLevel::SSE2:
+                GenerateNoiseSse2(firstBlock, key, numGroups, parameters, noise);
+                break;
+#elif defined(RELU_KERNELS_NEON)
+            case SimdLevel::NEON:
+                GenerateNoiseNeon(firstBlock, key, numGroups, parameters, noise);
+                break;
+#endif
+            default:
+                GenerateNoiseScalar(firstBlock, key, numGroups, parameters, noise);
+                break;
+        }
+    }
+
+    template <typename T>
+    inline void AddNoiseReluKernel(const T* input, const float* noise, T* output, size_t count, SimdLevel level)
+    {
+        size_t done = 0;
+        switch (level)
+        {
+#if defined(RELU_KERNELS_X64)
+            case SimdLevel::AVX512:
+                if constexpr (std::is_same<T, Float16>::value)
+                {
+                    done = AddNoiseReluAvx2(input, noise, output, count); // F16C converts 8 halves at a time
+                }
+                else
+                {
+                    done = AddNoiseReluAvx512(input, noise, output, count);
+                }
+                break;
+            case SimdLevel::AVX2:
+                done = AddNoiseReluAvx2(input, noise, output, count);
+                break;
+            case SimdLevel::SSE2:
+                done = AddNoiseReluSse2(input, noise, output, count);
+                break;
+#elif defined(RELU_KERNELS_NEON)
+            case SimdLevel::NEON:
+                done = AddNoiseReluNeon(input, noise, output, count);
+                break;
+#endif
+            default:
+                break;
+        }
+        AddNoiseReluScalar(input + done, noise + done, output + done, count - done);
+    }
+
+    // Random seed for the key of a NoiseStream.
+    inline uint64_t GenerateSeed()
+    {
+        std::random_device device;
+        return (static_cast<uint64_t>(device()) << 32) | device();
+    }
+
+    // Philox key and counter of one NoisyRelu kernel instance. Every call takes its own range of counters, so calls
+    // that run at the same time on one instance get different noise without sharing any generator state.
+    class NoiseStream
+    {
+    public:
+        explicit NoiseStream(uint64_t seed)
+            : m_key{ static_cast<uint32_t>(seed), static_cast<uint32_t>(seed >> 32) }, m_nextBlock(0)
+        {
+        }
+
+        PhiloxKey GetKey() const { return m_key; }
+
+        // Reserves the blocks for count elements and returns the first one, always a multiple of BlocksPerGroup.
+        uint64_t Reserve(size_t count) { return m_nextBlock.fetch_add(GetGroupCount(count) * BlocksPerGroup); }
+
+    private:
+        PhiloxKey m_key;
+        std::atomic<uint64_t> m_nextBlock;
+    };
+
+    // Noise values generated at once, a multiple of GroupSize that fits on the stack and in the L1 cache.
+    const size_t NoiseChunkSize = 1024;
+
+    // output = max(0, input + noise) for a float, double or Float16 tensor, where the noise is normally distributed
+    // with the given mean and standard deviation and comes from the next counters of stream. Large tensors are split
+    // across the threads of pool. Input and output may be the same buffer.
+    template <typename T>
+    inline void NoisyRelu(const T* input, T* output, size_t count, NoiseStream& stream, NoiseParameters parameters,
+                          KernelThreadPool* pool = nullptr, SimdLevel level = GetSimdLevel())
+    {
+        uint64_t firstBlock = stream.Reserve(count);
+        PhiloxKey key = stream.GetKey();
+        ForEachRange(count, pool, [=](size_t begin, size_t end) {
+            alignas(64) float noise[NoiseChunkSize];
+            for (size_t chunk = begin; chunk < end; chunk += NoiseChunkSize)
+            {
+                size_t chunkCount = (std::min)(NoiseChunkSize, end - chunk);
+                GenerateNoise(firstBlock + chunk / GroupSize * BlocksPerGroup, key, GetGroupCount(chunkCount),
+                              parameters, noise, level);
+                AddNoiseReluKernel(input + chunk, noise, output + chunk, chunkCount, level);
+            }
+        });
+    }
+} // namespace ReluKernels
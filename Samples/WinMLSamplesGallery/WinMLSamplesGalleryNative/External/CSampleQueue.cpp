@@ -1,26 +1,9 @@
 #include "pch.h"
 #include "CSampleQueue.h"
 
-class CSampleQueue::CNode
-{
-public:
-    IMFSample*  pSample;
-    CNode*      pNext;
-
-    CNode()
-    {
-        pSample = nullptr;
-        pNext   = nullptr;
-    }
-    ~CNode()
-    {
-        SAFE_RELEASE(pSample);
-        pNext   = nullptr;
-    }
-};
-
 HRESULT CSampleQueue::Create(
-    CSampleQueue**   ppQueue)
+    ULONG           capacity,
+    CSampleQueue**  ppQueue)
 {
     HRESULT         hr          = S_OK;
     CSampleQueue*   pNewQueue   = nullptr;
@@ -33,7 +16,7 @@ HRESULT CSampleQueue::Create(
             break;
         }
 
-        pNewQueue = new CSampleQueue();
+        pNewQueue = new CSampleQueue(capacity);
         if(pNewQueue == nullptr)
         {
             hr = E_OUTOFMEMORY;
@@ -106,8 +89,6 @@ HRESULT CSampleQueue::AddSample(
     IMFSample*  pSample)
 {
     HRESULT hr          = S_OK;
-    CNode*  pNewNode    = nullptr;
-
 
     do
     {
@@ -117,56 +98,35 @@ HRESULT CSampleQueue::AddSample(
             break;
         }
 
-        pNewNode = new CNode();
-        if(pNewNode == nullptr)
-        {
-            hr = E_OUTOFMEMORY;
-            break;
-        }
-
-        pNewNode->pSample           = pSample;
-        pNewNode->pSample->AddRef();
-        pNewNode->pNext             = nullptr;
-        InterlockedIncrement(&m_length);
-
+        // Whoever takes the marker sets it on its sample, so a marker set by
+        // MarkerNextSample lands on exactly one sample
+        ULONG_PTR pulMarkerID = m_pulMarkerID.exchange(0);
+        if(pulMarkerID != 0)
         {
-            std::lock_guard<std::recursive_mutex> lock(m_mutex);
-
-            if(m_bAddMarker != false)
+            hr = pSample->SetUINT64(TransformAsync_MFSampleExtension_Marker, pulMarkerID);
+            if(FAILED(hr))
             {
-                hr = pSample->SetUINT64(TransformAsync_MFSampleExtension_Marker, m_pulMarkerID);
-                if(FAILED(hr))
-                {
-                    break;
-                }
-
-                m_pulMarkerID   = 0;
-                m_bAddMarker    = false;
+                break;
             }
+        }
 
-            if(IsQueueEmpty() != false)
-            {
-                // This is the first sample in the queue
-                m_pHead     = pNewNode;
-                m_pTail     = pNewNode;
-
-            }
-            else
+        pSample->AddRef();
+        if(m_samples.TryPush(pSample) == false)
+        {
+            // Full, the caller has to slow down. Keep the marker for the next
+            // sample that gets in.
+            pSample->Release();
+            if(pulMarkerID != 0)
             {
-                m_pTail->pNext  = pNewNode;
-                m_pTail         = pNewNode;
-
+                pSample->DeleteItem(TransformAsync_MFSampleExtension_Marker);
+                ULONG_PTR pulNoMarker = 0;
+                m_pulMarkerID.compare_exchange_strong(pulNoMarker, pulMarkerID);
             }
-
+            hr = MF_E_NOTACCEPTING;
+            break;
         }
     }while(false);
 
-    if(FAILED(hr))
-    {
-        SAFE_DELETE(pNewNode);
-    }
-
-
     return hr;
 }
  
@@ -174,7 +134,6 @@ HRESULT CSampleQueue::GetNextSample(
     IMFSample** ppSample)
 {
     HRESULT hr              = S_OK;
-    CNode*  pCurrentNode    = nullptr;
 
     do
     {
@@ -185,61 +144,27 @@ HRESULT CSampleQueue::GetNextSample(
         }
 
         *ppSample   = nullptr;
-        InterlockedDecrement(&m_length);
 
+        // The reference the queue held now belongs to the caller
+        if(m_samples.TryPop(*ppSample) == false)
         {
-            std::lock_guard<std::recursive_mutex> lock(m_mutex);
-
-            if(IsQueueEmpty() != false)
-            {
-                // The queue is empty
-                hr = S_FALSE;
-                break;
-            }
-            
-            pCurrentNode = m_pHead;
-
-            (*ppSample) = pCurrentNode->pSample;
-            (*ppSample)->AddRef();
-
-            // Now remove the node from the list
-
-            m_pHead = m_pHead->pNext;
-
-
-            if(m_pHead == nullptr)
-            {
-                // This was the last sample in the queue
-                m_pTail = nullptr;
-
-            }
+            // The queue is empty
+            hr = S_FALSE;
+            break;
         }
     }while(false);
 
-    SAFE_DELETE(pCurrentNode);
-
     return hr;
 }
 
 HRESULT CSampleQueue::RemoveAllSamples()
 {
-    HRESULT hr          = S_OK;
-    CNode*  pCurrNode   = nullptr;
-    // Scope the lock
-    {
-        std::lock_guard<std::recursive_mutex> lock(m_mutex);
+    HRESULT     hr      = S_OK;
+    IMFSample*  pSample = nullptr;
 
-        while(IsQueueEmpty() == false)
-        {
-            pCurrNode = m_pHead;
-
-            m_pHead = m_pHead->pNext;
-
-            delete pCurrNode;
-        }
-
-        m_pTail = nullptr;
-        m_length = 0;
+    while(m_samples.TryPop(pSample) != false)
+    {
+        SAFE_RELEASE(pSample);
     }
 
     return hr;
@@ -249,41 +174,35 @@ HRESULT CSampleQueue::MarkerNextSample(
     const ULONG_PTR pulID)
 {
     HRESULT hr = S_OK;
-    // Scope the lock
-    {
-        std::lock_guard<std::recursive_mutex> lock(m_mutex);
 
-        m_pulMarkerID   = pulID;
-        m_bAddMarker    = true;
-    }
+    m_pulMarkerID = pulID;
 
     return hr;
 }
 
 bool CSampleQueue::IsQueueEmpty()
 {
-    std::lock_guard<std::recursive_mutex> lock(m_mutex);
-
-    return (m_pHead == nullptr) ? true : false;
+    return m_samples.IsEmpty();
 }
 
 ULONG CSampleQueue::GetLength()
 {
-    return m_length;
+    return static_cast<ULONG>(m_samples.Size());
 }
 
-CSampleQueue::CSampleQueue()
+SampleQueue::QueueStatistics CSampleQueue::GetStatistics()
+{
+    return m_samples.GetStatistics();
+}
+
+CSampleQueue::CSampleQueue(ULONG capacity) :
+    m_samples(capacity)
 {
     m_ulRef         = 1;
-    m_pHead         = nullptr;
-    m_pTail         = nullptr;
-    m_bAddMarker    = false;
     m_pulMarkerID   = 0;
-
 }
 
 CSampleQueue::~CSampleQueue()
 {
     RemoveAllSamples();
-    //m_critSec.~CritSec();
-}
\ No newline at end of file
+}
@@ -3,7 +3,7 @@
 #include <windows.h>
 #include <Mfidl.h>
 #include "common.h"
-#include <mutex> 
+#include "MpmcRingQueue.h"
 
 using namespace MediaFoundationSamples;
 
@@ -12,7 +12,12 @@ class CSampleQueue: public IUnknown
 public:
     class   ILockedSample;
 
-    static  HRESULT Create(CSampleQueue**   ppQueue);
+    // Holds up to capacity samples (rounded up to a power of two); AddSample
+    // returns MF_E_NOTACCEPTING once the queue is full.
+    static  HRESULT Create(
+                    ULONG           capacity,
+                    CSampleQueue**  ppQueue
+                    );
 
 #pragma region IUnknown
     // IUnknown Implementations
@@ -25,10 +30,10 @@ public:
 #pragma endregion IUnknown
 
     // ILockedSampleCallback Implementation     
-    HRESULT AddSample(                      // Add a sample to the back of the queue
+    HRESULT AddSample(                      // Add a sample to the back of the queue, MF_E_NOTACCEPTING when full
                     IMFSample*  pSample
                     );
-    HRESULT GetNextSample(                  // Remove a sample from the front of the queue
+    HRESULT GetNextSample(                  // Remove a sample from the front of the queue, S_FALSE when empty
                     IMFSample** pSample
                     );
     HRESULT RemoveAllSamples();
@@ -36,19 +41,17 @@ public:
     bool    IsQueueEmpty();
 
     ULONG GetLength();
+    SampleQueue::QueueStatistics GetStatistics();
 protected:
-    class CNode;
-
-    CSampleQueue();
+    CSampleQueue(ULONG capacity);
     ~CSampleQueue();
 
-    volatile    ULONG               m_ulRef;
-                CNode*              m_pHead;
-                CNode*              m_pTail;
-                bool                m_bAddMarker;
-                ULONG_PTR           m_pulMarkerID;
-                std::recursive_mutex    m_mutex;
-                ULONG               m_length;
+    // Lock free, so the evaluation workers never wait on each other or
+    // allocate to hand a sample over. The queue holds a reference to
+    // every sample in it.
+    volatile    ULONG                                   m_ulRef;
+                SampleQueue::MpmcRingQueue<IMFSample*>  m_samples;
+                std::atomic<ULONG_PTR>                  m_pulMarkerID;  // 0 when no marker is pending
 
 };
 
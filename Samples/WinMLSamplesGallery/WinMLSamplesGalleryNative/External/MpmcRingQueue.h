@@ -0,0 +1,175 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <utility>
+
+// Bounded multi-producer multi-consumer queue over a ring of preallocated slots (Dmitry Vyukov's bounded MPMC queue).
+// Every slot carries a sequence number that tells producers and consumers whose turn it is, so a push or a pop is one
+// compare-and-swap on the shared position and a store to its own slot: no lock and no allocation. A full queue refuses
+// new values instead of growing, which is the back-pressure signal to the producer. Nothing in here depends on Media
+// Foundation, so the queue can be built and stress tested anywhere.
+
+#ifdef _MSC_VER
+#pragma warning(push)
+#pragma warning(disable : 4324) // structure was padded due to alignment specifier, which is the point
+#endif
+
+namespace SampleQueue
+{
+    // Big enough to keep the positions and the slots on cache lines of their own on x64 and ARM64.
+    constexpr size_t CacheLineSize = 64;
+
+    struct QueueStatistics
+    {
+        uint64_t Pushed = 0;  // values accepted since the queue was created
+        uint64_t Popped = 0;
+        uint64_t Refused = 0; // pushes that found the queue full
+    };
+
+    // T must be default constructible and move assignable. A popped slot is reset to T(), so the queue does not keep
+    // anything alive, e.g. a reference counted pointer, after it was popped.
+    template <typename T> class MpmcRingQueue
+    {
+    public:
+        // The capacity is rounded up to a power of two, at least 2.
+        explicit MpmcRingQueue(size_t capacity)
+        {
+            m_capacity = 2;
+            while (m_capacity < capacity)
+            {
+                m_capacity *= 2;
+            }
+            m_mask = m_capacity - 1;
+            m_slots.reset(new Slot[m_capacity]);
+            for (size_t i = 0; i < m_capacity; i++)
+            {
+                m_slots[i].Sequence.store(i, std::memory_order_relaxed);
+            }
+        }
+
+        MpmcRingQueue(const MpmcRingQueue&) = delete;
+        MpmcRingQueue& operator=(const MpmcRingQueue&) = delete;
+
+        // Adds a value at the back of the queue. Returns false, leaving value untouched, if the queue is full.
+        template <typename U> bool TryPush(U&& value)
+        {
+            size_t position = m_enqueuePosition.load(std::memory_order_relaxed);
+            for (;;)
+            {
+                Slot& slot = m_slots[position & m_mask];
+                size_t sequence = slot.Sequence.load(std::memory_order_acquire);
+                intptr_t difference = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(position);
+                if (difference == 0)
+                {
+                    // The slot is free for this lap; claim it, a failed claim reloads position
+                    if (m_enqueuePosition.compare_exchange_weak(position, position + 1, std::memory_order_relaxed))
+                    {
+                        slot.Value = std::forward<U>(value);
+                        slot.Sequence.store(position + 1, std::memory_order_release);
+                        return true;
+                    }
+                }
+                else if (difference < 0)
+                {
+                    // The slot still holds the value of the previous lap: every slot is taken
+                    m_refused.fetch_add(1, std::memory_order_relaxed);
+                    return false;
+                }
+                else
+                {
+                    // Another producer claimed the slot first
+                    position = m_enqueuePosition.load(std::memory_order_relaxed);
+                }
+            }
+        }
+
+        // Moves the value at the front of the queue into value. Returns false if the queue is empty.
+        bool TryPop(T& value)
+        {
+            size_t position = m_dequeuePosition.load(std::memory_order_relaxed);
+            for (;;)
+            {
+                Slot& slot = m_slots[position & m_mask];
+                size_t sequence = slot.Sequence.load(std::memory_order_acquire);
+                intptr_t difference = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(position + 1);
+                if (difference == 0)
+                {
+                    if (m_dequeuePosition.compare_exchange_weak(position, position + 1, std::memory_order_relaxed))
+                    {
+                        value = std::move(slot.Value);
+                        slot.Value = T();
+                        // Hands the slot to the producer of the next lap
+                        slot.Sequence.store(position + m_capacity, std::memory_order_release);
+                        return true;
+                    }
+                }
+                else if (difference < 0)
+                {
+                    return false;
+                }
+                else
+                {
+                    position = m_dequeuePosition.load(std::memory_order_relaxed);
+                }
+            }
+        }
+
+        // Pops every value in the queue and returns how many there were. Values pushed meanwhile may be popped too.
+        size_t Clear()
+        {
+            size_t count = 0;
+            T value;
+            while (TryPop(value))
+            {
+                value = T();
+                count++;
+            }
+            return count;
+        }
+
+        // Only a snapshot while other threads push or pop. It counts values whose push or pop has claimed a slot but
+        // not finished yet.
+        size_t Size() const
+        {
+            size_t dequeued = m_dequeuePosition.load(std::memory_order_acquire);
+            size_t enqueued = m_enqueuePosition.load(std::memory_order_acquire);
+            return enqueued > dequeued ? enqueued - dequeued : 0;
+        }
+
+        bool IsEmpty() const { return Size() == 0; }
+
+        size_t Capacity() const { return m_capacity; }
+
+        QueueStatistics GetStatistics() const
+        {
+            QueueStatistics statistics;
+            statistics.Popped = m_dequeuePosition.load(std::memory_order_relaxed);
+            statistics.Pushed = m_enqueuePosition.load(std::memory_order_relaxed);
+            statistics.Refused = m_refused.load(std::memory_order_relaxed);
+            return statistics;
+        }
+
+    private:
+        struct alignas(CacheLineSize) Slot
+        {
+            std::atomic<size_t> Sequence{ 0 };
+            T Value{};
+        };
+
+        size_t m_capacity;
+        size_t m_mask;
+        std::unique_ptr<Slot[]> m_slots;
+
+        // Producers and consumers each write their own position, so they are kept on separate cache lines
+        alignas(CacheLineSize) std::atomic<size_t> m_enqueuePosition{ 0 };
+        alignas(CacheLineSize) std::atomic<size_t> m_dequeuePosition{ 0 };
+        alignas(CacheLineSize) std::atomic<uint64_t> m_refused{ 0 };
+    };
+} // namespace SampleQueue
+
+#ifdef _MSC_VER
+#pragma warning(pop)
+#endif
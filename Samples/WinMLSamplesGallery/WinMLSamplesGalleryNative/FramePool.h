@@ -0,0 +1,260 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+// Pool of frame surfaces keyed by format and size, so that a model running frame after frame takes the same surfaces
+// back instead of creating new ones each time. A surface is leased for one frame and returns to the pool when the
+// lease ends. Allocating and releasing surfaces is up to the caller, e.g. VideoFrame::CreateAsDirect3D11SurfaceBacked,
+// so nothing in here depends on WinML or Direct3D.
+namespace FrameResources
+{
+    struct FrameKey
+    {
+        int32_t Format = 0; // e.g. a DirectXPixelFormat
+        uint32_t Width = 0;
+        uint32_t Height = 0;
+
+        bool operator==(const FrameKey& other) const
+        {
+            return Format == other.Format && Width == other.Width && Height == other.Height;
+        }
+        bool operator!=(const FrameKey& other) const { return !(*this == other); }
+    };
+
+    struct PoolOptions
+    {
+        size_t MaxFreePerKey = 2; // free surfaces kept per key, more are released when their lease ends
+        size_t MaxKeys = 2;       // keys with free surfaces, the least recently used one is released beyond that
+    };
+
+    struct PoolStatistics
+    {
+        uint64_t Allocated = 0; // surfaces created by the allocator
+        uint64_t Reused = 0;    // leases served from the pool
+        uint64_t Released = 0;  // surfaces handed to the release callback
+        size_t Free = 0;        // surfaces waiting in the pool
+        size_t Leased = 0;
+    };
+
+    // Thread safe. TSurface is a handle to a surface, e.g. a VideoFrame, and must be movable.
+    template <typename TSurface> class FramePool
+    {
+    public:
+        using Allocator = std::function<TSurface(const FrameKey& key)>;
+        using Releaser = std::function<void(TSurface& surface)>;
+
+        // A surface lent out for one frame; it goes back to the pool when the lease is destroyed.
+        class Lease
+        {
+        public:
+            Lease() = default;
+            Lease(Lease&& other) noexcept { *this = std::move(other); }
+            Lease& operator=(Lease&& other) noexcept
+            {
+                if (this != &other)
+                {
+                    Return();
+                    m_pool = std::exchange(other.m_pool, nullptr);
+                    m_key = other.m_key;
+                    m_surface = std::move(other.m_surface);
+                }
+                return *this;
+            }
+            Lease(const Lease&) = delete;
+            Lease& operator=(const Lease&) = delete;
+            ~Lease() { Return(); }
+
+            TSurface& Get() { return m_surface; }
+            const FrameKey& Key() const { return m_key; }
+            explicit operator bool() const { return m_pool != nullptr; }
+
+            // Gives the surface back before the lease is destroyed.
+            void Return()
+            {
+                if (m_pool != nullptr)
+                {
+                    std::exchange(m_pool, nullptr)->Put(m_key, std::move(m_surface));
+                }
+            }
+
+        private:
+            friend class FramePool;
+            Lease(FramePool* pool, const FrameKey& key, TSurface&& surface)
+                : m_pool(pool), m_key(key), m_surface(std::move(surface))
+            {
+            }
+
+            FramePool* m_pool = nullptr;
+            FrameKey m_key;
+            TSurface m_surface{};
+        };
+
+        FramePool(Allocator allocate, Releaser release = nullptr, const PoolOptions& options = PoolOptions())
+            : m_allocate(std::move(allocate)), m_release(std::move(release)), m_options(options)
+        {
+        }
+
+        FramePool(const FramePool&) = delete;
+        FramePool& operator=(const FramePool&) = delete;
+
+        // Leases have to end before the pool is destroyed.
+        ~FramePool() { Clear(); }
+
+        // Leases a free surface of key, or a new one if the pool has none. The allocator is called outside of the lock
+        // and may throw, in which case nothing is leased.
+        Lease Acquire(const FrameKey& key)
+        {
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                m_leased++;
+                Bucket* bucket = Find(key);
+                if (bucket != nullptr && !bucket->Free.empty())
+                {
+                    TSurface surface = std::move(bucket->Free.back());
+                    bucket->Free.pop_back();
+                    bucket->LastUse = ++m_uses;
+                    m_statistics.Reused++;
+                    return Lease(this, key, std::move(surface));
+                }
+            }
+            try
+            {
+                TSurface surface = m_allocate(key);
+                std::lock_guard<std::mutex> lock(m_mutex);
+                m_statistics.Allocated++;
+                return Lease(this, key, std::move(surface));
+            }
+            catch (...)
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                m_leased--;
+                throw;
+            }
+        }
+
+        // Releases every free surface, e.g. when the device goes away. Leased surfaces still come back afterwards.
+        void Clear()
+        {
+            std::vector<TSurface> released;
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                for (auto& bucket : m_buckets)
+                {
+                    for (auto& surface : bucket.Free)
+                    {
+                        released.push_back(std::move(surface));
+                    }
+                }
+                m_buckets.clear();
+            }
+            Release(released);
+        }
+
+        PoolStatistics GetStatistics() const
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            PoolStatistics statistics = m_statistics;
+            statistics.Leased = m_leased;
+            for (const auto& bucket : m_buckets)
+            {
+                statistics.Free += bucket.Free.size();
+            }
+            return statistics;
+        }
+
+    private:
+        struct Bucket
+        {
+            FrameKey Key;
+            std::vector<TSurface> Free;
+            uint64_t LastUse = 0;
+        };
+
+        // Called with the mutex held. Few keys are ever in use at once, so a linear search is all it takes.
+        Bucket* Find(const FrameKey& key)
+        {
+            for (auto& bucket : m_buckets)
+            {
+                if (bucket.Key == key)
+                {
+                    return &bucket;
+                }
+            }
+            return nullptr;
+        }
+
+        void Put(const FrameKey& key, TSurface&& surface)
+        {
+            std::vector<TSurface> released;
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                m_leased--;
+                Bucket* bucket = Find(key);
+                if (bucket == nullptr)
+                {
+                    m_buckets.push_back(Bucket{ key, {}, 0 });
+                    bucket = &m_buckets.back();
+                }
+                bucket->LastUse = ++m_uses;
+                if (bucket->Free.size() < m_options.MaxFreePerKey)
+                {
+                    bucket->Free.push_back(std::move(surface));
+                }
+                else
+                {
+                    released.push_back(std::move(surface));
+                }
+
+                // A size or format change leaves the surfaces of the old key unused; let them go
+                while (m_buckets.size() > (std::max)(m_options.MaxKeys, static_cast<size_t>(1)))
+                {
+                    auto oldest = m_buckets.begin();
+                    for (auto candidate = m_buckets.begin(); candidate != m_buckets.end(); ++candidate)
+                    {
+                        oldest = candidate->LastUse < oldest->LastUse ? candidate : oldest;
+                    }
+                    for (auto& freeSurface : oldest->Free)
+                    {
+                        released.push_back(std::move(freeSurface));
+                    }
+                    m_buckets.erase(oldest);
+                }
+            }
+            Release(released);
+        }
+
+        void Release(std::vector<TSurface>& surfaces)
+        {
+            if (surfaces.empty())
+            {
+                return;
+            }
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                m_statistics.Released += surfaces.size();
+            }
+            if (m_release)
+            {
+                for (auto& surface : surfaces)
+                {
+                    m_release(surface);
+                }
+            }
+        }
+
+        Allocator m_allocate;
+        Releaser m_release;
+        PoolOptions m_options;
+        std::vector<Bucket> m_buckets;
+        size_t m_leased = 0;
+        uint64_t m_uses = 0;
+        PoolStatistics m_statistics;
+        mutable std::mutex m_mutex;
+    };
+} // namespace FrameResources
@@ -0,0 +1,278 @@
+// Tests of the frame pool of the segmentation models. A fake allocator hands out numbered surfaces and keeps track of
+// which ones are alive, so the tests can check what the pool reuses, keeps and releases. Exits with 1 if a check fails.
+#include <atomic>
+#include <cstdint>
+#include <iostream>
+#include <mutex>
+#include <set>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+#include "../FramePool.h"
+
+using namespace FrameResources;
+
+static int g_failures = 0;
+
+static void Check(bool condition, const std::string& test, const std::string& message)
+{
+    if (!condition)
+    {
+        std::cout << "FAILED " << test << ": " << message << std::endl;
+        g_failures++;
+    }
+}
+
+struct FakeSurface
+{
+    int Id = 0;
+    FrameKey Key;
+};
+
+// Stands in for VideoFrame::CreateAsDirect3D11SurfaceBacked and VideoFrame::Close.
+class FakeAllocator
+{
+public:
+    FramePool<FakeSurface>::Allocator Allocate()
+    {
+        return [this](const FrameKey& key) {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if (FailNext)
+            {
+                FailNext = false;
+                throw std::runtime_error("out of memory");
+            }
+            FakeSurface surface{ ++m_lastId, key };
+            m_alive.insert(surface.Id);
+            return surface;
+        };
+    }
+
+    FramePool<FakeSurface>::Releaser Release()
+    {
+        return [this](FakeSurface& surface) {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_doubleReleases += m_alive.erase(surface.Id) == 0 ? 1 : 0;
+        };
+    }
+
+    size_t Alive()
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_alive.size();
+    }
+
+    int DoubleReleases()
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_doubleReleases;
+    }
+
+    bool FailNext = false;
+
+private:
+    std::mutex m_mutex;
+    std::set<int> m_alive;
+    int m_lastId = 0;
+    int m_doubleReleases = 0;
+};
+
+static const FrameKey c_720p = { 87, 1280, 720 }; // 87 is DirectXPixelFormat::B8G8R8A8UIntNormalized
+static const FrameKey c_quarter = { 87, 320, 180 };
+
+// A surface given back is leased again for the same key instead of allocating a new one.
+static void TestReusesSurfaces()
+{
+    const std::string test = "reuses surfaces";
+    FakeAllocator allocator;
+    FramePool<FakeSurface> pool(allocator.Allocate(), allocator.Release());
+    int first = 0;
+    {
+        auto lease = pool.Acquire(c_720p);
+        first = lease.Get().Id;
+        Check(lease.Get().Key == c_720p, test, "the surface has the wrong key");
+    }
+    for (int frame = 0; frame < 100; frame++)
+    {
+        auto lease = pool.Acquire(c_720p);
+        Check(lease.Get().Id == first, test, "the surface was not reused");
+    }
+    PoolStatistics statistics = pool.GetStatistics();
+    Check(statistics.Allocated == 1, test, "allocated " + std::to_string(statistics.Allocated) + " surfaces");
+    Check(statistics.Reused == 100, test, "reused " + std::to_string(statistics.Reused) + " times");
+    Check(statistics.Free == 1 && statistics.Leased == 0, test, "the surface is not back in the pool");
+}
+
+// Surfaces leased at the same time are distinct, and only MaxFreePerKey of them are kept when they come back.
+static void TestKeepsAtMostMaxFreePerKey()
+{
+    const std::string test = "keeps at most MaxFreePerKey";
+    FakeAllocator allocator;
+    PoolOptions options;
+    options.MaxFreePerKey = 2;
+    FramePool<FakeSurface> pool(allocator.Allocate(), allocator.Release(), options);
+    {
+        std::vector<FramePool<FakeSurface>::Lease> leases;
+        std::set<int> ids;
+        for (int i = 0; i < 4; i++)
+        {
+            leases.push_back(pool.Acquire(c_720p));
+            ids.insert(leases.back().Get().Id);
+        }
+        Check(ids.size() == 4, test, "a surface was leased twice");
+        Check(pool.GetStatistics().Leased == 4, test, "leases are not counted");
+    }
+    PoolStatistics statistics = pool.GetStatistics();
+    Check(statistics.Free == 2, test, "kept " + std::to_string(statistics.Free) + " free surfaces");
+    Check(statistics.Released == 2, test, "released " + std::to_string(statistics.Released) + " surfaces");
+    Check(allocator.Alive() == 2, test, "released surfaces are still alive");
+}
+
+// Surfaces of different keys never stand in for each other, and a size change lets the surfaces of the old size go.
+static void TestKeysAndSizeChange()
+{
+    const std::string test = "keys and size change";
+    FakeAllocator allocator;
+    PoolOptions options;
+    options.MaxKeys = 1;
+    FramePool<FakeSurface> pool(allocator.Allocate(), allocator.Release(), options);
+    {
+        // small comes back last, so its key is the most recently used one
+        auto small = pool.Acquire(c_quarter);
+        auto large = pool.Acquire(c_720p);
+        Check(large.Get().Key == c_720p && small.Get().Key == c_quarter, test, "a surface has the wrong key");
+    }
+    Check(pool.GetStatistics().Free == 1, test, "surfaces of the least recently used key were kept");
+    auto lease = pool.Acquire(c_quarter);
+    Check(lease.Get().Key == c_quarter, test, "the kept surface has the wrong key");
+    Check(pool.GetStatistics().Reused == 1, test, "the surface of the most recently used key was not kept");
+    lease.Return();
+    Check(allocator.Alive() == 1, test, "the surface of the old size is still alive");
+}
+
+// Clear releases the free surfaces; a surface leased at the time comes back afterwards, and the pool releases
+// everything it holds when it is destroyed.
+static void TestClearAndDestroy()
+{
+    const std::string test = "clear and destroy";
+    FakeAllocator allocator;
+    {
+        FramePool<FakeSurface> pool(allocator.Allocate(), allocator.Release());
+        auto leased = pool.Acquire(c_720p);
+        pool.Acquire(c_720p);
+        pool.Clear();
+        Check(allocator.Alive() == 1, test, "Clear did not release the free surface");
+        leased.Return();
+        Check(pool.GetStatistics().Free == 1, test, "the leased surface did not come back after Clear");
+    }
+    Check(allocator.Alive() == 0, test, "the pool did not release its surfaces");
+    Check(allocator.DoubleReleases() == 0, test, "a surface was released twice");
+}
+
+// A moved lease gives its surface back once, from where it was moved to.
+static void TestMovedLease()
+{
+    const std::string test = "moved lease";
+    FakeAllocator allocator;
+    FramePool<FakeSurface> pool(allocator.Allocate(), allocator.Release());
+    FramePool<FakeSurface>::Lease outer;
+    Check(!outer, test, "an empty lease holds a surface");
+    {
+        auto lease = pool.Acquire(c_720p);
+        outer = std::move(lease);
+        Check(!lease && outer, test, "the surface did not move");
+    }
+    Check(pool.GetStatistics().Leased == 1, test, "the moved-from lease gave the surface back");
+    outer = pool.Acquire(c_720p);
+    Check(pool.GetStatistics().Leased == 1, test, "assigning a lease did not give back the old surface");
+    outer.Return();
+    outer.Return();
+    PoolStatistics statistics = pool.GetStatistics();
+    Check(statistics.Leased == 0 && statistics.Free == 2, test, "surfaces were given back more than once");
+}
+
+// An allocator that throws leaves the pool as it was.
+static void TestAllocatorFailure()
+{
+    const std::string test = "allocator failure";
+    FakeAllocator allocator;
+    FramePool<FakeSurface> pool(allocator.Allocate(), allocator.Release());
+    allocator.FailNext = true;
+    bool threw = false;
+    try
+    {
+        pool.Acquire(c_720p);
+    }
+    catch (const std::runtime_error&)
+    {
+        threw = true;
+    }
+    Check(threw, test, "the allocator exception was swallowed");
+    PoolStatistics statistics = pool.GetStatistics();
+    Check(statistics.Leased == 0 && statistics.Allocated == 0, test, "the failed lease was counted");
+    Check(pool.Acquire(c_720p).Get().Id != 0, test, "the pool does not allocate after a failure");
+}
+
+// Model threads each lease an input and an output surface per frame, the way StreamModelBase does; no surface may be
+// leased twice at once and the pool must settle on a few surfaces.
+static void TestThreaded()
+{
+    const std::string test = "threaded";
+    const int threadCount = 4;
+    const int frames = 2000;
+    FakeAllocator allocator;
+    PoolOptions options;
+    options.MaxFreePerKey = 2 * threadCount;
+    FramePool<FakeSurface> pool(allocator.Allocate(), allocator.Release(), options);
+    std::vector<std::atomic<int>> users(1024);
+    std::atomic<bool> shared(false);
+    std::vector<std::thread> threads;
+    for (int thread = 0; thread < threadCount; thread++)
+    {
+        threads.emplace_back([&]() {
+            for (int frame = 0; frame < frames; frame++)
+            {
+                auto input = pool.Acquire(c_720p);
+                auto output = pool.Acquire(c_720p);
+                for (auto* lease : { &input, &output })
+                {
+                    size_t id = static_cast<size_t>(lease->Get().Id) % users.size();
+                    shared = shared || users[id].fetch_add(1) != 0;
+                }
+                std::this_thread::yield();
+                for (auto* lease : { &input, &output })
+                {
+                    users[static_cast<size_t>(lease->Get().Id) % users.size()]--;
+                }
+            }
+        });
+    }
+    for (auto& thread : threads)
+    {
+        thread.join();
+    }
+    PoolStatistics statistics = pool.GetStatistics();
+    Check(!shared, test, "a surface was leased twice at once");
+    Check(statistics.Allocated <= 2 * threadCount, test, "allocated " + std::to_string(statistics.Allocated));
+    Check(statistics.Allocated + statistics.Reused == 2ull * threadCount * frames, test, "statistics do not add up");
+    std::cout << test << ": " << statistics.Allocated << " allocated, " << statistics.Reused << " reused" << std::endl;
+}
+
+int main()
+{
+    TestReusesSurfaces();
+    TestKeepsAtMostMaxFreePerKey();
+    TestKeysAndSizeChange();
+    TestClearAndDestroy();
+    TestMovedLease();
+    TestAllocatorFailure();
+    TestThreaded();
+    if (g_failures > 0)
+    {
+        std::cout << g_failures << " checks failed" << std::endl;
+        return 1;
+    }
+    std::cout << "All checks passed" << std::endl;
+    return 0;
+}
@@ -0,0 +1,275 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+// Schedules video frames over a fixed set of model instances (workers) that each run one frame at a time, and hands
+// the results back in presentation order. Every admitted frame gets the next sequence number and goes to the idle
+// worker that has been fastest lately. A reorder buffer holds finished frames until every earlier frame is delivered,
+// and the drop-late policy skips a frame that holds later frames back for too long, so one slow frame costs one frame
+// instead of a stall. Nothing in here depends on Media Foundation or WinML.
+namespace FrameScheduling
+{
+    using Clock = std::chrono::steady_clock;
+
+    enum class FrameStatus
+    {
+        Completed,   // the worker produced an output
+        Failed,      // the worker gave up on the frame
+        DroppedLate, // skipped by the drop-late policy, its output is discarded if it still arrives
+    };
+
+    struct SchedulerOptions
+    {
+        size_t Workers = 1;
+
+        // Drop-late policy: a frame still running while later frames are done is skipped once it has run for
+        // MaxLatency, or once MaxReorderDepth later frames are waiting behind it. 0 turns a limit off; with both off,
+        // or DropLateFrames false, frames are always delivered in order, however long that takes.
+        bool DropLateFrames = true;
+        Clock::duration MaxLatency = std::chrono::milliseconds(100);
+        size_t MaxReorderDepth = 0;
+    };
+
+    struct FrameTicket
+    {
+        uint64_t Sequence = 0;
+        size_t Worker = 0;
+        Clock::time_point Start;
+    };
+
+    struct WorkerStatistics
+    {
+        bool Busy = false;
+        uint64_t Frames = 0;              // frames the worker finished
+        double AverageMilliseconds = 0;   // exponential moving average of its frame times
+    };
+
+    struct SchedulerStatistics
+    {
+        uint64_t Admitted = 0;
+        uint64_t DroppedBusy = 0;      // frames refused because every worker was busy
+        uint64_t Completed = 0;        // delivered with an output
+        uint64_t Failed = 0;
+        uint64_t DroppedLate = 0;
+        uint64_t DiscardedLate = 0;    // outputs of skipped frames that arrived after all
+        size_t LargestReorderDepth = 0; // most finished frames waiting behind a running one
+    };
+
+    // TOutput is what a worker produces for a frame, e.g. the output sample; it must be default constructible and
+    // movable.
+    template <typename TOutput> class FrameScheduler
+    {
+    public:
+        explicit FrameScheduler(const SchedulerOptions& options)
+            : m_options(options), m_workers(options.Workers > 0 ? options.Workers : 1)
+        {
+        }
+
+        FrameScheduler(const FrameScheduler&) = delete;
+        FrameScheduler& operator=(const FrameScheduler&) = delete;
+
+        // Admits a frame: picks the idle worker with the lowest average frame time, the one idle the longest on a tie,
+        // and numbers the frame. Returns false when every worker is busy; the frame is then dropped right away rather
+        // than queued, so it cannot add latency to the frames after it.
+        bool BeginFrame(FrameTicket& ticket, Clock::time_point now = Clock::now())
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            size_t best = m_workers.size();
+            for (size_t i = 0; i < m_workers.size(); i++)
+            {
+                const Worker& worker = m_workers[i];
+                if (worker.Statistics.Busy)
+                {
+                    continue;
+                }
+                if (best == m_workers.size() ||
+                    worker.Statistics.AverageMilliseconds < m_workers[best].Statistics.AverageMilliseconds ||
+                    (worker.Statistics.AverageMilliseconds == m_workers[best].Statistics.AverageMilliseconds &&
+                     worker.IdleSince < m_workers[best].IdleSince))
+                {
+                    best = i;
+                }
+            }
+            if (best == m_workers.size())
+            {
+                m_statistics.DroppedBusy++;
+                return false;
+            }
+
+            m_workers[best].Statistics.Busy = true;
+            ticket.Sequence = m_nextSequence++;
+            ticket.Worker = best;
+            ticket.Start = now;
+            m_frames[ticket.Sequence].Start = now;
+            m_statistics.Admitted++;
+            return true;
+        }
+
+        // Frees the worker of a frame and puts its result in the reorder buffer. The output is only kept when the
+        // status is Completed and the frame has not been skipped meanwhile.
+        void CompleteFrame(const FrameTicket& ticket, FrameStatus status, TOutput output = TOutput(),
+                           Clock::time_point now = Clock::now())
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            Worker& worker = m_workers[ticket.Worker];
+            double milliseconds = std::chrono::duration<double, std::milli>(now - ticket.Start).count();
+            worker.Statistics.AverageMilliseconds = worker.Statistics.Frames == 0
+                                                        ? milliseconds
+                                                        : 0.8 * worker.Statistics.AverageMilliseconds +
+                                                              0.2 * milliseconds;
+            worker.Statistics.Frames++;
+            worker.Statistics.Busy = false;
+            worker.IdleSince = now;
+
+            auto frame = m_frames.find(ticket.Sequence);
+            if (frame == m_frames.end())
+            {
+                // Skipped by the drop-late policy or by Reset
+                m_statistics.DiscardedLate += status == FrameStatus::Completed ? 1 : 0;
+                return;
+            }
+            frame->second.Done = true;
+            frame->second.Status = status;
+            if (status == FrameStatus::Completed)
+            {
+                frame->second.Output = std::move(output);
+            }
+            m_doneFrames++;
+            Advance(now);
+        }
+
+        // Calls deliver(sequence, status, output) for every frame that is next in presentation order, with a null
+        // output unless the status is Completed. Only one thread delivers at a time, outside of the lock, so
+        // deliver can take other locks; a thread that finds another one delivering returns at once and leaves its
+        // frames to it. deliver must not throw. Returns the number of frames this call delivered.
+        template <typename Deliver> size_t DeliverFrames(Deliver&& deliver, Clock::time_point now = Clock::now())
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            Advance(now);
+            if (m_delivering)
+            {
+                return 0;
+            }
+            m_delivering = true;
+            size_t delivered = 0;
+            while (!m_ready.empty())
+            {
+                uint64_t sequence = m_ready.front().Sequence;
+                FrameStatus status = m_ready.front().Status;
+                TOutput output = std::move(m_ready.front().Output);
+                m_ready.pop_front();
+                lock.unlock();
+                deliver(sequence, status, status == FrameStatus::Completed ? &output : nullptr);
+                delivered++;
+                lock.lock();
+            }
+            m_delivering = false;
+            return delivered;
+        }
+
+        // Forgets every frame, e.g. on a flush: frames waiting for delivery are released without being delivered,
+        // and outputs of frames still running are discarded when they arrive.
+        void Reset()
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_frames.clear();
+            m_ready.clear();
+            m_doneFrames = 0;
+        }
+
+        SchedulerStatistics GetStatistics() const
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            return m_statistics;
+        }
+
+        WorkerStatistics GetWorkerStatistics(size_t worker) const
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            return m_workers[worker].Statistics;
+        }
+
+        size_t GetWorkerCount() const { return m_workers.size(); }
+
+    private:
+        struct Worker
+        {
+            WorkerStatistics Statistics;
+            Clock::time_point IdleSince;
+        };
+
+        struct Frame
+        {
+            Clock::time_point Start;
+            bool Done = false;
+            FrameStatus Status = FrameStatus::Failed;
+            TOutput Output{};
+        };
+
+        struct Ready
+        {
+            uint64_t Sequence;
+            FrameStatus Status;
+            TOutput Output{};
+        };
+
+        // Called with the mutex held. Moves frames that are next in order to the ready queue, skipping a running
+        // frame at the front when the drop-late policy says it held the frames behind it back for too long.
+        void Advance(Clock::time_point now)
+        {
+            while (!m_frames.empty())
+            {
+                auto front = m_frames.begin();
+                Frame& frame = front->second;
+                if (frame.Done)
+                {
+                    m_doneFrames--;
+                    m_statistics.Completed += frame.Status == FrameStatus::Completed ? 1 : 0;
+                    m_statistics.Failed += frame.Status == FrameStatus::Failed ? 1 : 0;
+                }
+                else if (IsLate(frame, now))
+                {
+                    frame.Status = FrameStatus::DroppedLate;
+                    m_statistics.DroppedLate++;
+                }
+                else
+                {
+                    m_statistics.LargestReorderDepth = (std::max)(m_statistics.LargestReorderDepth, m_doneFrames);
+                    return;
+                }
+                m_ready.push_back(Ready{ front->first, frame.Status, std::move(frame.Output) });
+                m_frames.erase(front);
+            }
+        }
+
+        bool IsLate(const Frame& frame, Clock::time_point now) const
+        {
+            if (!m_options.DropLateFrames || m_doneFrames == 0)
+            {
+                // Nothing is waiting for the frame, so it holds nothing back
+                return false;
+            }
+            bool tooOld = m_options.MaxLatency.count() > 0 && now - frame.Start >= m_options.MaxLatency;
+            bool tooDeep = m_options.MaxReorderDepth > 0 && m_doneFrames >= m_options.MaxReorderDepth;
+            return tooOld || tooDeep;
+        }
+
+        SchedulerOptions m_options;
+        std::vector<Worker> m_workers;
+        std::map<uint64_t, Frame> m_frames; // admitted and not yet ready, by sequence number
+        size_t m_doneFrames = 0;            // frames in m_frames that are done
+        std::deque<Ready> m_ready;          // in presentation order
+        uint64_t m_nextSequence = 0;
+        bool m_delivering = false;
+        SchedulerStatistics m_statistics;
+        mutable std::mutex m_mutex;
+    };
+} // namespace FrameScheduling
@@ -0,0 +1,265 @@
+// Frame pacing simulation of the TransformAsync frame scheduler. A producer sends frames at a fixed rate to worker
+// threads whose frame times vary at random, with occasional spikes, and the delivered frames are measured: how many
+// made it, how many came out of order, their latency from capture to delivery and how evenly they were spaced.
+// Compares the round-robin dispatch TransformAsync used before with the scheduler with and without dropping late
+// frames.
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+#include "../FrameScheduler.h"
+
+using namespace FrameScheduling;
+
+struct SimulationArgs
+{
+    size_t Workers = 4;
+    int Frames = 600;
+    double IntervalMilliseconds = 8;   // between two frames of the producer
+    double FrameMilliseconds = 20;     // median frame time of a worker
+    double SpikeRate = 0.05;           // share of frames that take SpikeFactor times longer
+    double SpikeFactor = 5;
+    double MaxLatencyMilliseconds = 60;
+    bool Help = false;
+};
+
+static void PrintUsage()
+{
+    std::cout << "frame-scheduler-simulation [options]" << std::endl;
+    std::cout << "  -Workers <n>       : model instances (default 4)" << std::endl;
+    std::cout << "  -Frames <n>        : frames sent by the producer (default 600)" << std::endl;
+    std::cout << "  -Interval <ms>     : time between two frames (default 8)" << std::endl;
+    std::cout << "  -FrameTime <ms>    : median frame time of a worker (default 20)" << std::endl;
+    std::cout << "  -SpikeRate <share> : share of frames that take -SpikeFactor times longer (default 0.05)"
+              << std::endl;
+    std::cout << "  -SpikeFactor <x>   : (default 5)" << std::endl;
+    std::cout << "  -MaxLatency <ms>   : MaxLatency of the drop-late policy (default 60)" << std::endl;
+    std::cout << "  -Help              : print this message" << std::endl;
+}
+
+static bool ParseArgs(int argc, char** argv, SimulationArgs& args)
+{
+    for (int i = 1; i < argc; i++)
+    {
+        std::string option = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (option == "-Help")
+        {
+            args.Help = true;
+        }
+        else if (!hasValue)
+        {
+            std::cout << "Unknown option or missing value: " << option << std::endl;
+            return false;
+        }
+        else if (option == "-Workers")
+        {
+            args.Workers = static_cast<size_t>(std::max(1, std::atoi(argv[++i])));
+        }
+        else if (option == "-Frames")
+        {
+            args.Frames = std::max(1, std::atoi(argv[++i]));
+        }
+        else if (option == "-Interval")
+        {
+            args.IntervalMilliseconds = std::atof(argv[++i]);
+        }
+        else if (option == "-FrameTime")
+        {
+            args.FrameMilliseconds = std::atof(argv[++i]);
+        }
+        else if (option == "-SpikeRate")
+        {
+            args.SpikeRate = std::atof(argv[++i]);
+        }
+        else if (option == "-SpikeFactor")
+        {
+            args.SpikeFactor = std::atof(argv[++i]);
+        }
+        else if (option == "-MaxLatency")
+        {
+            args.MaxLatencyMilliseconds = std::atof(argv[++i]);
+        }
+        else
+        {
+            std::cout << "Unknown option: " << option << std::endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+struct Measurements
+{
+    std::mutex Mutex;
+    std::vector<double> Latencies;    // ms from capture to delivery
+    std::vector<double> Deliveries;   // ms since the start, in delivery order
+    int OutOfOrder = 0;
+    int64_t LastCapture = -1;
+
+    void Add(int64_t capture, Clock::time_point captureTime, Clock::time_point start)
+    {
+        Clock::time_point now = Clock::now();
+        std::lock_guard<std::mutex> lock(Mutex);
+        Latencies.push_back(std::chrono::duration<double, std::milli>(now - captureTime).count());
+        Deliveries.push_back(std::chrono::duration<double, std::milli>(now - start).count());
+        OutOfOrder += capture < LastCapture ? 1 : 0;
+        LastCapture = std::max(LastCapture, capture);
+    }
+};
+
+static double Percentile(std::vector<double> values, double percentile)
+{
+    if (values.empty())
+    {
+        return 0;
+    }
+    std::sort(values.begin(), values.end());
+    return values[static_cast<size_t>(percentile / 100 * (values.size() - 1))];
+}
+
+static void Report(const std::string& name, const SimulationArgs& args, Measurements& measurements)
+{
+    std::vector<double> intervals;
+    for (size_t i = 1; i < measurements.Deliveries.size(); i++)
+    {
+        intervals.push_back(measurements.Deliveries[i] - measurements.Deliveries[i - 1]);
+    }
+    double mean = 0;
+    for (double interval : intervals)
+    {
+        mean += interval / intervals.size();
+    }
+    double variance = 0;
+    for (double interval : intervals)
+    {
+        variance += (interval - mean) * (interval - mean) / intervals.size();
+    }
+    std::cout << std::left << std::setw(22) << name << std::right << std::fixed << std::setprecision(1)
+              << std::setw(10) << measurements.Latencies.size() << std::setw(8) << args.Frames -
+                     static_cast<int>(measurements.Latencies.size())
+              << std::setw(12) << measurements.OutOfOrder << std::setw(10) << Percentile(measurements.Latencies, 50)
+              << std::setw(10) << Percentile(measurements.Latencies, 99) << std::setw(10)
+              << Percentile(intervals, 99) << std::setw(12) << std::sqrt(variance) << std::endl;
+}
+
+// Frame time of a frame: lognormal around the median, times the spike factor for a share of the frames.
+static std::vector<double> MakeFrameTimes(const SimulationArgs& args)
+{
+    std::mt19937 random(11);
+    std::lognormal_distribution<double> frameTime(std::log(args.FrameMilliseconds), 0.25);
+    std::uniform_real_distribution<double> spike(0, 1);
+    std::vector<double> frameTimes(args.Frames);
+    for (double& milliseconds : frameTimes)
+    {
+        milliseconds = frameTime(random) * (spike(random) < args.SpikeRate ? args.SpikeFactor : 1);
+    }
+    return frameTimes;
+}
+
+static void Wait(double milliseconds)
+{
+    std::this_thread::sleep_for(std::chrono::microseconds(static_cast<int64_t>(milliseconds * 1000)));
+}
+
+// What TransformAsync did before: the next model in turn gets the frame, which is dropped if that model is busy, and
+// frames go out as soon as they are done.
+static void RunRoundRobin(const SimulationArgs& args, const std::vector<double>& frameTimes)
+{
+    Measurements measurements;
+    std::vector<std::atomic<bool>> busy(args.Workers);
+    std::vector<std::thread> threads;
+    size_t modelIndex = 0;
+    Clock::time_point start = Clock::now();
+    for (int frame = 0; frame < args.Frames; frame++)
+    {
+        Clock::time_point capture = Clock::now();
+        modelIndex = (modelIndex + 1) % args.Workers;
+        if (!busy[modelIndex].exchange(true))
+        {
+            threads.emplace_back([&, frame, capture, modelIndex]() {
+                Wait(frameTimes[frame]);
+                measurements.Add(frame, capture, start);
+                busy[modelIndex] = false;
+            });
+        }
+        Wait(args.IntervalMilliseconds);
+    }
+    for (auto& thread : threads)
+    {
+        thread.join();
+    }
+    Report("round robin", args, measurements);
+}
+
+static void RunScheduler(const std::string& name, const SimulationArgs& args, const std::vector<double>& frameTimes,
+                         bool dropLateFrames)
+{
+    SchedulerOptions options;
+    options.Workers = args.Workers;
+    options.DropLateFrames = dropLateFrames;
+    options.MaxLatency = std::chrono::microseconds(static_cast<int64_t>(args.MaxLatencyMilliseconds * 1000));
+    options.MaxReorderDepth = args.Workers;
+    FrameScheduler<int> scheduler(options);
+    Measurements measurements;
+    std::vector<Clock::time_point> captures(args.Frames);
+    std::vector<std::thread> threads;
+    Clock::time_point start = Clock::now();
+    auto deliver = [&](uint64_t, FrameStatus, int* frame) {
+        if (frame != nullptr)
+        {
+            measurements.Add(*frame, captures[*frame], start);
+        }
+    };
+    for (int frame = 0; frame < args.Frames; frame++)
+    {
+        captures[frame] = Clock::now();
+        FrameTicket ticket;
+        if (scheduler.BeginFrame(ticket))
+        {
+            threads.emplace_back([&, frame, ticket]() {
+                Wait(frameTimes[frame]);
+                scheduler.CompleteFrame(ticket, FrameStatus::Completed, frame);
+                scheduler.DeliverFrames(deliver);
+            });
+        }
+        Wait(args.IntervalMilliseconds);
+    }
+    for (auto& thread : threads)
+    {
+        thread.join();
+    }
+    scheduler.DeliverFrames(deliver);
+    Report(name, args, measurements);
+}
+
+int main(int argc, char** argv)
+{
+    SimulationArgs args;
+    if (!ParseArgs(argc, argv, args) || args.Help)
+    {
+        PrintUsage();
+        return args.Help ? 0 : 1;
+    }
+
+    std::vector<double> frameTimes = MakeFrameTimes(args);
+    std::cout << args.Frames << " frames every " << args.IntervalMilliseconds << " ms on " << args.Workers
+              << " workers, median frame time " << args.FrameMilliseconds << " ms, " << args.SpikeRate * 100
+              << "% of frames " << args.SpikeFactor << "x slower" << std::endl;
+    std::cout << std::left << std::setw(22) << "dispatch" << std::right << std::setw(10) << "delivered"
+              << std::setw(8) << "lost" << std::setw(12) << "reordered" << std::setw(10) << "p50 ms" << std::setw(10)
+              << "p99 ms" << std::setw(10) << "p99 gap" << std::setw(12) << "gap stddev" << std::endl;
+    RunRoundRobin(args, frameTimes);
+    RunScheduler("scheduler, in order", args, frameTimes, false);
+    RunScheduler("scheduler, drop late", args, frameTimes, true);
+    return 0;
+}
@@ -0,0 +1,318 @@
+// Tests of the frame scheduler of TransformAsync. The deterministic tests pass their own time points, the threaded
+// test runs simulated workers with random frame times and checks that frames come out once each and in order.
+// Exits with 1 if a check fails.
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+#include "../FrameScheduler.h"
+
+using namespace FrameScheduling;
+
+static int g_failures = 0;
+
+static void Check(bool condition, const std::string& test, const std::string& message)
+{
+    if (!condition)
+    {
+        std::cout << "FAILED " << test << ": " << message << std::endl;
+        g_failures++;
+    }
+}
+
+struct Delivered
+{
+    uint64_t Sequence;
+    FrameStatus Status;
+    int Output;
+};
+
+static std::vector<Delivered> Deliver(FrameScheduler<int>& scheduler, Clock::time_point now)
+{
+    std::vector<Delivered> delivered;
+    scheduler.DeliverFrames(
+        [&delivered](uint64_t sequence, FrameStatus status, int* output) {
+            delivered.push_back(Delivered{ sequence, status, output != nullptr ? *output : -1 });
+        },
+        now);
+    return delivered;
+}
+
+static Clock::time_point At(int milliseconds)
+{
+    return Clock::time_point() + std::chrono::milliseconds(milliseconds);
+}
+
+// Frames finishing out of order come out in order, once the frame before them is done.
+static void TestReorders()
+{
+    const std::string test = "reorders";
+    SchedulerOptions options;
+    options.Workers = 3;
+    options.DropLateFrames = false;
+    FrameScheduler<int> scheduler(options);
+    FrameTicket tickets[3];
+    for (int i = 0; i < 3; i++)
+    {
+        Check(scheduler.BeginFrame(tickets[i], At(i)), test, "an idle worker was not used");
+        Check(tickets[i].Sequence == static_cast<uint64_t>(i), test, "sequence numbers");
+    }
+    FrameTicket refused;
+    Check(!scheduler.BeginFrame(refused, At(3)), test, "a frame was admitted with every worker busy");
+
+    scheduler.CompleteFrame(tickets[2], FrameStatus::Completed, 2, At(10));
+    scheduler.CompleteFrame(tickets[1], FrameStatus::Failed, 0, At(11));
+    Check(Deliver(scheduler, At(11)).empty(), test, "frames were delivered before the first one finished");
+
+    scheduler.CompleteFrame(tickets[0], FrameStatus::Completed, 0, At(500));
+    std::vector<Delivered> delivered = Deliver(scheduler, At(500));
+    Check(delivered.size() == 3, test, "not every frame was delivered");
+    if (delivered.size() == 3)
+    {
+        Check(delivered[0].Sequence == 0 && delivered[0].Output == 0, test, "first frame");
+        Check(delivered[1].Sequence == 1 && delivered[1].Status == FrameStatus::Failed && delivered[1].Output == -1,
+              test, "failed frame");
+        Check(delivered[2].Sequence == 2 && delivered[2].Output == 2, test, "last frame");
+    }
+
+    SchedulerStatistics statistics = scheduler.GetStatistics();
+    Check(statistics.Admitted == 3 && statistics.DroppedBusy == 1 && statistics.Completed == 2 &&
+              statistics.Failed == 1 && statistics.DroppedLate == 0 && statistics.LargestReorderDepth == 2,
+          test, "statistics");
+}
+
+// The idle worker with the lowest average frame time gets the next frame; on a tie the one idle the longest.
+static void TestPicksFastestIdleWorker()
+{
+    const std::string test = "picks-fastest-idle-worker";
+    SchedulerOptions options;
+    options.Workers = 3;
+    options.DropLateFrames = false;
+    FrameScheduler<int> scheduler(options);
+
+    // Worker 0 takes 30 ms, worker 1 10 ms and worker 2 20 ms
+    FrameTicket tickets[3];
+    for (int i = 0; i < 3; i++)
+    {
+        scheduler.BeginFrame(tickets[i], At(0));
+    }
+    scheduler.CompleteFrame(tickets[0], FrameStatus::Completed, 0, At(30));
+    scheduler.CompleteFrame(tickets[1], FrameStatus::Completed, 1, At(10));
+    scheduler.CompleteFrame(tickets[2], FrameStatus::Completed, 2, At(20));
+    Check(scheduler.GetWorkerStatistics(0).AverageMilliseconds == 30, test, "average frame time");
+
+    FrameTicket ticket;
+    scheduler.BeginFrame(ticket, At(40));
+    Check(ticket.Worker == 1, test, "the fastest worker was not picked");
+    FrameTicket second;
+    scheduler.BeginFrame(second, At(40));
+    Check(second.Worker == 2, test, "the fastest idle worker was not picked");
+    Check(scheduler.GetWorkerStatistics(1).Busy && !scheduler.GetWorkerStatistics(0).Busy, test, "busy flags");
+
+    // Equal averages: the worker that finished first has been idle the longest
+    FrameScheduler<int> tied(options);
+    for (int i = 0; i < 3; i++)
+    {
+        tied.BeginFrame(tickets[i], At(0));
+    }
+    tied.CompleteFrame(tickets[2], FrameStatus::Completed, 2, At(10));
+    tied.CompleteFrame(tickets[0], FrameStatus::Completed, 0, At(10));
+    tied.CompleteFrame(tickets[1], FrameStatus::Completed, 1, At(10));
+    tied.BeginFrame(ticket, At(20));
+    Check(ticket.Worker == 0, test, "the longest idle worker was not picked on a tie");
+}
+
+// A frame that holds finished frames back for MaxLatency is skipped, and its output is discarded when it arrives.
+static void TestDropsLateFrames()
+{
+    const std::string test = "drops-late-frames";
+    SchedulerOptions options;
+    options.Workers = 4;
+    options.MaxLatency = std::chrono::milliseconds(100);
+    options.MaxReorderDepth = 0;
+    FrameScheduler<std::shared_ptr<int>> scheduler(options);
+    FrameTicket tickets[3];
+    for (int i = 0; i < 3; i++)
+    {
+        scheduler.BeginFrame(tickets[i], At(i * 10));
+    }
+
+    // A slow frame with nothing finished behind it is not late, however long it runs
+    size_t delivered = scheduler.DeliverFrames([](uint64_t, FrameStatus, std::shared_ptr<int>*) {}, At(1000));
+    Check(delivered == 0, test, "a frame was dropped while nothing waited for it");
+
+    auto output = std::make_shared<int>(1);
+    scheduler.CompleteFrame(tickets[1], FrameStatus::Completed, output, At(1010));
+    std::vector<uint64_t> sequences;
+    std::vector<FrameStatus> statuses;
+    scheduler.DeliverFrames(
+        [&](uint64_t sequence, FrameStatus status, std::shared_ptr<int>*) {
+            sequences.push_back(sequence);
+            statuses.push_back(status);
+        },
+        At(1010));
+    Check(sequences.size() == 2 && sequences[0] == 0 && statuses[0] == FrameStatus::DroppedLate && sequences[1] == 1 &&
+              statuses[1] == FrameStatus::Completed,
+          test, "the late frame was not skipped");
+    Check(output.use_count() == 1, test, "a delivered output is still held");
+
+    // The skipped frame finishes after all: its worker is free again and its output is dropped
+    auto lateOutput = std::make_shared<int>(0);
+    scheduler.CompleteFrame(tickets[0], FrameStatus::Completed, lateOutput, At(1020));
+    Check(lateOutput.use_count() == 1, test, "the output of a skipped frame is held");
+    Check(!scheduler.GetWorkerStatistics(tickets[0].Worker).Busy, test, "the worker of a skipped frame is busy");
+    SchedulerStatistics statistics = scheduler.GetStatistics();
+    Check(statistics.DroppedLate == 1 && statistics.DiscardedLate == 1, test, "statistics");
+}
+
+// A frame is also late once MaxReorderDepth frames are finished behind it, even before MaxLatency.
+static void TestDropsByReorderDepth()
+{
+    const std::string test = "drops-by-reorder-depth";
+    SchedulerOptions options;
+    options.Workers = 4;
+    options.MaxLatency = std::chrono::seconds(10);
+    options.MaxReorderDepth = 2;
+    FrameScheduler<int> scheduler(options);
+    FrameTicket tickets[4];
+    for (int i = 0; i < 4; i++)
+    {
+        scheduler.BeginFrame(tickets[i], At(0));
+    }
+    scheduler.CompleteFrame(tickets[2], FrameStatus::Completed, 2, At(5));
+    Check(Deliver(scheduler, At(5)).empty(), test, "dropped before the depth was reached");
+    scheduler.CompleteFrame(tickets[3], FrameStatus::Completed, 3, At(6));
+
+    // Frames 0 and 1 are both still running: both are skipped to let 2 and 3 out
+    std::vector<Delivered> delivered = Deliver(scheduler, At(6));
+    Check(delivered.size() == 4, test, "frames behind the late ones were not delivered");
+    if (delivered.size() == 4)
+    {
+        Check(delivered[0].Status == FrameStatus::DroppedLate && delivered[1].Status == FrameStatus::DroppedLate, test,
+              "late frames");
+        Check(delivered[2].Output == 2 && delivered[3].Output == 3, test, "finished frames");
+    }
+}
+
+// Reset forgets queued and running frames, and numbering goes on.
+static void TestReset()
+{
+    const std::string test = "reset";
+    SchedulerOptions options;
+    options.Workers = 2;
+    options.DropLateFrames = false;
+    FrameScheduler<int> scheduler(options);
+    FrameTicket first;
+    FrameTicket second;
+    scheduler.BeginFrame(first, At(0));
+    scheduler.BeginFrame(second, At(0));
+    scheduler.CompleteFrame(second, FrameStatus::Completed, 1, At(1));
+    scheduler.Reset();
+    scheduler.CompleteFrame(first, FrameStatus::Completed, 0, At(2));
+    Check(Deliver(scheduler, At(2)).empty(), test, "frames from before the reset were delivered");
+
+    FrameTicket next;
+    Check(scheduler.BeginFrame(next, At(3)) && next.Sequence == 2, test, "numbering after the reset");
+    scheduler.CompleteFrame(next, FrameStatus::Completed, 2, At(4));
+    std::vector<Delivered> delivered = Deliver(scheduler, At(4));
+    Check(delivered.size() == 1 && delivered[0].Sequence == 2, test, "frame after the reset");
+}
+
+// Worker threads with random frame times, one of them occasionally very slow, take frames from a producer; other
+// threads deliver at the same time. Every admitted frame must come out exactly once and in order.
+static void TestSimulatedWorkers(bool dropLateFrames)
+{
+    const std::string test = std::string("simulated-workers ") + (dropLateFrames ? "drop-late" : "in-order");
+    const size_t workers = 4;
+    const int frames = 400;
+    SchedulerOptions options;
+    options.Workers = workers;
+    options.DropLateFrames = dropLateFrames;
+    options.MaxLatency = std::chrono::milliseconds(20);
+    options.MaxReorderDepth = workers;
+    FrameScheduler<uint64_t> scheduler(options);
+
+    std::vector<std::atomic<int>> deliveries(frames);
+    std::atomic<uint64_t> lastDelivered{ UINT64_MAX };
+    std::atomic<bool> outOfOrder{ false };
+    std::atomic<bool> wrongOutput{ false };
+    auto deliver = [&](uint64_t sequence, FrameStatus status, uint64_t* output) {
+        uint64_t last = lastDelivered.exchange(sequence);
+        if (last != UINT64_MAX && sequence <= last)
+        {
+            outOfOrder = true;
+        }
+        if (status == FrameStatus::Completed && (output == nullptr || *output != sequence))
+        {
+            wrongOutput = true;
+        }
+        if (sequence < deliveries.size())
+        {
+            deliveries[sequence]++;
+        }
+    };
+
+    std::vector<std::thread> threads;
+    std::mt19937 random(7);
+    for (int frame = 0; frame < frames; frame++)
+    {
+        FrameTicket ticket;
+        if (scheduler.BeginFrame(ticket))
+        {
+            // Mostly 1 to 4 ms, every 25th frame 30 ms
+            int milliseconds = frame % 25 == 0 ? 30 : 1 + static_cast<int>(random() % 4);
+            threads.emplace_back([&, ticket, milliseconds]() {
+                std::this_thread::sleep_for(std::chrono::milliseconds(milliseconds));
+                scheduler.CompleteFrame(ticket, FrameStatus::Completed, ticket.Sequence);
+                scheduler.DeliverFrames(deliver);
+            });
+        }
+        std::this_thread::sleep_for(std::chrono::microseconds(500));
+    }
+    for (auto& thread : threads)
+    {
+        thread.join();
+    }
+    scheduler.DeliverFrames(deliver);
+
+    SchedulerStatistics statistics = scheduler.GetStatistics();
+    uint64_t deliveredOnce = 0;
+    bool duplicated = false;
+    for (uint64_t i = 0; i < statistics.Admitted; i++)
+    {
+        deliveredOnce += deliveries[i] == 1 ? 1 : 0;
+        duplicated = duplicated || deliveries[i] > 1;
+    }
+    Check(!outOfOrder, test, "frames were delivered out of order");
+    Check(!wrongOutput, test, "a frame was delivered with another frame's output");
+    Check(!duplicated, test, "a frame was delivered more than once");
+    Check(deliveredOnce == statistics.Admitted, test, "admitted frames were not delivered");
+    Check(statistics.Completed + statistics.DroppedLate == statistics.Admitted, test, "statistics do not add up");
+    Check(dropLateFrames || statistics.DroppedLate == 0, test, "frames were dropped with the policy off");
+    std::cout << test << ": " << statistics.Admitted << " admitted, " << statistics.DroppedBusy << " dropped busy, "
+              << statistics.DroppedLate << " dropped late, largest reorder depth " << statistics.LargestReorderDepth
+              << std::endl;
+}
+
+int main()
+{
+    TestReorders();
+    TestPicksFastestIdleWorker();
+    TestDropsLateFrames();
+    TestDropsByReorderDepth();
+    TestReset();
+    TestSimulatedWorkers(false);
+    TestSimulatedWorkers(true);
+    if (g_failures > 0)
+    {
+        std::cout << g_failures << " checks failed" << std::endl;
+        return 1;
+    }
+    std::cout << "All checks passed" << std::endl;
+    return 0;
+}
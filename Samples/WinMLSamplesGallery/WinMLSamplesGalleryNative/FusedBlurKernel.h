@@ -0,0 +1,352 @@
+#pragma once
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define FUSED_BLUR_SSE2
+#endif
+
+// CPU version of the post-process of BackgroundBlur (BackgroundBlur::PostProcess builds it as an ONNX graph): the
+// pixels whose highest score is not the background class keep the input image, every other pixel gets the image
+// averaged over a KernelSize x KernelSize window (AveragePool with auto_pad SAME_UPPER, padding not counted).
+//
+// The graph runs nine operators and writes a full-size tensor after each one. This does it in one pass over the rows:
+// the mask of a row is computed once, the box blur keeps a running sum of every column over the window rows and a
+// running sum of those along the row, and the composite goes straight to the output. Rows are split over threads, each
+// with scratch buffers of a few rows' width. A caller that blurs every frame of a video keeps its threads in a
+// BlurWorkers, so that a frame doesn't start and join threads.
+//
+// For images of whole numbers, as converted from 8-bit video frames, every sum is exact and the output is identical
+// bit for bit to the graph's. For other inputs the running sums round differently than the pool's sum of each window.
+// Nothing in here depends on WinML.
+namespace BlurKernel
+{
+    struct BlurShape
+    {
+        size_t Classes = 0;  // channels of the scores; class 0 is the background
+        size_t Channels = 3; // channels of the image
+        size_t Height = 0;
+        size_t Width = 0;
+    };
+
+    // Threads that wait for the rows of the next BlurBackground call. The calls that use them must not overlap, so
+    // callers that blur at the same time each have their own.
+    class BlurWorkers
+    {
+    public:
+        // threads is the number of threads of a call, the calling one included
+        explicit BlurWorkers(size_t threads)
+        {
+            for (size_t thread = 1; thread < threads; thread++)
+            {
+                m_threads.emplace_back([this, thread]() { Work(thread); });
+            }
+        }
+
+        ~BlurWorkers()
+        {
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                m_stopping = true;
+            }
+            m_start.notify_all();
+            for (auto& thread : m_threads)
+            {
+                thread.join();
+            }
+        }
+
+        BlurWorkers(const BlurWorkers&) = delete;
+        BlurWorkers& operator=(const BlurWorkers&) = delete;
+
+        size_t GetThreadCount() const { return m_threads.size() + 1; }
+
+        // Runs task(0) to task(count - 1), task(0) on the calling thread and the others on the workers, and returns
+        // once they all have. count is at most GetThreadCount().
+        void Run(size_t count, const std::function<void(size_t)>& task)
+        {
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                m_task = &task;
+                m_count = count;
+                m_pending = m_threads.size();
+                m_generation++;
+            }
+            m_start.notify_all();
+            task(0);
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_done.wait(lock, [this]() { return m_pending == 0; });
+            m_task = nullptr;
+        }
+
+    private:
+        void Work(size_t thread)
+        {
+            uint64_t generation = 0;
+            std::unique_lock<std::mutex> lock(m_mutex);
+            while (true)
+            {
+                m_start.wait(lock, [this, generation]() { return m_stopping || m_generation != generation; });
+                if (m_stopping)
+                {
+                    return;
+                }
+                generation = m_generation;
+                if (thread < m_count)
+                {
+                    const std::function<void(size_t)>& task = *m_task;
+                    lock.unlock();
+                    task(thread);
+                    lock.lock();
+                }
+                if (--m_pending == 0)
+                {
+                    m_done.notify_one();
+                }
+            }
+        }
+
+        std::vector<std::thread> m_threads;
+        std::mutex m_mutex;
+        std::condition_variable m_start;
+        std::condition_variable m_done;
+        const std::function<void(size_t)>* m_task = nullptr;
+        size_t m_count = 0;
+        size_t m_pending = 0;
+        uint64_t m_generation = 0;
+        bool m_stopping = false;
+    };
+
+    struct BlurOptions
+    {
+        size_t KernelSize = 20;         // the kernel_shape of the AveragePool
+        size_t Threads = 1;             // rows are split over this many threads, the calling one included
+        BlurWorkers* Workers = nullptr; // if set, rows are split over its threads instead of Threads new ones
+    };
+
+    namespace Details
+    {
+        // Sets mask[x] to 1 where a class other than the background scores higher than the background: ArgMax over the
+        // classes picks the first highest score, so the background wins ties, and Clip(0, 1) turns the index into 0/1.
+        inline void RowMask(const float* scores, size_t plane, size_t classes, size_t width, uint8_t* mask)
+        {
+            if (classes < 2)
+            {
+                std::fill(mask, mask + width, static_cast<uint8_t>(0));
+                return;
+            }
+            size_t x = 0;
+#ifdef FUSED_BLUR_SSE2
+            for (; x + 4 <= width; x += 4)
+            {
+                __m128 background = _mm_loadu_ps(scores + x);
+                __m128 best = _mm_loadu_ps(scores + plane + x);
+                for (size_t c = 2; c < classes; c++)
+                {
+                    best = _mm_max_ps(best, _mm_loadu_ps(scores + c * plane + x));
+                }
+                int bits = _mm_movemask_ps(_mm_cmpgt_ps(best, background));
+                for (int lane = 0; lane < 4; lane++)
+                {
+                    mask[x + lane] = static_cast<uint8_t>((bits >> lane) & 1);
+                }
+            }
+#endif
+            for (; x < width; x++)
+            {
+                float best = scores[plane + x];
+                for (size_t c = 2; c < classes; c++)
+                {
+                    best = (std::max)(best, scores[c * plane + x]);
+                }
+                mask[x] = best > scores[x] ? 1 : 0;
+            }
+        }
+
+        inline void AddRow(float* sums, const float* row, size_t width)
+        {
+            size_t x = 0;
+#ifdef FUSED_BLUR_SSE2
+            for (; x + 4 <= width; x += 4)
+            {
+                _mm_storeu_ps(sums + x, _mm_add_ps(_mm_loadu_ps(sums + x), _mm_loadu_ps(row + x)));
+            }
+#endif
+            for (; x < width; x++)
+            {
+                sums[x] += row[x];
+            }
+        }
+
+        inline void SubtractRow(float* sums, const float* row, size_t width)
+        {
+            size_t x = 0;
+#ifdef FUSED_BLUR_SSE2
+            for (; x + 4 <= width; x += 4)
+            {
+                _mm_storeu_ps(sums + x, _mm_sub_ps(_mm_loadu_ps(sums + x), _mm_loadu_ps(row + x)));
+            }
+#endif
+            for (; x < width; x++)
+            {
+                sums[x] -= row[x];
+            }
+        }
+
+        // output[x] = mask[x] ? image[x] : windowSums[x] / counts[x]
+        inline void Composite(const float* image, const float* windowSums, const float* counts, const uint8_t* mask,
+                              size_t width, float* output)
+        {
+            size_t x = 0;
+#ifdef FUSED_BLUR_SSE2
+            for (; x + 4 <= width; x += 4)
+            {
+                __m128 keep = _mm_castsi128_ps(_mm_sub_epi32(
+                    _mm_setzero_si128(), _mm_setr_epi32(mask[x], mask[x + 1], mask[x + 2], mask[x + 3])));
+                __m128 blurred = _mm_div_ps(_mm_loadu_ps(windowSums + x), _mm_loadu_ps(counts + x));
+                __m128 result = _mm_or_ps(_mm_and_ps(keep, _mm_loadu_ps(image + x)), _mm_andnot_ps(keep, blurred));
+                _mm_storeu_ps(output + x, result);
+            }
+#endif
+            for (; x < width; x++)
+            {
+                output[x] = mask[x] ? image[x] : windowSums[x] / counts[x];
+            }
+        }
+
+        // Runs the rows [firstRow, endRow).
+        inline void BlurRows(const float* image, const float* scores, float* output, const BlurShape& shape,
+                             size_t kernelSize, size_t firstRow, size_t endRow)
+        {
+            const size_t height = shape.Height;
+            const size_t width = shape.Width;
+            const size_t plane = height * width;
+            // SAME_UPPER puts the odd padding after: the window of y is [y - before, y + after]
+            const size_t before = (kernelSize - 1) / 2;
+            const size_t after = kernelSize - 1 - before;
+
+            std::vector<uint8_t> mask(width);
+            std::vector<float> columnSums(shape.Channels * width, 0.f); // over the window rows of the current row
+            std::vector<float> windowSums(width);
+            std::vector<float> rowCounts(width);
+            std::vector<float> counts(width);
+            for (size_t x = 0; x < width; x++)
+            {
+                size_t left = x >= before ? x - before : 0;
+                size_t right = (std::min)(x + after, width - 1);
+                rowCounts[x] = static_cast<float>(right - left + 1);
+            }
+
+            for (size_t channel = 0; channel < shape.Channels; channel++)
+            {
+                size_t top = firstRow >= before ? firstRow - before : 0;
+                size_t bottom = (std::min)(firstRow + after, height - 1);
+                for (size_t y = top; y <= bottom; y++)
+                {
+                    AddRow(&columnSums[channel * width], image + channel * plane + y * width, width);
+                }
+            }
+
+            for (size_t y = firstRow; y < endRow; y++)
+            {
+                RowMask(scores + y * width, plane, shape.Classes, width, mask.data());
+                size_t top = y >= before ? y - before : 0;
+                size_t bottom = (std::min)(y + after, height - 1);
+                float rows = static_cast<float>(bottom - top + 1);
+                for (size_t x = 0; x < width; x++)
+                {
+                    counts[x] = rows * rowCounts[x];
+                }
+
+                for (size_t channel = 0; channel < shape.Channels; channel++)
+                {
+                    const float* imagePlane = image + channel * plane;
+                    float* sums = &columnSums[channel * width];
+                    // Running sum along the row, which stays as small as one window, so it is exact for whole numbers
+                    float windowSum = 0.f;
+                    for (size_t x = 0; x <= (std::min)(after, width - 1); x++)
+                    {
+                        windowSum += sums[x];
+                    }
+                    windowSums[0] = windowSum;
+                    for (size_t x = 1; x < width; x++)
+                    {
+                        if (x + after < width)
+                        {
+                            windowSum += sums[x + after];
+                        }
+                        if (x > before)
+                        {
+                            windowSum -= sums[x - before - 1];
+                        }
+                        windowSums[x] = windowSum;
+                    }
+                    Composite(imagePlane + y * width, windowSums.data(), counts.data(), mask.data(), width,
+                              output + channel * plane + y * width);
+
+                    // Slide the window down to the next row
+                    if (y + 1 < endRow)
+                    {
+                        if (y + 1 + after < height)
+                        {
+                            AddRow(sums, imagePlane + (y + 1 + after) * width, width);
+                        }
+                        if (y >= before)
+                        {
+                            SubtractRow(sums, imagePlane + (y - before) * width, width);
+                        }
+                    }
+                }
+            }
+        }
+    } // namespace Details
+
+    // image and output are NCHW with N = 1 and shape.Channels channels, scores has shape.Classes channels of the same
+    // height and width. output must not overlap the inputs.
+    inline void BlurBackground(const float* image, const float* scores, float* output, const BlurShape& shape,
+                               const BlurOptions& options = BlurOptions())
+    {
+        if (shape.Height == 0 || shape.Width == 0 || shape.Channels == 0)
+        {
+            return;
+        }
+        const size_t kernelSize = (std::max)(options.KernelSize, static_cast<size_t>(1));
+
+        // A thread gets at least a window of rows, as it has to sum up that many before its first one
+        const size_t minRows = (std::max)(kernelSize, static_cast<size_t>(8));
+        const size_t available = options.Workers ? options.Workers->GetThreadCount() : options.Threads;
+        const size_t threads = (std::max)(static_cast<size_t>(1), (std::min)(available, shape.Height / minRows));
+        const size_t rowsPerThread = (shape.Height + threads - 1) / threads;
+        auto blurRows = [=, &shape](size_t thread) {
+            size_t firstRow = thread * rowsPerThread;
+            size_t endRow = (std::min)(firstRow + rowsPerThread, shape.Height);
+            if (firstRow < endRow)
+            {
+                Details::BlurRows(image, scores, output, shape, kernelSize, firstRow, endRow);
+            }
+        };
+        if (options.Workers)
+        {
+            options.Workers->Run(threads, blurRows);
+            return;
+        }
+        std::vector<std::thread> workers;
+        for (size_t thread = 1; thread < threads; thread++)
+        {
+            workers.emplace_back(blurRows, thread);
+        }
+        blurRows(0);
+        for (auto& worker : workers)
+        {
+            worker.join();
+        }
+    }
+} // namespace BlurKernel
@@ -0,0 +1,112 @@
+#pragma once
+
+// The post-process graph of BackgroundBlur::PostProcess, run one operator at a time the way the ONNX operators are
+// specified, each writing a full-size tensor. The tests compare the fused kernel with it and the benchmark times both.
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "../FusedBlurKernel.h"
+
+namespace GraphReference
+{
+    using BlurKernel::BlurShape;
+
+    // ArgMax(axis 1, keepdims 1, select_last_index 0): the first class with the highest score.
+    inline std::vector<int64_t> ArgMax(const std::vector<float>& scores, const BlurShape& shape)
+    {
+        size_t plane = shape.Height * shape.Width;
+        std::vector<int64_t> reduced(plane, 0);
+        for (size_t i = 0; i < plane; i++)
+        {
+            float best = scores[i];
+            for (size_t c = 1; c < shape.Classes; c++)
+            {
+                if (scores[c * plane + i] > best)
+                {
+                    best = scores[c * plane + i];
+                    reduced[i] = static_cast<int64_t>(c);
+                }
+            }
+        }
+        return reduced;
+    }
+
+    // AveragePool(kernel_shape k x k, auto_pad SAME_UPPER, strides 1, count_include_pad 0): the sum over the window
+    // inside the image, divided by the number of pixels in it.
+    inline std::vector<float> AveragePool(const std::vector<float>& image, const BlurShape& shape, size_t kernelSize)
+    {
+        size_t height = shape.Height;
+        size_t width = shape.Width;
+        size_t padBefore = (kernelSize - 1) / 2;
+        std::vector<float> pooled(image.size());
+        for (size_t channel = 0; channel < shape.Channels; channel++)
+        {
+            const float* in = image.data() + channel * height * width;
+            for (size_t y = 0; y < height; y++)
+            {
+                for (size_t x = 0; x < width; x++)
+                {
+                    // The window is [y - padBefore, y - padBefore + k), clipped to the image
+                    size_t top = y >= padBefore ? y - padBefore : 0;
+                    size_t bottom = (std::min)(y + kernelSize - padBefore, height);
+                    size_t left = x >= padBefore ? x - padBefore : 0;
+                    size_t right = (std::min)(x + kernelSize - padBefore, width);
+                    float sum = 0.f;
+                    for (size_t wy = top; wy < bottom; wy++)
+                    {
+                        for (size_t wx = left; wx < right; wx++)
+                        {
+                            sum += in[wy * width + wx];
+                        }
+                    }
+                    pooled[channel * height * width + y * width + x] =
+                        sum / static_cast<float>((bottom - top) * (right - left));
+                }
+            }
+        }
+        return pooled;
+    }
+
+    // Elementwise binary operator with the second tensor broadcast over the channels when it has one plane, or a
+    // scalar when it has one element.
+    template <typename Op>
+    inline std::vector<float> Binary(const std::vector<float>& a, const std::vector<float>& b, size_t plane, Op op)
+    {
+        const std::vector<float>& large = a.size() >= b.size() ? a : b;
+        std::vector<float> result(large.size());
+        for (size_t i = 0; i < large.size(); i++)
+        {
+            float left = a.size() == 1 ? a[0] : a.size() == plane ? a[i % plane] : a[i];
+            float right = b.size() == 1 ? b[0] : b.size() == plane ? b[i % plane] : b[i];
+            result[i] = op(left, right);
+        }
+        return result;
+    }
+
+    inline std::vector<float> BlurBackground(const std::vector<float>& image, const std::vector<float>& scores,
+                                             const BlurShape& shape, size_t kernelSize = 20)
+    {
+        size_t plane = shape.Height * shape.Width;
+        auto mul = [](float a, float b) { return a * b; };
+        auto add = [](float a, float b) { return a + b; };
+
+        std::vector<int64_t> reduced = ArgMax(scores, shape);
+        std::vector<float> argmaxOutput(plane); // Cast to float
+        for (size_t i = 0; i < plane; i++)
+        {
+            argmaxOutput[i] = static_cast<float>(reduced[i]);
+        }
+        std::vector<float> maskBinary(plane); // Clip(0, 1)
+        for (size_t i = 0; i < plane; i++)
+        {
+            maskBinary[i] = (std::min)((std::max)(argmaxOutput[i], 0.f), 1.f);
+        }
+        std::vector<float> foregroundImage = Binary(image, maskBinary, plane, mul);
+        std::vector<float> blurredImage = AveragePool(image, shape, kernelSize);
+        std::vector<float> negMask = Binary(maskBinary, { -1.f }, plane, mul);
+        std::vector<float> backgroundMask = Binary({ 1.f }, negMask, plane, add);
+        std::vector<float> backgroundImage = Binary(blurredImage, backgroundMask, plane, mul);
+        return Binary(foregroundImage, backgroundImage, plane, add);
+    }
+} // namespace GraphReference
@@ -0,0 +1,133 @@
+// Times the fused background blur kernel against the post-process graph run one operator at a time, for the model
+// sizes BackgroundBlur runs at (a quarter of the camera frame) and for full frames.
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+#include "GraphReference.h"
+
+using namespace BlurKernel;
+using Clock = std::chrono::steady_clock;
+
+struct BenchmarkArgs
+{
+    int Iterations = 10;
+    size_t Threads = std::max(1u, std::thread::hardware_concurrency());
+    bool SkipGraph = false;
+    bool Help = false;
+};
+
+static void PrintUsage()
+{
+    std::cout << "fused-blur-benchmark [options]" << std::endl;
+    std::cout << "  -Iterations <n> : runs of each size (default 10)" << std::endl;
+    std::cout << "  -Threads <n>    : threads of the fused kernel (default: hardware threads)" << std::endl;
+    std::cout << "  -SkipGraph      : only time the fused kernel" << std::endl;
+    std::cout << "  -Help           : print this message" << std::endl;
+}
+
+static bool ParseArgs(int argc, char** argv, BenchmarkArgs& args)
+{
+    for (int i = 1; i < argc; i++)
+    {
+        std::string option = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (option == "-Help")
+        {
+            args.Help = true;
+        }
+        else if (option == "-SkipGraph")
+        {
+            args.SkipGraph = true;
+        }
+        else if (option == "-Iterations" && hasValue)
+        {
+            args.Iterations = std::max(1, std::atoi(argv[++i]));
+        }
+        else if (option == "-Threads" && hasValue)
+        {
+            args.Threads = static_cast<size_t>(std::max(1, std::atoi(argv[++i])));
+        }
+        else
+        {
+            std::cout << "Unknown option or missing value: " << option << std::endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+template <typename Run> static double MedianMilliseconds(int iterations, Run&& run)
+{
+    std::vector<double> times;
+    for (int i = 0; i < iterations; i++)
+    {
+        Clock::time_point start = Clock::now();
+        run();
+        times.push_back(std::chrono::duration<double, std::milli>(Clock::now() - start).count());
+    }
+    std::sort(times.begin(), times.end());
+    return times[times.size() / 2];
+}
+
+int main(int argc, char** argv)
+{
+    BenchmarkArgs args;
+    if (!ParseArgs(argc, argv, args) || args.Help)
+    {
+        PrintUsage();
+        return args.Help ? 0 : 1;
+    }
+
+    const size_t sizes[][2] = { { 320, 180 }, { 480, 270 }, { 1280, 720 }, { 1920, 1080 } };
+    std::cout << std::left << std::setw(12) << "size" << std::right << std::setw(12) << "graph ms" << std::setw(14)
+              << "fused 1t ms" << std::setw(14) << "fused ms" << std::setw(10) << "speedup" << std::endl;
+    std::mt19937 random(1);
+    // The threads are kept from frame to frame, as BackgroundBlur does
+    BlurWorkers workers(args.Threads);
+    for (auto& size : sizes)
+    {
+        BlurShape shape;
+        shape.Classes = 21;
+        shape.Width = size[0];
+        shape.Height = size[1];
+        std::uniform_int_distribution<int> pixel(0, 255);
+        std::normal_distribution<float> score(0.f, 1.f);
+        std::vector<float> image(shape.Channels * shape.Height * shape.Width);
+        std::vector<float> scores(shape.Classes * shape.Height * shape.Width);
+        for (float& x : image)
+        {
+            x = static_cast<float>(pixel(random));
+        }
+        for (float& x : scores)
+        {
+            x = score(random);
+        }
+        std::vector<float> output(image.size());
+
+        double graph = 0;
+        if (!args.SkipGraph)
+        {
+            graph = MedianMilliseconds(std::max(1, args.Iterations / 5),
+                                       [&]() { output = GraphReference::BlurBackground(image, scores, shape); });
+        }
+        BlurOptions options;
+        double fusedOneThread = MedianMilliseconds(args.Iterations, [&]() {
+            BlurBackground(image.data(), scores.data(), output.data(), shape, options);
+        });
+        options.Workers = &workers;
+        double fused = MedianMilliseconds(args.Iterations, [&]() {
+            BlurBackground(image.data(), scores.data(), output.data(), shape, options);
+        });
+        std::cout << std::left << std::setw(12) << (std::to_string(size[0]) + "x" + std::to_string(size[1]))
+                  << std::right << std::fixed << std::setprecision(2) << std::setw(12) << graph << std::setw(14)
+                  << fusedOneThread << std::setw(14) << fused << std::setw(9) << (fused > 0 ? graph / fused : 0)
+                  << "x" << std::endl;
+    }
+    return 0;
+}
@@ -0,0 +1,220 @@
+// Tests of the fused background blur kernel against the post-process graph of BackgroundBlur, run one operator at a
+// time. Images of whole numbers from 0 to 255, as converted from video frames, must come out identical bit for bit,
+// for any size, kernel and thread count; other images within a rounding tolerance. Exits with 1 if a check fails.
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+#include "GraphReference.h"
+
+using namespace BlurKernel;
+
+static int g_failures = 0;
+
+static void Check(bool condition, const std::string& test, const std::string& message)
+{
+    if (!condition)
+    {
+        std::cout << "FAILED " << test << ": " << message << std::endl;
+        g_failures++;
+    }
+}
+
+static std::string Describe(const BlurShape& shape, const BlurOptions& options)
+{
+    return std::to_string(shape.Width) + "x" + std::to_string(shape.Height) + ", " + std::to_string(shape.Classes) +
+           " classes, kernel " + std::to_string(options.KernelSize) + ", " + std::to_string(options.Threads) +
+           " threads";
+}
+
+static std::vector<float> MakeImage(const BlurShape& shape, std::mt19937& random, bool wholeNumbers)
+{
+    std::uniform_int_distribution<int> pixel(0, 255);
+    std::uniform_real_distribution<float> value(0.f, 255.f);
+    std::vector<float> image(shape.Channels * shape.Height * shape.Width);
+    for (float& x : image)
+    {
+        x = wholeNumbers ? static_cast<float>(pixel(random)) : value(random);
+    }
+    return image;
+}
+
+// Scores on a coarse grid of values, so that ties between the background and other classes are common.
+static std::vector<float> MakeScores(const BlurShape& shape, std::mt19937& random)
+{
+    std::uniform_int_distribution<int> score(-4, 4);
+    std::vector<float> scores(shape.Classes * shape.Height * shape.Width);
+    for (float& x : scores)
+    {
+        x = static_cast<float>(score(random)) * 0.5f;
+    }
+    return scores;
+}
+
+static std::vector<float> RunKernel(const std::vector<float>& image, const std::vector<float>& scores,
+                                    const BlurShape& shape, const BlurOptions& options)
+{
+    std::vector<float> output(image.size(), -1.f);
+    BlurBackground(image.data(), scores.data(), output.data(), shape, options);
+    return output;
+}
+
+static size_t CountBitDifferences(const std::vector<float>& a, const std::vector<float>& b)
+{
+    size_t differences = 0;
+    for (size_t i = 0; i < a.size(); i++)
+    {
+        differences += std::memcmp(&a[i], &b[i], sizeof(float)) != 0 ? 1 : 0;
+    }
+    return differences;
+}
+
+// Bit for bit against the graph for 8-bit images, over sizes around and below the kernel, widths that are not a
+// multiple of the SIMD width, odd and even kernels, and thread counts beyond the number of rows.
+static void TestMatchesGraphBitForBit()
+{
+    const std::string test = "matches graph bit for bit";
+    const size_t sizes[][2] = { { 1, 1 }, { 3, 5 }, { 7, 4 }, { 19, 21 }, { 20, 20 }, { 33, 17 }, { 64, 48 },
+                                { 130, 90 }, { 320, 180 } };
+    const size_t kernels[] = { 1, 2, 5, 20 };
+    const size_t threadCounts[] = { 1, 3, 8 };
+    std::mt19937 random(5);
+    for (auto& size : sizes)
+    {
+        for (size_t kernelSize : kernels)
+        {
+            BlurShape shape;
+            shape.Classes = 21;
+            shape.Width = size[0];
+            shape.Height = size[1];
+            std::vector<float> image = MakeImage(shape, random, true);
+            std::vector<float> scores = MakeScores(shape, random);
+            std::vector<float> expected = GraphReference::BlurBackground(image, scores, shape, kernelSize);
+            for (size_t threads : threadCounts)
+            {
+                BlurOptions options;
+                options.KernelSize = kernelSize;
+                options.Threads = threads;
+                size_t differences = CountBitDifferences(RunKernel(image, scores, shape, options), expected);
+                Check(differences == 0, test,
+                      Describe(shape, options) + ": " + std::to_string(differences) + " values differ");
+            }
+        }
+    }
+}
+
+// A larger frame, where the running sums get as far from a window as they go and every thread has many rows.
+static void TestLargeFrame()
+{
+    const std::string test = "large frame";
+    BlurShape shape;
+    shape.Classes = 21;
+    shape.Width = 640;
+    shape.Height = 360;
+    std::mt19937 random(7);
+    std::vector<float> image = MakeImage(shape, random, true);
+    std::vector<float> scores = MakeScores(shape, random);
+    std::vector<float> expected = GraphReference::BlurBackground(image, scores, shape);
+    BlurOptions options;
+    options.Threads = 4;
+    size_t differences = CountBitDifferences(RunKernel(image, scores, shape, options), expected);
+    Check(differences == 0, test, std::to_string(differences) + " values differ");
+}
+
+// Pixels where the background ties with another class are blurred, as ArgMax picks the first highest score; with a
+// single class everything is.
+static void TestTiesAndSingleClass()
+{
+    const std::string test = "ties and single class";
+    BlurShape shape;
+    shape.Classes = 3;
+    shape.Width = 6;
+    shape.Height = 6;
+    std::mt19937 random(3);
+    std::vector<float> image = MakeImage(shape, random, true);
+    std::vector<float> scores(shape.Classes * 36, 1.f);
+    scores[2 * 36 + 7] = 2.f; // pixel 7 is foreground, every other one a tie
+    std::vector<float> output = RunKernel(image, scores, shape, BlurOptions());
+    std::vector<float> expected = GraphReference::BlurBackground(image, scores, shape);
+    Check(CountBitDifferences(output, expected) == 0, test, "ties differ from the graph");
+    Check(output[7] == image[7] && output[36 + 7] == image[36 + 7], test, "the foreground pixel was blurred");
+    std::vector<float> blurred = GraphReference::AveragePool(image, shape, 20);
+    Check(output[8] == blurred[8], test, "a tie was not blurred");
+
+    shape.Classes = 1;
+    scores.assign(36, 3.f);
+    Check(CountBitDifferences(RunKernel(image, scores, shape, BlurOptions()), blurred) == 0, test,
+          "a single class did not blur everything");
+}
+
+// Other images round differently, but not by much.
+static void TestMatchesGraphWithinTolerance()
+{
+    const std::string test = "matches graph within tolerance";
+    BlurShape shape;
+    shape.Classes = 21;
+    shape.Width = 160;
+    shape.Height = 90;
+    std::mt19937 random(9);
+    std::vector<float> image = MakeImage(shape, random, false);
+    std::vector<float> scores = MakeScores(shape, random);
+    std::vector<float> expected = GraphReference::BlurBackground(image, scores, shape);
+    BlurOptions options;
+    options.Threads = 2;
+    std::vector<float> output = RunKernel(image, scores, shape, options);
+    float largest = 0.f;
+    for (size_t i = 0; i < output.size(); i++)
+    {
+        largest = (std::max)(largest, std::fabs(output[i] - expected[i]));
+    }
+    Check(largest < 1e-3f, test, "largest difference " + std::to_string(largest));
+}
+
+// Workers kept from one call to the next, as for the frames of a video, give the same output as new threads, also when a
+// frame uses fewer of them than there are.
+static void TestWorkersMatchGraph()
+{
+    const std::string test = "workers match graph";
+    const size_t sizes[][2] = { { 320, 180 }, { 33, 17 }, { 640, 360 }, { 7, 4 }, { 320, 180 } };
+    std::mt19937 random(11);
+    for (size_t threads : { 1, 4 })
+    {
+        BlurWorkers workers(threads);
+        Check(workers.GetThreadCount() == threads, test, "wrong number of threads");
+        for (auto& size : sizes)
+        {
+            BlurShape shape;
+            shape.Classes = 21;
+            shape.Width = size[0];
+            shape.Height = size[1];
+            std::vector<float> image = MakeImage(shape, random, true);
+            std::vector<float> scores = MakeScores(shape, random);
+            std::vector<float> expected = GraphReference::BlurBackground(image, scores, shape);
+            BlurOptions options;
+            options.Workers = &workers;
+            size_t differences = CountBitDifferences(RunKernel(image, scores, shape, options), expected);
+            Check(differences == 0, test,
+                  std::to_string(size[0]) + "x" + std::to_string(size[1]) + ", " + std::to_string(threads) +
+                      " workers: " + std::to_string(differences) + " values differ");
+        }
+    }
+}
+
+int main()
+{
+    TestMatchesGraphBitForBit();
+    TestLargeFrame();
+    TestTiesAndSingleClass();
+    TestMatchesGraphWithinTolerance();
+    TestWorkersMatchGraph();
+    if (g_failures > 0)
+    {
+        std::cout << g_failures << " checks failed" << std::endl;
+        return 1;
+    }
+    std::cout << "All checks passed" << std::endl;
+    return 0;
+}
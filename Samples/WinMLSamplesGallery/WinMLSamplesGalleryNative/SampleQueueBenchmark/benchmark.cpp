@@ -0,0 +1,239 @@
+// Contention benchmark of the lock free sample queue against the locked linked list it replaced, which allocated a
+// node per sample and took a recursive mutex for every push and pop. Producers and consumers run on their own threads
+// and pass a fixed number of values through each queue; the result is the throughput in values per second.
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include "../External/MpmcRingQueue.h"
+
+// The queue of the sample before: a singly linked list behind a recursive mutex, one allocation per value.
+template <typename T> class LockedListQueue
+{
+public:
+    explicit LockedListQueue(size_t) {}
+
+    ~LockedListQueue()
+    {
+        T value;
+        while (TryPop(value))
+        {
+        }
+    }
+
+    bool TryPush(const T& value)
+    {
+        Node* node = new Node{ value, nullptr };
+        std::lock_guard<std::recursive_mutex> lock(m_mutex);
+        if (m_tail == nullptr)
+        {
+            m_head = node;
+        }
+        else
+        {
+            m_tail->Next = node;
+        }
+        m_tail = node;
+        return true;
+    }
+
+    bool TryPop(T& value)
+    {
+        Node* node;
+        {
+            std::lock_guard<std::recursive_mutex> lock(m_mutex);
+            node = m_head;
+            if (node == nullptr)
+            {
+                return false;
+            }
+            m_head = node->Next;
+            if (m_head == nullptr)
+            {
+                m_tail = nullptr;
+            }
+        }
+        value = node->Value;
+        delete node;
+        return true;
+    }
+
+private:
+    struct Node
+    {
+        T Value;
+        Node* Next;
+    };
+
+    Node* m_head = nullptr;
+    Node* m_tail = nullptr;
+    std::recursive_mutex m_mutex;
+};
+
+struct BenchmarkArgs
+{
+    std::vector<unsigned int> ThreadCounts;
+    uint64_t Values = 2000000;
+    size_t Capacity = 64;
+    uint32_t Repeats = 3;
+    bool Help = false;
+};
+
+static void PrintUsage()
+{
+    std::cout << "sample-queue-benchmark [options]" << std::endl;
+    std::cout << "  -Threads <counts>  : comma separated producer counts, each run with as many consumers. Default: "
+                 "1, 2, 4, ... up to half the hardware thread count"
+              << std::endl;
+    std::cout << "  -Values <n>        : values passed through the queue per run (default 2000000)" << std::endl;
+    std::cout << "  -Capacity <n>      : slots of the lock free queue (default 64)" << std::endl;
+    std::cout << "  -Repeats <n>       : runs per configuration, the fastest one is reported (default 3)"
+              << std::endl;
+    std::cout << "  -Help              : print this message" << std::endl;
+}
+
+static bool ParseArgs(int argc, char** argv, BenchmarkArgs& args)
+{
+    for (int i = 1; i < argc; i++)
+    {
+        std::string option = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (option == "-Threads" && hasValue)
+        {
+            std::stringstream counts(argv[++i]);
+            std::string count;
+            while (std::getline(counts, count, ','))
+            {
+                args.ThreadCounts.push_back(static_cast<unsigned int>(std::max(1, std::atoi(count.c_str()))));
+            }
+        }
+        else if (option == "-Values" && hasValue)
+        {
+            args.Values = std::max(1ll, std::atoll(argv[++i]));
+        }
+        else if (option == "-Capacity" && hasValue)
+        {
+            args.Capacity = static_cast<size_t>(std::max(1ll, std::atoll(argv[++i])));
+        }
+        else if (option == "-Repeats" && hasValue)
+        {
+            args.Repeats = static_cast<uint32_t>(std::max(1, std::atoi(argv[++i])));
+        }
+        else if (option == "-Help")
+        {
+            args.Help = true;
+        }
+        else
+        {
+            std::cout << "Unknown option or missing value: " << option << std::endl;
+            return false;
+        }
+    }
+    if (args.ThreadCounts.empty())
+    {
+        unsigned int half = std::max(std::thread::hardware_concurrency() / 2, 1u);
+        for (unsigned int count = 1; count <= half; count *= 2)
+        {
+            args.ThreadCounts.push_back(count);
+        }
+    }
+    return true;
+}
+
+// Seconds to pass values through a queue with the given number of producers and consumers. Threads retry with a
+// yield when the queue is full or empty, the same back-pressure the transform applies.
+template <typename Queue> static double RunOnce(unsigned int threads, uint64_t values, size_t capacity)
+{
+    Queue queue(capacity);
+    std::atomic<bool> start{ false };
+    std::atomic<uint64_t> popped{ 0 };
+    std::vector<std::thread> workers;
+    uint64_t perProducer = values / threads;
+    uint64_t total = perProducer * threads;
+    for (unsigned int p = 0; p < threads; p++)
+    {
+        workers.emplace_back([&]() {
+            while (!start)
+            {
+                std::this_thread::yield();
+            }
+            for (uint64_t i = 0; i < perProducer; i++)
+            {
+                while (!queue.TryPush(i))
+                {
+                    std::this_thread::yield();
+                }
+            }
+        });
+        workers.emplace_back([&]() {
+            while (!start)
+            {
+                std::this_thread::yield();
+            }
+            uint64_t value;
+            while (popped.load(std::memory_order_relaxed) < total)
+            {
+                if (queue.TryPop(value))
+                {
+                    popped.fetch_add(1, std::memory_order_relaxed);
+                }
+                else
+                {
+                    std::this_thread::yield();
+                }
+            }
+        });
+    }
+    auto begin = std::chrono::steady_clock::now();
+    start = true;
+    for (auto& worker : workers)
+    {
+        worker.join();
+    }
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+}
+
+template <typename Queue> static double Run(unsigned int threads, const BenchmarkArgs& args)
+{
+    double best = 0;
+    for (uint32_t repeat = 0; repeat < args.Repeats; repeat++)
+    {
+        double seconds = RunOnce<Queue>(threads, args.Values, args.Capacity);
+        best = repeat == 0 ? seconds : std::min(best, seconds);
+    }
+    return best;
+}
+
+int main(int argc, char** argv)
+{
+    BenchmarkArgs args;
+    if (!ParseArgs(argc, argv, args) || args.Help)
+    {
+        PrintUsage();
+        return args.Help ? 0 : 1;
+    }
+
+    std::cout << std::left << std::setw(24) << "producers x consumers" << std::setw(18) << "locked list M/s"
+              << std::setw(18) << "lock free M/s"
+              << "speedup" << std::endl;
+    for (unsigned int threads : args.ThreadCounts)
+    {
+        double locked = Run<LockedListQueue<uint64_t>>(threads, args);
+        double lockFree = Run<SampleQueue::MpmcRingQueue<uint64_t>>(threads, args);
+        double values = static_cast<double>(args.Values / threads * threads);
+        std::ostringstream name;
+        name << threads << " x " << threads;
+        std::cout << std::left << std::setw(24) << name.str() << std::fixed << std::setprecision(2) << std::setw(18)
+                  << values / locked / 1e6 << std::setw(18) << values / lockFree / 1e6 << locked / lockFree << "x"
+                  << std::endl;
+    }
+    return 0;
+}
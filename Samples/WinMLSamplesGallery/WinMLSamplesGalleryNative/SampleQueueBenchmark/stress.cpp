@@ -0,0 +1,245 @@
+// Stress tests of the lock free sample queue. Every test hammers a small queue from several threads so that it wraps
+// around and fills up many times, then checks that every value came out exactly once and in order per producer.
+// Exits with 1 on the first failure; meant to also run under -fsanitize=thread.
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include "../External/MpmcRingQueue.h"
+
+using SampleQueue::MpmcRingQueue;
+
+static int g_failures = 0;
+
+static void Check(bool condition, const std::string& test, const std::string& message)
+{
+    if (!condition)
+    {
+        std::cout << "FAILED " << test << ": " << message << std::endl;
+        g_failures++;
+    }
+}
+
+static void TestSingleThread()
+{
+    const std::string test = "single-thread";
+    MpmcRingQueue<int> queue(5);
+    Check(queue.Capacity() == 8, test, "capacity is not rounded up to a power of two");
+    Check(MpmcRingQueue<int>(0).Capacity() == 2, test, "capacity is less than 2");
+
+    // Fill and drain a few times so the positions lap the ring
+    for (int lap = 0; lap < 3; lap++)
+    {
+        for (int i = 0; i < 8; i++)
+        {
+            Check(queue.TryPush(lap * 8 + i), test, "push into a queue with room failed");
+        }
+        Check(!queue.TryPush(-1), test, "push into a full queue succeeded");
+        Check(queue.Size() == 8, test, "size of a full queue");
+        for (int i = 0; i < 8; i++)
+        {
+            int value = -1;
+            Check(queue.TryPop(value) && value == lap * 8 + i, test, "values do not come out in order");
+        }
+        int value = -1;
+        Check(!queue.TryPop(value) && value == -1, test, "pop from an empty queue succeeded");
+        Check(queue.IsEmpty(), test, "drained queue is not empty");
+    }
+
+    SampleQueue::QueueStatistics statistics = queue.GetStatistics();
+    Check(statistics.Pushed == 24 && statistics.Popped == 24 && statistics.Refused == 3, test, "statistics");
+
+    queue.TryPush(1);
+    queue.TryPush(2);
+    Check(queue.Clear() == 2 && queue.IsEmpty(), test, "clear");
+}
+
+// Popped and cleared values must not stay alive in their slots.
+static void TestReleasesValues()
+{
+    const std::string test = "releases-values";
+    auto value = std::make_shared<int>(42);
+    MpmcRingQueue<std::shared_ptr<int>> queue(4);
+    for (int i = 0; i < 4; i++)
+    {
+        queue.TryPush(value);
+    }
+    Check(!queue.TryPush(value), test, "push into a full queue succeeded");
+    Check(value.use_count() == 5, test, "a refused push kept a reference");
+    {
+        std::shared_ptr<int> popped;
+        queue.TryPop(popped);
+        Check(popped == value, test, "popped value");
+    }
+    Check(value.use_count() == 4, test, "the slot of a popped value still holds it");
+    queue.Clear();
+    Check(value.use_count() == 1, test, "clear kept a reference");
+}
+
+// Producers push (producer, sequence) pairs, retrying while the queue is full, consumers pop until every value is
+// accounted for. Each value must be popped once, and one consumer must see the values of a producer in order.
+static void TestProducersConsumers(unsigned int producers, unsigned int consumers, size_t capacity,
+                                   uint32_t valuesPerProducer)
+{
+    const std::string test = "mpmc " + std::to_string(producers) + "x" + std::to_string(consumers) + " capacity " +
+                             std::to_string(capacity);
+    MpmcRingQueue<uint64_t> queue(capacity);
+    std::vector<std::atomic<uint32_t>> seen(static_cast<size_t>(producers) * valuesPerProducer);
+    std::atomic<uint64_t> remaining{ static_cast<uint64_t>(producers) * valuesPerProducer };
+    std::atomic<bool> outOfOrder{ false };
+    std::atomic<bool> badValue{ false };
+    std::atomic<uint64_t> fullRetries{ 0 };
+
+    std::vector<std::thread> threads;
+    for (unsigned int p = 0; p < producers; p++)
+    {
+        threads.emplace_back([&, p]() {
+            for (uint32_t i = 0; i < valuesPerProducer; i++)
+            {
+                uint64_t value = (static_cast<uint64_t>(p) << 32) | i;
+                while (!queue.TryPush(value))
+                {
+                    fullRetries.fetch_add(1, std::memory_order_relaxed);
+                    std::this_thread::yield();
+                }
+            }
+        });
+    }
+    for (unsigned int c = 0; c < consumers; c++)
+    {
+        threads.emplace_back([&]() {
+            std::vector<int64_t> last(producers, -1);
+            uint64_t value;
+            while (remaining.load(std::memory_order_relaxed) > 0)
+            {
+                if (!queue.TryPop(value))
+                {
+                    std::this_thread::yield();
+                    continue;
+                }
+                uint32_t producer = static_cast<uint32_t>(value >> 32);
+                uint32_t index = static_cast<uint32_t>(value);
+                if (producer >= producers || index >= valuesPerProducer)
+                {
+                    badValue = true;
+                    remaining--;
+                    continue;
+                }
+                if (static_cast<int64_t>(index) <= last[producer])
+                {
+                    outOfOrder = true;
+                }
+                last[producer] = index;
+                seen[static_cast<size_t>(producer) * valuesPerProducer + index]++;
+                remaining--;
+            }
+        });
+    }
+    for (auto& thread : threads)
+    {
+        thread.join();
+    }
+
+    size_t missing = 0;
+    size_t duplicated = 0;
+    for (auto& count : seen)
+    {
+        missing += count == 0 ? 1 : 0;
+        duplicated += count > 1 ? 1 : 0;
+    }
+    Check(!badValue, test, "popped a value that was never pushed");
+    Check(missing == 0, test, std::to_string(missing) + " values were lost");
+    Check(duplicated == 0, test, std::to_string(duplicated) + " values were popped more than once");
+    Check(!outOfOrder, test, "a consumer saw the values of a producer out of order");
+    Check(queue.IsEmpty(), test, "queue is not empty after every value was popped");
+    SampleQueue::QueueStatistics statistics = queue.GetStatistics();
+    Check(statistics.Refused == fullRetries, test, "refused pushes are not counted");
+    std::cout << test << ": " << seen.size() << " values, " << fullRetries << " pushes refused while full"
+              << std::endl;
+}
+
+// Clear racing with producers and consumers, the way a flush races with the evaluation workers: nothing may be lost
+// or counted twice.
+static void TestClearWhileRunning()
+{
+    const std::string test = "clear-while-running";
+    const uint32_t valuesPerProducer = 100000;
+    const unsigned int producers = 3;
+    MpmcRingQueue<uint32_t> queue(16);
+    std::atomic<bool> producing{ true };
+    std::atomic<uint64_t> pushed{ 0 };
+    std::atomic<uint64_t> removed{ 0 };
+
+    std::vector<std::thread> threads;
+    for (unsigned int p = 0; p < producers; p++)
+    {
+        threads.emplace_back([&]() {
+            for (uint32_t i = 0; i < valuesPerProducer; i++)
+            {
+                while (!queue.TryPush(i))
+                {
+                    std::this_thread::yield();
+                }
+                pushed++;
+            }
+        });
+    }
+    threads.emplace_back([&]() {
+        uint32_t value;
+        while (producing)
+        {
+            if (queue.TryPop(value))
+            {
+                removed++;
+            }
+            else
+            {
+                std::this_thread::yield();
+            }
+        }
+    });
+    threads.emplace_back([&]() {
+        while (producing)
+        {
+            removed += queue.Clear();
+            std::this_thread::yield();
+        }
+    });
+    for (unsigned int p = 0; p < producers; p++)
+    {
+        threads[p].join();
+    }
+    producing = false;
+    threads[producers].join();
+    threads[producers + 1].join();
+    removed += queue.Clear();
+
+    Check(pushed == static_cast<uint64_t>(producers) * valuesPerProducer, test, "pushes");
+    Check(removed == pushed, test,
+          std::to_string(pushed.load()) + " pushed but " + std::to_string(removed.load()) + " removed");
+}
+
+int main()
+{
+    unsigned int cores = (std::max)(std::thread::hardware_concurrency(), 2u);
+    TestSingleThread();
+    TestReleasesValues();
+    TestProducersConsumers(1, 1, 2, 200000);
+    TestProducersConsumers(4, 1, 8, 50000);
+    TestProducersConsumers(1, 4, 8, 200000);
+    TestProducersConsumers(4, 4, 4, 50000);
+    TestProducersConsumers(cores, cores, 64, 20000);
+    TestClearWhileRunning();
+    if (g_failures > 0)
+    {
+        std::cout << g_failures << " checks failed" << std::endl;
+        return 1;
+    }
+    std::cout << "All checks passed" << std::endl;
+    return 0;
+}
@@ -2,6 +2,8 @@
 #include "SegmentModel.h"
 #include <iostream>
 #include <filesystem>
+#include <MemoryBuffer.h>
+#include "FusedBlurKernel.h"
 
 using winrt::Windows::Foundation::PropertyValue;
 using winrt::hstring;
@@ -66,7 +68,7 @@ void StyleTransfer::Run(IDirect3DSurface src, IDirect3DSurface dest)
     m_binding.Bind(outputName, m_outputVideoFrame, outputBindProperties); 
     auto results = m_session.Evaluate(m_binding, L"");
 
-    m_outputVideoFrame.CopyToAsync(outVideoFrame).get();
+    FinishVideoFrames(outVideoFrame);
 
     m_syncStarted = false;
 }
@@ -91,6 +93,18 @@ void BackgroundBlur::InitializeSession(int w, int h)
     auto modelExperimental1 = LearningModelExperimental(Normalize0_1ThenZScore(h, w, 3, m_mean, m_stddev));
     LearningModel intermediateModel = modelExperimental1.JoinModel(GetModel(), joinOptions1);
 
+    if (m_postProcess == BlurPostProcess::FusedCpu)
+    {
+        // The model outputs the scores and the image, RunFusedPostProcess does the rest
+        m_session = CreateLearningModelSession(intermediateModel);
+        m_binding = LearningModelBinding(m_session);
+        m_blurredImage = TensorFloat::Create({ 1, 3, h, w });
+        m_imageSession = CreateLearningModelSession(TensorToImage(1, 3, h, w));
+        m_imageBinding = LearningModelBinding(m_imageSession);
+        m_blurWorkers = std::make_unique<BlurKernel::BlurWorkers>(m_fusedThreads);
+        return;
+    }
+
     auto joinOptions2 = LearningModelJoinOptions();
     joinOptions2.CloseModelOnJoin(true);
     joinOptions2.Link(L"FCN_out", L"InputScores");
@@ -126,15 +140,71 @@ void BackgroundBlur::Run(IDirect3DSurface src, IDirect3DSurface dest)
     assert((UINT32)m_inputVideoFrame.Direct3DSurface().Description().Width == m_imageWidthInPixels);
 
     hstring inputName = m_session.Model().InputFeatures().GetAt(0).Name();
-    hstring outputName = m_session.Model().OutputFeatures().GetAt(1).Name();
-
     m_binding.Bind(inputName, m_inputVideoFrame);
-    m_binding.Bind(outputName, m_outputVideoFrame);
-    auto results = m_session.Evaluate(m_binding, L"");
-    m_outputVideoFrame.CopyToAsync(outVideoFrame).get();
+
+    if (m_postProcess == BlurPostProcess::FusedCpu)
+    {
+        auto results = m_session.Evaluate(m_binding, L"");
+        RunFusedPostProcess(results.Outputs().Lookup(L"OutputImageForward").as<TensorFloat>(),
+            results.Outputs().Lookup(L"FCN_out").as<TensorFloat>());
+        m_imageBinding.Bind(m_imageSession.Model().InputFeatures().GetAt(0).Name(), m_blurredImage);
+        m_imageBinding.Bind(m_imageSession.Model().OutputFeatures().GetAt(0).Name(), m_outputVideoFrame);
+        m_imageSession.Evaluate(m_imageBinding, L"");
+    }
+    else
+    {
+        hstring outputName = m_session.Model().OutputFeatures().GetAt(1).Name();
+        m_binding.Bind(outputName, m_outputVideoFrame);
+        auto results = m_session.Evaluate(m_binding, L"");
+    }
+    FinishVideoFrames(outVideoFrame);
     m_syncStarted = false;
 }
 
+// Raw data of a CPU tensor, valid while reference is open
+static float* TensorData(const winrt::Windows::Foundation::IMemoryBufferReference& reference)
+{
+    BYTE* data = nullptr;
+    UINT32 capacity = 0;
+    check_hresult(reference.as<::Windows::Foundation::IMemoryBufferByteAccess>()->GetBuffer(&data, &capacity));
+    return reinterpret_cast<float*>(data);
+}
+
+// Same as PostProcess, in one pass over the model outputs and with no intermediate tensors. 
+void BackgroundBlur::RunFusedPostProcess(const TensorFloat& image, const TensorFloat& scores)
+{
+    auto scoresShape = scores.Shape();
+    BlurKernel::BlurShape shape;
+    shape.Classes = static_cast<size_t>(scoresShape.GetAt(1));
+    shape.Channels = 3;
+    shape.Height = static_cast<size_t>(scoresShape.GetAt(2));
+    shape.Width = static_cast<size_t>(scoresShape.GetAt(3));
+    BlurKernel::BlurOptions options;
+    options.KernelSize = 20; // kernel_shape of the AveragePool in PostProcess
+    options.Workers = m_blurWorkers.get();
+
+    auto imageReference = image.CreateReference();
+    auto scoresReference = scores.CreateReference();
+    auto outputReference = m_blurredImage.CreateReference();
+    BlurKernel::BlurBackground(TensorData(imageReference), TensorData(scoresReference), TensorData(outputReference),
+        shape, options);
+    imageReference.Close();
+    scoresReference.Close();
+    outputReference.Close();
+}
+
+LearningModel BackgroundBlur::TensorToImage(long n, long c, long h, long w)
+{
+    // Binding the output to a VideoFrame has WinML convert the tensor to the image
+    auto builder = LearningModelBuilder::Create(opset)
+        .Inputs().Add(LearningModelBuilder::CreateTensorFeatureDescriptor(L"Input", TensorKind::Float, { n, c, h, w }))
+        .Outputs().Add(LearningModelBuilder::CreateTensorFeatureDescriptor(L"Output", TensorKind::Float, { n, c, h, w }))
+        .Operators().Add(LearningModelOperator(L"Identity")
+            .SetInput(L"input", L"Input")
+            .SetOutput(L"output", L"Output"));
+    return builder.CreateModel();
+}
+
 LearningModel BackgroundBlur::PostProcess(long n, long c, long h, long w, long axis)
 {
     auto builder = LearningModelBuilder::Create(opset)
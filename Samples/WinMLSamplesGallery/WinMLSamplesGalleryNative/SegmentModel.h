@@ -11,11 +11,15 @@
 #include <winrt/base.h>
 #include <dxgi.h>
 #include <d3d11.h>
+#include <memory>
 #include <mutex>
 #include <winrt/windows.foundation.collections.h>
 #include <winrt/Windows.Media.h>
 //#include <DXProgrammableCapture.h>
+#include <windows.graphics.directx.direct3d11.interop.h>
 #include "External/common.h"
+#include "FramePool.h"
+#include "FusedBlurKernel.h"
 
 
 using namespace winrt::Microsoft::AI::MachineLearning;
@@ -41,8 +45,9 @@ public:
     virtual ~StreamModelBase() {
         if(m_session) m_session.Close();
         if(m_binding) m_binding.Clear();
-        if (m_inputVideoFrame) m_inputVideoFrame.Close();
-        if (m_outputVideoFrame) m_outputVideoFrame.Close(); 
+        m_inputFrameLease.Return();
+        m_outputFrameLease.Return();
+        m_framePool.reset(); // Closes the pooled frames
     };
 
     virtual void InitializeSession(int w, int h) = 0;
@@ -55,27 +60,89 @@ public:
     winrt::hstring m_modelBasePath;
 
 protected:
-    // Cache input frames into a shareable d3d-backed VideoFrame
+    using FramePool = FrameResources::FramePool<VideoFrame>;
+
+    // Picks the input and output VideoFrames to bind for one frame. A frame is bound as it is when its surface is
+    // shareable and already has the model's format and size. Otherwise a frame from the pool stands in for it: the
+    // input is copied into it here and FinishVideoFrames copies the output back, so each side costs at most one copy.
     void SetVideoFrames(VideoFrame inVideoFrame, VideoFrame outVideoFrame) 
     {
-        if (true || !m_videoFramesSet)
+        if (!m_framePool)
         {
             auto device = m_session.Device().Direct3D11Device();
-            auto inDesc = inVideoFrame.Direct3DSurface().Description();
-            auto outDesc = outVideoFrame.Direct3DSurface().Description();
-            /*
-                NOTE: VideoFrame::CreateAsDirect3D11SurfaceBacked takes arguments in (width, height) order
-                whereas every model created with LearningModelBuilder takes arguments in (height, width) order. 
-            */ 
-            auto format = winrt::Windows::Graphics::DirectX::DirectXPixelFormat::B8G8R8X8UIntNormalized;
-            m_inputVideoFrame = VideoFrame::CreateAsDirect3D11SurfaceBacked(format, m_imageWidthInPixels, m_imageHeightInPixels, device);
-            m_outputVideoFrame = VideoFrame::CreateAsDirect3D11SurfaceBacked(format, m_imageWidthInPixels, m_imageHeightInPixels, device);
-            m_videoFramesSet = true;
+            m_framePool = std::make_unique<FramePool>(
+                [device](const FrameResources::FrameKey& key) {
+                    /*
+                        NOTE: VideoFrame::CreateAsDirect3D11SurfaceBacked takes arguments in (width, height) order
+                        whereas every model created with LearningModelBuilder takes arguments in (height, width) order. 
+                    */ 
+                    return VideoFrame::CreateAsDirect3D11SurfaceBacked(
+                        static_cast<winrt::Windows::Graphics::DirectX::DirectXPixelFormat>(key.Format), key.Width, key.Height, device);
+                },
+                [](VideoFrame& frame) { if (frame) frame.Close(); });
         }
+        FrameResources::FrameKey key = { static_cast<int32_t>(m_format), m_imageWidthInPixels, m_imageHeightInPixels };
+
         // NOTE: WinML supports mainly RGB-formatted video frames, which aren't backed by a shareable surface by the Capture Engine. 
-        // Copying to a new VideoFrame makes it shareable for use in inference. 
-        inVideoFrame.CopyToAsync(m_inputVideoFrame).get();
-        outVideoFrame.CopyToAsync(m_outputVideoFrame).get();
+        // Copying to a VideoFrame from the pool makes it shareable for use in inference. 
+        if (CanBindDirectly(inVideoFrame))
+        {
+            m_inputVideoFrame = inVideoFrame;
+        }
+        else
+        {
+            m_inputFrameLease = m_framePool->Acquire(key);
+            m_inputVideoFrame = m_inputFrameLease.Get();
+            inVideoFrame.CopyToAsync(m_inputVideoFrame).get();
+        }
+
+        // The output is overwritten by the model, so there is nothing to copy in
+        if (CanBindDirectly(outVideoFrame))
+        {
+            m_outputVideoFrame = outVideoFrame;
+        }
+        else
+        {
+            m_outputFrameLease = m_framePool->Acquire(key);
+            m_outputVideoFrame = m_outputFrameLease.Get();
+        }
+        m_videoFramesSet = true;
+    }
+
+    // Copies the output to outVideoFrame unless it was bound directly, and gives the frames back to the pool.
+    void FinishVideoFrames(VideoFrame outVideoFrame)
+    {
+        if (m_outputFrameLease)
+        {
+            m_outputVideoFrame.CopyToAsync(outVideoFrame).get();
+        }
+        m_inputFrameLease.Return();
+        m_outputFrameLease.Return();
+        m_inputVideoFrame = nullptr;
+        m_outputVideoFrame = nullptr;
+        m_videoFramesSet = false;
+    }
+
+    bool CanBindDirectly(const VideoFrame& frame) const
+    {
+        auto surface = frame.Direct3DSurface();
+        auto desc = surface.Description();
+        if ((desc.Format != m_format && desc.Format != winrt::Windows::Graphics::DirectX::DirectXPixelFormat::B8G8R8A8UIntNormalized) ||
+            static_cast<UINT32>(desc.Width) != m_imageWidthInPixels ||
+            static_cast<UINT32>(desc.Height) != m_imageHeightInPixels)
+        {
+            return false;
+        }
+        auto access = surface.try_as<::Windows::Graphics::DirectX::Direct3D11::IDirect3DDxgiInterfaceAccess>();
+        com_ptr<ID3D11Texture2D> texture;
+        if (!access || FAILED(access->GetInterface(IID_PPV_ARGS(texture.put()))))
+        {
+            return false;
+        }
+        D3D11_TEXTURE2D_DESC textureDesc = {};
+        texture->GetDesc(&textureDesc);
+        return (textureDesc.MiscFlags & (D3D11_RESOURCE_MISC_SHARED | D3D11_RESOURCE_MISC_SHARED_NTHANDLE |
+                                         D3D11_RESOURCE_MISC_SHARED_KEYEDMUTEX)) != 0;
     }
 
     void SetImageSize(int w, int h) 
@@ -100,6 +167,12 @@ protected:
     VideoFrame  m_inputVideoFrame;
     UINT32      m_imageWidthInPixels = 0;
     UINT32      m_imageHeightInPixels = 0;
+    winrt::Windows::Graphics::DirectX::DirectXPixelFormat m_format = winrt::Windows::Graphics::DirectX::DirectXPixelFormat::B8G8R8X8UIntNormalized;
+
+    // Frames standing in for the src and dest surfaces, reused from frame to frame
+    std::unique_ptr<FramePool> m_framePool;
+    FramePool::Lease m_inputFrameLease;
+    FramePool::Lease m_outputFrameLease;
 
     // Learning Model Binding and Session. 
     LearningModelSession m_session;
@@ -118,22 +191,45 @@ private:
 };
 
 
+// How BackgroundBlur composites the blurred background and the foreground
+enum class BlurPostProcess
+{
+    Graph,    // the operators of BackgroundBlur::PostProcess, joined to the model
+    FusedCpu, // FusedBlurKernel.h in one pass on the CPU, for CPU-only deployments
+};
+
 class BackgroundBlur : public StreamModelBase
 {
 public:
-    BackgroundBlur() : 
-        StreamModelBase()
-    {};
+    // fusedThreads: threads of the fused post-process, the calling one included
+    BackgroundBlur(BlurPostProcess postProcess = BlurPostProcess::Graph, size_t fusedThreads = 1) : 
+        StreamModelBase(),
+        m_postProcess(postProcess),
+        m_fusedThreads(fusedThreads)
+    {
+        // The fused post-process reads the model outputs on the CPU, so the model runs there too
+        m_useGPU = m_postProcess != BlurPostProcess::FusedCpu;
+    };
     void InitializeSession(int w, int h);
     void Run(IDirect3DSurface src, IDirect3DSurface dest);
 
 private:
     LearningModel GetModel();
     LearningModel PostProcess(long n, long c, long h, long w, long axis);
+    LearningModel TensorToImage(long n, long c, long h, long w);
+    void RunFusedPostProcess(const TensorFloat& image, const TensorFloat& scores);
     
     // Mean and standard deviation for z-score normalization during preprocessing. 
     std::array<float, 3> m_mean = { 0.485f, 0.456f, 0.406f };
     std::array<float, 3> m_stddev = { 0.229f, 0.224f, 0.225f };
 
+    BlurPostProcess m_postProcess;
+    size_t m_fusedThreads;
 
+    // Fused post-process: its output, and the session that turns it into the output VideoFrame
+    TensorFloat m_blurredImage = nullptr;
+    LearningModelSession m_imageSession = nullptr;
+    LearningModelBinding m_imageBinding = nullptr;
+    // Kept from frame to frame, so that a frame doesn't start and join threads
+    std::unique_ptr<BlurKernel::BlurWorkers> m_blurWorkers;
 };
\ No newline at end of file
@@ -14,6 +14,14 @@
 #define MFT_NUM_DEFAULT_ATTRIBUTES  4
 #define MIN_ALLOCATED_SAMPLES 2
 #define MAX_ALLOCATED_SAMPLES std::thread::hardware_concurrency()
+// Sample queue slots per inference thread. ProcessInput keeps about one sample per thread in flight, so the queues
+// only fill up when the client keeps sending input without waiting for NeedInput.
+#define SAMPLE_QUEUE_SLOTS_PER_THREAD 4
+// A frame that holds later, finished frames back for this long is dropped, to keep the output paced
+#define MAX_FRAME_LATENCY_MS 100
+// Post-process of the background blur: BlurPostProcess::Graph on the GPU, or BlurPostProcess::FusedCpu to run the model
+// and a fused post-process on the CPU
+#define BLUR_POST_PROCESS BlurPostProcess::Graph
 
 using namespace MainWindow;
 
@@ -173,24 +181,51 @@ HRESULT TransformAsync::ScheduleFrameInference()
 
 // SubmitEval returns an HRESULT to use to signal the async result's status
 HRESULT TransformAsync::SubmitEval(IMFSample* pInput)
+{
+    DWORD dwCurrentSample = InterlockedIncrement(&m_sampleCounter);
+
+    // Select the idle model that has been fastest lately. If every model is still busy, drop the frame rather than
+    // queue it behind them, which would add latency to every frame after it.
+    FrameScheduling::FrameTicket ticket;
+    if (!m_frameScheduler->BeginFrame(ticket))
+    {
+        TRACE((L"All models running, DROP"));
+        RETURN_IF_FAILED(SkipFrame());
+        return S_OK;
+    }
+
+    TRACE((L"\n[Sample: %d | frame: %llu | model: %d | ", dwCurrentSample, ticket.Sequence, ticket.Worker));
+    TRACE((L" | SE Thread %d | ", std::hash<std::thread::id>()(std::this_thread::get_id())));
+
+    FrameOutput output;
+    HRESULT hr = RunEval(m_models[ticket.Worker].get(), pInput, output);
+    if (SUCCEEDED(hr))
+    {
+        m_frameScheduler->CompleteFrame(ticket, FrameScheduling::FrameStatus::Completed, std::move(output));
+    }
+    else
+    {
+        m_frameScheduler->CompleteFrame(ticket, FrameScheduling::FrameStatus::Failed);
+    }
+
+    // Models finish out of order, so only queue the frames that are next in presentation order
+    HRESULT deliverHr = DeliverFrames();
+    RETURN_IF_FAILED(hr);
+    return deliverHr;
+}
+
+// Runs inference of one frame on model and allocates the transformed output sample.
+HRESULT TransformAsync::RunEval(StreamModelBase* model, IMFSample* pInput, FrameOutput& output)
 {
     com_ptr<IMFSample> outputSample;
     com_ptr<IMFSample> inputSample;
     inputSample.copy_from(pInput); 
 
-    // Select the next available model
-    DWORD dwCurrentSample = InterlockedIncrement(&m_sampleCounter);
-    m_modelIndex = (++m_modelIndex) % m_numThreads;
-    auto model = m_models[m_modelIndex].get();
-
     //inputSample attributes to copy over to outputSample
     LONGLONG duration = 0;
     LONGLONG time = 0;
     UINT64 markerID = 0;
 
-    TRACE((L"\n[Sample: %d | model: %d | ", currentSample, m_modelIndex));
-    TRACE((L" | SE Thread %d | ", std::hash<std::thread::id>()(std::this_thread::get_id())));
-
      // Ensure we still have a valid d3d device
     RETURN_IF_FAILED(CheckDX11Device());
     // Ensure the allocator is set up 
@@ -211,27 +246,57 @@ HRESULT TransformAsync::SubmitEval(IMFSample* pInput)
     RETURN_IF_FAILED(inputSample->GetSampleTime(&time));
     inputSample->GetUINT64(TransformAsync_MFSampleExtension_Marker, &markerID);
 
-    // Make sure this model isn't already running, if so drop the frame and move on. 
-    if(!model->m_syncStarted)
-    {
-        // Extract an IDirect3DSurface from the input and output samples to use for inference, 
-        IDirect3DSurface src = SampleToD3Dsurface(inputSample.get());
-        IDirect3DSurface dest = SampleToD3Dsurface(outputSample.get());
+    // Extract an IDirect3DSurface from the input and output samples to use for inference, 
+    IDirect3DSurface src = SampleToD3Dsurface(inputSample.get());
+    IDirect3DSurface dest = SampleToD3Dsurface(outputSample.get());
+
+    auto now = std::chrono::high_resolution_clock::now();
+    // Run model inference 
+    model->Run(src, dest); 
+    auto timePassed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::high_resolution_clock::now() - now);
+    TRACE((L"Eval: %d", timePassed.count()));
+    src.Close();
+    dest.Close();
+
+    output.Sample = outputSample;
+    output.Duration = duration;
+    output.Time = time;
+    output.MarkerID = markerID;
+    return S_OK;
+}
 
-        auto now = std::chrono::high_resolution_clock::now();
-        // Run model inference 
-        model->Run(src, dest); 
-        auto timePassed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::high_resolution_clock::now() - now);
-        TRACE((L"Eval: %d", timePassed.count()));
-        src.Close();
-        dest.Close();
-        // Perform housekeeping out the output sample
-        RETURN_IF_FAILED(FinishEval(outputSample.get(), duration, time, markerID)); 
-    }
-    else {
-        TRACE((L"Model %d already running, DROP", m_modelIndex));
-    }
+// Queues the output of every frame that is next in presentation order. Frames without an output, because they
+// failed or came too late, still get their next input sample requested.
+HRESULT TransformAsync::DeliverFrames()
+{
+    HRESULT result = S_OK;
+    m_frameScheduler->DeliverFrames(
+        [this, &result](uint64_t sequence, FrameScheduling::FrameStatus status, FrameOutput* output) {
+            HRESULT hr;
+            if (output != nullptr)
+            {
+                // Perform housekeeping out the output sample
+                hr = FinishEval(output->Sample.get(), output->Duration, output->Time, output->MarkerID);
+            }
+            else
+            {
+                TRACE((L"Frame %llu %s, DROP", sequence,
+                    status == FrameScheduling::FrameStatus::DroppedLate ? L"too late" : L"failed"));
+                hr = SkipFrame();
+            }
+            if (FAILED(hr) && SUCCEEDED(result))
+            {
+                result = hr;
+            }
+        });
+    return result;
+}
 
+// A frame that produces no output still frees its place in the pipeline, so request the next input sample.
+HRESULT TransformAsync::SkipFrame()
+{
+    RETURN_IF_FAILED(RequestSample(0));
+    InterlockedIncrement(&m_processedFrameNum);
     return S_OK;
 }
 
@@ -257,16 +322,25 @@ HRESULT TransformAsync::FinishEval(IMFSample* pOutputSample,
         m_firstSample = false;
     }
 
-    // Allocate output sample to queue
-    RETURN_IF_FAILED(m_outputSampleQueue->AddSample(pOutputSample));
-    RETURN_IF_FAILED(MFCreateMediaEvent(METransformHaveOutput, GUID_NULL, S_OK, nullptr, haveOutputEvent.put()));
-    // Scope event queue lock
+    // Allocate output sample to queue. A full queue means the client is not collecting output, so drop the frame
+    // rather than fail the work item; the next frame is still requested below.
+    HRESULT hr = m_outputSampleQueue->AddSample(pOutputSample);
+    if (hr == MF_E_NOTACCEPTING)
     {
-        std::lock_guard<std::recursive_mutex> lock(m_mutex);
-        // TODO: If QueueEvent fails, consider decrementing m_haveOutputCount
-        RETURN_IF_FAILED(m_eventQueue->QueueEvent(haveOutputEvent.get()));
-        m_haveOutputCount++;
-        m_status |= MYMFT_STATUS_OUTPUT_SAMPLE_READY;
+        TRACE((L"Output queue full, DROP"));
+    }
+    else
+    {
+        RETURN_IF_FAILED(hr);
+        RETURN_IF_FAILED(MFCreateMediaEvent(METransformHaveOutput, GUID_NULL, S_OK, nullptr, haveOutputEvent.put()));
+        // Scope event queue lock
+        {
+            std::lock_guard<std::recursive_mutex> lock(m_mutex);
+            // TODO: If QueueEvent fails, consider decrementing m_haveOutputCount
+            RETURN_IF_FAILED(m_eventQueue->QueueEvent(haveOutputEvent.get()));
+            m_haveOutputCount++;
+            m_status |= MYMFT_STATUS_OUTPUT_SAMPLE_READY;
+        }
     }
 
     if (pun64MarkerID)
@@ -645,14 +719,23 @@ HRESULT TransformAsync::InitializeTransform()
     **********************************/
     RETURN_IF_FAILED(MFCreateEventQueue(m_eventQueue.put()));
 
-    RETURN_IF_FAILED(CSampleQueue::Create(&m_inputSampleQueue));
+    RETURN_IF_FAILED(CSampleQueue::Create(SAMPLE_QUEUE_SLOTS_PER_THREAD * m_numThreads, &m_inputSampleQueue));
 
-    RETURN_IF_FAILED(CSampleQueue::Create(&m_outputSampleQueue));
+    RETURN_IF_FAILED(CSampleQueue::Create(SAMPLE_QUEUE_SLOTS_PER_THREAD * m_numThreads, &m_outputSampleQueue));
 
-    // Set up circular queue of StreamModelBases
+    // Set up the StreamModelBases and the scheduler that runs frames on them. A frame is also late once as many
+    // frames as there are models finished after it.
+    FrameScheduling::SchedulerOptions schedulerOptions;
+    schedulerOptions.Workers = m_numThreads;
+    schedulerOptions.DropLateFrames = true;
+    schedulerOptions.MaxLatency = std::chrono::milliseconds(MAX_FRAME_LATENCY_MS);
+    schedulerOptions.MaxReorderDepth = m_numThreads;
+    m_frameScheduler = std::make_unique<FrameScheduling::FrameScheduler<FrameOutput>>(schedulerOptions);
+    // The models run side by side, so a fused post-process gets its share of the hardware threads
+    const size_t blurThreads = (std::max)(1u, std::thread::hardware_concurrency() / static_cast<unsigned int>(m_numThreads));
     for (int i = 0; i < m_numThreads; i++) {
         // TODO: Have a dialogue to select which model to select for real-time inference. 
-        m_models.push_back(std::make_unique<BackgroundBlur>());
+        m_models.push_back(std::make_unique<BackgroundBlur>(BLUR_POST_PROCESS, blurThreads));
     }
 
     return S_OK;
@@ -942,6 +1025,7 @@ HRESULT TransformAsync::FlushSamples()
     m_haveOutputCount = 0;    // Don't Output samples until new input samples are given
     RETURN_IF_FAILED(m_inputSampleQueue->RemoveAllSamples());
     RETURN_IF_FAILED(m_outputSampleQueue->RemoveAllSamples());
+    m_frameScheduler->Reset();   // Frames still running are discarded when they finish
     m_firstSample = true; // Be sure to reset our first sample so we know to set discontinuity
     return S_OK;
 }
@@ -21,6 +21,7 @@
 #include <dxva2api.h>
 #include "External/common.h"
 #include "SegmentModel.h"
+#include "FrameScheduler.h"
 
 #define USE_LOGGING
 #define MFT_NUM_DEFAULT_ATTRIBUTES  4
@@ -223,9 +224,21 @@ public:
     HRESULT STDMETHODCALLTYPE NotifyRelease();
 #pragma endregion IMFVideoSampleAllocatorNotify
 
-    // Uses the next available StreamModelBase to run inference on pInputSample 
-    // and allocates a transformed output sample. 
+    // Output of a frame, kept by the frame scheduler until the frames before it are done
+    struct FrameOutput
+    {
+        com_ptr<IMFSample> Sample;
+        LONGLONG Duration = 0;
+        LONGLONG Time = 0;
+        UINT64 MarkerID = 0;
+    };
+
+    // Uses the idle StreamModelBase picked by the frame scheduler to run inference
+    // on pInputSample, then queues finished frames in presentation order. 
     HRESULT SubmitEval(IMFSample* pInputSample);
+    HRESULT RunEval(StreamModelBase* model, IMFSample* pInputSample, FrameOutput& output);
+    HRESULT DeliverFrames();
+    HRESULT SkipFrame();
 
     // Helper function for SubmitEval, sets attributes on the output sample,
     // adds it to the output sample queue, and queues an MFHasOutput event. 
@@ -346,6 +359,6 @@ protected:
     // Model Inference fields
     int m_numThreads = std::thread::hardware_concurrency(); // Number of threads running inference in parallel.
     std::vector<std::unique_ptr<StreamModelBase>> m_models; // m_numThreads number of models to run inference in parallel. 
-    int m_modelIndex = 0;
+    std::unique_ptr<FrameScheduling::FrameScheduler<FrameOutput>> m_frameScheduler; // Picks a model per frame and puts finished frames back in order.
     winrt::hstring m_modelPath;
 };
@@ -760,20 +760,6 @@ HRESULT TransformAsync::ProcessInput(
     DWORD currFrameLocal = 0;
     TRACE((L" | PI Thread %d | ", std::hash<std::thread::id>()(std::this_thread::get_id())));
 
-    {
-        //graphicsAnalysis->BeginCapture();
-        std::lock_guard<std::recursive_mutex> lock(m_mutex);
-        if (m_needInputCount == 0)
-        {
-            // This call does not correspond to a need input call
-            return MF_E_NOTACCEPTING;
-        }
-        else
-        {
-            m_needInputCount--;
-        }
-        currFrameLocal = m_currFrameNumber++;
-    }
     if (pSample == nullptr)
     {
         return E_POINTER;
@@ -790,14 +776,29 @@ HRESULT TransformAsync::ProcessInput(
         return MF_E_INVALIDSTREAMNUMBER;
     }
 
-    // First, put sample into the input Queue
+    {
+        //graphicsAnalysis->BeginCapture();
+        std::lock_guard<std::recursive_mutex> lock(m_mutex);
+        if (m_needInputCount == 0)
+        {
+            // This call does not correspond to a need input call
+            return MF_E_NOTACCEPTING;
+        }
+
+        // First, put sample into the input Queue
 
-    /***************************************
-    ** Since this in an internal function
-    ** we know m_inputSampleQueue can never be
-    ** nullptr due to InitializeTransform()
-    ***************************************/
-    RETURN_IF_FAILED(m_inputSampleQueue->AddSample(pSample));
+        /***************************************
+        ** Since this in an internal function
+        ** we know m_inputSampleQueue can never be
+        ** nullptr due to InitializeTransform()
+        ***************************************/
+        // MF_E_NOTACCEPTING when the queue is full tells the client to wait for the next NeedInput event. The
+        // need input count and the frame number only move once the sample is queued, so a refused sample leaves
+        // the NeedInput request it answered open. The push is lock free, so holding m_mutex around it is cheap.
+        RETURN_IF_FAILED(m_inputSampleQueue->AddSample(pSample));
+        m_needInputCount--;
+        currFrameLocal = m_currFrameNumber++;
+    }
 
     // Now schedule the work to decode the sample
     RETURN_IF_FAILED(ScheduleFrameInference());
@@ -13,6 +13,7 @@
 #include <codecvt>
 #include <locale> 
 #include <cmath>
+#include "PerfReport.h"
 
 using namespace Microsoft::VisualStudio::CppUnitTestFramework;
 static HRESULT RunProc(wchar_t* commandLine)
@@ -614,6 +615,21 @@ namespace WinMLRunnerTest
                                                   tensorDataPath + L"\\softmaxout_1CpuIteration1.csv"));
         }
 
+        TEST_METHOD_WITH_NAME(ProvidedImageInputOnlyCpuSteadyStateSaveTensor)
+            const std::wstring modelPath = CURRENT_PATH + L"SqueezeNet.onnx";
+            const std::wstring inputPath = CURRENT_PATH + L"fish.png";
+            const std::wstring tensorDataPath = TENSOR_DATA_PATH + L"\\" + METHOD_NAME;
+            const std::wstring command = BuildCommand({ EXE_PATH, L"-model ", modelPath, L"-input", inputPath,
+                                                        L"-SteadyState", L"-Iterations", L"3", L"-SaveTensorData",
+                                                        L"All", L"-PerIterationPath", tensorDataPath, L"-CPU" });
+            Assert::AreEqual(S_OK, RunProc(const_cast<wchar_t*>(command.c_str())));
+            // Every iteration reuses the same binding and input features, so every iteration must match
+            Assert::AreEqual(true, CompareTensors(L"OutputTensorData\\Squeezenet_fish_input_CPU.csv",
+                                                  tensorDataPath + L"\\softmaxout_1CpuIteration1.csv"));
+            Assert::AreEqual(true, CompareTensors(L"OutputTensorData\\Squeezenet_fish_input_CPU.csv",
+                                                  tensorDataPath + L"\\softmaxout_1CpuIteration3.csv"));
+        }
+
         TEST_METHOD_WITH_NAME(ProvidedImageInputOnlyGpuSaveTensor)
             const std::wstring modelPath = CURRENT_PATH + L"SqueezeNet.onnx";
             const std::wstring inputPath = CURRENT_PATH + L"fish.png";
@@ -765,6 +781,52 @@ namespace WinMLRunnerTest
             Assert::AreEqual(S_OK, RunProc(const_cast<wchar_t*>(command.c_str())));
         }
 
+        // The inputs member of the first configuration record of a -PerfJsonOutput report
+        static PerfReport::JsonValue ReadReportedInputs(const std::wstring& path)
+        {
+            std::ifstream report(path);
+            std::string line;
+            while (std::getline(report, line))
+            {
+                PerfReport::JsonValue record = PerfReport::JsonValue::Parse(line);
+                if (record["type"].GetString() == "configuration")
+                {
+                    return record["inputs"];
+                }
+            }
+            return PerfReport::JsonValue();
+        }
+
+        TEST_METHOD(ProvidedCSVInputSteadyStatePerf)
+        {
+            const std::wstring modelPath = CURRENT_PATH + L"SqueezeNet.onnx";
+            const std::wstring inputPath = CURRENT_PATH + L"kitten_224.csv";
+            const std::wstring reportPath = CURRENT_PATH + L"steady_state_output.jsonl";
+            std::filesystem::remove(reportPath);
+            const std::wstring command = BuildCommand({ EXE_PATH, L"-model", modelPath, L"-input", inputPath,
+                                                        L"-SteadyState", L"-Iterations", L"5", L"-PerfOutput",
+                                                        OUTPUT_PATH, L"-PerfJsonOutput", reportPath, L"-perf",
+                                                        L"-CPU" });
+            Assert::AreEqual(S_OK, RunProc(const_cast<wchar_t*>(command.c_str())));
+
+            // We need to expect one more line because of the header
+            Assert::AreEqual(static_cast<size_t>(2), GetOutputCSVLineCount());
+            // The CSV input was tensorized and bound once for the 5 iterations
+            PerfReport::JsonValue inputs = ReadReportedInputs(reportPath);
+            Assert::AreEqual(1.0, inputs["prepared"].GetNumber());
+            Assert::AreEqual(1.0, inputs["bindings"].GetNumber());
+
+            std::filesystem::remove(reportPath);
+            const std::wstring defaultCommand = BuildCommand({ EXE_PATH, L"-model", modelPath, L"-input", inputPath,
+                                                               L"-Iterations", L"5", L"-PerfJsonOutput", reportPath,
+                                                               L"-perf", L"-CPU" });
+            Assert::AreEqual(S_OK, RunProc(const_cast<wchar_t*>(defaultCommand.c_str())));
+            inputs = ReadReportedInputs(reportPath);
+            Assert::AreEqual(5.0, inputs["prepared"].GetNumber());
+            Assert::AreEqual(5.0, inputs["bindings"].GetNumber());
+            std::filesystem::remove(reportPath);
+        }
+
         TEST_METHOD(ProvidedCSVBadBinding)
         {
             const std::wstring modelPath = CURRENT_PATH + L"SqueezeNet.onnx";
@@ -857,6 +919,14 @@ namespace WinMLRunnerTest
             });
             Assert::AreEqual(S_OK, RunProc(const_cast<wchar_t*>(command.c_str())));
         }
+
+        TEST_METHOD(ConcurrentEvaluate)
+        {
+            const std::wstring command = BuildCommand({ EXE_PATH, L"-model", CURRENT_PATH + L"SqueezeNet.onnx",
+                                                        L"-ConcurrentEvaluate", L"-NumThreads", L"3", L"-Iterations",
+                                                        L"4", L"-CPU" });
+            Assert::AreEqual(S_OK, RunProc(const_cast<wchar_t*>(command.c_str())));
+        }
     };
 
     TEST_CLASS(OtherTests)
@@ -0,0 +1,282 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Takes tensor snapshots off the inference thread. Capture only copies the tensor into one of a fixed number of slots
+// and queues it; a writer thread hands queued snapshots to the writer callback of their tap in capture order and gives
+// the slots back. One queue serves every tap of a session, so the slots and the writer thread are shared by all of
+// them. A slot is allocated when it first holds a tensor, and grows when a bigger one comes. When every slot is taken,
+// the drop policy of the tap decides whether the inference thread drops a snapshot or waits. Nothing in here depends
+// on WinML.
+namespace TensorCapture
+{
+	enum class DropPolicy
+	{
+		DropNewest, // skip the snapshot being captured
+		DropOldest, // replace the oldest snapshot that is not being written yet
+		Block,      // wait for the writer to free a slot, so nothing is lost
+	};
+
+	struct CaptureOptions
+	{
+		size_t SlotCount = 4; // shared by the taps of the queue
+	};
+
+	struct CaptureTap;
+
+	struct Snapshot
+	{
+		std::shared_ptr<const CaptureTap> Tap; // set while the snapshot is queued or being written
+		uint64_t Sequence = 0;     // index of the Capture call of the tap, so gaps show dropped snapshots
+		uint32_t DataType = 0;     // MLOperatorTensorDataType of the tensor
+		uint32_t ElementSize = 0;
+		uint32_t Stride = 1;
+		std::vector<uint32_t> Shape; // shape of the captured elements, after downsampling
+		std::unique_ptr<uint8_t[]> Data;
+		size_t Capacity = 0;
+		size_t Size = 0; // bytes of Data in use
+
+		size_t GetElementCount() const { return ElementSize == 0 ? 0 : Size / ElementSize; }
+
+		template <typename T> const T* As() const { return reinterpret_cast<const T*>(Data.get()); }
+
+		void Reserve(size_t size)
+		{
+			if (size > Capacity)
+			{
+				Data.reset(new uint8_t[size]);
+				Capacity = size;
+			}
+		}
+	};
+
+	// A place of the model that tensors are captured at, such as a Debug operator.
+	struct CaptureTap
+	{
+		// Called on the writer thread, one snapshot at a time.
+		using Writer = std::function<void(const Snapshot&)>;
+
+		CaptureTap(Writer writer, uint32_t stride = 1, DropPolicy policy = DropPolicy::DropNewest) :
+			Write(std::move(writer)),
+			Stride(stride > 0 ? stride : 1),
+			Policy(policy)
+		{
+		}
+
+		Writer Write;
+		uint32_t Stride; // keep every Stride-th row and column of the two innermost dimensions
+		DropPolicy Policy;
+		mutable std::atomic<uint64_t> Sequence{ 0 };
+	};
+
+	// Turns the shape of a tensor into the shape of the elements kept with the given stride: every stride-th row and
+	// column of its two innermost dimensions.
+	inline void DownsampleShape(std::vector<uint32_t>& shape, uint32_t stride)
+	{
+		for (size_t i = shape.size() < 2 ? 0 : shape.size() - 2; i < shape.size(); i++)
+		{
+			shape[i] = (shape[i] + stride - 1) / stride;
+		}
+	}
+
+	// Copies the elements of a tensor that are kept with the given stride, see DownsampleShape.
+	inline void CopyDownsampled(const uint8_t* source, uint8_t* destination, const uint32_t* shape,
+		size_t dimensionCount, uint32_t elementSize, uint32_t stride)
+	{
+		size_t height = dimensionCount >= 2 ? shape[dimensionCount - 2] : 1;
+		size_t width = dimensionCount >= 1 ? shape[dimensionCount - 1] : 1;
+		size_t outer = 1;
+		for (size_t i = 0; i + 2 < dimensionCount; i++)
+		{
+			outer *= shape[i];
+		}
+		if (stride == 1)
+		{
+			memcpy(destination, source, outer * height * width * elementSize);
+			return;
+		}
+		size_t rowBytes = width * elementSize;
+		for (size_t o = 0; o < outer; o++)
+		{
+			const uint8_t* plane = source + o * height * rowBytes;
+			for (size_t y = 0; y < height; y += stride)
+			{
+				const uint8_t* row = plane + y * rowBytes;
+				for (size_t x = 0; x < width; x += stride)
+				{
+					memcpy(destination, row + x * elementSize, elementSize);
+					destination += elementSize;
+				}
+			}
+		}
+	}
+
+	struct CaptureStatistics
+	{
+		uint64_t Captured = 0; // queued for the writer
+		uint64_t Dropped = 0;  // skipped or replaced because every slot was taken
+		uint64_t Written = 0;  // written by the writer callback
+		uint64_t Failed = 0;   // writer callback threw
+	};
+
+	class CaptureQueue
+	{
+	public:
+		explicit CaptureQueue(const CaptureOptions& options = CaptureOptions()) :
+			m_slots(options.SlotCount > 0 ? options.SlotCount : 1)
+		{
+			for (size_t i = 0; i < m_slots.size(); i++)
+			{
+				m_slots[i].Shape.reserve(8);
+				m_free.push_back(i);
+			}
+			m_queued.reserve(m_slots.size());
+			m_writerThread = std::thread(&CaptureQueue::WriterLoop, this);
+		}
+
+		CaptureQueue(const CaptureQueue&) = delete;
+		CaptureQueue& operator=(const CaptureQueue&) = delete;
+
+		// Writes out everything still queued before returning.
+		~CaptureQueue()
+		{
+			{
+				std::lock_guard<std::mutex> lock(m_mutex);
+				m_stopping = true;
+			}
+			m_queuedChanged.notify_all();
+			m_writerThread.join();
+		}
+
+		// Copies a tensor into a free slot and queues it for the writer of the tap. Safe to call from several threads
+		// at once. Returns false if the snapshot was dropped.
+		bool Capture(const std::shared_ptr<const CaptureTap>& tap, uint32_t dataType, uint32_t elementSize,
+			const uint32_t* shape, size_t dimensionCount, const void* data)
+		{
+			size_t slotIndex;
+			uint64_t sequence = tap->Sequence++;
+			{
+				std::unique_lock<std::mutex> lock(m_mutex);
+				if (m_free.empty())
+				{
+					switch (tap->Policy)
+					{
+					case DropPolicy::DropNewest:
+						m_statistics.Dropped++;
+						return false;
+					case DropPolicy::DropOldest:
+						if (!m_queued.empty())
+						{
+							// Slots being written are not in m_queued, so the oldest queued one can be reused. It may
+							// be a snapshot of another tap.
+							m_slots[m_queued.front()].Tap.reset();
+							m_free.push_back(m_queued.front());
+							m_queued.erase(m_queued.begin());
+							m_statistics.Dropped++;
+						}
+						break;
+					case DropPolicy::Block:
+						break;
+					}
+					m_slotFreed.wait(lock, [this] { return !m_free.empty(); });
+				}
+				slotIndex = m_free.back();
+				m_free.pop_back();
+			}
+
+			// The slot belongs to this call until it is queued, so the copy happens outside of the lock
+			Snapshot& slot = m_slots[slotIndex];
+			slot.Tap = tap;
+			slot.Sequence = sequence;
+			slot.DataType = dataType;
+			slot.ElementSize = elementSize;
+			slot.Stride = tap->Stride;
+			slot.Shape.assign(shape, shape + dimensionCount);
+			DownsampleShape(slot.Shape, tap->Stride);
+			size_t size = elementSize;
+			for (uint32_t dimension : slot.Shape)
+			{
+				size *= dimension;
+			}
+			slot.Reserve(size);
+			slot.Size = size;
+			CopyDownsampled(static_cast<const uint8_t*>(data), slot.Data.get(), shape, dimensionCount, elementSize,
+				tap->Stride);
+
+			{
+				std::lock_guard<std::mutex> lock(m_mutex);
+				m_queued.push_back(slotIndex);
+				m_statistics.Captured++;
+			}
+			m_queuedChanged.notify_one();
+			return true;
+		}
+
+		// Waits until every snapshot queued so far has been written.
+		void Flush()
+		{
+			std::unique_lock<std::mutex> lock(m_mutex);
+			m_slotFreed.wait(lock, [this] { return m_queued.empty() && !m_writing; });
+		}
+
+		CaptureStatistics GetStatistics() const
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			return m_statistics;
+		}
+
+	private:
+		void WriterLoop()
+		{
+			std::unique_lock<std::mutex> lock(m_mutex);
+			for (;;)
+			{
+				m_queuedChanged.wait(lock, [this] { return m_stopping || !m_queued.empty(); });
+				if (m_queued.empty())
+				{
+					return;
+				}
+				size_t slotIndex = m_queued.front();
+				m_queued.erase(m_queued.begin());
+				m_writing = true;
+				lock.unlock();
+				bool failed = false;
+				try
+				{
+					m_slots[slotIndex].Tap->Write(m_slots[slotIndex]);
+				}
+				catch (...)
+				{
+					failed = true;
+				}
+				// Let go of the tap, so that it closes its files once its operator is gone too
+				m_slots[slotIndex].Tap.reset();
+				lock.lock();
+				m_writing = false;
+				m_statistics.Written += failed ? 0 : 1;
+				m_statistics.Failed += failed ? 1 : 0;
+				m_free.push_back(slotIndex);
+				m_slotFreed.notify_all();
+			}
+		}
+
+		std::vector<Snapshot> m_slots;
+		std::vector<size_t> m_free;   // slots nobody uses
+		std::vector<size_t> m_queued; // filled slots waiting for the writer, oldest first
+		bool m_writing = false;
+		bool m_stopping = false;
+		CaptureStatistics m_statistics;
+		mutable std::mutex m_mutex;
+		std::condition_variable m_queuedChanged;
+		std::condition_variable m_slotFreed;
+		std::thread m_writerThread;
+	};
+}
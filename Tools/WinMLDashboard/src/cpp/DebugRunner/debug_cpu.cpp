@@ -1,12 +1,16 @@
 #pragma once
 
 #include "debug_cpu.h"
+#include "../../../../WinMLRunner/src/TensorTrace.h"
 #include <winrt/Windows.Media.h>
 #include <winrt/Windows.Storage.h>
 #include <winrt/Windows.Storage.Streams.h>
 #include <winrt/Windows.Graphics.h>
 #include <winrt/Windows.Graphics.Imaging.h>
+#include <charconv>
+#include <cmath>
 #include <fstream>
+#include <memory>
 #include <numeric>
 #include <vector>
 #include <shlwapi.h>
@@ -72,10 +76,102 @@ StorageFile CreateOutputFile(hstring filePath) {
 	}
 }
 
-template <typename T>
-void WriteToPng(vector<uint32_t> inputDims, T* inputData, uint32_t size, hstring m_filePath)
+// Size of one element of a tensor of the given type, or 0 if the operator does not support the type.
+static uint32_t GetElementSize(MLOperatorTensorDataType type)
+{
+	switch (type) {
+	case MLOperatorTensorDataType::Bool:
+	case MLOperatorTensorDataType::UInt8:
+	case MLOperatorTensorDataType::Int8:
+		return 1;
+	case MLOperatorTensorDataType::Float16:
+	case MLOperatorTensorDataType::UInt16:
+	case MLOperatorTensorDataType::Int16:
+		return 2;
+	case MLOperatorTensorDataType::Float:
+	case MLOperatorTensorDataType::Int32:
+	case MLOperatorTensorDataType::UInt32:
+		return 4;
+	case MLOperatorTensorDataType::Double:
+	case MLOperatorTensorDataType::Int64:
+	case MLOperatorTensorDataType::UInt64:
+		return 8;
+	default:
+		return 0;
+	}
+}
+
+static float HalfToFloat(uint16_t half)
+{
+	uint32_t sign = static_cast<uint32_t>(half & 0x8000) << 16;
+	uint32_t exponent = (half >> 10) & 0x1F;
+	uint32_t mantissa = half & 0x3FF;
+	float value;
+	if (exponent == 0x1F) {
+		// inf and nan
+		uint32_t bits = sign | 0x7F800000 | (mantissa << 13);
+		memcpy(&value, &bits, sizeof(value));
+		return value;
+	}
+	// normal and subnormal halves are exact in float: mantissa * 2^(exponent - 25), with the implicit bit when normal
+	value = ldexp(static_cast<float>(exponent == 0 ? mantissa : (mantissa | 0x400)), static_cast<int>(exponent == 0 ? 1 : exponent) - 25);
+	return sign ? -value : value;
+}
+
+// Calls visit(elements, count) with the elements of a snapshot as their C++ type. Bool elements are passed as bytes
+// and float16 elements are converted to float.
+template <typename Visitor>
+void VisitElements(const TensorCapture::Snapshot& snapshot, Visitor&& visit)
+{
+	size_t count = snapshot.GetElementCount();
+	switch (static_cast<MLOperatorTensorDataType>(snapshot.DataType)) {
+	case MLOperatorTensorDataType::Float:
+		visit(snapshot.As<float>(), count);
+		break;
+	case MLOperatorTensorDataType::Float16: {
+		vector<float> values(count);
+		const uint16_t* halves = snapshot.As<uint16_t>();
+		for (size_t i = 0; i < count; i++) {
+			values[i] = HalfToFloat(halves[i]);
+		}
+		visit(static_cast<const float*>(values.data()), count);
+		break;
+	}
+	case MLOperatorTensorDataType::Double:
+		visit(snapshot.As<double>(), count);
+		break;
+	case MLOperatorTensorDataType::Bool:
+	case MLOperatorTensorDataType::UInt8:
+		visit(snapshot.As<uint8_t>(), count);
+		break;
+	case MLOperatorTensorDataType::Int8:
+		visit(snapshot.As<int8_t>(), count);
+		break;
+	case MLOperatorTensorDataType::UInt16:
+		visit(snapshot.As<uint16_t>(), count);
+		break;
+	case MLOperatorTensorDataType::Int16:
+		visit(snapshot.As<int16_t>(), count);
+		break;
+	case MLOperatorTensorDataType::Int32:
+		visit(snapshot.As<int32_t>(), count);
+		break;
+	case MLOperatorTensorDataType::UInt32:
+		visit(snapshot.As<uint32_t>(), count);
+		break;
+	case MLOperatorTensorDataType::Int64:
+		visit(snapshot.As<int64_t>(), count);
+		break;
+	case MLOperatorTensorDataType::UInt64:
+		visit(snapshot.As<uint64_t>(), count);
+		break;
+	}
+}
+
+void WriteToPng(const TensorCapture::Snapshot& snapshot, hstring m_filePath)
 {
 	// expects nchw format
+	const vector<uint32_t>& inputDims = snapshot.Shape;
 	if (inputDims.size() != NUM_DIMENSIONS) {
 		return;
 	}
@@ -83,20 +179,21 @@ void WriteToPng(vector<uint32_t> inputDims, T* inputData, uint32_t size, hstring
 	// Convert data into pixel bytes
 	// TODO: add option to normalize data
 	// currently if data values increase beyond the capacity of a byte then information will be lost
-	vector<uint8_t> byteCopy;
-	for (uint32_t i = 0; i < size; i++) {
-		byteCopy.push_back(static_cast<uint8_t>(inputData[i]));
-	}
-	int pixelsPerImage = inputDims.at(HEIGHT) * inputDims.at(WIDTH);
+	vector<uint8_t> byteCopy(snapshot.GetElementCount());
+	VisitElements(snapshot, [&byteCopy](auto elements, size_t count) {
+		for (size_t i = 0; i < count; i++) {
+			byteCopy[i] = static_cast<uint8_t>(elements[i]);
+		}
+	});
+	uint32_t pixelsPerImage = inputDims.at(HEIGHT) * inputDims.at(WIDTH);
 
 	// for each output channel at this point in the network
 	for (uint32_t i = 0; i < inputDims.at(CHANNELS); i++) {
 		// create png file
-		size_t outSize = 0;
 		wstring suffix = L"_" + to_wstring(i);
 		wstring ext = L".png";
 		wstring finalPath{ m_filePath };
-		if (finalPath.compare(finalPath.size() - ext.size(), finalPath.size(), ext) != 0) {
+		if (finalPath.size() < ext.size() || finalPath.compare(finalPath.size() - ext.size(), ext.size(), ext) != 0) {
 			// append .png extension to filename
 			finalPath += suffix;
 			finalPath += ext;
@@ -114,10 +211,9 @@ void WriteToPng(vector<uint32_t> inputDims, T* inputData, uint32_t size, hstring
 		BitmapEncoder encoder = BitmapEncoder::CreateAsync(BitmapEncoder::PngEncoderId(), stream).get();
 
 		// select image pixels
-		vector<uint8_t> sub_vector(byteCopy.begin() + (i * pixelsPerImage), byteCopy.begin() + ((i + 1) * pixelsPerImage));
 		DataWriter writer;
-		writer.WriteBytes(sub_vector);
-		SoftwareBitmap softwareBitmap(BitmapPixelFormat::Gray8, inputDims.at(HEIGHT), inputDims.at(WIDTH));
+		writer.WriteBytes(array_view<const uint8_t>(byteCopy.data() + i * pixelsPerImage, pixelsPerImage));
+		SoftwareBitmap softwareBitmap(BitmapPixelFormat::Gray8, inputDims.at(WIDTH), inputDims.at(HEIGHT));
 		IBuffer buffer = writer.DetachBuffer();
 		softwareBitmap.CopyFromBuffer(buffer);
 		// target pixel format is arbitrary because each channel will have equal value
@@ -128,40 +224,87 @@ void WriteToPng(vector<uint32_t> inputDims, T* inputData, uint32_t size, hstring
 }
 
 template <typename T>
-void WriteToText(vector<uint32_t> inputDims, T* inputData, uint32_t size, hstring m_filePath, MLOperatorTensorDataType dataType) {
+void AppendNumber(string& text, T value)
+{
+	char buffer[32];
+	auto result = to_chars(buffer, buffer + sizeof(buffer), value);
+	text.append(buffer, result.ptr);
+}
+
+void WriteToText(const TensorCapture::Snapshot& snapshot, hstring m_filePath) {
 	// Get current directory
 	CreateOutputFile(m_filePath);
 
-	ofstream outputFile;
-	outputFile.open(winrt::to_string(m_filePath));
-	outputFile << "dimensions: ";
-	std::copy(begin(inputDims), end(inputDims), std::ostream_iterator<uint32_t>(outputFile, ", "));
-	outputFile << "\ndata type: ";
-	outputFile << (int)dataType;
-	outputFile << "\ndata: ";
-	for (uint32_t i = 0; i < size; i++) {
-		outputFile << inputData[i];
-		outputFile << ", ";
+	// The whole file is formatted in memory and written at once
+	string text = "dimensions: ";
+	for (uint32_t dimension : snapshot.Shape) {
+		AppendNumber(text, dimension);
+		text += ", ";
+	}
+	text += "\ndata type: ";
+	AppendNumber(text, snapshot.DataType);
+	if (snapshot.Stride != 1) {
+		text += "\ndownsample: ";
+		AppendNumber(text, snapshot.Stride);
 	}
-	outputFile.close();
+	text += "\ndata: ";
+	VisitElements(snapshot, [&text](auto elements, size_t count) {
+		text.reserve(text.size() + count * 8);
+		for (size_t i = 0; i < count; i++) {
+			AppendNumber(text, elements[i]);
+			text += ", ";
+		}
+	});
+
+	ofstream outputFile(winrt::to_string(m_filePath), ios_base::binary);
+	outputFile.write(text.data(), text.size());
 }
 
-template <typename T>
-void ComputeInternal(IMLOperatorTensor* pInputTensor, IMLOperatorTensor* pOutputTensor, uint32_t size,
-	vector<uint32_t> inputDims, hstring m_filePath, hstring m_fileType)
-{
-	// Just copy the data from output to input
-	// Then print the input out to a file
-	auto inputData = static_cast<T*>(pInputTensor->GetData());
-	auto outputData = static_cast<T*>(pOutputTensor->GetData());
-	auto dataType = pInputTensor->GetTensorDataType();
-
-	if (to_string(m_fileType) == "png") {
-		WriteToPng(inputDims, inputData, size, m_filePath);
-	}
-	else if (winrt::to_string(m_fileType) == "text") {
-		WriteToText(inputDims, inputData, size, m_filePath, dataType);
+// Appends every snapshot of the operator to one tensor trace (see TensorTrace.h of WinMLRunner), a record per
+// snapshot named after the file with the capture sequence number as its iteration. The file is replaced by the
+// first snapshot, like the text and png files are, and gets its index when the operator is destroyed.
+void WriteToTrace(const TensorCapture::Snapshot& snapshot, hstring m_filePath,
+	unique_ptr<TensorTrace::TraceWriter>& trace) {
+	wstring path{ m_filePath };
+	if (!trace) {
+		wstring ext = L".wmltrace";
+		if (path.size() < ext.size() || path.compare(path.size() - ext.size(), ext.size(), ext) != 0) {
+			path += ext;
+		}
+		CreateOutputFile(hstring(path));
+		trace = make_unique<TensorTrace::TraceWriter>(path);
 	}
+	TensorTrace::RecordInfo info;
+	wchar_t name[_MAX_FNAME];
+	_wsplitpath_s(m_filePath.c_str(), nullptr, 0, nullptr, 0, name, _MAX_FNAME, nullptr, 0);
+	info.Name = winrt::to_string(name);
+	info.Type = TensorTrace::GetElementType(snapshot.DataType);
+	info.Shape.assign(snapshot.Shape.begin(), snapshot.Shape.end());
+	info.Iteration = snapshot.Sequence;
+	info.Metadata = "downsample=" + std::to_string(snapshot.Stride);
+	trace->Add(info, snapshot.Data.get(), snapshot.Size);
+}
+
+DebugOperator::DebugOperator(hstring filePath, hstring fileType, shared_ptr<TensorCapture::CaptureQueue> capture,
+	uint32_t stride, TensorCapture::DropPolicy policy) :
+	m_filePath(filePath),
+	m_fileType(fileType),
+	m_capture(std::move(capture))
+{
+	// Only used on the writer thread
+	auto trace = make_shared<unique_ptr<TensorTrace::TraceWriter>>();
+	m_tap = make_shared<TensorCapture::CaptureTap>(
+		[filePath, fileType, trace](const TensorCapture::Snapshot& snapshot) {
+		if (fileType == L"png") {
+			WriteToPng(snapshot, filePath);
+		}
+		else if (fileType == L"text") {
+			WriteToText(snapshot, filePath);
+		}
+		else if (fileType == L"binary") {
+			WriteToTrace(snapshot, filePath, *trace);
+		}
+	}, stride, policy);
 }
 
 
@@ -204,43 +347,16 @@ HRESULT DebugOperator::Compute(IMLOperatorKernelContext* context)
 			return E_UNEXPECTED;
 		}
 
+		uint32_t elementSize = GetElementSize(type);
+		if (elementSize == 0) {
+			return E_UNEXPECTED;
+		}
+
 		if (outputTensor->IsCpuData() && inputTensor->IsCpuData()) {
-			switch (type) {
-			case MLOperatorTensorDataType::Float:
-			case MLOperatorTensorDataType::Float16:
-				ComputeInternal<float>(inputTensor.get(), outputTensor.get(), inputDataSize, inputDims, m_filePath, m_fileType);
-				break;
-			case MLOperatorTensorDataType::Bool:
-				ComputeInternal<bool>(inputTensor.get(), outputTensor.get(), inputDataSize, inputDims, m_filePath, m_fileType);
-				break;
-			case MLOperatorTensorDataType::Double:
-				ComputeInternal<double>(inputTensor.get(), outputTensor.get(), inputDataSize, inputDims, m_filePath, m_fileType);
-				break;
-			case MLOperatorTensorDataType::UInt8:
-				ComputeInternal<unsigned char>(inputTensor.get(), outputTensor.get(), inputDataSize, inputDims, m_filePath, m_fileType);
-				break;
-			case MLOperatorTensorDataType::Int8:
-				ComputeInternal<char>(inputTensor.get(), outputTensor.get(), inputDataSize, inputDims, m_filePath, m_fileType);
-				break;
-			case MLOperatorTensorDataType::UInt16:
-				ComputeInternal<unsigned short int>(inputTensor.get(), outputTensor.get(), inputDataSize, inputDims, m_filePath, m_fileType);
-				break;
-			case MLOperatorTensorDataType::Int16:
-				ComputeInternal<short int>(inputTensor.get(), outputTensor.get(), inputDataSize, inputDims, m_filePath, m_fileType);
-				break;
-			case MLOperatorTensorDataType::Int32:
-				ComputeInternal<int>(inputTensor.get(), outputTensor.get(), inputDataSize, inputDims, m_filePath, m_fileType);
-				break;
-			case MLOperatorTensorDataType::UInt32:
-				ComputeInternal<unsigned int>(inputTensor.get(), outputTensor.get(), inputDataSize, inputDims, m_filePath, m_fileType);
-				break;
-			case MLOperatorTensorDataType::Int64:
-				ComputeInternal<long long int>(inputTensor.get(), outputTensor.get(), inputDataSize, inputDims, m_filePath, m_fileType);
-				break;
-			case MLOperatorTensorDataType::UInt64:
-				ComputeInternal<unsigned long long int>(inputTensor.get(), outputTensor.get(), inputDataSize, inputDims, m_filePath, m_fileType);
-				break;
-			}
+			// Snapshot the input and let the writer thread write it out. If every capture slot is taken the snapshot
+			// is dropped or waits for a slot, depending on the drop_policy attribute.
+			m_capture->Capture(m_tap, static_cast<uint32_t>(type), elementSize, inputDims.data(), inputDims.size(),
+				inputTensor->GetData());
 		}
 		return S_OK;
 	}
@@ -273,7 +389,38 @@ HRESULT DebugOperatorFactory::CreateKernel(
 		wchar_t* wideType = new wchar_t[strlen(fileType) + 1];
 		mbstowcs_s(&outSize, wideType, strlen(fileType) + 1, fileType, _TRUNCATE);
 
-		auto debugOperator = winrt::make<DebugOperator>(widePath, wideType);
+		// Optional capture attributes, models without them capture every element and drop snapshots when the writer
+		// thread falls behind
+		uint32_t stride = 1;
+		TensorCapture::DropPolicy policy = TensorCapture::DropPolicy::DropNewest;
+		int64_t downsample = 1;
+		if (SUCCEEDED(context->GetAttribute("downsample", MLOperatorAttributeType::Int, 1, sizeof(downsample), &downsample)) &&
+			downsample > 1) {
+			stride = static_cast<uint32_t>(downsample);
+		}
+		uint32_t dropPolicySize = 0;
+		if (SUCCEEDED(context->GetStringAttributeElementLength("drop_policy", 0, &dropPolicySize)) && dropPolicySize > 0) {
+			std::string dropPolicy(dropPolicySize, '\0');
+			context->GetStringAttributeElement("drop_policy", 0, dropPolicySize, &dropPolicy[0]);
+			dropPolicy.resize(strlen(dropPolicy.c_str()));
+			if (dropPolicy == "drop_oldest") {
+				policy = TensorCapture::DropPolicy::DropOldest;
+			}
+			else if (dropPolicy == "block") {
+				policy = TensorCapture::DropPolicy::Block;
+			}
+		}
+
+		shared_ptr<TensorCapture::CaptureQueue> capture;
+		{
+			std::lock_guard<std::mutex> lock(m_captureMutex);
+			if (!m_capture) {
+				m_capture = make_shared<TensorCapture::CaptureQueue>();
+			}
+			capture = m_capture;
+		}
+
+		auto debugOperator = winrt::make<DebugOperator>(widePath, wideType, capture, stride, policy);
 		debugOperator.copy_to(kernel);
 		delete[] filePath, fileType, widePath, wideType;
 		return S_OK;
@@ -357,7 +504,19 @@ void DebugOperatorFactory::RegisterDebugSchema(winrt::com_ptr<IMLOperatorRegistr
 	debugFileTypeAttribute.required = false;
 	debugFileTypeAttribute.type = MLOperatorAttributeType::String;
 
-	std::vector<MLOperatorAttribute> attributes{ debugFilePathAttribute, debugFileTypeAttribute };
+	// keep every downsample-th row and column of the two innermost dimensions
+	MLOperatorAttribute debugDownsampleAttribute;
+	debugDownsampleAttribute.name = "downsample";
+	debugDownsampleAttribute.required = false;
+	debugDownsampleAttribute.type = MLOperatorAttributeType::Int;
+
+	// what Compute does when the writer thread is behind: drop_newest, drop_oldest or block
+	MLOperatorAttribute debugDropPolicyAttribute;
+	debugDropPolicyAttribute.name = "drop_policy";
+	debugDropPolicyAttribute.required = false;
+	debugDropPolicyAttribute.type = MLOperatorAttributeType::String;
+
+	std::vector<MLOperatorAttribute> attributes{ debugFilePathAttribute, debugFileTypeAttribute, debugDownsampleAttribute, debugDropPolicyAttribute };
 	debugSchema.attributes = attributes.data();
 	debugSchema.attributeCount = static_cast<uint32_t>(attributes.size());
 
@@ -375,7 +534,21 @@ void DebugOperatorFactory::RegisterDebugSchema(winrt::com_ptr<IMLOperatorRegistr
 	static const char* defaultTypes[] = { "png" };
 	debugFileTypeAttributeValue.strings = defaultPaths;
 
-	std::vector<MLOperatorAttributeNameValue> attributeDefaultValues{ debugFilePathAttributeValue, debugFileTypeAttributeValue };
+	MLOperatorAttributeNameValue debugDownsampleAttributeValue;
+	debugDownsampleAttributeValue.name = "downsample";
+	debugDownsampleAttributeValue.type = MLOperatorAttributeType::Int;
+	debugDownsampleAttributeValue.valueCount = 1;
+	static const int64_t defaultDownsample[] = { 1 };
+	debugDownsampleAttributeValue.ints = defaultDownsample;
+
+	MLOperatorAttributeNameValue debugDropPolicyAttributeValue;
+	debugDropPolicyAttributeValue.name = "drop_policy";
+	debugDropPolicyAttributeValue.type = MLOperatorAttributeType::String;
+	debugDropPolicyAttributeValue.valueCount = 1;
+	static const char* defaultDropPolicies[] = { "drop_newest" };
+	debugDropPolicyAttributeValue.strings = defaultDropPolicies;
+
+	std::vector<MLOperatorAttributeNameValue> attributeDefaultValues{ debugFilePathAttributeValue, debugFileTypeAttributeValue, debugDownsampleAttributeValue, debugDropPolicyAttributeValue };
 	debugSchema.defaultAttributes = attributeDefaultValues.data();
 	debugSchema.defaultAttributeCount = static_cast<uint32_t>(attributeDefaultValues.size());
 
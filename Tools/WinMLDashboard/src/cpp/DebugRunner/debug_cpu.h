@@ -3,6 +3,9 @@
 #include <windows.h>
 #include <winrt/Windows.AI.MachineLearning.h>
 #include "MLOperatorAuthor.h"
+#include "TensorCapture.h"
+#include <memory>
+#include <mutex>
 
 struct DebugShapeInferrer : winrt::implements<DebugShapeInferrer, IMLOperatorShapeInferrer>
 {
@@ -13,15 +16,20 @@ struct DebugOperator : winrt::implements<DebugOperator, IMLOperatorKernel>
 {
 	winrt::hstring m_filePath;
 	winrt::hstring m_fileType;
+	// Compute only copies the input into the capture queue of the session, its writer thread writes the files of
+	// the tap. The tap is shared by copies of the operator.
+	std::shared_ptr<TensorCapture::CaptureQueue> m_capture;
+	std::shared_ptr<const TensorCapture::CaptureTap> m_tap;
 
-	DebugOperator(winrt::hstring filePath, winrt::hstring fileType) :
-		m_filePath(filePath),
-		m_fileType(fileType)
-	{}
+	DebugOperator(winrt::hstring filePath, winrt::hstring fileType,
+		std::shared_ptr<TensorCapture::CaptureQueue> capture, uint32_t stride = 1,
+		TensorCapture::DropPolicy policy = TensorCapture::DropPolicy::DropNewest);
 
 	DebugOperator(const DebugOperator &obj) :
 		m_filePath(obj.m_filePath),
-		m_fileType(obj.m_fileType)
+		m_fileType(obj.m_fileType),
+		m_capture(obj.m_capture),
+		m_tap(obj.m_tap)
 	{}
 
 	// Computes the outputs of the kernel.  This may be called multiple times
@@ -32,6 +40,10 @@ struct DebugOperator : winrt::implements<DebugOperator, IMLOperatorKernel>
 
 struct DebugOperatorFactory : winrt::implements<DebugOperatorFactory, IMLOperatorKernelFactory>
 {
+	// One capture queue for the Debug operators of every session made with the registry, created with the first one
+	std::shared_ptr<TensorCapture::CaptureQueue> m_capture;
+	std::mutex m_captureMutex;
+
 	STDMETHOD(CreateKernel)(
 		IMLOperatorKernelCreationContext* context,
 		IMLOperatorKernel** kernel);
@@ -13,6 +13,7 @@ export interface IDebugNodeMap {
 export enum DebugFormat {
     text = "txt",
     png = "png",
+    binary = "wmltrace",
 }
 
 export default interface IState {
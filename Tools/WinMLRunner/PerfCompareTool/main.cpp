@@ -0,0 +1,251 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "../src/PerfComparison.h"
+
+// Compares the performance results of a candidate build with those of a baseline, for gating changes on latency
+// regressions (see src/PerfComparison.h).
+//   perf-compare <baseline> <candidate> [-RegressionThreshold <x>] [-ImprovementThreshold <x>] [-Alpha <p>] ...
+// Exit codes: 0 no regression; 1 regressions, or with -FailOnMissing configurations missing from the candidate;
+// 2 bad arguments or unreadable files.
+
+static void PrintUsage()
+{
+    std::cout << "perf-compare <baseline> <candidate> [options]" << std::endl;
+    std::cout << "  <baseline>, <candidate>        : a -PerfJsonOutput report, a -PerfOutput CSV file or a folder of "
+                 "them, exit with 1 if the candidate is slower"
+              << std::endl;
+    std::cout << "    -RegressionThreshold <x>     : smallest slowdown that fails, relative to the baseline "
+                 "(default 0.03)"
+              << std::endl;
+    std::cout << "    -ImprovementThreshold <x>    : smallest speedup that is reported (default 0.03)" << std::endl;
+    std::cout << "    -Alpha <p>                   : significance level of the tests, the confidence intervals are "
+                 "1 - p (default 0.01)"
+              << std::endl;
+    std::cout << "    -Metric <name>               : compare only this interval, can be repeated: load, "
+                 "createSession, firstBind, bind, firstEvaluate, evaluate (default all)"
+              << std::endl;
+    std::cout << "    -MinSamples <n>              : fewest iterations on each side to test a change (default 10)"
+              << std::endl;
+    std::cout << "    -Resamples <n>               : bootstrap resamples (default 2000)" << std::endl;
+    std::cout << "    -Seed <n>                    : seed of the bootstrap (default 1)" << std::endl;
+    std::cout << "    -FailOnMissing               : also exit with 1 if a configuration of the baseline is not in "
+                 "the candidate"
+              << std::endl;
+    std::cout << "    -Verbose                     : print every comparison, not only the changes" << std::endl;
+}
+
+static double ParseDouble(const std::string& value)
+{
+    char* end = nullptr;
+    double result = std::strtod(value.c_str(), &end);
+    if (value.empty() || *end != '\0')
+    {
+        throw std::invalid_argument("not a number: " + value);
+    }
+    return result;
+}
+
+static uint64_t ParseCount(const std::string& value)
+{
+    char* end = nullptr;
+    unsigned long long result = std::strtoull(value.c_str(), &end, 10);
+    if (value.empty() || value[0] == '-' || *end != '\0')
+    {
+        throw std::invalid_argument("not a count: " + value);
+    }
+    return result;
+}
+
+static std::string FormatPercent(double fraction)
+{
+    std::ostringstream text;
+    text << std::showpos << std::fixed << std::setprecision(2) << fraction * 100 << "%";
+    return text.str();
+}
+
+static void PrintComparison(const PerfComparison::MetricComparison& metric)
+{
+    std::ostringstream values;
+    values << std::fixed << std::setprecision(3) << metric.Baseline << " -> " << metric.Candidate << " ms";
+    std::cout << std::left << std::setw(13) << PerfComparison::GetVerdictName(metric.Result) << metric.Key.ToString()
+              << " " << metric.Metric << ": " << values.str();
+    if (metric.TestMethod != PerfComparison::Method::None)
+    {
+        std::cout << " " << FormatPercent(metric.RelativeChange) << " [" << FormatPercent(metric.Lower) << ", "
+                  << FormatPercent(metric.Upper) << "] p=" << std::setprecision(2) << std::scientific
+                  << metric.PValue << std::defaultfloat;
+    }
+    std::cout << " " << PerfComparison::GetMethodName(metric.TestMethod) << " n=" << metric.BaselineCount << "/"
+              << metric.CandidateCount << std::endl;
+}
+
+static PerfComparison::ResultSet ReadResults(const std::string& path)
+{
+    PerfComparison::ResultSet results;
+    results.AddPath(std::filesystem::u8path(path));
+    for (const auto& warning : results.GetWarnings())
+    {
+        std::cerr << "warning: " << warning << std::endl;
+    }
+    if (results.GetResults().empty())
+    {
+        throw std::runtime_error("no performance results in " + path);
+    }
+    return results;
+}
+
+static int Compare(const std::string& baselinePath, const std::string& candidatePath,
+                   const std::vector<std::string>& metrics, const PerfComparison::ComparisonOptions& options,
+                   bool failOnMissing, bool verbose)
+{
+    PerfComparison::ResultSet baseline = ReadResults(baselinePath);
+    PerfComparison::ResultSet candidate = ReadResults(candidatePath);
+    PerfComparison::Comparison comparison = PerfComparison::Compare(baseline, candidate, metrics, options);
+
+    // Regressions first, then improvements, each from the largest change
+    std::vector<PerfComparison::MetricComparison> sorted = comparison.Metrics;
+    std::stable_sort(sorted.begin(), sorted.end(), [](const auto& a, const auto& b) {
+        return a.Result != b.Result ? a.Result < b.Result
+                                    : std::abs(a.RelativeChange) > std::abs(b.RelativeChange);
+    });
+    for (const auto& metric : sorted)
+    {
+        if (verbose || metric.Result == PerfComparison::Verdict::Regression ||
+            metric.Result == PerfComparison::Verdict::Improvement)
+        {
+            PrintComparison(metric);
+        }
+    }
+    for (const auto& key : comparison.OnlyInBaseline)
+    {
+        std::cout << "missing      " << key.ToString() << ": only in " << baselinePath << std::endl;
+    }
+    if (verbose)
+    {
+        for (const auto& key : comparison.OnlyInCandidate)
+        {
+            std::cout << "new          " << key.ToString() << ": only in " << candidatePath << std::endl;
+        }
+    }
+
+    size_t regressions = comparison.Count(PerfComparison::Verdict::Regression);
+    std::cout << comparison.Metrics.size() << " comparisons: " << regressions << " regressions, "
+              << comparison.Count(PerfComparison::Verdict::Improvement) << " improvements, "
+              << comparison.Count(PerfComparison::Verdict::Unchanged) << " unchanged, "
+              << comparison.Count(PerfComparison::Verdict::Inconclusive) << " inconclusive; "
+              << comparison.OnlyInBaseline.size() << " configurations missing, " << comparison.OnlyInCandidate.size()
+              << " new" << std::endl;
+    bool fail = regressions > 0 || (failOnMissing && !comparison.OnlyInBaseline.empty());
+    return fail ? 1 : 0;
+}
+
+int main(int argc, char* argv[])
+{
+    std::vector<std::string> positional;
+    std::vector<std::string> metrics;
+    PerfComparison::ComparisonOptions options;
+    bool failOnMissing = false;
+    bool verbose = false;
+    try
+    {
+        for (int i = 1; i < argc; ++i)
+        {
+            std::string arg = argv[i];
+            bool hasValue = i + 1 < argc;
+            if (arg == "-Help" || arg == "-help" || arg == "/?")
+            {
+                PrintUsage();
+                return 0;
+            }
+            else if (arg == "-RegressionThreshold" && hasValue)
+            {
+                options.RegressionThreshold = ParseDouble(argv[++i]);
+            }
+            else if (arg == "-ImprovementThreshold" && hasValue)
+            {
+                options.ImprovementThreshold = ParseDouble(argv[++i]);
+            }
+            else if (arg == "-Alpha" && hasValue)
+            {
+                options.Alpha = ParseDouble(argv[++i]);
+            }
+            else if (arg == "-Metric" && hasValue)
+            {
+                std::string metric = argv[++i];
+                if (std::find(std::begin(PerfComparison::MetricNames), std::end(PerfComparison::MetricNames),
+                              metric) == std::end(PerfComparison::MetricNames))
+                {
+                    throw std::invalid_argument("unknown metric: " + metric);
+                }
+                metrics.push_back(metric);
+            }
+            else if (arg == "-MinSamples" && hasValue)
+            {
+                options.MinSamples = static_cast<size_t>(ParseCount(argv[++i]));
+            }
+            else if (arg == "-Resamples" && hasValue)
+            {
+                options.Resamples = static_cast<size_t>(ParseCount(argv[++i]));
+            }
+            else if (arg == "-Seed" && hasValue)
+            {
+                options.Seed = ParseCount(argv[++i]);
+            }
+            else if (arg == "-FailOnMissing")
+            {
+                failOnMissing = true;
+            }
+            else if (arg == "-Verbose")
+            {
+                verbose = true;
+            }
+            else if (!arg.empty() && arg[0] == '-')
+            {
+                throw std::invalid_argument("unknown option or missing value: " + arg);
+            }
+            else
+            {
+                positional.push_back(arg);
+            }
+        }
+        if (options.RegressionThreshold < 0 || options.ImprovementThreshold < 0)
+        {
+            throw std::invalid_argument("thresholds cannot be negative");
+        }
+        if (!(options.Alpha > 0 && options.Alpha < 1))
+        {
+            throw std::invalid_argument("-Alpha must be between 0 and 1");
+        }
+        if (options.Resamples < 100)
+        {
+            throw std::invalid_argument("-Resamples must be at least 100");
+        }
+    }
+    catch (const std::exception& e)
+    {
+        std::cerr << e.what() << std::endl;
+        PrintUsage();
+        return 2;
+    }
+
+    if (positional.size() != 2)
+    {
+        PrintUsage();
+        return 2;
+    }
+    try
+    {
+        return Compare(positional[0], positional[1], metrics, options, failOnMissing, verbose);
+    }
+    catch (const std::exception& e)
+    {
+        std::cerr << e.what() << std::endl;
+        return 2;
+    }
+}
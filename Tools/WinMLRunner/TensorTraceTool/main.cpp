@@ -0,0 +1,262 @@
+#include <algorithm>
+#include <cstdlib>
+#include <filesystem>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+#include "../src/MappedFile.h"
+#include "../src/TensorTrace.h"
+
+// Inspects, compares and creates tensor traces (.wmltrace files written by WinMLRunner -SaveTensorFormat Trace or by
+// the debug operator of WinMLDashboard).
+//   tensor-trace info <trace>
+//   tensor-trace diff <expected> <actual> [-AbsoluteTolerance <x>] [-RelativeTolerance <x>]
+//   tensor-trace convert <trace> <csv>... [-Name <name>] [-Compression None|Lz4]
+// Exit codes: 0 success and, for diff, matching traces; 1 traces that differ; 2 bad arguments or unreadable files.
+
+static void PrintUsage()
+{
+    std::cout << "tensor-trace <command> [options]" << std::endl;
+    std::cout << "  info <trace>                   : list the records of a trace" << std::endl;
+    std::cout << "  diff <expected> <actual>       : compare the records of two traces with the same name and "
+                 "iteration, exit with 1 if they differ"
+              << std::endl;
+    std::cout << "    -AbsoluteTolerance <x>       : largest absolute difference of matching elements (default 0)"
+              << std::endl;
+    std::cout << "    -RelativeTolerance <x>       : largest difference relative to the expected element (default 0)"
+              << std::endl;
+    std::cout << "  convert <trace> <csv>...       : write the Index,Value CSV files of WinMLRunner -SaveTensorData "
+                 "to a trace, one float32 record per file, the n-th file being iteration n"
+              << std::endl;
+    std::cout << "    -Name <name>                 : name of the records (default output)" << std::endl;
+    std::cout << "    -Compression <None|Lz4>      : payload compression (default Lz4)" << std::endl;
+}
+
+static std::wstring ToWide(const std::string& value) { return std::filesystem::path(value).wstring(); }
+
+static double ParseDouble(const std::string& value)
+{
+    char* end = nullptr;
+    double result = std::strtod(value.c_str(), &end);
+    if (value.empty() || *end != '\0')
+    {
+        throw std::invalid_argument("not a number: " + value);
+    }
+    return result;
+}
+
+static std::string FormatShape(const std::vector<int64_t>& shape)
+{
+    std::string text;
+    for (size_t i = 0; i < shape.size(); ++i)
+    {
+        text += (i > 0 ? "x" : "") + std::to_string(shape[i]);
+    }
+    return text.empty() ? "scalar" : text;
+}
+
+static std::string FormatRecord(const TensorTrace::Record& record)
+{
+    return record.Info.Name + " iteration " + std::to_string(record.Info.Iteration);
+}
+
+static int Info(const std::string& path)
+{
+    TensorTrace::TraceReader trace(ToWide(path));
+    std::cout << trace.GetRecords().size() << " records" << (trace.HasIndex() ? "" : ", no index (not closed)")
+              << std::endl;
+    for (const auto& record : trace.GetRecords())
+    {
+        std::cout << std::left << std::setw(32) << record.Info.Name << " iteration " << std::setw(6)
+                  << record.Info.Iteration << " " << std::setw(8)
+                  << TensorTrace::GetElementTypeName(record.Info.Type) << " " << std::setw(16)
+                  << FormatShape(record.Info.Shape) << " " << record.RawSize << " bytes";
+        if (record.PayloadCodec == TensorTrace::Codec::Lz4)
+        {
+            std::cout << ", lz4 " << record.PayloadSize << " bytes";
+        }
+        if (!record.Info.Metadata.empty())
+        {
+            std::cout << ", " << record.Info.Metadata;
+        }
+        std::cout << std::endl;
+    }
+    return 0;
+}
+
+static int Diff(const std::string& expectedPath, const std::string& actualPath,
+                const TensorTrace::Tolerance& tolerance)
+{
+    TensorTrace::TraceReader expected(ToWide(expectedPath));
+    TensorTrace::TraceReader actual(ToWide(actualPath));
+    size_t differences = 0;
+    auto results = TensorTrace::CompareTraces(expected, actual, tolerance);
+    for (const auto& result : results)
+    {
+        const TensorTrace::TensorDifference& difference = result.Difference;
+        if (result.Actual == nullptr)
+        {
+            std::cout << FormatRecord(*result.Expected) << ": only in " << expectedPath << std::endl;
+        }
+        else if (result.Expected == nullptr)
+        {
+            std::cout << FormatRecord(*result.Actual) << ": only in " << actualPath << std::endl;
+        }
+        else if (!difference.ShapesMatch)
+        {
+            std::cout << FormatRecord(*result.Expected) << ": shape " << FormatShape(result.Expected->Info.Shape)
+                      << " != " << FormatShape(result.Actual->Info.Shape) << std::endl;
+        }
+        else
+        {
+            std::cout << FormatRecord(*result.Expected) << ": "
+                      << (difference.Mismatches == 0 ? "match" : std::to_string(difference.Mismatches) + " of " +
+                                                                    std::to_string(difference.ElementCount) +
+                                                                    " elements differ, first at " +
+                                                                    std::to_string(difference.FirstMismatch))
+                      << ", max abs error " << difference.MaxAbsoluteError << " at " << difference.MaxErrorIndex
+                      << " (" << difference.Expected << " vs " << difference.Actual << ")";
+            if (!difference.TypesMatch)
+            {
+                std::cout << ", " << TensorTrace::GetElementTypeName(result.Expected->Info.Type) << " vs "
+                          << TensorTrace::GetElementTypeName(result.Actual->Info.Type);
+            }
+            std::cout << std::endl;
+        }
+        differences += result.IsMatch() ? 0 : 1;
+    }
+    std::cout << (differences == 0 ? "Traces match" : std::to_string(differences) + " records differ") << std::endl;
+    return differences == 0 ? 0 : 1;
+}
+
+// Reads the values of an Index,Value CSV written by -SaveTensorData.
+static std::vector<float> ReadTensorCsv(const std::string& path)
+{
+    MappedFile file(ToWide(path));
+    const char* position = file.Data();
+    const char* end = position + file.Size();
+    std::vector<float> values;
+    bool header = true;
+    while (position < end)
+    {
+        const char* lineEnd = std::find(position, end, '\n');
+        const char* comma = std::find(position, lineEnd, ',');
+        if (header)
+        {
+            header = false;
+        }
+        else if (comma != lineEnd)
+        {
+            const char* valueEnd = lineEnd > comma && lineEnd[-1] == '\r' ? lineEnd - 1 : lineEnd;
+            std::string value(comma + 1, valueEnd);
+            values.push_back(static_cast<float>(ParseDouble(value)));
+        }
+        position = lineEnd + (lineEnd < end ? 1 : 0);
+    }
+    return values;
+}
+
+static int Convert(const std::string& tracePath, const std::vector<std::string>& csvPaths, const std::string& name,
+                   TensorTrace::Codec codec)
+{
+    TensorTrace::TraceWriter trace(ToWide(tracePath), codec);
+    for (size_t i = 0; i < csvPaths.size(); ++i)
+    {
+        std::vector<float> values = ReadTensorCsv(csvPaths[i]);
+        TensorTrace::RecordInfo info;
+        info.Name = name;
+        info.Shape = { static_cast<int64_t>(values.size()) };
+        info.Iteration = i;
+        info.Metadata = "source=" + csvPaths[i];
+        trace.Add(info, values.data(), values.size() * sizeof(float));
+    }
+    trace.Close();
+    std::cout << "Wrote " << csvPaths.size() << " records to " << tracePath << std::endl;
+    return 0;
+}
+
+int main(int argc, char* argv[])
+{
+    std::vector<std::string> positional;
+    TensorTrace::Tolerance tolerance;
+    std::string name = "output";
+    TensorTrace::Codec codec = TensorTrace::Codec::Lz4;
+    try
+    {
+        for (int i = 1; i < argc; ++i)
+        {
+            std::string arg = argv[i];
+            bool hasValue = i + 1 < argc;
+            if (arg == "-Help" || arg == "-help" || arg == "/?")
+            {
+                PrintUsage();
+                return 0;
+            }
+            else if (arg == "-AbsoluteTolerance" && hasValue)
+            {
+                tolerance.Absolute = ParseDouble(argv[++i]);
+            }
+            else if (arg == "-RelativeTolerance" && hasValue)
+            {
+                tolerance.Relative = ParseDouble(argv[++i]);
+            }
+            else if (arg == "-Name" && hasValue)
+            {
+                name = argv[++i];
+            }
+            else if (arg == "-Compression" && hasValue)
+            {
+                std::string value = argv[++i];
+                if (value != "None" && value != "Lz4")
+                {
+                    throw std::invalid_argument("unknown compression: " + value);
+                }
+                codec = value == "Lz4" ? TensorTrace::Codec::Lz4 : TensorTrace::Codec::None;
+            }
+            else if (!arg.empty() && arg[0] == '-')
+            {
+                throw std::invalid_argument("unknown option or missing value: " + arg);
+            }
+            else
+            {
+                positional.push_back(arg);
+            }
+        }
+        if (tolerance.Absolute < 0 || tolerance.Relative < 0)
+        {
+            throw std::invalid_argument("tolerances cannot be negative");
+        }
+    }
+    catch (const std::exception& e)
+    {
+        std::cerr << e.what() << std::endl;
+        PrintUsage();
+        return 2;
+    }
+
+    std::string command = positional.empty() ? "" : positional[0];
+    try
+    {
+        if (command == "info" && positional.size() == 2)
+        {
+            return Info(positional[1]);
+        }
+        if (command == "diff" && positional.size() == 3)
+        {
+            return Diff(positional[1], positional[2], tolerance);
+        }
+        if (command == "convert" && positional.size() >= 3)
+        {
+            return Convert(positional[1], std::vector<std::string>(positional.begin() + 2, positional.end()), name,
+                           codec);
+        }
+    }
+    catch (const std::exception& e)
+    {
+        std::cerr << e.what() << std::endl;
+        return 2;
+    }
+    PrintUsage();
+    return 2;
+}
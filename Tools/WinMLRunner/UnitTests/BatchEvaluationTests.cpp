@@ -0,0 +1,91 @@
+// Tests of the batch size sweep of the batched evaluation mode (see src/BatchEvaluation.h), with stub evaluators.
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+#include "BatchEvaluation.h"
+#include "TestCheck.h"
+
+static void TestBatchSizeSweep()
+{
+    CHECK(std::vector<uint32_t>({ 1 }) == GetBatchSizeSweep(1));
+    CHECK(std::vector<uint32_t>({ 1, 2, 4, 8, 16, 24 }) == GetBatchSizeSweep(24));
+    CHECK(std::vector<uint32_t>({ 1, 2, 4, 8 }) == GetBatchSizeSweep(8));
+    CHECK(GetBatchSizeSweep(0).empty());
+}
+
+static void TestPackBatchRepeatsSamples()
+{
+    std::vector<float> first = { 1, 2, 3 };
+    std::vector<float> second = { 4, 5, 6 };
+    std::vector<const void*> samples = { first.data(), second.data() };
+    std::vector<float> batch(5 * 3, -1);
+    PackBatch(samples, 3 * sizeof(float), 5, batch.data());
+    CHECK(batch == std::vector<float>({ 1, 2, 3, 4, 5, 6, 1, 2, 3, 4, 5, 6, 1, 2, 3 }));
+
+    // A batch smaller than the number of samples only takes the first ones
+    std::vector<float> single(3);
+    PackBatch(samples, 3 * sizeof(float), 1, single.data());
+    CHECK(single == first);
+
+    CHECK_THROWS(std::invalid_argument,
+                 [&batch]() { PackBatch(std::vector<const void*>(), sizeof(float), 1, batch.data()); });
+}
+
+static void TestSweepTimesEveryBatchSize()
+{
+    std::vector<uint32_t> factoryBatchSizes;
+    uint32_t evaluations = 0;
+    BatchEvaluatorFactory factory = [&](uint32_t batchSize) -> std::function<void()> {
+        factoryBatchSizes.push_back(batchSize);
+        return [&evaluations]() { ++evaluations; };
+    };
+    std::vector<BatchResult> results = RunBatchSweep(GetBatchSizeSweep(4), 10, 2, factory);
+
+    CHECK(factoryBatchSizes == std::vector<uint32_t>({ 1, 2, 4 }));
+    CHECK(static_cast<uint32_t>(3 * (10 + 2)) == evaluations);
+    CHECK(static_cast<size_t>(3) == results.size());
+    for (const auto& result : results)
+    {
+        // Warm up evaluations are run but not recorded
+        CHECK(static_cast<uint64_t>(10) == result.NumBatches);
+        CHECK(static_cast<uint64_t>(10) == result.SampleLatency.GetCount());
+        CHECK(UnitTests::Near(result.BatchLatency.GetMean() / result.BatchSize, result.SampleLatency.GetMean(),
+                              1e-9));
+    }
+    CHECK(UnitTests::Near(0.0, results[0].ThroughputGain, 1e-9));
+}
+
+static void TestThroughputKnee()
+{
+    // A stub evaluator with a fixed cost per batch plus a cost per sample that grows past 8 samples gains
+    // throughput from batching up to 8 samples and then levels off
+    BatchEvaluatorFactory factory = [](uint32_t batchSize) -> std::function<void()> {
+        auto duration =
+            std::chrono::microseconds(8000 + 250 * batchSize + (batchSize > 8 ? 2000 * batchSize : 0));
+        return [duration]() { std::this_thread::sleep_for(duration); };
+    };
+    std::vector<BatchResult> results = RunBatchSweep(GetBatchSizeSweep(32), 5, 1, factory);
+    CHECK(static_cast<size_t>(6) == results.size());
+    CHECK(results[1].ThroughputGain > 1.5);
+    CHECK(static_cast<uint32_t>(8) == results[FindThroughputKnee(results)].BatchSize);
+
+    // Without a knee the largest batch size is reported
+    std::vector<BatchResult> growing(3);
+    growing[1].ThroughputGain = 2;
+    growing[2].ThroughputGain = 1.5;
+    CHECK(static_cast<size_t>(2) == FindThroughputKnee(growing));
+    CHECK(static_cast<size_t>(0) == FindThroughputKnee(std::vector<BatchResult>()));
+}
+
+int main()
+{
+    return UnitTests::RunTests({
+        { "TestBatchSizeSweep", TestBatchSizeSweep },
+        { "TestPackBatchRepeatsSamples", TestPackBatchRepeatsSamples },
+        { "TestSweepTimesEveryBatchSize", TestSweepTimesEveryBatchSize },
+        { "TestThroughputKnee", TestThroughputKnee },
+    });
+}
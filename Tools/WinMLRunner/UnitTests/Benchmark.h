@@ -0,0 +1,85 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+
+// Timing for the benchmarks of the WinMLRunner headers that build without WinML. Every benchmark program takes
+// -Repeats <n>, the number of runs of each measurement (the fastest one is reported), and -Scale <f>, which multiplies
+// its problem sizes. ctest runs each benchmark once at a small scale, so that they keep building and running.
+namespace Benchmarks
+{
+    struct BenchmarkOptions
+    {
+        uint32_t Repeats = 5;
+        double Scale = 1.0;
+    };
+
+    // Returns false if the program should exit: on -Help, and on an unknown option, which is reported
+    inline bool ParseOptions(int argc, char** argv, BenchmarkOptions& options, int& exitCode)
+    {
+        exitCode = 0;
+        for (int i = 1; i < argc; i++)
+        {
+            std::string option = argv[i];
+            bool hasValue = i + 1 < argc;
+            if (option == "-Repeats" && hasValue)
+            {
+                options.Repeats = static_cast<uint32_t>((std::max)(1, std::atoi(argv[++i])));
+            }
+            else if (option == "-Scale" && hasValue)
+            {
+                options.Scale = std::atof(argv[++i]);
+            }
+            else
+            {
+                exitCode = option == "-Help" ? 0 : 1;
+                if (exitCode != 0)
+                {
+                    std::cout << "Unknown option or missing value: " << option << std::endl;
+                }
+                std::cout << argv[0] << " [options]" << std::endl;
+                std::cout << "  -Repeats <n> : runs of each measurement, the fastest one is reported (default 5)"
+                          << std::endl;
+                std::cout << "  -Scale <f>   : multiplies the problem sizes (default 1)" << std::endl;
+                std::cout << "  -Help        : print this message" << std::endl;
+                return false;
+            }
+        }
+        if (!(options.Scale > 0))
+        {
+            std::cout << "-Scale must be positive" << std::endl;
+            exitCode = 1;
+            return false;
+        }
+        return true;
+    }
+
+    // A problem size multiplied by the -Scale option, at least 1
+    inline size_t Scaled(size_t size, const BenchmarkOptions& options)
+    {
+        return (std::max)(static_cast<size_t>(1), static_cast<size_t>(size * options.Scale));
+    }
+
+    // Seconds of the fastest of options.Repeats calls of function
+    template <typename Function> double MeasureSeconds(const BenchmarkOptions& options, Function&& function)
+    {
+        double best = 0;
+        for (uint32_t repeat = 0; repeat < options.Repeats; repeat++)
+        {
+            auto start = std::chrono::steady_clock::now();
+            function();
+            double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            best = repeat == 0 ? seconds : (std::min)(best, seconds);
+        }
+        return best;
+    }
+
+    inline volatile double KeptValue = 0;
+
+    // Keeps the compiler from dropping a computation whose result is otherwise unused
+    inline void KeepValue(double value) { KeptValue = value; }
+}
@@ -0,0 +1,88 @@
+// Tests of the scheduling and aggregation of the concurrent evaluation throughput mode (see
+// src/ConcurrentEvaluation.h), with stub evaluators.
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+#include "ConcurrentEvaluation.h"
+#include "TestCheck.h"
+
+static void TestThreadCountSweep()
+{
+    CHECK(std::vector<unsigned>({ 1 }) == GetThreadCountSweep(1));
+    CHECK(std::vector<unsigned>({ 1, 2, 4, 6 }) == GetThreadCountSweep(6));
+    CHECK(std::vector<unsigned>({ 1, 2, 4, 8 }) == GetThreadCountSweep(8));
+    CHECK(GetThreadCountSweep(0).empty());
+}
+
+static void TestEachWorkerOwnsItsEvaluator()
+{
+    const unsigned numThreads = 4;
+    const uint32_t iterations = 25;
+    std::vector<std::atomic<uint32_t>> evaluationCounts(numThreads);
+    std::atomic<uint32_t> factoryCalls(0);
+    EvaluatorFactory factory = [&](unsigned threadIndex) -> std::function<void()> {
+        ++factoryCalls;
+        return [&evaluationCounts, threadIndex]() { ++evaluationCounts[threadIndex]; };
+    };
+
+    ThroughputResult result = RunConcurrentEvaluation(numThreads, iterations, 2, factory);
+    CHECK(numThreads == factoryCalls.load());
+    CHECK(static_cast<uint64_t>(numThreads * iterations) == result.TotalInferences);
+    CHECK(static_cast<size_t>(numThreads) == result.ThreadLatency.size());
+    for (unsigned i = 0; i < numThreads; ++i)
+    {
+        // Warm up evaluations are run but not recorded
+        CHECK(iterations + 2 == evaluationCounts[i].load());
+        CHECK(static_cast<uint64_t>(iterations) == result.ThreadLatency[i].GetCount());
+    }
+}
+
+static void TestThroughputScaling()
+{
+    // A stub evaluator that sleeps scales linearly with the number of threads
+    EvaluatorFactory factory = [](unsigned) -> std::function<void()> {
+        return []() { std::this_thread::sleep_for(std::chrono::milliseconds(5)); };
+    };
+    std::vector<ThroughputResult> results = RunThroughputSweep(GetThreadCountSweep(4), 20, 1, factory);
+
+    CHECK(static_cast<size_t>(3) == results.size());
+    CHECK(UnitTests::Near(1.0, results[0].ScalingEfficiency, 1e-9));
+    for (const auto& result : results)
+    {
+        CHECK(result.InferencesPerSecond > 0);
+        CHECK(result.ScalingEfficiency > 0.5);
+        CHECK(result.Latency.GetPercentile(50) >= 5.0 * (1 - result.Latency.GetRelativePrecision()));
+    }
+    CHECK(results[2].InferencesPerSecond > results[0].InferencesPerSecond * 2);
+}
+
+static void TestEvaluatorFailureIsRethrown()
+{
+    EvaluatorFactory failingFactory = [](unsigned threadIndex) -> std::function<void()> {
+        if (threadIndex == 1)
+        {
+            throw std::runtime_error("session creation failed");
+        }
+        return []() {};
+    };
+    CHECK_THROWS(std::runtime_error, [&failingFactory]() { RunConcurrentEvaluation(3, 10, 0, failingFactory); });
+
+    EvaluatorFactory failingEvaluator = [](unsigned) -> std::function<void()> {
+        return []() { throw std::runtime_error("evaluation failed"); };
+    };
+    CHECK_THROWS(std::runtime_error, [&failingEvaluator]() { RunConcurrentEvaluation(2, 10, 0, failingEvaluator); });
+}
+
+int main()
+{
+    return UnitTests::RunTests({
+        { "TestThreadCountSweep", TestThreadCountSweep },
+        { "TestEachWorkerOwnsItsEvaluator", TestEachWorkerOwnsItsEvaluator },
+        { "TestThroughputScaling", TestThroughputScaling },
+        { "TestEvaluatorFailureIsRethrown", TestEvaluatorFailureIsRethrown },
+    });
+}
@@ -0,0 +1,102 @@
+// Benchmark of the CSV reader (see src/CsvReader.h) against the getline and stof loop of ReadCSVIntoBuffer it
+// replaced, on a synthetic file of eight 3x224x224 tensors, one per row, the size of the regression inputs. The file
+// is read from disk by every path: memory mapped and parsed on the calling thread, and parsed in chunks on a thread
+// pool.
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+#include "ThreadPool.h"
+#include "CsvReader.h"
+#include "Benchmark.h"
+
+// Rows of valuesPerRow random values with the given number of decimals. Rows end with a separator before the line
+// break, so that the getline loop, which only splits on commas, still reads every value.
+static std::string GenerateCsv(size_t rows, size_t valuesPerRow, int digits)
+{
+    std::mt19937 generator(11);
+    std::uniform_real_distribution<float> distribution(-3.0f, 3.0f);
+    std::string text;
+    char buffer[64];
+    for (size_t row = 0; row < rows; ++row)
+    {
+        for (size_t i = 0; i < valuesPerRow; ++i)
+        {
+            snprintf(buffer, sizeof(buffer), "%.*f", digits, distribution(generator));
+            text += buffer;
+            text += i + 1 < valuesPerRow || row + 1 < rows ? "," : "";
+        }
+        text += "\n";
+    }
+    return text;
+}
+
+// The parse loop of ReadCSVIntoBuffer
+static std::vector<float> ReadWithGetline(const std::filesystem::path& path)
+{
+    std::ifstream fileStream(path);
+    std::vector<float> values;
+    std::string field;
+    while (std::getline(fileStream, field, ','))
+    {
+        values.push_back(std::stof(field));
+    }
+    return values;
+}
+
+static void PrintRow(const char* name, double seconds, double referenceSeconds, size_t bytes)
+{
+    std::cout << std::left << std::setw(30) << name << std::fixed << std::setprecision(2) << std::setw(12)
+              << seconds * 1e3 << std::setw(12) << bytes / seconds / (1024 * 1024) << referenceSeconds / seconds
+              << "x" << std::endl;
+}
+
+int main(int argc, char** argv)
+{
+    Benchmarks::BenchmarkOptions options;
+    int exitCode;
+    if (!Benchmarks::ParseOptions(argc, argv, options, exitCode))
+    {
+        return exitCode;
+    }
+
+    std::string text = GenerateCsv(8, Benchmarks::Scaled(3 * 224 * 224, options), 9);
+    std::filesystem::path path = std::filesystem::temp_directory_path() / "WinMLRunnerCsvReaderBenchmark.csv";
+    {
+        std::ofstream file(path, std::ios::binary);
+        file << text;
+    }
+    ThreadPool pool((std::max)(1u, std::thread::hardware_concurrency()));
+
+    std::vector<float> getlineValues;
+    CsvReader::CsvData serial, parallel;
+    double getlineSeconds =
+        Benchmarks::MeasureSeconds(options, [&]() { getlineValues = ReadWithGetline(path); });
+    double serialSeconds =
+        Benchmarks::MeasureSeconds(options, [&]() { serial = CsvReader::ReadCsvFile(path.wstring()); });
+    double parallelSeconds =
+        Benchmarks::MeasureSeconds(options, [&]() { parallel = CsvReader::ReadCsvFile(path.wstring(), &pool); });
+    std::filesystem::remove(path);
+    if (serial.Values != getlineValues || parallel.Values != getlineValues)
+    {
+        std::cout << "The CSV reader and the getline loop read different values" << std::endl;
+        return 1;
+    }
+
+    std::cout << std::fixed << std::setprecision(1) << text.size() / (1024.0 * 1024) << " MB, "
+              << getlineValues.size() << " values" << std::endl;
+    std::cout << std::left << std::setw(30) << "path" << std::setw(12) << "ms" << std::setw(12) << "MB/s"
+              << "speedup" << std::endl;
+    PrintRow("getline + stof", getlineSeconds, getlineSeconds, text.size());
+    PrintRow("CsvReader", serialSeconds, getlineSeconds, text.size());
+    std::string parallelName = "CsvReader on " + std::to_string(pool.NumThreads() + 1) + " threads";
+    PrintRow(parallelName.c_str(), parallelSeconds, getlineSeconds, text.size());
+    return 0;
+}
@@ -0,0 +1,143 @@
+// Tests of the memory-mapped CSV reader of the CSV input (see src/CsvReader.h).
+#include <charconv>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <random>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <vector>
+#include "ThreadPool.h"
+#include "CsvReader.h"
+#include "TestCheck.h"
+
+static std::string GenerateCsv(size_t rows, size_t valuesPerRow, int digits)
+{
+    std::mt19937 generator(11);
+    std::uniform_real_distribution<float> distribution(-3.0f, 3.0f);
+    std::string text;
+    char buffer[64];
+    for (size_t row = 0; row < rows; ++row)
+    {
+        for (size_t i = 0; i < valuesPerRow; ++i)
+        {
+            snprintf(buffer, sizeof(buffer), "%.*f", digits, distribution(generator));
+            text += buffer;
+            text += i + 1 < valuesPerRow ? "," : "\n";
+        }
+    }
+    return text;
+}
+
+static void TestParseFloatMatchesFromChars()
+{
+    std::vector<std::string> numbers = { "0", "-0", "+1", "1.5", "-2.25e-3", "3.4028234e38", "1e-45", "7E+2",
+                                         "0.000000000000000000000000000001", "123456789012345678901234567890",
+                                         "0.1", "16777217", "0.30000001192092896", "1e39", "inf", "-nan" };
+    std::mt19937 generator(5);
+    std::uniform_real_distribution<float> distribution(-1000.0f, 1000.0f);
+    for (int i = 0; i < 100000; ++i)
+    {
+        float value = distribution(generator);
+        char buffer[64];
+        snprintf(buffer, sizeof(buffer), i % 3 == 0 ? "%.9g" : (i % 3 == 1 ? "%.4f" : "%.6e"), value);
+        numbers.push_back(buffer);
+    }
+
+    for (const auto& number : numbers)
+    {
+        const char* begin = number.data();
+        const char* end = begin + number.size();
+        float expected = 0;
+        auto parsed = std::from_chars(begin + (number[0] == '+' ? 1 : 0), end, expected);
+        float actual = 0;
+        const char* next = CsvReader::ParseFloat(begin, end, actual);
+        if (parsed.ec != std::errc())
+        {
+            CHECK(next == nullptr);
+            continue;
+        }
+        CHECK(next == end);
+        CHECK(std::memcmp(&expected, &actual, sizeof(float)) == 0 || (expected != expected));
+    }
+}
+
+static void TestSeparatorsAndRows()
+{
+    std::string text = "\xEF\xBB\xBF" "1,2,3,\n4,5,6,\r\n\n7\t8 9\n,";
+    auto csvData = CsvReader::ParseCsv(text.data(), text.size());
+    CHECK(static_cast<size_t>(9) == csvData.Values.size());
+    for (size_t i = 0; i < csvData.Values.size(); ++i)
+    {
+        CHECK(static_cast<float>(i + 1) == csvData.Values[i]);
+    }
+    CHECK(static_cast<size_t>(3) == csvData.RowSizes.size());
+    CHECK(static_cast<size_t>(3) == csvData.GetUniformRowSize());
+
+    text = "1,2\n3\n";
+    CHECK(static_cast<size_t>(0) == CsvReader::ParseCsv(text.data(), text.size()).GetUniformRowSize());
+}
+
+static void TestInvalidNumbersThrow()
+{
+    for (std::string text : { "1,abc,3", "1,2x", "--1", "1.5.5" })
+    {
+        CHECK_THROWS(std::invalid_argument, [&text]() { CsvReader::ParseCsv(text.data(), text.size()); });
+    }
+}
+
+static void TestParallelChunksMatchSerial()
+{
+    std::string text = GenerateCsv(64, 16384, 3);
+    ThreadPool pool(4);
+    auto serial = CsvReader::ParseCsv(text.data(), text.size());
+    auto parallel = CsvReader::ParseCsv(text.data(), text.size(), &pool);
+    CHECK(static_cast<size_t>(64 * 16384) == serial.Values.size());
+    CHECK(serial.Values == parallel.Values);
+    CHECK(serial.RowSizes == parallel.RowSizes);
+    CHECK(static_cast<size_t>(16384) == parallel.GetUniformRowSize());
+}
+
+static void TestReadCsvFile()
+{
+    std::filesystem::path path = std::filesystem::temp_directory_path() / L"WinMLRunnerCsvReaderTest.csv";
+    {
+        std::ofstream file(path, std::ios::binary);
+        file << "0.5,1.5\n2.5,3.5\n";
+    }
+    auto csvData = CsvReader::ReadCsvFile(path.wstring());
+    std::filesystem::remove(path);
+    CHECK(csvData.Values == std::vector<float>({ 0.5f, 1.5f, 2.5f, 3.5f }));
+    CHECK(static_cast<size_t>(2) == csvData.GetUniformRowSize());
+    CHECK_THROWS(std::runtime_error, [&path]() { CsvReader::ReadCsvFile(path.wstring()); });
+}
+
+// A one row tensor, like the CSV inputs of the tests, reads as it did with the getline and stof loop of
+// ReadCSVIntoBuffer.
+static void TestMatchesGetline()
+{
+    std::string text = GenerateCsv(1, 16384, 9);
+    std::vector<float> expected;
+    std::istringstream stream(text);
+    std::string field;
+    while (std::getline(stream, field, ','))
+    {
+        expected.push_back(std::stof(field));
+    }
+    CHECK(CsvReader::ParseCsv(text.data(), text.size()).Values == expected);
+}
+
+int main()
+{
+    return UnitTests::RunTests({
+        { "TestParseFloatMatchesFromChars", TestParseFloatMatchesFromChars },
+        { "TestSeparatorsAndRows", TestSeparatorsAndRows },
+        { "TestInvalidNumbersThrow", TestInvalidNumbersThrow },
+        { "TestParallelChunksMatchSerial", TestParallelChunksMatchSerial },
+        { "TestReadCsvFile", TestReadCsvFile },
+        { "TestMatchesGetline", TestMatchesGetline },
+    });
+}
@@ -0,0 +1,133 @@
+// Tests of the hardware counters (see src/HardwareCounters.h): the interval counts and totals, and on Linux the
+// perf_event software events of this process.
+#include <cstddef>
+#include <cstdint>
+#include <iostream>
+#include <string>
+#include <vector>
+#if defined(__linux__)
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+#include "HardwareCounters.h"
+#include "TestCheck.h"
+
+static HardwareCounters::Reading MakeReading(uint64_t value, uint64_t enabled, uint64_t running)
+{
+    HardwareCounters::Reading reading;
+    reading.Value = value;
+    reading.Enabled = enabled;
+    reading.Running = running;
+    reading.Valid = true;
+    return reading;
+}
+
+#if defined(__linux__)
+// Maps fresh memory, touches each of its pages and unmaps it. Returns the number of pages touched, each of which
+// faults: unlike memory the allocator already has, the pages of a new mapping are only backed on their first touch.
+// Without huge pages, so that each page is a fault of its own.
+static size_t TouchFreshPages()
+{
+    const size_t pageSize = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    const size_t pageCount = 1024;
+    void* mapping = mmap(nullptr, pageCount * pageSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (mapping == MAP_FAILED)
+    {
+        return 0;
+    }
+    madvise(mapping, pageCount * pageSize, MADV_NOHUGEPAGE);
+    volatile char* memory = static_cast<char*>(mapping);
+    for (size_t i = 0; i < pageCount; ++i)
+    {
+        memory[i * pageSize] = 1;
+    }
+    munmap(mapping, pageCount * pageSize);
+    return pageCount;
+}
+#endif
+
+static void TestDifferenceScalesMultiplexedCounts()
+{
+    HardwareCounters::Snapshot start = { MakeReading(100, 1000, 1000), MakeReading(50, 1000, 400),
+                                         MakeReading(7, 1000, 1000), HardwareCounters::Reading() };
+    HardwareCounters::Snapshot end = { MakeReading(300, 2000, 2000), MakeReading(150, 3000, 900),
+                                       MakeReading(7, 2000, 1000), MakeReading(5, 10, 10) };
+    HardwareCounters::IntervalCounts counts = HardwareCounters::Difference(start, end);
+    CHECK(static_cast<size_t>(4) == counts.Values.size());
+    CHECK(counts.Valid[0]);
+    CHECK(200.0 == counts.Values[0]);
+    // Counting for 500 of 2000 ns: scaled by 4
+    CHECK(counts.Valid[1]);
+    CHECK(400.0 == counts.Values[1]);
+    // Not scheduled at all during the interval, or not open at its start
+    CHECK(!(counts.Valid[2]));
+    CHECK(!(counts.Valid[3]));
+}
+
+static void TestTotals()
+{
+    HardwareCounters::CounterTotals totals;
+    totals.Add({ { 1000, 2500, 10 }, { true, true, false } });
+    totals.Add({ { 3000, 3500, 30 }, { true, true, true } });
+    CHECK(static_cast<uint64_t>(2) == totals.GetIntervalCount());
+    CHECK(2000.0 == totals.GetAverage(0));
+    CHECK(30.0 == totals.GetAverage(2));
+    CHECK(1.5 == totals.GetRatio(1, 0));
+    CHECK(!(totals.HasEvent(3)));
+    CHECK(0.0 == totals.GetRatio(3, 0));
+    totals.Reset();
+    CHECK(!(totals.HasEvent(0)));
+}
+
+// Counts software events of this process on Linux; elsewhere no counters open.
+static void TestCountsEvents()
+{
+    // The default hardware events need a PMU, which virtual machines often lack; software events do not
+    std::vector<HardwareCounters::EventDescription> events = {
+        { "taskClock", "task clock", HardwareCounters::PerfTypeSoftware, 1, 0 },
+        { "pageFaults", "page faults", HardwareCounters::PerfTypeSoftware, 2, 0 },
+        { "contextSwitches", "context switches", HardwareCounters::PerfTypeSoftware, 3, 1 },
+    };
+    HardwareCounters::CounterSet counters(events);
+#if defined(__linux__)
+    if (counters.GetOpenCount() == 0)
+    {
+        std::cout << "perf_event is not available: " << counters.GetError() << std::endl;
+        return;
+    }
+
+    // The kernel can start counting an event some time after it is opened, so the interval is measured again until
+    // the page fault counter ran for all of it
+    bool measured = false;
+    for (int attempt = 0; attempt < 10 && !measured; ++attempt)
+    {
+        HardwareCounters::Snapshot start = counters.Read();
+        size_t pageCount = TouchFreshPages();
+        HardwareCounters::Snapshot end = counters.Read();
+        const HardwareCounters::Reading& before = start[1];
+        const HardwareCounters::Reading& after = end[1];
+        measured = before.Valid && after.Valid && after.Running > before.Running &&
+                   after.Running - before.Running == after.Enabled - before.Enabled;
+        if (measured)
+        {
+            HardwareCounters::IntervalCounts counts = HardwareCounters::Difference(start, end);
+            CHECK(counts.Valid[0] && counts.Values[0] > 0);
+            CHECK(pageCount > 0 && after.Value - before.Value >= pageCount);
+        }
+    }
+    CHECK(measured);
+#else
+    CHECK(static_cast<size_t>(0) == counters.GetOpenCount());
+    CHECK(!(counters.GetError().empty()));
+    CHECK(!(counters.Read()[0].Valid));
+#endif
+}
+
+int main()
+{
+    return UnitTests::RunTests({
+        { "TestDifferenceScalesMultiplexedCounts", TestDifferenceScalesMultiplexedCounts },
+        { "TestTotals", TestTotals },
+        { "TestCountsEvents", TestCountsEvents },
+    });
+}
@@ -0,0 +1,159 @@
+// Tests of the convergence monitor of the bind and evaluate iterations (see src/IterationConvergence.h), fed
+// lognormal latency streams with and without a warmup.
+#include <cmath>
+#include <cstddef>
+#include <random>
+#include <stdexcept>
+#include <vector>
+#include "IterationConvergence.h"
+#include "TestCheck.h"
+
+// Lognormal latencies around median ms
+static std::vector<double> MakeStream(std::mt19937& generator, size_t count, double median, double sigma)
+{
+    std::lognormal_distribution<double> distribution(std::log(median), sigma);
+    std::vector<double> stream(count);
+    for (double& value : stream)
+    {
+        value = distribution(generator);
+    }
+    return stream;
+}
+
+// Feeds the stream to a monitor, with the latencies as the time passing, until it stops
+static IterationConvergence::ConvergenceResult Run(const IterationConvergence::ConvergenceOptions& options,
+                                                   const std::vector<double>& stream)
+{
+    IterationConvergence::ConvergenceMonitor monitor(options);
+    double elapsed = 0;
+    for (double latency : stream)
+    {
+        elapsed += latency;
+        if (monitor.AddIteration(latency, elapsed))
+        {
+            break;
+        }
+    }
+    return monitor.GetResult();
+}
+
+static void TestNormalQuantile()
+{
+    CHECK(UnitTests::Near(0.0, IterationConvergence::NormalQuantile(0.5), 1e-9));
+    CHECK(UnitTests::Near(1.959964, IterationConvergence::NormalQuantile(0.975), 1e-6));
+    CHECK(UnitTests::Near(-2.326348, IterationConvergence::NormalQuantile(0.01), 1e-6));
+    CHECK(UnitTests::Near(3.090232, IterationConvergence::NormalQuantile(0.999), 1e-6));
+}
+
+static void TestFindsWarmup()
+{
+    // 40 iterations that start 5x slower and settle, then a steady stream
+    std::mt19937 generator(1);
+    std::vector<double> stream = MakeStream(generator, 400, 10.0, 0.05);
+    for (size_t i = 0; i < 40; ++i)
+    {
+        stream[i] *= 1 + 4 * std::exp(-static_cast<double>(i) / 8);
+    }
+    size_t warmup = IterationConvergence::FindWarmup(stream);
+    CHECK(warmup >= 15 && warmup <= 60);
+
+    // Nothing to drop in a steady stream
+    std::vector<double> steady = MakeStream(generator, 400, 10.0, 0.05);
+    CHECK(IterationConvergence::FindWarmup(steady) <= 40);
+    CHECK(static_cast<size_t>(0) == IterationConvergence::FindWarmup({ 9.0, 1.0, 1.0 }));
+}
+
+static void TestConvergesWithWarmup()
+{
+    std::mt19937 generator(2);
+    std::vector<double> stream = MakeStream(generator, 5000, 10.0, 0.1);
+    stream[0] = 200; // first evaluation
+    for (size_t i = 1; i < 30; ++i)
+    {
+        stream[i] *= 3;
+    }
+    IterationConvergence::ConvergenceOptions options;
+    options.MaxIterations = 5000;
+    auto result = Run(options, stream);
+    CHECK(result.Reason == IterationConvergence::StopReason::Converged);
+    CHECK(result.WarmupIterations >= 25);
+    CHECK(result.Iterations == result.WarmupIterations + result.MeasuredIterations);
+    CHECK(result.HasBounds && result.RelativeError <= options.TargetRelativeError);
+    CHECK(result.Lower <= result.Estimate && result.Estimate <= result.Upper);
+    CHECK(result.Lower <= 10.0 && 10.0 <= result.Upper);
+    CHECK(result.Iterations < 1000);
+}
+
+static void TestNoisierStreamsRunLonger()
+{
+    IterationConvergence::ConvergenceOptions options;
+    options.MaxIterations = 100000;
+    std::mt19937 generator(3);
+    auto stable = Run(options, MakeStream(generator, 100000, 10.0, 0.02));
+    auto noisy = Run(options, MakeStream(generator, 100000, 10.0, 0.3));
+    CHECK(stable.Reason == IterationConvergence::StopReason::Converged);
+    CHECK(noisy.Reason == IterationConvergence::StopReason::Converged);
+    CHECK(stable.Iterations < 100);
+    CHECK(noisy.Iterations > 4 * stable.Iterations);
+
+    // The tail needs far more iterations than the median, and none converge before there are bounds for it
+    options.Statistic = IterationConvergence::LatencyStatistic::P99;
+    auto tail = Run(options, MakeStream(generator, 100000, 10.0, 0.3));
+    CHECK(tail.Reason == IterationConvergence::StopReason::Converged);
+    CHECK(tail.Iterations > noisy.Iterations);
+    CHECK(tail.MeasuredIterations >= 300);
+    double trueP99 = 10.0 * std::exp(0.3 * IterationConvergence::NormalQuantile(0.99));
+    CHECK(tail.Lower <= trueP99 && trueP99 <= tail.Upper);
+}
+
+static void TestLimits()
+{
+    IterationConvergence::ConvergenceOptions options;
+    options.TargetRelativeError = 0.001;
+    options.MaxIterations = 200;
+    std::mt19937 generator(4);
+    auto capped = Run(options, MakeStream(generator, 1000, 10.0, 0.5));
+    CHECK(capped.Reason == IterationConvergence::StopReason::MaxIterations);
+    CHECK(200u == capped.Iterations);
+    CHECK(capped.HasBounds && capped.RelativeError > options.TargetRelativeError);
+
+    // About 10 ms an iteration against a limit of 1 s
+    options.MaxIterations = 0;
+    options.MaxMilliseconds = 1000;
+    auto timed = Run(options, MakeStream(generator, 1000, 10.0, 0.05));
+    CHECK(timed.Reason == IterationConvergence::StopReason::MaxTime);
+    CHECK(timed.Iterations >= 95 && timed.Iterations <= 105);
+
+    options.TargetRelativeError = 0;
+    CHECK_THROWS(std::invalid_argument,
+                 [&options]() { IterationConvergence::ConvergenceMonitor monitor(options); });
+}
+
+static void TestConfidenceIntervalCoverage()
+{
+    // The 95% interval of the median of 200 lognormal latencies holds the true median in about 95% of runs
+    std::mt19937 generator(5);
+    int covered = 0;
+    const int runs = 400;
+    for (int run = 0; run < runs; ++run)
+    {
+        auto result =
+            IterationConvergence::EstimatePercentile(MakeStream(generator, 200, 10.0, 0.4), 50.0, 0.95);
+        CHECK(result.HasBounds);
+        covered += result.Lower <= 10.0 && 10.0 <= result.Upper ? 1 : 0;
+    }
+    CHECK(covered >= runs * 0.91 && covered <= runs * 0.99);
+    CHECK(!(IterationConvergence::EstimatePercentile({ 1.0, 2.0, 3.0 }, 99.0, 0.95).HasBounds));
+}
+
+int main()
+{
+    return UnitTests::RunTests({
+        { "TestNormalQuantile", TestNormalQuantile },
+        { "TestFindsWarmup", TestFindsWarmup },
+        { "TestConvergesWithWarmup", TestConvergesWithWarmup },
+        { "TestNoisierStreamsRunLonger", TestNoisierStreamsRunLonger },
+        { "TestLimits", TestLimits },
+        { "TestConfidenceIntervalCoverage", TestConfidenceIntervalCoverage },
+    });
+}
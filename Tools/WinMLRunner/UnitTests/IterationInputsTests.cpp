@@ -0,0 +1,120 @@
+// Tests of the input preparation of the bind and evaluate iterations (see src/IterationInputs.h), driven by a stub
+// session that counts how often it tensorizes its input and creates a binding.
+#include <cstdint>
+#include <vector>
+#include "IterationInputs.h"
+#include "TestCheck.h"
+
+namespace
+{
+    struct StubBinding
+    {
+        int Id;
+    };
+
+    struct StubSession
+    {
+        int TensorizeCount = 0;
+        int BindingCount = 0;
+        int FailAtTensorize = -1; // the tensorize call that fails, none if negative
+
+        // The features of an iteration: the iteration they were made for and the number of the tensorize call
+        bool Tensorize(std::vector<int>& features, uint32_t iteration)
+        {
+            if (TensorizeCount++ == FailAtTensorize)
+            {
+                return false;
+            }
+            features = { static_cast<int>(iteration), TensorizeCount };
+            return true;
+        }
+
+        StubBinding CreateBinding() { return StubBinding{ ++BindingCount }; }
+    };
+
+    typedef IterationInputs<std::vector<int>, StubBinding> StubInputs;
+
+    StubInputs MakeInputs(StubSession& session, bool steadyState)
+    {
+        return StubInputs(
+            steadyState,
+            [&session](std::vector<int>& features, uint32_t iteration) {
+                return session.Tensorize(features, iteration);
+            },
+            [&session]() { return session.CreateBinding(); });
+    }
+}
+
+// Every iteration tensorizes its input again and gets its own binding.
+static void TestPreparesEveryIteration()
+{
+    StubSession session;
+    StubInputs inputs = MakeInputs(session, false);
+    for (uint32_t iteration = 0; iteration < 5; ++iteration)
+    {
+        CHECK(inputs.BeginIteration(iteration));
+        CHECK(inputs.GetFeatures() == std::vector<int>{ static_cast<int>(iteration), static_cast<int>(iteration) + 1 });
+        CHECK(inputs.GetBinding().Id == static_cast<int>(iteration) + 1);
+    }
+    CHECK(session.TensorizeCount == 5);
+    CHECK(session.BindingCount == 5);
+    CHECK(inputs.GetPreparedCount() == 5);
+    CHECK(inputs.GetBindingCount() == 5);
+}
+
+// In steady state the features and the binding of the first iteration are reused by the others.
+static void TestSteadyStatePreparesOnce()
+{
+    StubSession session;
+    StubInputs inputs = MakeInputs(session, true);
+    StubBinding* firstBinding = nullptr;
+    for (uint32_t iteration = 0; iteration < 5; ++iteration)
+    {
+        CHECK(inputs.BeginIteration(iteration));
+        CHECK(inputs.GetFeatures() == std::vector<int>{ 0, 1 });
+        CHECK(inputs.GetBinding().Id == 1);
+        if (firstBinding == nullptr)
+        {
+            firstBinding = &inputs.GetBinding();
+        }
+        CHECK(&inputs.GetBinding() == firstBinding);
+    }
+    CHECK(session.TensorizeCount == 1);
+    CHECK(session.BindingCount == 1);
+    CHECK(inputs.GetPreparedCount() == 1);
+    CHECK(inputs.GetBindingCount() == 1);
+}
+
+// A failed tensorize is reported and no binding is created for it.
+static void TestFailedPreparation()
+{
+    for (bool steadyState : { false, true })
+    {
+        StubSession session;
+        session.FailAtTensorize = 0;
+        StubInputs inputs = MakeInputs(session, steadyState);
+        CHECK(!inputs.BeginIteration(0));
+        CHECK(session.BindingCount == 0);
+        CHECK(inputs.GetPreparedCount() == 0);
+        CHECK(inputs.GetBindingCount() == 0);
+    }
+
+    // Without steady state a later iteration can fail too
+    StubSession session;
+    session.FailAtTensorize = 2;
+    StubInputs inputs = MakeInputs(session, false);
+    CHECK(inputs.BeginIteration(0));
+    CHECK(inputs.BeginIteration(1));
+    CHECK(!inputs.BeginIteration(2));
+    CHECK(inputs.GetPreparedCount() == 2);
+    CHECK(session.BindingCount == 2);
+}
+
+int main()
+{
+    return UnitTests::RunTests({
+        { "TestPreparesEveryIteration", TestPreparesEveryIteration },
+        { "TestSteadyStatePreparesOnce", TestSteadyStatePreparesOnce },
+        { "TestFailedPreparation", TestFailedPreparation },
+    });
+}
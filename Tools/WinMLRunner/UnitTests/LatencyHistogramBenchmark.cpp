@@ -0,0 +1,65 @@
+// Microbenchmark of the latency histogram (see src/LatencyHistogram.h): the cost of Record per value and of
+// GetPercentile per query, in nanoseconds, on a soak run sized number of exponentially distributed latencies.
+#include <cstddef>
+#include <cstdint>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <vector>
+#include "LatencyHistogram.h"
+#include "Benchmark.h"
+
+int main(int argc, char** argv)
+{
+    Benchmarks::BenchmarkOptions options;
+    int exitCode;
+    if (!Benchmarks::ParseOptions(argc, argv, options, exitCode))
+    {
+        return exitCode;
+    }
+
+    // The values cycle through a table small enough to stay in cache, so the loop times Record and not the generator
+    const size_t numValues = Benchmarks::Scaled(10000000, options);
+    std::mt19937 generator(7);
+    std::exponential_distribution<double> distribution(0.2);
+    std::vector<double> values(4096);
+    for (double& value : values)
+    {
+        value = distribution(generator);
+    }
+
+    LatencyHistogram histogram;
+    double recordSeconds = Benchmarks::MeasureSeconds(options, [&]() {
+        histogram.Reset();
+        for (size_t i = 0; i < numValues; ++i)
+        {
+            histogram.Record(values[i & 4095]);
+        }
+    });
+    Benchmarks::KeepValue(static_cast<double>(histogram.GetCount()));
+
+    const size_t numQueries = Benchmarks::Scaled(100000, options);
+    const double percentiles[] = { 50.0, 90.0, 99.0, 99.9 };
+    std::cout << std::left << std::setw(24) << "operation" << std::setw(14) << "ns/op" << "result" << std::endl;
+    std::cout << std::left << std::fixed << std::setprecision(2) << std::setw(24) << "Record" << std::setw(14)
+              << recordSeconds * 1e9 / numValues << numValues << " values" << std::endl;
+    for (double percentile : percentiles)
+    {
+        double result = 0;
+        double querySeconds = Benchmarks::MeasureSeconds(options, [&]() {
+            double sum = 0;
+            for (size_t i = 0; i < numQueries; ++i)
+            {
+                sum += histogram.GetPercentile(percentile);
+            }
+            Benchmarks::KeepValue(sum);
+            result = sum / numQueries;
+        });
+        std::ostringstream name;
+        name << "GetPercentile(" << std::fixed << std::setprecision(1) << percentile << ")";
+        std::cout << std::left << std::fixed << std::setprecision(2) << std::setw(24) << name.str() << std::setw(14)
+                  << querySeconds * 1e9 / numQueries << std::setprecision(4) << result << std::endl;
+    }
+    return 0;
+}
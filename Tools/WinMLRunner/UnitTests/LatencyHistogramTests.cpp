@@ -0,0 +1,136 @@
+// Tests of the latency histogram of the performance counters (see src/LatencyHistogram.h).
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <random>
+#include <stdexcept>
+#include <vector>
+#include "LatencyHistogram.h"
+#include "TestCheck.h"
+
+static void TestExactStatistics()
+{
+    LatencyHistogram histogram;
+    std::vector<double> values = { 4.5, 1.25, 9.0, 3.0, 7.75 };
+    double total = 0;
+    for (double value : values)
+    {
+        histogram.Record(value);
+        total += value;
+    }
+    double mean = total / values.size();
+    double variance = 0;
+    for (double value : values)
+    {
+        variance += (value - mean) * (value - mean);
+    }
+    variance /= values.size();
+
+    CHECK(static_cast<uint64_t>(values.size()) == histogram.GetCount());
+    CHECK(1.25 == histogram.GetMin());
+    CHECK(9.0 == histogram.GetMax());
+    CHECK(UnitTests::Near(total, histogram.GetTotal(), 1e-9));
+    CHECK(UnitTests::Near(mean, histogram.GetMean(), 1e-9));
+    CHECK(UnitTests::Near(variance, histogram.GetVariance(), 1e-9));
+    CHECK(UnitTests::Near(1.25, histogram.GetPercentile(0), 1.25 * histogram.GetRelativePrecision()));
+    CHECK(UnitTests::Near(9.0, histogram.GetPercentile(100), 9.0 * histogram.GetRelativePrecision()));
+}
+
+static void TestPercentilesWithinPrecision()
+{
+    LatencyHistogram histogram;
+    std::mt19937 generator(42);
+    std::lognormal_distribution<double> distribution(1.0, 0.75);
+    std::vector<double> values(100000);
+    for (double& value : values)
+    {
+        value = distribution(generator);
+        histogram.Record(value);
+    }
+    std::sort(values.begin(), values.end());
+
+    for (double percentile : { 50.0, 90.0, 99.0, 99.9 })
+    {
+        size_t rank = static_cast<size_t>(std::ceil(percentile / 100.0 * values.size()));
+        double expected = values[rank - 1];
+        double actual = histogram.GetPercentile(percentile);
+        CHECK(std::abs(actual - expected) <= expected * histogram.GetRelativePrecision() + 0.001);
+    }
+}
+
+static void TestMoreThan1024Samples()
+{
+    LatencyHistogram histogram;
+    histogram.Record(0.5);
+    for (int i = 0; i < 200000; ++i)
+    {
+        histogram.Record(10.0);
+    }
+    histogram.Record(500.0);
+    CHECK(static_cast<uint64_t>(200002) == histogram.GetCount());
+    CHECK(0.5 == histogram.GetMin());
+    CHECK(500.0 == histogram.GetMax());
+    CHECK(UnitTests::Near(10.0, histogram.GetPercentile(50), 10.0 * histogram.GetRelativePrecision()));
+}
+
+static void TestMerge()
+{
+    LatencyHistogram first, second, combined;
+    for (int i = 1; i <= 1000; ++i)
+    {
+        double value = i * 0.37;
+        (i % 3 == 0 ? first : second).Record(value);
+        combined.Record(value);
+    }
+    first.Merge(second);
+    CHECK(combined.GetCount() == first.GetCount());
+    CHECK(combined.GetMin() == first.GetMin());
+    CHECK(combined.GetMax() == first.GetMax());
+    CHECK(UnitTests::Near(combined.GetMean(), first.GetMean(), 1e-9));
+    CHECK(UnitTests::Near(combined.GetVariance(), first.GetVariance(), 1e-6));
+    for (double percentile : { 50.0, 90.0, 99.0, 99.9 })
+    {
+        CHECK(combined.GetPercentile(percentile) == first.GetPercentile(percentile));
+    }
+    CHECK_THROWS(std::invalid_argument, [&first]() { first.Merge(LatencyHistogram(1000.0, 5)); });
+}
+
+static void TestNegativeValues()
+{
+    LatencyHistogram histogram;
+    histogram.Record(-2.0);
+    histogram.Record(2.0);
+    CHECK(-2.0 == histogram.GetMin());
+    CHECK(0.0 == histogram.GetMean());
+    CHECK(UnitTests::Near(4.0, histogram.GetVariance(), 1e-9));
+}
+
+// An empty histogram reads 0, and values above the largest trackable value keep their exact statistics but count
+// as the largest trackable value in percentiles.
+static void TestEmptyAndClampedValues()
+{
+    LatencyHistogram histogram(1000.0, 7, 20);
+    CHECK(histogram.GetCount() == 0);
+    CHECK(histogram.GetPercentile(50) == 0.0);
+    CHECK(histogram.GetMean() == 0.0);
+
+    histogram.Record(1.0);
+    histogram.Record(5000.0);
+    CHECK(histogram.GetMax() == 5000.0);
+    CHECK(UnitTests::Near(2500.5, histogram.GetMean(), 1e-9));
+    CHECK(UnitTests::Near(1.0, histogram.GetPercentile(50), histogram.GetRelativePrecision()));
+    double largest = ((1 << 20) - 1) / 1000.0;
+    CHECK(UnitTests::Near(largest, histogram.GetPercentile(100), largest * histogram.GetRelativePrecision()));
+}
+
+int main()
+{
+    return UnitTests::RunTests({
+        { "TestExactStatistics", TestExactStatistics },
+        { "TestPercentilesWithinPrecision", TestPercentilesWithinPrecision },
+        { "TestMoreThan1024Samples", TestMoreThan1024Samples },
+        { "TestMerge", TestMerge },
+        { "TestNegativeValues", TestNegativeValues },
+        { "TestEmptyAndClampedValues", TestEmptyAndClampedValues },
+    });
+}
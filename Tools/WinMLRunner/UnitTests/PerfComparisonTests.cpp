@@ -0,0 +1,237 @@
+// Tests of comparing two sets of WinMLRunner results (see src/PerfComparison.h): the statistical tests, the verdicts
+// and reading CSV files, per iteration summaries and reports.
+#include <cmath>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <numeric>
+#include <random>
+#include <set>
+#include <string>
+#include <vector>
+#include "PerfComparison.h"
+#include "PerfReport.h"
+#include "TestCheck.h"
+
+static void TestMannWhitneyU()
+{
+    // With ties; U, z and the p value of the normal approximation with tie and continuity corrections
+    std::vector<double> baseline = { 1.1, 2.2, 3.3, 4.4, 5, 5, 6, 7.5, 8, 9 };
+    std::vector<double> candidate = { 3, 4.4, 5, 6.5, 7, 8, 8, 9.5, 10, 11, 12 };
+    PerfComparison::MannWhitneyResult result = PerfComparison::MannWhitneyU(baseline, candidate);
+    CHECK(81.5 == result.U);
+    CHECK(UnitTests::Near(1.8362383484966645, result.Z, 1e-12));
+    CHECK(UnitTests::Near(0.06632241334279662, result.PValue, 1e-12));
+
+    // Symmetric, and nothing to tell apart when every value is the same
+    PerfComparison::MannWhitneyResult swapped = PerfComparison::MannWhitneyU(candidate, baseline);
+    CHECK(UnitTests::Near(-result.Z, swapped.Z, 1e-12));
+    CHECK(UnitTests::Near(result.PValue, swapped.PValue, 1e-12));
+    CHECK(1.0 == PerfComparison::MannWhitneyU({ 2, 2, 2 }, { 2, 2 }).PValue);
+
+    // Every candidate value above every baseline value
+    std::vector<double> low(20), high(20);
+    std::iota(low.begin(), low.end(), 0.0);
+    std::iota(high.begin(), high.end(), 100.0);
+    result = PerfComparison::MannWhitneyU(low, high);
+    CHECK(400.0 == result.U);
+    CHECK(result.Z > 5 && result.PValue < 1e-6);
+}
+
+static void TestBootstrapMedianDifference()
+{
+    std::mt19937 generator(7);
+    std::lognormal_distribution<double> distribution(std::log(10.0), 0.05);
+    std::vector<double> baseline(500), candidate(500);
+    for (double& value : baseline)
+    {
+        value = distribution(generator);
+    }
+    for (double& value : candidate)
+    {
+        value = distribution(generator) * 1.04;
+    }
+
+    // The interval of a 4% slowdown holds it and not 0, and the same seed gives the same interval
+    PerfComparison::ConfidenceInterval interval =
+        PerfComparison::BootstrapMedianDifference(baseline, candidate, 0.99, 2000, 1);
+    CHECK(interval.Lower > 0 && interval.Lower < 0.4 && interval.Upper > 0.4);
+    PerfComparison::ConfidenceInterval again =
+        PerfComparison::BootstrapMedianDifference(baseline, candidate, 0.99, 2000, 1);
+    CHECK(interval.Lower == again.Lower);
+    CHECK(interval.Upper == again.Upper);
+    PerfComparison::ConfidenceInterval wider =
+        PerfComparison::BootstrapMedianDifference(baseline, candidate, 0.999, 2000, 1);
+    CHECK(wider.Lower <= interval.Lower && wider.Upper >= interval.Upper);
+
+    // A resampled median is always one of the values, or the mean of two of them
+    std::vector<double> sorted = { 1, 2, 4, 8 };
+    PerfComparison::BootstrapRandom random(3);
+    std::set<double> medians;
+    for (int i = 0; i < 10000; ++i)
+    {
+        medians.insert(PerfComparison::ResampleMedian(sorted, random));
+    }
+    CHECK(medians == std::set<double>({ 1, 1.5, 2, 2.5, 3, 4, 4.5, 5, 6, 8 }));
+    CHECK(5.0 == PerfComparison::ResampleMedian({ 5 }, random));
+}
+
+static void TestVerdicts()
+{
+    std::mt19937 generator(11);
+    std::lognormal_distribution<double> distribution(std::log(4.0), 0.03);
+    auto measure = [&](double scale) {
+        std::vector<double> times(201);
+        for (double& time : times)
+        {
+            time = distribution(generator) * scale;
+        }
+        return PerfComparison::MeasureIterations(times);
+    };
+    PerfComparison::ComparisonOptions options;
+    PerfComparison::Measurement baseline = measure(1);
+    CHECK(static_cast<uint64_t>(200) == baseline.Count);
+
+    PerfComparison::MetricComparison regression =
+        PerfComparison::CompareMeasurements(baseline, measure(1.05), options);
+    CHECK(regression.Result == PerfComparison::Verdict::Regression);
+    CHECK(regression.TestMethod == PerfComparison::Method::MannWhitney);
+    CHECK(regression.Lower > 0 && regression.Lower < regression.RelativeChange &&
+          regression.RelativeChange < regression.Upper);
+    CHECK(PerfComparison::CompareMeasurements(baseline, measure(0.95), options).Result ==
+          PerfComparison::Verdict::Improvement);
+    CHECK(PerfComparison::CompareMeasurements(baseline, measure(1), options).Result ==
+          PerfComparison::Verdict::Unchanged);
+
+    // Significant but below the threshold
+    options.RegressionThreshold = 0.1;
+    CHECK(PerfComparison::CompareMeasurements(baseline, measure(1.05), options).Result ==
+          PerfComparison::Verdict::Unchanged);
+    options.RegressionThreshold = 0.03;
+
+    // Averages on one side only
+    PerfComparison::Measurement averages;
+    averages.Mean = 4.4;
+    averages.Stdev = 0.12;
+    averages.Count = 200;
+    PerfComparison::MetricComparison welch = PerfComparison::CompareMeasurements(baseline, averages, options);
+    CHECK(welch.TestMethod == PerfComparison::Method::Welch);
+    CHECK(welch.Result == PerfComparison::Verdict::Regression);
+    CHECK(averages.Mean == welch.Candidate);
+
+    averages.Count = 1;
+    CHECK(PerfComparison::CompareMeasurements(baseline, averages, options).Result ==
+          PerfComparison::Verdict::Inconclusive);
+}
+
+static void TestMergeMeasurements()
+{
+    PerfComparison::Measurement merged = PerfComparison::MeasureIterations({ 9, 1, 2, 3 });
+    PerfComparison::Merge(merged, PerfComparison::MeasureIterations({ 9, 4, 5 }));
+    PerfComparison::Measurement all = PerfComparison::MeasureIterations({ 9, 1, 2, 3, 4, 5 });
+    CHECK(merged.HasSamples);
+    CHECK(merged.Samples == all.Samples);
+    CHECK(UnitTests::Near(all.Mean, merged.Mean, 1e-12));
+    CHECK(UnitTests::Near(all.Stdev, merged.Stdev, 1e-12));
+
+    // Averages pool with iterations, which are then left out
+    PerfComparison::Measurement averages;
+    averages.Mean = 3;
+    averages.Stdev = 1.5811388300841898;
+    averages.Count = 5;
+    PerfComparison::Merge(merged, averages);
+    CHECK(!merged.HasSamples);
+    CHECK(merged.Samples.empty());
+    CHECK(static_cast<uint64_t>(10) == merged.Count);
+    CHECK(UnitTests::Near(3.0, merged.Mean, 1e-12));
+    CHECK(UnitTests::Near(1.4907119849998598, merged.Stdev, 1e-12));
+}
+
+static void TestReadAndCompareResults()
+{
+    std::filesystem::path folder = std::filesystem::temp_directory_path() / L"PerfComparisonTest";
+    std::filesystem::remove_all(folder);
+    std::filesystem::create_directories(folder / L"baseline" / L"PerIterationRun[2026-01-01_10.00.00]");
+    std::filesystem::create_directories(folder / L"candidate");
+
+    // The baseline as a -PerfOutput CSV file of an older version, with the input binding and input type
+    // columns swapped, and the Summary.csv of the same run
+    const int iterations = 30;
+    auto time = [](int iteration, double scale) { return scale * (10 + (iteration * 7) % 11 * 0.05); };
+    std::ofstream csv(folder / L"baseline" / L"WinMLRunner[2026-01-01_10.00.00].csv");
+    csv << "model name,device type,input binding,input type,device creation location,iterations,"
+           "load iterations,session creation iterations,average load (ms),standard deviation load (ms),"
+           "average evaluate (ms),standard deviation evaluate (ms),\n";
+    csv << "C:\\build\\models\\a\\model.onnx,CPU,Tensor,CPU,WinML," << iterations << ",1,1,50,0,10.2,0.1,\n";
+    csv << "C:\\build\\models\\b\\model.onnx,CPU,Tensor,CPU,WinML," << iterations << ",1,1,60,0,10.2,0.1,\n";
+    csv.close();
+    std::ofstream summary(folder / L"baseline" / L"PerIterationRun[2026-01-01_10.00.00]" / L"Summary.csv");
+    summary << "Model Name,Input Name,Iterations,Iteration Number ,Load (ms),Bind (ms),Evaluate (ms),\n";
+    for (int model = 0; model < 2; ++model)
+    {
+        for (int i = 1; i <= iterations; ++i)
+        {
+            summary << "model,," << iterations << "," << i << ",0,0.5," << time(i, 1) << ",\n";
+        }
+    }
+    summary.close();
+
+    // The candidate as a report, from another folder, where model b is 10% slower and model c is new
+    std::ofstream report(folder / L"candidate" / L"results.jsonl");
+    report << "{\"type\":\"run\",\"configurations\":3}\n";
+    for (const char* model : { "a", "b", "c" })
+    {
+        PerfReport::JsonWriter json;
+        json.BeginObject().Key("type").String("configuration");
+        json.Key("model").String(std::string("D:\\agent\\models\\") + model + "\\model.onnx");
+        json.Key("deviceType").String("CPU").Key("deviceCreationLocation").String("WinML");
+        json.Key("inputBinding").String("CPU").Key("inputType").String("Tensor");
+        json.Key("iterations").Number(iterations);
+        json.Key("perIteration").BeginObject().Key("evaluate").BeginArray();
+        for (int i = 1; i <= iterations; ++i)
+        {
+            json.Number(time(i, model[0] == 'b' ? 1.1 : 1));
+        }
+        json.EndArray().EndObject().EndObject();
+        report << json.GetString() << "\n";
+    }
+    report.close();
+
+    PerfComparison::ResultSet baseline;
+    baseline.AddPath(folder / L"baseline");
+    PerfComparison::ResultSet candidate;
+    candidate.AddPath(folder / L"candidate");
+    std::filesystem::remove_all(folder);
+    CHECK(baseline.GetWarnings().empty());
+    CHECK(static_cast<size_t>(2) == baseline.GetResults().size());
+    const PerfComparison::RunResult& a = baseline.GetResults().begin()->second;
+    CHECK(std::string("CPU") == a.Key.InputBinding);
+    CHECK(std::string("Tensor") == a.Key.InputType);
+    CHECK(a.Metrics.at("evaluate").HasSamples);
+    CHECK(static_cast<size_t>(iterations - 1) == a.Metrics.at("evaluate").Samples.size());
+    CHECK(50.0 == a.Metrics.at("load").Mean);
+
+    PerfComparison::Comparison comparison = PerfComparison::Compare(baseline, candidate, {}, {});
+    CHECK(static_cast<size_t>(2) == comparison.Metrics.size());
+    CHECK(std::string("a/model.onnx") == comparison.Metrics[0].Key.Model);
+    CHECK(comparison.Metrics[0].Result == PerfComparison::Verdict::Unchanged);
+    CHECK(0.0 == comparison.Metrics[0].RelativeChange);
+    CHECK(std::string("b/model.onnx") == comparison.Metrics[1].Key.Model);
+    CHECK(std::string("evaluate") == comparison.Metrics[1].Metric);
+    CHECK(comparison.Metrics[1].Result == PerfComparison::Verdict::Regression);
+    CHECK(UnitTests::Near(0.1, comparison.Metrics[1].RelativeChange, 1e-9));
+    CHECK(comparison.OnlyInBaseline.empty());
+    CHECK(static_cast<size_t>(1) == comparison.OnlyInCandidate.size());
+    CHECK(std::string("c/model.onnx") == comparison.OnlyInCandidate[0].Model);
+}
+
+int main()
+{
+    return UnitTests::RunTests({
+        { "TestMannWhitneyU", TestMannWhitneyU },
+        { "TestBootstrapMedianDifference", TestBootstrapMedianDifference },
+        { "TestVerdicts", TestVerdicts },
+        { "TestMergeMeasurements", TestMergeMeasurements },
+        { "TestReadAndCompareResults", TestReadAndCompareResults },
+    });
+}
@@ -0,0 +1,161 @@
+// Tests of the JSON Lines performance report (see src/PerfReport.h): the JSON writer, the latency histogram records
+// and appending the records of a run to a report file, and reading the records back.
+#include <algorithm>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <limits>
+#include <random>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <tuple>
+#include <vector>
+#include "LatencyHistogram.h"
+#include "PerfReport.h"
+#include "TestCheck.h"
+
+static void TestJsonWriter()
+{
+    PerfReport::JsonWriter json;
+    json.BeginObject();
+    json.Key("name").String("quote \" backslash \\ tab \t line\n bell \x07 unicode \xC3\xA9");
+    json.Key("integers").BeginArray().Number(0).Number(-42).Number(UINT64_MAX).EndArray();
+    json.Key("doubles").BeginArray().Number(0.1).Number(-2.5).Number(1e300).Number(1.0 / 3.0).EndArray();
+    json.Key("notFinite").BeginArray();
+    json.Number(std::numeric_limits<double>::infinity()).Number(std::numeric_limits<float>::quiet_NaN());
+    json.EndArray();
+    json.Key("empty").BeginObject().EndObject();
+    json.Key("nested").BeginArray().BeginArray().EndArray().BeginObject().Key("a").Bool(true).EndObject();
+    json.Null().EndArray();
+    json.EndObject();
+    CHECK(std::string("{\"name\":\"quote \\\" backslash \\\\ tab \\t line\\n bell \\u0007 unicode "
+                      "\xC3\xA9\",\"integers\":[0,-42,18446744073709551615],"
+                      "\"doubles\":[0.1,-2.5,1e+300,0.3333333333333333],\"notFinite\":[null,null],"
+                      "\"empty\":{},\"nested\":[[],{\"a\":true},null]}") == json.GetString());
+    CHECK_THROWS(std::logic_error, [&json]() { json.EndObject(); });
+}
+
+static void TestHistogramBuckets()
+{
+    LatencyHistogram histogram;
+    std::mt19937 generator(1234);
+    std::lognormal_distribution<double> distribution(1.0, 1.0);
+    std::vector<double> values(10000);
+    for (double& value : values)
+    {
+        value = distribution(generator);
+        histogram.Record(value);
+    }
+
+    // The buckets are ordered, do not overlap and hold every recorded value
+    std::vector<std::tuple<double, double, uint64_t>> buckets;
+    histogram.ForEachBucket([&buckets](double lowest, double highest, uint64_t count) {
+        buckets.emplace_back(lowest, highest, count);
+    });
+    uint64_t total = 0;
+    for (size_t i = 0; i < buckets.size(); ++i)
+    {
+        CHECK(std::get<0>(buckets[i]) <= std::get<1>(buckets[i]));
+        CHECK(i == 0 || std::get<1>(buckets[i - 1]) < std::get<0>(buckets[i]));
+        total += std::get<2>(buckets[i]);
+    }
+    CHECK(histogram.GetCount() == total);
+    for (double value : values)
+    {
+        // Values are quantized to the microsecond before they are bucketed
+        auto bucket = std::find_if(buckets.begin(), buckets.end(), [value](const auto& candidate) {
+            return value < std::get<1>(candidate) + 0.0005;
+        });
+        CHECK(bucket != buckets.end() && value >= std::get<0>(*bucket) - 0.0005);
+    }
+
+    PerfReport::JsonWriter json;
+    PerfReport::WriteHistogram(json, histogram);
+    const std::string& text = json.GetString();
+    CHECK(text.rfind("{\"count\":10000,\"total\":", 0) == 0);
+    CHECK(text.find("\"percentiles\":{\"p50\":") != std::string::npos);
+    CHECK(text.find("\"p99.9\":") != std::string::npos);
+    CHECK(buckets.size() + 1 == static_cast<size_t>(std::count(text.begin(), text.end(), '[')));
+}
+
+static void TestSinkAppendsJsonLines()
+{
+    PerfReport::PerfReportSink sink;
+    for (int i = 0; i < 3; ++i)
+    {
+        PerfReport::JsonWriter record;
+        record.BeginObject().Key("type").String("configuration").Key("index").Number(i);
+        record.Key("metadata");
+        PerfReport::WriteMetadata(record, { { "build", "1.2.3" }, { "machine", "lab \"7\"" } });
+        record.EndObject();
+        sink.AddRecord(record);
+    }
+    PerfReport::JsonWriter run;
+    run.BeginObject().Key("type").String("run").Key("configurations").Number(sink.GetRecordCount());
+    run.EndObject();
+    sink.SetRunRecord(run);
+
+    std::ostringstream output;
+    sink.Write(output);
+    CHECK(std::string("{\"type\":\"run\",\"configurations\":3}\n"
+                      "{\"type\":\"configuration\",\"index\":0,"
+                      "\"metadata\":{\"build\":\"1.2.3\",\"machine\":\"lab \\\"7\\\"\"}}\n") ==
+          output.str().substr(0, output.str().find('\n', output.str().find('\n') + 1) + 1));
+
+    // A second run appends to the report of the first one
+    std::filesystem::path path = std::filesystem::temp_directory_path() / L"WinMLRunnerPerfReportTest.jsonl";
+    std::filesystem::remove(path);
+    sink.WriteToFile(path.wstring());
+    sink.WriteToFile(path.wstring());
+    std::ifstream input(path, std::ios_base::binary);
+    std::string contents((std::istreambuf_iterator<char>(input)), std::istreambuf_iterator<char>());
+    input.close();
+    CHECK(output.str() + output.str() == contents);
+    std::filesystem::remove(path);
+}
+
+static void TestJsonValueReadsWriterOutput()
+{
+    PerfReport::JsonWriter json;
+    json.BeginObject();
+    json.Key("name").String("quote \" backslash \\ tab \t bell \x07 unicode \xC3\xA9");
+    json.Key("values").BeginArray().Number(-42).Number(0.1).Number(1e300).Bool(true).Null().EndArray();
+    json.Key("nested").BeginObject().Key("empty").BeginArray().EndArray().EndObject();
+    json.EndObject();
+
+    PerfReport::JsonValue value = PerfReport::JsonValue::Parse(json.GetString());
+    CHECK(value.IsObject());
+    CHECK(std::string("quote \" backslash \\ tab \t bell \x07 unicode \xC3\xA9") == value["name"].GetString());
+    const auto& values = value["values"].GetElements();
+    CHECK(static_cast<size_t>(5) == values.size());
+    CHECK(-42.0 == values[0].GetNumber());
+    CHECK(0.1 == values[1].GetNumber());
+    CHECK(1e300 == values[2].GetNumber());
+    CHECK(values[3].GetBool());
+    CHECK(values[4].IsNull());
+    CHECK(value["nested"]["empty"].IsArray());
+    // Missing members, and members of values that are not objects, are null
+    CHECK(value["missing"]["deeper"].IsNull());
+    CHECK(value["name"]["length"].IsNull());
+
+    CHECK(std::string("\xF0\x9F\x98\x80 \xC3\xA9") ==
+          PerfReport::JsonValue::Parse(" \"\\ud83d\\ude00 \\u00e9\" ").GetString());
+    for (const char* invalid : { "", "{", "[1,]", "{\"a\" 1}", "\"open", "tru", "1 2", "{\"a\":1}}" })
+    {
+        CHECK_THROWS(std::runtime_error, [invalid]() { PerfReport::JsonValue::Parse(invalid); });
+    }
+    CHECK_THROWS(std::runtime_error,
+                 []() { PerfReport::JsonValue::Parse(std::string(1000, '[') + std::string(1000, ']')); });
+}
+
+int main()
+{
+    return UnitTests::RunTests({
+        { "TestJsonWriter", TestJsonWriter },
+        { "TestHistogramBuckets", TestHistogramBuckets },
+        { "TestSinkAppendsJsonLines", TestSinkAppendsJsonLines },
+        { "TestJsonValueReadsWriterOutput", TestJsonValueReadsWriterOutput },
+    });
+}
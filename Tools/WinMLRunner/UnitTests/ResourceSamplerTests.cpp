@@ -0,0 +1,142 @@
+// Tests of the resource sampler (see src/ResourceSampler.h): interpolating and correlating samples with timed spans,
+// the counters of this process and the sampler thread.
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <thread>
+#include <vector>
+#include "ResourceSampler.h"
+#include "TestCheck.h"
+
+static ResourceSampling::ResourceSample MakeSample(double time, double cpuTime, double workingSet)
+{
+    ResourceSampling::ResourceSample sample;
+    sample.Time = time;
+    sample.CpuTime = cpuTime;
+    sample.WorkingSet = workingSet;
+    return sample;
+}
+
+static void TestInterpolate()
+{
+    std::vector<ResourceSampling::ResourceSample> samples = { MakeSample(10, 100, 50), MakeSample(20, 120, 70) };
+    ResourceSampling::ResourceSample middle = ResourceSampling::Interpolate(samples, 12.5);
+    CHECK(UnitTests::Near(105.0, middle.CpuTime, 1e-9));
+    CHECK(UnitTests::Near(55.0, middle.WorkingSet, 1e-9));
+    // Outside of the samples the first or last one holds
+    CHECK(100.0 == ResourceSampling::Interpolate(samples, 0).CpuTime);
+    CHECK(120.0 == ResourceSampling::Interpolate(samples, 30).CpuTime);
+    CHECK(0.0 == ResourceSampling::Interpolate({}, 5).CpuTime);
+}
+
+static void TestCorrelate()
+{
+    std::vector<ResourceSampling::ResourceSample> samples = { MakeSample(0, 0, 10), MakeSample(10, 10, 20),
+                                                              MakeSample(20, 30, 20) };
+    samples[1].GpuUsage = 20;
+    samples[2].GpuUsage = 80;
+    samples[2].PageFaults = 100;
+
+    // A span shorter than the interval gets its share of the change over it
+    ResourceSampling::SpanCounters counters = ResourceSampling::Correlate(samples, { 12, 14 });
+    CHECK(UnitTests::Near(4.0, counters.CpuTime, 1e-9));
+    CHECK(UnitTests::Near(20.0, counters.PageFaults, 1e-9));
+    CHECK(UnitTests::Near(0.0, counters.WorkingSet, 1e-9));
+    CHECK(UnitTests::Near(80.0, counters.GpuUsage, 1e-9));
+    CHECK(counters.Covered);
+
+    // GPU usage is weighted by the overlap with each sample's interval
+    counters = ResourceSampling::Correlate(samples, { 5, 20 });
+    CHECK(UnitTests::Near(25.0, counters.CpuTime, 1e-9));
+    CHECK(UnitTests::Near(5.0, counters.WorkingSet, 1e-9));
+    CHECK(UnitTests::Near(15.0, counters.StartWorkingSet, 1e-9));
+    CHECK(UnitTests::Near((20.0 * 5 + 80.0 * 10) / 15, counters.GpuUsage, 1e-9));
+
+    CHECK(!(ResourceSampling::Correlate(samples, { 15, 25 }).Covered));
+}
+
+static void TestReadProcessCounters()
+{
+    ResourceSampling::ResourceSample before;
+    CHECK(ResourceSampling::ReadProcessCounters(before));
+    CHECK(before.WorkingSet > 0 && before.PeakWorkingSet > 0 && before.PageFileUsage > 0);
+
+    // Touching 64 MB faults in pages and raises the working set; spinning uses CPU time
+    std::vector<char> memory(64 << 20);
+    for (size_t i = 0; i < memory.size(); i += 4096)
+    {
+        memory[i] = 1;
+    }
+    volatile double sink = 0;
+    double start = ResourceSampling::NowMilliseconds();
+    while (ResourceSampling::NowMilliseconds() - start < 50)
+    {
+        sink = sink + 1;
+    }
+    ResourceSampling::ResourceSample after;
+    CHECK(ResourceSampling::ReadProcessCounters(after));
+    CHECK(after.CpuTime > before.CpuTime);
+    CHECK(after.PageFaults > before.PageFaults);
+    CHECK(after.WorkingSet > before.WorkingSet + 32);
+    CHECK(after.PeakWorkingSet >= after.WorkingSet - 1);
+    CHECK(memory[4096] == 1);
+}
+
+static void TestSamplerThread()
+{
+    std::atomic<int> calls(0);
+    ResourceSampling::SamplerOptions options;
+    options.IntervalMilliseconds = 2;
+    ResourceSampling::ResourceSampler sampler(options, { ResourceSampling::ReadProcessCounters,
+                                                         [&calls](ResourceSampling::ResourceSample& sample) {
+                                                             sample.GpuUsage = ++calls;
+                                                             return true;
+                                                         } });
+    sampler.Start();
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    sampler.Stop();
+    std::vector<ResourceSampling::ResourceSample> samples = sampler.GetSamples();
+    CHECK(samples.size() >= 5);
+    CHECK(static_cast<size_t>(calls.load()) == samples.size());
+    for (size_t i = 1; i < samples.size(); ++i)
+    {
+        CHECK(samples[i].Time >= samples[i - 1].Time);
+        CHECK(samples[i].CpuTime >= samples[i - 1].CpuTime);
+    }
+
+    // Sampling again after a stop adds to the samples
+    sampler.SampleNow();
+    CHECK(samples.size() + 1 == sampler.GetSamples().size());
+    sampler.DiscardBefore(sampler.GetSamples().back().Time);
+    CHECK(static_cast<size_t>(2) == sampler.GetSamples().size());
+}
+
+static void TestSamplerDecimates()
+{
+    ResourceSampling::SamplerOptions options;
+    options.IntervalMilliseconds = 1;
+    options.MaxSamples = 16;
+    ResourceSampling::ResourceSampler sampler(options, {});
+    for (int i = 0; i < 100; ++i)
+    {
+        sampler.SampleNow();
+    }
+    std::vector<ResourceSampling::ResourceSample> samples = sampler.GetSamples();
+    CHECK(samples.size() < 16);
+    CHECK(sampler.GetIntervalMilliseconds() > 1);
+    for (size_t i = 1; i < samples.size(); ++i)
+    {
+        CHECK(samples[i].Time >= samples[i - 1].Time);
+    }
+}
+
+int main()
+{
+    return UnitTests::RunTests({
+        { "TestInterpolate", TestInterpolate },
+        { "TestCorrelate", TestCorrelate },
+        { "TestReadProcessCounters", TestReadProcessCounters },
+        { "TestSamplerThread", TestSamplerThread },
+        { "TestSamplerDecimates", TestSamplerDecimates },
+    });
+}
@@ -0,0 +1,209 @@
+// Tests of the scheduler of sweep jobs (see src/SweepScheduler.h): group limits, retries, timeouts and merging the
+// reports of the jobs.
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <map>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+#include "SweepScheduler.h"
+#include "TestCheck.h"
+
+// Jobs whose model path is their index, the first gpuJobs of them in the GPU group.
+static std::vector<SweepScheduler::SweepJob> MakeJobs(size_t count, size_t gpuJobs)
+{
+    std::vector<SweepScheduler::SweepJob> jobs(count);
+    for (size_t i = 0; i < count; ++i)
+    {
+        jobs[i].ModelPath = std::to_wstring(i);
+        jobs[i].Device = i < gpuJobs ? "GPU" : "CPU";
+        jobs[i].InputDataType = "Tensor";
+        jobs[i].InputBindingType = "CPU";
+        jobs[i].Group = jobs[i].Device;
+    }
+    return jobs;
+}
+
+static size_t GetIndex(const SweepScheduler::SweepJob& job) { return std::stoul(job.ModelPath); }
+
+static void TestRunsEveryJobOnce()
+{
+    std::vector<SweepScheduler::SweepJob> jobs = MakeJobs(40, 0);
+    std::vector<std::atomic<int>> runs(jobs.size());
+    SweepScheduler::SweepOptions options;
+    options.Workers = 4;
+    auto results = SweepScheduler::RunSweep(jobs, options, [&](const SweepScheduler::SweepJob& job,
+                                                               const SweepScheduler::JobContext&) {
+        runs[GetIndex(job)]++;
+        return SweepScheduler::JobOutcome();
+    });
+    CHECK(jobs.size() == results.size());
+    for (size_t i = 0; i < jobs.size(); ++i)
+    {
+        CHECK(1 == runs[i].load());
+        CHECK(1u == results[i].Attempts);
+        CHECK(results[i].Outcome.Status == SweepScheduler::JobStatus::Succeeded);
+    }
+    CHECK(static_cast<size_t>(0) == SweepScheduler::RunSweep({}, options, nullptr).size());
+}
+
+static void TestGroupLimits()
+{
+    // CPU jobs run side by side, GPU jobs one at a time
+    std::vector<SweepScheduler::SweepJob> jobs = MakeJobs(24, 12);
+    std::mutex mutex;
+    std::map<std::string, int> running;
+    std::map<std::string, int> mostRunning;
+    SweepScheduler::SweepOptions options;
+    options.Workers = 4;
+    options.GroupLimits["GPU"] = 1;
+    SweepScheduler::RunSweep(jobs, options, [&](const SweepScheduler::SweepJob& job,
+                                                const SweepScheduler::JobContext&) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            mostRunning[job.Group] = (std::max)(mostRunning[job.Group], ++running[job.Group]);
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        std::lock_guard<std::mutex> lock(mutex);
+        running[job.Group]--;
+        return SweepScheduler::JobOutcome();
+    });
+    CHECK(1 == mostRunning["GPU"]);
+    CHECK(mostRunning["CPU"] >= 2);
+    CHECK(mostRunning["CPU"] <= 4);
+}
+
+static void TestRetries()
+{
+    // Even jobs crash on their first attempt, jobs 1 and 3 always fail without being retryable
+    std::vector<SweepScheduler::SweepJob> jobs = MakeJobs(8, 0);
+    std::vector<SweepScheduler::SweepProgress> reports;
+    SweepScheduler::SweepOptions options;
+    options.Workers = 3;
+    options.MaxAttempts = 3;
+    options.Progress = [&reports](const SweepScheduler::SweepProgress& progress) {
+        reports.push_back(progress);
+    };
+    auto results = SweepScheduler::RunSweep(jobs, options, [](const SweepScheduler::SweepJob& job,
+                                                              const SweepScheduler::JobContext& context) {
+        SweepScheduler::JobOutcome outcome;
+        size_t index = GetIndex(job);
+        if (index % 2 == 0 && context.Attempt == 1)
+        {
+            outcome.Status = SweepScheduler::JobStatus::Failed;
+            outcome.ExitCode = static_cast<int>(0xC0000005);
+            outcome.Retryable = true;
+        }
+        else if (index == 1 || index == 3)
+        {
+            outcome.Status = SweepScheduler::JobStatus::Failed;
+            outcome.ExitCode = 1;
+        }
+        else if (index == 5)
+        {
+            throw std::runtime_error("runner failed");
+        }
+        return outcome;
+    });
+    for (size_t i = 0; i < jobs.size(); ++i)
+    {
+        bool fails = i == 1 || i == 3 || i == 5;
+        CHECK((i % 2 == 0 ? 2u : 1u) == results[i].Attempts);
+        CHECK(results[i].Outcome.Status ==
+              (fails ? SweepScheduler::JobStatus::Failed : SweepScheduler::JobStatus::Succeeded));
+    }
+    CHECK(std::string("runner failed") == results[5].Outcome.Message);
+
+    // One report per attempt, the job counted as finished once it will not run again
+    CHECK(static_cast<size_t>(12) == reports.size());
+    CHECK(4 == std::count_if(reports.begin(), reports.end(),
+                             [](const SweepScheduler::SweepProgress& p) { return p.WillRetry; }));
+    for (size_t i = 1; i < reports.size(); ++i)
+    {
+        CHECK(reports[i].Finished >= reports[i - 1].Finished);
+    }
+    CHECK(jobs.size() == reports.back().Finished);
+    CHECK(static_cast<size_t>(3) == reports.back().Failed);
+    CHECK(static_cast<size_t>(0) == reports.back().Running);
+}
+
+static void TestTimeouts()
+{
+    // Job 0 hangs until it is cancelled, job 1 ignores the cancellation and returns late, the others are quick
+    std::vector<SweepScheduler::SweepJob> jobs = MakeJobs(6, 0);
+    SweepScheduler::SweepOptions options;
+    options.Workers = 2;
+    options.MaxAttempts = 2;
+    options.Timeout = std::chrono::milliseconds(50);
+    auto start = std::chrono::steady_clock::now();
+    auto results = SweepScheduler::RunSweep(jobs, options, [](const SweepScheduler::SweepJob& job,
+                                                              const SweepScheduler::JobContext& context) {
+        size_t index = GetIndex(job);
+        while (index == 0 && !context.IsCancelled())
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        if (index == 1)
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(80));
+        }
+        return SweepScheduler::JobOutcome();
+    });
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    for (size_t i = 0; i < jobs.size(); ++i)
+    {
+        bool timesOut = i == 0 || i == 1;
+        CHECK(results[i].Outcome.Status ==
+              (timesOut ? SweepScheduler::JobStatus::TimedOut : SweepScheduler::JobStatus::Succeeded));
+        CHECK((timesOut ? 2u : 1u) == results[i].Attempts);
+    }
+    CHECK(results[0].DurationMilliseconds >= 100);
+    CHECK(seconds < 5);
+}
+
+static void TestMergeReports()
+{
+    std::filesystem::path directory = std::filesystem::temp_directory_path() / L"WinMLRunnerSweepTest";
+    std::filesystem::remove_all(directory);
+    std::filesystem::create_directories(directory);
+    std::ofstream(directory / L"job0.csv") << "model,time\na.onnx,1\n";
+    std::ofstream(directory / L"job2.csv") << "model,time\r\nc.onnx,3\r\n";
+    std::vector<std::wstring> inputs = { (directory / L"job0.csv").wstring(),
+                                         (directory / L"job1.csv").wstring(),
+                                         (directory / L"job2.csv").wstring() };
+
+    // The header is written once, and not again when the output already has one
+    std::filesystem::path merged = directory / L"merged.csv";
+    CHECK(static_cast<size_t>(2) == SweepScheduler::MergeCsvFiles(inputs, merged.wstring()));
+    CHECK(static_cast<size_t>(2) == SweepScheduler::MergeCsvFiles(inputs, merged.wstring()));
+    std::ifstream mergedFile(merged, std::ios::binary);
+    std::string text((std::istreambuf_iterator<char>(mergedFile)), std::istreambuf_iterator<char>());
+    CHECK(std::string("model,time\na.onnx,1\nc.onnx,3\r\na.onnx,1\nc.onnx,3\r\n") == text);
+
+    std::ofstream(directory / L"job0.jsonl")
+        << "{\"type\":\"run\",\"configurations\":2}\n{\"type\":\"configuration\",\"a\":1}\r\n\n"
+           "{\"type\":\"configuration\",\"a\":2}\n";
+    auto records = SweepScheduler::ReadReportRecords((directory / L"job0.jsonl").wstring());
+    CHECK(static_cast<size_t>(2) == records.size());
+    CHECK(std::string("{\"type\":\"configuration\",\"a\":1}") == records[0]);
+    CHECK(std::string("{\"type\":\"configuration\",\"a\":2}") == records[1]);
+    CHECK(SweepScheduler::ReadReportRecords((directory / L"job1.jsonl").wstring()).empty());
+    std::filesystem::remove_all(directory);
+}
+
+int main()
+{
+    return UnitTests::RunTests({
+        { "TestRunsEveryJobOnce", TestRunsEveryJobOnce },
+        { "TestGroupLimits", TestGroupLimits },
+        { "TestRetries", TestRetries },
+        { "TestTimeouts", TestTimeouts },
+        { "TestMergeReports", TestMergeReports },
+    });
+}
@@ -0,0 +1,248 @@
+// Tests of the cache of decoded input tensors (see src/TensorCache.h): cache keys, least recently used eviction,
+// the spill directory and concurrent use.
+#include <atomic>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+#include "TensorCache.h"
+#include "TensorFile.h"
+#include "TensorTrace.h"
+#include "TestCheck.h"
+
+static TensorCache::CacheKey MakeKey(const std::string& fileName, uint32_t index)
+{
+    TensorCache::CacheKey key;
+    key.Kind = "tensor";
+    key.Path = std::filesystem::path(fileName).wstring();
+    key.ModifiedTime = 1000 + index;
+    key.FileSize = 4096;
+    key.Shape = { 1, 3, 224, 224 };
+    key.DataType = 1;
+    key.Scale = 1.0f;
+    key.Means = { 0.485f, 0.456f, 0.406f };
+    key.StdDevs = { 0.229f, 0.224f, 0.225f };
+    return key;
+}
+
+// Tensors of index hold bytes counting up from index, so each key has its own values.
+static std::shared_ptr<const TensorCache::CachedTensor> Insert(TensorCache::TensorCache& cache,
+                                                              const TensorCache::CacheKey& key, size_t size)
+{
+    uint32_t index = static_cast<uint32_t>(key.ModifiedTime - 1000);
+    std::vector<uint8_t> values(size);
+    for (size_t i = 0; i < size; ++i)
+    {
+        values[i] = static_cast<uint8_t>(index + i);
+    }
+    return cache.Insert(key, TensorFile::ElementType::UInt8, { static_cast<int64_t>(size) }, index,
+                        values.data(), values.size());
+}
+
+static bool HasValues(const TensorCache::CachedTensor& tensor, uint32_t index, size_t size)
+{
+    if (tensor.SizeInBytes != size)
+    {
+        return false;
+    }
+    for (size_t i = 0; i < size; ++i)
+    {
+        if (tensor.Data[i] != static_cast<uint8_t>(index + i))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+static void TestCacheKey()
+{
+    TensorCache::CacheKey key = MakeKey("image.png", 0);
+    CHECK(key.ToString() == MakeKey("image.png", 0).ToString());
+
+    // Every field that decides the values changes the key
+    std::vector<TensorCache::CacheKey> keys(11, key);
+    keys[0].Kind = "bitmap";
+    keys[1].Path = L"other.png";
+    keys[2].ModifiedTime++;
+    keys[3].FileSize++;
+    keys[4].Shape[3] = 225;
+    keys[5].DataType = 10;
+    keys[6].PixelFormat = 1;
+    keys[7].Interpolation = 2;
+    keys[8].Scale = 1.0f / 255;
+    keys[9].Means[1] = 0.5f;
+    keys[10].StdDevs = {};
+    for (size_t i = 0; i < keys.size(); ++i)
+    {
+        CHECK(key.ToString() != keys[i].ToString());
+        CHECK(TensorCache::HashKey(key.ToString()) != TensorCache::HashKey(keys[i].ToString()));
+    }
+
+    // The file is stamped with its size and time, or cannot be cached when missing
+    std::filesystem::path path = std::filesystem::temp_directory_path() / L"WinMLRunnerTensorCacheTest.bin";
+    std::ofstream(path, std::ios::binary) << "12345";
+    key.Path = path.wstring();
+    CHECK(TensorCache::StampFile(key));
+    CHECK(static_cast<uint64_t>(5) == key.FileSize);
+    std::filesystem::remove(path);
+    CHECK(!(TensorCache::StampFile(key)));
+}
+
+static void TestLeastRecentlyUsedEviction()
+{
+    TensorCache::TensorCache cache(3 * 1000);
+    for (int i = 0; i < 3; ++i)
+    {
+        Insert(cache, MakeKey("image.png", i), 1000);
+    }
+    CHECK(cache.Find(MakeKey("image.png", 0)) != nullptr);
+
+    // The entry used longest ago goes first
+    Insert(cache, MakeKey("image.png", 3), 1000);
+    CHECK(cache.Find(MakeKey("image.png", 1)) == nullptr);
+    for (int i : { 0, 2, 3 })
+    {
+        auto tensor = cache.Find(MakeKey("image.png", i));
+        CHECK(tensor != nullptr);
+        CHECK(HasValues(*tensor, i, 1000));
+    }
+
+    // A bigger entry pushes out as many as it needs to
+    Insert(cache, MakeKey("image.png", 4), 2000);
+    TensorCache::CacheStatistics statistics = cache.GetStatistics();
+    CHECK(static_cast<size_t>(2) == statistics.Entries);
+    CHECK(static_cast<size_t>(3000) == statistics.Bytes);
+    CHECK(static_cast<uint64_t>(3) == statistics.Evictions);
+    CHECK(static_cast<uint64_t>(4) == statistics.Hits);
+    CHECK(static_cast<uint64_t>(1) == statistics.Misses);
+
+    // An entry larger than the cache is handed back but not kept
+    auto tensor = Insert(cache, MakeKey("image.png", 5), 4000);
+    CHECK(HasValues(*tensor, 5, 4000));
+    CHECK(cache.Find(MakeKey("image.png", 5)) == nullptr);
+    CHECK(static_cast<size_t>(2) == cache.GetStatistics().Entries);
+
+    // Inserting a key again replaces its entry
+    Insert(cache, MakeKey("image.png", 4), 1000);
+    CHECK(static_cast<size_t>(2000) == cache.GetStatistics().Bytes);
+    CHECK(HasValues(*cache.Find(MakeKey("image.png", 4)), 4, 1000));
+}
+
+static void TestSpillDirectory()
+{
+    std::filesystem::path directory = std::filesystem::temp_directory_path() / L"WinMLRunnerTensorCacheTest";
+    std::filesystem::remove_all(directory);
+    TensorCache::CacheKey key = MakeKey("image.png", 7);
+    {
+        TensorCache::TensorCache cache(1 << 20, directory.wstring());
+        Insert(cache, key, 600);
+        CHECK(std::filesystem::exists(cache.GetSpillPath(key)));
+    }
+
+    // A later run maps the tensor instead of making it again, and then keeps it in memory
+    {
+        TensorCache::TensorCache cache(1 << 20, directory.wstring());
+        auto tensor = cache.Find(key);
+        CHECK(tensor != nullptr);
+        CHECK(tensor->Type == TensorFile::ElementType::UInt8);
+        CHECK(tensor->Shape == std::vector<int64_t>{ 600 });
+        CHECK(static_cast<uint32_t>(7) == tensor->Format);
+        CHECK(HasValues(*tensor, 7, 600));
+        CHECK(cache.Find(key) != nullptr);
+        TensorCache::CacheStatistics statistics = cache.GetStatistics();
+        CHECK(static_cast<uint64_t>(1) == statistics.DiskHits);
+        CHECK(static_cast<uint64_t>(1) == statistics.Hits);
+
+        // Tensors evicted from memory are still found on disk
+        TensorCache::TensorCache smallCache(100, directory.wstring());
+        CHECK(smallCache.Find(key) != nullptr);
+        CHECK(static_cast<size_t>(0) == smallCache.GetStatistics().Entries);
+    }
+    std::filesystem::remove_all(directory);
+}
+
+static void TestDamagedSpillFilesAreMisses()
+{
+    std::filesystem::path directory = std::filesystem::temp_directory_path() / L"WinMLRunnerTensorCacheTest";
+    std::filesystem::remove_all(directory);
+    TensorCache::CacheKey key = MakeKey("image.png", 1);
+    std::wstring spillPath;
+    {
+        TensorCache::TensorCache cache(1 << 20, directory.wstring());
+        Insert(cache, key, 600);
+        spillPath = cache.GetSpillPath(key);
+    }
+
+    // Truncated file
+    std::filesystem::resize_file(spillPath, 100);
+    CHECK(TensorCache::TensorCache(1 << 20, directory.wstring()).Find(key) == nullptr);
+
+    // A valid trace of another key, as a hash collision would leave
+    {
+        TensorTrace::TraceWriter writer(spillPath);
+        TensorTrace::RecordInfo info;
+        info.Name = MakeKey("other.png", 1).ToString();
+        info.Type = TensorFile::ElementType::UInt8;
+        info.Shape = { 1 };
+        info.Metadata = "format=1";
+        uint8_t value = 1;
+        writer.Add(info, &value, 1);
+    }
+    TensorCache::TensorCache cache(1 << 20, directory.wstring());
+    CHECK(cache.Find(key) == nullptr);
+    CHECK(static_cast<uint64_t>(1) == cache.GetStatistics().Misses);
+
+    // Inserting again replaces the file
+    Insert(cache, key, 600);
+    CHECK(HasValues(*TensorCache::TensorCache(1 << 20, directory.wstring()).Find(key), 1, 600));
+    std::filesystem::remove_all(directory);
+}
+
+static void TestConcurrentFindAndInsert()
+{
+    // Room for about half of the keys, so that threads evict entries others are using
+    TensorCache::TensorCache cache(16 * 1000);
+    std::atomic<size_t> wrongValues(0);
+    std::vector<std::thread> threads;
+    for (uint32_t t = 0; t < 8; ++t)
+    {
+        threads.emplace_back([&cache, &wrongValues, t]() {
+            std::mt19937 generator(t);
+            for (int i = 0; i < 2000; ++i)
+            {
+                uint32_t index = generator() % 32;
+                auto tensor = cache.Find(MakeKey("image.png", index));
+                if (tensor == nullptr)
+                {
+                    tensor = Insert(cache, MakeKey("image.png", index), 1000);
+                }
+                wrongValues += HasValues(*tensor, index, 1000) ? 0 : 1;
+            }
+        });
+    }
+    for (auto& thread : threads)
+    {
+        thread.join();
+    }
+    TensorCache::CacheStatistics statistics = cache.GetStatistics();
+    CHECK(static_cast<size_t>(0) == wrongValues.load());
+    CHECK(static_cast<uint64_t>(8 * 2000) == statistics.Hits + statistics.Misses);
+    CHECK(statistics.Bytes <= 16 * 1000);
+    CHECK(statistics.Entries * 1000 == statistics.Bytes);
+}
+
+int main()
+{
+    return UnitTests::RunTests({
+        { "TestCacheKey", TestCacheKey },
+        { "TestLeastRecentlyUsedEviction", TestLeastRecentlyUsedEviction },
+        { "TestSpillDirectory", TestSpillDirectory },
+        { "TestDamagedSpillFilesAreMisses", TestDamagedSpillFilesAreMisses },
+        { "TestConcurrentFindAndInsert", TestConcurrentFindAndInsert },
+    });
+}
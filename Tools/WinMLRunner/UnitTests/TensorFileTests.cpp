@@ -0,0 +1,261 @@
+// Tests of the .npy, .npz and raw tensor file reader of the tensor file input (see src/TensorFile.h).
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <utility>
+#include <vector>
+#include "TensorFile.h"
+#include "TestCheck.h"
+
+template <typename T> static std::string ToBytes(const std::vector<T>& values)
+{
+    return std::string(reinterpret_cast<const char*>(values.data()), values.size() * sizeof(T));
+}
+
+static void AppendLittleEndian(std::string& bytes, uint64_t value, int size)
+{
+    for (int i = 0; i < size; ++i)
+    {
+        bytes += static_cast<char>((value >> (8 * i)) & 0xFF);
+    }
+}
+
+// A .npy file whose header is padded the way numpy pads it
+static std::string MakeNpy(std::string header, const std::string& data, int version)
+{
+    size_t prefixSize = version == 1 ? 10 : 12;
+    header += std::string(63 - (prefixSize + header.size()) % 64, ' ') + "\n";
+    std::string npy = "\x93NUMPY";
+    npy += static_cast<char>(version);
+    npy += '\0';
+    AppendLittleEndian(npy, header.size(), version == 1 ? 2 : 4);
+    return npy + header + data;
+}
+
+// A zip archive with uncompressed entries, as written by numpy.savez
+static std::string MakeStoredZip(const std::vector<std::pair<std::string, std::string>>& entries)
+{
+    std::string zip;
+    std::string centralDirectory;
+    for (const auto& entry : entries)
+    {
+        size_t localHeader = zip.size();
+        AppendLittleEndian(zip, 0x04034b50, 4);
+        AppendLittleEndian(zip, 20, 2); // version needed
+        AppendLittleEndian(zip, 0, 2);  // flags
+        AppendLittleEndian(zip, 0, 2);  // stored
+        AppendLittleEndian(zip, 0, 4);  // time and date
+        AppendLittleEndian(zip, 0, 4);  // crc, not checked by the reader
+        AppendLittleEndian(zip, entry.second.size(), 4);
+        AppendLittleEndian(zip, entry.second.size(), 4);
+        AppendLittleEndian(zip, entry.first.size(), 2);
+        AppendLittleEndian(zip, 0, 2);
+        zip += entry.first + entry.second;
+
+        AppendLittleEndian(centralDirectory, 0x02014b50, 4);
+        AppendLittleEndian(centralDirectory, 20, 2); // version made by
+        AppendLittleEndian(centralDirectory, 20, 2); // version needed
+        AppendLittleEndian(centralDirectory, 0, 2);  // flags
+        AppendLittleEndian(centralDirectory, 0, 2);  // stored
+        AppendLittleEndian(centralDirectory, 0, 4);  // time and date
+        AppendLittleEndian(centralDirectory, 0, 4);  // crc
+        AppendLittleEndian(centralDirectory, entry.second.size(), 4);
+        AppendLittleEndian(centralDirectory, entry.second.size(), 4);
+        AppendLittleEndian(centralDirectory, entry.first.size(), 2);
+        AppendLittleEndian(centralDirectory, 0, 2); // extra field
+        AppendLittleEndian(centralDirectory, 0, 2); // comment
+        AppendLittleEndian(centralDirectory, 0, 2); // disk
+        AppendLittleEndian(centralDirectory, 0, 2); // internal attributes
+        AppendLittleEndian(centralDirectory, 0, 4); // external attributes
+        AppendLittleEndian(centralDirectory, localHeader, 4);
+        centralDirectory += entry.first;
+    }
+    size_t centralDirectoryOffset = zip.size();
+    zip += centralDirectory;
+    AppendLittleEndian(zip, 0x06054b50, 4);
+    AppendLittleEndian(zip, 0, 4); // disks
+    AppendLittleEndian(zip, entries.size(), 2);
+    AppendLittleEndian(zip, entries.size(), 2);
+    AppendLittleEndian(zip, centralDirectory.size(), 4);
+    AppendLittleEndian(zip, centralDirectoryOffset, 4);
+    AppendLittleEndian(zip, 0, 2); // comment
+    return zip;
+}
+
+static void TestParseNpy()
+{
+    std::vector<float> values = { 0.5f, -1.0f, 2.0f, 3.25f, 4.0f, -5.5f };
+    for (int version : { 1, 2 })
+    {
+        std::string npy = MakeNpy("{'descr': '<f4', 'fortran_order': False, 'shape': (2, 3), }",
+                                  ToBytes(values), version);
+        auto tensorData = TensorFile::ParseNpy(reinterpret_cast<const uint8_t*>(npy.data()), npy.size());
+        CHECK(tensorData.Type == TensorFile::ElementType::Float32);
+        CHECK(tensorData.Shape == std::vector<int64_t>({ 2, 3 }));
+        CHECK(values.size() * sizeof(float) == tensorData.SizeInBytes);
+        CHECK(std::memcmp(tensorData.Data, values.data(), tensorData.SizeInBytes) == 0);
+    }
+
+    // Scalars have an empty shape and one element
+    std::string npy = MakeNpy("{'descr': '|u1', 'fortran_order': False, 'shape': (), }", "\x07", 1);
+    auto scalar = TensorFile::ParseNpy(reinterpret_cast<const uint8_t*>(npy.data()), npy.size());
+    CHECK(scalar.Type == TensorFile::ElementType::UInt8);
+    CHECK(static_cast<size_t>(1) == scalar.GetElementCount());
+}
+
+static void TestParseNpz()
+{
+    std::vector<float> image(3 * 4 * 4, 0.25f);
+    std::vector<int64_t> lengths = { 7, 9 };
+    std::string npz = MakeStoredZip(
+        { { "image.npy", MakeNpy("{'descr': '<f4', 'fortran_order': False, 'shape': (1, 3, 4, 4), }",
+                                 ToBytes(image), 1) },
+          { "lengths.npy",
+            MakeNpy("{'descr': '<i8', 'fortran_order': False, 'shape': (2,), }", ToBytes(lengths), 1) } });
+    auto arrays = TensorFile::ParseNpz(reinterpret_cast<const uint8_t*>(npz.data()), npz.size());
+    CHECK(static_cast<size_t>(2) == arrays.size());
+
+    TensorFile::TensorFileContents contents;
+    contents.Arrays = arrays;
+    const TensorFile::TensorData* lengthsData = contents.FindArray("lengths");
+    CHECK(lengthsData != nullptr);
+    CHECK(lengthsData->Type == TensorFile::ElementType::Int64);
+    CHECK(std::memcmp(lengthsData->Data, lengths.data(), lengthsData->SizeInBytes) == 0);
+    CHECK(contents.FindArray("image")->Shape == std::vector<int64_t>({ 1, 3, 4, 4 }));
+    CHECK(contents.FindArray("mask") == nullptr);
+}
+
+static void TestReadRawFileWithHeader()
+{
+    std::filesystem::path path = std::filesystem::temp_directory_path() / L"WinMLRunnerTensorFileTest.raw";
+    std::filesystem::path headerPath = path;
+    headerPath += L".header";
+    std::vector<uint16_t> values = { 1, 2, 3, 4, 5, 6, 7, 8 };
+    {
+        std::ofstream file(path, std::ios::binary);
+        file << ToBytes(values);
+        std::ofstream header(headerPath, std::ios::binary);
+        header << "{'descr': '<u2', 'shape': (2, 4)}\n";
+    }
+    auto contents = TensorFile::LoadTensorFile(path.wstring());
+    CHECK(contents == TensorFile::LoadTensorFile(path.wstring()));
+    const TensorFile::TensorData* tensorData = contents->FindArray("input");
+    CHECK(tensorData->Type == TensorFile::ElementType::UInt16);
+    CHECK(tensorData->Shape == std::vector<int64_t>({ 2, 4 }));
+    CHECK(std::memcmp(tensorData->Data, values.data(), tensorData->SizeInBytes) == 0);
+
+    // A header that does not match the file size is rejected
+    {
+        std::ofstream header(headerPath, std::ios::binary);
+        header << "{'descr': '<f4', 'shape': (2, 4)}\n";
+    }
+    CHECK_THROWS(std::invalid_argument, [&path]() { TensorFile::ReadTensorFile(path.wstring()); });
+    std::filesystem::remove(headerPath);
+    CHECK_THROWS(std::runtime_error, [&path]() { TensorFile::ReadTensorFile(path.wstring()); });
+    std::error_code error;
+    std::filesystem::remove(path, error); // fails while the cached contents keep the file mapped
+}
+
+static void TestInvalidFilesThrow()
+{
+    std::string data(16, '\0');
+    std::vector<std::string> files = {
+        "not a numpy file",
+        MakeNpy("{'descr': '>f4', 'fortran_order': False, 'shape': (4,), }", data, 1),
+        MakeNpy("{'descr': '<c8', 'fortran_order': False, 'shape': (2,), }", data, 1),
+        MakeNpy("{'descr': '<f4', 'fortran_order': True, 'shape': (2, 2), }", data, 1),
+        MakeNpy("{'descr': '<f4', 'fortran_order': False, 'shape': (5,), }", data, 1),
+        MakeNpy("{'descr': '<f4', 'fortran_order': False}", data, 1),
+        // Shapes whose size overflows, which must not wrap around to something that fits in the file
+        MakeNpy("{'descr': '<f4', 'fortran_order': False, 'shape': (4294967296, 4294967296, 1), }", data, 1),
+        MakeNpy("{'descr': '<f4', 'fortran_order': False, 'shape': (4611686018427387904,), }", data, 1),
+        MakeNpy("{'descr': '<f4', 'fortran_order': False, 'shape': (99999999999999999999,), }", data, 1),
+    };
+    for (const auto& file : files)
+    {
+        CHECK_THROWS(std::invalid_argument, [&file]() {
+            TensorFile::ParseNpy(reinterpret_cast<const uint8_t*>(file.data()), file.size());
+        });
+    }
+
+    // numpy.savez_compressed archives
+    std::string npz = MakeStoredZip(
+        { { "x.npy", MakeNpy("{'descr': '<f4', 'fortran_order': False, 'shape': (4,), }", data, 1) } });
+    npz[npz.find("PK\x01\x02") + 10] = 8;
+    CHECK_THROWS(std::invalid_argument, [&npz]() {
+        TensorFile::ParseNpz(reinterpret_cast<const uint8_t*>(npz.data()), npz.size());
+    });
+}
+
+static void TestConvertElements()
+{
+    std::vector<float> floats = { -2.75f, -1.0f, 0.0f, 0.5f, 1.0f, 200.5f, 255.0f, 3.0e9f };
+    std::vector<int32_t> ints(floats.size());
+    TensorFile::ConvertElements(floats.data(), TensorFile::ElementType::Float32, ints.data(),
+                                TensorFile::ElementType::Int32, 7);
+    CHECK(std::vector<int32_t>(ints.begin(), ints.begin() + 7) == std::vector<int32_t>({ -2, -1, 0, 0, 1, 200, 255 }));
+
+    std::vector<uint8_t> bytes = { 0, 1, 127, 255 };
+    std::vector<double> doubles(bytes.size());
+    TensorFile::ConvertElements(bytes.data(), TensorFile::ElementType::UInt8, doubles.data(),
+                                TensorFile::ElementType::Float64, bytes.size());
+    CHECK(doubles == std::vector<double>({ 0.0, 1.0, 127.0, 255.0 }));
+
+    // Unaligned source
+    std::string unaligned = " " + ToBytes(floats);
+    std::vector<float> copied(floats.size());
+    TensorFile::ConvertElements(unaligned.data() + 1, TensorFile::ElementType::Float32, copied.data(),
+                                TensorFile::ElementType::Float32, floats.size());
+    CHECK(copied == floats);
+
+    std::vector<uint16_t> halves(floats.size());
+    TensorFile::ConvertElements(floats.data(), TensorFile::ElementType::Float32, halves.data(),
+                                TensorFile::ElementType::Float16, 7);
+    CHECK(std::vector<uint16_t>(halves.begin(), halves.begin() + 7) ==
+          std::vector<uint16_t>({ 0xC180, 0xBC00, 0x0000, 0x3800, 0x3C00, 0x5A44, 0x5BF8 }));
+}
+
+static void TestHalfConversion()
+{
+    // Every half survives the round trip through float
+    for (uint32_t bits = 0; bits <= 0xFFFF; ++bits)
+    {
+        float value = TensorFile::HalfToFloat(static_cast<uint16_t>(bits));
+        if (value != value)
+        {
+            CHECK((TensorFile::FloatToHalf(value) & 0x7FFF) > 0x7C00);
+            continue;
+        }
+        CHECK(bits == static_cast<uint32_t>(TensorFile::FloatToHalf(value)));
+    }
+
+    // Ties round to even, in the normal and the subnormal range
+    CHECK(TensorFile::FloatToHalf(1.0f + std::ldexp(1.0f, -11)) == 0x3C00);
+    CHECK(TensorFile::FloatToHalf(1.0f + std::ldexp(3.0f, -11)) == 0x3C02);
+    CHECK(TensorFile::FloatToHalf(std::ldexp(1.0f, -25)) == 0x0000);
+    CHECK(TensorFile::FloatToHalf(std::ldexp(1.5f, -25)) == 0x0001);
+    CHECK(TensorFile::FloatToHalf(std::ldexp(3.0f, -25)) == 0x0002);
+    CHECK(TensorFile::FloatToHalf(std::ldexp(2047.0f, -25)) == 0x0400);
+
+    // Overflow goes to infinity
+    CHECK(TensorFile::FloatToHalf(65519.0f) == 0x7BFF);
+    CHECK(TensorFile::FloatToHalf(65520.0f) == 0x7C00);
+    CHECK(TensorFile::FloatToHalf(-1.0e10f) == 0xFC00);
+}
+
+int main()
+{
+    return UnitTests::RunTests({
+        { "TestParseNpy", TestParseNpy },
+        { "TestParseNpz", TestParseNpz },
+        { "TestReadRawFileWithHeader", TestReadRawFileWithHeader },
+        { "TestInvalidFilesThrow", TestInvalidFilesThrow },
+        { "TestConvertElements", TestConvertElements },
+        { "TestHalfConversion", TestHalfConversion },
+    });
+}
@@ -0,0 +1,167 @@
+// Benchmark of the output tensor processing of OutputHelper::ProcessTensorResult (see src/TensorResults.h) against the
+// priority queue, per element float16 conversion and per value std::endl it replaced, on a synthetic 1000x1000
+// segmentation output of float and of float16 values. The top k is taken alone and with the tensor dumped to a CSV
+// file.
+#include <algorithm>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <queue>
+#include <random>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include "TensorFile.h"
+#include "TensorizeKernels.h"
+#include "TensorResults.h"
+#include "Benchmark.h"
+
+template <typename T> static float ToFloat(T value)
+{
+    if constexpr (std::is_same<T, uint16_t>::value)
+    {
+        return TensorFile::HalfToFloat(value);
+    }
+    else
+    {
+        return value;
+    }
+}
+
+// The loop of OutputHelper::ProcessTensorResult before TensorResults
+template <typename T>
+static void ReferenceProcessTensorResult(const T* tensor, size_t size, bool saveTensor, std::ostream& out,
+                                         unsigned int k, std::vector<std::pair<float, int>>& maxValues)
+{
+    auto cmp = [](std::pair<float, int> x, std::pair<float, int> y) { return x.first > y.first; };
+    std::priority_queue<std::pair<float, int>, std::vector<std::pair<float, int>>, decltype(cmp)> topKvalues(
+        cmp);
+    for (int i = 0; i < static_cast<int>(size); i++)
+    {
+        float val = ToFloat(tensor[i]);
+        if (saveTensor)
+        {
+            out << i << "," << val << std::endl;
+        }
+        if (topKvalues.size() < k)
+        {
+            topKvalues.push({ val, i });
+        }
+        else if (k > 0 && topKvalues.top().first < val)
+        {
+            topKvalues.pop();
+            topKvalues.push({ val, i });
+        }
+    }
+    maxValues.clear();
+    while (!topKvalues.empty())
+    {
+        maxValues.push_back(topKvalues.top());
+        topKvalues.pop();
+    }
+    std::reverse(maxValues.begin(), maxValues.end());
+}
+
+// Same steps as OutputHelper::ProcessTensorResult
+template <typename T>
+static void ProcessTensorResult(const T* tensor, size_t size, bool saveTensor, std::ostream& out,
+                                unsigned int k, std::vector<std::pair<float, int>>& maxValues)
+{
+    TensorResults::TopKSelector topKValues(k);
+    std::unique_ptr<TensorResults::TensorCsvWriter> writer;
+    if (saveTensor)
+    {
+        writer = std::make_unique<TensorResults::TensorCsvWriter>(out);
+    }
+    float values[TensorResults::ChunkSize];
+    for (size_t begin = 0; begin < size; begin += TensorResults::ChunkSize)
+    {
+        size_t count = (std::min)(TensorResults::ChunkSize, size - begin);
+        const float* chunk = values;
+        if constexpr (std::is_same<T, uint16_t>::value)
+        {
+            TensorResults::ConvertHalfToFloat(tensor + begin, values, count);
+        }
+        else
+        {
+            chunk = tensor + begin;
+        }
+        if (writer)
+        {
+            writer->Write(chunk, count, begin);
+        }
+        topKValues.Add(chunk, count, begin);
+    }
+    maxValues = topKValues.GetValues();
+}
+
+// Times both paths on one tensor, the dump going to a new file every run. Returns false if their top k values differ.
+template <typename T>
+static bool RunTensor(const char* type, const std::vector<T>& tensor, bool saveTensor,
+                      const std::filesystem::path& path, const Benchmarks::BenchmarkOptions& options)
+{
+    const unsigned int k = 5;
+    std::vector<std::pair<float, int>> referenceResult, result;
+    double referenceSeconds = Benchmarks::MeasureSeconds(options, [&]() {
+        std::ofstream out(path, std::ios::binary);
+        ReferenceProcessTensorResult(tensor.data(), tensor.size(), saveTensor, out, k, referenceResult);
+    });
+    double seconds = Benchmarks::MeasureSeconds(options, [&]() {
+        std::ofstream out(path, std::ios::binary);
+        ProcessTensorResult(tensor.data(), tensor.size(), saveTensor, out, k, result);
+    });
+    std::string name = std::string(type) + (saveTensor ? ", top k and CSV" : ", top k");
+    std::cout << std::left << std::setw(26) << name << std::fixed << std::setprecision(3) << std::setw(18)
+              << referenceSeconds * 1e3 << std::setw(18) << seconds * 1e3 << std::setprecision(2)
+              << referenceSeconds / seconds << "x" << std::endl;
+    // Among equal values the priority queue doesn't keep the lowest index, so only the values are compared
+    return std::equal(referenceResult.begin(), referenceResult.end(), result.begin(), result.end(),
+                      [](const std::pair<float, int>& x, const std::pair<float, int>& y) {
+                          return x.first == y.first;
+                      });
+}
+
+int main(int argc, char** argv)
+{
+    Benchmarks::BenchmarkOptions options;
+    int exitCode;
+    if (!Benchmarks::ParseOptions(argc, argv, options, exitCode))
+    {
+        return exitCode;
+    }
+
+    const size_t size = Benchmarks::Scaled(1000 * 1000, options);
+    std::vector<float> values(size);
+    std::vector<uint16_t> halves(size);
+    std::mt19937 generator(1234);
+    std::normal_distribution<float> distribution;
+    for (size_t i = 0; i < size; ++i)
+    {
+        halves[i] = TensorFile::FloatToHalf(distribution(generator));
+        values[i] = TensorFile::HalfToFloat(halves[i]);
+    }
+    std::filesystem::path path = std::filesystem::temp_directory_path() / "WinMLRunnerTensorResultsBenchmark.csv";
+
+    std::cout << size << " values, top 5, "
+              << TensorizeKernels::SimdLevelName(TensorizeKernels::GetSimdLevel()) << std::endl;
+    std::cout << std::left << std::setw(26) << "tensor" << std::setw(18) << "priority queue ms" << std::setw(18)
+              << "TensorResults ms"
+              << "speedup" << std::endl;
+    bool same = true;
+    for (bool saveTensor : { false, true })
+    {
+        same = RunTensor("float", values, saveTensor, path, options) && same;
+        same = RunTensor("float16", halves, saveTensor, path, options) && same;
+    }
+    std::filesystem::remove(path);
+    if (!same)
+    {
+        std::cout << "TensorResults found different top k values than the priority queue" << std::endl;
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,262 @@
+// Tests of the top k selection, float16 conversion and CSV writing of output tensors (see src/TensorResults.h)
+// against the per value loops they replaced, at every SIMD level the CPU supports.
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <memory>
+#include <numeric>
+#include <queue>
+#include <random>
+#include <sstream>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include "TensorFile.h"
+#include "TensorizeKernels.h"
+#include "TensorResults.h"
+#include "TestCheck.h"
+
+static std::vector<TensorizeKernels::SimdLevel> GetTestedSimdLevels()
+{
+    std::vector<TensorizeKernels::SimdLevel> levels = { TensorizeKernels::SimdLevel::Scalar };
+    if (TensorizeKernels::GetSimdLevel() == TensorizeKernels::SimdLevel::AVX2)
+    {
+        levels.push_back(TensorizeKernels::SimdLevel::SSE2);
+    }
+    if (TensorizeKernels::GetSimdLevel() != TensorizeKernels::SimdLevel::Scalar)
+    {
+        levels.push_back(TensorizeKernels::GetSimdLevel());
+    }
+    return levels;
+}
+
+// The k largest values, largest first, with ties going to the lower index and nans left out
+static std::vector<std::pair<float, int>> ReferenceTopK(const std::vector<float>& values, unsigned int k)
+{
+    std::vector<std::pair<float, int>> sorted;
+    for (size_t i = 0; i < values.size(); ++i)
+    {
+        if (!std::isnan(values[i]))
+        {
+            sorted.push_back({ values[i], static_cast<int>(i) });
+        }
+    }
+    std::stable_sort(sorted.begin(), sorted.end(),
+                     [](const std::pair<float, int>& x, const std::pair<float, int>& y) {
+                         return x.first > y.first;
+                     });
+    sorted.resize((std::min)(sorted.size(), static_cast<size_t>(k)));
+    return sorted;
+}
+
+// The priority queue and per value std::endl OutputHelper::ProcessTensorResult used before TensorResults
+static void ReferenceProcessTensorResult(const float* tensor, size_t size, bool saveTensor, std::ostream& out,
+                                         unsigned int k, std::vector<std::pair<float, int>>& maxValues)
+{
+    auto cmp = [](std::pair<float, int> x, std::pair<float, int> y) { return x.first > y.first; };
+    std::priority_queue<std::pair<float, int>, std::vector<std::pair<float, int>>, decltype(cmp)> topKvalues(
+        cmp);
+    for (int i = 0; i < static_cast<int>(size); i++)
+    {
+        float val = tensor[i];
+        if (saveTensor)
+        {
+            out << i << "," << val << std::endl;
+        }
+        if (topKvalues.size() < k)
+        {
+            topKvalues.push({ val, i });
+        }
+        else if (k > 0 && topKvalues.top().first < val)
+        {
+            topKvalues.pop();
+            topKvalues.push({ val, i });
+        }
+    }
+    maxValues.clear();
+    while (!topKvalues.empty())
+    {
+        maxValues.push_back(topKvalues.top());
+        topKvalues.pop();
+    }
+    std::reverse(maxValues.begin(), maxValues.end());
+}
+
+// Same steps as OutputHelper::ProcessTensorResult
+template <typename T>
+static void ProcessTensorResult(const T* tensor, size_t size, bool saveTensor, std::ostream& out,
+                                unsigned int k, std::vector<std::pair<float, int>>& maxValues)
+{
+    TensorResults::TopKSelector topKValues(k);
+    std::unique_ptr<TensorResults::TensorCsvWriter> writer;
+    if (saveTensor)
+    {
+        writer = std::make_unique<TensorResults::TensorCsvWriter>(out);
+    }
+    float values[TensorResults::ChunkSize];
+    for (size_t begin = 0; begin < size; begin += TensorResults::ChunkSize)
+    {
+        size_t count = (std::min)(TensorResults::ChunkSize, size - begin);
+        const float* chunk = values;
+        if constexpr (std::is_same<T, uint16_t>::value)
+        {
+            TensorResults::ConvertHalfToFloat(tensor + begin, values, count);
+        }
+        else
+        {
+            chunk = tensor + begin;
+        }
+        if (writer)
+        {
+            writer->Write(chunk, count, begin);
+        }
+        topKValues.Add(chunk, count, begin);
+    }
+    maxValues = topKValues.GetValues();
+}
+
+static void TestHalfToFloatMatchesScalar()
+{
+    std::vector<uint16_t> halves(65536);
+    for (size_t i = 0; i < halves.size(); ++i)
+    {
+        halves[i] = static_cast<uint16_t>(i);
+    }
+    for (auto level : GetTestedSimdLevels())
+    {
+        // An odd count, so the vector kernels also run their scalar tail
+        std::vector<float> output(halves.size() - 3);
+        TensorResults::ConvertHalfToFloat(halves.data(), output.data(), output.size(), level);
+        for (size_t i = 0; i < output.size(); ++i)
+        {
+            float expected = TensorFile::HalfToFloat(halves[i]);
+            if (std::isnan(expected))
+            {
+                CHECK(std::isnan(output[i]));
+            }
+            else
+            {
+                CHECK(std::memcmp(&expected, &output[i], sizeof(float)) == 0);
+            }
+        }
+    }
+}
+
+static void TestTopKMatchesSort()
+{
+    // Few distinct values, so there are many ties, and a few nans
+    std::vector<float> values(10007);
+    std::mt19937 generator(1234);
+    std::uniform_int_distribution<int> distribution(-500, 500);
+    for (size_t i = 0; i < values.size(); ++i)
+    {
+        values[i] = i % 997 == 0 ? std::numeric_limits<float>::quiet_NaN() : distribution(generator) / 4.0f;
+    }
+    for (unsigned int k : { 0u, 1u, 5u, 100u, 20000u })
+    {
+        auto expected = ReferenceTopK(values, k);
+        for (auto level : GetTestedSimdLevels())
+        {
+            TensorResults::TopKSelector selector(k, level);
+            selector.Add(values.data(), values.size());
+            CHECK(expected == selector.GetValues());
+        }
+    }
+
+    // Increasing values replace the smallest kept value every time
+    std::vector<float> increasing(1000);
+    std::iota(increasing.begin(), increasing.end(), 0.0f);
+    TensorResults::TopKSelector selector(3);
+    selector.Add(increasing.data(), increasing.size());
+    CHECK(ReferenceTopK(increasing, 3) == selector.GetValues());
+}
+
+static void TestTopKInChunks()
+{
+    std::vector<float> values(3 * TensorResults::ChunkSize + 17);
+    std::mt19937 generator(4321);
+    std::normal_distribution<float> distribution;
+    for (float& value : values)
+    {
+        value = distribution(generator);
+    }
+    TensorResults::TopKSelector whole(10), chunked(10);
+    whole.Add(values.data(), values.size());
+    for (size_t begin = 0; begin < values.size(); begin += TensorResults::ChunkSize)
+    {
+        chunked.Add(values.data() + begin, (std::min)(TensorResults::ChunkSize, values.size() - begin), begin);
+    }
+    CHECK(whole.GetValues() == chunked.GetValues());
+    CHECK(ReferenceTopK(values, 10) == whole.GetValues());
+}
+
+static void TestCsvWriterMatchesStream()
+{
+    std::vector<float> values = { 0.0f, -0.0f, 1.0f, -1.5f, 0.1f, 1.0f / 3.0f, 123456.0f, 1234567.0f, 1e6f,
+                                  1e-5f, 1e-4f, 3.4e38f, 1e-40f, std::numeric_limits<float>::infinity(),
+                                  -std::numeric_limits<float>::infinity(),
+                                  std::numeric_limits<float>::quiet_NaN() };
+    std::mt19937 generator(1234);
+    std::uniform_real_distribution<float> distribution(-1000, 1000);
+    for (int i = 0; i < 20000; ++i) // more than one buffer of output
+    {
+        values.push_back(distribution(generator));
+    }
+
+    std::ostringstream expected, actual;
+    for (size_t i = 0; i < values.size(); ++i)
+    {
+        expected << i + 100 << "," << values[i] << "\n";
+    }
+    {
+        TensorResults::TensorCsvWriter writer(actual);
+        writer.Write(values.data(), 10, 100);
+        writer.Write(values.data() + 10, values.size() - 10, 110);
+    }
+    CHECK(expected.str() == actual.str());
+}
+
+// The chunked TensorResults path of OutputHelper::ProcessTensorResult writes the same CSV and finds the same top k
+// as the priority queue it replaced, for float tensors and for float16 tensors of the same values.
+static void TestProcessTensorResultMatchesReference()
+{
+    const size_t size = 3 * TensorResults::ChunkSize + 5;
+    const unsigned int k = 5;
+    std::vector<float> values(size);
+    std::vector<uint16_t> halves(size);
+    std::mt19937 generator(1234);
+    std::normal_distribution<float> distribution;
+    for (size_t i = 0; i < size; ++i)
+    {
+        halves[i] = TensorFile::FloatToHalf(distribution(generator));
+        values[i] = TensorFile::HalfToFloat(halves[i]);
+    }
+
+    for (bool saveTensor : { false, true })
+    {
+        std::vector<std::pair<float, int>> referenceResult, floatResult, halfResult;
+        std::ostringstream referenceCsv, floatCsv, halfCsv;
+        ReferenceProcessTensorResult(values.data(), size, saveTensor, referenceCsv, k, referenceResult);
+        ProcessTensorResult(values.data(), size, saveTensor, floatCsv, k, floatResult);
+        ProcessTensorResult(halves.data(), size, saveTensor, halfCsv, k, halfResult);
+        CHECK(referenceResult.size() == k);
+        CHECK(referenceResult == floatResult);
+        CHECK(referenceResult == halfResult);
+        CHECK(referenceCsv.str() == floatCsv.str());
+        CHECK(referenceCsv.str() == halfCsv.str());
+        CHECK(referenceCsv.str().empty() != saveTensor);
+    }
+}
+
+int main()
+{
+    return UnitTests::RunTests({
+        { "TestHalfToFloatMatchesScalar", TestHalfToFloatMatchesScalar },
+        { "TestTopKMatchesSort", TestTopKMatchesSort },
+        { "TestTopKInChunks", TestTopKInChunks },
+        { "TestCsvWriterMatchesStream", TestCsvWriterMatchesStream },
+        { "TestProcessTensorResultMatchesReference", TestProcessTensorResultMatchesReference },
+    });
+}
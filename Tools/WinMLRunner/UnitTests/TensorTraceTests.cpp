@@ -0,0 +1,365 @@
+// Tests of the binary tensor trace format (see src/TensorTrace.h): LZ4 blocks, byte shuffling, writing and reading
+// traces, truncated and corrupt traces, and comparing tensors and traces.
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <limits>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <vector>
+#include "TensorFile.h"
+#include "TensorTrace.h"
+#include "TestCheck.h"
+
+static TensorTrace::RecordInfo MakeInfo(const std::string& name, TensorTrace::ElementType type,
+                                        const std::vector<int64_t>& shape, uint64_t iteration)
+{
+    TensorTrace::RecordInfo info;
+    info.Name = name;
+    info.Type = type;
+    info.Shape = shape;
+    info.Iteration = iteration;
+    return info;
+}
+
+template <typename T>
+static TensorFile::TensorData MakeTensor(const std::vector<T>& values, TensorTrace::ElementType type,
+                                         const std::vector<int64_t>& shape)
+{
+    TensorFile::TensorData tensor;
+    tensor.Type = type;
+    tensor.Shape = shape;
+    tensor.Data = reinterpret_cast<const uint8_t*>(values.data());
+    tensor.SizeInBytes = values.size() * sizeof(T);
+    return tensor;
+}
+
+static void TestLz4RoundTrip()
+{
+    std::mt19937 generator(1234);
+    for (size_t size : { 0, 1, 12, 13, 100, 4096, 70000, 1 << 20 })
+    {
+        for (int pattern = 0; pattern < 3; ++pattern)
+        {
+            // Random bytes, a small alphabet and long runs
+            std::vector<uint8_t> source(size);
+            for (size_t i = 0; i < size; ++i)
+            {
+                source[i] = static_cast<uint8_t>(pattern == 0   ? generator()
+                                                 : pattern == 1 ? 'a' + generator() % 3
+                                                                : i / 1000);
+            }
+            std::vector<uint8_t> compressed(TensorTrace::Lz4::GetCompressBound(size));
+            size_t compressedSize = TensorTrace::Lz4::Compress(source.data(), size, compressed.data());
+            CHECK(compressedSize <= compressed.size());
+            if (pattern == 2 && size >= 4096)
+            {
+                CHECK(compressedSize < size / 50);
+            }
+            std::vector<uint8_t> decompressed(size);
+            TensorTrace::Lz4::Decompress(compressed.data(), compressedSize, decompressed.data(), size);
+            CHECK(decompressed == source);
+        }
+    }
+
+    // Overlapping matches: a literal "ab" repeated by a match of offset 2
+    std::vector<uint8_t> block = { 0x2F, 'a', 'b', 0x02, 0x00, 0x05, 0x50, 'a', 'b', 'a', 'b', 'a' };
+    std::vector<uint8_t> expected(2 + 24, 0);
+    for (size_t i = 0; i < 26; ++i)
+    {
+        expected[i] = i % 2 == 0 ? 'a' : 'b';
+    }
+    expected.insert(expected.end(), { 'a', 'b', 'a', 'b', 'a' });
+    std::vector<uint8_t> decompressed(expected.size());
+    TensorTrace::Lz4::Decompress(block.data(), block.size(), decompressed.data(), decompressed.size());
+    CHECK(decompressed == expected);
+}
+
+static void TestCorruptLz4BlocksThrow()
+{
+    std::vector<uint8_t> output(64);
+    std::vector<std::vector<uint8_t>> blocks = {
+        {},                                    // empty
+        { 0x50, 'a', 'b' },                    // literals past the end of the block
+        { 0x10, 'a', 0x05, 0x00 },             // match before the start of the output
+        { 0x10, 'a', 0x00, 0x00 },             // offset 0
+        { 0x1F, 'a', 0x01, 0x00, 0xFF, 0xFF }, // match past the end of the output
+        { 0x10, 'a', 0x01 },                   // truncated offset
+    };
+    for (const auto& block : blocks)
+    {
+        CHECK_THROWS(std::runtime_error, [&block, &output]() {
+            TensorTrace::Lz4::Decompress(block.data(), block.size(), output.data(), output.size());
+        });
+    }
+    // Fewer bytes than expected
+    std::vector<uint8_t> block = { 0x30, 'a', 'b', 'c' };
+    CHECK_THROWS(std::runtime_error, [&block, &output]() {
+        TensorTrace::Lz4::Decompress(block.data(), block.size(), output.data(), output.size());
+    });
+}
+
+static void TestShuffleBytes()
+{
+    std::vector<uint32_t> values = { 0x04030201, 0x08070605, 0x0C0B0A09 };
+    std::vector<uint8_t> shuffled(values.size() * 4);
+    TensorTrace::ShuffleBytes(reinterpret_cast<const uint8_t*>(values.data()), shuffled.data(),
+                              shuffled.size(), 4);
+    CHECK(shuffled == std::vector<uint8_t>({ 1, 5, 9, 2, 6, 10, 3, 7, 11, 4, 8, 12 }));
+    std::vector<uint32_t> unshuffled(values.size());
+    TensorTrace::UnshuffleBytes(shuffled.data(), reinterpret_cast<uint8_t*>(unshuffled.data()),
+                                shuffled.size(), 4);
+    CHECK(unshuffled == values);
+}
+
+static void TestWriteAndRead()
+{
+    std::filesystem::path path = std::filesystem::temp_directory_path() / L"WinMLRunnerTensorTraceTest.wmltrace";
+    // More than one compressed block, a type without shuffling, an empty tensor and a scalar
+    std::vector<float> floats(TensorTrace::BlockSize / 4 * 2 + 1000);
+    for (size_t i = 0; i < floats.size(); ++i)
+    {
+        floats[i] = std::sin(i * 0.001f);
+    }
+    std::vector<uint8_t> bytes = { 1, 2, 3, 4, 5, 6 };
+    std::vector<int64_t> scalar = { -42 };
+    for (auto codec : { TensorTrace::Codec::None, TensorTrace::Codec::Lz4 })
+    {
+        {
+            TensorTrace::TraceWriter writer(path.wstring(), codec);
+            for (uint64_t iteration = 0; iteration < 3; ++iteration)
+            {
+                floats[0] = static_cast<float>(iteration);
+                writer.Add(MakeInfo("output", TensorTrace::ElementType::Float32,
+                                    { 2, static_cast<int64_t>(floats.size() / 2) }, iteration),
+                           floats.data(), floats.size() * sizeof(float));
+            }
+            TensorTrace::RecordInfo info = MakeInfo("bytes", TensorTrace::ElementType::UInt8, { 2, 3 }, 0);
+            info.Timestamp = 1234;
+            info.Metadata = "model=test";
+            writer.Add(info, bytes.data(), bytes.size());
+            writer.Add(MakeInfo("empty", TensorTrace::ElementType::Float16, { 0, 3 }, 0), nullptr, 0);
+            writer.Add(MakeInfo("scalar", TensorTrace::ElementType::Int64, {}, 0), scalar.data(), 8);
+            CHECK_THROWS(std::invalid_argument, [&writer, &bytes]() {
+                writer.Add(MakeInfo("wrong size", TensorTrace::ElementType::UInt8, { 7 }, 0), bytes.data(),
+                           bytes.size());
+            });
+            CHECK(static_cast<size_t>(6) == writer.GetRecordCount());
+        }
+
+        TensorTrace::TraceReader reader(path.wstring());
+        CHECK(reader.HasIndex());
+        CHECK(static_cast<size_t>(6) == reader.GetRecords().size());
+        std::vector<uint8_t> buffer;
+        const TensorTrace::Record* output = reader.Find("output", 2);
+        CHECK(output != nullptr);
+        CHECK(output->Info.Shape == std::vector<int64_t>({ 2, static_cast<int64_t>(floats.size() / 2) }));
+        CHECK(output->PayloadCodec == codec);
+        const uint8_t* data = reader.GetData(*output, buffer);
+        CHECK(std::memcmp(data, floats.data(), floats.size() * sizeof(float)) == 0);
+        if (codec == TensorTrace::Codec::None)
+        {
+            // Raw records are read in place
+            CHECK(data == output->Payload && buffer.empty());
+        }
+        else
+        {
+            CHECK(static_cast<size_t>(3) == output->BlockSizes.size());
+            CHECK(output->PayloadSize < output->RawSize);
+        }
+        CHECK(1.0f == *reinterpret_cast<const float*>(reader.GetData(*reader.Find("output", 1), buffer)));
+
+        const TensorTrace::Record* byteRecord = reader.Find("bytes", 0);
+        CHECK(byteRecord->Info.Type == TensorTrace::ElementType::UInt8);
+        CHECK(static_cast<int64_t>(1234) == byteRecord->Info.Timestamp);
+        CHECK(std::string("model=test") == byteRecord->Info.Metadata);
+        CHECK(std::memcmp(reader.GetData(*byteRecord, buffer), bytes.data(), bytes.size()) == 0);
+        CHECK(reader.Find("output", 0)->Info.Timestamp > 0);
+        CHECK(static_cast<size_t>(0) == reader.Find("empty", 0)->GetElementCount());
+        const TensorTrace::Record* scalarRecord = reader.Find("scalar", 0);
+        CHECK(scalarRecord->Info.Shape.empty());
+        CHECK(static_cast<int64_t>(-42) == *reinterpret_cast<const int64_t*>(reader.GetData(*scalarRecord, buffer)));
+        CHECK(reader.Find("output", 3) == nullptr);
+    }
+    std::error_code error;
+    std::filesystem::remove(path, error);
+}
+
+static void TestReadWithoutIndex()
+{
+    std::filesystem::path path = std::filesystem::temp_directory_path() / L"WinMLRunnerTensorTraceTest.wmltrace";
+    std::vector<float> values(1000, 0.5f);
+    uint64_t thirdRecordOffset;
+    {
+        TensorTrace::TraceWriter writer(path.wstring(), TensorTrace::Codec::Lz4);
+        for (uint64_t iteration = 0; iteration < 3; ++iteration)
+        {
+            writer.Add(MakeInfo("output", TensorTrace::ElementType::Float32, { 1000 }, iteration),
+                       values.data(), values.size() * sizeof(float));
+        }
+    }
+    {
+        TensorTrace::TraceReader reader(path.wstring());
+        thirdRecordOffset = reader.GetRecords()[2].Offset;
+    }
+
+    // A run that stopped while writing the third record
+    std::filesystem::resize_file(path, thirdRecordOffset + 20);
+    {
+        TensorTrace::TraceReader reader(path.wstring());
+        CHECK(!reader.HasIndex());
+        CHECK(static_cast<size_t>(2) == reader.GetRecords().size());
+        std::vector<uint8_t> buffer;
+        CHECK(std::memcmp(reader.GetData(*reader.Find("output", 1), buffer), values.data(),
+                          values.size() * sizeof(float)) == 0);
+    }
+    std::error_code error;
+    std::filesystem::remove(path, error);
+}
+
+static void TestCorruptTracesThrow()
+{
+    std::filesystem::path path = std::filesystem::temp_directory_path() / L"WinMLRunnerTensorTraceTest.wmltrace";
+    std::vector<float> values(1000, 0.5f);
+    {
+        TensorTrace::TraceWriter writer(path.wstring(), TensorTrace::Codec::Lz4);
+        writer.Add(MakeInfo("output", TensorTrace::ElementType::Float32, { 1000 }, 0), values.data(),
+                   values.size() * sizeof(float));
+    }
+    std::ifstream input(path, std::ios_base::binary);
+    std::string trace((std::istreambuf_iterator<char>(input)), std::istreambuf_iterator<char>());
+    input.close();
+
+    auto expectInvalid = [&path](const std::string& contents) {
+        {
+            std::ofstream file(path, std::ios_base::binary | std::ios_base::trunc);
+            file << contents;
+        }
+        CHECK_THROWS(std::invalid_argument, [&path]() { TensorTrace::TraceReader reader(path.wstring()); });
+    };
+    expectInvalid("not a trace, not a trace");
+    std::string version = trace;
+    version[8] = 2;
+    expectInvalid(version);
+    std::string index = trace;
+    index[index.size() - 16] ^= 1; // index offset
+    expectInvalid(index);
+    std::string dataType = trace;
+    dataType[TensorTrace::FileHeaderSize + 40] = 14; // complex64
+    expectInvalid(dataType);
+    std::string rawSize = trace;
+    rawSize[TensorTrace::FileHeaderSize + 16] ^= 4;
+    expectInvalid(rawSize);
+
+    // Compressed data is only checked when it is decoded: zeroes are a sequence with a match at offset 0
+    std::string payload = trace;
+    uint32_t headerSize;
+    uint64_t payloadSize;
+    std::memcpy(&headerSize, trace.data() + TensorTrace::FileHeaderSize + 4, sizeof(headerSize));
+    std::memcpy(&payloadSize, trace.data() + TensorTrace::FileHeaderSize + 8, sizeof(payloadSize));
+    std::fill_n(payload.begin() + TensorTrace::FileHeaderSize + headerSize, payloadSize, '\0');
+    {
+        std::ofstream file(path, std::ios_base::binary | std::ios_base::trunc);
+        file << payload;
+    }
+    {
+        TensorTrace::TraceReader reader(path.wstring());
+        std::vector<uint8_t> buffer;
+        CHECK_THROWS(std::runtime_error, [&reader, &buffer]() { reader.GetData(reader.GetRecords()[0], buffer); });
+    }
+    std::error_code error;
+    std::filesystem::remove(path, error);
+}
+
+static void TestCompareTensors()
+{
+    std::vector<float> expected = { 1.0f, 100.0f, -2.0f, std::numeric_limits<float>::quiet_NaN(), 0.0f };
+    std::vector<float> actual = { 1.0f, 100.5f, -2.001f, std::numeric_limits<float>::quiet_NaN(), 0.0f };
+    auto expectedTensor = MakeTensor(expected, TensorTrace::ElementType::Float32, { 5 });
+    auto actualTensor = MakeTensor(actual, TensorTrace::ElementType::Float32, { 5 });
+
+    TensorTrace::TensorDifference difference = TensorTrace::CompareTensors(expectedTensor, actualTensor, {});
+    CHECK(static_cast<size_t>(2) == difference.Mismatches);
+    CHECK(static_cast<size_t>(1) == difference.FirstMismatch);
+    CHECK(static_cast<size_t>(1) == difference.MaxErrorIndex);
+    CHECK(0.5 == difference.MaxAbsoluteError);
+    CHECK(100.5 == difference.Actual);
+
+    // |a - b| <= absolute + relative * |a|
+    CHECK(static_cast<size_t>(1) == TensorTrace::CompareTensors(expectedTensor, actualTensor, { 0.01, 0 }).Mismatches);
+    CHECK(static_cast<size_t>(1) == TensorTrace::CompareTensors(expectedTensor, actualTensor, { 0, 0.001 }).Mismatches);
+    difference = TensorTrace::CompareTensors(expectedTensor, actualTensor, { 0.01, 0.005 });
+    CHECK(difference.IsMatch());
+    CHECK(0.5 == difference.MaxAbsoluteError);
+
+    // A nan only matches a nan
+    actual[3] = 0.0f;
+    difference = TensorTrace::CompareTensors(
+        expectedTensor, MakeTensor(actual, TensorTrace::ElementType::Float32, { 5 }), { 1, 1 });
+    CHECK(static_cast<size_t>(1) == difference.Mismatches);
+    CHECK(static_cast<size_t>(3) == difference.FirstMismatch);
+
+    // Different types are compared by value, different shapes are not compared
+    std::vector<uint16_t> halves(expected.size());
+    TensorFile::ConvertElements(expected.data(), TensorTrace::ElementType::Float32, halves.data(),
+                                TensorTrace::ElementType::Float16, expected.size());
+    difference = TensorTrace::CompareTensors(expectedTensor,
+                                             MakeTensor(halves, TensorTrace::ElementType::Float16, { 5 }), {});
+    CHECK(!difference.TypesMatch);
+    CHECK(difference.IsMatch());
+    difference = TensorTrace::CompareTensors(expectedTensor,
+                                             MakeTensor(expected, TensorTrace::ElementType::Float32, { 1, 5 }),
+                                             {});
+    CHECK(!difference.ShapesMatch);
+    CHECK(!difference.IsMatch());
+}
+
+static void TestCompareTraces()
+{
+    std::filesystem::path directory = std::filesystem::temp_directory_path();
+    std::wstring expectedPath = (directory / L"WinMLRunnerTensorTraceTestExpected.wmltrace").wstring();
+    std::wstring actualPath = (directory / L"WinMLRunnerTensorTraceTestActual.wmltrace").wstring();
+    std::vector<float> values = { 1.0f, 2.0f, 3.0f };
+    {
+        // Two models with the same output name, the second one differs in the actual trace
+        TensorTrace::TraceWriter expected(expectedPath);
+        TensorTrace::TraceWriter actual(actualPath, TensorTrace::Codec::Lz4);
+        for (int model = 0; model < 2; ++model)
+        {
+            expected.Add(MakeInfo("output", TensorTrace::ElementType::Float32, { 3 }, 0), values.data(), 12);
+            values[2] += model;
+            actual.Add(MakeInfo("output", TensorTrace::ElementType::Float32, { 3 }, 0), values.data(), 12);
+        }
+        expected.Add(MakeInfo("expected only", TensorTrace::ElementType::Float32, { 3 }, 0), values.data(), 12);
+        actual.Add(MakeInfo("actual only", TensorTrace::ElementType::Float32, { 3 }, 0), values.data(), 12);
+    }
+    TensorTrace::TraceReader expected(expectedPath);
+    TensorTrace::TraceReader actual(actualPath);
+    auto differences = TensorTrace::CompareTraces(expected, actual, {});
+    CHECK(static_cast<size_t>(4) == differences.size());
+    CHECK(differences[0].IsMatch());
+    CHECK(!(differences[1].IsMatch()));
+    CHECK(static_cast<size_t>(2) == differences[1].Difference.FirstMismatch);
+    CHECK(differences[2].Actual == nullptr && differences[2].Expected->Info.Name == "expected only");
+    CHECK(differences[3].Expected == nullptr && differences[3].Actual->Info.Name == "actual only");
+    CHECK(TensorTrace::CompareTraces(expected, actual, { 1, 0 })[1].IsMatch());
+}
+
+int main()
+{
+    return UnitTests::RunTests({
+        { "TestLz4RoundTrip", TestLz4RoundTrip },
+        { "TestCorruptLz4BlocksThrow", TestCorruptLz4BlocksThrow },
+        { "TestShuffleBytes", TestShuffleBytes },
+        { "TestWriteAndRead", TestWriteAndRead },
+        { "TestReadWithoutIndex", TestReadWithoutIndex },
+        { "TestCorruptTracesThrow", TestCorruptTracesThrow },
+        { "TestCompareTensors", TestCompareTensors },
+        { "TestCompareTraces", TestCompareTraces },
+    });
+}
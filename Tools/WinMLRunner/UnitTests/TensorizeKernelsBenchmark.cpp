@@ -0,0 +1,123 @@
+// Benchmark of the tensorize kernels (see src/TensorizeKernels.h) against the per element loop they replaced, which
+// divided by the scale and the standard deviation of every value. Bgra8 and Rgba16 images of 1080p and 4K are
+// normalized to float NCHW at every SIMD level the CPU supports, and at the best one with the rows split over a
+// thread pool.
+#include <algorithm>
+#include <cstdint>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include "ThreadPool.h"
+#include "TensorizeKernels.h"
+#include "Benchmark.h"
+
+static std::vector<TensorizeKernels::SimdLevel> GetSupportedSimdLevels()
+{
+    std::vector<TensorizeKernels::SimdLevel> levels = { TensorizeKernels::SimdLevel::Scalar };
+    if (TensorizeKernels::GetSimdLevel() == TensorizeKernels::SimdLevel::AVX2)
+    {
+        levels.push_back(TensorizeKernels::SimdLevel::SSE2);
+    }
+    if (TensorizeKernels::GetSimdLevel() != TensorizeKernels::SimdLevel::Scalar)
+    {
+        levels.push_back(TensorizeKernels::GetSimdLevel());
+    }
+    return levels;
+}
+
+template <typename T> static std::vector<T> GenerateInput(size_t count, uint32_t maxValue)
+{
+    std::mt19937 generator(1234);
+    std::uniform_int_distribution<uint32_t> distribution(0, maxValue);
+    std::vector<T> values(count);
+    for (T& value : values)
+    {
+        value = static_cast<T>(distribution(generator));
+    }
+    return values;
+}
+
+// The per element loop CopyTensorFromBuffer used before the vector kernels, writing planar output
+template <typename T>
+static void ReferenceTensorize(const T* input, uint32_t pixelStride, uint32_t numChannels, size_t numPixels,
+                               float* output, float scale, const std::vector<float>& means,
+                               const std::vector<float>& stddevs)
+{
+    for (size_t element = 0; element < numPixels; ++element)
+    {
+        for (uint32_t channel = 0; channel < numChannels; ++channel)
+        {
+            output[element + channel * numPixels] =
+                ((input[channel] / scale) - means[channel]) / stddevs[channel];
+        }
+        input += pixelStride;
+    }
+}
+
+static void PrintRow(const std::string& name, double seconds, double referenceSeconds)
+{
+    std::cout << std::left << std::setw(30) << name << std::fixed << std::setprecision(3) << std::setw(12)
+              << seconds * 1e3 << std::setprecision(2) << referenceSeconds / seconds << "x" << std::endl;
+}
+
+template <typename T>
+static void RunImage(const char* format, float scale, uint32_t height, uint32_t width, ThreadPool& pool,
+                     const Benchmarks::BenchmarkOptions& options)
+{
+    const std::vector<float> means = { 0.485f, 0.456f, 0.406f }, stddevs = { 0.229f, 0.224f, 0.225f };
+    auto constants = TensorizeKernels::ComputeNormalizeConstants(scale, means, stddevs);
+    auto identity = [](float value) { return value; };
+    std::vector<T> input = GenerateInput<T>(static_cast<size_t>(height) * width * 4, static_cast<uint32_t>(scale));
+    std::vector<float> output(static_cast<size_t>(height) * width * 3);
+
+    std::cout << std::endl << width << "x" << height << " " << format << " to float NCHW" << std::endl;
+    std::cout << std::left << std::setw(30) << "path" << std::setw(12) << "ms" << "speedup" << std::endl;
+    double referenceSeconds = Benchmarks::MeasureSeconds(options, [&]() {
+        ReferenceTensorize(input.data(), 4, 3, static_cast<size_t>(height) * width, output.data(), scale, means,
+                           stddevs);
+    });
+    PrintRow("per element divide", referenceSeconds, referenceSeconds);
+    for (auto level : GetSupportedSimdLevels())
+    {
+        double seconds = Benchmarks::MeasureSeconds(options, [&]() {
+            TensorizeKernels::Tensorize(input.data(), 4, 3, height, width, true, output.data(), constants, identity,
+                                        nullptr, level);
+        });
+        PrintRow(TensorizeKernels::SimdLevelName(level), seconds, referenceSeconds);
+    }
+    double parallelSeconds = Benchmarks::MeasureSeconds(options, [&]() {
+        TensorizeKernels::Tensorize(input.data(), 4, 3, height, width, true, output.data(), constants, identity,
+                                    &pool);
+    });
+    std::ostringstream name;
+    name << TensorizeKernels::SimdLevelName(TensorizeKernels::GetSimdLevel()) << " on " << pool.NumThreads() + 1
+         << " threads";
+    PrintRow(name.str(), parallelSeconds, referenceSeconds);
+    Benchmarks::KeepValue(output[output.size() / 2]);
+}
+
+int main(int argc, char** argv)
+{
+    Benchmarks::BenchmarkOptions options;
+    int exitCode;
+    if (!Benchmarks::ParseOptions(argc, argv, options, exitCode))
+    {
+        return exitCode;
+    }
+
+    // The calling thread runs rows too, so the pool gets one thread less than the hardware has
+    unsigned int hardwareThreads = std::thread::hardware_concurrency();
+    ThreadPool pool(hardwareThreads > 1 ? hardwareThreads - 1 : 1);
+    for (uint32_t height : { 1080u, 2160u })
+    {
+        uint32_t width = height * 16 / 9;
+        uint32_t scaledHeight = static_cast<uint32_t>(Benchmarks::Scaled(height, options));
+        RunImage<uint8_t>("Bgra8", 255.0f, scaledHeight, width, pool, options);
+        RunImage<uint16_t>("Rgba16", 65535.0f, scaledHeight, width, pool, options);
+    }
+    return 0;
+}
@@ -0,0 +1,175 @@
+// Tests of the vectorized tensorize kernels against the per element loop they replaced, at every SIMD level the
+// CPU supports (see src/TensorizeKernels.h).
+#include <cmath>
+#include <cstdint>
+#include <random>
+#include <vector>
+#include "ThreadPool.h"
+#include "TensorizeKernels.h"
+#include "TestCheck.h"
+
+static std::vector<TensorizeKernels::SimdLevel> GetTestedSimdLevels()
+{
+    std::vector<TensorizeKernels::SimdLevel> levels = { TensorizeKernels::SimdLevel::Scalar };
+    if (TensorizeKernels::GetSimdLevel() == TensorizeKernels::SimdLevel::AVX2)
+    {
+        levels.push_back(TensorizeKernels::SimdLevel::SSE2);
+    }
+    if (TensorizeKernels::GetSimdLevel() != TensorizeKernels::SimdLevel::Scalar)
+    {
+        levels.push_back(TensorizeKernels::GetSimdLevel());
+    }
+    return levels;
+}
+
+template <typename T> static std::vector<T> GenerateInput(size_t count, uint32_t maxValue)
+{
+    std::mt19937 generator(1234);
+    std::uniform_int_distribution<uint32_t> distribution(0, maxValue);
+    std::vector<T> values(count);
+    for (T& value : values)
+    {
+        value = static_cast<T>(distribution(generator));
+    }
+    return values;
+}
+
+// The per element loop CopyTensorFromBuffer used before the vector kernels, writing planar output
+template <typename T>
+static void ReferenceTensorize(const T* input, uint32_t pixelStride, uint32_t numChannels, size_t numPixels,
+                               float* output, float scale, const std::vector<float>& means,
+                               const std::vector<float>& stddevs)
+{
+    for (size_t element = 0; element < numPixels; ++element)
+    {
+        for (uint32_t channel = 0; channel < numChannels; ++channel)
+        {
+            output[element + channel * numPixels] =
+                ((input[channel] / scale) - means[channel]) / stddevs[channel];
+        }
+        input += pixelStride;
+    }
+}
+
+template <typename T>
+static void CheckAgainstReference(TensorizeKernels::SimdLevel level, uint32_t height, uint32_t width,
+                                  uint32_t pixelStride, uint32_t numChannels, float scale,
+                                  const std::vector<float>& means, const std::vector<float>& stddevs)
+{
+    std::vector<float> channelMeans(means.begin(), means.begin() + numChannels);
+    std::vector<float> channelStddevs(stddevs.begin(), stddevs.begin() + numChannels);
+    std::vector<T> input = GenerateInput<T>(height * width * pixelStride, static_cast<uint32_t>(scale));
+    std::vector<float> expected(height * width * numChannels), actual(expected.size());
+    ReferenceTensorize(input.data(), pixelStride, numChannels, height * width, expected.data(), scale,
+                       channelMeans, channelStddevs);
+    TensorizeKernels::Tensorize(input.data(), pixelStride, numChannels, height, width, true, actual.data(),
+                                TensorizeKernels::ComputeNormalizeConstants(scale, channelMeans,
+                                                                            channelStddevs),
+                                [](float value) { return value; }, nullptr, level);
+    for (size_t i = 0; i < expected.size(); ++i)
+    {
+        CHECK(UnitTests::Near(expected[i], actual[i], 1e-5f + std::abs(expected[i]) * 1e-6f));
+    }
+}
+
+static void TestImageLayoutsMatchReference()
+{
+    // width is not a multiple of any vector width, so every kernel also runs its scalar tail
+    const uint32_t height = 7, width = 37;
+    const std::vector<float> means = { 0.485f, 0.456f, 0.406f, 0.5f };
+    const std::vector<float> stddevs = { 0.229f, 0.224f, 0.225f, 0.25f };
+    for (auto level : GetTestedSimdLevels())
+    {
+        CheckAgainstReference<uint8_t>(level, height, width, 4, 3, 255.0f, means, stddevs); // Bgra8/Rgba8
+        CheckAgainstReference<uint8_t>(level, height, width, 4, 4, 255.0f, means, stddevs);
+        CheckAgainstReference<uint8_t>(level, height, width, 1, 1, 255.0f, means, stddevs); // Gray8
+        CheckAgainstReference<uint16_t>(level, height, width, 4, 3, 65535.0f, means, stddevs); // Rgba16
+        CheckAgainstReference<uint16_t>(level, height, width, 1, 1, 65535.0f, means, stddevs); // Gray16
+        CheckAgainstReference<float>(level, height, width, 1, 1, 1.0f, means, stddevs);
+        CheckAgainstReference<float>(level, height, width, 3, 2, 1.0f, means, stddevs); // no vector kernel
+    }
+}
+
+static void TestIdentityIsExact()
+{
+    const uint32_t height = 3, width = 29;
+    std::vector<uint8_t> input = GenerateInput<uint8_t>(height * width * 4, 255);
+    auto constants = TensorizeKernels::ComputeNormalizeConstants(1.0f, { 0, 0, 0 }, { 1, 1, 1 });
+    for (auto level : GetTestedSimdLevels())
+    {
+        std::vector<float> output(height * width * 3);
+        TensorizeKernels::Tensorize(input.data(), 4, 3, height, width, true, output.data(), constants,
+                                    [](float value) { return value; }, nullptr, level);
+        for (uint32_t channel = 0; channel < 3; ++channel)
+        {
+            for (uint32_t i = 0; i < height * width; ++i)
+            {
+                CHECK(static_cast<float>(input[i * 4 + channel]) == output[channel * height * width + i]);
+            }
+        }
+    }
+}
+
+static void TestInterleavedOutput()
+{
+    // CSV data: the channels of an element stay next to each other
+    const uint32_t height = 4, width = 5, channels = 6;
+    std::vector<float> input = GenerateInput<float>(height * width * channels, 100);
+    std::vector<float> means(channels, 2.0f), stddevs(channels, 4.0f);
+    std::vector<float> output(input.size());
+    TensorizeKernels::Tensorize(input.data(), channels, channels, height, width, false, output.data(),
+                                TensorizeKernels::ComputeNormalizeConstants(1.0f, means, stddevs),
+                                [](float value) { return value; });
+    for (size_t i = 0; i < input.size(); ++i)
+    {
+        CHECK(UnitTests::Near((input[i] - 2.0f) / 4.0f, output[i], 1e-5f));
+    }
+}
+
+static void TestConvertedOutput()
+{
+    const uint32_t height = 5, width = 300; // wider than one tile
+    std::vector<uint8_t> input = GenerateInput<uint8_t>(height * width * 4, 255);
+    auto constants = TensorizeKernels::ComputeNormalizeConstants(1.0f, { 10, 20, 30 }, { 1, 1, 1 });
+    for (auto level : GetTestedSimdLevels())
+    {
+        std::vector<int32_t> output(height * width * 3);
+        TensorizeKernels::Tensorize(input.data(), 4, 3, height, width, true, output.data(), constants,
+                                    [](float value) { return static_cast<int32_t>(value); }, nullptr, level);
+        for (uint32_t channel = 0; channel < 3; ++channel)
+        {
+            for (uint32_t i = 0; i < height * width; ++i)
+            {
+                int32_t expected =
+                    static_cast<int32_t>(input[i * 4 + channel]) - 10 * static_cast<int32_t>(channel + 1);
+                CHECK(expected == output[channel * height * width + i]);
+            }
+        }
+    }
+}
+
+static void TestParallelRowsMatchSerial()
+{
+    const uint32_t height = 1080, width = 1920;
+    std::vector<uint8_t> input = GenerateInput<uint8_t>(height * width * 4, 255);
+    auto constants = TensorizeKernels::ComputeNormalizeConstants(255.0f, { 0.485f, 0.456f, 0.406f },
+                                                                 { 0.229f, 0.224f, 0.225f });
+    std::vector<float> serial(height * width * 3), parallel(height * width * 3);
+    ThreadPool pool(4);
+    TensorizeKernels::Tensorize(input.data(), 4, 3, height, width, true, serial.data(), constants,
+                                [](float value) { return value; });
+    TensorizeKernels::Tensorize(input.data(), 4, 3, height, width, true, parallel.data(), constants,
+                                [](float value) { return value; }, &pool);
+    CHECK(serial == parallel);
+}
+
+int main()
+{
+    return UnitTests::RunTests({
+        { "TestImageLayoutsMatchReference", TestImageLayoutsMatchReference },
+        { "TestIdentityIsExact", TestIdentityIsExact },
+        { "TestInterleavedOutput", TestInterleavedOutput },
+        { "TestConvertedOutput", TestConvertedOutput },
+        { "TestParallelRowsMatchSerial", TestParallelRowsMatchSerial },
+    });
+}
@@ -0,0 +1,82 @@
+#pragma once
+
+#include <cmath>
+#include <exception>
+#include <functional>
+#include <iostream>
+#include <vector>
+
+// Checks for the tests of the WinMLRunner headers that build without WinML, which don't need a test framework. A
+// failed check prints where it failed and the test goes on. RunTests runs the tests of a test program and returns its
+// exit code: 0 if every check passed, 1 otherwise.
+namespace UnitTests
+{
+    inline int& GetFailureCount()
+    {
+        static int failures = 0;
+        return failures;
+    }
+
+    inline void Check(bool condition, const char* expression, const char* file, int line)
+    {
+        if (!condition)
+        {
+            std::cout << file << "(" << line << "): check failed: " << expression << std::endl;
+            ++GetFailureCount();
+        }
+    }
+
+    // Whether actual is within tolerance of expected.
+    template <typename T> bool Near(T expected, T actual, T tolerance)
+    {
+        return std::abs(expected - actual) <= tolerance;
+    }
+
+    // Whether calling function throws an Exception. Other exceptions fail the test.
+    template <typename Exception, typename Function> bool Throws(Function&& function)
+    {
+        try
+        {
+            function();
+        }
+        catch (const Exception&)
+        {
+            return true;
+        }
+        return false;
+    }
+
+    struct Test
+    {
+        const char* Name;
+        std::function<void()> Function;
+    };
+
+    inline int RunTests(const std::vector<Test>& tests)
+    {
+        for (const Test& test : tests)
+        {
+            int failures = GetFailureCount();
+            try
+            {
+                test.Function();
+            }
+            catch (const std::exception& e)
+            {
+                std::cout << test.Name << ": unexpected exception: " << e.what() << std::endl;
+                ++GetFailureCount();
+            }
+            catch (...)
+            {
+                std::cout << test.Name << ": unexpected exception" << std::endl;
+                ++GetFailureCount();
+            }
+            std::cout << (GetFailureCount() == failures ? "passed " : "FAILED ") << test.Name << std::endl;
+        }
+        return GetFailureCount() == 0 ? 0 : 1;
+    }
+}
+
+#define CHECK(...) UnitTests::Check(static_cast<bool>(__VA_ARGS__), #__VA_ARGS__, __FILE__, __LINE__)
+#define CHECK_THROWS(exception, ...)                                                                                   \
+    UnitTests::Check(UnitTests::Throws<exception>(__VA_ARGS__), "throws " #exception, __FILE__, __LINE__)
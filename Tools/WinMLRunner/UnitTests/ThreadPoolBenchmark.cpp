@@ -0,0 +1,191 @@
+// Benchmark of the work stealing thread pool (see src/ThreadPool.h) against the single queue pool it replaced. Single
+// submissions (SubmitWork, which queues with Push) report the time the caller spends per submission and the task
+// throughput until every future is ready. Bulk submissions (ParallelFor with one index per task, which queues with
+// PushBulk) are compared with submitting as many tasks to the old pool and waiting for all of them.
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <vector>
+#include "ThreadPool.h"
+#include "Benchmark.h"
+
+// The previous ThreadPool design: one std::queue of std::function behind one mutex and one condition variable, with
+// std::bind and make_shared on every submission.
+class SingleQueueThreadPool
+{
+public:
+    SingleQueueThreadPool(unsigned int numThreads) : m_destructPool(false)
+    {
+        for (unsigned int i = 0; i < numThreads; i++)
+        {
+            m_threads.emplace_back([this]() {
+                while (true)
+                {
+                    std::unique_lock<std::mutex> lock(m_mutex);
+                    m_condVar.wait(lock, [this] { return m_destructPool || !m_workQueue.empty(); });
+                    if (m_workQueue.empty())
+                    {
+                        break;
+                    }
+                    auto work = m_workQueue.front();
+                    m_workQueue.pop();
+                    lock.unlock();
+                    work();
+                }
+            });
+        }
+    }
+
+    ~SingleQueueThreadPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_destructPool = true;
+        }
+        m_condVar.notify_all();
+        for (auto& thread : m_threads)
+        {
+            thread.join();
+        }
+    }
+
+    template <typename F, typename... Args>
+    auto SubmitWork(F&& f, Args&&... args) -> std::future<decltype(f(args...))>
+    {
+        auto func = std::bind(std::forward<F>(f), std::forward<Args>(args)...);
+        auto task = std::make_shared<std::packaged_task<decltype(f(args...))()>>(func);
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_workQueue.push([task]() { (*task)(); });
+        }
+        m_condVar.notify_one();
+        return task->get_future();
+    }
+
+private:
+    std::condition_variable m_condVar;
+    bool m_destructPool;
+    std::mutex m_mutex;
+    std::vector<std::thread> m_threads;
+    std::queue<std::function<void()>> m_workQueue;
+};
+
+struct SubmitResult
+{
+    double SubmitNanoseconds = 0; // caller time per submitted task
+    double TasksPerSecond = 0;    // from the first submission until all tasks are done
+};
+
+// Submits numTasks tasks one at a time and waits for their futures. The fastest of the repeats is kept for each of
+// the two numbers.
+template <typename Pool>
+static SubmitResult MeasureSubmit(unsigned int numThreads, size_t numTasks,
+                                  const Benchmarks::BenchmarkOptions& options)
+{
+    Pool pool(numThreads);
+    SubmitResult result;
+    std::vector<std::future<size_t>> futures;
+    futures.reserve(numTasks);
+    for (uint32_t repeat = 0; repeat < options.Repeats; repeat++)
+    {
+        futures.clear();
+        auto start = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < numTasks; ++i)
+        {
+            futures.push_back(pool.SubmitWork([i]() { return i; }));
+        }
+        auto submitted = std::chrono::steady_clock::now();
+        size_t total = 0;
+        for (auto& future : futures)
+        {
+            total += future.get();
+        }
+        auto finished = std::chrono::steady_clock::now();
+        Benchmarks::KeepValue(static_cast<double>(total));
+
+        double submitNanoseconds = std::chrono::duration<double, std::nano>(submitted - start).count() / numTasks;
+        double tasksPerSecond = numTasks / std::chrono::duration<double>(finished - start).count();
+        result.SubmitNanoseconds =
+            repeat == 0 ? submitNanoseconds : (std::min)(result.SubmitNanoseconds, submitNanoseconds);
+        result.TasksPerSecond = (std::max)(result.TasksPerSecond, tasksPerSecond);
+    }
+    return result;
+}
+
+// Seconds to run numTasks small tasks submitted as one batch
+static double MeasureBulk(SingleQueueThreadPool& pool, size_t numTasks, std::vector<float>& values,
+                          const Benchmarks::BenchmarkOptions& options)
+{
+    std::vector<std::future<void>> futures;
+    futures.reserve(numTasks);
+    return Benchmarks::MeasureSeconds(options, [&]() {
+        futures.clear();
+        for (size_t i = 0; i < numTasks; ++i)
+        {
+            futures.push_back(pool.SubmitWork([&values, i]() { values[i] = values[i] * 0.5f + 1.0f; }));
+        }
+        for (auto& future : futures)
+        {
+            future.get();
+        }
+    });
+}
+
+static double MeasureBulk(ThreadPool& pool, size_t numTasks, std::vector<float>& values,
+                          const Benchmarks::BenchmarkOptions& options)
+{
+    return Benchmarks::MeasureSeconds(options, [&]() {
+        pool.ParallelFor(0, numTasks, [&values](size_t i) { values[i] = values[i] * 0.5f + 1.0f; }, 1);
+    });
+}
+
+int main(int argc, char** argv)
+{
+    Benchmarks::BenchmarkOptions options;
+    int exitCode;
+    if (!Benchmarks::ParseOptions(argc, argv, options, exitCode))
+    {
+        return exitCode;
+    }
+
+    const size_t numTasks = Benchmarks::Scaled(200000, options);
+    std::vector<unsigned int> threadCounts = { 1, 4, (std::max)(1u, std::thread::hardware_concurrency()) };
+    std::sort(threadCounts.begin(), threadCounts.end());
+    threadCounts.erase(std::unique(threadCounts.begin(), threadCounts.end()), threadCounts.end());
+
+    std::cout << "SubmitWork (Push), " << numTasks << " tasks" << std::endl;
+    std::cout << std::left << std::setw(10) << "threads" << std::setw(22) << "single queue ns/task" << std::setw(22)
+              << "work stealing ns/task" << std::setw(22) << "single queue Mtask/s" << std::setw(22)
+              << "work stealing Mtask/s" << std::endl;
+    for (unsigned int numThreads : threadCounts)
+    {
+        SubmitResult single = MeasureSubmit<SingleQueueThreadPool>(numThreads, numTasks, options);
+        SubmitResult stealing = MeasureSubmit<ThreadPool>(numThreads, numTasks, options);
+        std::cout << std::left << std::fixed << std::setprecision(2) << std::setw(10) << numThreads << std::setw(22)
+                  << single.SubmitNanoseconds << std::setw(22) << stealing.SubmitNanoseconds << std::setw(22)
+                  << single.TasksPerSecond / 1e6 << std::setw(22) << stealing.TasksPerSecond / 1e6 << std::endl;
+    }
+
+    std::cout << std::endl << "Bulk submission (ParallelFor with PushBulk), " << numTasks << " tasks" << std::endl;
+    std::cout << std::left << std::setw(10) << "threads" << std::setw(22) << "single queue ns/task" << std::setw(22)
+              << "work stealing ns/task" << std::endl;
+    std::vector<float> values(numTasks, 1.0f);
+    for (unsigned int numThreads : threadCounts)
+    {
+        SingleQueueThreadPool singlePool(numThreads);
+        ThreadPool stealingPool(numThreads);
+        double single = MeasureBulk(singlePool, numTasks, values, options);
+        double stealing = MeasureBulk(stealingPool, numTasks, values, options);
+        std::cout << std::left << std::fixed << std::setprecision(2) << std::setw(10) << numThreads << std::setw(22)
+                  << single * 1e9 / numTasks << std::setw(22) << stealing * 1e9 / numTasks << std::endl;
+    }
+    return 0;
+}
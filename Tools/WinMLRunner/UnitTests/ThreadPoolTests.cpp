@@ -0,0 +1,140 @@
+// Tests of the work stealing thread pool (see src/ThreadPool.h).
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <future>
+#include <mutex>
+#include <set>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+#include "ThreadPool.h"
+#include "TestCheck.h"
+
+static int Add(int a, int b) { return a + b; }
+
+static void TestSubmitWork()
+{
+    ThreadPool pool(4);
+    CHECK(5 == pool.SubmitWork(Add, 2, 3).get());
+
+    std::wstring value = L"reference";
+    auto length = pool.SubmitWork([](const std::wstring& s) { return s.size(); }, std::ref(value));
+    CHECK(value.size() == length.get());
+
+    // Callables larger than the inline task storage are still supported
+    std::array<char, 256> large = {};
+    large[255] = 7;
+    CHECK(7 == static_cast<int>(pool.SubmitWork([large]() { return large[255]; }).get()));
+
+    auto failing = pool.SubmitWork([]() -> int { throw std::runtime_error("task failed"); });
+    CHECK_THROWS(std::runtime_error, [&failing]() { failing.get(); });
+}
+
+static void TestNestedSubmission()
+{
+    ThreadPool pool(3);
+    auto outer = pool.SubmitWork([&pool]() {
+        std::vector<std::future<int>> inner;
+        for (int i = 0; i < 100; ++i)
+        {
+            inner.push_back(pool.SubmitWork([i]() { return i; }));
+        }
+        int total = 0;
+        for (auto& future : inner)
+        {
+            // Run queued work while waiting, so that this cannot starve the pool of threads
+            while (future.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+            {
+                pool.RunPendingTask();
+            }
+            total += future.get();
+        }
+        return total;
+    });
+    CHECK(4950 == outer.get());
+}
+
+static void TestParallelFor()
+{
+    ThreadPool pool(4);
+    std::vector<int> visited(100000, 0);
+    pool.ParallelFor(0, visited.size(), [&visited](size_t i) { visited[i]++; });
+    CHECK(std::all_of(visited.begin(), visited.end(), [](int count) { return count == 1; }));
+
+    std::atomic<size_t> count(0);
+    pool.ParallelFor(10, 10, [&count](size_t) { count++; });
+    pool.ParallelFor(0, 7, [&count](size_t) { count++; }, 3);
+    CHECK(static_cast<size_t>(7) == count.load());
+
+    CHECK_THROWS(std::runtime_error, [&pool]() {
+        pool.ParallelFor(0, 1000, [](size_t i) {
+            if (i == 500)
+            {
+                throw std::runtime_error("body failed");
+            }
+        });
+    });
+}
+
+static void TestDestructorDrainsWork()
+{
+    std::atomic<int> completed(0);
+    {
+        ThreadPool pool(2);
+        for (int i = 0; i < 1000; ++i)
+        {
+            pool.SubmitWork([&completed]() { completed++; });
+        }
+    }
+    CHECK(1000 == completed.load());
+}
+
+// Without threads, queued work runs on the threads that call RunPendingTask or ParallelFor.
+static void TestPoolWithoutThreads()
+{
+    ThreadPool pool(0);
+    CHECK(pool.NumThreads() == 0);
+    CHECK(!pool.RunPendingTask());
+    auto sum = pool.SubmitWork(Add, 2, 3);
+    CHECK(sum.wait_for(std::chrono::seconds(0)) != std::future_status::ready);
+    CHECK(pool.RunPendingTask());
+    CHECK(5 == sum.get());
+    CHECK(!pool.RunPendingTask());
+
+    std::thread::id caller = std::this_thread::get_id();
+    std::vector<int> visited(1000, 0);
+    pool.ParallelFor(0, visited.size(), [&visited, caller](size_t i) {
+        visited[i] += std::this_thread::get_id() == caller ? 1 : 2;
+    });
+    CHECK(std::all_of(visited.begin(), visited.end(), [](int count) { return count == 1; }));
+}
+
+// The chunks of a ParallelFor are spread over the workers and the calling thread.
+static void TestParallelForUsesWorkers()
+{
+    ThreadPool pool(4);
+    std::mutex mutex;
+    std::set<std::thread::id> threads;
+    pool.ParallelFor(0, 64, [&mutex, &threads](size_t) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        std::lock_guard<std::mutex> lock(mutex);
+        threads.insert(std::this_thread::get_id());
+    }, 1);
+    CHECK(threads.size() > 1);
+}
+
+int main()
+{
+    return UnitTests::RunTests({
+        { "TestSubmitWork", TestSubmitWork },
+        { "TestNestedSubmission", TestNestedSubmission },
+        { "TestParallelFor", TestParallelFor },
+        { "TestDestructorDrainsWork", TestDestructorDrainsWork },
+        { "TestPoolWithoutThreads", TestPoolWithoutThreads },
+        { "TestParallelForUsesWorkers", TestParallelForUsesWorkers },
+    });
+}
@@ -0,0 +1,129 @@
+// Tests of the timeline trace (see src/TraceTimeline.h): spans and counters, recording from several threads and
+// merging the events of another process.
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <filesystem>
+#include <set>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include "TraceTimeline.h"
+#include "TestCheck.h"
+
+static double ReadNumber(const std::string& text, size_t from, const char* key)
+{
+    size_t position = text.find(key, from) + std::strlen(key);
+    return std::stod(text.substr(position, text.find_first_of(",}", position) - position));
+}
+
+static size_t CountLines(const std::string& text)
+{
+    return static_cast<size_t>(std::count(text.begin(), text.end(), '\n'));
+}
+
+static void TestDisabledRecordsNothing()
+{
+    TraceTimeline::Recorder recorder;
+    {
+        TraceTimeline::Scope scope("evaluate", "phase", recorder);
+        CHECK(!scope.IsRecording());
+    }
+    recorder.AddCounter("working set (MB)", 1);
+    CHECK(static_cast<size_t>(0) == recorder.GetEventCount());
+}
+
+static void TestNestedSpans()
+{
+    TraceTimeline::Recorder recorder;
+    recorder.Enable();
+    recorder.SetProcessName("WinMLRunner");
+    recorder.SetThreadName("main");
+    {
+        TraceTimeline::Scope iteration("iteration", "phase", recorder);
+        iteration.SetArgument("iteration", 3);
+        TraceTimeline::Scope file("read csv", "io", recorder);
+        file.SetDetail("C:\\data\\input \"1\".csv");
+    }
+    recorder.AddCounter("working set (MB)", 12.5);
+    CHECK(static_cast<size_t>(3) == recorder.GetEventCount());
+
+    std::ostringstream trace;
+    recorder.Write(trace);
+    std::string text = trace.str();
+    CHECK(static_cast<size_t>(0) == text.find("{\"traceEvents\":[\n"));
+    CHECK(text.find("\"name\":\"process_name\"") != std::string::npos);
+    CHECK(text.find("\"args\":{\"name\":\"main\"}") != std::string::npos);
+    CHECK(text.find("\"args\":{\"iteration\":3}") != std::string::npos);
+    CHECK(text.find("\"detail\":\"C:\\\\data\\\\input \\\"1\\\".csv\"") != std::string::npos);
+    CHECK(text.find("\"ph\":\"C\"") != std::string::npos);
+
+    // The inner span ends first, so it is recorded first, and lies within the outer one
+    size_t file = text.find("\"name\":\"read csv\"");
+    size_t iteration = text.find("\"name\":\"iteration\"");
+    CHECK(file < iteration);
+    double fileStart = ReadNumber(text, file, "\"ts\":");
+    double fileDuration = ReadNumber(text, file, "\"dur\":");
+    double iterationStart = ReadNumber(text, iteration, "\"ts\":");
+    double iterationDuration = ReadNumber(text, iteration, "\"dur\":");
+    CHECK(iterationStart <= fileStart);
+    CHECK(fileStart + fileDuration <= iterationStart + iterationDuration);
+}
+
+static void TestThreadsAndMerge()
+{
+    TraceTimeline::Recorder recorder;
+    recorder.Enable();
+    std::vector<std::thread> threads;
+    for (int thread = 0; thread < 4; ++thread)
+    {
+        threads.emplace_back([&recorder, thread]() {
+            recorder.SetThreadName("worker " + std::to_string(thread));
+            for (int i = 0; i < 1000; ++i)
+            {
+                TraceTimeline::Scope scope("evaluate", "phase", recorder);
+            }
+        });
+    }
+    for (auto& thread : threads)
+    {
+        thread.join();
+    }
+    CHECK(static_cast<size_t>(4000) == recorder.GetEventCount());
+
+    std::wstring path = (std::filesystem::temp_directory_path() / L"TraceTimelineTest.json").wstring();
+    recorder.WriteToFile(path);
+    std::vector<std::string> events = TraceTimeline::ReadTraceEvents(path);
+    std::filesystem::remove(path);
+    // One thread name per worker and its spans
+    CHECK(static_cast<size_t>(4004) == events.size());
+    std::set<std::string> threadIds;
+    for (const auto& event : events)
+    {
+        CHECK(event.front() == '{' && event.back() == '}');
+        size_t tid = event.find("\"tid\":");
+        threadIds.insert(event.substr(tid, event.find_first_of(",}", tid) - tid));
+    }
+    CHECK(static_cast<size_t>(4) == threadIds.size());
+
+    // The events of another process are written with this one's
+    TraceTimeline::Recorder merged;
+    merged.Enable();
+    merged.AddExternalEvents(events);
+    {
+        TraceTimeline::Scope scope("job", "sweep", merged);
+    }
+    std::ostringstream trace;
+    merged.Write(trace);
+    CHECK(static_cast<size_t>(4005) == CountLines(trace.str()) - 2);
+}
+
+int main()
+{
+    return UnitTests::RunTests({
+        { "TestDisabledRecordsNothing", TestDisabledRecordsNothing },
+        { "TestNestedSpans", TestNestedSpans },
+        { "TestThreadsAndMerge", TestThreadsAndMerge },
+    });
+}
@@ -0,0 +1,117 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <stdexcept>
+#include <vector>
+#include "LatencyHistogram.h"
+
+// Batch packing and the batch size sweep of the batched evaluation mode. Nothing in here depends on WinML, the
+// evaluator is supplied by the caller, so it can be driven by a stub evaluator in tests.
+
+// Called once per batch size before that batch size is timed. Creates the state the evaluation needs (e.g. a binding
+// with batchSize samples packed into each input) and returns the callable that evaluates one batch.
+typedef std::function<std::function<void()>(uint32_t batchSize)> BatchEvaluatorFactory;
+
+struct BatchResult
+{
+    uint32_t BatchSize = 0;
+    uint64_t NumBatches = 0;
+    double WallTime = 0;          // in milliseconds, over all timed batches
+    double SamplesPerSecond = 0;
+    double ThroughputGain = 0;    // SamplesPerSecond / SamplesPerSecond of the previous batch size, 0 for the first
+    LatencyHistogram BatchLatency;  // per batch latency in milliseconds
+    LatencyHistogram SampleLatency; // per batch latency divided by the batch size, in milliseconds
+};
+
+// Copies batchSize samples of bytesPerSample bytes each into batch, one after the other. Slot i of the batch takes
+// samples[i % samples.size()], so a batch larger than the number of distinct samples repeats them in order.
+inline void PackBatch(const std::vector<const void*>& samples, size_t bytesPerSample, uint32_t batchSize, void* batch)
+{
+    if (samples.empty())
+    {
+        throw std::invalid_argument("PackBatch: no samples to pack");
+    }
+    uint8_t* destination = static_cast<uint8_t*>(batch);
+    for (uint32_t i = 0; i < batchSize; ++i)
+    {
+        std::memcpy(destination + i * bytesPerSample, samples[i % samples.size()], bytesPerSample);
+    }
+}
+
+// Batch sizes to sweep when scaling from 1 to maxBatchSize: powers of two, plus maxBatchSize itself.
+inline std::vector<uint32_t> GetBatchSizeSweep(uint32_t maxBatchSize)
+{
+    std::vector<uint32_t> batchSizes;
+    for (uint32_t batchSize = 1; batchSize < maxBatchSize; batchSize *= 2)
+    {
+        batchSizes.push_back(batchSize);
+    }
+    if (maxBatchSize > 0)
+    {
+        batchSizes.push_back(maxBatchSize);
+    }
+    return batchSizes;
+}
+
+// Evaluates numBatches batches of batchSize samples after warmupBatches untimed ones.
+inline BatchResult RunBatchEvaluation(uint32_t batchSize, uint32_t numBatches, uint32_t warmupBatches,
+                                      const BatchEvaluatorFactory& factory)
+{
+    BatchResult result;
+    result.BatchSize = batchSize;
+    std::function<void()> evaluate = factory(batchSize);
+    for (uint32_t i = 0; i < warmupBatches; ++i)
+    {
+        evaluate();
+    }
+    for (uint32_t i = 0; i < numBatches; ++i)
+    {
+        auto evaluateStart = std::chrono::steady_clock::now();
+        evaluate();
+        double latency =
+            std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - evaluateStart).count();
+        result.BatchLatency.Record(latency);
+        result.SampleLatency.Record(latency / batchSize);
+    }
+    result.NumBatches = result.BatchLatency.GetCount();
+    result.WallTime = result.BatchLatency.GetTotal();
+    result.SamplesPerSecond =
+        result.WallTime > 0 ? static_cast<double>(result.NumBatches) * batchSize * 1000.0 / result.WallTime : 0;
+    return result;
+}
+
+// Runs RunBatchEvaluation once per entry of batchSizes and fills in the throughput gain of each batch size over the
+// previous one.
+inline std::vector<BatchResult> RunBatchSweep(const std::vector<uint32_t>& batchSizes, uint32_t numBatches,
+                                              uint32_t warmupBatches, const BatchEvaluatorFactory& factory)
+{
+    std::vector<BatchResult> results;
+    for (uint32_t batchSize : batchSizes)
+    {
+        results.push_back(RunBatchEvaluation(batchSize, numBatches, warmupBatches, factory));
+        if (results.size() > 1 && results[results.size() - 2].SamplesPerSecond > 0)
+        {
+            results.back().ThroughputGain =
+                results.back().SamplesPerSecond / results[results.size() - 2].SamplesPerSecond;
+        }
+    }
+    return results;
+}
+
+// Index of the throughput knee of a sweep: the first batch size after which growing the batch raises throughput by
+// less than minimumGain (1.1 = 10%). Past the knee a larger batch mostly adds latency. Returns the last index if
+// throughput keeps growing, and 0 for an empty sweep.
+inline size_t FindThroughputKnee(const std::vector<BatchResult>& results, double minimumGain = 1.1)
+{
+    for (size_t i = 0; i + 1 < results.size(); ++i)
+    {
+        if (results[i + 1].ThroughputGain < minimumGain)
+        {
+            return i;
+        }
+    }
+    return results.empty() ? 0 : results.size() - 1;
+}
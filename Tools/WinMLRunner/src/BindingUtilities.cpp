@@ -1,5 +1,6 @@
 #include "d3dx12.h"
 #include <random>
+#include <limits>
 #include <time.h>
 #ifdef USE_WINML_NUGET
 #include "Microsoft.AI.Machinelearning.Native.h"
@@ -11,6 +12,12 @@
 #include "CommandLineArgs.h"
 #include "OutputHelper.h"
 #include "BindingUtilities.h"
+#include "TensorizeKernels.h"
+#include "CsvReader.h"
+#include "TensorFile.h"
+#include "BatchEvaluation.h"
+#include "TensorCache.h"
+#include "TraceTimeline.h"
 using namespace winrt::Windows::Media;
 using namespace winrt::Windows::Storage;
 using namespace winrt::Windows::Storage::Streams;
@@ -267,6 +274,64 @@ namespace BindingUtilities
                                                     static_cast<int32_t>(width), static_cast<int32_t>(height));
     }
 
+    // Holds the decoded and the tensorized input images of every iteration, session and model, so that each image is
+    // only converted once per settings. Null with -TensorCacheSize 0.
+    static TensorCache::TensorCache* GetTensorCache(const CommandLineArgs& args)
+    {
+        static std::unique_ptr<TensorCache::TensorCache> tensorCache =
+            args.TensorCacheSize() == 0
+                ? nullptr
+                : std::make_unique<TensorCache::TensorCache>(static_cast<size_t>(args.TensorCacheSize()) * 1024 * 1024,
+                                                             args.TensorCacheDirectory());
+        return tensorCache.get();
+    }
+
+    // Keys an input image by its file and everything that decides its decoded pixels. Returns false if the file
+    // cannot be found.
+    static bool MakeImageCacheKey(const char* kind, const std::wstring& imagePath, const std::vector<int64_t>& shape,
+                                  InputDataType inputDataType, const CommandLineArgs& args,
+                                  ColorManagementMode colorManagementMode, TensorCache::CacheKey& key)
+    {
+        key.Kind = kind;
+        key.Path = imagePath;
+        key.Shape = shape;
+        key.PixelFormat = static_cast<int32_t>(inputDataType);
+        key.Interpolation = args.IsAutoScale() ? static_cast<int32_t>(args.AutoScaleInterpMode()) : -1;
+        key.ColorManagement = static_cast<int32_t>(colorManagementMode);
+        return TensorCache::StampFile(key);
+    }
+
+    // Bitmaps are cached as their pixels, with the pixel format in the low and the alpha mode in the high 16 bits of
+    // the format.
+    static void InsertCachedBitmap(TensorCache::TensorCache& tensorCache, const TensorCache::CacheKey& key,
+                                   const SoftwareBitmap& softwareBitmap)
+    {
+        const BitmapBuffer bitmapBuffer(softwareBitmap.LockBuffer(BitmapBufferAccessMode::Read));
+        winrt::Windows::Foundation::IMemoryBufferReference reference = bitmapBuffer.CreateReference();
+        auto byteAccess = reference.as<::Windows::Foundation::IMemoryBufferByteAccess>();
+        uint8_t* pixels = nullptr;
+        uint32_t size = 0;
+        winrt::check_hresult(byteAccess->GetBuffer(&pixels, &size));
+        uint32_t format = static_cast<uint32_t>(softwareBitmap.BitmapPixelFormat()) |
+                          static_cast<uint32_t>(softwareBitmap.BitmapAlphaMode()) << 16;
+        tensorCache.Insert(key, TensorFile::ElementType::UInt8,
+                           { softwareBitmap.PixelHeight(), softwareBitmap.PixelWidth() }, format, pixels, size);
+    }
+
+    static SoftwareBitmap CreateCachedBitmap(const TensorCache::CachedTensor& cachedBitmap)
+    {
+        winrt::array_view<const uint8_t> dataView(cachedBitmap.Data, cachedBitmap.Data + cachedBitmap.SizeInBytes);
+        InMemoryRandomAccessStream dataStream;
+        DataWriter dataWriter(dataStream);
+        dataWriter.WriteBytes(dataView);
+        IBuffer buffer = dataWriter.DetachBuffer();
+        return SoftwareBitmap::CreateCopyFromBuffer(buffer,
+                                                    static_cast<BitmapPixelFormat>(cachedBitmap.Format & 0xffff),
+                                                    static_cast<int32_t>(cachedBitmap.Shape[1]),
+                                                    static_cast<int32_t>(cachedBitmap.Shape[0]),
+                                                    static_cast<BitmapAlphaMode>(cachedBitmap.Format >> 16));
+    }
+
     SoftwareBitmap LoadImageFile(const ILearningModelFeatureDescriptor& modelFeatureDescriptor,
                                  const InputDataType inputDataType, const hstring& filePath,
                                  const CommandLineArgs& args, uint32_t iterationNum,
@@ -276,10 +341,31 @@ namespace BindingUtilities
         uint64_t width = 0;
         uint64_t height = 0;
         GetHeightAndWidthFromLearningModelFeatureDescriptor(modelFeatureDescriptor, width, height);
+
+        TensorCache::TensorCache* tensorCache = GetTensorCache(args);
+        TensorCache::CacheKey cacheKey;
+        bool isCacheable = tensorCache != nullptr &&
+                           MakeImageCacheKey("bitmap", filePath.c_str(),
+                                             { static_cast<int64_t>(height), static_cast<int64_t>(width) },
+                                             inputDataType, args, colorManagementMode, cacheKey);
+        if (isCacheable)
+        {
+            auto cachedBitmap = tensorCache->Find(cacheKey);
+            if (cachedBitmap)
+            {
+                return CreateCachedBitmap(*cachedBitmap);
+            }
+        }
+
         IRandomAccessStream stream;
         BitmapDecoder decoder = NULL;
         try
         {
+            TraceTimeline::Scope scope("open image", "io");
+            if (scope.IsRecording())
+            {
+                scope.SetDetail(to_string(filePath));
+            }
             // open the file
             StorageFile file = StorageFile::GetFileFromPathAsync(filePath).get();
             // get a stream on it
@@ -296,6 +382,7 @@ namespace BindingUtilities
         BitmapPixelFormat format = inputDataType == InputDataType::Tensor
                                        ? decoder.BitmapPixelFormat()
                                        : TypeHelper::GetBitmapPixelFormat(inputDataType);
+        SoftwareBitmap softwareBitmap(nullptr);
         try
         {
             // If input dimensions are different from tensor input, then scale / crop while reading
@@ -312,7 +399,8 @@ namespace BindingUtilities
                 transform.InterpolationMode(args.AutoScaleInterpMode());
 
                 // get the bitmap
-                return decoder
+                TraceTimeline::Scope scope("decode and resize image", "input");
+                softwareBitmap = decoder
                     .GetSoftwareBitmapAsync(format, decoder.BitmapAlphaMode(), transform,
                                             ExifOrientationMode::RespectExifOrientation, colorManagementMode)
                     .get();
@@ -320,7 +408,8 @@ namespace BindingUtilities
             else
             {
                 // get the bitmap
-                return decoder
+                TraceTimeline::Scope scope("decode image", "input");
+                softwareBitmap = decoder
                     .GetSoftwareBitmapAsync(format, decoder.BitmapAlphaMode(), BitmapTransform(),
                                             ExifOrientationMode::RespectExifOrientation, colorManagementMode)
                     .get();
@@ -333,6 +422,12 @@ namespace BindingUtilities
             printf("    %ws\n", hr.message().c_str());
             exit(hr.code());
         }
+
+        if (isCacheable)
+        {
+            InsertCachedBitmap(*tensorCache, cacheKey, softwareBitmap);
+        }
+        return softwareBitmap;
     }
 
     VideoFrame CreateVideoFrame(const SoftwareBitmap& softwareBitmap, InputBindingType inputBindingType,
@@ -351,6 +446,7 @@ namespace BindingUtilities
                                                                   softwareBitmap.PixelWidth(),
                                                                   softwareBitmap.PixelHeight());
 
+            TraceTimeline::Scope scope("copy image to GPU", "input");
             inputImage.CopyToAsync(gpuImage).get();
 
             return gpuImage;
@@ -368,44 +464,143 @@ namespace BindingUtilities
         bool isPlanar;
         TensorKind channelFormat;
         BitmapPixelFormat elementFormat;
+        bool isTensorized; // elements are the cached tensor itself, in the element type of the model
+        const TensorCache::CacheKey* cacheKey; // where to cache the tensor made from elements, or null
 
         InputBufferDesc()
             : elements(nullptr), totalSizeInBytes(0), numChannelsPerElement(0), elementStrideInBytes(0), isPlanar(0),
-              channelFormat(TensorKind::Undefined), elementFormat(BitmapPixelFormat::Unknown)
+              channelFormat(TensorKind::Undefined), elementFormat(BitmapPixelFormat::Unknown), isTensorized(false),
+              cacheKey(nullptr)
         {
         }
     };
 
-    void ReadCSVIntoBuffer(const std::wstring& csvFilePath, InputBufferDesc& inputBufferDesc)
+    // Shared by every tensorization and CSV parse so that large inputs are split over the cores without starting
+    // threads per call. The calling thread takes part in the work too, so one worker fewer than the number of cores is
+    // enough.
+    static ThreadPool& GetBindingThreadPool()
     {
-        std::ifstream fileStream;
-        fileStream.open(csvFilePath);
-        if (!fileStream.is_open())
+        static ThreadPool threadPool((std::max)(std::thread::hardware_concurrency(), 2u) - 1);
+        return threadPool;
+    }
+
+    // Parsed files are cached by path, so every iteration binds the same values without reading the file again.
+    std::shared_ptr<const CsvReader::CsvData> ReadCSVFile(const std::wstring& csvFilePath)
+    {
+        try
+        {
+            TraceTimeline::Scope scope("read csv", "io");
+            if (scope.IsRecording())
+            {
+                scope.SetDetail(to_string(csvFilePath));
+            }
+            return CsvReader::LoadCsvFile(csvFilePath, &GetBindingThreadPool());
+        }
+        catch (const std::runtime_error&)
         {
             ThrowFailure(L"BindingUtilities: could not open data file.");
         }
+        catch (const std::invalid_argument& e)
+        {
+            throw hresult_invalid_argument(L"BindingUtilities: " + to_hstring(e.what()));
+        }
+        return nullptr;
+    }
 
-        uint32_t pos = 0;
-        std::string line;
-        float_t* pData = (float_t*)inputBufferDesc.elements;
-        uint32_t expectedPos = (inputBufferDesc.totalSizeInBytes * inputBufferDesc.numChannelsPerElement) /
-                               inputBufferDesc.elementStrideInBytes;
-        while (std::getline(fileStream, line, ','))
+    std::shared_ptr<const TensorFile::TensorFileContents> ReadTensorFile(const std::wstring& tensorFilePath)
+    {
+        try
         {
-            if (pos > expectedPos)
-                throw hresult_invalid_argument(L"Too many elements in CSV file to fit in input of what model expects!");
-            *pData = std::stof(line);
-            ++pData;
+            TraceTimeline::Scope scope("read tensor file", "io");
+            if (scope.IsRecording())
+            {
+                scope.SetDetail(to_string(tensorFilePath));
+            }
+            return TensorFile::LoadTensorFile(tensorFilePath);
+        }
+        catch (const std::runtime_error&)
+        {
+            ThrowFailure(L"BindingUtilities: could not open data file.");
+        }
+        catch (const std::invalid_argument& e)
+        {
+            throw hresult_invalid_argument(L"BindingUtilities: " + to_hstring(e.what()));
+        }
+        return nullptr;
+    }
 
-            ++pos;
-            if (pos >= inputBufferDesc.totalSizeInBytes)
-                break;
+    // The size of a tensor as the 32 bit size of an InputBufferDesc
+    static uint32_t GetInputBufferSize(size_t sizeInBytes)
+    {
+        if (sizeInBytes > (std::numeric_limits<uint32_t>::max)())
+        {
+            throw hresult_invalid_argument(L"BindingUtilities: input tensors of 4 GB or more are not supported");
         }
+        return static_cast<uint32_t>(sizeInBytes);
+    }
 
-        // Check to see if csv didn't fill in entire buffer and throw or fill with zeros?
-        if (pos != expectedPos)
+    TensorKind ElementTypeToTensorKind(TensorFile::ElementType elementType)
+    {
+        switch (elementType)
         {
-            throw hresult_invalid_argument(L"CSV input size/shape is different from what model expects!");
+            case TensorFile::ElementType::Float32:
+                return TensorKind::Float;
+            case TensorFile::ElementType::Float16:
+                return TensorKind::Float16;
+            case TensorFile::ElementType::Float64:
+                return TensorKind::Double;
+            case TensorFile::ElementType::Int8:
+                return TensorKind::Int8;
+            case TensorFile::ElementType::UInt8:
+                return TensorKind::UInt8;
+            case TensorFile::ElementType::Int16:
+                return TensorKind::Int16;
+            case TensorFile::ElementType::UInt16:
+                return TensorKind::UInt16;
+            case TensorFile::ElementType::Int32:
+                return TensorKind::Int32;
+            case TensorFile::ElementType::UInt32:
+                return TensorKind::UInt32;
+            case TensorFile::ElementType::Int64:
+                return TensorKind::Int64;
+            case TensorFile::ElementType::UInt64:
+                return TensorKind::UInt64;
+            case TensorFile::ElementType::Bool:
+                return TensorKind::Boolean;
+        }
+        return TensorKind::Undefined;
+    }
+
+    TensorFile::ElementType TensorKindToElementType(TensorKind tensorKind)
+    {
+        switch (tensorKind)
+        {
+            case TensorKind::Float:
+                return TensorFile::ElementType::Float32;
+            case TensorKind::Float16:
+                return TensorFile::ElementType::Float16;
+            case TensorKind::Double:
+                return TensorFile::ElementType::Float64;
+            case TensorKind::Int8:
+                return TensorFile::ElementType::Int8;
+            case TensorKind::UInt8:
+                return TensorFile::ElementType::UInt8;
+            case TensorKind::Int16:
+                return TensorFile::ElementType::Int16;
+            case TensorKind::UInt16:
+                return TensorFile::ElementType::UInt16;
+            case TensorKind::Int32:
+                return TensorFile::ElementType::Int32;
+            case TensorKind::UInt32:
+                return TensorFile::ElementType::UInt32;
+            case TensorKind::Int64:
+                return TensorFile::ElementType::Int64;
+            case TensorKind::UInt64:
+                return TensorFile::ElementType::UInt64;
+            case TensorKind::Boolean:
+                return TensorFile::ElementType::Bool;
+            default:
+                throw hresult_not_implemented(L"BindingUtilities: tensor kind is not supported for tensor file input.");
         }
     }
 
@@ -416,21 +611,16 @@ namespace BindingUtilities
                               const std::vector<float>& stddevs)
     {
         using WriteType = typename TensorKindToPointerType<TKind>::Type;
-
-        WriteType* pDataOut = static_cast<WriteType*>(actualData);
-        InputType* pDataIn = (InputType*)inputBufferDesc.elements;
-        uint32_t elementOffsetMultiplier = inputBufferDesc.isPlanar ? inputBufferDesc.numChannelsPerElement : 1;
-        uint32_t channelOffsetMultiplier = inputBufferDesc.isPlanar ? 1 : tensorHeight * tensorWidth;
-        for (uint32_t element = 0; element < tensorHeight * tensorWidth; ++element)
-        {
-            for (uint32_t channel = 0; channel < inputBufferDesc.numChannelsPerElement; ++channel)
-            {
-                pDataOut[element * elementOffsetMultiplier + channel * channelOffsetMultiplier] =
-                    ConvertToPointerType<TKind, WriteType>(((pDataIn[channel] / scale) - means[channel]) /
-                                                           stddevs[channel]);
-            }
-            pDataIn += inputBufferDesc.elementStrideInBytes / sizeof(InputType);
-        }
+        TraceTimeline::Scope scope("tensorize", "input");
+
+        // Image buffers hold interleaved pixels that are written out planar (NCHW). CSV buffers are already laid out
+        // like the tensor and are copied in order.
+        TensorizeKernels::Tensorize(
+            reinterpret_cast<const InputType*>(inputBufferDesc.elements),
+            inputBufferDesc.elementStrideInBytes / sizeof(InputType), inputBufferDesc.numChannelsPerElement,
+            tensorHeight, tensorWidth, !inputBufferDesc.isPlanar, static_cast<WriteType*>(actualData),
+            TensorizeKernels::ComputeNormalizeConstants(scale, means, stddevs),
+            [](float value) { return ConvertToPointerType<TKind, WriteType>(value); }, &GetBindingThreadPool());
     }
 
     template <TensorKind TKind, typename WriteType>
@@ -466,11 +656,19 @@ namespace BindingUtilities
         uint32_t actualSizeInBytes;
         THROW_IF_FAILED(spTensorValueNative->GetBuffer(reinterpret_cast<BYTE**>(&actualData), &actualSizeInBytes));
 
-        if (args.IsCSVInput() || args.IsImageInput())
+        if (inputBufferDesc.isTensorized)
         {
-            // Assumes NCHW
+            if (inputBufferDesc.totalSizeInBytes != actualSizeInBytes)
+            {
+                throw hresult_invalid_argument(L"Cached input size is different from what the model expects");
+            }
+            memcpy(actualData, inputBufferDesc.elements, actualSizeInBytes);
+        }
+        else if (args.IsCSVInput() || args.IsImageInput())
+        {
+            // Assumes NCHW, with the items of a batch stacked along the rows
             uint32_t channels = static_cast<uint32_t>(tensorShape[1]);
-            uint32_t tensorHeight = static_cast<uint32_t>(tensorShape[2]);
+            uint32_t tensorHeight = static_cast<uint32_t>(tensorShape[0] * tensorShape[2]);
             uint32_t tensorWidth = static_cast<uint32_t>(tensorShape[3]);
 
             // Check to make sure the sizes are right
@@ -536,6 +734,10 @@ namespace BindingUtilities
                     CopyTensorFromBuffer<TKind, uint8_t>(actualData, tensorHeight, tensorWidth, inputBufferDesc, scale,
                                                          means, stddevs);
                     break;
+                case TensorKind::UInt16:
+                    CopyTensorFromBuffer<TKind, uint16_t>(actualData, tensorHeight, tensorWidth, inputBufferDesc,
+                                                          scale, means, stddevs);
+                    break;
                 case TensorKind::Float:
                     CopyTensorFromBuffer<TKind, float>(actualData, tensorHeight, tensorWidth, inputBufferDesc, scale,
                                                        means, stddevs);
@@ -543,6 +745,20 @@ namespace BindingUtilities
                 default:
                     throw hresult_not_implemented(L"Creating Tensors for Input Images with unhandled channel format!");
             }
+
+            // Cached before the GPU upload below, so the cache always holds the CPU values
+            if (inputBufferDesc.cacheKey != nullptr)
+            {
+                GetTensorCache(args)->Insert(*inputBufferDesc.cacheKey, TensorKindToElementType(TKind), tensorShape, 0,
+                                             actualData, actualSizeInBytes);
+            }
+        }
+        else if (args.IsTensorFileInput())
+        {
+            // Same layout as the model, so only the element type may need converting
+            TensorFile::ConvertElements(inputBufferDesc.elements,
+                                        TensorKindToElementType(inputBufferDesc.channelFormat), actualData,
+                                        TensorKindToElementType(TKind), actualSizeInBytes / sizeof(WriteType));
         }
         // Garbage Data
         else if (args.IsGarbageDataRange())
@@ -734,6 +950,30 @@ namespace BindingUtilities
         throw hresult_invalid_argument(L"ProcessDescriptor: Unknown desription type!");
     } // namespace BindingUtilities
 
+    // Looks up the tensor made from an input image with the same file, shape, element type and tensorize settings by an
+    // earlier call. key is left empty when the tensor cannot be cached.
+    static bool FindCachedTensor(const std::wstring& imagePath, const std::vector<int64_t>& shape,
+                                 TensorKind tensorKind, InputDataType inputDataType, const CommandLineArgs& args,
+                                 ColorManagementMode colorManagementMode, TensorCache::CacheKey& key,
+                                 std::shared_ptr<const TensorCache::CachedTensor>& cachedTensor)
+    {
+        TensorCache::TensorCache* tensorCache = GetTensorCache(args);
+        if (tensorCache == nullptr || tensorKind == TensorKind::Undefined || tensorKind == TensorKind::String ||
+            !MakeImageCacheKey("tensor", imagePath, shape, inputDataType, args, colorManagementMode, key))
+        {
+            key = {};
+            return false;
+        }
+        const auto& tensorizeArgs = args.TensorizeArgs();
+        key.DataType = TensorTrace::GetDataType(TensorKindToElementType(tensorKind));
+        key.TensorizeFunction = static_cast<int32_t>(tensorizeArgs.Func);
+        key.Scale = tensorizeArgs.Normalize.Scale;
+        key.Means = tensorizeArgs.Normalize.Means;
+        key.StdDevs = tensorizeArgs.Normalize.StdDevs;
+        cachedTensor = tensorCache->Find(key);
+        return cachedTensor != nullptr;
+    }
+
     // Binds tensor floats, ints, doubles from CSV data.
     ITensor CreateBindableTensor(const ILearningModelFeatureDescriptor& description, const std::wstring& imagePath,
                                  const InputBindingType inputBindingType, const InputDataType inputDataType,
@@ -747,12 +987,27 @@ namespace BindingUtilities
         ProcessDescriptor(description, shape, tensorKind, inputBufferDesc);
 
         SoftwareBitmap softwareBitmap(nullptr);
+        TensorCache::CacheKey tensorCacheKey;
+        std::shared_ptr<const TensorCache::CachedTensor> cachedTensor;
         if (args.IsCSVInput())
         {
-            inputBufferDesc.channelFormat = TensorKind::Float;
-            inputBufferDesc.isPlanar = true;
+            auto csvData = ReadCSVFile(args.CsvPath());
 
             // Assumes shape is in the format of 'NCHW'
+            size_t valuesPerBatch = 1;
+            for (uint32_t i = 1; i < shape.size(); ++i)
+                valuesPerBatch *= static_cast<size_t>(shape[i]);
+
+            // A file with one row per batch item fills a free batch dimension
+            auto tensorDescriptor = description.try_as<TensorFeatureDescriptor>();
+            if (tensorDescriptor && tensorDescriptor.Shape().Size() > 0 && tensorDescriptor.Shape().GetAt(0) == -1 &&
+                csvData->RowSizes.size() > 1 && csvData->GetUniformRowSize() == valuesPerBatch)
+            {
+                shape[0] = static_cast<int64_t>(csvData->RowSizes.size());
+            }
+
+            inputBufferDesc.channelFormat = TensorKind::Float;
+            inputBufferDesc.isPlanar = true;
             inputBufferDesc.numChannelsPerElement = static_cast<uint32_t>(shape[1]);
 
             // Assumes no gaps in the input csv file
@@ -762,14 +1017,62 @@ namespace BindingUtilities
             for (uint32_t i = 0; i < shape.size(); ++i)
                 inputBufferDesc.totalSizeInBytes *= static_cast<uint32_t>(shape[i]);
 
-            inputBufferDesc.elements = new uint8_t[inputBufferDesc.totalSizeInBytes];
+            if (csvData->Values.size() * sizeof(float_t) != inputBufferDesc.totalSizeInBytes)
+            {
+                throw hresult_invalid_argument(L"CSV input size/shape is different from what model expects!");
+            }
+
+            // The tensor is filled straight from the cached values, which are only read
+            inputBufferDesc.elements = reinterpret_cast<uint8_t*>(const_cast<float*>(csvData->Values.data()));
+        }
+        else if (args.IsTensorFileInput())
+        {
+            auto tensorFile = ReadTensorFile(args.TensorFilePath());
+            const TensorFile::TensorData* tensorData = tensorFile->FindArray(to_string(description.Name()));
+            if (tensorData == nullptr)
+            {
+                throw hresult_invalid_argument(L"Tensor file has no array for input " + description.Name());
+            }
+
+            // Free dimensions of the model take their size from the file
+            auto tensorDescriptor = description.try_as<TensorFeatureDescriptor>();
+            if (tensorDescriptor && tensorDescriptor.Shape().Size() == tensorData->Shape.size())
+            {
+                for (uint32_t i = 0; i < shape.size(); ++i)
+                {
+                    if (tensorDescriptor.Shape().GetAt(i) == -1)
+                    {
+                        shape[i] = tensorData->Shape[i];
+                    }
+                }
+            }
+
+            size_t elementCount = 1;
+            for (uint32_t i = 0; i < shape.size(); ++i)
+                elementCount *= static_cast<size_t>(shape[i]);
+            if (tensorData->GetElementCount() != elementCount)
+            {
+                throw hresult_invalid_argument(L"Tensor file input size/shape is different from what model expects!");
+            }
 
-            ReadCSVIntoBuffer(args.CsvPath(), inputBufferDesc);
+            // The tensor is filled straight from the mapped file, which is only read
+            inputBufferDesc.elements = const_cast<uint8_t*>(tensorData->Data);
+            inputBufferDesc.totalSizeInBytes = GetInputBufferSize(tensorData->SizeInBytes);
+            inputBufferDesc.channelFormat = ElementTypeToTensorKind(tensorData->Type);
+        }
+        else if (args.IsImageInput() && FindCachedTensor(imagePath, shape, tensorKind, inputDataType, args,
+                                                         colorManagementMode, tensorCacheKey, cachedTensor))
+        {
+            // Neither decoded nor tensorized again, the tensor is filled straight from the cache
+            inputBufferDesc.elements = const_cast<uint8_t*>(cachedTensor->Data);
+            inputBufferDesc.totalSizeInBytes = GetInputBufferSize(cachedTensor->SizeInBytes);
+            inputBufferDesc.isTensorized = true;
         }
         else if (args.IsImageInput())
         {
             softwareBitmap =
                 LoadImageFile(description, inputDataType, imagePath.c_str(), args, iterationNum, colorManagementMode);
+            inputBufferDesc.cacheKey = tensorCacheKey.Kind.empty() ? nullptr : &tensorCacheKey;
 
             // Get Pointers to the SoftwareBitmap data buffers
             const BitmapBuffer sbBitmapBuffer(softwareBitmap.LockBuffer(BitmapBufferAccessMode::Read));
@@ -883,6 +1186,115 @@ namespace BindingUtilities
         throw hresult_not_implemented();
     }
 
+    template <TensorKind TKind>
+    static ITensor CreatePackedTensor(const std::vector<int64_t>& shape, const std::vector<const void*>& samples,
+                                      size_t bytesPerSample, uint32_t batchSize)
+    {
+        using TensorValue = typename TensorKindToValue<TKind>::Type;
+        auto tensorValue = TensorValue::Create(shape);
+
+        com_ptr<ITensorNative> spTensorValueNative;
+        tensorValue.as(spTensorValueNative);
+        BYTE* actualData;
+        uint32_t actualSizeInBytes;
+        THROW_IF_FAILED(spTensorValueNative->GetBuffer(&actualData, &actualSizeInBytes));
+        if (actualSizeInBytes != bytesPerSample * batchSize)
+        {
+            throw hresult_invalid_argument(L"Batched input size is different from what the model expects");
+        }
+        PackBatch(samples, bytesPerSample, batchSize, actualData);
+        return tensorValue;
+    }
+
+    // Packs batchSize samples into one CPU tensor along its free batch dimension. The samples are the input images,
+    // or the items of the CSV or tensor file (one per row / per index of the first dimension), or one garbage sample.
+    // They are repeated in order when there are fewer samples than the batch size.
+    ITensor CreateBatchedTensor(const ILearningModelFeatureDescriptor& description,
+                                const std::vector<std::wstring>& imagePaths, uint32_t batchSize,
+                                const CommandLineArgs& args, ColorManagementMode colorManagementMode)
+    {
+        auto tensorDescriptor = description.try_as<TensorFeatureDescriptor>();
+        if (!tensorDescriptor || tensorDescriptor.Shape().Size() == 0 || tensorDescriptor.Shape().GetAt(0) != -1)
+        {
+            throw hresult_invalid_argument(L"Batched evaluation needs a free batch dimension on input " +
+                                           description.Name());
+        }
+
+        // Tensorize every sample once with the single input path
+        std::vector<ITensor> sampleTensors;
+        if (args.IsImageInput())
+        {
+            for (size_t i = 0; i < imagePaths.size() && i < batchSize; ++i)
+            {
+                sampleTensors.push_back(CreateBindableTensor(description, imagePaths[i], InputBindingType::CPU,
+                                                             InputDataType::Tensor, args, 0, colorManagementMode));
+            }
+        }
+        else
+        {
+            sampleTensors.push_back(CreateBindableTensor(description, L"", InputBindingType::CPU,
+                                                         InputDataType::Tensor, args, 0, colorManagementMode));
+        }
+
+        std::vector<const void*> samples;
+        size_t bytesPerSample = 0;
+        for (const auto& sampleTensor : sampleTensors)
+        {
+            com_ptr<ITensorNative> spTensorValueNative = sampleTensor.as<ITensorNative>();
+            BYTE* data;
+            uint32_t sizeInBytes;
+            THROW_IF_FAILED(spTensorValueNative->GetBuffer(&data, &sizeInBytes));
+            size_t numItems = static_cast<size_t>(sampleTensor.Shape().GetAt(0));
+            if (bytesPerSample == 0)
+            {
+                bytesPerSample = sizeInBytes / numItems;
+            }
+            if (numItems * bytesPerSample != sizeInBytes)
+            {
+                throw hresult_invalid_argument(L"Batched input samples have different sizes");
+            }
+            for (size_t item = 0; item < numItems && samples.size() < batchSize; ++item)
+            {
+                samples.push_back(data + item * bytesPerSample);
+            }
+        }
+
+        std::vector<int64_t> shape = { static_cast<int64_t>(batchSize) };
+        for (uint32_t i = 1; i < sampleTensors.front().Shape().Size(); ++i)
+        {
+            shape.push_back(sampleTensors.front().Shape().GetAt(i));
+        }
+        switch (tensorDescriptor.TensorKind())
+        {
+            case TensorKind::Float:
+                return CreatePackedTensor<TensorKind::Float>(shape, samples, bytesPerSample, batchSize);
+            case TensorKind::Float16:
+                return CreatePackedTensor<TensorKind::Float16>(shape, samples, bytesPerSample, batchSize);
+            case TensorKind::Double:
+                return CreatePackedTensor<TensorKind::Double>(shape, samples, bytesPerSample, batchSize);
+            case TensorKind::Int8:
+                return CreatePackedTensor<TensorKind::Int8>(shape, samples, bytesPerSample, batchSize);
+            case TensorKind::UInt8:
+                return CreatePackedTensor<TensorKind::UInt8>(shape, samples, bytesPerSample, batchSize);
+            case TensorKind::Int16:
+                return CreatePackedTensor<TensorKind::Int16>(shape, samples, bytesPerSample, batchSize);
+            case TensorKind::UInt16:
+                return CreatePackedTensor<TensorKind::UInt16>(shape, samples, bytesPerSample, batchSize);
+            case TensorKind::Int32:
+                return CreatePackedTensor<TensorKind::Int32>(shape, samples, bytesPerSample, batchSize);
+            case TensorKind::UInt32:
+                return CreatePackedTensor<TensorKind::UInt32>(shape, samples, bytesPerSample, batchSize);
+            case TensorKind::Int64:
+                return CreatePackedTensor<TensorKind::Int64>(shape, samples, bytesPerSample, batchSize);
+            case TensorKind::UInt64:
+                return CreatePackedTensor<TensorKind::UInt64>(shape, samples, bytesPerSample, batchSize);
+            default:
+                break;
+        }
+        throw hresult_not_implemented(L"Batched evaluation does not support the tensor kind of input " +
+                                      description.Name());
+    }
+
     ImageFeatureValue CreateBindableImage(const ILearningModelFeatureDescriptor& featureDescriptor,
                                           const std::wstring& imagePath, InputBindingType inputBindingType,
                                           InputDataType inputDataType, const IDirect3DDevice winrtDevice,
@@ -943,7 +1355,7 @@ namespace BindingUtilities
                 unsigned int topK = args.TopK();
                 std::vector<std::pair<float, int>> maxKValues;
                 std::ofstream fout;
-                if (args.IsSaveTensor())
+                if (args.IsSaveTensor() && !args.IsSaveTensorTrace())
                 {
                     fout.open(output.GetCsvFileNamePerIterationResult(), std::ios_base::app);
                     fout << "Index"
@@ -990,6 +1402,20 @@ namespace BindingUtilities
                     }
                     break;
                 }
+                if (args.IsSaveTensorTrace() && TensorTrace::IsSupportedDataType(static_cast<uint32_t>(tensorKind)))
+                {
+                    // TensorKind values are the ONNX data types used by tensor traces
+                    TensorTrace::RecordInfo info;
+                    info.Name = to_string(desc.Name());
+                    info.Type = TensorTrace::GetElementType(static_cast<uint32_t>(tensorKind));
+                    for (int64_t dimension : results.Lookup(desc.Name()).as<ITensor>().Shape())
+                    {
+                        info.Shape.push_back(dimension);
+                    }
+                    info.Iteration = iterationNum;
+                    info.Metadata = "model=" + to_string(model.Name());
+                    output.SaveTensorTrace(args, info, tensor, uCapacity);
+                }
                 if (args.IsSaveTensor())
                 {
                     fout.close();
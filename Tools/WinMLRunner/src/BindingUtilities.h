@@ -12,6 +12,10 @@ namespace BindingUtilities
                                  const CommandLineArgs& args, uint32_t iterationNum,
                                  ColorManagementMode colorManagementMode);
 
+    ITensor CreateBatchedTensor(const ILearningModelFeatureDescriptor& description,
+                                const std::vector<std::wstring>& imagePaths, uint32_t batchSize,
+                                const CommandLineArgs& args, ColorManagementMode colorManagementMode);
+
     ImageFeatureValue CreateBindableImage(const ILearningModelFeatureDescriptor& featureDescriptor,
                                           const std::wstring& imagePath, InputBindingType inputBindingType,
                                           InputDataType inputDataType, const winrt::Windows::Graphics::DirectX::Direct3D11::IDirect3DDevice winrtDevice,
@@ -55,8 +55,22 @@ void CommandLineArgs::PrintUsage()
     std::cout << "  -Perf [all]: capture performance measurements such as timing and memory usage. Specifying \"all\" "
                  "will output all measurements"
               << std::endl;
-    std::cout << "  -Iterations : # times perf measurements will be run/averaged. (maximum: 1024 times)" << std::endl;
-    std::cout << "  -Input <path to input file>: binds image or CSV to model" << std::endl;
+    std::cout << "  -PerfSampling [<milliseconds>] : with -Perf, only time the measured intervals and sample CPU, "
+                 "memory and GPU counters on a background thread every <milliseconds> (default 5) instead"
+              << std::endl;
+    std::cout << "  -HardwareCounters : with -Perf, also count CPU cycles, instructions, branch, LLC and dTLB misses "
+                 "of every measured interval (Linux perf_event only)"
+              << std::endl;
+    std::cout << "  -Iterations : # times perf measurements will be run/averaged." << std::endl;
+    std::cout << "  -Converge <relative error> : evaluate until the 95% confidence interval of the latency statistic "
+                 "is within <relative error> of it, e.g. 0.02, leaving out warmup iterations detected at the start. "
+                 "-Iterations then caps the run, default 1000"
+              << std::endl;
+    std::cout << "  -ConvergeStatistic <statistic> : latency statistic of -Converge [Median, P99]. Default: Median"
+              << std::endl;
+    std::cout << "  -ConvergeTimeLimit <seconds> : stop a -Converge run that takes longer than this. Default: no limit"
+              << std::endl;
+    std::cout << "  -Input <path to input file>: binds image, CSV, .npy/.npz or raw tensor file to model" << std::endl;
     std::cout << "  -InputImageFolder <path to directory of images> : specify folder of images to bind to model"
               << std::endl;
     std::cout << "  -TopK <number> : print top <number> values in the result. Default to 1" << std::endl;
@@ -65,6 +79,13 @@ void CommandLineArgs::PrintUsage()
               << std::endl;
     std::cout << "  -PerfOutput [<path>] : fully qualified or relative path including csv filename for perf results"
               << std::endl;
+    std::cout << "  -PerfJsonOutput [<path>] : also write perf results with full latency histograms and per iteration "
+                 "values as JSON Lines, by default next to the -PerfOutput csv file with a .jsonl extension"
+              << std::endl;
+    std::cout << "  -TraceOutput <path> : write a timeline of load, session creation, input generation, bind, "
+                 "evaluate, output processing and file I/O with memory counters, in the Chrome trace format that "
+                 "ui.perfetto.dev and chrome://tracing open"
+              << std::endl;
     std::cout << "  -SavePerIterationPerf : save per iteration performance results to csv file" << std::endl;
     std::cout << "  -PerIterationPath <directory_path> : Relative or fully qualified path for per iteration and save "
                  "tensor output results.  If not specified a default(timestamped) folder will be created."
@@ -72,6 +93,10 @@ void CommandLineArgs::PrintUsage()
     std::cout << "  -SaveTensorData <saveMode>: saveMode: save first iteration or all iteration output "
                  "tensor results to csv file [First, All]"
               << std::endl;
+    std::cout << "  -SaveTensorFormat <format>: file format of -SaveTensorData [Csv, Trace, TraceLz4]. Trace writes "
+                 "every output of every iteration to one tensor trace file per device, TraceLz4 compresses it. "
+                 "Default: Csv"
+              << std::endl;
     std::cout << "  -DebugEvaluate: Print evaluation debug output to debug console if debugger is present."
               << std::endl;
     std::cout << "  -Terse: Terse Mode (suppresses repetitive console output)" << std::endl;
@@ -79,11 +104,36 @@ void CommandLineArgs::PrintUsage()
                  "Linear, Cubic, Fant]"
               << std::endl;
     std::cout << "  -LogCPUFallback : output warnings when operators execute on the CPU when the CPU is not the chosen device" << std::endl;
+    std::cout << "  -SteadyState : create the binding and input features once per configuration and only rebind and "
+                 "evaluate on each iteration"
+              << std::endl;
+    std::cout << "  -BatchSize <number> : pack 1, 2, 4, ... up to <number> images or CSV rows into one tensor for models "
+                 "with a free batch dimension and report per batch and per sample latency for each batch size"
+              << std::endl;
+    std::cout << "  -TensorCacheSize <MB> : memory for decoded and tensorized input images, so that they are only "
+                 "converted once per file and settings. 0 disables the cache. Default: 256"
+              << std::endl;
+    std::cout << "  -TensorCacheDir <path> : also keep cached inputs in this folder, so that later runs map them "
+                 "instead of converting the images again"
+              << std::endl;
+    std::cout << "  -ParallelSweep [<workers>] : run every model, device, input type and input binding in its own "
+                 "WinMLRunner process and merge the perf results. Up to <workers> CPU jobs run at once (default: a "
+                 "quarter of the cores), jobs that use a GPU run one at a time"
+              << std::endl;
+    std::cout << "  -SweepTimeout <seconds> : stop a -ParallelSweep job that runs longer than this. Default: no limit"
+              << std::endl;
+    std::cout << "  -SweepRetries <number> : run a -ParallelSweep job that crashed or timed out up to <number> more "
+                 "times. Default: 1"
+              << std::endl;
     std::cout << std::endl;
     std::cout << "Concurrency Options:" << std::endl;
     std::cout << "  -ConcurrentLoad: load models concurrently" << std::endl;
-    std::cout << "  -NumThreads <number>: number of threads to load a model. By default this will be the number of "
-                 "model files to be executed"
+    std::cout << "  -ConcurrentEvaluate: measure evaluation throughput with 1 to NumThreads threads that each own a "
+                 "session on the same model and evaluate Iterations times"
+              << std::endl;
+    std::cout << "  -NumThreads <number>: number of threads to load the model files with (default: 1, each file is "
+                 "loaded once), or the largest number of evaluating threads for -ConcurrentEvaluate (default: the "
+                 "number of hardware threads)"
               << std::endl;
     std::cout << "  -ThreadInterval <milliseconds>: interval time between two thread creations in milliseconds"
               << std::endl;
@@ -108,6 +158,7 @@ CommandLineArgs::CommandLineArgs(const std::vector<std::wstring>& args)
     std::wstring sPerfOutputPath;
     std::wstring sBaseOutputPath;
     std::wstring sPerIterationDataPath;
+    m_arguments = args;
 
     for (UINT i = 0; i < args.size(); i++)
     {
@@ -154,6 +205,53 @@ CommandLineArgs::CommandLineArgs(const std::vector<std::wstring>& args)
         else if ((_wcsicmp(args[i].c_str(), L"-Iterations") == 0) && (i + 1 < args.size()))
         {
             m_numIterations = static_cast<UINT>(_wtoi(args[++i].c_str()));
+            m_iterationsSpecified = true;
+        }
+        else if ((_wcsicmp(args[i].c_str(), L"-PerfSampling") == 0))
+        {
+            m_perfSamplingInterval = 5;
+            if (i + 1 < args.size() && args[i + 1][0] != L'-')
+            {
+                m_perfSamplingInterval = std::stod(args[++i].c_str());
+                if (!(m_perfSamplingInterval > 0))
+                {
+                    throw hresult_invalid_argument(L"-PerfSampling interval must be more than 0 milliseconds.");
+                }
+            }
+        }
+        else if ((_wcsicmp(args[i].c_str(), L"-HardwareCounters") == 0))
+        {
+            m_hardwareCounters = true;
+        }
+        else if ((_wcsicmp(args[i].c_str(), L"-Converge") == 0))
+        {
+            CheckNextArgument(args, i);
+            m_convergeTarget = std::stod(args[++i].c_str());
+            if (!(m_convergeTarget > 0 && m_convergeTarget < 1))
+            {
+                throw hresult_invalid_argument(L"-Converge must be a relative error between 0 and 1, e.g. 0.02");
+            }
+        }
+        else if ((_wcsicmp(args[i].c_str(), L"-ConvergeStatistic") == 0))
+        {
+            CheckNextArgument(args, i);
+            if (_wcsicmp(args[++i].c_str(), L"Median") == 0)
+            {
+                m_convergeStatistic = IterationConvergence::LatencyStatistic::Median;
+            }
+            else if (_wcsicmp(args[i].c_str(), L"P99") == 0)
+            {
+                m_convergeStatistic = IterationConvergence::LatencyStatistic::P99;
+            }
+            else
+            {
+                throw hresult_invalid_argument(L"-ConvergeStatistic must be Median or P99");
+            }
+        }
+        else if ((_wcsicmp(args[i].c_str(), L"-ConvergeTimeLimit") == 0))
+        {
+            CheckNextArgument(args, i);
+            m_convergeTimeLimitSeconds = std::stod(args[++i].c_str());
         }
         else if ((_wcsicmp(args[i].c_str(), L"-Model") == 0))
         {
@@ -183,6 +281,19 @@ CommandLineArgs::CommandLineArgs(const std::vector<std::wstring>& args)
             }
             m_perfOutput = true;
         }
+        else if ((_wcsicmp(args[i].c_str(), L"-PerfJsonOutput") == 0))
+        {
+            if (i + 1 < args.size() && args[i + 1][0] != L'-')
+            {
+                m_perfJsonOutputPath = FileHelper::GetAbsolutePath(args[++i]);
+            }
+            m_perfJsonOutput = true;
+        }
+        else if ((_wcsicmp(args[i].c_str(), L"-TraceOutput") == 0))
+        {
+            CheckNextArgument(args, i);
+            m_traceOutputPath = FileHelper::GetAbsolutePath(args[++i]);
+        }
         else if ((_wcsicmp(args[i].c_str(), L"-RGB") == 0))
         {
             m_useRGB = true;
@@ -325,6 +436,27 @@ CommandLineArgs::CommandLineArgs(const std::vector<std::wstring>& args)
                 throw hresult_invalid_argument(L"Unknown SaveTensorData Mode[" + m_saveTensorMode + L"]!");
             }
         }
+        else if (_wcsicmp(args[i].c_str(), L"-SaveTensorFormat") == 0)
+        {
+            CheckNextArgument(args, i);
+            if (_wcsicmp(args[++i].c_str(), L"Csv") == 0)
+            {
+                m_saveTensorFormat = L"Csv";
+            }
+            else if (_wcsicmp(args[i].c_str(), L"Trace") == 0)
+            {
+                m_saveTensorFormat = L"Trace";
+            }
+            else if (_wcsicmp(args[i].c_str(), L"TraceLz4") == 0)
+            {
+                m_saveTensorFormat = L"TraceLz4";
+            }
+            else
+            {
+                PrintUsage();
+                throw hresult_invalid_argument(L"Unknown SaveTensorFormat[" + args[i] + L"]!");
+            }
+        }
         else if (_wcsicmp(args[i].c_str(), L"-Version") == 0)
         {
             TCHAR szExeFileName[MAX_PATH];
@@ -364,6 +496,10 @@ CommandLineArgs::CommandLineArgs(const std::vector<std::wstring>& args)
         {
             ToggleConcurrentLoad(true);
         }
+        else if ((_wcsicmp(args[i].c_str(), L"-ConcurrentEvaluate") == 0))
+        {
+            ToggleConcurrentEvaluate(true);
+        }
         else if ((_wcsicmp(args[i].c_str(), L"-NumThreads") == 0))
         {
             CheckNextArgument(args, i);
@@ -398,6 +534,56 @@ CommandLineArgs::CommandLineArgs(const std::vector<std::wstring>& args)
         {
             EnableLogCPUFallback();
         }
+        else if ((_wcsicmp(args[i].c_str(), L"-SteadyState") == 0))
+        {
+            ToggleSteadyState(true);
+        }
+        else if ((_wcsicmp(args[i].c_str(), L"-BatchSize") == 0))
+        {
+            CheckNextArgument(args, i);
+            // Parsed signed, so that a negative size is rejected rather than wrapping around to a huge one
+            int batchSize = std::stoi(args[++i].c_str());
+            if (batchSize < 1)
+            {
+                throw hresult_invalid_argument(L"-BatchSize must be at least 1");
+            }
+            SetBatchSize(static_cast<unsigned>(batchSize));
+        }
+        else if ((_wcsicmp(args[i].c_str(), L"-TensorCacheSize") == 0))
+        {
+            CheckNextArgument(args, i);
+            SetTensorCacheSize(std::stoi(args[++i].c_str()));
+        }
+        else if ((_wcsicmp(args[i].c_str(), L"-TensorCacheDir") == 0))
+        {
+            CheckNextArgument(args, i);
+            m_tensorCacheDirectory = args[++i];
+        }
+        else if ((_wcsicmp(args[i].c_str(), L"-ParallelSweep") == 0))
+        {
+            m_parallelSweep = true;
+            if (i + 1 < args.size() && args[i + 1][0] != L'-')
+            {
+                m_sweepWorkers = std::stoi(args[++i].c_str());
+            }
+        }
+        else if ((_wcsicmp(args[i].c_str(), L"-SweepTimeout") == 0))
+        {
+            CheckNextArgument(args, i);
+            m_sweepTimeoutSeconds = std::stoi(args[++i].c_str());
+        }
+        else if ((_wcsicmp(args[i].c_str(), L"-SweepRetries") == 0))
+        {
+            CheckNextArgument(args, i);
+            m_sweepRetries = std::stoi(args[++i].c_str());
+        }
+        else if ((_wcsicmp(args[i].c_str(), L"-SweepJob") == 0))
+        {
+            // Passed by -ParallelSweep to its jobs: run only this device, input data type and input binding type
+            CheckNextArgument(args, i, i + 3);
+            m_sweepJob.assign(args.begin() + i + 1, args.begin() + i + 4);
+            i += 3;
+        }
         else
         {
             std::wstring msg = L"Unknown option ";
@@ -416,6 +602,7 @@ CommandLineArgs::CommandLineArgs(const std::vector<std::wstring>& args)
     if (!m_inputData.empty())
     {
         std::transform(m_inputData.begin(), m_inputData.end(), m_inputData.begin(), ::towlower);
+        const std::wstring extension = std::filesystem::path(m_inputData).extension().wstring();
         if (m_inputData.find(L".png") != std::string::npos || m_inputData.find(L".jpg") != std::string::npos ||
             m_inputData.find(L".jpeg") != std::string::npos)
         {
@@ -425,6 +612,10 @@ CommandLineArgs::CommandLineArgs(const std::vector<std::wstring>& args)
         {
             m_csvData = m_inputData;
         }
+        else if (extension == L".npy" || extension == L".npz" || extension == L".raw" || extension == L".bin")
+        {
+            m_tensorFilePath = m_inputData;
+        }
         else
         {
             std::wstring msg = L"unknown input type ";
@@ -436,7 +627,16 @@ CommandLineArgs::CommandLineArgs(const std::vector<std::wstring>& args)
     {
         PopulateInputImagePaths();
     }
+    if (IsConvergence() && !m_iterationsSpecified)
+    {
+        m_numIterations = 1000;
+    }
     SetupOutputDirectories(sBaseOutputPath, sPerfOutputPath, sPerIterationDataPath);
+    if (m_perfJsonOutput && m_perfJsonOutputPath.empty())
+    {
+        // Next to the CSV perf results by default
+        m_perfJsonOutputPath = std::filesystem::path(m_perfOutputPath).replace_extension(L".jsonl").c_str();
+    }
 
     CheckForInvalidArguments();
 }
@@ -541,6 +741,51 @@ void CommandLineArgs::CheckForInvalidArguments()
     {
         throw hresult_not_implemented(L"Saving tensor output for multiple images isn't implemented.");
     }
+    if (m_batchSize > 0 && m_concurrentEvaluate)
+    {
+        throw hresult_invalid_argument(L"-BatchSize cannot be combined with -ConcurrentEvaluate.");
+    }
+    if (m_perfJsonOutput && !m_perfCapture)
+    {
+        throw hresult_invalid_argument(L"-PerfJsonOutput requires -Perf.");
+    }
+    if (m_saveTensorFormat != L"Csv" && !m_saveTensor)
+    {
+        throw hresult_invalid_argument(L"-SaveTensorFormat requires -SaveTensorData.");
+    }
+    if (IsPerfSampling() && (!m_perfCapture || m_perIterCapture))
+    {
+        throw hresult_invalid_argument(
+            L"-PerfSampling requires -Perf and cannot be combined with -SavePerIterationPerf.");
+    }
+    if (m_hardwareCounters && !m_perfCapture)
+    {
+        throw hresult_invalid_argument(L"-HardwareCounters requires -Perf.");
+    }
+    if (IsConvergence() && (m_concurrentEvaluate || m_batchSize > 0))
+    {
+        throw hresult_invalid_argument(L"-Converge cannot be combined with -ConcurrentEvaluate or -BatchSize.");
+    }
+    if (IsConvergence() && m_numIterations == 0)
+    {
+        throw hresult_invalid_argument(L"-Iterations caps a -Converge run and must be at least 1.");
+    }
+    if (m_parallelSweep && (m_saveTensor || m_perIterCapture || m_concurrentLoad))
+    {
+        throw hresult_invalid_argument(
+            L"-ParallelSweep cannot be combined with -SaveTensorData, -SavePerIterationPerf or -ConcurrentLoad.");
+    }
+}
+
+// Keeps the configuration named like the one of a -SweepJob, see TypeHelper::Stringify.
+template <typename T> static void KeepSweepJobConfiguration(std::vector<T>& configurations, const std::wstring& name)
+{
+    configurations.erase(std::remove_if(configurations.begin(), configurations.end(),
+                                        [&name](T configuration) {
+                                            return _wcsicmp(to_hstring(TypeHelper::Stringify(configuration)).c_str(),
+                                                            name.c_str()) != 0;
+                                        }),
+                         configurations.end());
 }
 
 std::vector<InputDataType> CommandLineArgs::FetchInputDataTypes()
@@ -562,6 +807,10 @@ std::vector<InputDataType> CommandLineArgs::FetchInputDataTypes()
         inputDataTypes.push_back(InputDataType::ImageBGR);
     }
 
+    if (!m_sweepJob.empty())
+    {
+        KeepSweepJobConfiguration(inputDataTypes, m_sweepJob[1]);
+    }
     return inputDataTypes;
 }
 
@@ -589,6 +838,10 @@ std::vector<DeviceType> CommandLineArgs::FetchDeviceTypes()
         deviceTypes.push_back(DeviceType::MinPowerGPU);
     }
 
+    if (!m_sweepJob.empty())
+    {
+        KeepSweepJobConfiguration(deviceTypes, m_sweepJob[0]);
+    }
     return deviceTypes;
 }
 
@@ -606,6 +859,10 @@ std::vector<InputBindingType> CommandLineArgs::FetchInputBindingTypes()
         inputBindingTypes.push_back(InputBindingType::GPU);
     }
 
+    if (!m_sweepJob.empty())
+    {
+        KeepSweepJobConfiguration(inputBindingTypes, m_sweepJob[2]);
+    }
     return inputBindingTypes;
 }
 
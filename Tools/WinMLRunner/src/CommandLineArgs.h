@@ -2,6 +2,7 @@
 #include "Common.h"
 #include <winrt/Windows.Graphics.Imaging.h>
 #include "TypeHelper.h"
+#include "IterationConvergence.h"
 enum TensorizeFuncs
 {
     Identity = 0,
@@ -29,6 +30,7 @@ public:
     CommandLineArgs(const std::vector<std::wstring>& args);
     void PrintUsage();
     bool IsConcurrentLoad() const { return m_concurrentLoad; }
+    bool IsConcurrentEvaluate() const { return m_concurrentEvaluate; }
     bool IsUsingGPUHighPerformance() const { return m_useGPUHighPerformance; }
     bool IsUsingGPUMinPower() const { return m_useGPUMinPower; }
     bool UseBGR() const { return m_useBGR; }
@@ -41,9 +43,19 @@ public:
     bool IsCreateDeviceOnClient() const { return m_createDeviceOnClient; }
     bool IsAutoScale() const { return m_autoScale; }
     bool IsOutputPerf() const { return m_perfOutput; }
+    bool IsOutputPerfJson() const { return m_perfJsonOutput; }
     bool IsSaveTensor() const { return m_saveTensor; }
     bool IsTimeLimitIterations() const { return m_timeLimitIterations; }
     bool IsLogCPUFallbackEnabled() const { return m_logCPUFallback; }
+    bool IsSteadyState() const { return m_steadyState; }
+    // -PerfSampling: resource counters come from a background sampler, see Profiler::EnableSampling
+    bool IsPerfSampling() const { return m_perfSamplingInterval > 0; }
+    double PerfSamplingInterval() const { return m_perfSamplingInterval; }
+    // -HardwareCounters: count CPU hardware events in every interval, see Profiler::EnableHardwareCounters
+    bool IsHardwareCounters() const { return m_hardwareCounters; }
+    // -Converge: iterate until the latency statistic is known to within ConvergenceOptions().TargetRelativeError
+    bool IsConvergence() const { return m_convergeTarget > 0; }
+    bool IsParallelSweep() const { return m_parallelSweep; }
     BitmapInterpolationMode AutoScaleInterpMode() const { return m_autoScaleInterpMode; }
 
     const std::vector<std::wstring>& ImagePaths() const { return m_imagePaths; }
@@ -52,7 +64,12 @@ public:
         return m_providedInputFeatureValues;
     }
     const std::wstring& CsvPath() const { return m_csvData; }
+    const std::wstring& TensorFilePath() const { return m_tensorFilePath; }
     const std::wstring& OutputPath() const { return m_perfOutputPath; }
+    const std::wstring& PerfJsonOutputPath() const { return m_perfJsonOutputPath; }
+    // -TraceOutput: a timeline of the phases of the run, see TraceTimeline.h
+    bool IsTraceOutput() const { return !m_traceOutputPath.empty(); }
+    const std::wstring& TraceOutputPath() const { return m_traceOutputPath; }
     const std::wstring& FolderPath() const { return m_modelFolderPath; }
     const std::wstring& ModelPath() const { return m_modelPath; }
     const std::wstring& PerIterationDataPath() const { return m_perIterationDataPath; }
@@ -97,17 +114,38 @@ public:
 
     bool IsGarbageInput() const
     {
-        // When there is no image or csv input provided, then garbage input binding is used.
-        return m_imagePaths.empty() && m_csvData.empty() && m_providedInputFeatureValues.empty();
+        // When there is no image, csv or tensor file input provided, then garbage input binding is used.
+        return m_imagePaths.empty() && m_csvData.empty() && m_tensorFilePath.empty() &&
+               m_providedInputFeatureValues.empty();
     }
     bool IsCSVInput() const { return m_imagePaths.empty() && !m_csvData.empty(); }
+    bool IsTensorFileInput() const { return m_imagePaths.empty() && m_csvData.empty() && !m_tensorFilePath.empty(); }
     bool IsImageInput() const { return !m_imagePaths.empty() && m_csvData.empty(); }
     bool InputFeatureValuesProvided() const { return !m_providedInputFeatureValues.empty(); }
     uint32_t NumIterations() const { return m_numIterations; }
     uint32_t NumLoadIterations() const { return m_numLoadIterations; }
     uint32_t NumSessionCreationIterations() const { return m_numSessionIterations; }
     double IterationTimeLimit() const { return m_iterationTimeLimitMilliseconds; }
-    uint32_t NumThreads() const { return m_numThreads; }
+    IterationConvergence::ConvergenceOptions ConvergenceOptions() const
+    {
+        IterationConvergence::ConvergenceOptions options;
+        options.Statistic = m_convergeStatistic;
+        options.TargetRelativeError = m_convergeTarget;
+        options.MaxIterations = m_numIterations;
+        options.MaxMilliseconds = m_convergeTimeLimitSeconds * 1000;
+        return options;
+    }
+    uint32_t NumThreads() const { return m_numThreads; } // 0 unless -NumThreads is given
+    uint32_t BatchSize() const { return m_batchSize; } // 0 unless -BatchSize is given
+    uint32_t TensorCacheSize() const { return m_tensorCacheSize; } // in MB, 0 disables the tensor cache
+    std::wstring TensorCacheDirectory() const { return m_tensorCacheDirectory; } // empty without -TensorCacheDir
+    uint32_t SweepWorkers() const { return m_sweepWorkers; }       // processes running CPU jobs at once
+    uint32_t SweepTimeout() const { return m_sweepTimeoutSeconds; } // in seconds, 0 for none
+    uint32_t SweepRetries() const { return m_sweepRetries; }
+    // The arguments WinMLRunner was started with, which -ParallelSweep passes on to its jobs
+    const std::vector<std::wstring>& Arguments() const { return m_arguments; }
+    // Device, input data type and input binding type of a -ParallelSweep job, empty otherwise
+    const std::vector<std::wstring>& SweepJob() const { return m_sweepJob; }
     uint32_t ThreadInterval() const { return m_threadInterval; } // Thread interval in milliseconds
     uint32_t TopK() const { return m_topK; }
     uint32_t GarbageDataMaxValue() const { return m_garbageDataMaxValue; }
@@ -118,6 +156,7 @@ public:
     void ToggleGPUHighPerformance(bool useGPUHighPerformance) { m_useGPUHighPerformance = useGPUHighPerformance; }
     void ToggleUseGPUMinPower(bool useGPUMinPower) { m_useGPUMinPower = useGPUMinPower; }
     void ToggleConcurrentLoad(bool concurrentLoad) { m_concurrentLoad = concurrentLoad; }
+    void ToggleConcurrentEvaluate(bool concurrentEvaluate) { m_concurrentEvaluate = concurrentEvaluate; }
     void ToggleCreateDeviceOnClient(bool createDeviceOnClient) { m_createDeviceOnClient = createDeviceOnClient; }
     void ToggleCreateDeviceInWinML(bool createDeviceInWinML) { m_createDeviceInWinML = createDeviceInWinML; }
     void ToggleCPUBoundInput(bool useCPUBoundInput) { m_useCPUBoundInput = useCPUBoundInput; }
@@ -132,6 +171,7 @@ public:
     void ToggleTerseOutput(bool terseOutput) { m_terseOutput = terseOutput; }
     void TogglePerfOutput(bool perfOutput) { m_perfOutput = perfOutput; }
     void EnableLogCPUFallback() { m_logCPUFallback = true; }
+    void ToggleSteadyState(bool steadyState) { m_steadyState = steadyState; }
 
     void SetModelPath(const std::wstring& modelPath) { m_modelPath = modelPath; }
     void SetPerIterationDataPath(const std::wstring& perIterationDataPath)
@@ -140,6 +180,8 @@ public:
     }
     void SetInputDataPath(const std::wstring& inputDataPath) { m_inputData = inputDataPath; }
     void SetNumThreads(unsigned numThreads) { m_numThreads = numThreads; }
+    void SetBatchSize(unsigned batchSize) { m_batchSize = batchSize; }
+    void SetTensorCacheSize(unsigned megabytes) { m_tensorCacheSize = megabytes; }
     void SetThreadInterval(unsigned threadInterval) { m_threadInterval = threadInterval; }
     void SetTopK(unsigned k) { m_topK = k; }
     void SetPerformanceCSVPath(const std::wstring& performanceCSVPath) { m_perfOutputPath = performanceCSVPath; }
@@ -158,6 +200,9 @@ public:
         m_iterationTimeLimitMilliseconds = milliseconds;
     }
     std::wstring SaveTensorMode() const { return m_saveTensorMode; }
+    std::wstring SaveTensorFormat() const { return m_saveTensorFormat; }
+    // -SaveTensorData writes tensor traces (see TensorTrace.h) instead of one CSV file per output and iteration.
+    bool IsSaveTensorTrace() const { return m_saveTensor && m_saveTensorFormat != L"Csv"; }
 
     std::vector<InputBindingType> FetchInputBindingTypes();
     std::vector<DeviceType> FetchDeviceTypes();
@@ -172,6 +217,7 @@ private:
     bool m_useGPUHighPerformance = false;
     bool m_useGPUMinPower = false;
     bool m_concurrentLoad = false;
+    bool m_concurrentEvaluate = false;
     bool m_createDeviceOnClient = false;
     bool m_createDeviceInWinML = false;
     bool m_useRGB = false;
@@ -185,11 +231,16 @@ private:
     bool m_terseOutput = false;
     bool m_autoScale = false;
     bool m_perfOutput = false;
+    bool m_perfJsonOutput = false;
     BitmapInterpolationMode m_autoScaleInterpMode = BitmapInterpolationMode::Cubic;
     bool m_saveTensor = false;
     bool m_timeLimitIterations = false;
     bool m_logCPUFallback = false;
+    bool m_steadyState = false;
+    bool m_parallelSweep = false;
+    bool m_hardwareCounters = false;
     std::wstring m_saveTensorMode = L"First";
+    std::wstring m_saveTensorFormat = L"Csv";
     ::TensorizeArgs m_tensorizeArgs;
 
     std::wstring m_modelFolderPath;
@@ -198,17 +249,33 @@ private:
     std::vector<ILearningModelFeatureValue> m_providedInputFeatureValues;
     std::wstring m_inputImageFolderPath;
     std::wstring m_csvData;
+    std::wstring m_tensorFilePath;
     std::wstring m_inputData;
 #ifdef DXCORE_SUPPORTED_BUILD
     std::wstring m_adapterName;
 #endif
     std::wstring m_perfOutputPath;
+    std::wstring m_perfJsonOutputPath;
+    std::wstring m_traceOutputPath;
     std::wstring m_perIterationDataPath;
+    std::wstring m_tensorCacheDirectory;
     uint32_t m_numIterations = 1;
     uint32_t m_numLoadIterations = 1;
     uint32_t m_numSessionIterations = 1;
     double m_iterationTimeLimitMilliseconds = 0;
-    uint32_t m_numThreads = 1;
+    double m_perfSamplingInterval = 0; // 0 without -PerfSampling
+    bool m_iterationsSpecified = false;
+    double m_convergeTarget = 0; // 0 without -Converge
+    IterationConvergence::LatencyStatistic m_convergeStatistic = IterationConvergence::LatencyStatistic::Median;
+    double m_convergeTimeLimitSeconds = 0;
+    uint32_t m_numThreads = 0;
+    uint32_t m_batchSize = 0;
+    uint32_t m_tensorCacheSize = 256;
+    uint32_t m_sweepWorkers = 0;
+    uint32_t m_sweepTimeoutSeconds = 0;
+    uint32_t m_sweepRetries = 1;
+    std::vector<std::wstring> m_sweepJob; // device, input data type and input binding type of a -ParallelSweep job
+    std::vector<std::wstring> m_arguments;
     uint32_t m_threadInterval = 0;
     uint32_t m_topK = 1;
     uint32_t m_garbageDataMaxValue = 0;
@@ -5,8 +5,14 @@
 #include "Windows.h"
 #include "common.h"
 #include "ThreadPool.h"
+#include "Run.h"
+#include "OutputHelper.h"
+#include "ConcurrentEvaluation.h"
+#include "TraceTimeline.h"
+#include <winrt/Windows.Foundation.Metadata.h>
 
 using namespace winrt;
+using namespace winrt::Windows::Foundation::Metadata;
 #ifdef USE_WINML_NUGET
 using namespace winrt::Microsoft::AI::MachineLearning;
 #else
@@ -21,7 +27,16 @@ void load_model(const std::wstring& path, bool print_info)
         ss << L"Begin loading a model " << path << L" in thread " << std::this_thread::get_id() << std::endl;
         std::wcout << ss.str();
     }
-    auto model = LearningModel::LoadFromFilePath(path);
+    TraceTimeline::Global().SetThreadName("load worker");
+    {
+        TraceTimeline::Scope scope("load model");
+        if (scope.IsRecording())
+        {
+            scope.SetDetail(to_string(path));
+        }
+        auto model = LearningModel::LoadFromFilePath(path);
+    }
+    TraceTimeline::Global().AddMemoryCounters();
     if (print_info)
     {
         std::wstringstream ss;
@@ -46,3 +61,57 @@ void ConcurrentLoadModel(const std::vector<std::wstring>& paths, unsigned num_th
     }
     // TODO: read output values from load_model
 }
+
+HRESULT ConcurrentEvaluateModel(const LearningModel& model, const LearningModelDeviceWithMetadata& device,
+                                const CommandLineArgs& args, OutputHelper& output, InputBindingType inputBindingType,
+                                InputDataType inputDataType, const LearningModelSessionOptions& sessionOptions)
+{
+    auto statics = get_activation_factory<ApiInformation, IApiInformationStatics>();
+    bool isSessionOptionsTypePresent =
+        statics.IsTypePresent(L"Windows.AI.MachineLearning.LearningModelSessionOptions");
+    std::wstring imagePath = args.IsImageInput() ? args.ImagePaths()[0] : L"";
+
+    // Each worker owns its session, binding and inputs, so the only state shared between workers is the model.
+    EvaluatorFactory createEvaluator = [&](unsigned threadIndex) -> std::function<void()> {
+        TraceTimeline::Global().SetThreadName("evaluate worker " + std::to_string(threadIndex));
+        LearningModelSession session = nullptr;
+        {
+            TraceTimeline::Scope scope("create session");
+            session = isSessionOptionsTypePresent
+                          ? LearningModelSession(model, device.LearningModelDevice, sessionOptions)
+                          : LearningModelSession(model, device.LearningModelDevice);
+        }
+        LearningModelBinding binding(session);
+        std::vector<ILearningModelFeatureValue> inputFeatures =
+            GenerateInputFeatures(model, args, inputBindingType, inputDataType, device, threadIndex, imagePath);
+        {
+            TraceTimeline::Scope scope("bind");
+            for (uint32_t i = 0; i < model.InputFeatures().Size(); i++)
+            {
+                binding.Bind(model.InputFeatures().GetAt(i).Name(), inputFeatures[i]);
+            }
+        }
+        return [session, binding]() {
+            TraceTimeline::Scope scope("evaluate");
+            session.Evaluate(binding, L"");
+        };
+    };
+
+    try
+    {
+        // Without -NumThreads the sweep goes up to every hardware thread, so that it shows how throughput scales
+        unsigned maxThreads =
+            args.NumThreads() > 0 ? args.NumThreads() : (std::max)(std::thread::hardware_concurrency(), 1u);
+        std::vector<ThroughputResult> results =
+            RunThroughputSweep(GetThreadCountSweep(maxThreads), args.NumIterations(), 1, createEvaluator);
+        output.PrintThroughputResults(results, device.DeviceType, inputBindingType, inputDataType,
+                                      args.IsPerformanceConsoleOutputVerbose());
+    }
+    catch (hresult_error hr)
+    {
+        std::cout << "Concurrent evaluation [FAILED]" << std::endl;
+        std::wcout << hr.message().c_str() << std::endl;
+        return hr.code();
+    }
+    return S_OK;
+}
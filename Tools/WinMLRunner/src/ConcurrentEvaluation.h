@@ -0,0 +1,176 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "LatencyHistogram.h"
+
+// Scheduling and aggregation for the concurrent evaluation throughput mode. Nothing in here depends on WinML, the
+// evaluator is supplied by the caller, so it can be driven by a stub evaluator in tests.
+
+// Called once on each worker thread before the timed run starts, with the index of the worker. Creates the state the
+// worker owns (e.g. a LearningModelSession and its binding) and returns the callable that performs one evaluation.
+typedef std::function<std::function<void()>(unsigned threadIndex)> EvaluatorFactory;
+
+struct ThroughputResult
+{
+    unsigned NumThreads = 0;
+    uint64_t TotalInferences = 0;
+    double WallTime = 0;             // in milliseconds, from the moment all workers are released to the last one finishing
+    double InferencesPerSecond = 0;
+    double ScalingEfficiency = 0;    // InferencesPerSecond / (NumThreads * single thread InferencesPerSecond)
+    LatencyHistogram Latency;                   // per evaluation latency in milliseconds, all workers merged
+    std::vector<LatencyHistogram> ThreadLatency; // per evaluation latency in milliseconds, one per worker
+};
+
+// Runs numThreads workers that each evaluate iterationsPerThread times after warmupIterations untimed evaluations.
+// All workers set up their evaluator and warm up first, then are released together so that the measured interval only
+// covers concurrent evaluation. An exception thrown by a factory or an evaluator is rethrown on the calling thread once
+// every worker has stopped.
+inline ThroughputResult RunConcurrentEvaluation(unsigned numThreads, uint32_t iterationsPerThread,
+                                                uint32_t warmupIterations, const EvaluatorFactory& factory)
+{
+    ThroughputResult result;
+    result.NumThreads = numThreads;
+    result.ThreadLatency.resize(numThreads);
+    if (numThreads == 0)
+    {
+        return result;
+    }
+
+    std::mutex mutex;
+    std::condition_variable condVar;
+    unsigned readyCount = 0;
+    bool released = false;
+    bool failed = false;
+    std::exception_ptr error;
+
+    auto markFailed = [&]() {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!failed)
+        {
+            failed = true;
+            error = std::current_exception();
+        }
+    };
+
+    std::vector<std::thread> workers;
+    workers.reserve(numThreads);
+    std::chrono::steady_clock::time_point startTime;
+    for (unsigned threadIndex = 0; threadIndex < numThreads; ++threadIndex)
+    {
+        workers.emplace_back([&, threadIndex]() {
+            std::function<void()> evaluate;
+            try
+            {
+                evaluate = factory(threadIndex);
+                for (uint32_t i = 0; i < warmupIterations; ++i)
+                {
+                    evaluate();
+                }
+            }
+            catch (...)
+            {
+                markFailed();
+            }
+
+            {
+                // Wait until every worker is ready so that they all start evaluating at the same time
+                std::unique_lock<std::mutex> lock(mutex);
+                if (++readyCount == numThreads)
+                {
+                    startTime = std::chrono::steady_clock::now();
+                    released = true;
+                    condVar.notify_all();
+                }
+                else
+                {
+                    condVar.wait(lock, [&] { return released; });
+                }
+                if (failed)
+                {
+                    return;
+                }
+            }
+
+            LatencyHistogram& latency = result.ThreadLatency[threadIndex];
+            try
+            {
+                for (uint32_t i = 0; i < iterationsPerThread; ++i)
+                {
+                    auto evaluateStart = std::chrono::steady_clock::now();
+                    evaluate();
+                    latency.Record(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() -
+                                                                             evaluateStart)
+                                       .count());
+                }
+            }
+            catch (...)
+            {
+                markFailed();
+            }
+        });
+    }
+
+    for (auto& worker : workers)
+    {
+        worker.join();
+    }
+    auto stopTime = std::chrono::steady_clock::now();
+    if (error)
+    {
+        std::rethrow_exception(error);
+    }
+
+    result.WallTime = std::chrono::duration<double, std::milli>(stopTime - startTime).count();
+    for (const auto& latency : result.ThreadLatency)
+    {
+        result.Latency.Merge(latency);
+    }
+    result.TotalInferences = result.Latency.GetCount();
+    result.InferencesPerSecond =
+        result.WallTime > 0 ? static_cast<double>(result.TotalInferences) * 1000.0 / result.WallTime : 0;
+    return result;
+}
+
+// Thread counts to sweep when scaling from 1 to maxThreads: powers of two, plus maxThreads itself.
+inline std::vector<unsigned> GetThreadCountSweep(unsigned maxThreads)
+{
+    std::vector<unsigned> threadCounts;
+    for (unsigned numThreads = 1; numThreads < maxThreads; numThreads *= 2)
+    {
+        threadCounts.push_back(numThreads);
+    }
+    if (maxThreads > 0)
+    {
+        threadCounts.push_back(maxThreads);
+    }
+    return threadCounts;
+}
+
+// Runs RunConcurrentEvaluation once per entry of threadCounts and fills in the scaling efficiency of each run
+// relative to the per thread throughput of the first run (normally the single threaded one).
+inline std::vector<ThroughputResult> RunThroughputSweep(const std::vector<unsigned>& threadCounts,
+                                                        uint32_t iterationsPerThread, uint32_t warmupIterations,
+                                                        const EvaluatorFactory& factory)
+{
+    std::vector<ThroughputResult> results;
+    for (unsigned numThreads : threadCounts)
+    {
+        results.push_back(RunConcurrentEvaluation(numThreads, iterationsPerThread, warmupIterations, factory));
+    }
+    if (!results.empty() && results.front().NumThreads > 0 && results.front().InferencesPerSecond > 0)
+    {
+        double baselinePerThread = results.front().InferencesPerSecond / results.front().NumThreads;
+        for (auto& result : results)
+        {
+            result.ScalingEfficiency =
+                result.NumThreads > 0 ? result.InferencesPerSecond / (result.NumThreads * baselinePerThread) : 0;
+        }
+    }
+    return results;
+}
@@ -0,0 +1,313 @@
+#pragma once
+
+#include <algorithm>
+#include <charconv>
+#include <cstdint>
+#include <cstring>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <vector>
+#include "MappedFile.h"
+#include "ThreadPool.h"
+
+// Reader for numeric CSV / TSV input files.
+//
+// The file is memory mapped and parsed in place: values may be separated by commas, tabs or spaces, every line break
+// ends a row and empty fields (e.g. a trailing comma) are skipped. Numbers are parsed without going through the C
+// locale, so a decimal comma locale cannot change the result. Large files are split into chunks at separator
+// characters and the chunks are parsed in parallel. Nothing in here depends on WinML.
+namespace CsvReader
+{
+    struct CsvData
+    {
+        std::vector<float> Values;   // every value of the file, in file order
+        std::vector<size_t> RowSizes; // number of values on each line that has any
+
+        // Number of values on every row, or 0 if the rows have different lengths.
+        size_t GetUniformRowSize() const
+        {
+            if (RowSizes.empty())
+            {
+                return 0;
+            }
+            for (size_t rowSize : RowSizes)
+            {
+                if (rowSize != RowSizes.front())
+                {
+                    return 0;
+                }
+            }
+            return RowSizes.front();
+        }
+    };
+
+    inline bool IsSeparator(char c) { return c == ',' || c == '\t' || c == ' ' || c == '\r' || c == '\n'; }
+
+    inline bool IsDigit(char c) { return static_cast<unsigned>(c - '0') < 10; }
+
+    // SWAR helpers for reading eight ASCII digits at once from a little endian 64 bit load.
+    inline bool IsEightDigits(uint64_t chars)
+    {
+        return ((chars & 0xF0F0F0F0F0F0F0F0ull) |
+                (((chars + 0x0606060606060606ull) & 0xF0F0F0F0F0F0F0F0ull) >> 4)) == 0x3333333333333333ull;
+    }
+
+    inline uint32_t ParseEightDigits(uint64_t chars)
+    {
+        chars -= 0x3030303030303030ull;
+        chars = (chars * 10) + (chars >> 8); // pairs of digits
+        chars = (((chars & 0x000000FF000000FFull) * 0x000F424000000064ull) +
+                 (((chars >> 16) & 0x000000FF000000FFull) * 0x0000271000000001ull)) >>
+                32;
+        return static_cast<uint32_t>(chars);
+    }
+
+    // Accumulates the run of digits at p into mantissa, eight at a time while they fit. Digits that no longer fit in
+    // the mantissa are counted in droppedDigits, and truncated is set if any of them is not a zero. Returns the position
+    // after the run.
+    inline const char* ConsumeDigits(const char* p, const char* end, uint64_t& mantissa, int& droppedDigits,
+                                     bool& truncated)
+    {
+        while (end - p >= 8 && mantissa < 100000000000ull)
+        {
+            uint64_t chars;
+            std::memcpy(&chars, p, sizeof(chars));
+            if (!IsEightDigits(chars))
+            {
+                break;
+            }
+            mantissa = mantissa * 100000000 + ParseEightDigits(chars);
+            p += 8;
+        }
+        for (; p < end && IsDigit(*p); ++p)
+        {
+            if (mantissa < 1000000000000000000ull)
+            {
+                mantissa = mantissa * 10 + static_cast<unsigned>(*p - '0');
+            }
+            else
+            {
+                ++droppedDigits;
+                truncated |= *p != '0';
+            }
+        }
+        return p;
+    }
+
+    // Parses one number starting at begin and returns the position after it, or nullptr if there is no valid number.
+    // Numbers whose digits fit in a 64 bit mantissa of at most 2^53 and whose decimal exponent is within [-22, 22] are
+    // converted with a single correctly rounded double operation. The rare doubles that sit exactly halfway between two
+    // floats, and everything else (long mantissas, large exponents, inf, nan), go to std::from_chars. Either way the
+    // result is the correctly rounded float.
+    inline const char* ParseFloat(const char* begin, const char* end, float& value)
+    {
+        static const double powersOf10[] = { 1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+                                             1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22 };
+        const char* p = begin;
+        bool negative = false;
+        if (p < end && (*p == '-' || *p == '+'))
+        {
+            negative = *p == '-';
+            ++p;
+        }
+        const char* numberBegin = p; // std::from_chars does not accept a leading '+'
+
+        uint64_t mantissa = 0;
+        int exponent = 0;
+        bool truncated = false;
+        p = ConsumeDigits(p, end, mantissa, exponent, truncated);
+        bool sawDigit = p != numberBegin;
+        if (p < end && *p == '.')
+        {
+            const char* fractionBegin = ++p;
+            int droppedDigits = 0;
+            p = ConsumeDigits(p, end, mantissa, droppedDigits, truncated);
+            exponent -= static_cast<int>(p - fractionBegin) - droppedDigits;
+            sawDigit |= p != fractionBegin;
+        }
+        if (sawDigit && p < end && (*p == 'e' || *p == 'E'))
+        {
+            const char* exponentBegin = p++;
+            bool negativeExponent = false;
+            if (p < end && (*p == '-' || *p == '+'))
+            {
+                negativeExponent = *p == '-';
+                ++p;
+            }
+            if (p < end && IsDigit(*p))
+            {
+                int explicitExponent = 0;
+                for (; p < end && IsDigit(*p); ++p)
+                {
+                    explicitExponent = (std::min)(explicitExponent * 10 + (*p - '0'), 100000);
+                }
+                exponent += negativeExponent ? -explicitExponent : explicitExponent;
+            }
+            else
+            {
+                p = exponentBegin; // 'e' without digits is not part of the number
+            }
+        }
+
+        if (sawDigit && !truncated && mantissa <= (1ull << 53) && exponent >= -22 && exponent <= 22)
+        {
+            double result = static_cast<double>(mantissa);
+            result = exponent >= 0 ? result * powersOf10[exponent] : result / powersOf10[-exponent];
+            // Rounding a double that is exactly halfway between two floats could round the decimal the wrong way, and
+            // results outside the normal float range need the overflow and subnormal handling of from_chars
+            uint64_t bits;
+            std::memcpy(&bits, &result, sizeof(bits));
+            bool halfway = (bits & ((1ull << 29) - 1)) == (1ull << 28);
+            if (result == 0 || (!halfway && result >= 1.1754943508222875e-38 && result <= 3.4028234663852886e38))
+            {
+                value = static_cast<float>(negative ? -result : result);
+                return p;
+            }
+        }
+
+        if (numberBegin != begin && numberBegin < end && *numberBegin == '-')
+        {
+            return nullptr; // two signs
+        }
+        auto parsed = std::from_chars(numberBegin, end, value);
+        if (parsed.ec != std::errc())
+        {
+            return nullptr;
+        }
+        value = negative ? -value : value;
+        return parsed.ptr;
+    }
+
+    // Values parsed from one chunk of the file, and the number of values parsed before each line break in the chunk.
+    struct ChunkResult
+    {
+        std::vector<float> Values;
+        std::vector<size_t> LineBreaks;
+    };
+
+    inline void ParseChunk(const char* begin, const char* end, const char* fileBegin, ChunkResult& result)
+    {
+        const char* p = begin;
+        while (p < end)
+        {
+            if (*p == '\n')
+            {
+                result.LineBreaks.push_back(result.Values.size());
+                ++p;
+                continue;
+            }
+            if (IsSeparator(*p))
+            {
+                ++p;
+                continue;
+            }
+            float value;
+            const char* next = ParseFloat(p, end, value);
+            if (next == nullptr || (next < end && !IsSeparator(*next)))
+            {
+                throw std::invalid_argument("CsvReader: invalid number at byte " + std::to_string(p - fileBegin));
+            }
+            result.Values.push_back(value);
+            p = next;
+        }
+    }
+
+    // Files smaller than this are parsed on the calling thread.
+    const size_t ParallelParseThreshold = 1024 * 1024;
+
+    inline CsvData ParseCsv(const char* data, size_t size, ThreadPool* pool = nullptr)
+    {
+        const char* begin = data;
+        const char* end = data + size;
+        if (size >= 3 && std::memcmp(begin, "\xEF\xBB\xBF", 3) == 0)
+        {
+            begin += 3; // UTF-8 byte order mark
+        }
+
+        // Split into chunks that each start right after a separator, so that no number spans two chunks
+        size_t numChunks = 1;
+        if (pool != nullptr && pool->NumThreads() > 0 && size >= ParallelParseThreshold)
+        {
+            numChunks = 4 * (static_cast<size_t>(pool->NumThreads()) + 1);
+        }
+        std::vector<const char*> chunkBegins = { begin };
+        for (size_t chunk = 1; chunk < numChunks; ++chunk)
+        {
+            const char* boundary = (std::max)(chunkBegins.back(), begin + (end - begin) * chunk / numChunks);
+            while (boundary < end && !IsSeparator(*boundary))
+            {
+                ++boundary;
+            }
+            chunkBegins.push_back(boundary < end ? boundary + 1 : end);
+        }
+        chunkBegins.push_back(end);
+
+        std::vector<ChunkResult> chunkResults(numChunks);
+        auto parseChunk = [&](size_t chunk) {
+            chunkResults[chunk].Values.reserve((chunkBegins[chunk + 1] - chunkBegins[chunk]) / 4);
+            ParseChunk(chunkBegins[chunk], chunkBegins[chunk + 1], data, chunkResults[chunk]);
+        };
+        if (numChunks > 1)
+        {
+            pool->ParallelFor(0, numChunks, parseChunk, 1);
+        }
+        else
+        {
+            parseChunk(0);
+        }
+
+        CsvData csvData;
+        size_t totalValues = 0;
+        for (const auto& chunkResult : chunkResults)
+        {
+            totalValues += chunkResult.Values.size();
+        }
+        csvData.Values.reserve(totalValues);
+        size_t rowBegin = 0;
+        for (const auto& chunkResult : chunkResults)
+        {
+            size_t chunkOffset = csvData.Values.size();
+            for (size_t lineBreak : chunkResult.LineBreaks)
+            {
+                if (chunkOffset + lineBreak > rowBegin)
+                {
+                    csvData.RowSizes.push_back(chunkOffset + lineBreak - rowBegin);
+                }
+                rowBegin = chunkOffset + lineBreak;
+            }
+            csvData.Values.insert(csvData.Values.end(), chunkResult.Values.begin(), chunkResult.Values.end());
+        }
+        if (csvData.Values.size() > rowBegin)
+        {
+            csvData.RowSizes.push_back(csvData.Values.size() - rowBegin);
+        }
+        return csvData;
+    }
+
+    inline CsvData ReadCsvFile(const std::wstring& path, ThreadPool* pool = nullptr)
+    {
+        MappedFile file(path);
+        return ParseCsv(file.Data(), file.Size(), pool);
+    }
+
+    // Parses each file once per process: later calls for the same path return the cached values.
+    inline std::shared_ptr<const CsvData> LoadCsvFile(const std::wstring& path, ThreadPool* pool = nullptr)
+    {
+        static std::mutex cacheMutex;
+        static std::map<std::wstring, std::shared_ptr<const CsvData>> cache;
+
+        std::lock_guard<std::mutex> lock(cacheMutex);
+        auto cached = cache.find(path);
+        if (cached != cache.end())
+        {
+            return cached->second;
+        }
+        auto csvData = std::make_shared<const CsvData>(ReadCsvFile(path, pool));
+        cache.emplace(path, csvData);
+        return csvData;
+    }
+} // namespace CsvReader
@@ -0,0 +1,299 @@
+#pragma once
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+#if defined(__linux__)
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+// CPU hardware counters of the measured intervals, for -HardwareCounters: cycles, instructions, branch, last level
+// cache and data TLB misses tell whether an interval is bound by compute or by memory, not just how long it took.
+//
+// On Linux the events are opened with perf_event_open for the user mode of the process, including the threads it
+// creates after they are opened (inherit), and run for as long as the CounterSet lives. An interval reads all of them
+// at its start and end. The events are opened in groups that the kernel schedules on the counters of a core together,
+// so that the cycles and instructions of an interval come from the same time. When there are more groups than
+// counters the kernel multiplexes them, and each count is scaled up by the time its event was enabled over the time it
+// was running. Other platforms open no events.
+// Nothing in here depends on WinML.
+namespace HardwareCounters
+{
+    // The indices of DefaultEvents
+    enum class HardwareEvent
+    {
+        Cycles,
+        Instructions,
+        BranchMisses,
+        LlcMisses,
+        DtlbMisses,
+    };
+
+    // The perf_event ABI values of the events, so that they can be described without linux/perf_event.h
+    const uint32_t PerfTypeHardware = 0;
+    const uint32_t PerfTypeSoftware = 1;
+    const uint32_t PerfTypeHardwareCache = 3;
+
+    struct EventDescription
+    {
+        const char* Name;        // key in the JSON report
+        const char* DisplayName; // in the console and CSV output
+        uint32_t Type;           // perf_event_attr::type
+        uint64_t Config;         // perf_event_attr::config
+        int Group;               // events of the same group are scheduled together
+    };
+
+    inline const std::vector<EventDescription>& DefaultEvents()
+    {
+        // Cycles and instructions in one group for the IPC, the misses in another. dTLB misses are read misses.
+        static const std::vector<EventDescription> events = {
+            { "cycles", "cycles", PerfTypeHardware, 0, 0 },
+            { "instructions", "instructions", PerfTypeHardware, 1, 0 },
+            { "branchMisses", "branch misses", PerfTypeHardware, 5, 0 },
+            { "llcMisses", "LLC misses", PerfTypeHardware, 3, 1 },
+            { "dtlbMisses", "dTLB misses", PerfTypeHardwareCache, 3 | (0 << 8) | (1 << 16), 1 },
+        };
+        return events;
+    }
+
+#if defined(__linux__)
+    static_assert(PerfTypeHardware == PERF_TYPE_HARDWARE && PerfTypeSoftware == PERF_TYPE_SOFTWARE &&
+                      PerfTypeHardwareCache == PERF_TYPE_HW_CACHE,
+                  "perf_event types");
+    static_assert(PERF_COUNT_HW_CPU_CYCLES == 0 && PERF_COUNT_HW_INSTRUCTIONS == 1 &&
+                      PERF_COUNT_HW_BRANCH_MISSES == 5 && PERF_COUNT_HW_CACHE_MISSES == 3 &&
+                      PERF_COUNT_HW_CACHE_DTLB == 3 && PERF_COUNT_HW_CACHE_OP_READ == 0 &&
+                      PERF_COUNT_HW_CACHE_RESULT_MISS == 1,
+                  "perf_event configs");
+#endif
+
+    // An event at one point in time: its count and the ns it was enabled and actually counting.
+    struct Reading
+    {
+        uint64_t Value = 0;
+        uint64_t Enabled = 0;
+        uint64_t Running = 0;
+        bool Valid = false; // false if the event is not open or could not be read
+    };
+
+    // One Reading per event of a CounterSet
+    using Snapshot = std::vector<Reading>;
+
+    // The counts of an interval, one per event, scaled for multiplexing.
+    struct IntervalCounts
+    {
+        std::vector<double> Values;
+        std::vector<bool> Valid; // false if the event did not run at all during the interval
+    };
+
+    // The counts between two snapshots. An event that ran for part of the interval is scaled up to all of it, as
+    // perf stat does.
+    inline IntervalCounts Difference(const Snapshot& start, const Snapshot& end)
+    {
+        IntervalCounts counts;
+        size_t events = (std::min)(start.size(), end.size());
+        counts.Values.assign(events, 0);
+        counts.Valid.assign(events, false);
+        for (size_t i = 0; i < events; ++i)
+        {
+            if (!start[i].Valid || !end[i].Valid || end[i].Value < start[i].Value)
+            {
+                continue;
+            }
+            double value = static_cast<double>(end[i].Value - start[i].Value);
+            uint64_t enabled = end[i].Enabled - start[i].Enabled;
+            uint64_t running = end[i].Running - start[i].Running;
+            if (running > 0)
+            {
+                counts.Values[i] = value * static_cast<double>(enabled) / static_cast<double>(running);
+                counts.Valid[i] = true;
+            }
+            else if (enabled == 0)
+            {
+                counts.Values[i] = value; // an empty interval
+                counts.Valid[i] = true;
+            }
+        }
+        return counts;
+    }
+
+    // The sum of the counts of the intervals, per event.
+    class CounterTotals
+    {
+    public:
+        void Reset()
+        {
+            m_sums.clear();
+            m_counts.clear();
+            m_intervals = 0;
+        }
+
+        void Add(const IntervalCounts& counts)
+        {
+            if (m_sums.size() < counts.Values.size())
+            {
+                m_sums.resize(counts.Values.size(), 0);
+                m_counts.resize(counts.Values.size(), 0);
+            }
+            for (size_t i = 0; i < counts.Values.size(); ++i)
+            {
+                if (counts.Valid[i])
+                {
+                    m_sums[i] += counts.Values[i];
+                    m_counts[i]++;
+                }
+            }
+            m_intervals++;
+        }
+
+        uint64_t GetIntervalCount() const { return m_intervals; }
+        // Whether any interval counted event
+        bool HasEvent(size_t event) const { return event < m_counts.size() && m_counts[event] > 0; }
+        double GetAverage(size_t event) const { return HasEvent(event) ? m_sums[event] / m_counts[event] : 0; }
+        // GetAverage(numerator) / GetAverage(denominator), e.g. the instructions per cycle, 0 if either is missing
+        double GetRatio(size_t numerator, size_t denominator) const
+        {
+            double average = GetAverage(denominator);
+            return HasEvent(numerator) && average > 0 ? GetAverage(numerator) / average : 0;
+        }
+
+    private:
+        std::vector<double> m_sums;
+        std::vector<uint64_t> m_counts;
+        uint64_t m_intervals = 0;
+    };
+
+    inline size_t Index(HardwareEvent event) { return static_cast<size_t>(event); }
+
+    // The events of DefaultEvents, or others, opened for the current process for the lifetime of the object. Events
+    // that cannot be opened, e.g. without a PMU in a virtual machine or with a high perf_event_paranoid, read as not
+    // valid and GetError tells why.
+    class CounterSet
+    {
+    public:
+        explicit CounterSet(const std::vector<EventDescription>& events = DefaultEvents())
+            : m_events(events), m_files(events.size(), -1)
+        {
+#if defined(__linux__)
+            std::vector<int> leaders;
+            std::vector<int> groups;
+            for (size_t i = 0; i < m_events.size(); ++i)
+            {
+                auto group = std::find(groups.begin(), groups.end(), m_events[i].Group);
+                int leader = group != groups.end() ? leaders[group - groups.begin()] : -1;
+                m_files[i] = Open(m_events[i], leader);
+                if (m_files[i] < 0 && leader >= 0)
+                {
+                    // The group may not fit on the counters of a core, count the event on its own then
+                    m_files[i] = Open(m_events[i], -1);
+                }
+                if (m_files[i] < 0)
+                {
+                    if (m_error.empty())
+                    {
+                        m_error = std::string("could not open ") + m_events[i].DisplayName + ": " + Explain(errno);
+                    }
+                }
+                else if (leader < 0)
+                {
+                    leaders.push_back(m_files[i]);
+                    groups.push_back(m_events[i].Group);
+                }
+            }
+#else
+            m_error = "hardware counters need perf_event on Linux";
+#endif
+        }
+
+        ~CounterSet()
+        {
+#if defined(__linux__)
+            // Members before their leaders
+            for (size_t i = m_files.size(); i-- > 0;)
+            {
+                if (m_files[i] >= 0)
+                {
+                    close(m_files[i]);
+                }
+            }
+#endif
+        }
+
+        CounterSet(const CounterSet&) = delete;
+        CounterSet& operator=(const CounterSet&) = delete;
+
+        const std::vector<EventDescription>& GetEvents() const { return m_events; }
+        bool IsOpen(size_t event) const { return m_files[event] >= 0; }
+        size_t GetOpenCount() const
+        {
+            size_t open = 0;
+            for (int file : m_files)
+            {
+                open += file >= 0 ? 1 : 0;
+            }
+            return open;
+        }
+        // Why the first event that is not open could not be opened
+        const std::string& GetError() const { return m_error; }
+
+        Snapshot Read() const
+        {
+            Snapshot snapshot(m_files.size());
+#if defined(__linux__)
+            for (size_t i = 0; i < m_files.size(); ++i)
+            {
+                uint64_t values[3];
+                if (m_files[i] >= 0 && read(m_files[i], values, sizeof(values)) == sizeof(values))
+                {
+                    snapshot[i].Value = values[0];
+                    snapshot[i].Enabled = values[1];
+                    snapshot[i].Running = values[2];
+                    snapshot[i].Valid = true;
+                }
+            }
+#endif
+            return snapshot;
+        }
+
+    private:
+#if defined(__linux__)
+        static std::string Explain(int error)
+        {
+            switch (error)
+            {
+            case ENOENT:
+            case EOPNOTSUPP:
+                return "the CPU, or the virtual machine, does not count it";
+            case EACCES:
+            case EPERM:
+                return "not permitted, see /proc/sys/kernel/perf_event_paranoid";
+            default:
+                return std::strerror(error);
+            }
+        }
+
+        static int Open(const EventDescription& event, int leader)
+        {
+            perf_event_attr attributes;
+            std::memset(&attributes, 0, sizeof(attributes));
+            attributes.size = sizeof(attributes);
+            attributes.type = event.Type;
+            attributes.config = event.Config;
+            attributes.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+            attributes.inherit = 1;
+            attributes.exclude_kernel = 1;
+            attributes.exclude_hv = 1;
+            return static_cast<int>(syscall(SYS_perf_event_open, &attributes, 0, -1, leader, 0));
+        }
+#endif
+
+        std::vector<EventDescription> m_events;
+        std::vector<int> m_files;
+        std::string m_error;
+    };
+} // namespace HardwareCounters
@@ -0,0 +1,260 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <stdexcept>
+#include <vector>
+
+// Decides how many iterations a model has to be evaluated for its latency statistic to be known well enough. Warmup
+// iterations at the start are found with MSER-5 (the truncation point that minimizes the standard error of the mean of
+// the rest) and left out. The confidence interval of the median or p99 of the remaining iterations comes from the
+// order statistics around it, which holds for any latency distribution, and the run converges once the interval is
+// within the target relative error of the statistic. An iteration and a time limit cap runs that never get there.
+// Nothing in here depends on WinML.
+namespace IterationConvergence
+{
+    enum class LatencyStatistic
+    {
+        Median,
+        P99,
+    };
+
+    inline double GetPercentile(LatencyStatistic statistic) { return statistic == LatencyStatistic::P99 ? 99.0 : 50.0; }
+
+    inline const char* GetStatisticName(LatencyStatistic statistic)
+    {
+        return statistic == LatencyStatistic::P99 ? "p99" : "median";
+    }
+
+    enum class StopReason
+    {
+        None, // keep iterating
+        Converged,
+        MaxIterations,
+        MaxTime,
+    };
+
+    inline const char* GetStopReasonName(StopReason reason)
+    {
+        switch (reason)
+        {
+            case StopReason::Converged:
+                return "converged";
+            case StopReason::MaxIterations:
+                return "iteration limit";
+            case StopReason::MaxTime:
+                return "time limit";
+            default:
+                return "running";
+        }
+    }
+
+    struct ConvergenceOptions
+    {
+        LatencyStatistic Statistic = LatencyStatistic::Median;
+        double TargetRelativeError = 0.02; // largest distance of a confidence bound from the statistic, relative to it
+        double Confidence = 0.95;
+        uint32_t MinIterations = 10;       // measured iterations, after the warmup, before the run can converge
+        uint32_t MaxIterations = 1000;     // warmup included, 0 for no limit
+        double MaxMilliseconds = 0;        // 0 for no limit
+    };
+
+    struct ConvergenceResult
+    {
+        StopReason Reason = StopReason::None;
+        uint32_t Iterations = 0;
+        uint32_t WarmupIterations = 0;
+        uint32_t MeasuredIterations = 0;
+        bool HasBounds = false;     // too few measured iterations for a confidence interval of the statistic otherwise
+        double Estimate = 0;        // the statistic over the measured iterations, in ms
+        double Lower = 0;           // confidence bounds, in ms
+        double Upper = 0;
+        double RelativeError = 0;   // largest distance of a bound from the estimate, relative to it
+    };
+
+    // Quantile of the standard normal distribution (Acklam's approximation, relative error below 1.2e-9).
+    inline double NormalQuantile(double p)
+    {
+        if (p <= 0 || p >= 1)
+        {
+            throw std::invalid_argument("NormalQuantile: p must be in (0, 1)");
+        }
+        static const double a[] = { -3.969683028665376e+01, 2.209460984245205e+02, -2.759285104469687e+02,
+                                    1.383577518672690e+02,  -3.066479806614716e+01, 2.506628277459239e+00 };
+        static const double b[] = { -5.447609879822406e+01, 1.615858368580409e+02, -1.556989798598866e+02,
+                                    6.680131188771972e+01,  -1.328068155288572e+01 };
+        static const double c[] = { -7.784894002430293e-03, -3.223964580411365e-01, -2.400758277161838e+00,
+                                    -2.549732539343734e+00, 4.374664141464968e+00,  2.938163982698783e+00 };
+        static const double d[] = { 7.784695709041462e-03, 3.224671290700398e-01, 2.445134137142996e+00,
+                                    3.754408661907416e+00 };
+        const double low = 0.02425;
+        if (p < low || p > 1 - low)
+        {
+            double q = std::sqrt(-2 * std::log(p < low ? p : 1 - p));
+            double x = (((((c[0] * q + c[1]) * q + c[2]) * q + c[3]) * q + c[4]) * q + c[5]) /
+                       ((((d[0] * q + d[1]) * q + d[2]) * q + d[3]) * q + 1);
+            return p < low ? x : -x;
+        }
+        double q = p - 0.5;
+        double r = q * q;
+        return (((((a[0] * r + a[1]) * r + a[2]) * r + a[3]) * r + a[4]) * r + a[5]) * q /
+               (((((b[0] * r + b[1]) * r + b[2]) * r + b[3]) * r + b[4]) * r + 1);
+    }
+
+    // MSER-5: the number of leading values to drop, a multiple of 5 and at most half of them. The values are averaged
+    // in batches of 5, and the batches dropped are those that minimize the variance of the remaining batch means
+    // divided by the square of their count.
+    inline size_t FindWarmup(const std::vector<double>& values)
+    {
+        const size_t batchSize = 5;
+        size_t batches = values.size() / batchSize;
+        if (batches < 4)
+        {
+            return 0;
+        }
+        std::vector<double> means(batches);
+        for (size_t i = 0; i < batches; ++i)
+        {
+            double sum = 0;
+            for (size_t j = 0; j < batchSize; ++j)
+            {
+                sum += values[i * batchSize + j];
+            }
+            means[i] = sum / batchSize;
+        }
+
+        // Walk the truncation point back from the middle, adding one batch mean at a time (Welford)
+        size_t best = 0;
+        double bestScore = 0;
+        double mean = 0;
+        double sumOfSquaredDeltas = 0;
+        size_t count = 0;
+        for (size_t i = batches; i-- > 0;)
+        {
+            ++count;
+            double delta = means[i] - mean;
+            mean += delta / static_cast<double>(count);
+            sumOfSquaredDeltas += delta * (means[i] - mean);
+            if (i > batches / 2)
+            {
+                continue;
+            }
+            double score = sumOfSquaredDeltas / (static_cast<double>(count) * count);
+            if (i == batches / 2 || score <= bestScore)
+            {
+                best = i;
+                bestScore = score;
+            }
+        }
+        return best * batchSize;
+    }
+
+    // The statistic of values and its distribution-free confidence interval: the sorted values at the ranks of the
+    // binomial distribution of the number of values below the true percentile, by its normal approximation. Returns
+    // a result without bounds when the ranks fall outside of the values.
+    inline ConvergenceResult EstimatePercentile(std::vector<double> values, double percentile, double confidence)
+    {
+        ConvergenceResult result;
+        result.MeasuredIterations = static_cast<uint32_t>(values.size());
+        if (values.empty())
+        {
+            return result;
+        }
+        const double n = static_cast<double>(values.size());
+        const double p = percentile / 100;
+        auto valueAtRank = [&values](size_t rank) {
+            std::nth_element(values.begin(), values.begin() + (rank - 1), values.end());
+            return values[rank - 1];
+        };
+
+        // Nearest rank, as LatencyHistogram::GetPercentile
+        size_t rank = static_cast<size_t>((std::max)(1.0, std::ceil(p * n)));
+        result.Estimate = valueAtRank((std::min)(rank, values.size()));
+
+        double z = NormalQuantile(0.5 + confidence / 2);
+        double spread = z * std::sqrt(n * p * (1 - p));
+        double lowerRank = std::floor(n * p - spread);
+        double upperRank = std::ceil(n * p + spread) + 1;
+        if (lowerRank < 1 || upperRank > n)
+        {
+            return result;
+        }
+        result.HasBounds = true;
+        result.Lower = valueAtRank(static_cast<size_t>(lowerRank));
+        result.Upper = valueAtRank(static_cast<size_t>(upperRank));
+        result.RelativeError = result.Estimate > 0
+                                   ? (std::max)(result.Estimate - result.Lower, result.Upper - result.Estimate) /
+                                         result.Estimate
+                                   : 0;
+        return result;
+    }
+
+    // Fed with the latency of every iteration, first one included, and tells when to stop. Estimating sorts the
+    // measured iterations, so it only runs every 2% more iterations.
+    class ConvergenceMonitor
+    {
+    public:
+        explicit ConvergenceMonitor(const ConvergenceOptions& options) : m_options(options)
+        {
+            if (!(options.TargetRelativeError > 0) || !(options.Confidence > 0 && options.Confidence < 1))
+            {
+                throw std::invalid_argument("ConvergenceMonitor: invalid target relative error or confidence");
+            }
+        }
+
+        // Records an iteration that took latency ms, elapsed ms after the first iteration started. Returns true when
+        // the run should stop, GetResult tells why.
+        bool AddIteration(double latency, double elapsed)
+        {
+            m_latencies.push_back(latency);
+            uint32_t iterations = static_cast<uint32_t>(m_latencies.size());
+            if (iterations >= m_nextCheck)
+            {
+                m_nextCheck = iterations + (std::max)(1u, iterations / 50);
+                m_result = Estimate();
+                if (m_result.HasBounds && m_result.MeasuredIterations >= m_options.MinIterations &&
+                    m_result.RelativeError <= m_options.TargetRelativeError)
+                {
+                    m_result.Reason = StopReason::Converged;
+                    return true;
+                }
+            }
+            if (m_options.MaxIterations > 0 && iterations >= m_options.MaxIterations)
+            {
+                m_result = Estimate();
+                m_result.Reason = StopReason::MaxIterations;
+                return true;
+            }
+            if (m_options.MaxMilliseconds > 0 && elapsed >= m_options.MaxMilliseconds)
+            {
+                m_result = Estimate();
+                m_result.Reason = StopReason::MaxTime;
+                return true;
+            }
+            return false;
+        }
+
+        // The result of the last estimate, or of the one that stopped the run.
+        const ConvergenceResult& GetResult() const { return m_result; }
+
+        const ConvergenceOptions& GetOptions() const { return m_options; }
+
+    private:
+        ConvergenceResult Estimate() const
+        {
+            size_t warmup = FindWarmup(m_latencies);
+            ConvergenceResult result =
+                EstimatePercentile(std::vector<double>(m_latencies.begin() + warmup, m_latencies.end()),
+                                   GetPercentile(m_options.Statistic), m_options.Confidence);
+            result.Iterations = static_cast<uint32_t>(m_latencies.size());
+            result.WarmupIterations = static_cast<uint32_t>(warmup);
+            return result;
+        }
+
+        ConvergenceOptions m_options;
+        std::vector<double> m_latencies;
+        uint32_t m_nextCheck = 1;
+        ConvergenceResult m_result;
+    };
+} // namespace IterationConvergence
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <optional>
+#include <utility>
+
+// The input features and binding of each bind and evaluate iteration. By default both are made again for every
+// iteration, as a separate run would. In steady state mode they are made for the first iteration and reused by the
+// others, so that the bind and evaluate measurements don't include allocation and input decode. Nothing in here
+// depends on WinML: the features and the binding are made by the caller's functions, so a stub session can drive it in
+// tests.
+template <typename Features, typename Binding> class IterationInputs
+{
+public:
+    // Fills the input features of an iteration, returns false if that failed
+    typedef std::function<bool(Features& features, uint32_t iteration)> PrepareFunction;
+    typedef std::function<Binding()> CreateBindingFunction;
+
+    IterationInputs(bool steadyState, PrepareFunction prepare, CreateBindingFunction createBinding)
+        : m_steadyState(steadyState), m_prepare(std::move(prepare)), m_createBinding(std::move(createBinding))
+    {
+    }
+
+    // Makes the features and the binding of the iteration, unless the ones of an earlier iteration are reused.
+    // Returns false if preparing the features failed.
+    bool BeginIteration(uint32_t iteration)
+    {
+        if (m_steadyState && m_binding)
+        {
+            return true;
+        }
+        m_binding.reset();
+        if (!m_prepare(m_features, iteration))
+        {
+            return false;
+        }
+        ++m_preparedCount;
+        m_binding.emplace(m_createBinding());
+        ++m_bindingCount;
+        return true;
+    }
+
+    // The features and the binding of the current iteration, after BeginIteration succeeded
+    const Features& GetFeatures() const { return m_features; }
+    Binding& GetBinding() { return *m_binding; }
+
+    // How many times the features were prepared and a binding created
+    size_t GetPreparedCount() const { return m_preparedCount; }
+    size_t GetBindingCount() const { return m_bindingCount; }
+
+private:
+    bool m_steadyState;
+    PrepareFunction m_prepare;
+    CreateBindingFunction m_createBinding;
+    Features m_features;
+    std::optional<Binding> m_binding;
+    size_t m_preparedCount = 0;
+    size_t m_bindingCount = 0;
+};
@@ -0,0 +1,234 @@
+#pragma once
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstdint>
+#include <stdexcept>
+#include <vector>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+// A log-bucketed, mergeable histogram for latency style measurements (HdrHistogram layout).
+//
+// Values are quantized to integer units (value * unitsPerValue) and stored in buckets whose width doubles with
+// every power of two, while each power of two is split into 2^subBucketBits linear sub-buckets. This bounds the
+// relative error of a percentile to 2^-subBucketBits while keeping memory constant regardless of how many values
+// are recorded. Count, total, min, max, mean and variance are tracked exactly. Negative values contribute to the
+// exact statistics but are recorded in the zero bucket for percentile queries.
+class LatencyHistogram
+{
+public:
+    // unitsPerValue : quantization of a recorded value. 1000 means a value in milliseconds is tracked to the microsecond.
+    // subBucketBits : log2 of the number of linear sub-buckets per power of two, which sets the relative precision.
+    // maxValueBits  : log2 of the largest quantized value that can be tracked. Larger values are clamped.
+    explicit LatencyHistogram(double unitsPerValue = 1000.0, uint32_t subBucketBits = 7, uint32_t maxValueBits = 40)
+        : m_unitsPerValue(unitsPerValue), m_subBucketHalfCountMagnitude(subBucketBits),
+          m_subBucketHalfCount(1ull << subBucketBits), m_subBucketMask((2ull << subBucketBits) - 1),
+          m_maxTrackableUnits(maxValueBits >= 63 ? INT64_MAX : (1ll << maxValueBits) - 1)
+    {
+        if (unitsPerValue <= 0 || subBucketBits == 0 || subBucketBits > 16 || maxValueBits <= subBucketBits + 1 ||
+            maxValueBits > 63)
+        {
+            throw std::invalid_argument("LatencyHistogram: invalid configuration");
+        }
+
+        // Number of power of two buckets needed so that m_maxTrackableUnits falls in the last one
+        uint32_t bucketCount = 1;
+        uint64_t smallestUntrackableValue = m_subBucketHalfCount << 1;
+        while (smallestUntrackableValue <= static_cast<uint64_t>(m_maxTrackableUnits))
+        {
+            if (smallestUntrackableValue > (UINT64_MAX >> 1))
+            {
+                ++bucketCount;
+                break;
+            }
+            smallestUntrackableValue <<= 1;
+            ++bucketCount;
+        }
+        m_counts.resize(static_cast<size_t>(bucketCount + 1) << m_subBucketHalfCountMagnitude, 0);
+        Reset();
+    }
+
+    void Reset()
+    {
+        std::fill(m_counts.begin(), m_counts.end(), 0);
+        m_count = 0;
+        m_total = 0;
+        m_mean = 0;
+        m_sumOfSquaredDeltas = 0;
+        m_min = DBL_MAX;
+        m_max = -DBL_MAX;
+    }
+
+    // O(1): one bucket increment plus a running (Welford) update of the exact moments.
+    void Record(double value)
+    {
+        ++m_counts[CountsIndexForUnits(ToUnits(value))];
+        ++m_count;
+        m_total += value;
+        double delta = value - m_mean;
+        m_mean += delta / static_cast<double>(m_count);
+        m_sumOfSquaredDeltas += delta * (value - m_mean);
+        m_min = (value < m_min) ? value : m_min;
+        m_max = (value > m_max) ? value : m_max;
+    }
+
+    // Adds the samples of another histogram with the same configuration to this one.
+    void Merge(const LatencyHistogram& other)
+    {
+        if (other.m_counts.size() != m_counts.size() || other.m_unitsPerValue != m_unitsPerValue ||
+            other.m_subBucketHalfCountMagnitude != m_subBucketHalfCountMagnitude)
+        {
+            throw std::invalid_argument("LatencyHistogram: cannot merge histograms with different configurations");
+        }
+        if (other.m_count == 0)
+        {
+            return;
+        }
+        for (size_t i = 0; i < m_counts.size(); ++i)
+        {
+            m_counts[i] += other.m_counts[i];
+        }
+
+        // Chan et al. pairwise combination of mean and sum of squared deltas
+        uint64_t combinedCount = m_count + other.m_count;
+        double delta = other.m_mean - m_mean;
+        m_sumOfSquaredDeltas += other.m_sumOfSquaredDeltas + delta * delta * static_cast<double>(m_count) *
+                                                                 static_cast<double>(other.m_count) /
+                                                                 static_cast<double>(combinedCount);
+        m_mean += delta * static_cast<double>(other.m_count) / static_cast<double>(combinedCount);
+        m_count = combinedCount;
+        m_total += other.m_total;
+        m_min = (other.m_min < m_min) ? other.m_min : m_min;
+        m_max = (other.m_max > m_max) ? other.m_max : m_max;
+    }
+
+    uint64_t GetCount() const { return m_count; }
+    double GetTotal() const { return m_total; }
+    double GetMean() const { return m_count == 0 ? 0 : m_mean; }
+    double GetMin() const { return m_count == 0 ? 0 : m_min; }
+    double GetMax() const { return m_count == 0 ? 0 : m_max; }
+    double GetVariance() const { return m_count == 0 ? 0 : m_sumOfSquaredDeltas / static_cast<double>(m_count); }
+    double GetStdev() const { return sqrt(GetVariance()); }
+
+    // Value at the given percentile in [0, 100]. The result is the midpoint of the bucket that holds the requested
+    // rank, clamped to the exact min and max, so it is within the relative precision of the histogram.
+    double GetPercentile(double percentile) const
+    {
+        if (m_count == 0)
+        {
+            return 0;
+        }
+        percentile = percentile < 0 ? 0 : (percentile > 100 ? 100 : percentile);
+        uint64_t targetRank = static_cast<uint64_t>(ceil(percentile / 100.0 * static_cast<double>(m_count)));
+        targetRank = targetRank == 0 ? 1 : targetRank;
+
+        uint64_t runningCount = 0;
+        for (size_t i = 0; i < m_counts.size(); ++i)
+        {
+            runningCount += m_counts[i];
+            if (runningCount >= targetRank)
+            {
+                double lowest = static_cast<double>(LowestUnitsForIndex(i));
+                double width = static_cast<double>(BucketWidthForIndex(i));
+                double value = (lowest + (width - 1) / 2.0) / m_unitsPerValue;
+                value = value < m_min ? m_min : value;
+                return value > m_max ? m_max : value;
+            }
+        }
+        return m_max;
+    }
+
+    // Largest relative error of a percentile query for values well above the unit resolution.
+    double GetRelativePrecision() const { return 1.0 / static_cast<double>(m_subBucketHalfCount); }
+
+    // Calls visit(lowestValue, highestValue, count) for every bucket that holds values, from the lowest bucket up. A
+    // bucket holds the values that quantize to [lowestValue, highestValue].
+    template <typename F> void ForEachBucket(F&& visit) const
+    {
+        for (size_t i = 0; i < m_counts.size(); ++i)
+        {
+            if (m_counts[i] != 0)
+            {
+                uint64_t lowest = LowestUnitsForIndex(i);
+                visit(static_cast<double>(lowest) / m_unitsPerValue,
+                      static_cast<double>(lowest + BucketWidthForIndex(i) - 1) / m_unitsPerValue, m_counts[i]);
+            }
+        }
+    }
+
+private:
+    static uint32_t CountLeadingZeros(uint64_t value)
+    {
+#if defined(_MSC_VER) && defined(_M_X64)
+        unsigned long index;
+        return _BitScanReverse64(&index, value) ? 63 - index : 64;
+#elif defined(__GNUC__) || defined(__clang__)
+        return value == 0 ? 64 : static_cast<uint32_t>(__builtin_clzll(value));
+#else
+        uint32_t count = 0;
+        for (uint64_t bit = 1ull << 63; bit != 0 && (value & bit) == 0; bit >>= 1)
+        {
+            ++count;
+        }
+        return count;
+#endif
+    }
+
+    uint64_t ToUnits(double value) const
+    {
+        double units = value * m_unitsPerValue + 0.5;
+        if (!(units > 0))
+        {
+            return 0;
+        }
+        if (units >= static_cast<double>(m_maxTrackableUnits))
+        {
+            return static_cast<uint64_t>(m_maxTrackableUnits);
+        }
+        return static_cast<uint64_t>(units);
+    }
+
+    size_t CountsIndexForUnits(uint64_t units) const
+    {
+        uint32_t pow2Ceiling = 64 - CountLeadingZeros(units | m_subBucketMask);
+        uint32_t bucketIndex = pow2Ceiling - (m_subBucketHalfCountMagnitude + 1);
+        uint64_t subBucketIndex = units >> bucketIndex;
+        return (static_cast<size_t>(bucketIndex + 1) << m_subBucketHalfCountMagnitude) +
+               static_cast<size_t>(subBucketIndex - m_subBucketHalfCount);
+    }
+
+    uint64_t LowestUnitsForIndex(size_t index) const
+    {
+        int64_t bucketIndex = static_cast<int64_t>(index >> m_subBucketHalfCountMagnitude) - 1;
+        uint64_t subBucketIndex = (index & (m_subBucketHalfCount - 1)) + m_subBucketHalfCount;
+        if (bucketIndex < 0)
+        {
+            subBucketIndex -= m_subBucketHalfCount;
+            bucketIndex = 0;
+        }
+        return subBucketIndex << bucketIndex;
+    }
+
+    uint64_t BucketWidthForIndex(size_t index) const
+    {
+        int64_t bucketIndex = static_cast<int64_t>(index >> m_subBucketHalfCountMagnitude) - 1;
+        return 1ull << (bucketIndex < 0 ? 0 : bucketIndex);
+    }
+
+    double m_unitsPerValue;
+    uint32_t m_subBucketHalfCountMagnitude;
+    uint64_t m_subBucketHalfCount;
+    uint64_t m_subBucketMask;
+    int64_t m_maxTrackableUnits;
+    std::vector<uint64_t> m_counts;
+
+    uint64_t m_count;
+    double m_total;
+    double m_mean;
+    double m_sumOfSquaredDeltas;
+    double m_min;
+    double m_max;
+};
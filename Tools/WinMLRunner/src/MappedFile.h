@@ -0,0 +1,121 @@
+#pragma once
+
+#include <climits>
+#include <cstddef>
+#include <cstdlib>
+#include <stdexcept>
+#include <string>
+#if defined(_WIN32)
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// Read only memory mapping of a whole file.
+class MappedFile
+{
+public:
+    explicit MappedFile(const std::wstring& path)
+    {
+#if defined(_WIN32)
+        m_file = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+                             FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+        LARGE_INTEGER size;
+        if (m_file == INVALID_HANDLE_VALUE || !GetFileSizeEx(m_file, &size))
+        {
+            Close();
+            throw std::runtime_error("MappedFile: could not open file");
+        }
+        m_size = static_cast<size_t>(size.QuadPart);
+        if (m_size == 0)
+        {
+            return; // empty files cannot be mapped
+        }
+        m_mapping = CreateFileMappingW(m_file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        m_data = m_mapping ? static_cast<const char*>(MapViewOfFile(m_mapping, FILE_MAP_READ, 0, 0, 0)) : nullptr;
+#else
+        std::string narrowPath(path.size() * MB_LEN_MAX + 1, '\0');
+        size_t narrowLength = std::wcstombs(&narrowPath[0], path.c_str(), narrowPath.size());
+        if (narrowLength == static_cast<size_t>(-1))
+        {
+            throw std::runtime_error("MappedFile: could not open file");
+        }
+        narrowPath.resize(narrowLength);
+        m_file = open(narrowPath.c_str(), O_RDONLY);
+        struct stat status;
+        if (m_file < 0 || fstat(m_file, &status) != 0)
+        {
+            Close();
+            throw std::runtime_error("MappedFile: could not open file");
+        }
+        m_size = static_cast<size_t>(status.st_size);
+        if (m_size == 0)
+        {
+            return;
+        }
+        void* data = mmap(nullptr, m_size, PROT_READ, MAP_PRIVATE, m_file, 0);
+        if (data != MAP_FAILED)
+        {
+            madvise(data, m_size, MADV_SEQUENTIAL);
+            m_data = static_cast<const char*>(data);
+        }
+#endif
+        if (m_data == nullptr)
+        {
+            Close();
+            throw std::runtime_error("MappedFile: could not map file");
+        }
+    }
+
+    ~MappedFile() { Close(); }
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    const char* Data() const { return m_data; }
+    size_t Size() const { return m_size; }
+
+private:
+    void Close()
+    {
+#if defined(_WIN32)
+        if (m_data != nullptr)
+        {
+            UnmapViewOfFile(m_data);
+        }
+        if (m_mapping != nullptr)
+        {
+            CloseHandle(m_mapping);
+        }
+        if (m_file != INVALID_HANDLE_VALUE)
+        {
+            CloseHandle(m_file);
+        }
+        m_mapping = nullptr;
+        m_file = INVALID_HANDLE_VALUE;
+#else
+        if (m_data != nullptr)
+        {
+            munmap(const_cast<char*>(m_data), m_size);
+        }
+        if (m_file >= 0)
+        {
+            close(m_file);
+        }
+        m_file = -1;
+#endif
+        m_data = nullptr;
+    }
+
+#if defined(_WIN32)
+    HANDLE m_file = INVALID_HANDLE_VALUE;
+    HANDLE m_mapping = nullptr;
+#else
+    int m_file = -1;
+#endif
+    const char* m_data = nullptr;
+    size_t m_size = 0;
+};
@@ -9,10 +9,11 @@
 #include <dxgi.h>
 #include <Windows.Graphics.DirectX.Direct3D11.interop.h>
 #include <filesystem>
-#include <queue>
 #include "TimerHelper.h"
 #include "LearningModelDeviceHelper.h"
 #include "OutputHelper.h"
+#include "TensorResults.h"
+#include "TraceTimeline.h"
 
 #ifdef USE_WINML_NUGET
 using namespace winrt::Microsoft::AI::MachineLearning;
@@ -156,6 +157,102 @@ void OutputHelper::PrintLearningModelDevice(const LearningModelDeviceWithMetadat
     }
 }
 
+void OutputHelper::PrintPercentiles(const PerfCounterStatistics& counter, const char* name) const
+{
+    std::cout << "  Percentiles " << name << " (p50 / p90 / p99 / p99.9): "
+              << counter.GetPercentile(CounterType::TIMER, 50) << " / "
+              << counter.GetPercentile(CounterType::TIMER, 90) << " / "
+              << counter.GetPercentile(CounterType::TIMER, 99) << " / "
+              << counter.GetPercentile(CounterType::TIMER, 99.9) << " ms" << std::endl;
+}
+
+void OutputHelper::SetConvergenceResult(const IterationConvergence::ConvergenceOptions& options,
+                                        const IterationConvergence::ConvergenceResult& result)
+{
+    m_convergenceOptions = options;
+    m_convergenceResult = result;
+}
+
+void OutputHelper::PrintConvergenceResult() const
+{
+    using namespace IterationConvergence;
+    const ConvergenceResult& result = m_convergenceResult;
+    if (result.Reason == StopReason::None)
+    {
+        return;
+    }
+    std::cout << std::endl;
+    std::cout << "Convergence (" << GetStatisticName(m_convergenceOptions.Statistic) << " evaluate, "
+              << m_convergenceOptions.Confidence * 100 << "% confidence, target "
+              << m_convergenceOptions.TargetRelativeError * 100 << "%):" << std::endl;
+    std::cout << "  Stopped: " << GetStopReasonName(result.Reason) << " after " << result.Iterations
+              << " iterations (" << result.WarmupIterations << " warmup, " << result.MeasuredIterations
+              << " measured)" << std::endl;
+    if (result.HasBounds)
+    {
+        std::cout << "  " << GetStatisticName(m_convergenceOptions.Statistic) << ": " << result.Estimate << " ms ["
+                  << result.Lower << ", " << result.Upper << "], +/- " << result.RelativeError * 100 << "%"
+                  << std::endl;
+    }
+    else
+    {
+        std::cout << "  " << GetStatisticName(m_convergenceOptions.Statistic) << ": " << result.Estimate
+                  << " ms, too few measured iterations for a confidence interval" << std::endl;
+    }
+}
+
+void OutputHelper::PrintHardwareCounters(const Profiler<WINML_MODEL_TEST_PERF>& profiler) const
+{
+    static const std::pair<WINML_MODEL_TEST_PERF, const char*> intervals[] = {
+        { LOAD_MODEL, "Load" },
+        { CREATE_SESSION, "Session Creation" },
+        { BIND_VALUE_FIRST_RUN, "First Bind" },
+        { BIND_VALUE, "Bind" },
+        { EVAL_MODEL_FIRST_RUN, "First Evaluate" },
+        { EVAL_MODEL, "Evaluate" }
+    };
+    const HardwareCounters::CounterSet* counterSet = profiler.GetHardwareCounters();
+    if (counterSet == nullptr)
+    {
+        return;
+    }
+    const size_t cycles = HardwareCounters::Index(HardwareCounters::HardwareEvent::Cycles);
+    const size_t instructions = HardwareCounters::Index(HardwareCounters::HardwareEvent::Instructions);
+    const std::vector<HardwareCounters::EventDescription>& events = counterSet->GetEvents();
+
+    std::cout << std::endl;
+    std::cout << "Hardware counters (average per interval):" << std::endl;
+    for (const auto& interval : intervals)
+    {
+        if (!profiler[interval.first].HasHardwareCounters())
+        {
+            continue;
+        }
+        const HardwareCounters::CounterTotals& totals = profiler[interval.first].GetHardwareCounters();
+        std::cout << "  " << interval.second << ":";
+        const char* separator = " ";
+        for (size_t event = 0; event < events.size(); ++event)
+        {
+            if (!totals.HasEvent(event))
+            {
+                continue;
+            }
+            std::cout << separator << events[event].DisplayName << " "
+                      << static_cast<uint64_t>(totals.GetAverage(event));
+            if (event != cycles && event != instructions && totals.HasEvent(instructions))
+            {
+                std::cout << " (" << 1000 * totals.GetRatio(event, instructions) << " per 1k instructions)";
+            }
+            separator = ", ";
+        }
+        if (totals.HasEvent(cycles) && totals.HasEvent(instructions))
+        {
+            std::cout << separator << "IPC " << totals.GetRatio(instructions, cycles);
+        }
+        std::cout << std::endl;
+    }
+}
+
 void OutputHelper::PrintResults(const Profiler<WINML_MODEL_TEST_PERF>& profiler, uint32_t numIterations, DeviceType deviceType,
                     InputBindingType inputBindingType, InputDataType inputDataType,
                     DeviceCreationLocation deviceCreationLocation, bool isPerformanceConsoleOutputVerbose) const
@@ -339,6 +436,7 @@ void OutputHelper::PrintResults(const Profiler<WINML_MODEL_TEST_PERF>& profiler,
             std::cout << "  Minimum Bind: " << minBindTime << " ms" << std::endl;
             std::cout << "  Maximum Bind: " << maxBindTime << " ms" << std::endl;
             std::cout << "  Standard Deviation Bind: " << stdevBindTime << " ms" << std::endl;
+            PrintPercentiles(profiler[BIND_VALUE], "Bind");
         }
         std::cout << "  Average Evaluate: " << averageEvalTime << " ms" << std::endl;
         if (isPerformanceConsoleOutputVerbose)
@@ -346,6 +444,7 @@ void OutputHelper::PrintResults(const Profiler<WINML_MODEL_TEST_PERF>& profiler,
             std::cout << "  Minimum Evaluate: " << minEvalTime << " ms" << std::endl;
             std::cout << "  Maximum Evaluate: " << maxEvalTime << " ms" << std::endl;
             std::cout << "  Standard Deviation Evaluate: " << stdevEvalTime << " ms" << std::endl;
+            PrintPercentiles(profiler[EVAL_MODEL], "Evaluate");
         }
 
         std::cout << "\n  Average Working Set Memory usage (bind): " << averageBindMemoryUsage << " MB"
@@ -412,6 +511,68 @@ void OutputHelper::PrintResults(const Profiler<WINML_MODEL_TEST_PERF>& profiler,
     std::cout << std::endl << std::endl << std::endl;
 }
 
+void OutputHelper::PrintThroughputResults(const std::vector<ThroughputResult>& results, DeviceType deviceType,
+                                          InputBindingType inputBindingType, InputDataType inputDataType,
+                                          bool isPerformanceConsoleOutputVerbose) const
+{
+    printf("\nConcurrent evaluation throughput (device = %s, inputBinding = %s, inputDataType = %s):\n",
+           TypeHelper::Stringify(deviceType).c_str(), TypeHelper::Stringify(inputBindingType).c_str(),
+           TypeHelper::Stringify(inputDataType).c_str());
+    std::cout << std::setw(9) << "Threads" << std::setw(14) << "Evaluations" << std::setw(16) << "Inferences/sec"
+              << std::setw(13) << "Efficiency" << std::setw(11) << "p50 (ms)" << std::setw(11) << "p90 (ms)"
+              << std::setw(11) << "p99 (ms)" << std::setw(12) << "p99.9 (ms)" << std::endl;
+    for (const auto& result : results)
+    {
+        std::cout << std::fixed << std::setprecision(3) << std::setw(9) << result.NumThreads << std::setw(14)
+                  << result.TotalInferences << std::setw(16) << result.InferencesPerSecond << std::setw(12)
+                  << result.ScalingEfficiency * 100 << "%" << std::setw(11) << result.Latency.GetPercentile(50)
+                  << std::setw(11) << result.Latency.GetPercentile(90) << std::setw(11)
+                  << result.Latency.GetPercentile(99) << std::setw(12) << result.Latency.GetPercentile(99.9)
+                  << std::endl;
+        if (isPerformanceConsoleOutputVerbose)
+        {
+            for (size_t i = 0; i < result.ThreadLatency.size(); ++i)
+            {
+                const LatencyHistogram& latency = result.ThreadLatency[i];
+                std::cout << "    Thread " << i << ": average " << latency.GetMean() << " ms, min "
+                          << latency.GetMin() << " ms, max " << latency.GetMax() << " ms, p50 "
+                          << latency.GetPercentile(50) << " ms, p99 " << latency.GetPercentile(99) << " ms"
+                          << std::endl;
+            }
+        }
+    }
+    std::cout.unsetf(std::ios_base::floatfield);
+    std::cout << std::setprecision(6) << std::endl;
+}
+
+void OutputHelper::PrintBatchResults(const std::vector<BatchResult>& results, size_t kneeIndex, DeviceType deviceType,
+                                     InputBindingType inputBindingType, InputDataType inputDataType) const
+{
+    printf("\nBatched evaluation (device = %s, inputBinding = %s, inputDataType = %s):\n",
+           TypeHelper::Stringify(deviceType).c_str(), TypeHelper::Stringify(inputBindingType).c_str(),
+           TypeHelper::Stringify(inputDataType).c_str());
+    std::cout << std::setw(7) << "Batch" << std::setw(10) << "Batches" << std::setw(13) << "Samples/sec"
+              << std::setw(9) << "Gain" << std::setw(19) << "Batch p50 (ms)" << std::setw(16) << "Batch p99 (ms)"
+              << std::setw(18) << "Sample avg (ms)" << std::setw(18) << "Sample p50 (ms)" << std::endl;
+    for (size_t i = 0; i < results.size(); ++i)
+    {
+        const BatchResult& result = results[i];
+        std::cout << std::fixed << std::setprecision(3) << std::setw(7) << result.BatchSize << std::setw(10)
+                  << result.NumBatches << std::setw(13) << result.SamplesPerSecond << std::setw(8)
+                  << result.ThroughputGain << "x" << std::setw(19) << result.BatchLatency.GetPercentile(50)
+                  << std::setw(16) << result.BatchLatency.GetPercentile(99) << std::setw(18)
+                  << result.SampleLatency.GetMean() << std::setw(18) << result.SampleLatency.GetPercentile(50)
+                  << (i == kneeIndex ? "  <- knee" : "") << std::endl;
+    }
+    if (kneeIndex < results.size())
+    {
+        std::cout << "Throughput knee at batch size " << results[kneeIndex].BatchSize << ": "
+                  << results[kneeIndex].SamplesPerSecond << " samples/sec" << std::endl;
+    }
+    std::cout.unsetf(std::ios_base::floatfield);
+    std::cout << std::setprecision(6) << std::endl;
+}
+
 std::wstring OutputHelper::FeatureDescriptorToString(const ILearningModelFeatureDescriptor& descriptor)
 {
     switch (descriptor.Kind())
@@ -537,11 +698,11 @@ std::wstring OutputHelper::GetCsvFileNamePerIterationResult() { return m_csvFile
 void OutputHelper::SetDefaultCSVIterationResult(uint32_t iterationNum, const CommandLineArgs& args,
                                                 std::wstring& featureName)
 {
+    std::wstring device = L"Cpu";
     if (args.UseCPU() && args.UseGPU())
     {
         if (!m_flagGpuDevice)
         {
-            m_fileNameResultDevice = m_folderNamePerIteration + L"\\" + featureName + L"CpuIteration";
             if (iterationNum == args.NumIterations() - 1 || args.SaveTensorMode() == L"First")
             {
                 m_flagGpuDevice = true;
@@ -549,18 +710,30 @@ void OutputHelper::SetDefaultCSVIterationResult(uint32_t iterationNum, const Com
         }
         else
         {
-            m_fileNameResultDevice = m_folderNamePerIteration + L"\\" + featureName + L"GpuIteration";
+            device = L"Gpu";
         }
     }
     else if (args.UseGPU())
     {
-        m_fileNameResultDevice = m_folderNamePerIteration + L"\\" + featureName + L"GpuIteration";
+        device = L"Gpu";
     }
-    else
+    m_fileNameResultDevice = m_folderNamePerIteration + L"\\" + featureName + device + L"Iteration";
+    m_csvFileNamePerIterationResult = m_fileNameResultDevice + std::to_wstring(iterationNum + 1) + L".csv";
+    m_traceFileNameResult = m_folderNamePerIteration + L"\\TensorData" + device + L".wmltrace";
+}
+
+void OutputHelper::SaveTensorTrace(const CommandLineArgs& args, const TensorTrace::RecordInfo& info, const void* data,
+                                   size_t size)
+{
+    TraceTimeline::Scope scope("write tensor trace", "io");
+    auto& trace = m_tensorTraces[m_traceFileNameResult];
+    if (!trace)
     {
-        m_fileNameResultDevice = m_folderNamePerIteration + L"\\" + featureName + L"CpuIteration";
+        trace = std::make_unique<TensorTrace::TraceWriter>(
+            m_traceFileNameResult,
+            args.SaveTensorFormat() == L"TraceLz4" ? TensorTrace::Codec::Lz4 : TensorTrace::Codec::None);
     }
-    m_csvFileNamePerIterationResult = m_fileNameResultDevice + std::to_wstring(iterationNum + 1) + L".csv";
+    trace->Add(info, data, size);
 }
 
 void OutputHelper::SetCSVFileName(const std::wstring& fileName) { m_csvFileName = fileName; }
@@ -568,6 +741,7 @@ void OutputHelper::SetCSVFileName(const std::wstring& fileName) { m_csvFileName
 void OutputHelper::WritePerIterationPerformance(const CommandLineArgs& args, const std::wstring model,
                                     const std::wstring imagePath)
 {
+    TraceTimeline::Scope scope("write per iteration csv", "io");
     if (m_csvFileNamePerIterationSummary.length() > 0)
     {
         bool bNewFile = false;
@@ -586,8 +760,15 @@ void OutputHelper::WritePerIterationPerformance(const CommandLineArgs& args, con
         std::wstring_convert<std::codecvt_utf8_utf16<wchar_t>> converter;
         std::string modelName = converter.to_bytes(model);
         std::string fileNameResultDevice = converter.to_bytes(m_fileNameResultDevice);
-        std::string inputName = args.IsCSVInput() ? converter.to_bytes(args.CsvPath())
-                                                    : args.IsImageInput() ? converter.to_bytes(imagePath) : "";
+        std::string traceFileNameResult = converter.to_bytes(m_traceFileNameResult);
+        auto resultFileName = [&](uint32_t i) {
+            return args.IsSaveTensorTrace() ? traceFileNameResult
+                                            : fileNameResultDevice + std::to_string(i + 1) + ".csv";
+        };
+        std::string inputName = args.IsCSVInput()          ? converter.to_bytes(args.CsvPath())
+                                : args.IsTensorFileInput() ? converter.to_bytes(args.TensorFilePath())
+                                : args.IsImageInput()      ? converter.to_bytes(imagePath)
+                                                           : "";
 
         if (bNewFile)
         {
@@ -653,9 +834,7 @@ void OutputHelper::WritePerIterationPerformance(const CommandLineArgs& args, con
                 if (args.IsSaveTensor() &&
                     (args.SaveTensorMode() == L"All" || (args.SaveTensorMode() == L"First" && i == 0)))
                 {
-                    fout << m_outputResult[i] << "," << m_outputTensorHash[i] << ","
-                            << fileNameResultDevice + std::to_string(i + 1) + ".csv"
-                            << ",";
+                    fout << m_outputResult[i] << "," << m_outputTensorHash[i] << "," << resultFileName(i) << ",";
                 }
                 fout << std::endl;
             }
@@ -665,7 +844,7 @@ void OutputHelper::WritePerIterationPerformance(const CommandLineArgs& args, con
             for (uint32_t i = 0; i < args.NumIterations(); i++)
             {
                 fout << i + 1 << "," << m_outputResult[i] << "," << m_outputTensorHash[i] << ","
-                        << fileNameResultDevice + std::to_string(i + 1) + ".csv" << std::endl;
+                        << resultFileName(i) << std::endl;
                 if (args.SaveTensorMode() == L"First" && i == 0)
                 {
                     break;
@@ -680,51 +859,39 @@ template <typename T>
 void OutputHelper::ProcessTensorResult(const CommandLineArgs& args, const void* buffer, const uint32_t uCapacity,
                          std::vector<std::pair<float, int>>& maxValues, std::ofstream& fout, unsigned int k)
 {
-    // Create a priority queue of size k that pops the lowest value first
-    // We will remove lowest values as we iterate over all the values
-    auto cmp = [](std::pair<float, int> x, std::pair<float, int> y) { return x.first > y.first; };
-    std::priority_queue<std::pair<float, int>, std::vector<std::pair<float, int>>, decltype(cmp)> topKvalues(cmp);
-
-    T* tensor = (T*)buffer;
-    int size = uCapacity / sizeof(T);
-    for (int i = 0; i < size; i++)
+    TensorResults::TopKSelector topKValues(k);
+    std::unique_ptr<TensorResults::TensorCsvWriter> writer;
+    if (args.IsSaveTensor() && !args.IsSaveTensorTrace())
     {
-        float val = 0;
-        if (!std::is_same<T, HALF>::value)
-        {
-            val = *(tensor + i);
-        }
-        else
-        {
-            val = XMConvertHalfToFloat(static_cast<HALF>(*(tensor + i)));
-        }
-        if (args.IsSaveTensor())
+        writer = std::make_unique<TensorResults::TensorCsvWriter>(fout);
+    }
+    auto processValues = [&](const float* values, size_t count, size_t baseIndex) {
+        if (writer)
         {
-            fout << i << "," << val << std::endl;
+            writer->Write(values, count, baseIndex);
         }
+        topKValues.Add(values, count, baseIndex);
+    };
 
-        if (topKvalues.size() < k)
+    size_t size = uCapacity / sizeof(T);
+    if constexpr (std::is_same<T, HALF>::value)
+    {
+        // Convert in chunks on the stack rather than into a float copy of the whole tensor
+        float values[TensorResults::ChunkSize];
+        for (size_t begin = 0; begin < size; begin += TensorResults::ChunkSize)
         {
-            topKvalues.push({ val, i });
-        }
-        else if (k > 0)
-        {
-            auto maxValue = topKvalues.top().first;
-            if (maxValue < val)
-            {
-                topKvalues.pop();
-                topKvalues.push({ val, i });
-            }
+            size_t count = (std::min)(TensorResults::ChunkSize, size - begin);
+            TensorResults::ConvertHalfToFloat(static_cast<const HALF*>(buffer) + begin, values, count);
+            processValues(values, count, begin);
         }
     }
-    while (!topKvalues.empty())
+    else
     {
-        auto pair = topKvalues.top();
-        maxValues.push_back(pair);
-        topKvalues.pop();
+        processValues(static_cast<const float*>(buffer), size, 0);
     }
-    // Put vector in order of highest value to lowest
-    std::reverse(maxValues.begin(), maxValues.end());
+
+    // Largest value first
+    maxValues.insert(maxValues.end(), topKValues.GetValues().begin(), topKValues.GetValues().end());
 }
 template void OutputHelper::ProcessTensorResult<float>(const CommandLineArgs& args, const void* buffer, const uint32_t uCapacity,
                                                        std::vector<std::pair<float, int>>& maxValues, std::ofstream& fout,
@@ -891,8 +1058,15 @@ void OutputHelper::WritePerformanceDataToCSV(const Profiler<WINML_MODEL_TEST_PER
     double maxFirstEvalSharedMemoryUsage =
         profiler[EVAL_MODEL_FIRST_RUN].GetAverage(CounterType::GPU_SHARED_MEM_USAGE);
 
+    // With -HardwareCounters, the average events of bind and evaluate follow the memory columns
+    const bool writeHardwareCounters = profiler.GetHardwareCounters() != nullptr;
+    const std::vector<HardwareCounters::EventDescription> hardwareEvents =
+        writeHardwareCounters ? profiler.GetHardwareCounters()->GetEvents()
+                              : std::vector<HardwareCounters::EventDescription>();
+
     if (!m_csvFileName.empty())
     {
+        TraceTimeline::Scope scope("write csv", "io");
         // Check if header exists
         bool bNewFile = false;
         std::ifstream fin;
@@ -1120,6 +1294,17 @@ void OutputHelper::WritePerformanceDataToCSV(const Profiler<WINML_MODEL_TEST_PER
                     << ","
                     << "evaluate max shared memory (MB)"
                     << ",";
+            if (writeHardwareCounters)
+            {
+                for (const char* interval : { "bind", "evaluate" })
+                {
+                    for (const auto& event : hardwareEvents)
+                    {
+                        fout << interval << " average " << event.DisplayName << ",";
+                    }
+                    fout << interval << " IPC,";
+                }
+            }
             for (auto metaDataPair : perfFileMetadata)
             {
                 fout << metaDataPair.first << ",";
@@ -1187,6 +1372,20 @@ void OutputHelper::WritePerformanceDataToCSV(const Profiler<WINML_MODEL_TEST_PER
                 << "," << (numIterations <= 1 ? 0 : stdevEvalSharedMemoryUsage) << ","
                 << (numIterations <= 1 ? 0 : maxEvalSharedMemoryUsage) << ","
                 << (numIterations <= 1 ? 0 : minEvalSharedMemoryUsage) << ",";
+        if (writeHardwareCounters)
+        {
+            const size_t cycles = HardwareCounters::Index(HardwareCounters::HardwareEvent::Cycles);
+            const size_t instructions = HardwareCounters::Index(HardwareCounters::HardwareEvent::Instructions);
+            for (WINML_MODEL_TEST_PERF interval : { BIND_VALUE, EVAL_MODEL })
+            {
+                const HardwareCounters::CounterTotals& totals = profiler[interval].GetHardwareCounters();
+                for (size_t event = 0; event < hardwareEvents.size(); ++event)
+                {
+                    fout << totals.GetAverage(event) << ",";
+                }
+                fout << totals.GetRatio(instructions, cycles) << ",";
+            }
+        }
         for (auto metaDataPair : perfFileMetadata)
         {
             fout << metaDataPair.second << ",";
@@ -1195,3 +1394,179 @@ void OutputHelper::WritePerformanceDataToCSV(const Profiler<WINML_MODEL_TEST_PER
         fout.close();
     }
 }
+
+// Current UTC time in ISO 8601 format, e.g. 2020-01-31T12:00:00Z
+static std::string GetUtcTimestamp()
+{
+    auto time = std::time(nullptr);
+    struct tm utcTime;
+    gmtime_s(&utcTime, &time);
+    std::ostringstream oss;
+    oss << std::put_time(&utcTime, "%Y-%m-%dT%H:%M:%SZ");
+    return oss.str();
+}
+
+void OutputHelper::AddPerformanceDataToReport(const Profiler<WINML_MODEL_TEST_PERF>& profiler, int numIterations,
+                                              const std::wstring& model, const std::wstring& input,
+                                              const std::string& deviceType, const std::string& inputBinding,
+                                              const std::string& inputType, const std::string& deviceCreationLocation,
+                                              const std::vector<std::pair<std::string, std::string>>& perfFileMetadata)
+{
+    static const std::pair<WINML_MODEL_TEST_PERF, const char*> intervals[] = {
+        { LOAD_MODEL, "load" },
+        { CREATE_SESSION, "createSession" },
+        { BIND_VALUE_FIRST_RUN, "firstBind" },
+        { BIND_VALUE, "bind" },
+        { EVAL_MODEL_FIRST_RUN, "firstEvaluate" },
+        { EVAL_MODEL, "evaluate" }
+    };
+    // In CounterType order
+    static const char* counterNames[CounterType::TYPE_COUNT] = {
+        "time",
+        "cpuUsage",
+        "pageFaultCount",
+        "pageFileUsage",
+        "peakPageFileUsage",
+        "workingSetUsage",
+        "peakWorkingSetUsage",
+        "gpuUsage",
+        "gpuDedicatedMemoryUsage",
+        "gpuSharedMemoryUsage",
+        "startingWorkingSet",
+        "startingSharedMemory"
+    };
+
+    std::wstring_convert<std::codecvt_utf8_utf16<wchar_t>> converter;
+    PerfReport::JsonWriter json;
+    json.BeginObject();
+    json.Key("type").String("configuration");
+    json.Key("timestamp").String(GetUtcTimestamp());
+    json.Key("model").String(converter.to_bytes(model));
+    json.Key("input").String(converter.to_bytes(input));
+    json.Key("deviceType").String(deviceType);
+    json.Key("inputBinding").String(inputBinding);
+    json.Key("inputType").String(inputType);
+    json.Key("deviceCreationLocation").String(deviceCreationLocation);
+    json.Key("iterations").Number(numIterations);
+    json.Key("metadata");
+    PerfReport::WriteMetadata(json, perfFileMetadata);
+
+    // A histogram of every counter of every measured interval, in the units of the CSV output (ms and MB)
+    json.Key("intervals").BeginObject();
+    for (const auto& interval : intervals)
+    {
+        const PerfCounterStatistics& counter = profiler[interval.first];
+        if (counter.GetCount() == 0)
+        {
+            continue;
+        }
+        json.Key(interval.second).BeginObject();
+        for (int type = 0; type < CounterType::TYPE_COUNT; ++type)
+        {
+            json.Key(counterNames[type]);
+            PerfReport::WriteHistogram(json, counter.GetHistogram(static_cast<CounterType>(type)));
+        }
+        if (counter.HasHardwareCounters())
+        {
+            // Averages per interval, scaled for multiplexing; events that could not be counted are left out
+            const HardwareCounters::CounterTotals& totals = counter.GetHardwareCounters();
+            const std::vector<HardwareCounters::EventDescription>& events = profiler.GetHardwareCounters()->GetEvents();
+            json.Key("hardwareCounters").BeginObject();
+            json.Key("intervals").Number(totals.GetIntervalCount());
+            for (size_t event = 0; event < events.size(); ++event)
+            {
+                if (totals.HasEvent(event))
+                {
+                    json.Key(events[event].Name).Number(totals.GetAverage(event));
+                }
+            }
+            const size_t cycles = HardwareCounters::Index(HardwareCounters::HardwareEvent::Cycles);
+            const size_t instructions = HardwareCounters::Index(HardwareCounters::HardwareEvent::Instructions);
+            if (totals.HasEvent(cycles) && totals.HasEvent(instructions))
+            {
+                json.Key("ipc").Number(totals.GetRatio(instructions, cycles));
+            }
+            json.EndObject();
+        }
+        json.EndObject();
+    }
+    json.EndObject();
+
+    // The bind and evaluate measurements of each iteration, first iteration first
+    size_t numValues = (std::min)(static_cast<size_t>((std::max)(numIterations, 0)), m_clockEvalTimes.size());
+    auto writeValues = [&json, numValues](const char* name, const std::vector<double>& values) {
+        json.Key(name).BeginArray();
+        for (size_t i = 0; i < numValues; ++i)
+        {
+            json.Number(values[i]);
+        }
+        json.EndArray();
+    };
+    json.Key("perIteration").BeginObject();
+    writeValues("bind", m_clockBindTimes);
+    writeValues("evaluate", m_clockEvalTimes);
+    writeValues("cpuWorkingSetDiff", m_CPUWorkingDiff);
+    writeValues("cpuWorkingSetStart", m_CPUWorkingStart);
+    writeValues("gpuSharedMemoryDiff", m_GPUSharedDiff);
+    writeValues("gpuSharedMemoryStart", m_GPUSharedStart);
+    writeValues("gpuDedicatedMemoryDiff", m_GPUDedicatedDiff);
+    json.EndObject();
+
+    // Once each with -SteadyState, once per iteration otherwise
+    json.Key("inputs").BeginObject();
+    json.Key("prepared").Number(m_inputPreparedCount);
+    json.Key("bindings").Number(m_inputBindingCount);
+    json.EndObject();
+
+    if (m_convergenceResult.Reason != IterationConvergence::StopReason::None)
+    {
+        const IterationConvergence::ConvergenceResult& result = m_convergenceResult;
+        json.Key("convergence").BeginObject();
+        json.Key("statistic").String(IterationConvergence::GetStatisticName(m_convergenceOptions.Statistic));
+        json.Key("targetRelativeError").Number(m_convergenceOptions.TargetRelativeError);
+        json.Key("confidence").Number(m_convergenceOptions.Confidence);
+        json.Key("stopReason").String(IterationConvergence::GetStopReasonName(result.Reason));
+        json.Key("iterations").Number(result.Iterations);
+        json.Key("warmupIterations").Number(result.WarmupIterations);
+        json.Key("measuredIterations").Number(result.MeasuredIterations);
+        json.Key("estimate").Number(result.Estimate);
+        if (result.HasBounds)
+        {
+            json.Key("lower").Number(result.Lower);
+            json.Key("upper").Number(result.Upper);
+            json.Key("relativeError").Number(result.RelativeError);
+        }
+        json.EndObject();
+    }
+    json.EndObject();
+    m_perfReport.AddRecord(json);
+}
+
+void OutputHelper::WritePerformanceReport(const std::wstring& path,
+                                          const std::vector<std::pair<std::string, std::string>>& perfFileMetadata)
+{
+    TraceTimeline::Scope scope("write report", "io");
+    PerfReport::JsonWriter json;
+    json.BeginObject();
+    json.Key("type").String("run");
+    json.Key("timestamp").String(GetUtcTimestamp());
+#ifdef USE_WINML_NUGET
+    json.Key("tool").String("MicrosoftMLRunner");
+#else
+    json.Key("tool").String("WinMLRunner");
+#endif
+    json.Key("configurations").Number(m_perfReport.GetRecordCount());
+    json.Key("metadata");
+    PerfReport::WriteMetadata(json, perfFileMetadata);
+    json.EndObject();
+    m_perfReport.SetRunRecord(json);
+    try
+    {
+        m_perfReport.WriteToFile(path);
+    }
+    catch (const std::exception&)
+    {
+        std::wcout << L"Failed to write performance report to " << path << std::endl;
+        throw;
+    }
+}
@@ -3,6 +3,11 @@
 #include <DXProgrammableCapture.h>
 #endif
 #include "TimerHelper.h"
+#include "ConcurrentEvaluation.h"
+#include "BatchEvaluation.h"
+#include "PerfReport.h"
+#include "TensorTrace.h"
+#include "IterationConvergence.h"
 #include "LearningModelDeviceHelper.h"
 // Stores performance information and handles output to the command line and CSV files.
 class OutputHelper
@@ -35,6 +40,24 @@ public:
     void PrintResults(const Profiler<WINML_MODEL_TEST_PERF>& profiler, uint32_t numIterations, DeviceType deviceType,
                       InputBindingType inputBindingType, InputDataType inputDataType,
                       DeviceCreationLocation deviceCreationLocation, bool isPerformanceConsoleOutputVerbose) const;
+    void PrintPercentiles(const PerfCounterStatistics& counter, const char* name) const;
+    void PrintThroughputResults(const std::vector<ThroughputResult>& results, DeviceType deviceType,
+                                InputBindingType inputBindingType, InputDataType inputDataType,
+                                bool isPerformanceConsoleOutputVerbose) const;
+    void PrintBatchResults(const std::vector<BatchResult>& results, size_t kneeIndex, DeviceType deviceType,
+                           InputBindingType inputBindingType, InputDataType inputDataType) const;
+    // Keeps how a -Converge run stopped, for PrintConvergenceResult and the performance report
+    void SetConvergenceResult(const IterationConvergence::ConvergenceOptions& options,
+                              const IterationConvergence::ConvergenceResult& result);
+    void PrintConvergenceResult() const;
+    // Keeps how many times the measured iterations prepared input features and created a binding, for the report
+    void SetInputCounts(size_t preparedCount, size_t bindingCount)
+    {
+        m_inputPreparedCount = preparedCount;
+        m_inputBindingCount = bindingCount;
+    }
+    // Prints the CPU hardware events of the intervals that counted them, see Profiler::EnableHardwareCounters
+    void PrintHardwareCounters(const Profiler<WINML_MODEL_TEST_PERF>& profiler) const;
     void SaveLoadTimes(Profiler<WINML_MODEL_TEST_PERF>& profiler, uint32_t iterNum);
     void SaveBindTimes(Profiler<WINML_MODEL_TEST_PERF>& profiler, uint32_t iterNum);
     void SaveEvalPerformance(Profiler<WINML_MODEL_TEST_PERF>& profiler, uint32_t iterNum);
@@ -44,6 +67,10 @@ public:
     std::wstring GetDefaultCSVFileNamePerIteration();
     std::wstring GetCsvFileNamePerIterationResult();
     void SetDefaultCSVIterationResult(uint32_t iterationNum, const CommandLineArgs& args, std::wstring& featureName);
+    // Appends an output tensor to the tensor trace of the current device, see SetDefaultCSVIterationResult. Traces are
+    // closed when the OutputHelper is destroyed.
+    void SaveTensorTrace(const CommandLineArgs& args, const TensorTrace::RecordInfo& info, const void* data,
+                         size_t size);
     void SetCSVFileName(const std::wstring& fileName);
     void WritePerIterationPerformance(const CommandLineArgs& args, const std::wstring model,
                                       const std::wstring imagePath);
@@ -51,6 +78,15 @@ public:
                                    std::wstring model, const std::string& deviceType, const std::string& inputBinding,
                                    const std::string& inputType, const std::string& deviceCreationLocation,
                                    const std::vector<std::pair<std::string, std::string>>& perfFileMetadata) const;
+    void AddPerformanceDataToReport(const Profiler<WINML_MODEL_TEST_PERF>& profiler, int numIterations,
+                                    const std::wstring& model, const std::wstring& input, const std::string& deviceType,
+                                    const std::string& inputBinding, const std::string& inputType,
+                                    const std::string& deviceCreationLocation,
+                                    const std::vector<std::pair<std::string, std::string>>& perfFileMetadata);
+    void WritePerformanceReport(const std::wstring& path,
+                                const std::vector<std::pair<std::string, std::string>>& perfFileMetadata);
+    // Adds a record read from the report of another run, e.g. a -ParallelSweep job
+    void AddPerformanceReportRecord(const std::string& record) { m_perfReport.AddRecord(record); }
     static void PrintLearningModelDevice(const LearningModelDeviceWithMetadata& device);
     static std::wstring FeatureDescriptorToString(const ILearningModelFeatureDescriptor& descriptor);
     static bool doesDescriptorContainFP16(const ILearningModelFeatureDescriptor& descriptor);
@@ -71,6 +107,8 @@ private:
     std::wstring m_csvFileNamePerIterationResult;
     std::wstring m_folderNamePerIteration;
     std::wstring m_fileNameResultDevice;
+    std::wstring m_traceFileNameResult;
+    std::map<std::wstring, std::unique_ptr<TensorTrace::TraceWriter>> m_tensorTraces;
 
     bool m_silent = false;
     bool m_flagGpuDevice = false;
@@ -83,6 +121,11 @@ private:
     std::vector<double> m_GPUDedicatedDiff;
     std::vector<std::string> m_outputResult;
     std::vector<int> m_outputTensorHash;
+    PerfReport::PerfReportSink m_perfReport;
+    IterationConvergence::ConvergenceOptions m_convergenceOptions;
+    IterationConvergence::ConvergenceResult m_convergenceResult; // Reason is None unless -Converge stopped the run
+    size_t m_inputPreparedCount = 0;
+    size_t m_inputBindingCount = 0;
 
 #if defined(_AMD64_)
     // PIX markers only work on amd64
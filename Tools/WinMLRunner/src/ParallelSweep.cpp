@@ -0,0 +1,327 @@
+#include <filesystem>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <thread>
+
+#include "Windows.h"
+#include "common.h"
+#include "Scenarios.h"
+#include "OutputHelper.h"
+#include "SweepScheduler.h"
+#include "TraceTimeline.h"
+
+// Quotes an argument so that the command line of the job splits into the same arguments again.
+static std::wstring QuoteArgument(const std::wstring& argument)
+{
+    if (!argument.empty() && argument.find_first_of(L" \t\"") == std::wstring::npos)
+    {
+        return argument;
+    }
+    std::wstring quoted = L"\"";
+    size_t backslashes = 0;
+    for (wchar_t c : argument)
+    {
+        if (c == L'\\')
+        {
+            backslashes++;
+            continue;
+        }
+        // Backslashes are only special before a quote
+        quoted.append(c == L'"' ? backslashes * 2 + 1 : backslashes, L'\\');
+        quoted.push_back(c);
+        backslashes = 0;
+    }
+    quoted.append(backslashes * 2, L'\\');
+    quoted.push_back(L'"');
+    return quoted;
+}
+
+// The arguments of the sweep without the ones that each job gets its own value for.
+static std::vector<std::wstring> GetSharedJobArguments(const std::vector<std::wstring>& arguments)
+{
+    std::vector<std::wstring> shared;
+    for (size_t i = 0; i < arguments.size(); i++)
+    {
+        const wchar_t* argument = arguments[i].c_str();
+        bool hasValue = i + 1 < arguments.size() && !arguments[i + 1].empty() && arguments[i + 1][0] != L'-';
+        if (_wcsicmp(argument, L"-Model") == 0 || _wcsicmp(argument, L"-Folder") == 0 ||
+            _wcsicmp(argument, L"-SweepTimeout") == 0 || _wcsicmp(argument, L"-SweepRetries") == 0 ||
+            _wcsicmp(argument, L"-TraceOutput") == 0)
+        {
+            i++;
+        }
+        else if (_wcsicmp(argument, L"-ParallelSweep") == 0 || _wcsicmp(argument, L"-PerfOutput") == 0 ||
+                 _wcsicmp(argument, L"-PerfJsonOutput") == 0)
+        {
+            i += hasValue ? 1 : 0;
+        }
+        else
+        {
+            shared.push_back(arguments[i]);
+        }
+    }
+    return shared;
+}
+
+struct JobFiles
+{
+    std::wstring CommandLine;
+    std::wstring PerfOutputPath;
+    std::wstring PerfJsonOutputPath;
+    std::wstring TraceOutputPath;
+    std::wstring LogPath;
+};
+
+// Starts WinMLRunner for one job with its output going to the log file of the job, and waits for it to exit. The
+// process is stopped when the job times out. Crashes are retryable, failures reported by WinMLRunner itself are not.
+static SweepScheduler::JobOutcome RunJobProcess(const JobFiles& files, HANDLE jobObject,
+                                                const SweepScheduler::JobContext& context)
+{
+    SweepScheduler::JobOutcome outcome;
+    SECURITY_ATTRIBUTES security = { sizeof(security), nullptr, TRUE };
+    HANDLE log = CreateFileW(files.LogPath.c_str(), GENERIC_WRITE, FILE_SHARE_READ, &security, CREATE_ALWAYS,
+                             FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (log == INVALID_HANDLE_VALUE)
+    {
+        outcome.Status = SweepScheduler::JobStatus::Failed;
+        outcome.ExitCode = HRESULT_FROM_WIN32(GetLastError());
+        outcome.Message = "could not create the log file";
+        return outcome;
+    }
+
+    // Only the log is inherited, not the logs of the jobs started at the same time on other threads
+    SIZE_T attributeListSize = 0;
+    InitializeProcThreadAttributeList(nullptr, 1, 0, &attributeListSize);
+    std::vector<uint8_t> attributeList(attributeListSize);
+    STARTUPINFOEXW startupInfo = {};
+    startupInfo.StartupInfo.cb = sizeof(startupInfo);
+    startupInfo.StartupInfo.dwFlags = STARTF_USESTDHANDLES;
+    startupInfo.StartupInfo.hStdOutput = log;
+    startupInfo.StartupInfo.hStdError = log;
+    startupInfo.lpAttributeList = reinterpret_cast<LPPROC_THREAD_ATTRIBUTE_LIST>(attributeList.data());
+    InitializeProcThreadAttributeList(startupInfo.lpAttributeList, 1, 0, &attributeListSize);
+    UpdateProcThreadAttribute(startupInfo.lpAttributeList, 0, PROC_THREAD_ATTRIBUTE_HANDLE_LIST, &log, sizeof(log),
+                              nullptr, nullptr);
+
+    std::wstring commandLine = files.CommandLine;
+    PROCESS_INFORMATION processInfo = {};
+    BOOL created = CreateProcessW(nullptr, &commandLine[0], nullptr, nullptr, TRUE,
+                                  CREATE_NO_WINDOW | CREATE_SUSPENDED | EXTENDED_STARTUPINFO_PRESENT, nullptr,
+                                  nullptr, &startupInfo.StartupInfo, &processInfo);
+    DWORD createError = GetLastError();
+    DeleteProcThreadAttributeList(startupInfo.lpAttributeList);
+    CloseHandle(log);
+    if (!created)
+    {
+        outcome.Status = SweepScheduler::JobStatus::Failed;
+        outcome.ExitCode = HRESULT_FROM_WIN32(createError);
+        outcome.Message = "could not start WinMLRunner";
+        return outcome;
+    }
+
+    // In the job object before it runs, so that it is stopped with WinMLRunner even if the sweep is killed
+    AssignProcessToJobObject(jobObject, processInfo.hProcess);
+    ResumeThread(processInfo.hThread);
+    CloseHandle(processInfo.hThread);
+
+    DWORD wait;
+    while ((wait = WaitForSingleObject(processInfo.hProcess, 100)) == WAIT_TIMEOUT && !context.IsCancelled())
+    {
+    }
+    if (wait == WAIT_TIMEOUT)
+    {
+        TerminateProcess(processInfo.hProcess, static_cast<UINT>(HRESULT_FROM_WIN32(ERROR_TIMEOUT)));
+        WaitForSingleObject(processInfo.hProcess, INFINITE);
+        outcome.Status = SweepScheduler::JobStatus::TimedOut;
+        outcome.ExitCode = HRESULT_FROM_WIN32(ERROR_TIMEOUT);
+        outcome.Retryable = true;
+    }
+    else
+    {
+        DWORD exitCode = 0;
+        GetExitCodeProcess(processInfo.hProcess, &exitCode);
+        outcome.ExitCode = static_cast<int>(exitCode);
+        outcome.Status = exitCode == 0 ? SweepScheduler::JobStatus::Succeeded : SweepScheduler::JobStatus::Failed;
+
+        // NTSTATUS errors such as access violations, rather than the HRESULT of a failed load or evaluation
+        outcome.Retryable = (exitCode & 0xF0000000) == 0xC0000000;
+    }
+    CloseHandle(processInfo.hProcess);
+    return outcome;
+}
+
+static std::string FormatExitCode(int exitCode)
+{
+    std::ostringstream text;
+    text << "0x" << std::hex << std::setw(8) << std::setfill('0') << static_cast<uint32_t>(exitCode);
+    return text.str();
+}
+
+HRESULT ParallelSweep(const std::vector<std::wstring>& modelPaths, CommandLineArgs& args, OutputHelper& output)
+{
+    std::vector<SweepScheduler::SweepJob> jobs;
+    for (const auto& modelPath : modelPaths)
+    {
+        for (DeviceType deviceType : args.FetchDeviceTypes())
+        {
+            for (InputDataType inputDataType : args.FetchInputDataTypes())
+            {
+                for (InputBindingType inputBindingType : args.FetchInputBindingTypes())
+                {
+                    SweepScheduler::SweepJob job;
+                    job.ModelPath = modelPath;
+                    job.Device = TypeHelper::Stringify(deviceType);
+                    job.InputDataType = TypeHelper::Stringify(inputDataType);
+                    job.InputBindingType = TypeHelper::Stringify(inputBindingType);
+
+                    // GPU bound input needs the GPU even when the model runs on the CPU
+                    bool usesGpu = deviceType != DeviceType::CPU || inputBindingType == InputBindingType::GPU;
+                    job.Group = usesGpu ? "GPU" : "CPU";
+                    jobs.push_back(job);
+                }
+            }
+        }
+    }
+
+    std::vector<wchar_t> executablePath(32768);
+    GetModuleFileNameW(nullptr, executablePath.data(), static_cast<DWORD>(executablePath.size()));
+    std::wstring sharedArguments;
+    for (const auto& argument : GetSharedJobArguments(args.Arguments()))
+    {
+        sharedArguments += L" " + QuoteArgument(argument);
+    }
+
+    std::filesystem::path jobFolder =
+        std::filesystem::temp_directory_path() / (L"WinMLRunnerSweep" + std::to_wstring(GetCurrentProcessId()));
+    std::filesystem::create_directories(jobFolder);
+    std::vector<JobFiles> jobFiles(jobs.size());
+    for (size_t i = 0; i < jobs.size(); i++)
+    {
+        std::wstring name = L"job" + std::to_wstring(i);
+        JobFiles& files = jobFiles[i];
+        files.PerfOutputPath = (jobFolder / (name + L".csv")).wstring();
+        files.PerfJsonOutputPath = (jobFolder / (name + L".jsonl")).wstring();
+        files.TraceOutputPath = (jobFolder / (name + L".trace.json")).wstring();
+        files.LogPath = (jobFolder / (name + L".log")).wstring();
+        files.CommandLine = QuoteArgument(executablePath.data()) + sharedArguments + L" -Model " +
+                            QuoteArgument(jobs[i].ModelPath) + L" -SweepJob " + to_hstring(jobs[i].Device).c_str() +
+                            L" " + to_hstring(jobs[i].InputDataType).c_str() + L" " +
+                            to_hstring(jobs[i].InputBindingType).c_str();
+        if (args.IsOutputPerf())
+        {
+            files.CommandLine += L" -PerfOutput " + QuoteArgument(files.PerfOutputPath);
+        }
+        if (args.IsOutputPerfJson())
+        {
+            files.CommandLine += L" -PerfJsonOutput " + QuoteArgument(files.PerfJsonOutputPath);
+        }
+        if (args.IsTraceOutput())
+        {
+            files.CommandLine += L" -TraceOutput " + QuoteArgument(files.TraceOutputPath);
+        }
+    }
+
+    // Closing the last handle to the job object stops every job that is still running
+    HANDLE jobObject = CreateJobObjectW(nullptr, nullptr);
+    JOBOBJECT_EXTENDED_LIMIT_INFORMATION limits = {};
+    limits.BasicLimitInformation.LimitFlags = JOB_OBJECT_LIMIT_KILL_ON_JOB_CLOSE;
+    SetInformationJobObject(jobObject, JobObjectExtendedLimitInformation, &limits, sizeof(limits));
+
+    SweepScheduler::SweepOptions options;
+    options.Workers = args.SweepWorkers() > 0 ? args.SweepWorkers()
+                                              : (std::max)(std::thread::hardware_concurrency() / 4, 1u);
+    options.GroupLimits["GPU"] = 1;
+    options.MaxAttempts = args.SweepRetries() + 1;
+    options.Timeout = std::chrono::seconds(args.SweepTimeout());
+    options.Progress = [&jobFiles](const SweepScheduler::SweepProgress& progress) {
+        const SweepScheduler::JobOutcome& outcome = *progress.Outcome;
+        std::ostringstream line;
+        line << "[" << progress.Finished << "/" << progress.Total << "] " << progress.Job->GetName() << " "
+             << SweepScheduler::GetStatusName(outcome.Status);
+        if (outcome.Status != SweepScheduler::JobStatus::Succeeded)
+        {
+            line << " (" << FormatExitCode(outcome.ExitCode) << (outcome.Message.empty() ? "" : ", ")
+                 << outcome.Message << ")";
+        }
+        line << " after " << std::fixed << std::setprecision(1) << progress.DurationMilliseconds / 1000 << " s";
+        if (progress.WillRetry)
+        {
+            line << ", retrying (attempt " << progress.Attempt + 1 << ")";
+        }
+        else if (outcome.Status != SweepScheduler::JobStatus::Succeeded)
+        {
+            line << ", see " << std::filesystem::path(jobFiles[progress.JobIndex].LogPath).u8string();
+        }
+        std::cout << line.str() << std::endl;
+    };
+
+    std::cout << "Sweeping " << jobs.size() << " configurations of " << modelPaths.size() << " models with up to "
+              << options.Workers << " jobs at once" << std::endl;
+    std::vector<SweepScheduler::JobResult> results =
+        SweepScheduler::RunSweep(jobs, options, [&](const SweepScheduler::SweepJob& job,
+                                                    const SweepScheduler::JobContext& context) {
+            // The job on the track of the worker that waits for it, next to the timeline of the job process itself
+            TraceTimeline::Global().SetThreadName("sweep worker");
+            TraceTimeline::Scope scope("job", "sweep");
+            if (scope.IsRecording())
+            {
+                scope.SetDetail(job.GetName());
+            }
+            return RunJobProcess(jobFiles[&job - jobs.data()], jobObject, context);
+        });
+    CloseHandle(jobObject);
+
+    // One report over all jobs, in the order of the jobs
+    if (args.IsOutputPerf())
+    {
+        std::vector<std::wstring> csvPaths;
+        for (const auto& files : jobFiles)
+        {
+            csvPaths.push_back(files.PerfOutputPath);
+        }
+        SweepScheduler::MergeCsvFiles(csvPaths, args.OutputPath());
+    }
+    if (args.IsOutputPerfJson())
+    {
+        for (const auto& files : jobFiles)
+        {
+            for (const auto& record : SweepScheduler::ReadReportRecords(files.PerfJsonOutputPath))
+            {
+                output.AddPerformanceReportRecord(record);
+            }
+        }
+        output.WritePerformanceReport(args.PerfJsonOutputPath(), args.GetPerformanceFileMetadata());
+    }
+    if (args.IsTraceOutput())
+    {
+        for (const auto& files : jobFiles)
+        {
+            TraceTimeline::Global().AddExternalEvents(TraceTimeline::ReadTraceEvents(files.TraceOutputPath));
+        }
+    }
+
+    HRESULT hr = S_OK;
+    size_t failed = 0;
+    for (const auto& result : results)
+    {
+        if (result.Outcome.Status != SweepScheduler::JobStatus::Succeeded)
+        {
+            failed++;
+            hr = result.Outcome.ExitCode != 0 ? static_cast<HRESULT>(result.Outcome.ExitCode) : E_FAIL;
+        }
+    }
+    std::cout << jobs.size() - failed << " of " << jobs.size() << " configurations succeeded" << std::endl;
+
+    // The logs of failed jobs are kept for a look at what went wrong
+    std::error_code error;
+    if (failed == 0)
+    {
+        std::filesystem::remove_all(jobFolder, error);
+    }
+    else
+    {
+        std::cout << "Logs of the jobs are in " << jobFolder.u8string() << std::endl;
+    }
+    return hr;
+}
@@ -0,0 +1,922 @@
+#pragma once
+
+#include <algorithm>
+#include <charconv>
+#include <cmath>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <istream>
+#include <iterator>
+#include <map>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <tuple>
+#include <utility>
+#include <vector>
+#include "IterationConvergence.h"
+#include "PerfReport.h"
+
+// Compares the performance results of two sets of runs, a baseline and a candidate, to catch latency regressions of a
+// few percent across many models. Results are read from -PerfJsonOutput reports and -PerfOutput CSV files, and a
+// configuration of the baseline is matched with the candidate by model, device, input binding and input type.
+//
+// When both sides have the time of every iteration, a Mann-Whitney U test tells whether the candidate is faster or
+// slower, and a bootstrap gives the confidence interval of the change of the median: neither assumes the latencies are
+// normally distributed, and a few outlier iterations cannot move them much. Otherwise, e.g. with only the averages of
+// a -PerfOutput CSV file, Welch's test on the means is all there is. A change is flagged when it is significant and at
+// least the threshold, so that a difference that is real but too small to matter does not fail a build.
+// Nothing in here depends on WinML.
+namespace PerfComparison
+{
+    // The intervals that are compared, named as in the JSON report.
+    const char* const MetricNames[] = { "load", "createSession", "firstBind", "bind", "firstEvaluate", "evaluate" };
+
+    // What a configuration is matched on. The model is the path it was loaded from until Compare shortens it.
+    struct RunKey
+    {
+        std::string Model;
+        std::string DeviceType;
+        std::string DeviceCreationLocation;
+        std::string InputBinding;
+        std::string InputType;
+
+        bool operator<(const RunKey& other) const
+        {
+            return std::tie(Model, DeviceType, DeviceCreationLocation, InputBinding, InputType) <
+                   std::tie(other.Model, other.DeviceType, other.DeviceCreationLocation, other.InputBinding,
+                            other.InputType);
+        }
+
+        std::string ToString() const
+        {
+            return Model + " " + DeviceType + "/" + DeviceCreationLocation + " " + InputBinding + " " + InputType;
+        }
+    };
+
+    // The time of one interval of a configuration, in ms.
+    struct Measurement
+    {
+        std::vector<double> Samples; // one per iteration, if HasSamples
+        bool HasSamples = false;
+        double Mean = 0;
+        double Stdev = 0;
+        uint64_t Count = 0;
+    };
+
+    // Adds the measurements of another run of the same configuration. Iterations are only kept if both have them,
+    // the means and standard deviations are pooled.
+    inline void Merge(Measurement& into, const Measurement& from)
+    {
+        if (into.Count == 0 && !into.HasSamples)
+        {
+            into = from;
+            return;
+        }
+        into.HasSamples = into.HasSamples && from.HasSamples;
+        if (into.HasSamples)
+        {
+            into.Samples.insert(into.Samples.end(), from.Samples.begin(), from.Samples.end());
+        }
+        else
+        {
+            into.Samples.clear();
+        }
+        double count = static_cast<double>(into.Count + from.Count);
+        if (count > 0)
+        {
+            double mean = (into.Mean * into.Count + from.Mean * from.Count) / count;
+            double squares = (into.Count > 0 ? (into.Count - 1.0) * into.Stdev * into.Stdev : 0) +
+                             (from.Count > 0 ? (from.Count - 1.0) * from.Stdev * from.Stdev : 0) +
+                             into.Count * (into.Mean - mean) * (into.Mean - mean) +
+                             from.Count * (from.Mean - mean) * (from.Mean - mean);
+            into.Mean = mean;
+            into.Stdev = count > 1 ? std::sqrt(squares / (count - 1)) : 0;
+        }
+        into.Count += from.Count;
+    }
+
+    // The results of one configuration of one run.
+    struct RunResult
+    {
+        RunKey Key;
+        uint64_t Iterations = 0;
+        std::map<std::string, Measurement> Metrics;
+    };
+
+    // Splits a line of a CSV file written by WinMLRunner, which does not quote its fields.
+    inline std::vector<std::string> SplitCsvLine(const std::string& line)
+    {
+        std::vector<std::string> fields;
+        size_t end = line.size();
+        while (end > 0 && (line[end - 1] == '\r' || line[end - 1] == '\n'))
+        {
+            --end;
+        }
+        size_t begin = 0;
+        while (true)
+        {
+            size_t comma = line.find(',', begin);
+            if (comma == std::string::npos || comma >= end)
+            {
+                fields.push_back(line.substr(begin, end - begin));
+                return fields;
+            }
+            fields.push_back(line.substr(begin, comma - begin));
+            begin = comma + 1;
+        }
+    }
+
+    inline double ParseCsvNumber(const std::string& field)
+    {
+        double value = 0;
+        const char* begin = field.data();
+        while (begin != field.data() + field.size() && *begin == ' ')
+        {
+            ++begin;
+        }
+        auto result = std::from_chars(begin, field.data() + field.size(), value);
+        if (result.ec != std::errc())
+        {
+            throw std::runtime_error("PerfComparison: not a number: " + field);
+        }
+        return value;
+    }
+
+    // The column named name (ignoring surrounding spaces) of a CSV header, or -1.
+    inline int FindColumn(const std::vector<std::string>& header, const std::string& name)
+    {
+        for (size_t i = 0; i < header.size(); ++i)
+        {
+            size_t begin = header[i].find_first_not_of(' ');
+            size_t end = header[i].find_last_not_of(' ');
+            if (begin != std::string::npos && header[i].compare(begin, end - begin + 1, name) == 0)
+            {
+                return static_cast<int>(i);
+            }
+        }
+        return -1;
+    }
+
+    // Whether the line is the header of a -PerfOutput CSV file.
+    inline bool IsPerformanceCsvHeader(const std::string& line)
+    {
+        return line.rfind("model name,device type,", 0) == 0;
+    }
+
+    // Reads the rows of a -PerfOutput CSV file: the average and standard deviation of every interval, no iterations.
+    // Files that several runs appended to have one row per configuration and run. Throws std::runtime_error if the
+    // file is not one.
+    inline std::vector<RunResult> ReadPerformanceCsv(std::istream& input)
+    {
+        // The column names of each of MetricNames and of the number of values averaged
+        static const char* const columns[][2] = {
+            { "load (ms)", "load iterations" },
+            { "session creation (ms)", "session creation iterations" },
+            { "first bind (ms)", "session creation iterations" },
+            { "bind (ms)", "iterations" },
+            { "first evaluate (ms)", "session creation iterations" },
+            { "evaluate (ms)", "iterations" },
+        };
+        std::string line;
+        if (!std::getline(input, line) || !IsPerformanceCsvHeader(line))
+        {
+            throw std::runtime_error("PerfComparison: not a -PerfOutput CSV file");
+        }
+        std::vector<std::string> header = SplitCsvLine(line);
+        int keyColumns[] = { FindColumn(header, "model name"), FindColumn(header, "device type"),
+                             FindColumn(header, "device creation location"), FindColumn(header, "input binding"),
+                             FindColumn(header, "input type"), FindColumn(header, "iterations") };
+        int metricColumns[std::size(MetricNames)][3];
+        for (size_t metric = 0; metric < std::size(MetricNames); ++metric)
+        {
+            metricColumns[metric][0] = FindColumn(header, std::string("average ") + columns[metric][0]);
+            metricColumns[metric][1] = FindColumn(header, std::string("standard deviation ") + columns[metric][0]);
+            metricColumns[metric][2] = FindColumn(header, columns[metric][1]);
+        }
+        if (std::find(std::begin(keyColumns), std::end(keyColumns), -1) != std::end(keyColumns))
+        {
+            throw std::runtime_error("PerfComparison: the -PerfOutput CSV file has no configuration columns");
+        }
+
+        std::vector<RunResult> results;
+        while (std::getline(input, line))
+        {
+            std::vector<std::string> fields = SplitCsvLine(line);
+            if (fields.size() < header.size() - 1 || fields[0].empty())
+            {
+                continue;
+            }
+            RunResult result;
+            result.Key = { fields[keyColumns[0]], fields[keyColumns[1]], fields[keyColumns[2]], fields[keyColumns[3]],
+                           fields[keyColumns[4]] };
+            auto isBinding = [](const std::string& value) { return value == "CPU" || value == "GPU"; };
+            if (!isBinding(result.Key.InputBinding) && isBinding(result.Key.InputType))
+            {
+                // Older versions wrote the input type in the input binding column and the other way around
+                std::swap(result.Key.InputBinding, result.Key.InputType);
+            }
+            result.Iterations = static_cast<uint64_t>(ParseCsvNumber(fields[keyColumns[5]]));
+            for (size_t metric = 0; metric < std::size(MetricNames); ++metric)
+            {
+                const int* column = metricColumns[metric];
+                if (column[0] < 0 || column[1] < 0 || column[2] < 0)
+                {
+                    continue;
+                }
+                Measurement measurement;
+                measurement.Mean = ParseCsvNumber(fields[column[0]]);
+                measurement.Stdev = ParseCsvNumber(fields[column[1]]);
+                measurement.Count = static_cast<uint64_t>(ParseCsvNumber(fields[column[2]]));
+                if (column[2] == keyColumns[5])
+                {
+                    // The first iteration is measured as first bind and first evaluate
+                    measurement.Count = measurement.Count > 0 ? measurement.Count - 1 : 0;
+                }
+                if (measurement.Count > 0)
+                {
+                    result.Metrics[MetricNames[metric]] = measurement;
+                }
+            }
+            results.push_back(std::move(result));
+        }
+        return results;
+    }
+
+    // The bind and evaluate times of the iterations of one configuration in a -SavePerIterationPerf Summary.csv file.
+    struct IterationTimes
+    {
+        std::vector<double> Bind;
+        std::vector<double> Evaluate;
+    };
+
+    // Reads a -SavePerIterationPerf Summary.csv file, one IterationTimes per configuration in the order they ran. The
+    // file does not name the device, input binding or input type, only AddIterationTimes can tell.
+    inline std::vector<IterationTimes> ReadPerIterationCsv(std::istream& input)
+    {
+        std::string line;
+        std::getline(input, line);
+        std::vector<std::string> header = SplitCsvLine(line);
+        int iterationColumn = FindColumn(header, "Iteration Number");
+        int bindColumn = FindColumn(header, "Bind (ms)");
+        int evaluateColumn = FindColumn(header, "Evaluate (ms)");
+        if (iterationColumn < 0 || bindColumn < 0 || evaluateColumn < 0)
+        {
+            throw std::runtime_error("PerfComparison: not a -SavePerIterationPerf Summary.csv file");
+        }
+        int lastColumn = (std::max)({ iterationColumn, bindColumn, evaluateColumn });
+
+        std::vector<IterationTimes> configurations;
+        while (std::getline(input, line))
+        {
+            std::vector<std::string> fields = SplitCsvLine(line);
+            if (static_cast<int>(fields.size()) <= lastColumn)
+            {
+                continue;
+            }
+            // Iterations are numbered from 1 in each configuration
+            if (configurations.empty() || ParseCsvNumber(fields[iterationColumn]) == 1)
+            {
+                configurations.emplace_back();
+            }
+            configurations.back().Bind.push_back(ParseCsvNumber(fields[bindColumn]));
+            configurations.back().Evaluate.push_back(ParseCsvNumber(fields[evaluateColumn]));
+        }
+        return configurations;
+    }
+
+    // The times of the iterations after the first one, which is measured as first bind or first evaluate.
+    inline Measurement MeasureIterations(const std::vector<double>& times)
+    {
+        Measurement measurement;
+        measurement.HasSamples = true;
+        if (times.size() > 1)
+        {
+            measurement.Samples.assign(times.begin() + 1, times.end());
+        }
+        double sum = 0;
+        for (double value : measurement.Samples)
+        {
+            sum += value;
+        }
+        measurement.Count = measurement.Samples.size();
+        measurement.Mean = measurement.Count > 0 ? sum / measurement.Count : 0;
+        double squares = 0;
+        for (double value : measurement.Samples)
+        {
+            squares += (value - measurement.Mean) * (value - measurement.Mean);
+        }
+        measurement.Stdev = measurement.Count > 1 ? std::sqrt(squares / (measurement.Count - 1)) : 0;
+        return measurement;
+    }
+
+    // Adds the iterations of a Summary.csv file written by the same runs as the -PerfOutput CSV file results were read
+    // from, matching them up in order. Returns false, and leaves results as they were, if they do not line up.
+    inline bool AddIterationTimes(std::vector<RunResult>& results, const std::vector<IterationTimes>& iterations)
+    {
+        if (iterations.size() != results.size())
+        {
+            return false;
+        }
+        for (size_t i = 0; i < results.size(); ++i)
+        {
+            if (iterations[i].Evaluate.size() != results[i].Iterations)
+            {
+                return false;
+            }
+        }
+        for (size_t i = 0; i < results.size(); ++i)
+        {
+            results[i].Metrics["bind"] = MeasureIterations(iterations[i].Bind);
+            results[i].Metrics["evaluate"] = MeasureIterations(iterations[i].Evaluate);
+        }
+        return true;
+    }
+
+    // Reads the configuration records of a -PerfJsonOutput report, with the time of every iteration of bind and
+    // evaluate and the time statistics of the other intervals. Throws std::runtime_error for a line that is not JSON.
+    inline std::vector<RunResult> ReadPerformanceReport(std::istream& input)
+    {
+        std::vector<RunResult> results;
+        std::string line;
+        while (std::getline(input, line))
+        {
+            if (line.find_first_not_of(" \t\r") == std::string::npos)
+            {
+                continue;
+            }
+            PerfReport::JsonValue record = PerfReport::JsonValue::Parse(line);
+            if (record["type"].GetString() != "configuration")
+            {
+                continue;
+            }
+            RunResult result;
+            result.Key = { record["model"].GetString(), record["deviceType"].GetString(),
+                           record["deviceCreationLocation"].GetString(), record["inputBinding"].GetString(),
+                           record["inputType"].GetString() };
+            result.Iterations = static_cast<uint64_t>(record["iterations"].GetNumber());
+            for (const char* metric : MetricNames)
+            {
+                const PerfReport::JsonValue& time = record["intervals"][metric]["time"];
+                const PerfReport::JsonValue& iterations = record["perIteration"][metric];
+                if (iterations.IsArray())
+                {
+                    std::vector<double> times;
+                    for (const auto& value : iterations.GetElements())
+                    {
+                        times.push_back(value.GetNumber());
+                    }
+                    result.Metrics[metric] = MeasureIterations(times);
+                }
+                else if (time.IsObject() && time["count"].GetNumber() > 0)
+                {
+                    Measurement& measurement = result.Metrics[metric];
+                    measurement.Mean = time["mean"].GetNumber();
+                    measurement.Stdev = time["stdev"].GetNumber();
+                    measurement.Count = static_cast<uint64_t>(time["count"].GetNumber());
+                }
+            }
+            results.push_back(std::move(result));
+        }
+        return results;
+    }
+
+    inline double Median(std::vector<double> values)
+    {
+        if (values.empty())
+        {
+            return 0;
+        }
+        size_t middle = values.size() / 2;
+        std::nth_element(values.begin(), values.begin() + middle, values.end());
+        double median = values[middle];
+        if (values.size() % 2 == 0)
+        {
+            median = (median + *std::max_element(values.begin(), values.begin() + middle)) / 2;
+        }
+        return median;
+    }
+
+    struct MannWhitneyResult
+    {
+        double U = 0;      // of the candidate: the number of pairs where the candidate is slower, ties count half
+        double Z = 0;      // positive if the candidate tends to be slower
+        double PValue = 1; // two sided
+    };
+
+    // The Mann-Whitney U test of whether the values of one sample tend to be larger than those of the other, with the
+    // normal approximation corrected for ties and continuity, which is accurate from about 10 values per sample.
+    inline MannWhitneyResult MannWhitneyU(const std::vector<double>& baseline, const std::vector<double>& candidate)
+    {
+        MannWhitneyResult result;
+        const double n1 = static_cast<double>(baseline.size());
+        const double n2 = static_cast<double>(candidate.size());
+        if (baseline.empty() || candidate.empty())
+        {
+            return result;
+        }
+        // Rank the values of both, true for those of the candidate
+        std::vector<std::pair<double, bool>> values;
+        values.reserve(baseline.size() + candidate.size());
+        for (double value : baseline)
+        {
+            values.emplace_back(value, false);
+        }
+        for (double value : candidate)
+        {
+            values.emplace_back(value, true);
+        }
+        std::sort(values.begin(), values.end());
+        double candidateRanks = 0;
+        double ties = 0; // sum of t^3 - t over groups of t tied values
+        for (size_t begin = 0; begin < values.size();)
+        {
+            size_t end = begin + 1;
+            while (end < values.size() && values[end].first == values[begin].first)
+            {
+                ++end;
+            }
+            double rank = (begin + 1 + end) / 2.0; // average of the ranks begin + 1 to end
+            for (size_t i = begin; i < end; ++i)
+            {
+                candidateRanks += values[i].second ? rank : 0;
+            }
+            double tied = static_cast<double>(end - begin);
+            ties += tied * tied * tied - tied;
+            begin = end;
+        }
+        result.U = candidateRanks - n2 * (n2 + 1) / 2;
+        const double n = n1 + n2;
+        const double variance = n1 * n2 / 12 * ((n + 1) - ties / (n * (n - 1)));
+        if (variance <= 0)
+        {
+            return result; // all values are equal
+        }
+        const double difference = result.U - n1 * n2 / 2;
+        const double corrected = (std::max)(std::abs(difference) - 0.5, 0.0);
+        result.Z = (difference < 0 ? -corrected : corrected) / std::sqrt(variance);
+        result.PValue = std::erfc(std::abs(result.Z) / std::sqrt(2.0));
+        return result;
+    }
+
+    // Random numbers for the bootstrap that are the same with every compiler: the distributions of <random> are not.
+    class BootstrapRandom
+    {
+    public:
+        explicit BootstrapRandom(uint64_t seed) : m_engine(seed) {}
+
+        // Uniform in (0, 1)
+        double Uniform() { return ((m_engine() >> 11) + 0.5) * (1.0 / 9007199254740992.0); }
+
+        double Normal()
+        {
+            // Box-Muller, one of the pair
+            return std::sqrt(-2 * std::log(Uniform())) * std::cos(6.283185307179586 * Uniform());
+        }
+
+        // Marsaglia and Tsang's method, for shape >= 1
+        double Gamma(double shape)
+        {
+            const double d = shape - 1.0 / 3;
+            const double c = 1 / std::sqrt(9 * d);
+            while (true)
+            {
+                double x = Normal();
+                double v = 1 + c * x;
+                if (v <= 0)
+                {
+                    continue;
+                }
+                v = v * v * v;
+                double u = Uniform();
+                if (std::log(u) < 0.5 * x * x + d - d * v + d * std::log(v))
+                {
+                    return d * v;
+                }
+            }
+        }
+
+        double Beta(double a, double b)
+        {
+            double x = Gamma(a);
+            return x / (x + Gamma(b));
+        }
+
+    private:
+        std::mt19937_64 m_engine; // its output, unlike that of the distributions, is fixed by the standard
+    };
+
+    // The median of n values drawn with replacement from the sorted values, without drawing them: the k-th smallest of
+    // n draws is sorted[floor(n * u)] for the k-th smallest u of n uniform numbers, which has a Beta(k, n + 1 - k)
+    // distribution. The next one is the smallest of the n - k uniform numbers above it. So each resample costs a few
+    // random numbers instead of n draws and a selection, and thousands of resamples of thousands of iterations take
+    // microseconds.
+    inline double ResampleMedian(const std::vector<double>& sorted, BootstrapRandom& random)
+    {
+        const size_t n = sorted.size();
+        auto value = [&](double u) { return sorted[(std::min)(static_cast<size_t>(u * n), n - 1)]; };
+        const size_t k = (n + 1) / 2;
+        double u = random.Beta(static_cast<double>(k), static_cast<double>(n + 1 - k));
+        if (n % 2 == 1)
+        {
+            return value(u);
+        }
+        double next = u + (1 - u) * (1 - std::pow(random.Uniform(), 1.0 / (n - k)));
+        return (value(u) + value(next)) / 2;
+    }
+
+    struct ConfidenceInterval
+    {
+        double Lower = 0;
+        double Upper = 0;
+    };
+
+    // The percentile bootstrap confidence interval of median(candidate) - median(baseline).
+    inline ConfidenceInterval BootstrapMedianDifference(std::vector<double> baseline, std::vector<double> candidate,
+                                                        double confidence, size_t resamples, uint64_t seed)
+    {
+        if (baseline.empty() || candidate.empty() || resamples == 0)
+        {
+            return {};
+        }
+        std::sort(baseline.begin(), baseline.end());
+        std::sort(candidate.begin(), candidate.end());
+        BootstrapRandom random(seed);
+        std::vector<double> differences(resamples);
+        for (double& difference : differences)
+        {
+            difference = ResampleMedian(candidate, random) - ResampleMedian(baseline, random);
+        }
+        std::sort(differences.begin(), differences.end());
+        auto at = [&](double p) {
+            double position = p * (resamples - 1);
+            size_t index = static_cast<size_t>(position);
+            double fraction = position - index;
+            return index + 1 < resamples ? differences[index] * (1 - fraction) + differences[index + 1] * fraction
+                                         : differences[index];
+        };
+        return { at((1 - confidence) / 2), at((1 + confidence) / 2) };
+    }
+
+    struct ComparisonOptions
+    {
+        double RegressionThreshold = 0.03;  // smallest slowdown that is flagged, relative to the baseline
+        double ImprovementThreshold = 0.03; // smallest speedup that is flagged
+        double Alpha = 0.01;                // significance level, the intervals have a confidence of 1 - Alpha
+        size_t Resamples = 2000;            // of the bootstrap
+        uint64_t Seed = 1;
+        size_t MinSamples = 10;             // fewest iterations or values averaged on each side
+    };
+
+    enum class Method
+    {
+        None,        // too few values to test
+        MannWhitney, // iterations on both sides: medians, Mann-Whitney U test and bootstrap interval
+        Welch,       // averages only: means, Welch's test and its interval, normal approximations of both
+    };
+
+    // In the order the tool lists them
+    enum class Verdict
+    {
+        Regression,
+        Improvement,
+        Unchanged,
+        Inconclusive, // too few values
+    };
+
+    inline const char* GetMethodName(Method method)
+    {
+        switch (method)
+        {
+            case Method::MannWhitney: return "mann-whitney";
+            case Method::Welch: return "welch";
+            default: return "none";
+        }
+    }
+
+    inline const char* GetVerdictName(Verdict verdict)
+    {
+        switch (verdict)
+        {
+            case Verdict::Regression: return "regression";
+            case Verdict::Improvement: return "improvement";
+            case Verdict::Inconclusive: return "inconclusive";
+            default: return "unchanged";
+        }
+    }
+
+    // The comparison of one interval of one configuration.
+    struct MetricComparison
+    {
+        RunKey Key;
+        std::string Metric;
+        Method TestMethod = Method::None;
+        Verdict Result = Verdict::Inconclusive;
+        double Baseline = 0;       // median, or mean for Welch, in ms
+        double Candidate = 0;
+        double RelativeChange = 0; // (Candidate - Baseline) / Baseline, positive if slower
+        double Lower = 0;          // confidence interval of RelativeChange
+        double Upper = 0;
+        double PValue = 1;
+        uint64_t BaselineCount = 0;
+        uint64_t CandidateCount = 0;
+    };
+
+    inline MetricComparison CompareMeasurements(const Measurement& baseline, const Measurement& candidate,
+                                                const ComparisonOptions& options)
+    {
+        MetricComparison comparison;
+        comparison.TestMethod = baseline.HasSamples && candidate.HasSamples ? Method::MannWhitney : Method::Welch;
+        comparison.BaselineCount = baseline.Count;
+        comparison.CandidateCount = candidate.Count;
+        double difference = 0;
+        ConfidenceInterval interval;
+        if (comparison.TestMethod == Method::MannWhitney)
+        {
+            comparison.Baseline = Median(baseline.Samples);
+            comparison.Candidate = Median(candidate.Samples);
+            difference = comparison.Candidate - comparison.Baseline;
+            comparison.PValue = MannWhitneyU(baseline.Samples, candidate.Samples).PValue;
+            interval = BootstrapMedianDifference(baseline.Samples, candidate.Samples, 1 - options.Alpha,
+                                                 options.Resamples, options.Seed);
+        }
+        else
+        {
+            comparison.Baseline = baseline.Mean;
+            comparison.Candidate = candidate.Mean;
+            difference = comparison.Candidate - comparison.Baseline;
+            double error = baseline.Count > 1 && candidate.Count > 1
+                               ? std::sqrt(baseline.Stdev * baseline.Stdev / baseline.Count +
+                                           candidate.Stdev * candidate.Stdev / candidate.Count)
+                               : 0;
+            comparison.PValue = error > 0 ? std::erfc(std::abs(difference / error) / std::sqrt(2.0))
+                                          : (difference == 0 ? 1 : 0);
+            double z = IterationConvergence::NormalQuantile(1 - options.Alpha / 2);
+            interval = { difference - z * error, difference + z * error };
+        }
+        if (comparison.Baseline > 0)
+        {
+            comparison.RelativeChange = difference / comparison.Baseline;
+            comparison.Lower = interval.Lower / comparison.Baseline;
+            comparison.Upper = interval.Upper / comparison.Baseline;
+        }
+
+        if ((std::min)(baseline.Count, candidate.Count) < (std::max<size_t>)(options.MinSamples, 2) ||
+            comparison.Baseline <= 0)
+        {
+            comparison.TestMethod = Method::None;
+            comparison.Result = Verdict::Inconclusive;
+        }
+        else if (comparison.PValue >= options.Alpha || (comparison.Lower <= 0 && comparison.Upper >= 0))
+        {
+            comparison.Result = Verdict::Unchanged;
+        }
+        else if (comparison.RelativeChange >= options.RegressionThreshold)
+        {
+            comparison.Result = Verdict::Regression;
+        }
+        else if (comparison.RelativeChange <= -options.ImprovementThreshold)
+        {
+            comparison.Result = Verdict::Improvement;
+        }
+        else
+        {
+            comparison.Result = Verdict::Unchanged;
+        }
+        return comparison;
+    }
+
+    // The results of a set of runs, merged per configuration.
+    class ResultSet
+    {
+    public:
+        void Add(const RunResult& result)
+        {
+            RunResult& merged = m_results[result.Key];
+            merged.Key = result.Key;
+            merged.Iterations += result.Iterations;
+            for (const auto& metric : result.Metrics)
+            {
+                Merge(merged.Metrics[metric.first], metric.second);
+            }
+        }
+
+        void Add(const std::vector<RunResult>& results)
+        {
+            for (const auto& result : results)
+            {
+                Add(result);
+            }
+        }
+
+        const std::map<RunKey, RunResult>& GetResults() const { return m_results; }
+        size_t GetFileCount() const { return m_files; }
+        // Why some of the files were not read, or only partly
+        const std::vector<std::string>& GetWarnings() const { return m_warnings; }
+
+        // Reads a -PerfJsonOutput report, a -PerfOutput CSV file or every one of them in a folder and its subfolders.
+        // A -PerfOutput CSV file is skipped if the report of the same run is next to it, and gets the iterations of
+        // the Summary.csv in the PerIterationRun folder of the same run if there is one. Throws std::runtime_error if
+        // a file cannot be read.
+        void AddPath(const std::filesystem::path& path)
+        {
+            if (!std::filesystem::is_directory(path))
+            {
+                if (!AddFile(path))
+                {
+                    throw std::runtime_error("PerfComparison: " + path.u8string() +
+                                             " is not a -PerfJsonOutput report or -PerfOutput CSV file");
+                }
+                return;
+            }
+            std::vector<std::filesystem::path> files;
+            for (const auto& entry : std::filesystem::recursive_directory_iterator(path))
+            {
+                if (entry.is_regular_file())
+                {
+                    files.push_back(entry.path());
+                }
+            }
+            std::sort(files.begin(), files.end());
+            for (const auto& file : files)
+            {
+                std::filesystem::path report = file;
+                if (file.extension() == ".csv" && std::filesystem::exists(report.replace_extension(".jsonl")))
+                {
+                    continue;
+                }
+                AddFile(file);
+            }
+        }
+
+    private:
+        // Returns false if the file is neither a report nor a -PerfOutput CSV file.
+        bool AddFile(const std::filesystem::path& path)
+        {
+            std::ifstream input(path, std::ios_base::binary);
+            if (!input)
+            {
+                throw std::runtime_error("PerfComparison: cannot open " + path.u8string());
+            }
+            if (path.extension() == ".jsonl")
+            {
+                Add(ReadPerformanceReport(input));
+                m_files++;
+                return true;
+            }
+            std::string header;
+            std::getline(input, header);
+            if (path.extension() != ".csv" || !IsPerformanceCsvHeader(header))
+            {
+                return false;
+            }
+            input.clear();
+            input.seekg(0);
+            std::vector<RunResult> results = ReadPerformanceCsv(input);
+
+            // WinMLRunner[<time>].csv and PerIterationRun[<time>]\Summary.csv are written by the same run
+            std::string name = path.stem().u8string();
+            size_t bracket = name.find('[');
+            std::filesystem::path summary;
+            if (bracket != std::string::npos)
+            {
+                summary = path.parent_path() / ("PerIterationRun" + name.substr(bracket)) / "Summary.csv";
+            }
+            if (!summary.empty() && std::filesystem::exists(summary))
+            {
+                std::ifstream summaryInput(summary, std::ios_base::binary);
+                if (!AddIterationTimes(results, ReadPerIterationCsv(summaryInput)))
+                {
+                    m_warnings.push_back(summary.u8string() + " does not match the configurations of " +
+                                         path.u8string() + ", its iterations are not used");
+                }
+            }
+            Add(results);
+            m_files++;
+            return true;
+        }
+
+        std::map<RunKey, RunResult> m_results;
+        std::vector<std::string> m_warnings;
+        size_t m_files = 0;
+    };
+
+    // The last depth components of a model path, with / between them.
+    inline std::string ShortenModelPath(const std::string& path, size_t depth)
+    {
+        std::string normalized = path;
+        std::replace(normalized.begin(), normalized.end(), '\\', '/');
+        size_t begin = normalized.size();
+        for (size_t i = 0; i < depth && begin != std::string::npos && begin > 0; ++i)
+        {
+            begin = normalized.rfind('/', begin - 1);
+        }
+        return begin == std::string::npos ? normalized : normalized.substr(begin + 1);
+    }
+
+    // How many trailing components of the model paths tell the models of each set apart, so that results match
+    // although the baseline and candidate loaded the models from different folders.
+    inline size_t GetModelPathDepth(const ResultSet& baseline, const ResultSet& candidate)
+    {
+        size_t depth = 1;
+        for (const ResultSet* results : { &baseline, &candidate })
+        {
+            std::vector<std::string> paths;
+            for (const auto& result : results->GetResults())
+            {
+                paths.push_back(result.first.Model);
+            }
+            paths.erase(std::unique(paths.begin(), paths.end()), paths.end());
+            while (true)
+            {
+                std::vector<std::string> shortened;
+                for (const auto& path : paths)
+                {
+                    shortened.push_back(ShortenModelPath(path, depth));
+                }
+                std::sort(shortened.begin(), shortened.end());
+                bool unique = std::adjacent_find(shortened.begin(), shortened.end()) == shortened.end();
+                bool whole = std::all_of(paths.begin(), paths.end(), [&](const std::string& path) {
+                    return ShortenModelPath(path, depth).size() == path.size();
+                });
+                if (unique || whole)
+                {
+                    break;
+                }
+                ++depth;
+            }
+        }
+        return depth;
+    }
+
+    struct Comparison
+    {
+        std::vector<MetricComparison> Metrics;
+        std::vector<RunKey> OnlyInBaseline;
+        std::vector<RunKey> OnlyInCandidate;
+
+        size_t Count(Verdict verdict) const
+        {
+            return std::count_if(Metrics.begin(), Metrics.end(),
+                                 [verdict](const MetricComparison& metric) { return metric.Result == verdict; });
+        }
+    };
+
+    // Compares the metrics (all of MetricNames if empty) of every configuration of the baseline with the candidate.
+    inline Comparison Compare(const ResultSet& baseline, const ResultSet& candidate,
+                              const std::vector<std::string>& metrics, const ComparisonOptions& options)
+    {
+        const size_t depth = GetModelPathDepth(baseline, candidate);
+        auto shorten = [depth](const ResultSet& results) {
+            ResultSet shortened;
+            for (const auto& result : results.GetResults())
+            {
+                RunResult copy = result.second;
+                copy.Key.Model = ShortenModelPath(copy.Key.Model, depth);
+                shortened.Add(copy);
+            }
+            return shortened;
+        };
+        const ResultSet shortBaseline = shorten(baseline);
+        const ResultSet shortCandidate = shorten(candidate);
+
+        Comparison comparison;
+        const auto& candidates = shortCandidate.GetResults();
+        for (const auto& result : shortBaseline.GetResults())
+        {
+            auto match = candidates.find(result.first);
+            if (match == candidates.end())
+            {
+                comparison.OnlyInBaseline.push_back(result.first);
+                continue;
+            }
+            for (const char* metric : MetricNames)
+            {
+                if (!metrics.empty() && std::find(metrics.begin(), metrics.end(), metric) == metrics.end())
+                {
+                    continue;
+                }
+                auto baselineMetric = result.second.Metrics.find(metric);
+                auto candidateMetric = match->second.Metrics.find(metric);
+                if (baselineMetric == result.second.Metrics.end() || candidateMetric == match->second.Metrics.end())
+                {
+                    continue;
+                }
+                MetricComparison metricComparison =
+                    CompareMeasurements(baselineMetric->second, candidateMetric->second, options);
+                metricComparison.Key = result.first;
+                metricComparison.Metric = metric;
+                comparison.Metrics.push_back(std::move(metricComparison));
+            }
+        }
+        for (const auto& result : candidates)
+        {
+            if (shortBaseline.GetResults().count(result.first) == 0)
+            {
+                comparison.OnlyInCandidate.push_back(result.first);
+            }
+        }
+        return comparison;
+    }
+} // namespace PerfComparison
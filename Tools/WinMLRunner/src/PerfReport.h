@@ -0,0 +1,523 @@
+#pragma once
+
+#include <charconv>
+#include <cmath>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include "LatencyHistogram.h"
+
+// Machine readable performance report, written as JSON Lines: one self contained JSON object per line. Records are
+// collected in memory while the tool runs and the file is opened once at the end, so a folder of thousands of models
+// does not reopen the report per configuration, and new fields can be added without breaking existing parsers the way
+// a new CSV column does. Nothing in here depends on WinML.
+namespace PerfReport
+{
+    // Builds one JSON value into a string. Values are written in call order and the separators between them are added
+    // automatically, e.g. json.BeginObject().Key("count").Number(3).EndObject() gives {"count":3}.
+    class JsonWriter
+    {
+    public:
+        JsonWriter& BeginObject() { return Open('{'); }
+        JsonWriter& EndObject() { return Close('}'); }
+        JsonWriter& BeginArray() { return Open('['); }
+        JsonWriter& EndArray() { return Close(']'); }
+
+        // Starts a member of the enclosing object, the next value written is its value.
+        JsonWriter& Key(const std::string& key)
+        {
+            String(key);
+            m_json += ':';
+            m_afterKey = true;
+            return *this;
+        }
+
+        // Writes a UTF-8 string, escaping quotes, backslashes and control characters.
+        JsonWriter& String(const std::string& value)
+        {
+            static const char hexDigits[] = "0123456789abcdef";
+            BeforeValue();
+            m_json += '"';
+            for (char c : value)
+            {
+                switch (c)
+                {
+                    case '"': m_json += "\\\""; break;
+                    case '\\': m_json += "\\\\"; break;
+                    case '\n': m_json += "\\n"; break;
+                    case '\r': m_json += "\\r"; break;
+                    case '\t': m_json += "\\t"; break;
+                    default:
+                        if (static_cast<unsigned char>(c) < 0x20)
+                        {
+                            m_json += "\\u00";
+                            m_json += hexDigits[static_cast<unsigned char>(c) >> 4];
+                            m_json += hexDigits[static_cast<unsigned char>(c) & 0xF];
+                        }
+                        else
+                        {
+                            m_json += c;
+                        }
+                }
+            }
+            m_json += '"';
+            return *this;
+        }
+
+        // Writes an integer exactly, or a floating point value in the shortest form that reads back to the same value.
+        // JSON has no inf or nan, so those are written as null.
+        template <typename T> JsonWriter& Number(T value)
+        {
+            static_assert(std::is_arithmetic<T>::value, "JsonWriter::Number takes an arithmetic type");
+            char buffer[32];
+            std::to_chars_result result;
+            if constexpr (std::is_integral<T>::value)
+            {
+                result = std::to_chars(buffer, buffer + sizeof(buffer), value);
+            }
+            else
+            {
+                if (!std::isfinite(value))
+                {
+                    return Null();
+                }
+                result = std::to_chars(buffer, buffer + sizeof(buffer), static_cast<double>(value));
+            }
+            BeforeValue();
+            m_json.append(buffer, result.ptr);
+            return *this;
+        }
+
+        JsonWriter& Bool(bool value)
+        {
+            BeforeValue();
+            m_json += value ? "true" : "false";
+            return *this;
+        }
+
+        JsonWriter& Null()
+        {
+            BeforeValue();
+            m_json += "null";
+            return *this;
+        }
+
+        const std::string& GetString() const { return m_json; }
+
+    private:
+        JsonWriter& Open(char bracket)
+        {
+            BeforeValue();
+            m_json += bracket;
+            m_isEmpty.push_back(true);
+            return *this;
+        }
+
+        JsonWriter& Close(char bracket)
+        {
+            if (m_isEmpty.empty())
+            {
+                throw std::logic_error("JsonWriter: no object or array to close");
+            }
+            m_isEmpty.pop_back();
+            m_json += bracket;
+            return *this;
+        }
+
+        void BeforeValue()
+        {
+            if (m_afterKey)
+            {
+                m_afterKey = false;
+                return;
+            }
+            if (!m_isEmpty.empty())
+            {
+                if (!m_isEmpty.back())
+                {
+                    m_json += ',';
+                }
+                m_isEmpty.back() = false;
+            }
+        }
+
+        std::string m_json;
+        std::vector<bool> m_isEmpty; // one entry per open object or array, true until it gets its first element
+        bool m_afterKey = false;
+    };
+
+    // A JSON value parsed back from a report, e.g. JsonValue::Parse(line)["intervals"]["evaluate"]["time"]["mean"].
+    // Numbers are read as doubles and object members keep their order. Looking up a member that does not exist, or a
+    // member of something that is not an object, gives a null value, so parsers can ignore fields they do not know and
+    // read optional ones without checking every level.
+    class JsonValue
+    {
+    public:
+        enum class Type
+        {
+            Null,
+            Bool,
+            Number,
+            String,
+            Array,
+            Object,
+        };
+
+        // Throws std::runtime_error if text is not a single JSON value.
+        static JsonValue Parse(const std::string& text)
+        {
+            Parser parser{ text.data(), text.data() + text.size() };
+            JsonValue value = parser.ParseValue(0);
+            parser.SkipWhitespace();
+            if (parser.Position != parser.End)
+            {
+                parser.Fail("unexpected text after the value");
+            }
+            return value;
+        }
+
+        Type GetType() const { return m_type; }
+        bool IsNull() const { return m_type == Type::Null; }
+        bool IsNumber() const { return m_type == Type::Number; }
+        bool IsString() const { return m_type == Type::String; }
+        bool IsArray() const { return m_type == Type::Array; }
+        bool IsObject() const { return m_type == Type::Object; }
+
+        bool GetBool(bool fallback = false) const { return m_type == Type::Bool ? m_number != 0 : fallback; }
+        double GetNumber(double fallback = 0) const { return m_type == Type::Number ? m_number : fallback; }
+        // The string, or an empty string if this is not one
+        const std::string& GetString() const { return m_string; }
+        // The elements of an array, empty for other types
+        const std::vector<JsonValue>& GetElements() const { return m_elements; }
+        const std::vector<std::pair<std::string, JsonValue>>& GetMembers() const { return m_members; }
+
+        const JsonValue& operator[](const std::string& key) const
+        {
+            for (const auto& member : m_members)
+            {
+                if (member.first == key)
+                {
+                    return member.second;
+                }
+            }
+            static const JsonValue null;
+            return null;
+        }
+
+    private:
+        struct Parser
+        {
+            const char* Position;
+            const char* End;
+
+            // Deep enough for any report, shallow enough not to overflow the stack on malicious input
+            static const int MaxDepth = 256;
+
+            [[noreturn]] void Fail(const char* message) const
+            {
+                throw std::runtime_error(std::string("JsonValue: ") + message);
+            }
+
+            void SkipWhitespace()
+            {
+                while (Position != End &&
+                       (*Position == ' ' || *Position == '\t' || *Position == '\n' || *Position == '\r'))
+                {
+                    ++Position;
+                }
+            }
+
+            bool Consume(char c)
+            {
+                SkipWhitespace();
+                if (Position != End && *Position == c)
+                {
+                    ++Position;
+                    return true;
+                }
+                return false;
+            }
+
+            void Expect(const char* literal)
+            {
+                for (; *literal != '\0'; ++literal, ++Position)
+                {
+                    if (Position == End || *Position != *literal)
+                    {
+                        Fail("invalid literal");
+                    }
+                }
+            }
+
+            JsonValue ParseValue(int depth)
+            {
+                if (depth > MaxDepth)
+                {
+                    Fail("too deeply nested");
+                }
+                SkipWhitespace();
+                if (Position == End)
+                {
+                    Fail("unexpected end of text");
+                }
+                JsonValue value;
+                switch (*Position)
+                {
+                    case 'n': Expect("null"); break;
+                    case 't': Expect("true"); value.m_type = Type::Bool; value.m_number = 1; break;
+                    case 'f': Expect("false"); value.m_type = Type::Bool; break;
+                    case '"': value.m_type = Type::String; value.m_string = ParseString(); break;
+                    case '[':
+                        ++Position;
+                        value.m_type = Type::Array;
+                        if (!Consume(']'))
+                        {
+                            do
+                            {
+                                value.m_elements.push_back(ParseValue(depth + 1));
+                            } while (Consume(','));
+                            if (!Consume(']'))
+                            {
+                                Fail("expected , or ]");
+                            }
+                        }
+                        break;
+                    case '{':
+                        ++Position;
+                        value.m_type = Type::Object;
+                        if (!Consume('}'))
+                        {
+                            do
+                            {
+                                SkipWhitespace();
+                                if (Position == End || *Position != '"')
+                                {
+                                    Fail("expected a member name");
+                                }
+                                std::string key = ParseString();
+                                if (!Consume(':'))
+                                {
+                                    Fail("expected :");
+                                }
+                                value.m_members.emplace_back(std::move(key), ParseValue(depth + 1));
+                            } while (Consume(','));
+                            if (!Consume('}'))
+                            {
+                                Fail("expected , or }");
+                            }
+                        }
+                        break;
+                    default:
+                    {
+                        value.m_type = Type::Number;
+                        auto result = std::from_chars(Position, End, value.m_number);
+                        if (result.ec != std::errc() || result.ptr == Position)
+                        {
+                            Fail("invalid value");
+                        }
+                        Position = result.ptr;
+                    }
+                }
+                return value;
+            }
+
+            unsigned ParseHex4()
+            {
+                unsigned code = 0;
+                for (int i = 0; i < 4; ++i, ++Position)
+                {
+                    char c = Position != End ? *Position : '\0';
+                    unsigned digit = c >= '0' && c <= '9'   ? c - '0'
+                                     : c >= 'a' && c <= 'f' ? c - 'a' + 10
+                                     : c >= 'A' && c <= 'F' ? c - 'A' + 10
+                                                            : 16;
+                    if (digit == 16)
+                    {
+                        Fail("invalid \\u escape");
+                    }
+                    code = code * 16 + digit;
+                }
+                return code;
+            }
+
+            // Reads a string at the opening quote, decoding escapes to UTF-8.
+            std::string ParseString()
+            {
+                std::string text;
+                ++Position;
+                while (true)
+                {
+                    if (Position == End)
+                    {
+                        Fail("unterminated string");
+                    }
+                    char c = *Position++;
+                    if (c == '"')
+                    {
+                        return text;
+                    }
+                    if (c != '\\')
+                    {
+                        text += c;
+                        continue;
+                    }
+                    if (Position == End)
+                    {
+                        Fail("unterminated string");
+                    }
+                    switch (*Position++)
+                    {
+                        case '"': text += '"'; break;
+                        case '\\': text += '\\'; break;
+                        case '/': text += '/'; break;
+                        case 'b': text += '\b'; break;
+                        case 'f': text += '\f'; break;
+                        case 'n': text += '\n'; break;
+                        case 'r': text += '\r'; break;
+                        case 't': text += '\t'; break;
+                        case 'u':
+                        {
+                            unsigned code = ParseHex4();
+                            if (code >= 0xD800 && code < 0xDC00 && End - Position >= 6 && Position[0] == '\\' &&
+                                Position[1] == 'u')
+                            {
+                                Position += 2;
+                                unsigned low = ParseHex4();
+                                code = low >= 0xDC00 && low < 0xE000
+                                           ? 0x10000 + ((code - 0xD800) << 10) + (low - 0xDC00)
+                                           : 0xFFFD;
+                            }
+                            AppendUtf8(text, code);
+                            break;
+                        }
+                        default: Fail("invalid escape");
+                    }
+                }
+            }
+
+            static void AppendUtf8(std::string& text, unsigned code)
+            {
+                if (code < 0x80)
+                {
+                    text += static_cast<char>(code);
+                }
+                else if (code < 0x800)
+                {
+                    text += static_cast<char>(0xC0 | (code >> 6));
+                    text += static_cast<char>(0x80 | (code & 0x3F));
+                }
+                else if (code < 0x10000)
+                {
+                    text += static_cast<char>(0xE0 | (code >> 12));
+                    text += static_cast<char>(0x80 | ((code >> 6) & 0x3F));
+                    text += static_cast<char>(0x80 | (code & 0x3F));
+                }
+                else
+                {
+                    text += static_cast<char>(0xF0 | (code >> 18));
+                    text += static_cast<char>(0x80 | ((code >> 12) & 0x3F));
+                    text += static_cast<char>(0x80 | ((code >> 6) & 0x3F));
+                    text += static_cast<char>(0x80 | (code & 0x3F));
+                }
+            }
+        };
+
+        Type m_type = Type::Null;
+        double m_number = 0;
+        std::string m_string;
+        std::vector<JsonValue> m_elements;
+        std::vector<std::pair<std::string, JsonValue>> m_members;
+    };
+
+    // Percentiles written for every histogram, in [0, 100].
+    const double ReportedPercentiles[] = { 50, 90, 95, 99, 99.9 };
+
+    // Writes the exact statistics of a histogram, its standard percentiles and every bucket that holds values, so any
+    // other percentile can be recomputed from the report to within the histogram's relative precision.
+    inline void WriteHistogram(JsonWriter& json, const LatencyHistogram& histogram)
+    {
+        json.BeginObject();
+        json.Key("count").Number(histogram.GetCount());
+        json.Key("total").Number(histogram.GetTotal());
+        json.Key("mean").Number(histogram.GetMean());
+        json.Key("stdev").Number(histogram.GetStdev());
+        json.Key("min").Number(histogram.GetMin());
+        json.Key("max").Number(histogram.GetMax());
+        json.Key("percentiles").BeginObject();
+        for (double percentile : ReportedPercentiles)
+        {
+            char name[16] = "p";
+            *std::to_chars(name + 1, name + sizeof(name) - 1, percentile).ptr = '\0';
+            json.Key(name).Number(histogram.GetPercentile(percentile));
+        }
+        json.EndObject();
+        json.Key("relativePrecision").Number(histogram.GetRelativePrecision());
+        // [lowest value, highest value, count] of each bucket, lowest bucket first
+        json.Key("buckets").BeginArray();
+        histogram.ForEachBucket([&json](double lowest, double highest, uint64_t count) {
+            json.BeginArray().Number(lowest).Number(highest).Number(count).EndArray();
+        });
+        json.EndArray();
+        json.EndObject();
+    }
+
+    // Writes a list of key/value pairs (e.g. the -PerfOutput metadata) as an object of strings.
+    inline void WriteMetadata(JsonWriter& json, const std::vector<std::pair<std::string, std::string>>& metadata)
+    {
+        json.BeginObject();
+        for (const auto& entry : metadata)
+        {
+            json.Key(entry.first).String(entry.second);
+        }
+        json.EndObject();
+    }
+
+    // Collects the records of a run in memory. The run record, if set, is written before all other records.
+    class PerfReportSink
+    {
+    public:
+        void SetRunRecord(const JsonWriter& record) { m_runRecord = record.GetString(); }
+        void AddRecord(const JsonWriter& record) { m_records.push_back(record.GetString()); }
+        void AddRecord(const std::string& record) { m_records.push_back(record); }
+
+        size_t GetRecordCount() const { return m_records.size(); }
+        const std::vector<std::string>& GetRecords() const { return m_records; }
+
+        void Write(std::ostream& output) const
+        {
+            if (!m_runRecord.empty())
+            {
+                output << m_runRecord << '\n';
+            }
+            for (const auto& record : m_records)
+            {
+                output << record << '\n';
+            }
+        }
+
+        // Appends the report to the file at path, like the CSV perf output appends rows to an existing file.
+        void WriteToFile(const std::wstring& path) const
+        {
+            std::ofstream output(std::filesystem::path(path), std::ios_base::binary | std::ios_base::app);
+            if (output)
+            {
+                Write(output);
+                output.flush();
+            }
+            if (!output)
+            {
+                throw std::runtime_error("PerfReport: could not write the performance report");
+            }
+        }
+
+    private:
+        std::string m_runRecord;
+        std::vector<std::string> m_records;
+    };
+} // namespace PerfReport
@@ -0,0 +1,367 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+#if defined(_WIN32)
+#include <Windows.h>
+#include <psapi.h>
+#else
+#include <cstdio>
+#include <cstring>
+#include <sys/resource.h>
+#include <sys/time.h>
+#include <unistd.h>
+#endif
+
+// Resource counters sampled by a background thread, for -PerfSampling. Reading the process and GPU counters costs far
+// more than a sub-millisecond evaluation, so measured intervals only take a timestamp at their start and end (a Span)
+// and a sampler thread polls the counters every few milliseconds. Afterwards each span gets the change of every
+// counter between its start and end, interpolated between the samples around them: a span shorter than the sampling
+// interval gets its share of the change over that interval.
+// Nothing in here depends on WinML.
+namespace ResourceSampling
+{
+    // Milliseconds on the monotonic clock that spans and samples share.
+    inline double NowMilliseconds()
+    {
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    // Counters at one point in time. Fields a source does not fill stay 0.
+    struct ResourceSample
+    {
+        double Time = 0;               // NowMilliseconds
+        double CpuTime = 0;            // ms of user and kernel time of the process, over all of its threads
+        double PageFaults = 0;         // since the process started
+        double WorkingSet = 0;         // MB
+        double PeakWorkingSet = 0;     // MB
+        double PageFileUsage = 0;      // MB, private committed memory
+        double PeakPageFileUsage = 0;  // MB
+        double GpuUsage = 0;           // percent of the busiest engine since the previous sample
+        double GpuDedicatedMemory = 0; // MB
+        double GpuSharedMemory = 0;    // MB
+    };
+
+    // Fills a sample from a counter source, e.g. ReadProcessCounters. Returns false if the counters could not be read.
+    using SampleSource = std::function<bool(ResourceSample&)>;
+
+    // CPU time, page faults and memory of the current process. On Windows from GetProcessTimes and
+    // GetProcessMemoryInfo; elsewhere from getrusage and /proc/self/stat, where the page file usage is the virtual
+    // size of the process and its peak the largest seen by this process.
+    inline bool ReadProcessCounters(ResourceSample& sample)
+    {
+        const double megabyte = 1024.0 * 1024.0;
+#if defined(_WIN32)
+        HANDLE process = GetCurrentProcess();
+        FILETIME ignored, kernel, user;
+        PROCESS_MEMORY_COUNTERS counters = {};
+        if (!GetProcessTimes(process, &ignored, &ignored, &kernel, &user) ||
+            !GetProcessMemoryInfo(process, &counters, sizeof(counters)))
+        {
+            return false;
+        }
+        auto to100ns = [](const FILETIME& time) {
+            return static_cast<double>((static_cast<unsigned long long>(time.dwHighDateTime) << 32) |
+                                       time.dwLowDateTime);
+        };
+        sample.CpuTime = (to100ns(kernel) + to100ns(user)) / 10000.0;
+        sample.PageFaults = counters.PageFaultCount;
+        sample.WorkingSet = counters.WorkingSetSize / megabyte;
+        sample.PeakWorkingSet = counters.PeakWorkingSetSize / megabyte;
+        sample.PageFileUsage = counters.PagefileUsage / megabyte;
+        sample.PeakPageFileUsage = counters.PeakPagefileUsage / megabyte;
+        return true;
+#else
+        struct rusage usage;
+        if (getrusage(RUSAGE_SELF, &usage) != 0)
+        {
+            return false;
+        }
+        auto toMilliseconds = [](const timeval& time) { return time.tv_sec * 1000.0 + time.tv_usec / 1000.0; };
+        sample.CpuTime = toMilliseconds(usage.ru_utime) + toMilliseconds(usage.ru_stime);
+        sample.PageFaults = static_cast<double>(usage.ru_minflt + usage.ru_majflt);
+        sample.PeakWorkingSet = usage.ru_maxrss / 1024.0; // KB
+
+        // The fields after the command name, which may contain spaces: vsize and rss are the 21st and 22nd of them
+        FILE* file = std::fopen("/proc/self/stat", "r");
+        if (file == nullptr)
+        {
+            return false;
+        }
+        char line[1024];
+        size_t length = std::fread(line, 1, sizeof(line) - 1, file);
+        std::fclose(file);
+        line[length] = '\0';
+        const char* fields = std::strrchr(line, ')');
+        unsigned long long virtualSize = 0;
+        long long residentPages = 0;
+        if (fields == nullptr ||
+            std::sscanf(fields + 1, " %*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %*u %*u %*d %*d %*d %*d %*d %*d %*u "
+                                    "%llu %lld",
+                        &virtualSize, &residentPages) != 2)
+        {
+            return false;
+        }
+        static std::mutex peakMutex;
+        static double peakPageFileUsage = 0;
+        sample.WorkingSet = residentPages * static_cast<double>(sysconf(_SC_PAGESIZE)) / megabyte;
+        sample.PageFileUsage = virtualSize / megabyte;
+        std::lock_guard<std::mutex> lock(peakMutex);
+        peakPageFileUsage = (std::max)(peakPageFileUsage, sample.PageFileUsage);
+        sample.PeakPageFileUsage = peakPageFileUsage;
+        return true;
+#endif
+    }
+
+    // A measured interval, in NowMilliseconds.
+    struct Span
+    {
+        double Start = 0;
+        double End = 0;
+    };
+
+    // The change of the counters over a span, in the units of ResourceSample.
+    struct SpanCounters
+    {
+        double CpuTime = 0;
+        double PageFaults = 0;
+        double WorkingSet = 0;
+        double PeakWorkingSet = 0;
+        double PageFileUsage = 0;
+        double PeakPageFileUsage = 0;
+        double GpuUsage = 0; // average over the span
+        double GpuDedicatedMemory = 0;
+        double GpuSharedMemory = 0;
+        double StartWorkingSet = 0;      // at the start of the span, not a change
+        double StartGpuSharedMemory = 0; // at the start of the span, not a change
+        bool Covered = false;            // false if the span is not within the samples, which are then extrapolated
+    };
+
+    // The counters at time, linearly interpolated between the samples around it and the first or last sample outside
+    // of them. samples must be in time order.
+    inline ResourceSample Interpolate(const std::vector<ResourceSample>& samples, double time)
+    {
+        if (samples.empty())
+        {
+            return ResourceSample();
+        }
+        auto after = std::lower_bound(samples.begin(), samples.end(), time,
+                                      [](const ResourceSample& sample, double t) { return sample.Time < t; });
+        if (after == samples.begin() || after == samples.end())
+        {
+            ResourceSample sample = after == samples.end() ? samples.back() : samples.front();
+            sample.Time = time;
+            return sample;
+        }
+        const ResourceSample& a = *(after - 1);
+        const ResourceSample& b = *after;
+        double w = b.Time > a.Time ? (time - a.Time) / (b.Time - a.Time) : 1;
+        auto mix = [w](double x, double y) { return x + (y - x) * w; };
+        ResourceSample sample;
+        sample.Time = time;
+        sample.CpuTime = mix(a.CpuTime, b.CpuTime);
+        sample.PageFaults = mix(a.PageFaults, b.PageFaults);
+        sample.WorkingSet = mix(a.WorkingSet, b.WorkingSet);
+        sample.PeakWorkingSet = mix(a.PeakWorkingSet, b.PeakWorkingSet);
+        sample.PageFileUsage = mix(a.PageFileUsage, b.PageFileUsage);
+        sample.PeakPageFileUsage = mix(a.PeakPageFileUsage, b.PeakPageFileUsage);
+        sample.GpuUsage = b.GpuUsage; // covers the time since the previous sample
+        sample.GpuDedicatedMemory = mix(a.GpuDedicatedMemory, b.GpuDedicatedMemory);
+        sample.GpuSharedMemory = mix(a.GpuSharedMemory, b.GpuSharedMemory);
+        return sample;
+    }
+
+    // The change of the counters over span. The GPU usage of each sample covers the time since the one before, so
+    // the usage of the span is the average of those it overlaps, weighted by the overlap.
+    inline SpanCounters Correlate(const std::vector<ResourceSample>& samples, const Span& span)
+    {
+        SpanCounters counters;
+        if (samples.empty())
+        {
+            return counters;
+        }
+        ResourceSample start = Interpolate(samples, span.Start);
+        ResourceSample end = Interpolate(samples, span.End);
+        counters.CpuTime = end.CpuTime - start.CpuTime;
+        counters.PageFaults = end.PageFaults - start.PageFaults;
+        counters.WorkingSet = end.WorkingSet - start.WorkingSet;
+        counters.PeakWorkingSet = end.PeakWorkingSet - start.PeakWorkingSet;
+        counters.PageFileUsage = end.PageFileUsage - start.PageFileUsage;
+        counters.PeakPageFileUsage = end.PeakPageFileUsage - start.PeakPageFileUsage;
+        counters.GpuDedicatedMemory = end.GpuDedicatedMemory - start.GpuDedicatedMemory;
+        counters.GpuSharedMemory = end.GpuSharedMemory - start.GpuSharedMemory;
+        counters.StartWorkingSet = start.WorkingSet;
+        counters.StartGpuSharedMemory = start.GpuSharedMemory;
+        counters.Covered = span.Start >= samples.front().Time && span.End <= samples.back().Time;
+
+        double weightedUsage = 0;
+        double weight = 0;
+        for (size_t i = 1; i < samples.size() && samples[i - 1].Time < span.End; ++i)
+        {
+            double overlap = (std::min)(samples[i].Time, span.End) - (std::max)(samples[i - 1].Time, span.Start);
+            if (overlap > 0)
+            {
+                weightedUsage += samples[i].GpuUsage * overlap;
+                weight += overlap;
+            }
+        }
+        counters.GpuUsage = weight > 0 ? weightedUsage / weight : Interpolate(samples, span.End).GpuUsage;
+        return counters;
+    }
+
+    struct SamplerOptions
+    {
+        double IntervalMilliseconds = 1;
+        // When this many samples are kept, every other one is dropped and the interval doubles, so that a long run
+        // keeps sampling all of it at a coarser rate. Call DiscardBefore to drop samples no span needs any more.
+        size_t MaxSamples = 1 << 16;
+    };
+
+    // Polls its sources on a thread of its own from Start to Stop. The sources run one at a time, on the sampler
+    // thread or in SampleNow, so they need not be thread safe.
+    class ResourceSampler
+    {
+    public:
+        ResourceSampler(const SamplerOptions& options, std::vector<SampleSource> sources)
+            : m_options(options), m_sources(std::move(sources)), m_interval(options.IntervalMilliseconds)
+        {
+            m_options.MaxSamples = (std::max)(m_options.MaxSamples, static_cast<size_t>(4));
+        }
+
+        ~ResourceSampler() { Stop(); }
+
+        ResourceSampler(const ResourceSampler&) = delete;
+        ResourceSampler& operator=(const ResourceSampler&) = delete;
+
+        void Start()
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if (m_thread.joinable())
+            {
+                return;
+            }
+            m_stop = false;
+            TakeSample();
+            m_thread = std::thread([this]() { Run(); });
+        }
+
+        // Stops the thread after a last sample. The samples are kept.
+        void Stop()
+        {
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                if (!m_thread.joinable())
+                {
+                    return;
+                }
+                m_stop = true;
+            }
+            m_wake.notify_all();
+            m_thread.join();
+            std::lock_guard<std::mutex> lock(m_mutex);
+            TakeSample();
+        }
+
+        // Takes a sample on the calling thread, e.g. right after the last span to correlate ended.
+        void SampleNow()
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            TakeSample();
+        }
+
+        // Drops the samples before time, except for the last one, which the spans after it interpolate from.
+        void DiscardBefore(double time)
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            auto after = std::lower_bound(m_samples.begin(), m_samples.end(), time,
+                                          [](const ResourceSample& sample, double t) { return sample.Time < t; });
+            if (after - m_samples.begin() > 1)
+            {
+                m_samples.erase(m_samples.begin(), after - 1);
+            }
+        }
+
+        std::vector<ResourceSample> GetSamples() const
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            return m_samples;
+        }
+
+        // The current interval, larger than SamplerOptions::IntervalMilliseconds once MaxSamples was reached.
+        double GetIntervalMilliseconds() const
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            return m_interval;
+        }
+
+    private:
+        void Run()
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            auto next = std::chrono::steady_clock::now();
+            while (!m_stop)
+            {
+                // Sample on a fixed schedule rather than a fixed sleep, so the time spent sampling does not add up
+                next += std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                    std::chrono::duration<double, std::milli>(m_interval));
+                auto now = std::chrono::steady_clock::now();
+                if (next < now)
+                {
+                    next = now;
+                }
+                if (m_wake.wait_until(lock, next, [this]() { return m_stop; }))
+                {
+                    break;
+                }
+                TakeSample();
+            }
+        }
+
+        // Called with m_mutex held.
+        void TakeSample()
+        {
+            ResourceSample sample;
+            double before = NowMilliseconds();
+            for (const SampleSource& source : m_sources)
+            {
+                source(sample);
+            }
+            sample.Time = (before + NowMilliseconds()) / 2;
+            if (!m_samples.empty() && sample.Time < m_samples.back().Time)
+            {
+                sample.Time = m_samples.back().Time;
+            }
+            m_samples.push_back(sample);
+            if (m_samples.size() >= m_options.MaxSamples)
+            {
+                // Keep the first and last sample and every other one in between
+                size_t kept = 1;
+                for (size_t i = 2; i < m_samples.size(); i += 2)
+                {
+                    m_samples[kept++] = m_samples[i];
+                }
+                if (m_samples[kept - 1].Time != sample.Time)
+                {
+                    m_samples[kept++] = sample;
+                }
+                m_samples.resize(kept);
+                m_interval *= 2;
+            }
+        }
+
+        SamplerOptions m_options;
+        std::vector<SampleSource> m_sources;
+        mutable std::mutex m_mutex;
+        std::condition_variable m_wake;
+        std::thread m_thread;
+        bool m_stop = false;
+        double m_interval;
+        std::vector<ResourceSample> m_samples;
+    };
+} // namespace ResourceSampling
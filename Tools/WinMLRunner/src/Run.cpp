@@ -7,6 +7,8 @@
 #include <d3d11.h>
 #include <Windows.Graphics.DirectX.Direct3D11.interop.h>
 #include "Scenarios.h"
+#include "TraceTimeline.h"
+#include "IterationInputs.h"
 #include <winrt/Windows.Foundation.Metadata.h>
 
 using namespace winrt::Windows::Graphics::DirectX::Direct3D11;
@@ -17,6 +19,8 @@ std::vector<ILearningModelFeatureValue> GenerateInputFeatures(const LearningMode
                                                               const LearningModelDeviceWithMetadata& device, uint32_t iterationNum,
                                                               const std::wstring& imagePath)
 {
+    TraceTimeline::Scope scope("generate inputs", "input");
+    scope.SetArgument("iteration", iterationNum);
     std::vector<ILearningModelFeatureValue> inputFeatures;
     if (!imagePath.empty() && (!args.TerseOutput() || args.TerseOutput() && iterationNum == 0))
     {
@@ -60,6 +64,8 @@ HRESULT BindInputFeatures(const LearningModel& model, const LearningModelBinding
     {
         context.Clear();
 
+        TraceTimeline::Scope scope("bind");
+        scope.SetArgument("iteration", iterationNum);
         if (capturePerf)
         {
             WINML_PROFILING_START(profiler, iterationNum == 0 ? WINML_MODEL_TEST_PERF::BIND_VALUE_FIRST_RUN
@@ -76,7 +82,7 @@ HRESULT BindInputFeatures(const LearningModel& model, const LearningModelBinding
         {
             WINML_PROFILING_STOP(profiler, iterationNum == 0 ? WINML_MODEL_TEST_PERF::BIND_VALUE_FIRST_RUN
                                                              : WINML_MODEL_TEST_PERF::BIND_VALUE);
-            if (args.IsPerIterationCapture())
+            if (args.IsPerIterationCapture() || args.IsOutputPerfJson())
             {
                 output.SaveBindTimes(profiler, iterationNum);
             }
@@ -100,6 +106,11 @@ HRESULT LoadModel(LearningModel& model, const std::wstring& path, bool capturePe
         output.PrintLoadingInfo(path);
         for (uint32_t loadIteration = 0; loadIteration < args.NumLoadIterations(); loadIteration++)
         {
+            TraceTimeline::Scope scope("load model");
+            if (scope.IsRecording())
+            {
+                scope.SetDetail(to_string(path));
+            }
             if (capturePerf)
             {
                 WINML_PROFILING_START(profiler, WINML_MODEL_TEST_PERF::LOAD_MODEL);
@@ -109,12 +120,13 @@ HRESULT LoadModel(LearningModel& model, const std::wstring& path, bool capturePe
             if (capturePerf)
             {
                 WINML_PROFILING_STOP(profiler, WINML_MODEL_TEST_PERF::LOAD_MODEL);
-                if (args.IsPerIterationCapture())
+                if (args.IsPerIterationCapture() || args.IsOutputPerfJson())
                 {
                     output.SaveLoadTimes(profiler, iterationNum);
                 }
             }
         }
+        TraceTimeline::Global().AddMemoryCounters();
         output.PrintModelInfo(path, model);
     }
     catch (hresult_error hr)
@@ -176,6 +188,7 @@ HRESULT CreateSession(LearningModelSession& session,
     }
     try
     {
+        TraceTimeline::Scope scope("create session");
         CreateSessionConsideringSupportForSessionOptions(session, model, profiler, args, learningModelDevice, sessionOptions);
     }
     catch (hresult_error hr)
@@ -184,6 +197,7 @@ HRESULT CreateSession(LearningModelSession& session,
         std::wcout << hr.message().c_str() << std::endl;
         return hr.code();
     }
+    TraceTimeline::Global().AddMemoryCounters();
 
     if (args.IsEvaluationDebugOutputEnabled())
     {
@@ -194,10 +208,10 @@ HRESULT CreateSession(LearningModelSession& session,
     return S_OK;
 }
 
-HRESULT BindInputs(LearningModelBinding& context, const LearningModelSession& session,
-                   OutputHelper& output, const LearningModelDeviceWithMetadata& device, const CommandLineArgs& args,
-                   InputBindingType inputBindingType, InputDataType inputDataType, uint32_t iteration,
-                   Profiler<WINML_MODEL_TEST_PERF>& profiler, const std::wstring& imagePath)
+HRESULT PrepareInputFeatures(std::vector<ILearningModelFeatureValue>& inputFeatures, const LearningModelSession& session,
+                             const LearningModelDeviceWithMetadata& device, const CommandLineArgs& args,
+                             InputBindingType inputBindingType, InputDataType inputDataType, uint32_t iteration,
+                             const std::wstring& imagePath)
 {
     if (device.DeviceType == DeviceType::CPU && inputDataType == InputDataType::Tensor &&
         inputBindingType == InputBindingType::GPU)
@@ -205,31 +219,34 @@ HRESULT BindInputs(LearningModelBinding& context, const LearningModelSession& se
         std::cout << "Cannot create D3D12 device on client if CPU device type is selected." << std::endl;
         return E_INVALIDARG;
     }
-    bool useInputData = false;
-    bool isGarbageData = args.IsGarbageInput();
-    std::string completionString = "\n";
 
-    // Run the binding + evaluate multiple times and average the results
-    bool captureIterationPerf = args.IsPerformanceCapture() || args.IsPerIterationCapture();
-
-    std::vector<ILearningModelFeatureValue> inputFeatures;
     if (args.InputFeatureValuesProvided())
     {
         inputFeatures = args.ProvidedInputFeatureValues();
+        return S_OK;
     }
-    else
+
+    try
     {
-        try
-        {
-            inputFeatures = GenerateInputFeatures(session.Model(), args, inputBindingType, inputDataType, device, iteration, imagePath);
-        }
-        catch (hresult_error hr)
-        {
-            std::wcout << "\nGenerating Input Features [FAILED]" << std::endl;
-            std::wcout << hr.message().c_str() << std::endl;
-            return hr.code();
-        }
+        inputFeatures = GenerateInputFeatures(session.Model(), args, inputBindingType, inputDataType, device, iteration, imagePath);
+    }
+    catch (hresult_error hr)
+    {
+        std::wcout << "\nGenerating Input Features [FAILED]" << std::endl;
+        std::wcout << hr.message().c_str() << std::endl;
+        return hr.code();
     }
+    return S_OK;
+}
+
+HRESULT BindInputs(LearningModelBinding& context, const LearningModelSession& session,
+                   OutputHelper& output, const LearningModelDeviceWithMetadata& device, const CommandLineArgs& args,
+                   InputBindingType inputBindingType, InputDataType inputDataType, uint32_t iteration,
+                   Profiler<WINML_MODEL_TEST_PERF>& profiler, const std::vector<ILearningModelFeatureValue>& inputFeatures)
+{
+    // Run the binding + evaluate multiple times and average the results
+    bool captureIterationPerf = args.IsPerformanceCapture() || args.IsPerIterationCapture();
+
     HRESULT bindInputResult =
         BindInputFeatures(session.Model(), context, inputFeatures, args, output, captureIterationPerf, iteration, profiler);
 
@@ -248,7 +265,7 @@ HRESULT BindInputs(LearningModelBinding& context, const LearningModelSession& se
     return S_OK;
 }
 
-std::vector<std::wstring> GetModelsInDirectory(CommandLineArgs& args, OutputHelper* output)
+std::vector<std::wstring> GetModelsInDirectory(const CommandLineArgs& args, OutputHelper* output)
 {
     std::vector<std::wstring> modelPaths;
     std::wstring folderPath = args.FolderPath();
@@ -261,7 +278,6 @@ std::vector<std::wstring> GetModelsInDirectory(CommandLineArgs& args, OutputHelp
         {
             std::wstring fileName;
             fileName.assign(path.begin(), path.end());
-            args.SetModelPath(fileName);
             modelPaths.push_back(fileName);
         }
     }
@@ -314,6 +330,8 @@ HRESULT EvaluateModel(LearningModelEvaluationResult& result,
 {
     try
     {
+        TraceTimeline::Scope scope("evaluate");
+        scope.SetArgument("iteration", iterationNum);
         if (capturePerf)
         {
             WINML_PROFILING_START(profiler, iterationNum == 0 ? WINML_MODEL_TEST_PERF::EVAL_MODEL_FIRST_RUN
@@ -326,7 +344,7 @@ HRESULT EvaluateModel(LearningModelEvaluationResult& result,
         {
             WINML_PROFILING_STOP(profiler, iterationNum == 0 ? WINML_MODEL_TEST_PERF::EVAL_MODEL_FIRST_RUN
                                                              : WINML_MODEL_TEST_PERF::EVAL_MODEL);
-            if (args.IsPerIterationCapture())
+            if (args.IsPerIterationCapture() || args.IsOutputPerfJson())
             {
                 output.SaveEvalPerformance(profiler, iterationNum);
             }
@@ -400,15 +418,39 @@ void PrintIfPIXToolAttached(OutputHelper& output)
 }
 #endif
 
-void IterateBindAndEvaluate(const int maxBindAndEvalIterations, int& lastIteration, CommandLineArgs& args, OutputHelper& output,
-                            LearningModelSession& session, HRESULT& lastHr,
+// trackConvergence is set for the measured iterations of a configuration, which stop early with -Converge
+void IterateBindAndEvaluate(const int maxBindAndEvalIterations, const bool trackConvergence, int& lastIteration,
+                            CommandLineArgs& args, OutputHelper& output, LearningModelSession& session, HRESULT& lastHr,
                             const LearningModelDeviceWithMetadata& device, const InputBindingType inputBindingType,
                             const InputDataType inputDataType,
                             Profiler<WINML_MODEL_TEST_PERF>& profiler, const std::wstring& imagePath)
 {
     Timer iterationTimer;
+
+    // In steady state mode the binding and the input features are created once for the configuration so that the
+    // bind and evaluate measurements of each iteration don't include allocation and input decode.
+    IterationInputs<std::vector<ILearningModelFeatureValue>, LearningModelBinding> inputs(
+        args.IsSteadyState(),
+        [&](std::vector<ILearningModelFeatureValue>& inputFeatures, uint32_t iteration) {
+            lastHr = PrepareInputFeatures(inputFeatures, session, device, args, inputBindingType, inputDataType,
+                                          iteration, imagePath);
+            return SUCCEEDED(lastHr);
+        },
+        [&session]() { return LearningModelBinding(session); });
+
+    // With -Converge the run stops once the evaluate latency statistic is known well enough, -Iterations is the cap
+    std::unique_ptr<IterationConvergence::ConvergenceMonitor> convergence;
+    Timer runTimer;
+    if (trackConvergence && args.IsConvergence())
+    {
+        convergence = std::make_unique<IterationConvergence::ConvergenceMonitor>(args.ConvergenceOptions());
+        runTimer.Start();
+    }
+
     for (; lastIteration < maxBindAndEvalIterations; lastIteration++)
     {
+        TraceTimeline::Scope iterationScope("iteration");
+        iterationScope.SetArgument("iteration", lastIteration);
 #if defined(_AMD64_)
         // PIX markers only work on AMD64
         // If PIX tool was attached then capture already began for the first iteration before
@@ -431,15 +473,24 @@ void IterateBindAndEvaluate(const int maxBindAndEvalIterations, int& lastIterati
                 break;
             }
         }
-        LearningModelBinding context(session);
-        lastHr = BindInputs(context, session, output, device, args, inputBindingType, inputDataType, lastIteration, profiler, imagePath);
+        if (!inputs.BeginIteration(lastIteration))
+        {
+            break;
+        }
+        LearningModelBinding& context = inputs.GetBinding();
+        lastHr = BindInputs(context, session, output, device, args, inputBindingType, inputDataType, lastIteration,
+                            profiler, inputs.GetFeatures());
         if (FAILED(lastHr))
         {
             break;
         }
         LearningModelEvaluationResult result = nullptr;
         bool capture_perf = args.IsPerformanceCapture() || args.IsPerIterationCapture();
+        Timer evaluateTimer;
+        evaluateTimer.Start();
         lastHr = EvaluateModel(result, context, session, args, output, capture_perf, lastIteration, profiler);
+        double evaluateTime = evaluateTimer.Stop();
+        TraceTimeline::Global().AddMemoryCounters();
         if (FAILED(lastHr))
         {
             output.PrintEvaluatingInfo(lastIteration + 1, device.DeviceType, inputBindingType, inputDataType,
@@ -454,10 +505,16 @@ void IterateBindAndEvaluate(const int maxBindAndEvalIterations, int& lastIterati
             // Only print eval results on the first iteration, iff it's not garbage data
             if (!args.IsGarbageInput() || args.IsSaveTensor())
             {
+                TraceTimeline::Scope outputScope("process outputs", "output");
                 BindingUtilities::PrintOrSaveEvaluationResults(session.Model(), args, result.Outputs(), output, lastIteration);
             }
 
-            if (args.TerseOutput() && args.NumIterations() > 1)
+            if (args.TerseOutput() && convergence)
+            {
+                printf("Binding and Evaluating until the %s latency converges...",
+                       IterationConvergence::GetStatisticName(convergence->GetOptions().Statistic));
+            }
+            else if (args.TerseOutput() && args.NumIterations() > 1)
             {
                 printf("Binding and Evaluating %d more time%s...", args.NumIterations() - 1,
                        (args.NumIterations() == 2 ? "" : "s"));
@@ -466,6 +523,17 @@ void IterateBindAndEvaluate(const int maxBindAndEvalIterations, int& lastIterati
 #if defined(_AMD64_)
         EndPIXCapture(output);
 #endif
+        if (convergence && convergence->AddIteration(evaluateTime, runTimer.Stop()))
+        {
+            lastIteration++;
+            break;
+        }
+    }
+
+    output.SetInputCounts(inputs.GetPreparedCount(), inputs.GetBindingCount());
+    if (convergence)
+    {
+        output.SetConvergenceResult(convergence->GetOptions(), convergence->GetResult());
     }
 }
 
@@ -475,8 +543,8 @@ void RunBindAndEvaluateOnce(CommandLineArgs& args, OutputHelper& output, Learnin
                             Profiler<WINML_MODEL_TEST_PERF>& profiler, const std::wstring& imagePath)
 {
     int lastIteration = 0;
-    IterateBindAndEvaluate(1, lastIteration, args, output, session, lastHr, device, inputBindingType, inputDataType,
-                           profiler, imagePath);
+    IterateBindAndEvaluate(1, false, lastIteration, args, output, session, lastHr, device, inputBindingType,
+                           inputDataType, profiler, imagePath);
 }
 
 void WritePerfResults(CommandLineArgs& args, OutputHelper& output, LearningModelSession& session,
@@ -485,8 +553,15 @@ void WritePerfResults(CommandLineArgs& args, OutputHelper& output, LearningModel
                       const std::wstring& modelPath, const std::wstring& imagePath,
                       const uint32_t sessionCreationIteration, const int lastIteration)
 {
+    TraceTimeline::Scope scope("write results", "io");
+    profiler.CollectSamples();
     output.PrintResults(profiler, lastIteration, device.DeviceType, inputBindingType, inputDataType, device.DeviceCreationLocation,
                         args.IsPerformanceConsoleOutputVerbose());
+    output.PrintHardwareCounters(profiler);
+    if (args.IsConvergence())
+    {
+        output.PrintConvergenceResult();
+    }
     if (args.IsOutputPerf())
     {
         std::string deviceTypeStringified = TypeHelper::Stringify(device.DeviceType);
@@ -494,9 +569,20 @@ void WritePerfResults(CommandLineArgs& args, OutputHelper& output, LearningModel
         std::string inputBindingTypeStringified = TypeHelper::Stringify(inputBindingType);
         std::string deviceCreationLocationStringified = TypeHelper::Stringify(device.DeviceCreationLocation);
         output.WritePerformanceDataToCSV(profiler, lastIteration, modelPath, deviceTypeStringified,
-                                            inputDataTypeStringified, inputBindingTypeStringified,
+                                            inputBindingTypeStringified, inputDataTypeStringified,
                                             deviceCreationLocationStringified, args.GetPerformanceFileMetadata());
     }
+    if (args.IsOutputPerfJson())
+    {
+        const std::wstring& input = args.IsCSVInput()          ? args.CsvPath()
+                                    : args.IsTensorFileInput() ? args.TensorFilePath()
+                                                               : imagePath;
+        output.AddPerformanceDataToReport(profiler, lastIteration, modelPath, input,
+                                          TypeHelper::Stringify(device.DeviceType),
+                                          TypeHelper::Stringify(inputBindingType), TypeHelper::Stringify(inputDataType),
+                                          TypeHelper::Stringify(device.DeviceCreationLocation),
+                                          args.GetPerformanceFileMetadata());
+    }
     if (args.IsPerIterationCapture())
     {
         output.WritePerIterationPerformance(args, session.Model().Name().c_str(), imagePath);
@@ -516,7 +602,7 @@ void RunConfiguration(CommandLineArgs& args, OutputHelper& output, LearningModel
     else
     {
         int lastIteration = 0;
-        IterateBindAndEvaluate(args.NumIterations(), lastIteration, args, output, session, lastHr, device,
+        IterateBindAndEvaluate(args.NumIterations(), true, lastIteration, args, output, session, lastHr, device,
                                inputBindingType, inputDataType, profiler, imagePath);
         if (args.IsPerformanceCapture() && SUCCEEDED(lastHr))
         {
@@ -525,6 +611,99 @@ void RunConfiguration(CommandLineArgs& args, OutputHelper& output, LearningModel
         }
     }
 }
+
+HRESULT BatchEvaluateModel(LearningModel& model, const LearningModelDeviceWithMetadata& device, CommandLineArgs& args,
+                           OutputHelper& output, const InputBindingType inputBindingType,
+                           const InputDataType inputDataType, Profiler<WINML_MODEL_TEST_PERF>& profiler,
+                           const LearningModelSessionOptions& sessionOptions)
+{
+    // Samples are packed on the CPU, so only CPU bound tensors can be batched
+    if (inputDataType != InputDataType::Tensor || inputBindingType != InputBindingType::CPU)
+    {
+        std::cout << "Batched evaluation only supports CPU bound tensor input, skipping inputBinding = "
+                  << TypeHelper::Stringify(inputBindingType) << ", inputDataType = "
+                  << TypeHelper::Stringify(inputDataType) << std::endl;
+        return S_OK;
+    }
+
+    LearningModelSession session = nullptr;
+    HRESULT hr = CreateSession(session, model, device, args, output, profiler, sessionOptions);
+    if (FAILED(hr))
+    {
+        return hr;
+    }
+    ColorManagementMode colorManagementMode =
+        args.IsImageInput() ? GetColorManagementMode(model) : ColorManagementMode::DoNotColorManage;
+
+    // Each batch size gets its own binding, so tensorizing and packing the samples is not timed.
+    BatchEvaluatorFactory createEvaluator = [&](uint32_t batchSize) -> std::function<void()> {
+        TraceTimeline::Scope scope("create batch", "input");
+        scope.SetArgument("batch size", batchSize);
+        LearningModelBinding binding(session);
+        for (uint32_t i = 0; i < model.InputFeatures().Size(); i++)
+        {
+            auto&& description = model.InputFeatures().GetAt(i);
+            binding.Bind(description.Name(), BindingUtilities::CreateBatchedTensor(description, args.ImagePaths(),
+                                                                                   batchSize, args,
+                                                                                   colorManagementMode));
+        }
+        return [session, binding, batchSize]() {
+            TraceTimeline::Scope scope("evaluate batch");
+            scope.SetArgument("batch size", batchSize);
+            session.Evaluate(binding, L"");
+        };
+    };
+
+    try
+    {
+        std::vector<BatchResult> results =
+            RunBatchSweep(GetBatchSizeSweep(args.BatchSize()), args.NumIterations(), 1, createEvaluator);
+        output.PrintBatchResults(results, FindThroughputKnee(results), device.DeviceType, inputBindingType,
+                                 inputDataType);
+    }
+    catch (hresult_error error)
+    {
+        std::cout << "Batched evaluation [FAILED]" << std::endl;
+        std::wcout << error.message().c_str() << std::endl;
+        hr = error.code();
+    }
+    session.Close();
+    return hr;
+}
+
+// Starts recording the -TraceOutput timeline. The process of a -ParallelSweep job is named after the job.
+static void StartTraceOutput(const CommandLineArgs& args)
+{
+    TraceTimeline::Recorder& recorder = TraceTimeline::Global();
+    recorder.Enable();
+    std::string processName = "WinMLRunner";
+    if (!args.SweepJob().empty())
+    {
+        processName += " " + std::filesystem::path(args.ModelPath()).filename().u8string();
+        for (const auto& value : args.SweepJob())
+        {
+            processName += " " + to_string(value);
+        }
+    }
+    recorder.SetProcessName(processName);
+    recorder.SetThreadName("main");
+}
+
+static void WriteTraceOutput(const CommandLineArgs& args)
+{
+    if (!args.IsTraceOutput())
+    {
+        return;
+    }
+    TraceTimeline::Recorder& recorder = TraceTimeline::Global();
+    if (recorder.GetDroppedCount() > 0)
+    {
+        std::cout << "Trace output: dropped " << recorder.GetDroppedCount() << " events of threads that recorded more "
+                  << "than " << TraceTimeline::MaxEventsPerThread << std::endl;
+    }
+    recorder.WriteToFile(args.TraceOutputPath());
+}
+
 int run(CommandLineArgs& args,
         Profiler<WINML_MODEL_TEST_PERF>& profiler,
         const std::vector<LearningModelDeviceWithMetadata>& deviceList,
@@ -542,6 +721,19 @@ int run(CommandLineArgs& args,
     // Profiler is a wrapper class that captures and stores timing and memory usage data on the
     // CPU and GPU.
     profiler.Enable();
+    if (args.IsPerfSampling())
+    {
+        profiler.EnableSampling(args.PerfSamplingInterval());
+    }
+    std::string hardwareCountersError;
+    if (args.IsHardwareCounters() && !profiler.EnableHardwareCounters(hardwareCountersError))
+    {
+        std::cout << "Hardware counters are not available: " << hardwareCountersError << std::endl;
+    }
+    if (args.IsTraceOutput())
+    {
+        StartTraceOutput(args);
+    }
 
     output.SetCSVFileName(args.OutputPath());
     if (args.IsSaveTensor() || args.IsPerIterationCapture())
@@ -560,10 +752,17 @@ int run(CommandLineArgs& args,
         HRESULT lastHr = S_OK;
         if (args.IsConcurrentLoad())
         {
-            ConcurrentLoadModel(modelPaths, args.NumThreads(), args.ThreadInterval(), true);
+            ConcurrentLoadModel(modelPaths, (std::max)(args.NumThreads(), 1u), args.ThreadInterval(), true);
             printf("Concurrent model loading, will skip event trace for CPU fallback.");
+            WriteTraceOutput(args);
             return 0;
         }
+        if (args.IsParallelSweep())
+        {
+            HRESULT sweepHr = ParallelSweep(modelPaths, args, output);
+            WriteTraceOutput(args);
+            return sweepHr;
+        }
         traceHelper.Start();
         for (const auto& path : modelPaths)
         {
@@ -592,6 +791,18 @@ int run(CommandLineArgs& args,
                             // Resets all values from profiler for bind and evaluate.
                             profiler.Reset(WINML_MODEL_TEST_PERF::BIND_VALUE, WINML_MODEL_TEST_PERF::COUNT);
                         }
+                        if (args.IsConcurrentEvaluate())
+                        {
+                            lastHr = ConcurrentEvaluateModel(model, learningModelDevice, args, output, inputBindingType,
+                                                             inputDataType, sessionOptions);
+                            continue;
+                        }
+                        if (args.BatchSize() > 0)
+                        {
+                            lastHr = BatchEvaluateModel(model, learningModelDevice, args, output, inputBindingType,
+                                                        inputDataType, profiler, sessionOptions);
+                            continue;
+                        }
                         for (uint32_t sessionCreationIteration = 0;
                             sessionCreationIteration < args.NumSessionCreationIterations();
                             sessionCreationIteration++)
@@ -624,6 +835,11 @@ int run(CommandLineArgs& args,
             }
         }
         traceHelper.Stop();
+        if (args.IsOutputPerfJson())
+        {
+            output.WritePerformanceReport(args.PerfJsonOutputPath(), args.GetPerformanceFileMetadata());
+        }
+        WriteTraceOutput(args);
         return lastHr;
     }
     return 0;
@@ -4,4 +4,9 @@
 int run(CommandLineArgs& args,
     Profiler<WINML_MODEL_TEST_PERF>& profiler,
     const std::vector<LearningModelDeviceWithMetadata>& deviceList,
-        const LearningModelSessionOptions& sessionOptions);
\ No newline at end of file
+        const LearningModelSessionOptions& sessionOptions);
+std::vector<ILearningModelFeatureValue> GenerateInputFeatures(const LearningModel& model, const CommandLineArgs& args,
+                                                              InputBindingType inputBindingType,
+                                                              InputDataType inputDataType,
+                                                              const LearningModelDeviceWithMetadata& device,
+                                                              uint32_t iterationNum, const std::wstring& imagePath);
@@ -1,9 +1,22 @@
 #pragma once
 
 #include "common.h"
+#include "LearningModelDeviceHelper.h"
+
+class OutputHelper;
 
 // load a model in a multi-threaded environment with num_threads number of
 // threads Each thread will load a model once, with interval in milliseconds for
 // each thread tasks
 void ConcurrentLoadModel(const std::vector<std::wstring>& paths, unsigned num_threads, unsigned interval_milliseconds,
                          bool print_info);
+
+// measure evaluation throughput of a model with 1 to args.NumThreads() threads. Each thread creates its own session
+// on the model and evaluates args.NumIterations() times concurrently with the other threads
+HRESULT ConcurrentEvaluateModel(const LearningModel& model, const LearningModelDeviceWithMetadata& device,
+                                const CommandLineArgs& args, OutputHelper& output, InputBindingType inputBindingType,
+                                InputDataType inputDataType, const LearningModelSessionOptions& sessionOptions);
+
+// run every model, device, input data type and input binding type in its own WinMLRunner process, CPU jobs up to
+// args.SweepWorkers() at a time and jobs that use the GPU one at a time, and merge their perf results
+HRESULT ParallelSweep(const std::vector<std::wstring>& modelPaths, CommandLineArgs& args, OutputHelper& output);
@@ -0,0 +1,296 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Runs the jobs of a model sweep, one model, device, input type and input binding each, on a pool of workers. Jobs of
+// the same isolation group share a resource and run at most the limit of the group at a time, so that e.g. jobs using
+// the GPU run one after another while CPU jobs run side by side. Failed jobs can be retried, jobs running longer than
+// the timeout are cancelled, and progress is reported whenever a job finishes. How a job runs is up to the runner, e.g.
+// one WinMLRunner process per job, so nothing in here depends on WinML.
+namespace SweepScheduler
+{
+    using Clock = std::chrono::steady_clock;
+
+    struct SweepJob
+    {
+        std::wstring ModelPath;
+        std::string Device;           // as printed by TypeHelper::Stringify, e.g. "CPU" or "GPU"
+        std::string InputDataType;    // e.g. "Tensor"
+        std::string InputBindingType; // e.g. "CPU"
+        std::string Group;            // jobs of a group share a resource, e.g. "CPU" or "GPU"
+
+        std::string GetName() const
+        {
+            return std::filesystem::path(ModelPath).filename().u8string() + " " + Device + " " + InputDataType + " " +
+                   InputBindingType;
+        }
+    };
+
+    enum class JobStatus
+    {
+        Succeeded,
+        Failed,
+        TimedOut,
+    };
+
+    inline const char* GetStatusName(JobStatus status)
+    {
+        switch (status)
+        {
+            case JobStatus::Succeeded:
+                return "succeeded";
+            case JobStatus::Failed:
+                return "failed";
+            case JobStatus::TimedOut:
+                return "timed out";
+        }
+        return "unknown";
+    }
+
+    struct JobOutcome
+    {
+        JobStatus Status = JobStatus::Succeeded;
+        int ExitCode = 0;
+        bool Retryable = false; // the failure may not happen again, e.g. a crash. Time outs are always retryable.
+        std::string Message;
+    };
+
+    // What the runner knows about the attempt it runs.
+    struct JobContext
+    {
+        uint32_t Attempt = 1; // 1 for the first run of a job
+        bool HasDeadline = false;
+        Clock::time_point Deadline;
+
+        // The runner should give up and return once the deadline has passed; the attempt counts as timed out anyway.
+        bool IsCancelled() const { return HasDeadline && Clock::now() >= Deadline; }
+    };
+
+    // Runs one attempt of a job. Called on the worker threads, for several jobs at once.
+    using JobRunner = std::function<JobOutcome(const SweepJob& job, const JobContext& context)>;
+
+    struct JobResult
+    {
+        JobOutcome Outcome; // of the last attempt
+        uint32_t Attempts = 0;
+        double DurationMilliseconds = 0; // of all attempts
+    };
+
+    // Reported after every attempt.
+    struct SweepProgress
+    {
+        size_t JobIndex = 0;
+        const SweepJob* Job = nullptr;
+        const JobOutcome* Outcome = nullptr;
+        uint32_t Attempt = 1;
+        bool WillRetry = false;
+        double DurationMilliseconds = 0; // of the attempt
+        size_t Finished = 0;             // jobs that will not run again
+        size_t Failed = 0;               // finished jobs that did not succeed
+        size_t Running = 0;
+        size_t Total = 0;
+    };
+
+    struct SweepOptions
+    {
+        uint32_t Workers = 1;                        // jobs running at once over all groups
+        std::map<std::string, uint32_t> GroupLimits; // jobs of a group running at once, unlisted groups are unlimited
+        uint32_t MaxAttempts = 1;                    // of a job whose failure is retryable
+        std::chrono::milliseconds Timeout{ 0 };      // of an attempt, 0 for none
+        std::function<void(const SweepProgress&)> Progress; // called by one worker at a time, must not throw
+    };
+
+    // Runs every job and returns their results in the order of the jobs. Jobs are started in order, except that a job
+    // whose group is at its limit lets later jobs of other groups go first. Retries run after the jobs that have not
+    // started yet, so a job that keeps failing does not hold up the others.
+    inline std::vector<JobResult> RunSweep(const std::vector<SweepJob>& jobs, const SweepOptions& options,
+                                           const JobRunner& runner)
+    {
+        std::vector<JobResult> results(jobs.size());
+        std::deque<size_t> pending;
+        for (size_t i = 0; i < jobs.size(); ++i)
+        {
+            pending.push_back(i);
+        }
+        std::map<std::string, uint32_t> groupRunning;
+        size_t finished = 0;
+        size_t failed = 0;
+        size_t running = 0;
+        std::mutex mutex;
+        std::condition_variable changed;
+
+        auto groupHasRoom = [&](const std::string& group) {
+            auto limit = options.GroupLimits.find(group);
+            return limit == options.GroupLimits.end() || groupRunning[group] < (std::max)(limit->second, 1u);
+        };
+
+        auto work = [&]() {
+            std::unique_lock<std::mutex> lock(mutex);
+            for (;;)
+            {
+                auto next = pending.end();
+                changed.wait(lock, [&]() {
+                    next = std::find_if(pending.begin(), pending.end(),
+                                        [&](size_t index) { return groupHasRoom(jobs[index].Group); });
+                    return next != pending.end() || finished == jobs.size();
+                });
+                if (next == pending.end())
+                {
+                    return;
+                }
+                size_t index = *next;
+                pending.erase(next);
+                const SweepJob& job = jobs[index];
+                groupRunning[job.Group]++;
+                running++;
+                JobContext context;
+                context.Attempt = ++results[index].Attempts;
+                lock.unlock();
+
+                Clock::time_point start = Clock::now();
+                context.HasDeadline = options.Timeout.count() > 0;
+                context.Deadline = start + options.Timeout;
+                JobOutcome outcome;
+                try
+                {
+                    outcome = runner(job, context);
+                }
+                catch (const std::exception& e)
+                {
+                    outcome.Status = JobStatus::Failed;
+                    outcome.ExitCode = -1;
+                    outcome.Message = e.what();
+                }
+                catch (...)
+                {
+                    outcome.Status = JobStatus::Failed;
+                    outcome.ExitCode = -1;
+                    outcome.Message = "unknown exception";
+                }
+                if (context.IsCancelled())
+                {
+                    outcome.Status = JobStatus::TimedOut;
+                    outcome.Retryable = true;
+                }
+                double duration = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+
+                lock.lock();
+                groupRunning[job.Group]--;
+                running--;
+                JobResult& result = results[index];
+                result.Outcome = outcome;
+                result.DurationMilliseconds += duration;
+                bool willRetry = outcome.Status != JobStatus::Succeeded && outcome.Retryable &&
+                                 context.Attempt < options.MaxAttempts;
+                if (willRetry)
+                {
+                    pending.push_back(index);
+                }
+                else
+                {
+                    finished++;
+                    failed += outcome.Status == JobStatus::Succeeded ? 0 : 1;
+                }
+                if (options.Progress)
+                {
+                    SweepProgress progress;
+                    progress.JobIndex = index;
+                    progress.Job = &job;
+                    progress.Outcome = &result.Outcome;
+                    progress.Attempt = context.Attempt;
+                    progress.WillRetry = willRetry;
+                    progress.DurationMilliseconds = duration;
+                    progress.Finished = finished;
+                    progress.Failed = failed;
+                    progress.Running = running;
+                    progress.Total = jobs.size();
+                    options.Progress(progress);
+                }
+                changed.notify_all();
+            }
+        };
+
+        size_t workerCount = (std::min)(static_cast<size_t>((std::max)(options.Workers, 1u)), jobs.size());
+        std::vector<std::thread> workers;
+        for (size_t i = 1; i < workerCount; ++i)
+        {
+            workers.emplace_back(work);
+        }
+        if (workerCount > 0)
+        {
+            work();
+        }
+        for (auto& worker : workers)
+        {
+            worker.join();
+        }
+        return results;
+    }
+
+    // Appends the rows of the CSV files written by the jobs to the CSV file at path, with the header of the first
+    // file unless path already has one. Files that do not exist, e.g. of failed jobs, are skipped. Returns the number
+    // of rows appended.
+    inline size_t MergeCsvFiles(const std::vector<std::wstring>& inputs, const std::wstring& path)
+    {
+        std::error_code error;
+        bool hasHeader = std::filesystem::file_size(path, error) > 0 && !error;
+        std::ofstream output(std::filesystem::path(path), std::ios_base::binary | std::ios_base::app);
+        size_t rows = 0;
+        for (const auto& inputPath : inputs)
+        {
+            std::ifstream input(std::filesystem::path(inputPath), std::ios_base::binary);
+            std::string line;
+            for (bool first = true; std::getline(input, line); first = false)
+            {
+                if (line.empty() || line == "\r" || (first && hasHeader))
+                {
+                    continue;
+                }
+                output << line << '\n';
+                rows += first ? 0 : 1;
+                hasHeader = true;
+            }
+        }
+        output.flush();
+        if (!output)
+        {
+            throw std::runtime_error("SweepScheduler: could not write " + std::filesystem::path(path).u8string());
+        }
+        return rows;
+    }
+
+    // Reads the records of a JSON Lines performance report written by a job, without its run record, so that the
+    // records of all jobs can be written under one run record. Returns nothing if the file does not exist.
+    inline std::vector<std::string> ReadReportRecords(const std::wstring& path)
+    {
+        std::vector<std::string> records;
+        std::ifstream input(std::filesystem::path(path), std::ios_base::binary);
+        std::string line;
+        while (std::getline(input, line))
+        {
+            if (!line.empty() && line.back() == '\r')
+            {
+                line.pop_back();
+            }
+            if (!line.empty() && line.rfind("{\"type\":\"run\"", 0) != 0)
+            {
+                records.push_back(line);
+            }
+        }
+        return records;
+    }
+} // namespace SweepScheduler
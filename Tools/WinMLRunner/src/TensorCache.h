@@ -0,0 +1,322 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include "TensorTrace.h"
+
+// Caches decoded images and tensorized inputs, so that binding the same input again (every iteration, every session,
+// every model of a folder) does not decode and convert the file again. Entries are found by a key made of everything
+// that decides their values, evicted least recently used first once their total size exceeds the capacity, and can
+// also be spilled to a directory as single record tensor traces, which later runs memory map instead of producing the
+// values again. Nothing in here depends on WinML.
+namespace TensorCache
+{
+    // Everything that decides the values of a cached tensor. Keys with the same fields describe the same values, so the
+    // key doubles as the name of the tensor in the spill directory.
+    struct CacheKey
+    {
+        std::string Kind;          // what the values are, e.g. "bitmap" or "tensor"
+        std::wstring Path;         // of the source file
+        int64_t ModifiedTime = 0;  // of the source file, so an edited file is produced again, see StampFile
+        uint64_t FileSize = 0;
+        std::vector<int64_t> Shape; // requested shape
+        uint32_t DataType = 0;      // requested element type, as an ONNX data type
+        int32_t PixelFormat = 0;
+        int32_t Interpolation = -1; // -1 when the image is not scaled
+        int32_t ColorManagement = 0;
+        int32_t TensorizeFunction = 0;
+        float Scale = 1.0f;
+        std::vector<float> Means;
+        std::vector<float> StdDevs;
+
+        // Canonical text form of every field, floats as their bits so that keys compare exactly.
+        std::string ToString() const
+        {
+            std::ostringstream text;
+            auto floatBits = [](float value) {
+                uint32_t bits;
+                std::memcpy(&bits, &value, sizeof(bits));
+                return bits;
+            };
+            text << Kind << ";path=" << std::filesystem::path(Path).u8string() << ";modified=" << ModifiedTime
+                 << ";size=" << FileSize << ";shape=";
+            for (int64_t dimension : Shape)
+            {
+                text << dimension << ",";
+            }
+            text << ";type=" << DataType << ";pixels=" << PixelFormat << ";interpolation=" << Interpolation
+                 << ";color=" << ColorManagement << ";tensorize=" << TensorizeFunction << ";scale=" << std::hex
+                 << floatBits(Scale) << ";means=";
+            for (float mean : Means)
+            {
+                text << floatBits(mean) << ",";
+            }
+            text << ";stddevs=";
+            for (float stddev : StdDevs)
+            {
+                text << floatBits(stddev) << ",";
+            }
+            return text.str();
+        }
+    };
+
+    // 64 bit FNV-1a hash of a key, which names its spill file.
+    inline uint64_t HashKey(const std::string& key)
+    {
+        uint64_t hash = 14695981039346656037ull;
+        for (unsigned char c : key)
+        {
+            hash = (hash ^ c) * 1099511628211ull;
+        }
+        return hash;
+    }
+
+    // Sets the modification time and size of the source file of a key. Returns false if the file cannot be found,
+    // in which case nothing should be cached for it.
+    inline bool StampFile(CacheKey& key)
+    {
+        std::error_code error;
+        auto modified = std::filesystem::last_write_time(key.Path, error);
+        if (error)
+        {
+            return false;
+        }
+        key.FileSize = std::filesystem::file_size(key.Path, error);
+        key.ModifiedTime = static_cast<int64_t>(modified.time_since_epoch().count());
+        return !error;
+    }
+
+    struct CachedTensor
+    {
+        TensorFile::ElementType Type = TensorFile::ElementType::Float32;
+        std::vector<int64_t> Shape;
+        uint32_t Format = 0; // opaque to the cache, e.g. the pixel format of a bitmap
+        const uint8_t* Data = nullptr;
+        size_t SizeInBytes = 0;
+
+        // Owns Data: either the copy made by Insert or the mapped spill file
+        std::vector<uint8_t> Storage;
+        std::shared_ptr<TensorTrace::TraceReader> File;
+    };
+
+    struct CacheStatistics
+    {
+        uint64_t Hits = 0;      // found in memory
+        uint64_t DiskHits = 0;  // mapped from the spill directory
+        uint64_t Misses = 0;
+        uint64_t Evictions = 0; // dropped from memory to stay within the capacity
+        size_t Entries = 0;
+        size_t Bytes = 0;       // of the tensors in memory
+    };
+
+    // Thread safe. Two threads missing the same key at once both produce and insert it, the last insert wins.
+    class TensorCache
+    {
+    public:
+        // Keeps at most capacityBytes of tensors in memory. With a spill directory, inserted tensors are also written
+        // there, and tensors missing from memory are looked for there before they count as a miss.
+        explicit TensorCache(size_t capacityBytes, const std::wstring& spillDirectory = L"")
+            : m_capacity(capacityBytes), m_spillDirectory(spillDirectory)
+        {
+            if (!m_spillDirectory.empty())
+            {
+                std::error_code error;
+                std::filesystem::create_directories(m_spillDirectory, error);
+            }
+        }
+
+        TensorCache(const TensorCache&) = delete;
+        TensorCache& operator=(const TensorCache&) = delete;
+
+        // The cached tensor of key, or nullptr.
+        std::shared_ptr<const CachedTensor> Find(const CacheKey& key)
+        {
+            std::string name = key.ToString();
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                auto entry = m_index.find(name);
+                if (entry != m_index.end())
+                {
+                    m_entries.splice(m_entries.begin(), m_entries, entry->second);
+                    m_statistics.Hits++;
+                    return entry->second->Tensor;
+                }
+            }
+
+            std::shared_ptr<const CachedTensor> tensor = ReadSpillFile(name);
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if (tensor)
+            {
+                m_statistics.DiskHits++;
+                Add(name, tensor);
+            }
+            else
+            {
+                m_statistics.Misses++;
+            }
+            return tensor;
+        }
+
+        // Caches a copy of size bytes of data, a tensor of the given type and shape, and returns it.
+        std::shared_ptr<const CachedTensor> Insert(const CacheKey& key, TensorFile::ElementType type,
+                                                   const std::vector<int64_t>& shape, uint32_t format,
+                                                   const void* data, size_t size)
+        {
+            auto tensor = std::make_shared<CachedTensor>();
+            tensor->Type = type;
+            tensor->Shape = shape;
+            tensor->Format = format;
+            tensor->Storage.assign(static_cast<const uint8_t*>(data), static_cast<const uint8_t*>(data) + size);
+            tensor->Data = tensor->Storage.data();
+            tensor->SizeInBytes = size;
+
+            std::string name = key.ToString();
+            WriteSpillFile(name, *tensor);
+            std::lock_guard<std::mutex> lock(m_mutex);
+            Add(name, tensor);
+            return tensor;
+        }
+
+        CacheStatistics GetStatistics() const
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            CacheStatistics statistics = m_statistics;
+            statistics.Entries = m_entries.size();
+            statistics.Bytes = m_bytes;
+            return statistics;
+        }
+
+        // Path of the spill file of a key, empty without a spill directory.
+        std::wstring GetSpillPath(const CacheKey& key) const { return GetSpillPath(key.ToString()); }
+
+    private:
+        struct Entry
+        {
+            std::string Name;
+            std::shared_ptr<const CachedTensor> Tensor;
+        };
+
+        // Called with the mutex held. Tensors larger than the whole capacity are returned but not kept.
+        void Add(const std::string& name, const std::shared_ptr<const CachedTensor>& tensor)
+        {
+            auto existing = m_index.find(name);
+            if (existing != m_index.end())
+            {
+                m_bytes -= existing->second->Tensor->SizeInBytes;
+                m_entries.erase(existing->second);
+                m_index.erase(existing);
+            }
+            if (tensor->SizeInBytes > m_capacity)
+            {
+                return;
+            }
+            m_entries.push_front(Entry{ name, tensor });
+            m_index[name] = m_entries.begin();
+            m_bytes += tensor->SizeInBytes;
+            while (m_bytes > m_capacity)
+            {
+                m_bytes -= m_entries.back().Tensor->SizeInBytes;
+                m_index.erase(m_entries.back().Name);
+                m_entries.pop_back();
+                m_statistics.Evictions++;
+            }
+        }
+
+        std::wstring GetSpillPath(const std::string& name) const
+        {
+            if (m_spillDirectory.empty())
+            {
+                return L"";
+            }
+            wchar_t fileName[32];
+            swprintf(fileName, 32, L"%016llx.wmltrace", static_cast<unsigned long long>(HashKey(name)));
+            return (std::filesystem::path(m_spillDirectory) / fileName).wstring();
+        }
+
+        // A spill file holds one raw record named after the full key, so a hash collision or a damaged file is a miss.
+        std::shared_ptr<const CachedTensor> ReadSpillFile(const std::string& name) const
+        {
+            std::wstring path = GetSpillPath(name);
+            std::error_code error;
+            if (path.empty() || !std::filesystem::exists(path, error))
+            {
+                return nullptr;
+            }
+            try
+            {
+                auto file = std::make_shared<TensorTrace::TraceReader>(path);
+                if (file->GetRecords().size() != 1 || file->GetRecords()[0].Info.Name != name ||
+                    file->GetRecords()[0].PayloadCodec != TensorTrace::Codec::None)
+                {
+                    return nullptr;
+                }
+                const TensorTrace::Record& record = file->GetRecords()[0];
+                auto tensor = std::make_shared<CachedTensor>();
+                tensor->Type = record.Info.Type;
+                tensor->Shape = record.Info.Shape;
+                const std::string& metadata = record.Info.Metadata;
+                tensor->Format = static_cast<uint32_t>(std::stoul(metadata.substr(metadata.find('=') + 1)));
+                tensor->Data = record.Payload;
+                tensor->SizeInBytes = static_cast<size_t>(record.RawSize);
+                tensor->File = std::move(file);
+                return tensor;
+            }
+            catch (const std::exception&)
+            {
+                return nullptr;
+            }
+        }
+
+        // Writes to a temporary file first, so readers never map a partly written file. Failing to spill only costs
+        // later runs the time to produce the tensor again.
+        void WriteSpillFile(const std::string& name, const CachedTensor& tensor) const
+        {
+            std::wstring path = GetSpillPath(name);
+            if (path.empty())
+            {
+                return;
+            }
+            std::wostringstream temporaryPath;
+            temporaryPath << path << L"." << std::hash<std::thread::id>()(std::this_thread::get_id()) << L".tmp";
+            std::error_code error;
+            try
+            {
+                TensorTrace::TraceWriter writer(temporaryPath.str());
+                TensorTrace::RecordInfo info;
+                info.Name = name;
+                info.Type = tensor.Type;
+                info.Shape = tensor.Shape;
+                info.Metadata = "format=" + std::to_string(tensor.Format);
+                writer.Add(info, tensor.Data, tensor.SizeInBytes);
+                writer.Close();
+                std::filesystem::rename(temporaryPath.str(), path, error);
+            }
+            catch (const std::exception&)
+            {
+                error = std::make_error_code(std::errc::io_error);
+            }
+            if (error)
+            {
+                std::filesystem::remove(temporaryPath.str(), error);
+            }
+        }
+
+        size_t m_capacity;
+        std::wstring m_spillDirectory;
+        std::list<Entry> m_entries; // most recently used first
+        std::unordered_map<std::string, std::list<Entry>::iterator> m_index;
+        size_t m_bytes = 0;
+        CacheStatistics m_statistics;
+        mutable std::mutex m_mutex;
+    };
+} // namespace TensorCache
@@ -0,0 +1,576 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <cwctype>
+#include <limits>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <vector>
+#include "MappedFile.h"
+
+// Loader for binary tensor files:
+//   .npy : a NumPy array (numpy.save).
+//   .npz : an uncompressed archive of NumPy arrays (numpy.savez), one per model input, looked up by input name.
+//   other: a raw little endian, C ordered blob whose element type and shape are given by a sidecar text file with the
+//          same path plus ".header", holding a NumPy style header such as {'descr': '<f4', 'shape': (1, 3, 224, 224)}.
+// Files are memory mapped and the arrays point straight into the mapping. Nothing in here depends on WinML.
+namespace TensorFile
+{
+    enum class ElementType
+    {
+        Float32,
+        Float16,
+        Float64,
+        Int8,
+        UInt8,
+        Int16,
+        UInt16,
+        Int32,
+        UInt32,
+        Int64,
+        UInt64,
+        Bool,
+    };
+
+    // IEEE half precision value, kept as its bit pattern.
+    struct Float16
+    {
+        uint16_t Bits;
+    };
+
+    inline size_t GetElementSize(ElementType type)
+    {
+        switch (type)
+        {
+            case ElementType::Int8:
+            case ElementType::UInt8:
+            case ElementType::Bool:
+                return 1;
+            case ElementType::Float16:
+            case ElementType::Int16:
+            case ElementType::UInt16:
+                return 2;
+            case ElementType::Float32:
+            case ElementType::Int32:
+            case ElementType::UInt32:
+                return 4;
+            default:
+                return 8;
+        }
+    }
+
+    // a * b, throws std::invalid_argument if that does not fit in a size_t.
+    inline size_t MultiplySizes(size_t a, size_t b)
+    {
+        if (b != 0 && a > (std::numeric_limits<size_t>::max)() / b)
+        {
+            throw std::invalid_argument("TensorFile: the array is too large");
+        }
+        return a * b;
+    }
+
+    struct TensorData
+    {
+        std::string Name; // array name inside a .npz archive, empty otherwise
+        ElementType Type = ElementType::Float32;
+        std::vector<int64_t> Shape;
+        const uint8_t* Data = nullptr; // little endian, C order, not necessarily aligned
+        size_t SizeInBytes = 0;
+
+        // Throws std::invalid_argument if the number of elements does not fit in a size_t.
+        size_t GetElementCount() const
+        {
+            size_t count = 1;
+            for (int64_t dim : Shape)
+            {
+                count = MultiplySizes(count, static_cast<size_t>(dim));
+            }
+            return count;
+        }
+    };
+
+    struct TensorFileContents
+    {
+        std::shared_ptr<MappedFile> File; // keeps the data of every array mapped
+        std::vector<TensorData> Arrays;
+
+        // The array called name, or the only array if the file has just one. nullptr if there is no such array.
+        const TensorData* FindArray(const std::string& name) const
+        {
+            for (const auto& array : Arrays)
+            {
+                if (array.Name == name)
+                {
+                    return &array;
+                }
+            }
+            return Arrays.size() == 1 ? &Arrays.front() : nullptr;
+        }
+    };
+
+    // Element type of a NumPy type string such as "<f4" or "|u1". Big endian data is rejected.
+    inline ElementType ParseTypeDescription(const std::string& description)
+    {
+        if (description.size() < 3 || (description[0] != '<' && description[0] != '|' && description[0] != '='))
+        {
+            throw std::invalid_argument("TensorFile: unsupported element type '" + description +
+                                        "', only little endian numeric types are supported");
+        }
+        static const std::map<std::string, ElementType> types = {
+            { "f2", ElementType::Float16 }, { "f4", ElementType::Float32 }, { "f8", ElementType::Float64 },
+            { "i1", ElementType::Int8 },    { "u1", ElementType::UInt8 },   { "i2", ElementType::Int16 },
+            { "u2", ElementType::UInt16 },  { "i4", ElementType::Int32 },   { "u4", ElementType::UInt32 },
+            { "i8", ElementType::Int64 },   { "u8", ElementType::UInt64 },  { "b1", ElementType::Bool },
+        };
+        auto type = types.find(description.substr(1));
+        if (type == types.end())
+        {
+            throw std::invalid_argument("TensorFile: unsupported element type '" + description + "'");
+        }
+        return type->second;
+    }
+
+    // Parses the Python dictionary literal of a NumPy array header:
+    //   {'descr': '<f4', 'fortran_order': False, 'shape': (1, 3, 224, 224), }
+    // into the element type and shape. A missing 'fortran_order' means C order.
+    inline void ParseArrayHeader(const std::string& header, ElementType& type, std::vector<int64_t>& shape)
+    {
+        auto findValue = [&header](const char* key) -> size_t {
+            for (char quote : { '\'', '"' })
+            {
+                size_t position = header.find(std::string(1, quote) + key + quote);
+                if (position != std::string::npos)
+                {
+                    position = header.find(':', position);
+                    return position == std::string::npos ? position
+                                                         : header.find_first_not_of(" \t", position + 1);
+                }
+            }
+            return std::string::npos;
+        };
+
+        size_t descr = findValue("descr");
+        if (descr == std::string::npos || (header[descr] != '\'' && header[descr] != '"'))
+        {
+            throw std::invalid_argument("TensorFile: array header has no 'descr'");
+        }
+        size_t descrEnd = header.find(header[descr], descr + 1);
+        if (descrEnd == std::string::npos)
+        {
+            throw std::invalid_argument("TensorFile: array header is malformed");
+        }
+        type = ParseTypeDescription(header.substr(descr + 1, descrEnd - descr - 1));
+
+        size_t fortranOrder = findValue("fortran_order");
+        if (fortranOrder != std::string::npos && header.compare(fortranOrder, 4, "True") == 0)
+        {
+            throw std::invalid_argument("TensorFile: Fortran ordered arrays are not supported");
+        }
+
+        size_t shapeBegin = findValue("shape");
+        size_t shapeEnd = shapeBegin == std::string::npos ? shapeBegin : header.find(')', shapeBegin);
+        if (shapeBegin == std::string::npos || header[shapeBegin] != '(' || shapeEnd == std::string::npos)
+        {
+            throw std::invalid_argument("TensorFile: array header has no 'shape'");
+        }
+        shape.clear();
+        for (size_t position = shapeBegin + 1; position < shapeEnd;)
+        {
+            if (header[position] >= '0' && header[position] <= '9')
+            {
+                int64_t dim = 0;
+                for (; header[position] >= '0' && header[position] <= '9'; ++position)
+                {
+                    if (dim > ((std::numeric_limits<int64_t>::max)() - 9) / 10)
+                    {
+                        throw std::invalid_argument("TensorFile: array header has an invalid 'shape'");
+                    }
+                    dim = dim * 10 + (header[position] - '0');
+                }
+                shape.push_back(dim);
+            }
+            else if (header[position] == ',' || header[position] == ' ' || header[position] == 'L')
+            {
+                ++position;
+            }
+            else
+            {
+                throw std::invalid_argument("TensorFile: array header has an invalid 'shape'");
+            }
+        }
+    }
+
+    template <typename T> inline T ReadLittleEndian(const uint8_t* data)
+    {
+        T value = 0;
+        for (size_t i = 0; i < sizeof(T); ++i)
+        {
+            value |= static_cast<T>(data[i]) << (8 * i);
+        }
+        return value;
+    }
+
+    // Parses a .npy file held in memory. The returned array points into data.
+    inline TensorData ParseNpy(const uint8_t* data, size_t size)
+    {
+        if (size < 10 || std::memcmp(data, "\x93NUMPY", 6) != 0)
+        {
+            throw std::invalid_argument("TensorFile: not a .npy file");
+        }
+        uint8_t majorVersion = data[6];
+        size_t headerBegin = majorVersion == 1 ? 10 : 12;
+        if (majorVersion < 1 || majorVersion > 3 || size < headerBegin)
+        {
+            throw std::invalid_argument("TensorFile: unsupported .npy version");
+        }
+        size_t headerSize =
+            majorVersion == 1 ? ReadLittleEndian<uint16_t>(data + 8) : ReadLittleEndian<uint32_t>(data + 8);
+        if (headerBegin + headerSize > size)
+        {
+            throw std::invalid_argument("TensorFile: truncated .npy header");
+        }
+
+        TensorData tensorData;
+        ParseArrayHeader(std::string(reinterpret_cast<const char*>(data) + headerBegin, headerSize), tensorData.Type,
+                         tensorData.Shape);
+        tensorData.Data = data + headerBegin + headerSize;
+        tensorData.SizeInBytes = MultiplySizes(tensorData.GetElementCount(), GetElementSize(tensorData.Type));
+        if (tensorData.SizeInBytes > size - headerBegin - headerSize)
+        {
+            throw std::invalid_argument("TensorFile: .npy file is smaller than its shape");
+        }
+        return tensorData;
+    }
+
+    // Parses the arrays of a .npz (zip) archive held in memory. Only stored entries are supported, which is what
+    // numpy.savez writes; numpy.savez_compressed archives are rejected.
+    inline std::vector<TensorData> ParseNpz(const uint8_t* data, size_t size)
+    {
+        const uint32_t EndOfCentralDirectorySignature = 0x06054b50;
+        const uint32_t CentralDirectorySignature = 0x02014b50;
+        const uint32_t LocalHeaderSignature = 0x04034b50;
+
+        // The end of central directory record is the last 22 bytes of the archive, plus an optional comment
+        size_t endRecord = size;
+        for (size_t position = size >= 22 ? size - 22 : 0; size >= 22; --position)
+        {
+            if (ReadLittleEndian<uint32_t>(data + position) == EndOfCentralDirectorySignature)
+            {
+                endRecord = position;
+                break;
+            }
+            if (position == 0 || size - position > 22 + 0xFFFF)
+            {
+                break;
+            }
+        }
+        if (endRecord == size)
+        {
+            throw std::invalid_argument("TensorFile: not a .npz file");
+        }
+        size_t entryCount = ReadLittleEndian<uint16_t>(data + endRecord + 10);
+        size_t entry = ReadLittleEndian<uint32_t>(data + endRecord + 16);
+
+        std::vector<TensorData> arrays;
+        for (size_t i = 0; i < entryCount; ++i)
+        {
+            if (entry + 46 > size || ReadLittleEndian<uint32_t>(data + entry) != CentralDirectorySignature)
+            {
+                throw std::invalid_argument("TensorFile: corrupt .npz central directory");
+            }
+            uint16_t compression = ReadLittleEndian<uint16_t>(data + entry + 10);
+            uint64_t entrySize = ReadLittleEndian<uint32_t>(data + entry + 20);
+            uint64_t localHeader = ReadLittleEndian<uint32_t>(data + entry + 42);
+            size_t nameSize = ReadLittleEndian<uint16_t>(data + entry + 28);
+            size_t extraSize = ReadLittleEndian<uint16_t>(data + entry + 30);
+            size_t commentSize = ReadLittleEndian<uint16_t>(data + entry + 32);
+            if (entry + 46 + nameSize + extraSize > size)
+            {
+                throw std::invalid_argument("TensorFile: corrupt .npz central directory");
+            }
+            std::string name(reinterpret_cast<const char*>(data) + entry + 46, nameSize);
+
+            // Sizes and offsets that do not fit in 32 bits are in the zip64 extra field, in this order
+            const uint8_t* extra = data + entry + 46 + nameSize;
+            for (size_t field = 0; field + 4 <= extraSize;)
+            {
+                uint16_t fieldId = ReadLittleEndian<uint16_t>(extra + field);
+                uint16_t fieldSize = ReadLittleEndian<uint16_t>(extra + field + 2);
+                if (fieldId == 0x0001)
+                {
+                    size_t value = field + 4;
+                    uint64_t uncompressedSize = ReadLittleEndian<uint32_t>(data + entry + 24);
+                    if (uncompressedSize == 0xFFFFFFFF && value + 8 <= field + 4 + fieldSize)
+                    {
+                        value += 8;
+                    }
+                    if (entrySize == 0xFFFFFFFF && value + 8 <= field + 4 + fieldSize)
+                    {
+                        entrySize = ReadLittleEndian<uint64_t>(extra + value);
+                        value += 8;
+                    }
+                    if (localHeader == 0xFFFFFFFF && value + 8 <= field + 4 + fieldSize)
+                    {
+                        localHeader = ReadLittleEndian<uint64_t>(extra + value);
+                    }
+                }
+                field += 4 + fieldSize;
+            }
+            entry += 46 + nameSize + extraSize + commentSize;
+
+            if (compression != 0)
+            {
+                throw std::invalid_argument("TensorFile: compressed .npz archives are not supported, save the arrays "
+                                            "with numpy.savez instead of numpy.savez_compressed");
+            }
+            if (localHeader + 30 > size || ReadLittleEndian<uint32_t>(data + localHeader) != LocalHeaderSignature)
+            {
+                throw std::invalid_argument("TensorFile: corrupt .npz entry " + name);
+            }
+            size_t dataBegin = static_cast<size_t>(localHeader) + 30 +
+                               ReadLittleEndian<uint16_t>(data + localHeader + 26) +
+                               ReadLittleEndian<uint16_t>(data + localHeader + 28);
+            if (dataBegin > size || entrySize > size - dataBegin)
+            {
+                throw std::invalid_argument("TensorFile: corrupt .npz entry " + name);
+            }
+
+            TensorData array = ParseNpy(data + dataBegin, static_cast<size_t>(entrySize));
+            array.Name = name.size() > 4 && name.compare(name.size() - 4, 4, ".npy") == 0
+                             ? name.substr(0, name.size() - 4)
+                             : name;
+            arrays.push_back(std::move(array));
+        }
+        return arrays;
+    }
+
+    inline bool HasExtension(const std::wstring& path, const std::wstring& extension)
+    {
+        if (path.size() < extension.size())
+        {
+            return false;
+        }
+        for (size_t i = 0; i < extension.size(); ++i)
+        {
+            if (static_cast<wchar_t>(std::towlower(path[path.size() - extension.size() + i])) != extension[i])
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    inline TensorFileContents ReadTensorFile(const std::wstring& path)
+    {
+        TensorFileContents contents;
+        contents.File = std::make_shared<MappedFile>(path);
+        const uint8_t* data = reinterpret_cast<const uint8_t*>(contents.File->Data());
+        size_t size = contents.File->Size();
+        if (HasExtension(path, L".npy"))
+        {
+            contents.Arrays.push_back(ParseNpy(data, size));
+        }
+        else if (HasExtension(path, L".npz"))
+        {
+            contents.Arrays = ParseNpz(data, size);
+        }
+        else
+        {
+            MappedFile headerFile(path + L".header");
+            TensorData array;
+            ParseArrayHeader(std::string(headerFile.Data() ? headerFile.Data() : "", headerFile.Size()), array.Type,
+                             array.Shape);
+            array.Data = data;
+            array.SizeInBytes = MultiplySizes(array.GetElementCount(), GetElementSize(array.Type));
+            if (array.SizeInBytes != size)
+            {
+                throw std::invalid_argument("TensorFile: raw tensor file size does not match the shape in its header");
+            }
+            contents.Arrays.push_back(std::move(array));
+        }
+        return contents;
+    }
+
+    // Reads each file once per process: later calls for the same path return the cached contents.
+    inline std::shared_ptr<const TensorFileContents> LoadTensorFile(const std::wstring& path)
+    {
+        static std::mutex cacheMutex;
+        static std::map<std::wstring, std::shared_ptr<const TensorFileContents>> cache;
+
+        std::lock_guard<std::mutex> lock(cacheMutex);
+        auto cached = cache.find(path);
+        if (cached != cache.end())
+        {
+            return cached->second;
+        }
+        auto contents = std::make_shared<const TensorFileContents>(ReadTensorFile(path));
+        cache.emplace(path, contents);
+        return contents;
+    }
+
+    inline float HalfToFloat(uint16_t half)
+    {
+        uint32_t sign = static_cast<uint32_t>(half & 0x8000) << 16;
+        uint32_t exponent = (half >> 10) & 0x1F;
+        uint32_t mantissa = half & 0x3FF;
+        uint32_t bits;
+        if (exponent == 0x1F)
+        {
+            bits = sign | 0x7F800000 | (mantissa << 13); // inf and nan
+        }
+        else if (exponent != 0)
+        {
+            bits = sign | ((exponent + 112) << 23) | (mantissa << 13);
+        }
+        else if (mantissa == 0)
+        {
+            bits = sign;
+        }
+        else
+        {
+            // Subnormal half, normal float
+            exponent = 113;
+            while ((mantissa & 0x400) == 0)
+            {
+                mantissa <<= 1;
+                --exponent;
+            }
+            bits = sign | (exponent << 23) | ((mantissa & 0x3FF) << 13);
+        }
+        float value;
+        std::memcpy(&value, &bits, sizeof(value));
+        return value;
+    }
+
+    // Rounds to the nearest half, ties to even.
+    inline uint16_t FloatToHalf(float value)
+    {
+        uint32_t bits;
+        std::memcpy(&bits, &value, sizeof(bits));
+        uint32_t sign = (bits >> 16) & 0x8000;
+        bits &= 0x7FFFFFFF;
+        if (bits >= 0x7F800000)
+        {
+            return static_cast<uint16_t>(sign | 0x7C00 | (bits > 0x7F800000 ? 0x200 : 0)); // inf and nan
+        }
+        if (bits >= 0x477FF000)
+        {
+            return static_cast<uint16_t>(sign | 0x7C00); // rounds past the largest half
+        }
+        uint32_t result;
+        uint32_t remainder;
+        uint32_t halfway;
+        if (bits < 0x38800000)
+        {
+            // Subnormal half: the value in units of 2^-24
+            if (bits < 0x33000000)
+            {
+                return static_cast<uint16_t>(sign);
+            }
+            uint32_t shift = 126 - (bits >> 23);
+            uint32_t mantissa = (bits & 0x7FFFFF) | 0x800000;
+            result = mantissa >> shift;
+            remainder = mantissa & ((1u << shift) - 1);
+            halfway = 1u << (shift - 1);
+        }
+        else
+        {
+            result = (bits - 0x38000000) >> 13;
+            remainder = bits & 0x1FFF;
+            halfway = 0x1000;
+        }
+        if (remainder > halfway || (remainder == halfway && (result & 1) != 0))
+        {
+            ++result; // may carry into the exponent, which is the correct rounding
+        }
+        return static_cast<uint16_t>(sign | result);
+    }
+
+    template <typename To, typename From> inline To ConvertElement(From value)
+    {
+        if constexpr (std::is_same<To, From>::value)
+        {
+            return value;
+        }
+        else if constexpr (std::is_same<From, Float16>::value)
+        {
+            return ConvertElement<To>(HalfToFloat(value.Bits));
+        }
+        else if constexpr (std::is_same<To, Float16>::value)
+        {
+            return Float16{ FloatToHalf(static_cast<float>(value)) };
+        }
+        else if constexpr (std::is_same<To, bool>::value)
+        {
+            return value != 0;
+        }
+        else
+        {
+            return static_cast<To>(value);
+        }
+    }
+
+    // Calls visit with a value of the C++ type that stores elements of the given type.
+    template <typename F> inline void VisitElementType(ElementType type, F&& visit)
+    {
+        switch (type)
+        {
+            case ElementType::Float32:
+                return visit(float());
+            case ElementType::Float16:
+                return visit(Float16());
+            case ElementType::Float64:
+                return visit(double());
+            case ElementType::Int8:
+                return visit(int8_t());
+            case ElementType::UInt8:
+                return visit(uint8_t());
+            case ElementType::Int16:
+                return visit(int16_t());
+            case ElementType::UInt16:
+                return visit(uint16_t());
+            case ElementType::Int32:
+                return visit(int32_t());
+            case ElementType::UInt32:
+                return visit(uint32_t());
+            case ElementType::Int64:
+                return visit(int64_t());
+            case ElementType::UInt64:
+                return visit(uint64_t());
+            case ElementType::Bool:
+                return visit(bool());
+        }
+    }
+
+    // Converts count elements from source to destination, which must be aligned for its element type. The same type
+    // is a plain copy; otherwise every pair of types gets its own loop, which the compiler can vectorize for everything
+    // but half precision.
+    inline void ConvertElements(const void* source, ElementType sourceType, void* destination,
+                                ElementType destinationType, size_t count)
+    {
+        if (sourceType == destinationType)
+        {
+            std::memcpy(destination, source, count * GetElementSize(sourceType));
+            return;
+        }
+        VisitElementType(sourceType, [&](auto sourceValue) {
+            VisitElementType(destinationType, [&](auto destinationValue) {
+                typedef decltype(sourceValue) From;
+                typedef decltype(destinationValue) To;
+                const uint8_t* input = static_cast<const uint8_t*>(source);
+                To* output = static_cast<To*>(destination);
+                for (size_t i = 0; i < count; ++i)
+                {
+                    From value;
+                    std::memcpy(&value, input + i * sizeof(From), sizeof(From)); // source may be unaligned
+                    output[i] = ConvertElement<To>(value);
+                }
+            });
+        });
+    }
+} // namespace TensorFile
@@ -0,0 +1,306 @@
+#pragma once
+
+#include <algorithm>
+#include <charconv>
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include <utility>
+#include <vector>
+#include "TensorFile.h"
+#include "TensorizeKernels.h"
+
+#if defined(TENSORIZE_KERNELS_X64) && !defined(_MSC_VER)
+#include <cpuid.h>
+#endif
+
+#if defined(TENSORIZE_KERNELS_X64) && (defined(__GNUC__) || defined(__clang__))
+#define TENSOR_RESULTS_TARGET_F16C __attribute__((target("avx,f16c")))
+#else
+#define TENSOR_RESULTS_TARGET_F16C
+#endif
+
+// Post processing of float output tensors: float16 to float conversion, top K selection and the CSV dump of
+// -SaveTensorData. All of it works on chunks of values, so a float16 tensor can be converted into a small buffer on
+// the stack and consumed chunk by chunk without allocating a float copy of the whole tensor. Nothing in here depends
+// on WinML.
+namespace TensorResults
+{
+    // Values per chunk when a tensor is converted before it is consumed.
+    const size_t ChunkSize = 4096;
+
+    // True if the CPU (and OS) support the F16C half precision conversion instructions used with AVX.
+    inline bool HasF16C()
+    {
+        static const bool hasF16C = []() {
+#if defined(TENSORIZE_KERNELS_X64)
+            if (TensorizeKernels::GetSimdLevel() != TensorizeKernels::SimdLevel::AVX2)
+            {
+                return false; // AVX state must be enabled by the OS
+            }
+#if defined(_MSC_VER)
+            int info[4];
+            __cpuid(info, 1);
+            return (info[2] & (1 << 29)) != 0;
+#else
+            unsigned int eax, ebx, ecx, edx;
+            return __get_cpuid(1, &eax, &ebx, &ecx, &edx) && (ecx & (1u << 29)) != 0;
+#endif
+#else
+            return false;
+#endif
+        }();
+        return hasF16C;
+    }
+
+    inline void ConvertHalfToFloatScalar(const uint16_t* input, float* output, size_t count)
+    {
+        for (size_t i = 0; i < count; ++i)
+        {
+            output[i] = TensorFile::HalfToFloat(input[i]);
+        }
+    }
+
+#if defined(TENSORIZE_KERNELS_X64)
+    TENSOR_RESULTS_TARGET_F16C inline size_t ConvertHalfToFloatF16C(const uint16_t* input, float* output,
+                                                                    size_t count)
+    {
+        size_t i = 0;
+        for (; i + 8 <= count; i += 8)
+        {
+            __m128i halves = _mm_loadu_si128(reinterpret_cast<const __m128i*>(input + i));
+            _mm256_storeu_ps(output + i, _mm256_cvtph_ps(halves));
+        }
+        return i;
+    }
+#endif
+
+#if defined(TENSORIZE_KERNELS_NEON) && (defined(__GNUC__) || defined(__clang__))
+    inline size_t ConvertHalfToFloatNeon(const uint16_t* input, float* output, size_t count)
+    {
+        size_t i = 0;
+        for (; i + 4 <= count; i += 4)
+        {
+            vst1q_f32(output + i, vcvt_f32_f16(vreinterpret_f16_u16(vld1_u16(input + i))));
+        }
+        return i;
+    }
+#endif
+
+    // Converts count IEEE half precision values to float. Every half, including subnormals, infinities and nans,
+    // converts exactly, so all levels give the same result.
+    inline void ConvertHalfToFloat(const uint16_t* input, float* output, size_t count,
+                                   TensorizeKernels::SimdLevel level = TensorizeKernels::GetSimdLevel())
+    {
+        size_t done = 0;
+#if defined(TENSORIZE_KERNELS_X64)
+        if (level == TensorizeKernels::SimdLevel::AVX2 && HasF16C())
+        {
+            done = ConvertHalfToFloatF16C(input, output, count);
+        }
+#elif defined(TENSORIZE_KERNELS_NEON) && (defined(__GNUC__) || defined(__clang__))
+        if (level == TensorizeKernels::SimdLevel::NEON)
+        {
+            done = ConvertHalfToFloatNeon(input, output, count);
+        }
+#endif
+        (void)level;
+        ConvertHalfToFloatScalar(input + done, output + done, count - done);
+    }
+
+    // Kernels that return the index of the first value in [begin, end) that is greater than threshold, or end. They
+    // test a block of values with one compare per vector and only look at single values in a block that has a hit.
+
+    inline size_t FindFirstAboveScalar(const float* values, size_t begin, size_t end, float threshold)
+    {
+        for (size_t i = begin; i < end; ++i)
+        {
+            if (values[i] > threshold)
+            {
+                return i;
+            }
+        }
+        return end;
+    }
+
+#if defined(TENSORIZE_KERNELS_X64)
+    inline size_t FindFirstAboveSse2(const float* values, size_t begin, size_t end, float threshold)
+    {
+        __m128 limit = _mm_set1_ps(threshold);
+        size_t i = begin;
+        for (; i + 16 <= end; i += 16)
+        {
+            __m128 above = _mm_or_ps(_mm_or_ps(_mm_cmpgt_ps(_mm_loadu_ps(values + i), limit),
+                                               _mm_cmpgt_ps(_mm_loadu_ps(values + i + 4), limit)),
+                                     _mm_or_ps(_mm_cmpgt_ps(_mm_loadu_ps(values + i + 8), limit),
+                                               _mm_cmpgt_ps(_mm_loadu_ps(values + i + 12), limit)));
+            if (_mm_movemask_ps(above) != 0)
+            {
+                return FindFirstAboveScalar(values, i, i + 16, threshold);
+            }
+        }
+        return FindFirstAboveScalar(values, i, end, threshold);
+    }
+
+    TENSORIZE_KERNELS_TARGET_AVX2 inline size_t FindFirstAboveAvx2(const float* values, size_t begin, size_t end,
+                                                                   float threshold)
+    {
+        __m256 limit = _mm256_set1_ps(threshold);
+        size_t i = begin;
+        for (; i + 32 <= end; i += 32)
+        {
+            __m256 above =
+                _mm256_or_ps(_mm256_or_ps(_mm256_cmp_ps(_mm256_loadu_ps(values + i), limit, _CMP_GT_OQ),
+                                          _mm256_cmp_ps(_mm256_loadu_ps(values + i + 8), limit, _CMP_GT_OQ)),
+                             _mm256_or_ps(_mm256_cmp_ps(_mm256_loadu_ps(values + i + 16), limit, _CMP_GT_OQ),
+                                          _mm256_cmp_ps(_mm256_loadu_ps(values + i + 24), limit, _CMP_GT_OQ)));
+            if (_mm256_movemask_ps(above) != 0)
+            {
+                return FindFirstAboveScalar(values, i, i + 32, threshold);
+            }
+        }
+        return FindFirstAboveScalar(values, i, end, threshold);
+    }
+#endif
+
+#if defined(TENSORIZE_KERNELS_NEON)
+    inline size_t FindFirstAboveNeon(const float* values, size_t begin, size_t end, float threshold)
+    {
+        float32x4_t limit = vdupq_n_f32(threshold);
+        size_t i = begin;
+        for (; i + 16 <= end; i += 16)
+        {
+            uint32x4_t above = vorrq_u32(vorrq_u32(vcgtq_f32(vld1q_f32(values + i), limit),
+                                                   vcgtq_f32(vld1q_f32(values + i + 4), limit)),
+                                         vorrq_u32(vcgtq_f32(vld1q_f32(values + i + 8), limit),
+                                                   vcgtq_f32(vld1q_f32(values + i + 12), limit)));
+            if (vmaxvq_u32(above) != 0)
+            {
+                return FindFirstAboveScalar(values, i, i + 16, threshold);
+            }
+        }
+        return FindFirstAboveScalar(values, i, end, threshold);
+    }
+#endif
+
+    inline size_t FindFirstAbove(const float* values, size_t begin, size_t end, float threshold,
+                                 TensorizeKernels::SimdLevel level)
+    {
+        switch (level)
+        {
+#if defined(TENSORIZE_KERNELS_X64)
+            case TensorizeKernels::SimdLevel::AVX2:
+                return FindFirstAboveAvx2(values, begin, end, threshold);
+            case TensorizeKernels::SimdLevel::SSE2:
+                return FindFirstAboveSse2(values, begin, end, threshold);
+#elif defined(TENSORIZE_KERNELS_NEON)
+            case TensorizeKernels::SimdLevel::NEON:
+                return FindFirstAboveNeon(values, begin, end, threshold);
+#endif
+            default:
+                return FindFirstAboveScalar(values, begin, end, threshold);
+        }
+    }
+
+    // Keeps the k largest values seen so far, in a buffer sorted from the largest value down that is allocated once.
+    // Once the buffer is full its smallest value is the threshold a new value has to beat, and the SIMD kernels skip
+    // whole blocks of values below it, so only a handful of values out of a large tensor ever reach the buffer. Equal
+    // values keep the one with the lowest index, and nans are ignored.
+    class TopKSelector
+    {
+    public:
+        explicit TopKSelector(unsigned int k, TensorizeKernels::SimdLevel level = TensorizeKernels::GetSimdLevel())
+            : m_k(k), m_level(level)
+        {
+            m_values.reserve(k);
+        }
+
+        // Adds values[i] with index baseIndex + i for every i in [0, count).
+        void Add(const float* values, size_t count, size_t baseIndex = 0)
+        {
+            size_t i = 0;
+            for (; i < count && m_values.size() < m_k; ++i)
+            {
+                if (values[i] == values[i])
+                {
+                    Insert(values[i], baseIndex + i);
+                }
+            }
+            while (!m_values.empty() && m_values.size() == m_k &&
+                   (i = FindFirstAbove(values, i, count, m_values.back().first, m_level)) < count)
+            {
+                Insert(values[i], baseIndex + i);
+                ++i;
+            }
+        }
+
+        // The selected values and their indices, largest value first.
+        const std::vector<std::pair<float, int>>& GetValues() const { return m_values; }
+
+    private:
+        void Insert(float value, size_t index)
+        {
+            if (m_values.size() == m_k)
+            {
+                m_values.pop_back(); // only called with a value larger than the smallest one
+            }
+            auto position = std::upper_bound(
+                m_values.begin(), m_values.end(), value,
+                [](float newValue, const std::pair<float, int>& kept) { return newValue > kept.first; });
+            m_values.insert(position, { value, static_cast<int>(index) });
+        }
+
+        unsigned int m_k;
+        TensorizeKernels::SimdLevel m_level;
+        std::vector<std::pair<float, int>> m_values;
+    };
+
+    // Writes "index,value" lines in the format of std::ostream's default float output (6 significant digits), but
+    // formats them with std::to_chars into a buffer that is written out in large blocks instead of one stream
+    // insertion and flush per value.
+    class TensorCsvWriter
+    {
+    public:
+        static const size_t BufferSize = 64 * 1024;
+
+        explicit TensorCsvWriter(std::ostream& output) : m_output(output), m_buffer(BufferSize), m_used(0) {}
+        ~TensorCsvWriter() { Flush(); }
+
+        TensorCsvWriter(const TensorCsvWriter&) = delete;
+        TensorCsvWriter& operator=(const TensorCsvWriter&) = delete;
+
+        // Writes values[i] with index baseIndex + i for every i in [0, count).
+        void Write(const float* values, size_t count, size_t baseIndex = 0)
+        {
+            const size_t MaxLineSize = 64; // an index, a comma, a float with 6 digits and a line break
+            for (size_t i = 0; i < count; ++i)
+            {
+                if (BufferSize - m_used < MaxLineSize)
+                {
+                    Flush();
+                }
+                char* begin = m_buffer.data() + m_used;
+                char* end = m_buffer.data() + BufferSize;
+                char* p = std::to_chars(begin, end, baseIndex + i).ptr;
+                *p++ = ',';
+                p = std::to_chars(p, end, values[i], std::chars_format::general, 6).ptr;
+                *p++ = '\n';
+                m_used += p - begin;
+            }
+        }
+
+        void Flush()
+        {
+            if (m_used > 0)
+            {
+                m_output.write(m_buffer.data(), static_cast<std::streamsize>(m_used));
+                m_used = 0;
+            }
+        }
+
+    private:
+        std::ostream& m_output;
+        std::vector<char> m_buffer;
+        size_t m_used;
+    };
+} // namespace TensorResults
@@ -0,0 +1,909 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <limits>
+#include <map>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <tuple>
+#include <vector>
+#include "MappedFile.h"
+#include "TensorFile.h"
+
+// Tensor trace files: one append only binary file holding any number of tensors, e.g. every output of every iteration
+// of a run, or every tensor a debug operator sees. Each tensor is a record with a small header (name, element type,
+// shape, iteration, timestamp, free form metadata) and its data, either raw or split into blocks compressed with the
+// LZ4 block format. Closing the writer appends an index of the records, so a reader can jump to any record of a
+// memory mapped trace; a trace whose writer never closed is still read by scanning its records.
+//
+// Layout, all integers little endian:
+//   file header   char magic[8] "WMLTRACE", uint32 version, uint32 reserved
+//   records       each starts at a multiple of 8 bytes:
+//                   char   magic[4] "WMLR"
+//                   uint32 headerSize      bytes from the start of the record to its payload, a multiple of 8
+//                   uint64 payloadSize     bytes of payload, not counting the padding after it
+//                   uint64 rawSize         bytes of the uncompressed tensor data
+//                   uint64 iteration
+//                   int64  timestamp       nanoseconds since the Unix epoch
+//                   uint32 dataType        ONNX TensorProto data type, the values of WinML's TensorKind
+//                   uint16 codec           Codec
+//                   uint16 filters         Filters
+//                   uint32 dimensionCount
+//                   uint32 nameLength
+//                   uint32 metadataLength
+//                   uint32 blockCount      0 for raw payloads
+//                   int64  shape[dimensionCount]
+//                   uint32 blockSizes[blockCount]  stored bytes of each block, every block but the last holds
+//                                                  BlockSize raw bytes, and a block as big as its raw bytes is stored
+//                                                  as is
+//                   char   name[nameLength], char metadata[metadataLength], padding to a multiple of 8
+//                   payload, padding to a multiple of 8
+//   index         uint64 recordOffsets[recordCount], uint64 recordCount, uint64 indexOffset, char magic[8] "WMLINDEX"
+// Nothing in here depends on WinML.
+namespace TensorTrace
+{
+    const char FileMagic[8] = { 'W', 'M', 'L', 'T', 'R', 'A', 'C', 'E' };
+    const char RecordMagic[4] = { 'W', 'M', 'L', 'R' };
+    const char IndexMagic[8] = { 'W', 'M', 'L', 'I', 'N', 'D', 'E', 'X' };
+    const uint32_t FormatVersion = 1;
+    const size_t FileHeaderSize = 16;
+    const size_t RecordFixedHeaderSize = 64;
+    const size_t IndexTailSize = 24;
+    const size_t BlockSize = 1 << 20; // raw bytes per compressed block, a multiple of every element size
+
+    using ElementType = TensorFile::ElementType;
+
+    enum class Codec : uint16_t
+    {
+        None = 0,
+        Lz4 = 1,
+    };
+
+    enum Filters : uint16_t
+    {
+        FilterNone = 0,
+        // Before compression, the bytes of each block are regrouped by their position in the element (all first bytes,
+        // then all second bytes, ...), which turns the slowly changing sign and exponent bytes of floats into runs.
+        FilterShuffle = 1,
+    };
+
+    // ONNX TensorProto data type of an element type, the value stored in records.
+    inline uint32_t GetDataType(TensorFile::ElementType type)
+    {
+        switch (type)
+        {
+            case TensorFile::ElementType::Float32: return 1;
+            case TensorFile::ElementType::UInt8: return 2;
+            case TensorFile::ElementType::Int8: return 3;
+            case TensorFile::ElementType::UInt16: return 4;
+            case TensorFile::ElementType::Int16: return 5;
+            case TensorFile::ElementType::Int32: return 6;
+            case TensorFile::ElementType::Int64: return 7;
+            case TensorFile::ElementType::Bool: return 9;
+            case TensorFile::ElementType::Float16: return 10;
+            case TensorFile::ElementType::Float64: return 11;
+            case TensorFile::ElementType::UInt32: return 12;
+            case TensorFile::ElementType::UInt64: return 13;
+        }
+        throw std::invalid_argument("TensorTrace: unknown element type");
+    }
+
+    // False for strings and complex numbers.
+    inline bool IsSupportedDataType(uint32_t dataType) { return dataType >= 1 && dataType <= 13 && dataType != 8; }
+
+    inline TensorFile::ElementType GetElementType(uint32_t dataType)
+    {
+        switch (dataType)
+        {
+            case 1: return TensorFile::ElementType::Float32;
+            case 2: return TensorFile::ElementType::UInt8;
+            case 3: return TensorFile::ElementType::Int8;
+            case 4: return TensorFile::ElementType::UInt16;
+            case 5: return TensorFile::ElementType::Int16;
+            case 6: return TensorFile::ElementType::Int32;
+            case 7: return TensorFile::ElementType::Int64;
+            case 9: return TensorFile::ElementType::Bool;
+            case 10: return TensorFile::ElementType::Float16;
+            case 11: return TensorFile::ElementType::Float64;
+            case 12: return TensorFile::ElementType::UInt32;
+            case 13: return TensorFile::ElementType::UInt64;
+        }
+        throw std::invalid_argument("TensorTrace: unsupported data type " + std::to_string(dataType));
+    }
+
+    inline const char* GetElementTypeName(TensorFile::ElementType type)
+    {
+        static const char* const names[] = { "float32", "float16", "float64", "int8",   "uint8",  "int16",
+                                             "uint16",  "int32",   "uint32",  "int64", "uint64", "bool" };
+        return names[static_cast<size_t>(type)];
+    }
+
+    // LZ4 block format (https://github.com/lz4/lz4/blob/dev/doc/lz4_Block_format.md), so payloads can also be read by
+    // the reference library. The compressor is the greedy single hash table matcher of LZ4's fast mode.
+    namespace Lz4
+    {
+        const size_t MinMatch = 4;
+        const size_t LastLiterals = 5; // the last bytes of a block are always literals
+        const size_t MatchFindLimit = 12; // no match starts in the last bytes of a block
+        const size_t MaxOffset = 65535;
+        const int HashLog = 14;
+
+        inline size_t GetCompressBound(size_t size) { return size + size / 255 + 16; }
+
+        inline uint32_t Read32(const uint8_t* p)
+        {
+            uint32_t value;
+            std::memcpy(&value, p, sizeof(value));
+            return value;
+        }
+
+        inline uint8_t* WriteLength(uint8_t* op, size_t length)
+        {
+            for (; length >= 255; length -= 255)
+            {
+                *op++ = 255;
+            }
+            *op++ = static_cast<uint8_t>(length);
+            return op;
+        }
+
+        inline uint8_t* WriteSequence(uint8_t* op, const uint8_t* literals, size_t literalLength, size_t offset,
+                                      size_t matchLength)
+        {
+            uint8_t* token = op++;
+            *token = static_cast<uint8_t>((literalLength < 15 ? literalLength : 15) << 4);
+            if (literalLength >= 15)
+            {
+                op = WriteLength(op, literalLength - 15);
+            }
+            if (literalLength > 0)
+            {
+                std::memcpy(op, literals, literalLength);
+                op += literalLength;
+            }
+            if (offset != 0)
+            {
+                *op++ = static_cast<uint8_t>(offset);
+                *op++ = static_cast<uint8_t>(offset >> 8);
+                size_t length = matchLength - MinMatch;
+                *token |= static_cast<uint8_t>(length < 15 ? length : 15);
+                if (length >= 15)
+                {
+                    op = WriteLength(op, length - 15);
+                }
+            }
+            return op;
+        }
+
+        // Compresses size bytes into destination, which must hold GetCompressBound(size) bytes. Returns the number of
+        // bytes written.
+        inline size_t Compress(const uint8_t* source, size_t size, uint8_t* destination)
+        {
+            uint8_t* op = destination;
+            const uint8_t* anchor = source;
+            if (size > MatchFindLimit)
+            {
+                std::vector<uint32_t> table(size_t(1) << HashLog, 0);
+                const uint8_t* matchFindEnd = source + size - MatchFindLimit;
+                const uint8_t* matchEnd = source + size - LastLiterals;
+                const uint8_t* ip = source;
+                while (ip <= matchFindEnd)
+                {
+                    uint32_t sequence = Read32(ip);
+                    uint32_t hash = (sequence * 2654435761u) >> (32 - HashLog);
+                    const uint8_t* candidate = source + table[hash];
+                    table[hash] = static_cast<uint32_t>(ip - source);
+                    if (candidate >= ip || static_cast<size_t>(ip - candidate) > MaxOffset ||
+                        Read32(candidate) != sequence)
+                    {
+                        // Step further the longer nothing matched, so incompressible data is skipped quickly
+                        ip += 1 + (static_cast<size_t>(ip - anchor) >> 6);
+                        continue;
+                    }
+                    while (ip > anchor && candidate > source && ip[-1] == candidate[-1])
+                    {
+                        --ip;
+                        --candidate;
+                    }
+                    const uint8_t* end = ip + MinMatch;
+                    const uint8_t* match = candidate + MinMatch;
+                    while (end < matchEnd && *end == *match)
+                    {
+                        ++end;
+                        ++match;
+                    }
+                    op = WriteSequence(op, anchor, static_cast<size_t>(ip - anchor),
+                                       static_cast<size_t>(ip - candidate), static_cast<size_t>(end - ip));
+                    ip = end;
+                    anchor = ip;
+                }
+            }
+            op = WriteSequence(op, anchor, static_cast<size_t>(source + size - anchor), 0, 0);
+            return static_cast<size_t>(op - destination);
+        }
+
+        inline size_t ReadLength(const uint8_t*& ip, const uint8_t* end)
+        {
+            size_t length = 0;
+            uint8_t byte;
+            do
+            {
+                if (ip >= end)
+                {
+                    throw std::runtime_error("TensorTrace: corrupt LZ4 block");
+                }
+                byte = *ip++;
+                length += byte;
+            } while (byte == 255);
+            return length;
+        }
+
+        // Decompresses a whole block of exactly size bytes, checking every length and offset against the buffers.
+        inline void Decompress(const uint8_t* source, size_t sourceSize, uint8_t* destination, size_t size)
+        {
+            const uint8_t* ip = source;
+            const uint8_t* sourceEnd = source + sourceSize;
+            uint8_t* op = destination;
+            uint8_t* end = destination + size;
+            for (;;)
+            {
+                if (ip >= sourceEnd)
+                {
+                    throw std::runtime_error("TensorTrace: corrupt LZ4 block");
+                }
+                uint8_t token = *ip++;
+                size_t literalLength = token >> 4;
+                if (literalLength == 15)
+                {
+                    literalLength += ReadLength(ip, sourceEnd);
+                }
+                if (literalLength > static_cast<size_t>(sourceEnd - ip) ||
+                    literalLength > static_cast<size_t>(end - op))
+                {
+                    throw std::runtime_error("TensorTrace: corrupt LZ4 block");
+                }
+                if (literalLength > 0)
+                {
+                    std::memcpy(op, ip, literalLength);
+                    ip += literalLength;
+                    op += literalLength;
+                }
+                if (ip == sourceEnd)
+                {
+                    break; // the last sequence has no match
+                }
+                if (sourceEnd - ip < 2)
+                {
+                    throw std::runtime_error("TensorTrace: corrupt LZ4 block");
+                }
+                size_t offset = ip[0] | (static_cast<size_t>(ip[1]) << 8);
+                ip += 2;
+                size_t matchLength = token & 15;
+                if (matchLength == 15)
+                {
+                    matchLength += ReadLength(ip, sourceEnd);
+                }
+                matchLength += MinMatch;
+                if (offset == 0 || offset > static_cast<size_t>(op - destination) ||
+                    matchLength > static_cast<size_t>(end - op))
+                {
+                    throw std::runtime_error("TensorTrace: corrupt LZ4 block");
+                }
+                const uint8_t* match = op - offset;
+                if (offset >= matchLength)
+                {
+                    std::memcpy(op, match, matchLength);
+                    op += matchLength;
+                }
+                else
+                {
+                    // Overlapping copy, repeats the last offset bytes
+                    for (size_t i = 0; i < matchLength; ++i)
+                    {
+                        *op++ = match[i];
+                    }
+                }
+            }
+            if (op != end)
+            {
+                throw std::runtime_error("TensorTrace: corrupt LZ4 block");
+            }
+        }
+    } // namespace Lz4
+
+    inline void ShuffleBytes(const uint8_t* source, uint8_t* destination, size_t size, size_t elementSize)
+    {
+        size_t count = size / elementSize;
+        for (size_t byte = 0; byte < elementSize; ++byte)
+        {
+            uint8_t* output = destination + byte * count;
+            for (size_t i = 0; i < count; ++i)
+            {
+                output[i] = source[i * elementSize + byte];
+            }
+        }
+    }
+
+    inline void UnshuffleBytes(const uint8_t* source, uint8_t* destination, size_t size, size_t elementSize)
+    {
+        size_t count = size / elementSize;
+        for (size_t byte = 0; byte < elementSize; ++byte)
+        {
+            const uint8_t* input = source + byte * count;
+            for (size_t i = 0; i < count; ++i)
+            {
+                destination[i * elementSize + byte] = input[i];
+            }
+        }
+    }
+
+    // Header fields of a record.
+    struct RecordInfo
+    {
+        std::string Name;
+        TensorFile::ElementType Type = TensorFile::ElementType::Float32;
+        std::vector<int64_t> Shape;
+        uint64_t Iteration = 0;
+        int64_t Timestamp = 0; // nanoseconds since the Unix epoch, 0 for the time the record is written
+        std::string Metadata;  // free form, e.g. "model=squeezenet"
+    };
+
+    inline int64_t GetTimestamp()
+    {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                   std::chrono::system_clock::now().time_since_epoch())
+            .count();
+    }
+
+    inline size_t AlignUp(size_t value) { return (value + 7) & ~size_t(7); }
+
+    // Writes a trace file, replacing any existing file. Not thread safe.
+    class TraceWriter
+    {
+    public:
+        explicit TraceWriter(const std::wstring& path, Codec codec = Codec::None)
+            : m_file(std::filesystem::path(path), std::ios_base::binary | std::ios_base::trunc), m_codec(codec)
+        {
+            if (!m_file)
+            {
+                throw std::runtime_error("TensorTrace: could not create the trace file");
+            }
+            char header[FileHeaderSize] = {};
+            std::memcpy(header, FileMagic, sizeof(FileMagic));
+            std::memcpy(header + 8, &FormatVersion, sizeof(FormatVersion));
+            Write(header, sizeof(header));
+        }
+
+        // Writes the index, see Close.
+        ~TraceWriter()
+        {
+            try
+            {
+                Close();
+            }
+            catch (...)
+            {
+            }
+        }
+
+        TraceWriter(const TraceWriter&) = delete;
+        TraceWriter& operator=(const TraceWriter&) = delete;
+
+        // Appends a tensor of info.Type and info.Shape whose size bytes of little endian, C ordered data start at data.
+        void Add(const RecordInfo& info, const void* data, size_t size)
+        {
+            if (!m_file.is_open())
+            {
+                throw std::logic_error("TensorTrace: the trace is closed");
+            }
+            size_t elementSize = TensorFile::GetElementSize(info.Type);
+            size_t elementCount = 1;
+            for (int64_t dimension : info.Shape)
+            {
+                elementCount *= static_cast<size_t>(dimension);
+            }
+            if (elementCount * elementSize != size)
+            {
+                throw std::invalid_argument("TensorTrace: the data size does not match the shape of " + info.Name);
+            }
+
+            const uint8_t* bytes = static_cast<const uint8_t*>(data);
+            std::vector<uint32_t> blockSizes;
+            uint16_t filters = FilterNone;
+            m_payload.clear();
+            if (m_codec == Codec::Lz4)
+            {
+                filters = elementSize > 1 ? FilterShuffle : FilterNone;
+                for (size_t begin = 0; begin < size; begin += BlockSize)
+                {
+                    size_t blockSize = (std::min)(BlockSize, size - begin);
+                    const uint8_t* block = bytes + begin;
+                    if (filters & FilterShuffle)
+                    {
+                        m_shuffled.resize(blockSize);
+                        ShuffleBytes(block, m_shuffled.data(), blockSize, elementSize);
+                        block = m_shuffled.data();
+                    }
+                    size_t offset = m_payload.size();
+                    m_payload.resize(offset + Lz4::GetCompressBound(blockSize));
+                    size_t compressedSize = Lz4::Compress(block, blockSize, m_payload.data() + offset);
+                    if (compressedSize >= blockSize)
+                    {
+                        // Incompressible, stored as is
+                        std::memcpy(m_payload.data() + offset, block, blockSize);
+                        compressedSize = blockSize;
+                    }
+                    m_payload.resize(offset + compressedSize);
+                    blockSizes.push_back(static_cast<uint32_t>(compressedSize));
+                }
+            }
+            const uint8_t* payload = m_codec == Codec::Lz4 ? m_payload.data() : bytes;
+            size_t payloadSize = m_codec == Codec::Lz4 ? m_payload.size() : size;
+
+            size_t headerSize = AlignUp(RecordFixedHeaderSize + info.Shape.size() * sizeof(int64_t) +
+                                        blockSizes.size() * sizeof(uint32_t) + info.Name.size() + info.Metadata.size());
+            std::vector<uint8_t> header(headerSize, 0);
+            uint8_t* p = header.data();
+            auto put = [&p](const void* value, size_t valueSize) {
+                if (valueSize > 0)
+                {
+                    std::memcpy(p, value, valueSize);
+                    p += valueSize;
+                }
+            };
+            int64_t timestamp = info.Timestamp != 0 ? info.Timestamp : GetTimestamp();
+            uint32_t dataType = GetDataType(info.Type);
+            uint16_t codec = static_cast<uint16_t>(m_codec);
+            uint32_t counts[] = { static_cast<uint32_t>(info.Shape.size()), static_cast<uint32_t>(info.Name.size()),
+                                  static_cast<uint32_t>(info.Metadata.size()),
+                                  static_cast<uint32_t>(blockSizes.size()) };
+            uint32_t header32 = static_cast<uint32_t>(headerSize);
+            uint64_t payloadSize64 = payloadSize;
+            uint64_t rawSize64 = size;
+            put(RecordMagic, sizeof(RecordMagic));
+            put(&header32, sizeof(header32));
+            put(&payloadSize64, sizeof(payloadSize64));
+            put(&rawSize64, sizeof(rawSize64));
+            put(&info.Iteration, sizeof(info.Iteration));
+            put(&timestamp, sizeof(timestamp));
+            put(&dataType, sizeof(dataType));
+            put(&codec, sizeof(codec));
+            put(&filters, sizeof(filters));
+            put(counts, sizeof(counts));
+            put(info.Shape.data(), info.Shape.size() * sizeof(int64_t));
+            put(blockSizes.data(), blockSizes.size() * sizeof(uint32_t));
+            put(info.Name.data(), info.Name.size());
+            put(info.Metadata.data(), info.Metadata.size());
+
+            m_recordOffsets.push_back(m_offset);
+            Write(header.data(), header.size());
+            Write(payload, payloadSize);
+            static const char padding[8] = {};
+            Write(padding, AlignUp(payloadSize) - payloadSize);
+        }
+
+        // Writes the index and closes the file. Records can no longer be added.
+        void Close()
+        {
+            if (!m_file.is_open())
+            {
+                return;
+            }
+            uint64_t indexOffset = m_offset;
+            Write(m_recordOffsets.data(), m_recordOffsets.size() * sizeof(uint64_t));
+            uint64_t recordCount = m_recordOffsets.size();
+            Write(&recordCount, sizeof(recordCount));
+            Write(&indexOffset, sizeof(indexOffset));
+            Write(IndexMagic, sizeof(IndexMagic));
+            m_file.close();
+            if (!m_file)
+            {
+                throw std::runtime_error("TensorTrace: could not write the trace file");
+            }
+        }
+
+        size_t GetRecordCount() const { return m_recordOffsets.size(); }
+
+    private:
+        void Write(const void* data, size_t size)
+        {
+            m_file.write(static_cast<const char*>(data), static_cast<std::streamsize>(size));
+            if (!m_file)
+            {
+                throw std::runtime_error("TensorTrace: could not write the trace file");
+            }
+            m_offset += size;
+        }
+
+        std::ofstream m_file;
+        Codec m_codec;
+        uint64_t m_offset = 0;
+        std::vector<uint64_t> m_recordOffsets;
+        std::vector<uint8_t> m_payload;  // compressed blocks of the record being written
+        std::vector<uint8_t> m_shuffled; // shuffled bytes of the block being compressed
+    };
+
+    // A record of a mapped trace. The strings and the payload point into the mapping.
+    struct Record
+    {
+        RecordInfo Info;
+        Codec PayloadCodec = Codec::None;
+        uint16_t PayloadFilters = FilterNone;
+        uint64_t RawSize = 0;
+        std::vector<uint32_t> BlockSizes;
+        const uint8_t* Payload = nullptr;
+        uint64_t PayloadSize = 0;
+        uint64_t Offset = 0; // of the record in the file
+
+        size_t GetElementCount() const { return static_cast<size_t>(RawSize / TensorFile::GetElementSize(Info.Type)); }
+    };
+
+    // Reads a trace through a memory mapping. Raw records are used in place; compressed ones are decoded on request.
+    class TraceReader
+    {
+    public:
+        explicit TraceReader(const std::wstring& path) : m_file(std::make_shared<MappedFile>(path))
+        {
+            const uint8_t* data = reinterpret_cast<const uint8_t*>(m_file->Data());
+            size_t size = m_file->Size();
+            if (size < FileHeaderSize || std::memcmp(data, FileMagic, sizeof(FileMagic)) != 0)
+            {
+                throw std::invalid_argument("TensorTrace: not a tensor trace");
+            }
+            uint32_t version;
+            std::memcpy(&version, data + 8, sizeof(version));
+            if (version != FormatVersion)
+            {
+                throw std::invalid_argument("TensorTrace: unsupported trace version " + std::to_string(version));
+            }
+
+            if (size >= FileHeaderSize + IndexTailSize &&
+                std::memcmp(data + size - sizeof(IndexMagic), IndexMagic, sizeof(IndexMagic)) == 0)
+            {
+                uint64_t recordCount;
+                uint64_t indexOffset;
+                std::memcpy(&recordCount, data + size - IndexTailSize, sizeof(recordCount));
+                std::memcpy(&indexOffset, data + size - IndexTailSize + 8, sizeof(indexOffset));
+                if (indexOffset > size - IndexTailSize || (size - IndexTailSize - indexOffset) / 8 != recordCount ||
+                    (size - IndexTailSize - indexOffset) % 8 != 0)
+                {
+                    throw std::invalid_argument("TensorTrace: corrupt index");
+                }
+                m_records.reserve(static_cast<size_t>(recordCount));
+                for (uint64_t i = 0; i < recordCount; ++i)
+                {
+                    uint64_t offset;
+                    std::memcpy(&offset, data + indexOffset + i * 8, sizeof(offset));
+                    m_records.push_back(ParseRecord(data, static_cast<size_t>(indexOffset), offset));
+                }
+                m_hasIndex = true;
+            }
+            else
+            {
+                // The writer did not close the trace, keep every complete record
+                uint64_t offset = FileHeaderSize;
+                try
+                {
+                    while (offset < size)
+                    {
+                        m_records.push_back(ParseRecord(data, size, offset));
+                        const Record& record = m_records.back();
+                        offset = AlignUp(static_cast<size_t>(record.Payload + record.PayloadSize - data));
+                    }
+                }
+                catch (const std::invalid_argument&)
+                {
+                }
+            }
+        }
+
+        // False if the trace was not closed and its records were found by scanning.
+        bool HasIndex() const { return m_hasIndex; }
+        const std::vector<Record>& GetRecords() const { return m_records; }
+
+        // The first record with the given name and iteration, or nullptr.
+        const Record* Find(const std::string& name, uint64_t iteration) const
+        {
+            for (const auto& record : m_records)
+            {
+                if (record.Info.Name == name && record.Info.Iteration == iteration)
+                {
+                    return &record;
+                }
+            }
+            return nullptr;
+        }
+
+        // The data of a record: straight from the mapping for raw records, otherwise decoded into buffer.
+        const uint8_t* GetData(const Record& record, std::vector<uint8_t>& buffer) const
+        {
+            if (record.PayloadCodec == Codec::None)
+            {
+                return record.Payload;
+            }
+            size_t elementSize = TensorFile::GetElementSize(record.Info.Type);
+            buffer.resize(static_cast<size_t>(record.RawSize));
+            std::vector<uint8_t> shuffled;
+            const uint8_t* block = record.Payload;
+            for (size_t i = 0; i < record.BlockSizes.size(); ++i)
+            {
+                size_t begin = i * BlockSize;
+                size_t blockSize = (std::min)(BlockSize, buffer.size() - begin);
+                uint8_t* output = buffer.data() + begin;
+                if (record.PayloadFilters & FilterShuffle)
+                {
+                    shuffled.resize(blockSize);
+                    output = shuffled.data();
+                }
+                if (record.BlockSizes[i] == blockSize)
+                {
+                    std::memcpy(output, block, blockSize);
+                }
+                else
+                {
+                    Lz4::Decompress(block, record.BlockSizes[i], output, blockSize);
+                }
+                if (record.PayloadFilters & FilterShuffle)
+                {
+                    UnshuffleBytes(shuffled.data(), buffer.data() + begin, blockSize, elementSize);
+                }
+                block += record.BlockSizes[i];
+            }
+            return buffer.data();
+        }
+
+        // A record as TensorFile data, e.g. for TensorFile::ConvertElements. Decoded data is kept in buffer.
+        TensorFile::TensorData GetTensor(const Record& record, std::vector<uint8_t>& buffer) const
+        {
+            TensorFile::TensorData tensor;
+            tensor.Name = record.Info.Name;
+            tensor.Type = record.Info.Type;
+            tensor.Shape = record.Info.Shape;
+            tensor.Data = GetData(record, buffer);
+            tensor.SizeInBytes = static_cast<size_t>(record.RawSize);
+            return tensor;
+        }
+
+    private:
+        // Parses the record at offset, which must end before end.
+        static Record ParseRecord(const uint8_t* data, size_t end, uint64_t offset)
+        {
+            auto corrupt = []() { return std::invalid_argument("TensorTrace: corrupt record"); };
+            if (offset % 8 != 0 || offset > end || end - offset < RecordFixedHeaderSize ||
+                std::memcmp(data + offset, RecordMagic, sizeof(RecordMagic)) != 0)
+            {
+                throw corrupt();
+            }
+            const uint8_t* p = data + offset + sizeof(RecordMagic);
+            auto get = [&p](void* value, size_t valueSize) {
+                if (valueSize > 0)
+                {
+                    std::memcpy(value, p, valueSize);
+                    p += valueSize;
+                }
+            };
+            Record record;
+            record.Offset = offset;
+            uint32_t headerSize;
+            uint32_t dataType;
+            uint16_t codec;
+            uint32_t counts[4];
+            get(&headerSize, sizeof(headerSize));
+            get(&record.PayloadSize, sizeof(record.PayloadSize));
+            get(&record.RawSize, sizeof(record.RawSize));
+            get(&record.Info.Iteration, sizeof(record.Info.Iteration));
+            get(&record.Info.Timestamp, sizeof(record.Info.Timestamp));
+            get(&dataType, sizeof(dataType));
+            get(&codec, sizeof(codec));
+            get(&record.PayloadFilters, sizeof(record.PayloadFilters));
+            get(counts, sizeof(counts));
+            uint64_t variableSize = uint64_t(counts[0]) * 8 + uint64_t(counts[3]) * 4 + counts[1] + counts[2];
+            if (headerSize < RecordFixedHeaderSize + variableSize || headerSize > end - offset ||
+                record.PayloadSize > end - offset - headerSize || codec > static_cast<uint16_t>(Codec::Lz4))
+            {
+                throw corrupt();
+            }
+            record.Info.Type = GetElementType(dataType);
+            record.PayloadCodec = static_cast<Codec>(codec);
+            record.Info.Shape.resize(counts[0]);
+            get(record.Info.Shape.data(), counts[0] * sizeof(int64_t));
+            record.BlockSizes.resize(counts[3]);
+            get(record.BlockSizes.data(), counts[3] * sizeof(uint32_t));
+            record.Info.Name.assign(reinterpret_cast<const char*>(p), counts[1]);
+            p += counts[1];
+            record.Info.Metadata.assign(reinterpret_cast<const char*>(p), counts[2]);
+            record.Payload = data + offset + headerSize;
+
+            // The sizes must add up, so decoding never reads or writes out of bounds
+            size_t elementCount = 1;
+            for (int64_t dimension : record.Info.Shape)
+            {
+                if (dimension < 0)
+                {
+                    throw corrupt();
+                }
+                elementCount *= static_cast<size_t>(dimension);
+            }
+            uint64_t storedSize = 0;
+            for (uint32_t blockSize : record.BlockSizes)
+            {
+                storedSize += blockSize;
+            }
+            bool sizesMatch = elementCount * TensorFile::GetElementSize(record.Info.Type) == record.RawSize;
+            if (record.PayloadCodec == Codec::None)
+            {
+                sizesMatch = sizesMatch && record.BlockSizes.empty() && record.PayloadSize == record.RawSize;
+            }
+            else
+            {
+                sizesMatch = sizesMatch && storedSize == record.PayloadSize &&
+                             record.BlockSizes.size() == (record.RawSize + BlockSize - 1) / BlockSize;
+            }
+            if (!sizesMatch)
+            {
+                throw corrupt();
+            }
+            return record;
+        }
+
+        std::shared_ptr<MappedFile> m_file;
+        std::vector<Record> m_records;
+        bool m_hasIndex = false;
+    };
+
+    // Tolerances of a comparison: elements a (expected) and b match when |a - b| <= Absolute + Relative * |a|, like
+    // numpy.isclose. Two nans match, a nan and a number do not.
+    struct Tolerance
+    {
+        double Absolute = 0;
+        double Relative = 0;
+    };
+
+    struct TensorDifference
+    {
+        bool ShapesMatch = true;
+        bool TypesMatch = true; // element types may differ, e.g. a float16 and a float32 run, values are still compared
+        size_t ElementCount = 0;
+        size_t Mismatches = 0;
+        size_t FirstMismatch = 0;
+        // Largest error of the mismatching elements, or of all elements if they all match
+        double MaxAbsoluteError = 0;
+        size_t MaxErrorIndex = 0;
+        double Expected = 0; // values at MaxErrorIndex
+        double Actual = 0;
+
+        bool IsMatch() const { return ShapesMatch && Mismatches == 0; }
+    };
+
+    inline TensorDifference CompareTensors(const TensorFile::TensorData& expected, const TensorFile::TensorData& actual,
+                                           const Tolerance& tolerance)
+    {
+        TensorDifference difference;
+        difference.TypesMatch = expected.Type == actual.Type;
+        difference.ShapesMatch = expected.Shape == actual.Shape;
+        if (!difference.ShapesMatch)
+        {
+            return difference;
+        }
+        difference.ElementCount = expected.GetElementCount();
+        const size_t chunkSize = 4096;
+        std::vector<double> expectedValues(chunkSize);
+        std::vector<double> actualValues(chunkSize);
+        size_t expectedElementSize = TensorFile::GetElementSize(expected.Type);
+        size_t actualElementSize = TensorFile::GetElementSize(actual.Type);
+        for (size_t begin = 0; begin < difference.ElementCount; begin += chunkSize)
+        {
+            size_t count = (std::min)(chunkSize, difference.ElementCount - begin);
+            TensorFile::ConvertElements(expected.Data + begin * expectedElementSize, expected.Type,
+                                        expectedValues.data(), TensorFile::ElementType::Float64, count);
+            TensorFile::ConvertElements(actual.Data + begin * actualElementSize, actual.Type, actualValues.data(),
+                                        TensorFile::ElementType::Float64, count);
+            for (size_t i = 0; i < count; ++i)
+            {
+                double a = expectedValues[i];
+                double b = actualValues[i];
+                double error = std::abs(a - b);
+                bool match = (std::isnan(a) && std::isnan(b)) || a == b ||
+                             error <= tolerance.Absolute + tolerance.Relative * std::abs(a);
+                if (!match)
+                {
+                    if (difference.Mismatches++ == 0)
+                    {
+                        difference.FirstMismatch = begin + i;
+                    }
+                    if (std::isnan(error))
+                    {
+                        error = std::numeric_limits<double>::infinity();
+                    }
+                }
+                if (!match && (error > difference.MaxAbsoluteError || difference.Mismatches == 1))
+                {
+                    difference.MaxAbsoluteError = error;
+                    difference.MaxErrorIndex = begin + i;
+                    difference.Expected = a;
+                    difference.Actual = b;
+                }
+                else if (match && difference.Mismatches == 0 && error > difference.MaxAbsoluteError)
+                {
+                    difference.MaxAbsoluteError = error;
+                    difference.MaxErrorIndex = begin + i;
+                    difference.Expected = a;
+                    difference.Actual = b;
+                }
+            }
+        }
+        return difference;
+    }
+
+    // A pair of records with the same name and iteration, or a record found in only one of the traces.
+    struct RecordDifference
+    {
+        const Record* Expected = nullptr;
+        const Record* Actual = nullptr;
+        TensorDifference Difference;
+
+        bool IsMatch() const { return Expected != nullptr && Actual != nullptr && Difference.IsMatch(); }
+    };
+
+    // Pairs the records of two traces by name, iteration and, when a trace holds several records with the same name
+    // and iteration (e.g. a folder of models), their order, then compares each pair. Records are in the order of the
+    // expected trace, followed by the records only found in the actual trace.
+    inline std::vector<RecordDifference> CompareTraces(const TraceReader& expected, const TraceReader& actual,
+                                                       const Tolerance& tolerance)
+    {
+        typedef std::tuple<std::string, uint64_t, size_t> Key;
+        auto getKeys = [](const TraceReader& trace) {
+            std::map<std::pair<std::string, uint64_t>, size_t> occurrences;
+            std::vector<Key> keys;
+            for (const auto& record : trace.GetRecords())
+            {
+                size_t occurrence = occurrences[{ record.Info.Name, record.Info.Iteration }]++;
+                keys.emplace_back(record.Info.Name, record.Info.Iteration, occurrence);
+            }
+            return keys;
+        };
+        std::vector<Key> expectedKeys = getKeys(expected);
+        std::vector<Key> actualKeys = getKeys(actual);
+        std::map<Key, const Record*> actualRecords;
+        for (size_t i = 0; i < actualKeys.size(); ++i)
+        {
+            actualRecords[actualKeys[i]] = &actual.GetRecords()[i];
+        }
+
+        std::vector<RecordDifference> differences;
+        std::vector<uint8_t> expectedBuffer;
+        std::vector<uint8_t> actualBuffer;
+        for (size_t i = 0; i < expectedKeys.size(); ++i)
+        {
+            RecordDifference difference;
+            difference.Expected = &expected.GetRecords()[i];
+            auto match = actualRecords.find(expectedKeys[i]);
+            if (match != actualRecords.end())
+            {
+                difference.Actual = match->second;
+                actualRecords.erase(match);
+                difference.Difference =
+                    CompareTensors(expected.GetTensor(*difference.Expected, expectedBuffer),
+                                   actual.GetTensor(*difference.Actual, actualBuffer), tolerance);
+            }
+            differences.push_back(difference);
+        }
+        for (size_t i = 0; i < actualKeys.size(); ++i)
+        {
+            if (actualRecords.count(actualKeys[i]) != 0)
+            {
+                RecordDifference difference;
+                difference.Actual = &actual.GetRecords()[i];
+                differences.push_back(difference);
+            }
+        }
+        return differences;
+    }
+} // namespace TensorTrace
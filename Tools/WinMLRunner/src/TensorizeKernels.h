@@ -0,0 +1,561 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+#include <type_traits>
+#include <vector>
+#include "ThreadPool.h"
+
+#if defined(_M_X64) || defined(__x86_64__)
+#define TENSORIZE_KERNELS_X64
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+#elif defined(_M_ARM64) || defined(__aarch64__)
+#define TENSORIZE_KERNELS_NEON
+#include <arm_neon.h>
+#endif
+
+#if defined(TENSORIZE_KERNELS_X64) && (defined(__GNUC__) || defined(__clang__))
+#define TENSORIZE_KERNELS_TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define TENSORIZE_KERNELS_TARGET_AVX2
+#endif
+
+// Deinterleave and normalize kernels that turn pixel (or CSV) buffers into tensor data.
+//
+// Normalization ((x / scale) - mean) / stddev is rewritten as x * multiplier + offset with per channel constants that
+// are computed once, so the inner loops have no divides. The common image layouts (one channel, or four channels per
+// pixel of uint8 / uint16, and one channel of float) have SSE2, AVX2 and NEON kernels that are picked at runtime; every
+// other layout, and the tail of every row, goes through the scalar kernel. Nothing in here depends on WinML.
+namespace TensorizeKernels
+{
+    enum class SimdLevel
+    {
+        Scalar,
+        SSE2,
+        AVX2,
+        NEON,
+    };
+
+    inline const char* SimdLevelName(SimdLevel level)
+    {
+        switch (level)
+        {
+            case SimdLevel::SSE2:
+                return "SSE2";
+            case SimdLevel::AVX2:
+                return "AVX2";
+            case SimdLevel::NEON:
+                return "NEON";
+            default:
+                return "Scalar";
+        }
+    }
+
+    // Widest instruction set supported by both this build and the CPU it is running on.
+    inline SimdLevel GetSimdLevel()
+    {
+        static const SimdLevel level = []() {
+#if defined(TENSORIZE_KERNELS_X64)
+#if defined(_MSC_VER)
+            int info[4];
+            __cpuid(info, 0);
+            if (info[0] < 7)
+            {
+                return SimdLevel::SSE2;
+            }
+            __cpuid(info, 1);
+            const int osxsaveAndAvx = (1 << 27) | (1 << 28);
+            if ((info[2] & osxsaveAndAvx) != osxsaveAndAvx || (_xgetbv(0) & 6) != 6)
+            {
+                return SimdLevel::SSE2;
+            }
+            __cpuidex(info, 7, 0);
+            return (info[1] & (1 << 5)) != 0 ? SimdLevel::AVX2 : SimdLevel::SSE2;
+#else
+            return __builtin_cpu_supports("avx2") ? SimdLevel::AVX2 : SimdLevel::SSE2;
+#endif
+#elif defined(TENSORIZE_KERNELS_NEON)
+            return SimdLevel::NEON;
+#else
+            return SimdLevel::Scalar;
+#endif
+        }();
+        return level;
+    }
+
+    struct NormalizeConstants
+    {
+        std::vector<float> Multipliers; // 1 / (scale * stddev)
+        std::vector<float> Offsets;     // -mean / stddev
+    };
+
+    inline NormalizeConstants ComputeNormalizeConstants(float scale, const std::vector<float>& means,
+                                                        const std::vector<float>& stddevs)
+    {
+        if (means.size() != stddevs.size())
+        {
+            throw std::invalid_argument("TensorizeKernels: means and stddevs must have one entry per channel");
+        }
+        NormalizeConstants constants;
+        constants.Multipliers.resize(means.size());
+        constants.Offsets.resize(means.size());
+        for (size_t channel = 0; channel < means.size(); ++channel)
+        {
+            constants.Multipliers[channel] = 1.0f / (scale * stddevs[channel]);
+            constants.Offsets[channel] = -means[channel] / stddevs[channel];
+        }
+        return constants;
+    }
+
+    // Kernels for one run of pixels. Each writes channel c of pixel i to output[c][i] as a float and returns how many
+    // leading pixels it handled; the rest are left to the scalar kernel.
+
+    template <typename InputType>
+    inline void NormalizePixelsScalar(const InputType* input, uint32_t pixelStride, uint32_t numChannels,
+                                      size_t begin, size_t end, float* const* output, const float* multipliers,
+                                      const float* offsets)
+    {
+        for (size_t i = begin; i < end; ++i)
+        {
+            for (uint32_t channel = 0; channel < numChannels; ++channel)
+            {
+                output[channel][i] =
+                    static_cast<float>(input[i * pixelStride + channel]) * multipliers[channel] + offsets[channel];
+            }
+        }
+    }
+
+#if defined(TENSORIZE_KERNELS_X64)
+    inline void StoreNormalizedSse2(float* output, __m128i values, __m128 multiplier, __m128 offset)
+    {
+        _mm_storeu_ps(output, _mm_add_ps(_mm_mul_ps(_mm_cvtepi32_ps(values), multiplier), offset));
+    }
+
+    inline size_t NormalizePixelsSse2(const uint8_t* input, uint32_t pixelStride, uint32_t numChannels, size_t count,
+                                      float* const* output, const float* multipliers, const float* offsets)
+    {
+        size_t i = 0;
+        const __m128i zero = _mm_setzero_si128();
+        if (pixelStride == 4)
+        {
+            // Four pixels per register, channel c is byte c of every 32 bit lane
+            const __m128i byteMask = _mm_set1_epi32(0xFF);
+            for (; i + 4 <= count; i += 4)
+            {
+                __m128i pixels = _mm_loadu_si128(reinterpret_cast<const __m128i*>(input + i * 4));
+                for (uint32_t channel = 0; channel < numChannels; ++channel)
+                {
+                    __m128i values = _mm_and_si128(_mm_srl_epi32(pixels, _mm_cvtsi32_si128(8 * channel)), byteMask);
+                    StoreNormalizedSse2(output[channel] + i, values, _mm_set1_ps(multipliers[channel]),
+                                        _mm_set1_ps(offsets[channel]));
+                }
+            }
+        }
+        else if (pixelStride == 1 && numChannels == 1)
+        {
+            const __m128 multiplier = _mm_set1_ps(multipliers[0]);
+            const __m128 offset = _mm_set1_ps(offsets[0]);
+            for (; i + 16 <= count; i += 16)
+            {
+                __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(input + i));
+                __m128i low = _mm_unpacklo_epi8(bytes, zero);
+                __m128i high = _mm_unpackhi_epi8(bytes, zero);
+                StoreNormalizedSse2(output[0] + i, _mm_unpacklo_epi16(low, zero), multiplier, offset);
+                StoreNormalizedSse2(output[0] + i + 4, _mm_unpackhi_epi16(low, zero), multiplier, offset);
+                StoreNormalizedSse2(output[0] + i + 8, _mm_unpacklo_epi16(high, zero), multiplier, offset);
+                StoreNormalizedSse2(output[0] + i + 12, _mm_unpackhi_epi16(high, zero), multiplier, offset);
+            }
+        }
+        return i;
+    }
+
+    inline size_t NormalizePixelsSse2(const uint16_t* input, uint32_t pixelStride, uint32_t numChannels, size_t count,
+                                      float* const* output, const float* multipliers, const float* offsets)
+    {
+        size_t i = 0;
+        const __m128i zero = _mm_setzero_si128();
+        if (pixelStride == 4)
+        {
+            // Gather channels 0 and 1 of four pixels into the 32 bit lanes of one register and channels 2 and 3 into
+            // another, then split each lane into its low and high half
+            const __m128i wordMask = _mm_set1_epi32(0xFFFF);
+            for (; i + 4 <= count; i += 4)
+            {
+                __m128 first = _mm_castsi128_ps(_mm_loadu_si128(reinterpret_cast<const __m128i*>(input + i * 4)));
+                __m128 second =
+                    _mm_castsi128_ps(_mm_loadu_si128(reinterpret_cast<const __m128i*>(input + i * 4 + 8)));
+                __m128i pairs[2] = { _mm_castps_si128(_mm_shuffle_ps(first, second, _MM_SHUFFLE(2, 0, 2, 0))),
+                                     _mm_castps_si128(_mm_shuffle_ps(first, second, _MM_SHUFFLE(3, 1, 3, 1))) };
+                for (uint32_t channel = 0; channel < numChannels; ++channel)
+                {
+                    __m128i pair = pairs[channel / 2];
+                    __m128i values = (channel % 2) == 0 ? _mm_and_si128(pair, wordMask) : _mm_srli_epi32(pair, 16);
+                    StoreNormalizedSse2(output[channel] + i, values, _mm_set1_ps(multipliers[channel]),
+                                        _mm_set1_ps(offsets[channel]));
+                }
+            }
+        }
+        else if (pixelStride == 1 && numChannels == 1)
+        {
+            const __m128 multiplier = _mm_set1_ps(multipliers[0]);
+            const __m128 offset = _mm_set1_ps(offsets[0]);
+            for (; i + 8 <= count; i += 8)
+            {
+                __m128i words = _mm_loadu_si128(reinterpret_cast<const __m128i*>(input + i));
+                StoreNormalizedSse2(output[0] + i, _mm_unpacklo_epi16(words, zero), multiplier, offset);
+                StoreNormalizedSse2(output[0] + i + 4, _mm_unpackhi_epi16(words, zero), multiplier, offset);
+            }
+        }
+        return i;
+    }
+
+    inline size_t NormalizePixelsSse2(const float* input, uint32_t pixelStride, uint32_t numChannels, size_t count,
+                                      float* const* output, const float* multipliers, const float* offsets)
+    {
+        size_t i = 0;
+        if (pixelStride == 1 && numChannels == 1)
+        {
+            const __m128 multiplier = _mm_set1_ps(multipliers[0]);
+            const __m128 offset = _mm_set1_ps(offsets[0]);
+            for (; i + 4 <= count; i += 4)
+            {
+                _mm_storeu_ps(output[0] + i, _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(input + i), multiplier), offset));
+            }
+        }
+        return i;
+    }
+
+    TENSORIZE_KERNELS_TARGET_AVX2 inline void StoreNormalizedAvx2(float* output, __m256i values, __m256 multiplier,
+                                                                  __m256 offset)
+    {
+        _mm256_storeu_ps(output, _mm256_add_ps(_mm256_mul_ps(_mm256_cvtepi32_ps(values), multiplier), offset));
+    }
+
+    TENSORIZE_KERNELS_TARGET_AVX2 inline size_t NormalizePixelsAvx2(const uint8_t* input, uint32_t pixelStride,
+                                                                    uint32_t numChannels, size_t count,
+                                                                    float* const* output, const float* multipliers,
+                                                                    const float* offsets)
+    {
+        size_t i = 0;
+        if (pixelStride == 4)
+        {
+            const __m256i byteMask = _mm256_set1_epi32(0xFF);
+            for (; i + 8 <= count; i += 8)
+            {
+                __m256i pixels = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(input + i * 4));
+                for (uint32_t channel = 0; channel < numChannels; ++channel)
+                {
+                    __m256i values =
+                        _mm256_and_si256(_mm256_srl_epi32(pixels, _mm_cvtsi32_si128(8 * channel)), byteMask);
+                    StoreNormalizedAvx2(output[channel] + i, values, _mm256_set1_ps(multipliers[channel]),
+                                        _mm256_set1_ps(offsets[channel]));
+                }
+            }
+        }
+        else if (pixelStride == 1 && numChannels == 1)
+        {
+            const __m256 multiplier = _mm256_set1_ps(multipliers[0]);
+            const __m256 offset = _mm256_set1_ps(offsets[0]);
+            for (; i + 16 <= count; i += 16)
+            {
+                __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(input + i));
+                StoreNormalizedAvx2(output[0] + i, _mm256_cvtepu8_epi32(bytes), multiplier, offset);
+                StoreNormalizedAvx2(output[0] + i + 8, _mm256_cvtepu8_epi32(_mm_srli_si128(bytes, 8)), multiplier,
+                                    offset);
+            }
+        }
+        return i;
+    }
+
+    TENSORIZE_KERNELS_TARGET_AVX2 inline size_t NormalizePixelsAvx2(const uint16_t* input, uint32_t pixelStride,
+                                                                    uint32_t numChannels, size_t count,
+                                                                    float* const* output, const float* multipliers,
+                                                                    const float* offsets)
+    {
+        size_t i = 0;
+        if (pixelStride == 4)
+        {
+            // Same as the SSE2 kernel, except that the shuffle works within 128 bit halves, so the 64 bit pixel pairs
+            // come out as 0 1 4 5 2 3 6 7 and are put back in order with a cross lane permute
+            const __m256i wordMask = _mm256_set1_epi32(0xFFFF);
+            for (; i + 8 <= count; i += 8)
+            {
+                __m256 first = _mm256_castsi256_ps(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(input + i * 4)));
+                __m256 second =
+                    _mm256_castsi256_ps(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(input + i * 4 + 16)));
+                __m256i pairs[2] = {
+                    _mm256_permute4x64_epi64(
+                        _mm256_castps_si256(_mm256_shuffle_ps(first, second, _MM_SHUFFLE(2, 0, 2, 0))),
+                        _MM_SHUFFLE(3, 1, 2, 0)),
+                    _mm256_permute4x64_epi64(
+                        _mm256_castps_si256(_mm256_shuffle_ps(first, second, _MM_SHUFFLE(3, 1, 3, 1))),
+                        _MM_SHUFFLE(3, 1, 2, 0))
+                };
+                for (uint32_t channel = 0; channel < numChannels; ++channel)
+                {
+                    __m256i pair = pairs[channel / 2];
+                    __m256i values =
+                        (channel % 2) == 0 ? _mm256_and_si256(pair, wordMask) : _mm256_srli_epi32(pair, 16);
+                    StoreNormalizedAvx2(output[channel] + i, values, _mm256_set1_ps(multipliers[channel]),
+                                        _mm256_set1_ps(offsets[channel]));
+                }
+            }
+        }
+        else if (pixelStride == 1 && numChannels == 1)
+        {
+            const __m256 multiplier = _mm256_set1_ps(multipliers[0]);
+            const __m256 offset = _mm256_set1_ps(offsets[0]);
+            for (; i + 8 <= count; i += 8)
+            {
+                __m128i words = _mm_loadu_si128(reinterpret_cast<const __m128i*>(input + i));
+                StoreNormalizedAvx2(output[0] + i, _mm256_cvtepu16_epi32(words), multiplier, offset);
+            }
+        }
+        return i;
+    }
+
+    TENSORIZE_KERNELS_TARGET_AVX2 inline size_t NormalizePixelsAvx2(const float* input, uint32_t pixelStride,
+                                                                    uint32_t numChannels, size_t count,
+                                                                    float* const* output, const float* multipliers,
+                                                                    const float* offsets)
+    {
+        size_t i = 0;
+        if (pixelStride == 1 && numChannels == 1)
+        {
+            const __m256 multiplier = _mm256_set1_ps(multipliers[0]);
+            const __m256 offset = _mm256_set1_ps(offsets[0]);
+            for (; i + 8 <= count; i += 8)
+            {
+                _mm256_storeu_ps(output[0] + i,
+                                 _mm256_add_ps(_mm256_mul_ps(_mm256_loadu_ps(input + i), multiplier), offset));
+            }
+        }
+        return i;
+    }
+#endif
+
+#if defined(TENSORIZE_KERNELS_NEON)
+    inline void StoreNormalizedNeon(float* output, uint16x8_t values, float32x4_t multiplier, float32x4_t offset)
+    {
+        float32x4_t low = vcvtq_f32_u32(vmovl_u16(vget_low_u16(values)));
+        float32x4_t high = vcvtq_f32_u32(vmovl_u16(vget_high_u16(values)));
+        vst1q_f32(output, vaddq_f32(vmulq_f32(low, multiplier), offset));
+        vst1q_f32(output + 4, vaddq_f32(vmulq_f32(high, multiplier), offset));
+    }
+
+    inline size_t NormalizePixelsNeon(const uint8_t* input, uint32_t pixelStride, uint32_t numChannels, size_t count,
+                                      float* const* output, const float* multipliers, const float* offsets)
+    {
+        size_t i = 0;
+        if (pixelStride == 4)
+        {
+            // vld4 deinterleaves eight pixels into one register per channel
+            for (; i + 8 <= count; i += 8)
+            {
+                uint8x8x4_t pixels = vld4_u8(input + i * 4);
+                for (uint32_t channel = 0; channel < numChannels; ++channel)
+                {
+                    StoreNormalizedNeon(output[channel] + i, vmovl_u8(pixels.val[channel]),
+                                        vdupq_n_f32(multipliers[channel]), vdupq_n_f32(offsets[channel]));
+                }
+            }
+        }
+        else if (pixelStride == 1 && numChannels == 1)
+        {
+            const float32x4_t multiplier = vdupq_n_f32(multipliers[0]);
+            const float32x4_t offset = vdupq_n_f32(offsets[0]);
+            for (; i + 8 <= count; i += 8)
+            {
+                StoreNormalizedNeon(output[0] + i, vmovl_u8(vld1_u8(input + i)), multiplier, offset);
+            }
+        }
+        return i;
+    }
+
+    inline size_t NormalizePixelsNeon(const uint16_t* input, uint32_t pixelStride, uint32_t numChannels, size_t count,
+                                      float* const* output, const float* multipliers, const float* offsets)
+    {
+        size_t i = 0;
+        if (pixelStride == 4)
+        {
+            for (; i + 4 <= count; i += 4)
+            {
+                uint16x4x4_t pixels = vld4_u16(input + i * 4);
+                for (uint32_t channel = 0; channel < numChannels; ++channel)
+                {
+                    float32x4_t values = vcvtq_f32_u32(vmovl_u16(pixels.val[channel]));
+                    vst1q_f32(output[channel] + i, vaddq_f32(vmulq_f32(values, vdupq_n_f32(multipliers[channel])),
+                                                             vdupq_n_f32(offsets[channel])));
+                }
+            }
+        }
+        else if (pixelStride == 1 && numChannels == 1)
+        {
+            const float32x4_t multiplier = vdupq_n_f32(multipliers[0]);
+            const float32x4_t offset = vdupq_n_f32(offsets[0]);
+            for (; i + 8 <= count; i += 8)
+            {
+                StoreNormalizedNeon(output[0] + i, vld1q_u16(input + i), multiplier, offset);
+            }
+        }
+        return i;
+    }
+
+    inline size_t NormalizePixelsNeon(const float* input, uint32_t pixelStride, uint32_t numChannels, size_t count,
+                                      float* const* output, const float* multipliers, const float* offsets)
+    {
+        size_t i = 0;
+        if (pixelStride == 1 && numChannels == 1)
+        {
+            const float32x4_t multiplier = vdupq_n_f32(multipliers[0]);
+            const float32x4_t offset = vdupq_n_f32(offsets[0]);
+            for (; i + 4 <= count; i += 4)
+            {
+                vst1q_f32(output[0] + i, vaddq_f32(vmulq_f32(vld1q_f32(input + i), multiplier), offset));
+            }
+        }
+        return i;
+    }
+#endif
+
+    template <typename InputType>
+    inline void NormalizePixels(const InputType* input, uint32_t pixelStride, uint32_t numChannels, size_t count,
+                                float* const* output, const float* multipliers, const float* offsets,
+                                SimdLevel level)
+    {
+        size_t done = 0;
+#if defined(TENSORIZE_KERNELS_X64)
+        if (level == SimdLevel::AVX2)
+        {
+            done = NormalizePixelsAvx2(input, pixelStride, numChannels, count, output, multipliers, offsets);
+        }
+        else if (level == SimdLevel::SSE2)
+        {
+            done = NormalizePixelsSse2(input, pixelStride, numChannels, count, output, multipliers, offsets);
+        }
+#elif defined(TENSORIZE_KERNELS_NEON)
+        if (level == SimdLevel::NEON)
+        {
+            done = NormalizePixelsNeon(input, pixelStride, numChannels, count, output, multipliers, offsets);
+        }
+#endif
+        NormalizePixelsScalar(input, pixelStride, numChannels, done, count, output, multipliers, offsets);
+    }
+
+    // Largest channel count that goes through the vector kernels. Anything wider (e.g. CSV data whose second dimension
+    // is not a color channel) is normalized element by element.
+    const uint32_t MaxVectorChannels = 4;
+    // Pixels per row tile when the normalized floats still have to be converted to another output type.
+    const size_t TileSize = 256;
+    // Images with fewer pixels than this are not worth handing to the thread pool.
+    const size_t ParallelPixelThreshold = 256 * 1024;
+    // Approximate number of pixels per chunk of rows handed to the thread pool.
+    const size_t PixelsPerParallelChunk = 32 * 1024;
+
+    template <typename OutputType, typename Convert> inline OutputType ConvertOutput(float value, Convert& convert)
+    {
+        if constexpr (std::is_same<OutputType, float>::value)
+        {
+            return value;
+        }
+        else
+        {
+            return convert(value);
+        }
+    }
+
+    // Normalizes height * width pixels of numChannels values each, read pixelStride elements apart from input, into
+    // output. With planarOutput the channels are written one after the other (NCHW), otherwise the values of a pixel
+    // are written next to each other. Float output is written directly by the kernels; any other output type is
+    // produced by convert(float) from a per row tile of floats. If a pool is given, large images are split into chunks
+    // of rows that are normalized in parallel.
+    template <typename InputType, typename OutputType, typename Convert>
+    void Tensorize(const InputType* input, uint32_t pixelStride, uint32_t numChannels, uint32_t height,
+                   uint32_t width, bool planarOutput, OutputType* output, const NormalizeConstants& constants,
+                   Convert convert, ThreadPool* pool = nullptr, SimdLevel level = GetSimdLevel())
+    {
+        if (pixelStride < numChannels || constants.Multipliers.size() < numChannels ||
+            constants.Offsets.size() < numChannels)
+        {
+            throw std::invalid_argument("TensorizeKernels: pixel layout does not match the normalize constants");
+        }
+        const size_t planeSize = static_cast<size_t>(height) * width;
+        if (planeSize == 0 || numChannels == 0)
+        {
+            return;
+        }
+        // With a single channel both layouts are the same, and the planar one has the vector kernels
+        planarOutput = planarOutput || numChannels == 1;
+        const float* multipliers = constants.Multipliers.data();
+        const float* offsets = constants.Offsets.data();
+
+        auto tensorizeRow = [&](size_t row) {
+            const size_t rowBegin = row * width;
+            const InputType* rowInput = input + rowBegin * pixelStride;
+            if (planarOutput && numChannels <= MaxVectorChannels)
+            {
+                if constexpr (std::is_same<OutputType, float>::value)
+                {
+                    float* rowOutput[MaxVectorChannels];
+                    for (uint32_t channel = 0; channel < numChannels; ++channel)
+                    {
+                        rowOutput[channel] = output + channel * planeSize + rowBegin;
+                    }
+                    NormalizePixels(rowInput, pixelStride, numChannels, width, rowOutput, multipliers, offsets, level);
+                }
+                else
+                {
+                    float tile[MaxVectorChannels][TileSize];
+                    float* tileRows[MaxVectorChannels] = { tile[0], tile[1], tile[2], tile[3] };
+                    for (size_t tileBegin = 0; tileBegin < width; tileBegin += TileSize)
+                    {
+                        size_t tileCount = (std::min)(TileSize, width - tileBegin);
+                        NormalizePixels(rowInput + tileBegin * pixelStride, pixelStride, numChannels, tileCount,
+                                        tileRows, multipliers, offsets, level);
+                        for (uint32_t channel = 0; channel < numChannels; ++channel)
+                        {
+                            OutputType* channelOutput = output + channel * planeSize + rowBegin + tileBegin;
+                            for (size_t i = 0; i < tileCount; ++i)
+                            {
+                                channelOutput[i] = convert(tile[channel][i]);
+                            }
+                        }
+                    }
+                }
+            }
+            else
+            {
+                for (size_t i = 0; i < width; ++i)
+                {
+                    for (uint32_t channel = 0; channel < numChannels; ++channel)
+                    {
+                        float value =
+                            static_cast<float>(rowInput[i * pixelStride + channel]) * multipliers[channel] +
+                            offsets[channel];
+                        size_t outputIndex = planarOutput ? channel * planeSize + rowBegin + i
+                                                          : (rowBegin + i) * numChannels + channel;
+                        output[outputIndex] = ConvertOutput<OutputType>(value, convert);
+                    }
+                }
+            }
+        };
+
+        if (pool != nullptr && pool->NumThreads() > 0 && planeSize >= ParallelPixelThreshold && height > 1)
+        {
+            size_t rowsPerChunk = (std::max)(static_cast<size_t>(1), PixelsPerParallelChunk / width);
+            pool->ParallelFor(0, height, tensorizeRow, rowsPerChunk);
+        }
+        else
+        {
+            for (size_t row = 0; row < height; ++row)
+            {
+                tensorizeRow(row);
+            }
+        }
+    }
+} // namespace TensorizeKernels
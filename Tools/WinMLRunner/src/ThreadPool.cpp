@@ -1,40 +1,152 @@
 #include "ThreadPool.h"
 #include <ctime>
 
-ThreadPool::ThreadPool(unsigned int initial_pool_size) : m_threads(), m_destruct_pool(false)
+namespace
 {
+// The pool and worker index of the current thread, if it is a pool worker
+thread_local ThreadPool* t_current_pool = nullptr;
+thread_local size_t t_worker_index = 0;
+} // namespace
+
+ThreadPool::ThreadPool(unsigned int initial_pool_size)
+    : m_destruct_pool(false), m_threads(), m_pending_tasks(0), m_sleeping_threads(0), m_next_queue(0)
+{
+    // Keep at least one queue so that work can be submitted to a pool without threads, see RunPendingTask
+    for (unsigned int i = 0; i < std::max(initial_pool_size, 1u); i++)
+    {
+        m_work_queues.emplace_back(std::make_unique<WorkQueue>());
+    }
     for (unsigned int i = 0; i < initial_pool_size; i++)
     {
-        m_threads.emplace_back([this]() {
-            while (true)
-            {
-                std::unique_lock<std::mutex> lock(m_mutex);
-                // thread listening for event and acquire lock if event triggered
-                m_cond_var.wait(lock, [this] { return m_destruct_pool || !m_work_queue.empty(); });
-                if (!m_work_queue.empty())
-                {
-                    auto work = m_work_queue.front();
-                    m_work_queue.pop();
-                    lock.unlock();
-                    work();
-                }
-                else
-                {
-                    // Work queue is empty but lock acquired
-                    // This means we are destructing the pool
-                    break;
-                }
-            }
-        });
+        m_threads.emplace_back([this, i]() { WorkerLoop(i); });
     }
 }
 
 ThreadPool::~ThreadPool()
 {
-    m_destruct_pool = true;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_destruct_pool = true;
+    }
     m_cond_var.notify_all(); // notify destruction to threads
     for (auto& thread : m_threads)
     {
         thread.join();
     }
 }
+
+void ThreadPool::WorkerLoop(unsigned worker_index)
+{
+    t_current_pool = this;
+    t_worker_index = worker_index;
+    while (true)
+    {
+        if (RunPendingTask())
+        {
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(m_mutex);
+        // Publish that this thread may sleep before checking for work. Submitters increment the pending count before
+        // checking for sleeping threads, so either this thread sees the new work or the submitter sees this thread.
+        m_sleeping_threads.fetch_add(1);
+        m_cond_var.wait(lock, [this] { return m_destruct_pool || m_pending_tasks.load() > 0; });
+        m_sleeping_threads.fetch_sub(1);
+        if (m_destruct_pool && m_pending_tasks.load() <= 0)
+        {
+            // Work queues are drained and we are destructing the pool
+            break;
+        }
+    }
+}
+
+bool ThreadPool::RunPendingTask()
+{
+    ThreadPoolTask task;
+    size_t num_queues = m_work_queues.size();
+    size_t first = 0;
+    if (t_current_pool == this)
+    {
+        // Newest work of our own queue first, it is the most likely to be in cache
+        first = t_worker_index;
+        WorkQueue& own_queue = *m_work_queues[first];
+        std::lock_guard<std::mutex> lock(own_queue.m_mutex);
+        own_queue.PopBack(task);
+    }
+    // Steal the oldest work of the other queues
+    for (size_t i = 0; !task && i < num_queues; ++i)
+    {
+        WorkQueue& queue = *m_work_queues[(first + i) % num_queues];
+        std::lock_guard<std::mutex> lock(queue.m_mutex);
+        queue.PopFront(task);
+    }
+    if (!task)
+    {
+        return false;
+    }
+    m_pending_tasks.fetch_sub(1);
+    task();
+    return true;
+}
+
+size_t ThreadPool::GetSubmitQueueIndex()
+{
+    if (t_current_pool == this)
+    {
+        return t_worker_index;
+    }
+    return m_next_queue.fetch_add(1, std::memory_order_relaxed) % m_work_queues.size();
+}
+
+void ThreadPool::Push(ThreadPoolTask&& task)
+{
+    WorkQueue& queue = *m_work_queues[GetSubmitQueueIndex()];
+    {
+        std::lock_guard<std::mutex> lock(queue.m_mutex);
+        queue.PushBack(std::move(task));
+    }
+    m_pending_tasks.fetch_add(1);
+    WakeWorkers(1);
+}
+
+void ThreadPool::PushBulk(size_t count, const std::function<ThreadPoolTask(size_t)>& make_task)
+{
+    if (count == 0)
+    {
+        return;
+    }
+    // Deal the tasks out over all queues, taking each queue lock once
+    size_t num_queues = m_work_queues.size();
+    size_t first_queue = GetSubmitQueueIndex();
+    for (size_t q = 0; q < num_queues && q < count; ++q)
+    {
+        WorkQueue& queue = *m_work_queues[(first_queue + q) % num_queues];
+        std::lock_guard<std::mutex> lock(queue.m_mutex);
+        for (size_t i = q; i < count; i += num_queues)
+        {
+            queue.PushBack(make_task(i));
+        }
+    }
+    m_pending_tasks.fetch_add(static_cast<int64_t>(count));
+    WakeWorkers(count);
+}
+
+void ThreadPool::WakeWorkers(size_t count)
+{
+    if (m_sleeping_threads.load() == 0)
+    {
+        return;
+    }
+    {
+        // A sleeping thread is either waiting already or still holds the lock and will see the new work
+        std::lock_guard<std::mutex> lock(m_mutex);
+    }
+    if (count == 1)
+    {
+        m_cond_var.notify_one();
+    }
+    else
+    {
+        m_cond_var.notify_all();
+    }
+}
@@ -2,34 +2,280 @@
 
 #include <vector>
 #include <thread>
-#include <queue>
 #include <mutex>
+#include <condition_variable>
 #include <future>
+#include <atomic>
+#include <memory>
+#include <tuple>
+#include <exception>
+#include <functional>
+#include <algorithm>
+#include <type_traits>
+#include <cstddef>
 
+// A move-only void() callable. Callables of up to InlineSize bytes are stored in place, so queueing a task does not
+// allocate.
+class ThreadPoolTask
+{
+public:
+    static const size_t InlineSize = 64;
+
+    ThreadPoolTask() noexcept : m_ops(nullptr) {}
+
+    template <typename F, typename = std::enable_if_t<!std::is_same<std::decay_t<F>, ThreadPoolTask>::value>>
+    ThreadPoolTask(F&& f)
+    {
+        typedef std::decay_t<F> Callable;
+        if constexpr (sizeof(Callable) <= InlineSize && alignof(Callable) <= alignof(std::max_align_t) &&
+                      std::is_nothrow_move_constructible<Callable>::value)
+        {
+            new (&m_storage) Callable(std::forward<F>(f));
+            m_ops = &InlineOps<Callable>::Ops;
+        }
+        else
+        {
+            *reinterpret_cast<Callable**>(&m_storage) = new Callable(std::forward<F>(f));
+            m_ops = &HeapOps<Callable>::Ops;
+        }
+    }
+
+    ThreadPoolTask(ThreadPoolTask&& other) noexcept : m_ops(other.m_ops)
+    {
+        if (m_ops)
+        {
+            m_ops->Move(&m_storage, &other.m_storage);
+            other.m_ops = nullptr;
+        }
+    }
+
+    ThreadPoolTask& operator=(ThreadPoolTask&& other) noexcept
+    {
+        if (this != &other)
+        {
+            Reset();
+            if (other.m_ops)
+            {
+                other.m_ops->Move(&m_storage, &other.m_storage);
+                m_ops = other.m_ops;
+                other.m_ops = nullptr;
+            }
+        }
+        return *this;
+    }
+
+    ThreadPoolTask(const ThreadPoolTask&) = delete;
+    ThreadPoolTask& operator=(const ThreadPoolTask&) = delete;
+
+    ~ThreadPoolTask() { Reset(); }
+
+    explicit operator bool() const { return m_ops != nullptr; }
+
+    void operator()() { m_ops->Invoke(&m_storage); }
+
+private:
+    struct TaskOps
+    {
+        void (*Invoke)(void* storage);
+        void (*Move)(void* destination, void* source); // leaves source destroyed
+        void (*Destroy)(void* storage);
+    };
+
+    template <typename Callable> struct InlineOps
+    {
+        static void Invoke(void* storage) { (*static_cast<Callable*>(storage))(); }
+        static void Move(void* destination, void* source)
+        {
+            new (destination) Callable(std::move(*static_cast<Callable*>(source)));
+            static_cast<Callable*>(source)->~Callable();
+        }
+        static void Destroy(void* storage) { static_cast<Callable*>(storage)->~Callable(); }
+        static constexpr TaskOps Ops = { Invoke, Move, Destroy };
+    };
+
+    template <typename Callable> struct HeapOps
+    {
+        static void Invoke(void* storage) { (**static_cast<Callable**>(storage))(); }
+        static void Move(void* destination, void* source)
+        {
+            *static_cast<Callable**>(destination) = *static_cast<Callable**>(source);
+        }
+        static void Destroy(void* storage) { delete *static_cast<Callable**>(storage); }
+        static constexpr TaskOps Ops = { Invoke, Move, Destroy };
+    };
+
+    void Reset()
+    {
+        if (m_ops)
+        {
+            m_ops->Destroy(&m_storage);
+            m_ops = nullptr;
+        }
+    }
+
+    std::aligned_storage_t<InlineSize, alignof(std::max_align_t)> m_storage;
+    const TaskOps* m_ops;
+};
+
+// A work stealing thread pool. Every worker owns a deque of tasks: it takes work from the back of its own deque and,
+// when that is empty, steals from the front of the other workers' deques. Work submitted from outside the pool is
+// spread round robin over the workers, work submitted from inside a task goes to the deque of the current worker.
+// Pending work is drained before the pool is destroyed.
 class ThreadPool
 {
 private:
+    // Growable ring buffer of tasks, guarded by its own mutex.
+    class WorkQueue
+    {
+    public:
+        std::mutex m_mutex;
+
+        void PushBack(ThreadPoolTask&& task)
+        {
+            if (m_count == m_tasks.size())
+            {
+                Grow();
+            }
+            m_tasks[(m_head + m_count) & (m_tasks.size() - 1)] = std::move(task);
+            ++m_count;
+        }
+
+        bool PopBack(ThreadPoolTask& task)
+        {
+            if (m_count == 0)
+            {
+                return false;
+            }
+            --m_count;
+            task = std::move(m_tasks[(m_head + m_count) & (m_tasks.size() - 1)]);
+            return true;
+        }
+
+        bool PopFront(ThreadPoolTask& task)
+        {
+            if (m_count == 0)
+            {
+                return false;
+            }
+            task = std::move(m_tasks[m_head]);
+            m_head = (m_head + 1) & (m_tasks.size() - 1);
+            --m_count;
+            return true;
+        }
+
+    private:
+        void Grow()
+        {
+            std::vector<ThreadPoolTask> tasks((std::max)(static_cast<size_t>(16), m_tasks.size() * 2));
+            for (size_t i = 0; i < m_count; ++i)
+            {
+                tasks[i] = std::move(m_tasks[(m_head + i) & (m_tasks.size() - 1)]);
+            }
+            m_tasks.swap(tasks);
+            m_head = 0;
+        }
+
+        std::vector<ThreadPoolTask> m_tasks;
+        size_t m_head = 0;
+        size_t m_count = 0;
+    };
+
     std::condition_variable m_cond_var;
     bool m_destruct_pool;
-    std::mutex m_mutex;
+    std::mutex m_mutex; // guards m_destruct_pool and the sleep/wake handshake
     std::vector<std::thread> m_threads;
-    std::queue<std::function<void()>> m_work_queue;
+    std::vector<std::unique_ptr<WorkQueue>> m_work_queues;
+    std::atomic<int64_t> m_pending_tasks;
+    std::atomic<unsigned> m_sleeping_threads;
+    std::atomic<size_t> m_next_queue;
+
+    void WorkerLoop(unsigned worker_index);
+    // Index of the work queue to push to from the calling thread.
+    size_t GetSubmitQueueIndex();
+    void Push(ThreadPoolTask&& task);
+    void PushBulk(size_t count, const std::function<ThreadPoolTask(size_t)>& make_task);
+    void WakeWorkers(size_t count);
 
 public:
     ThreadPool(unsigned int initial_pool_size);
     ~ThreadPool();
+
+    unsigned int NumThreads() const { return static_cast<unsigned int>(m_threads.size()); }
+
+    // Takes one queued task, preferring the calling worker's own queue, and runs it on the calling thread.
+    // Returns false if there was no queued task.
+    bool RunPendingTask();
+
     template <typename F, typename... Args>
     inline auto SubmitWork(F&& f, Args&&... args) -> std::future<decltype(f(args...))>
     {
-        auto func = std::bind(std::forward<F>(f), std::forward<Args>(args)...);
-        auto task = std::make_shared<std::packaged_task<decltype(f(args...))()>>(func);
+        typedef decltype(f(args...)) ReturnType;
+        // The callable and its arguments are stored in the packaged task's shared state, which is the only allocation
+        // per submission. The packaged task itself fits in the inline storage of ThreadPoolTask.
+        std::packaged_task<ReturnType()> task(
+            [func = std::forward<F>(f), arguments = std::make_tuple(std::forward<Args>(args)...)]() mutable {
+                return std::apply(func, arguments);
+            });
+        std::future<ReturnType> future = task.get_future();
+        Push(ThreadPoolTask(std::move(task)));
+        return future;
+    }
+
+    // Calls body(i) for every i in [begin, end). The range is split into chunks of grain_size indices (by default
+    // about four chunks per thread), which are queued in one bulk submission; the calling thread runs chunks too and
+    // returns once all of them are done. The first exception thrown by body is rethrown on the calling thread.
+    template <typename F> void ParallelFor(size_t begin, size_t end, F&& body, size_t grain_size = 0)
+    {
+        if (end <= begin)
         {
-            std::lock_guard<std::mutex> lock(m_mutex);
-            // wrap packed task into a void return function type so that it can be stored in queue
-            m_work_queue.push([task]() { (*task)(); });
+            return;
         }
+        size_t count = end - begin;
+        if (grain_size == 0)
+        {
+            grain_size =
+                (std::max)(static_cast<size_t>(1), count / (4 * (static_cast<size_t>(NumThreads()) + 1)));
+        }
+        size_t num_chunks = (count + grain_size - 1) / grain_size;
+
+        std::atomic<size_t> remaining_chunks(num_chunks);
+        std::mutex error_mutex;
+        std::exception_ptr error;
+        auto run_chunk = [&](size_t chunk) {
+            size_t chunk_begin = begin + chunk * grain_size;
+            size_t chunk_end = (std::min)(end, chunk_begin + grain_size);
+            try
+            {
+                for (size_t i = chunk_begin; i < chunk_end; ++i)
+                {
+                    body(i);
+                }
+            }
+            catch (...)
+            {
+                std::lock_guard<std::mutex> lock(error_mutex);
+                if (!error)
+                {
+                    error = std::current_exception();
+                }
+            }
+            remaining_chunks.fetch_sub(1, std::memory_order_release);
+        };
 
-        m_cond_var.notify_one(); // unblocks one of the waiting threads
-        return task->get_future();
+        PushBulk(num_chunks - 1, [&run_chunk](size_t chunk) {
+            return ThreadPoolTask([&run_chunk, chunk]() { run_chunk(chunk + 1); });
+        });
+        run_chunk(0);
+        while (remaining_chunks.load(std::memory_order_acquire) != 0)
+        {
+            if (!RunPendingTask())
+            {
+                std::this_thread::yield();
+            }
+        }
+        if (error)
+        {
+            std::rethrow_exception(error);
+        }
     }
 };
@@ -6,8 +6,10 @@
 #include <PdhMsg.h>
 #endif
 #include <psapi.h>
+#include "HardwareCounters.h"
+#include "LatencyHistogram.h"
+#include "ResourceSampler.h"
 
-#define TIMER_SLOT_SIZE (1024)
 #define CONVERT_100NS_TO_SECOND(x) ((x)*0.0000001)
 #define BYTE_TO_MB(x) ((x) / (1024.0 * 1024.0))
 
@@ -75,7 +77,7 @@ public:
         FILETIME ftIgnore, ftKernel, ftUser;
 
         if (!GetProcessTimes(m_procHandle, &ftIgnore, &ftIgnore, &ftKernel, &ftUser) ||
-            !GetProcessMemoryCounters(m_pid, m_startPageFaultCount, m_startPagefileUsage, m_startPeakPagefileUsage,
+            !GetProcessMemoryCounters(m_startPageFaultCount, m_startPagefileUsage, m_startPeakPagefileUsage,
                                       m_startWorkingSetSize, m_startPeakWorkingSetSize))
         {
             m_previousStartCallFailed = true;
@@ -100,7 +102,7 @@ public:
 
         if (m_previousStartCallFailed || m_numProcessors == 0 ||
             !GetProcessTimes(m_procHandle, &ftIgnore, &ftIgnore, &ftKernel, &ftUser) ||
-            !GetProcessMemoryCounters(m_pid, stopPageFaultCount, stopPagefileUsage, stopPeakPagefileUsage,
+            !GetProcessMemoryCounters(stopPageFaultCount, stopPagefileUsage, stopPeakPagefileUsage,
                                       stopWorkingSetSize, stopPeakWorkingSetSize))
         {
             return;
@@ -129,18 +131,13 @@ public:
     double GetStartWorkingSet() { return (double)BYTE_TO_MB((double)m_startWorkingSetSize); }
 
 private:
-    bool GetProcessMemoryCounters(DWORD pid, ULONG& pageFaultCount, SIZE_T& pageFileUsage, SIZE_T& peakPageFileUsage,
+    bool GetProcessMemoryCounters(ULONG& pageFaultCount, SIZE_T& pageFileUsage, SIZE_T& peakPageFileUsage,
                                   SIZE_T& workingSetSize, SIZE_T& peakWorkingSetSize)
     {
-        HANDLE hProcess = NULL;
-
-        hProcess = OpenProcess(PROCESS_QUERY_INFORMATION | PROCESS_VM_READ, FALSE, pid);
-        if (NULL == hProcess)
-            return false;
-
         PROCESS_MEMORY_COUNTERS pmc = { 0 };
 
-        bool result = GetProcessMemoryInfo(hProcess, &pmc, sizeof(pmc));
+        // The pseudo handle of the current process, rather than an OpenProcess and CloseHandle on every call
+        bool result = GetProcessMemoryInfo(m_procHandle, &pmc, sizeof(pmc));
         if (result)
         {
             pageFaultCount = pmc.PageFaultCount;
@@ -150,8 +147,6 @@ private:
             peakWorkingSetSize = pmc.PeakWorkingSetSize;
         }
 
-        CloseHandle(hProcess);
-
         return result;
     }
 
@@ -266,25 +261,62 @@ public:
 
     void Stop()
     {
-        PDH_FMT_COUNTERVALUE_ITEM* gpuUsageCounterValue = nullptr;
-        PDH_FMT_COUNTERVALUE gpuDedicatedMemUsageCounterValue = {};
-        PDH_FMT_COUNTERVALUE gpuSharedMemUsageCounterValue = {};
-        DWORD bufferSize = 0;
-        DWORD itemCount = 0;
         PDH_STATUS status = S_OK;
 
-        // Query the gpu usage.
-        // For different IHVs, compute shader usage could be counted as either 3D or compute engine usage.
-        // Here we simply pick the max usage from all types of engines to see if bottleneck is from GPU.
-        // The same concept has been used in task manager to display GPU usage.
+        // Usage rate counter requires the query at Start() and this one
         status = CollectQueryData(m_query);
         if (S_OK != status && PDH_NO_DATA != status)
             return;
 
-        status =
+        if (!ReadGpuUsage(m_gpuUsage))
+            return;
+
+        double stopGpuDedicatedMemory; // in MB
+        double stopGpuSharedMemory;    // in MB
+
+        if (ReadMemoryUsage(m_gpuDedicatedMemUsageCounter, stopGpuDedicatedMemory))
+        {
+            m_deltaGpuDedicatedMemory = stopGpuDedicatedMemory - m_startGpuDedicatedMemory;
+        }
+
+        if (ReadMemoryUsage(m_gpuSharedMemUsageCounter, stopGpuSharedMemory))
+        {
+            m_deltaGpuSharedMemory = stopGpuSharedMemory - m_startGpuSharedMemory;
+        }
+    }
+
+    // Fills the GPU fields of a -PerfSampling sample. The usage covers the time since the previous call.
+    bool Sample(ResourceSampling::ResourceSample& sample)
+    {
+        PDH_STATUS status = CollectQueryData(m_query);
+        if (S_OK != status && PDH_NO_DATA != status)
+            return false;
+
+        ReadGpuUsage(sample.GpuUsage);
+        ReadMemoryUsage(m_gpuDedicatedMemUsageCounter, sample.GpuDedicatedMemory);
+        ReadMemoryUsage(m_gpuSharedMemUsageCounter, sample.GpuSharedMemory);
+        return true;
+    }
+
+    double GetGpuUsage() const { return m_gpuUsage; }
+    double GetDedicatedMemory() const { return m_deltaGpuDedicatedMemory; }
+    double GetSharedMemory() const { return m_deltaGpuSharedMemory; }
+    double GetStartSharedMemory() { return m_startGpuSharedMemory; }
+
+private:
+    // Query the gpu usage of the last collected data.
+    // For different IHVs, compute shader usage could be counted as either 3D or compute engine usage.
+    // Here we simply pick the max usage from all types of engines to see if bottleneck is from GPU.
+    // The same concept has been used in task manager to display GPU usage.
+    bool ReadGpuUsage(double& usage)
+    {
+        PDH_FMT_COUNTERVALUE_ITEM* gpuUsageCounterValue = nullptr;
+        DWORD bufferSize = 0;
+        DWORD itemCount = 0;
+        PDH_STATUS status =
             GetFormattedCounterArray(m_gpuUsageCounter, PDH_FMT_DOUBLE, &bufferSize, &itemCount, gpuUsageCounterValue);
         if (PDH_MORE_DATA != status)
-            return;
+            return false;
 
         gpuUsageCounterValue = (PDH_FMT_COUNTERVALUE_ITEM*)malloc(bufferSize);
         if (gpuUsageCounterValue != nullptr)
@@ -300,41 +332,24 @@ public:
                                    ? gpuUsageCounterValue[i].FmtValue.doubleValue
                                    : maxValue;
                 }
-                m_gpuUsage = maxValue;
+                usage = maxValue;
             }
         }
 
         free(gpuUsageCounterValue);
-        gpuUsageCounterValue = NULL;
-        bufferSize = 0;
-        itemCount = 0;
-
-        double stopGpuDedicatedMemory; // in MB
-        double stopGpuSharedMemory;    // in MB
-
-        status = GetFormattedCounterValue(m_gpuDedicatedMemUsageCounter, PDH_FMT_LARGE, NULL,
-                                          &gpuDedicatedMemUsageCounterValue);
-        if (ERROR_SUCCESS == status)
-        {
-            stopGpuDedicatedMemory = (double)BYTE_TO_MB(gpuDedicatedMemUsageCounterValue.largeValue);
-            m_deltaGpuDedicatedMemory = stopGpuDedicatedMemory - m_startGpuDedicatedMemory;
-        }
-
-        status =
-            GetFormattedCounterValue(m_gpuSharedMemUsageCounter, PDH_FMT_LARGE, NULL, &gpuSharedMemUsageCounterValue);
-        if (ERROR_SUCCESS == status)
-        {
-            stopGpuSharedMemory = (double)BYTE_TO_MB(gpuSharedMemUsageCounterValue.largeValue);
-            m_deltaGpuSharedMemory = stopGpuSharedMemory - m_startGpuSharedMemory;
-        }
+        return true;
     }
 
-    double GetGpuUsage() const { return m_gpuUsage; }
-    double GetDedicatedMemory() const { return m_deltaGpuDedicatedMemory; }
-    double GetSharedMemory() const { return m_deltaGpuSharedMemory; }
-    double GetStartSharedMemory() { return m_startGpuSharedMemory; }
+    // Memory usage in MB of the last collected data
+    bool ReadMemoryUsage(HCOUNTER counter, double& memory)
+    {
+        PDH_FMT_COUNTERVALUE counterValue = {};
+        if (ERROR_SUCCESS != GetFormattedCounterValue(counter, PDH_FMT_LARGE, NULL, &counterValue))
+            return false;
+        memory = (double)BYTE_TO_MB(counterValue.largeValue);
+        return true;
+    }
 
-private:
     // Pdh function prototypes
     typedef PDH_STATUS(WINAPI* PFNPdhOpenQuery)(_In_opt_ LPCWSTR szDataSource, _In_ DWORD_PTR dwUserData,
                                                 _Out_ PDH_HQUERY* phQuery);
@@ -450,21 +465,31 @@ public:
 
     void Disable() { m_bDisabled = true; }
 
+    // Start and Stop only take timestamps, and ApplySamples gives the intervals measured since the last call their
+    // CPU, memory and GPU counters from a ResourceSampler. See Profiler::EnableSampling.
+    void EnableSampling() { m_sampled = true; }
+
+    // Also counts the events of counters in each interval, see Profiler::EnableHardwareCounters.
+    void EnableHardwareCounters(const HardwareCounters::CounterSet* counters) { m_hardwareCounters = counters; }
+
     void Reset()
     {
         if (m_bDisabled)
             return;
 
-        m_pos = 0;
-        m_bBufferFull = false;
-        m_cpuCounter.Reset();
+        if (!m_sampled)
+        {
+            m_cpuCounter.Reset();
 #ifndef DISABLE_GPU_COUNTERS
-        m_gpuCounter.Reset();
+            m_gpuCounter.Reset();
 #endif
+        }
         for (int i = 0; i < CounterType::TYPE_COUNT; ++i)
         {
             m_data[i].Reset();
         }
+        m_pendingSpans.clear();
+        m_hardwareTotals.Reset();
     }
 
     void Start()
@@ -472,11 +497,24 @@ public:
         if (m_bDisabled)
             return;
 
-        m_timer.Start();
-        m_cpuCounter.Start();
+        if (m_sampled)
+        {
+            m_spanStart = ResourceSampling::NowMilliseconds();
+            m_spanOpen = true;
+        }
+        else
+        {
+            m_timer.Start();
+            m_cpuCounter.Start();
 #ifndef DISABLE_GPU_COUNTERS
-        m_gpuCounter.Start();
+            m_gpuCounter.Start();
 #endif
+        }
+        // Last, so that the events of starting the other counters are not counted
+        if (m_hardwareCounters)
+        {
+            m_hardwareStart = m_hardwareCounters->Read();
+        }
     }
 
     void Stop()
@@ -484,6 +522,21 @@ public:
         if (m_bDisabled)
             return;
 
+        if (m_hardwareCounters)
+        {
+            m_hardwareTotals.Add(HardwareCounters::Difference(m_hardwareStart, m_hardwareCounters->Read()));
+        }
+
+        if (m_sampled)
+        {
+            ResourceSampling::Span span = { m_spanStart, ResourceSampling::NowMilliseconds() };
+            m_pendingSpans.push_back(span);
+            m_spanOpen = false;
+            clockTime = span.End - span.Start;
+            Record(CounterType::TIMER, clockTime);
+            return;
+        }
+
         double counterValue[CounterType::TYPE_COUNT];
 
         // Query counters
@@ -511,21 +564,7 @@ public:
         // Update data blocks
         for (int i = 0; i < CounterType::TYPE_COUNT; ++i)
         {
-            m_data[i].total = m_data[i].total - m_data[i].measured[m_pos] + counterValue[i];
-            m_data[i].measured[m_pos] = counterValue[i];
-            m_data[i].max = (counterValue[i] > m_data[i].max) ? counterValue[i] : m_data[i].max;
-            m_data[i].min = (counterValue[i] < m_data[i].min) ? counterValue[i] : m_data[i].min;
-        }
-
-        // Update buffer index
-        if (m_pos + 1 >= TIMER_SLOT_SIZE)
-        {
-            m_pos = 0;
-            m_bBufferFull = true;
-        }
-        else
-        {
-            ++m_pos;
+            Record(static_cast<CounterType>(i), counterValue[i]);
         }
 
         clockTime = counterValue[CounterType::TIMER];
@@ -536,26 +575,54 @@ public:
         GpuDedicatedDiff = counterValue[CounterType::GPU_DEDICATED_MEM_USAGE];
     }
 
-    int GetCount() const { return (m_bBufferFull) ? TIMER_SLOT_SIZE : m_pos; }
-    double GetAverage(CounterType t) const { return (m_bDisabled) ? 0 : m_data[t].total / GetCount(); }
-    double GetMin(CounterType t) const { return (m_bDisabled) ? 0 : m_data[t].min; }
-    double GetMax(CounterType t) const { return (m_bDisabled) ? 0 : m_data[t].max; }
-    double GetValues(CounterType t, int index) const { return (m_bDisabled) ? 0 : m_data[t].measured[index]; }
-    double GetStdev(CounterType t) const { return (m_bDisabled) ? 0 : sqrt(GetVariance(t)); }
-    double GetVariance(CounterType t) const
+    // Records the counters of the intervals measured since the last call, from samples in time order that cover them.
+    void ApplySamples(const std::vector<ResourceSampling::ResourceSample>& samples)
     {
-        if (m_bDisabled)
-            return 0;
+        if (m_bDisabled || samples.empty())
+            return;
 
-        int count = GetCount();
-        double average = m_data[t].total / count;
-        double var = 0;
-        for (int i = 0; i < count; ++i)
+        const double numProcessors = (std::max)(1u, std::thread::hardware_concurrency());
+        for (const ResourceSampling::Span& span : m_pendingSpans)
         {
-            var += (m_data[t].measured[i] - average) * (m_data[t].measured[i] - average);
+            ResourceSampling::SpanCounters counters = ResourceSampling::Correlate(samples, span);
+            double time = span.End - span.Start;
+            Record(CounterType::CPU_USAGE, time > 0 ? 100.0 * counters.CpuTime / numProcessors / time : 0);
+            Record(CounterType::PAGE_FAULT_COUNT, counters.PageFaults);
+            Record(CounterType::PAGE_FILE_USAGE, counters.PageFileUsage);
+            Record(CounterType::PEAK_PAGE_FILE_USAGE, counters.PeakPageFileUsage);
+            Record(CounterType::WORKING_SET_USAGE, counters.WorkingSet);
+            Record(CounterType::PEAK_WORKING_SET_USAGE, counters.PeakWorkingSet);
+            Record(CounterType::STARTING_WORKING_SET, counters.StartWorkingSet);
+            Record(CounterType::GPU_USAGE, counters.GpuUsage);
+            Record(CounterType::GPU_DEDICATED_MEM_USAGE, counters.GpuDedicatedMemory);
+            Record(CounterType::GPU_SHARED_MEM_USAGE, counters.GpuSharedMemory);
+            Record(CounterType::STARTING_SHARED_MEM, counters.StartGpuSharedMemory);
         }
-        return var / count;
+        m_pendingSpans.clear();
+    }
+
+    // The start of an interval measured with sampling that has not stopped yet, DBL_MAX if there is none.
+    double GetOpenSpanStart() const { return m_spanOpen ? m_spanStart : DBL_MAX; }
+
+    // All statistics cover every sample since the last Reset, there is no upper bound on the number of samples.
+    int GetCount() const { return static_cast<int>(m_data[CounterType::TIMER].histogram.GetCount()); }
+    double GetAverage(CounterType t) const { return (m_bDisabled) ? 0 : m_data[t].histogram.GetTotal() / GetCount(); }
+    double GetMin(CounterType t) const { return (m_bDisabled) ? 0 : m_data[t].min; }
+    double GetMax(CounterType t) const { return (m_bDisabled) ? 0 : m_data[t].max; }
+    double GetStdev(CounterType t) const { return (m_bDisabled) ? 0 : m_data[t].histogram.GetStdev(); }
+    double GetVariance(CounterType t) const { return (m_bDisabled) ? 0 : m_data[t].histogram.GetVariance(); }
+    // percentile is in [0, 100], e.g. 99.9 for p99.9. Accurate to LatencyHistogram::GetRelativePrecision().
+    double GetPercentile(CounterType t, double percentile) const
+    {
+        return (m_bDisabled) ? 0 : m_data[t].histogram.GetPercentile(percentile);
     }
+    const LatencyHistogram& GetHistogram(CounterType t) const { return m_data[t].histogram; }
+    // The events of the CounterSet given to EnableHardwareCounters, per interval since the last Reset.
+    bool HasHardwareCounters() const
+    {
+        return m_hardwareCounters != nullptr && m_hardwareTotals.GetIntervalCount() > 0;
+    }
+    const HardwareCounters::CounterTotals& GetHardwareCounters() const { return m_hardwareTotals; }
     double GetClockTime() { return clockTime; }
     double GetCpuWorkingDiff() { return CpuWorkingDiff; }
     double GetGpuSharedDiff() { return GpuSharedDiff; }
@@ -564,24 +631,27 @@ public:
     double GetGpuDedicatedDiff() { return GpuDedicatedDiff; }
 
 private:
+    void Record(CounterType t, double value)
+    {
+        m_data[t].histogram.Record(value);
+        m_data[t].max = (value > m_data[t].max) ? value : m_data[t].max;
+        m_data[t].min = (value < m_data[t].min) ? value : m_data[t].min;
+    }
+
     struct DataBlock
     {
         void Reset()
         {
             max = 0;
             min = DBL_MAX;
-            total = 0;
-            memset(measured, 0, sizeof(double) * TIMER_SLOT_SIZE);
+            histogram.Reset();
         }
 
         double max;
         double min;
-        double total;
-        double measured[TIMER_SLOT_SIZE];
+        LatencyHistogram histogram;
     };
 
-    int m_pos;
-    bool m_bBufferFull;
     bool m_bDisabled;
 
     Timer m_timer;
@@ -590,6 +660,13 @@ private:
     GpuPerfCounter m_gpuCounter;
 #endif
     DataBlock m_data[CounterType::TYPE_COUNT];
+    bool m_sampled = false;
+    double m_spanStart = 0;
+    bool m_spanOpen = false;
+    std::vector<ResourceSampling::Span> m_pendingSpans; // measured with sampling, waiting for ApplySamples
+    const HardwareCounters::CounterSet* m_hardwareCounters = nullptr; // owned by the Profiler
+    HardwareCounters::Snapshot m_hardwareStart;
+    HardwareCounters::CounterTotals m_hardwareTotals;
 
     double clockTime;
     double CpuWorkingDiff;
@@ -636,8 +713,70 @@ public:
         }
     }
 
+    // Measures the intervals with timestamps only, while a background thread samples the CPU, memory and GPU counters
+    // every intervalMilliseconds, see ResourceSampler.h. Call CollectSamples before reading the counters.
+    void EnableSampling(double intervalMilliseconds)
+    {
+        std::vector<ResourceSampling::SampleSource> sources = { ResourceSampling::ReadProcessCounters };
+#ifndef DISABLE_GPU_COUNTERS
+        auto gpuCounter = std::make_shared<GpuPerfCounter>();
+        sources.push_back(
+            [gpuCounter](ResourceSampling::ResourceSample& sample) { return gpuCounter->Sample(sample); });
+#endif
+        ResourceSampling::SamplerOptions options;
+        options.IntervalMilliseconds = intervalMilliseconds;
+        m_sampler = std::make_unique<ResourceSampling::ResourceSampler>(options, std::move(sources));
+        for (int i = 0; i < T::COUNT; ++i)
+        {
+            m_perfCounterStat[i].EnableSampling();
+        }
+        m_sampler->Start();
+    }
+
+    // Gives every interval measured since the last call its counters. Does nothing without EnableSampling.
+    void CollectSamples()
+    {
+        if (!m_sampler)
+        {
+            return;
+        }
+        m_sampler->SampleNow();
+        std::vector<ResourceSampling::ResourceSample> samples = m_sampler->GetSamples();
+        double keepFrom = samples.back().Time;
+        for (int i = 0; i < T::COUNT; ++i)
+        {
+            m_perfCounterStat[i].ApplySamples(samples);
+            keepFrom = (std::min)(keepFrom, m_perfCounterStat[i].GetOpenSpanStart());
+        }
+        // Intervals that have not stopped yet, or start later, still interpolate from the samples around their start
+        m_sampler->DiscardBefore(keepFrom);
+    }
+
+    // Counts the CPU hardware events of HardwareCounters::DefaultEvents in every interval. Returns false with the
+    // reason in error if none of them can be counted on this machine.
+    bool EnableHardwareCounters(std::string& error)
+    {
+        auto counters = std::make_unique<HardwareCounters::CounterSet>();
+        if (counters->GetOpenCount() == 0)
+        {
+            error = counters->GetError();
+            return false;
+        }
+        m_hardwareCounters = std::move(counters);
+        for (int i = 0; i < T::COUNT; ++i)
+        {
+            m_perfCounterStat[i].EnableHardwareCounters(m_hardwareCounters.get());
+        }
+        return true;
+    }
+
+    // The events counted by EnableHardwareCounters, nullptr without it.
+    const HardwareCounters::CounterSet* GetHardwareCounters() const { return m_hardwareCounters.get(); }
+
 private:
     PerfCounterStatistics m_perfCounterStat[T::COUNT];
+    std::unique_ptr<ResourceSampling::ResourceSampler> m_sampler;
+    std::unique_ptr<HardwareCounters::CounterSet> m_hardwareCounters;
 };
 
 #define WINML_PROFILING
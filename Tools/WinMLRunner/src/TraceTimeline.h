@@ -0,0 +1,389 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+#if defined(_WIN32)
+#include <Windows.h>
+#else
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+#include "PerfReport.h"
+#include "ResourceSampler.h"
+
+// Timeline of the phases of a run for -TraceOutput, in the Chrome Trace Event format that chrome://tracing and
+// ui.perfetto.dev open. Every span records its thread, so nested phases, concurrent workers and the gaps between them
+// show up where the averages of -Perf hide them.
+//
+// Spans are appended to a buffer owned by the thread that records them, so recording takes no lock that another
+// thread contends on, and nothing is formatted until the trace is written. When the recorder is not enabled a span only
+// reads one atomic flag. Timestamps come from the steady clock, which all processes of a machine share, so the traces
+// of -ParallelSweep jobs line up with the one of the sweep.
+// Nothing in here depends on WinML.
+namespace TraceTimeline
+{
+    // Microseconds, the unit of the trace format.
+    inline double NowMicroseconds()
+    {
+        return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    inline uint32_t CurrentProcessId()
+    {
+#if defined(_WIN32)
+        return static_cast<uint32_t>(::GetCurrentProcessId());
+#else
+        return static_cast<uint32_t>(getpid());
+#endif
+    }
+
+    // The id the OS gives the thread, as shown by debuggers and profilers.
+    inline uint32_t CurrentThreadId()
+    {
+#if defined(_WIN32)
+        return static_cast<uint32_t>(::GetCurrentThreadId());
+#else
+        return static_cast<uint32_t>(syscall(SYS_gettid));
+#endif
+    }
+
+    struct Event
+    {
+        const char* Name;         // a string literal
+        const char* Category;     // a string literal, e.g. "phase", "input", "io"
+        char Phase;               // 'X' for a span, 'C' for a counter
+        double Timestamp;         // NowMicroseconds at the start of the span
+        double Duration;          // us, 0 for counters
+        const char* ArgumentName; // a numeric argument, e.g. the iteration, or the value of a counter
+        double ArgumentValue;
+        std::string Detail;       // e.g. the file a span reads, empty for none
+    };
+
+    // Spans a thread records beyond this are dropped and counted, so a very long run cannot run out of memory.
+    const size_t MaxEventsPerThread = 1 << 20;
+
+    class Recorder
+    {
+    public:
+        Recorder() : m_id(NextId()) {}
+        Recorder(const Recorder&) = delete;
+        Recorder& operator=(const Recorder&) = delete;
+
+        void Enable() { m_enabled.store(true, std::memory_order_relaxed); }
+        bool IsEnabled() const { return m_enabled.load(std::memory_order_relaxed); }
+
+        void SetProcessName(const std::string& name)
+        {
+            std::lock_guard<std::mutex> lock(m_lock);
+            m_processName = name;
+        }
+
+        // Names the track of the calling thread, e.g. "evaluate worker 2".
+        void SetThreadName(const std::string& name)
+        {
+            if (!IsEnabled())
+            {
+                return;
+            }
+            ThreadBuffer& buffer = GetThreadBuffer();
+            std::lock_guard<std::mutex> lock(buffer.Lock);
+            buffer.Name = name;
+        }
+
+        // Records a span of the calling thread from start to end, in NowMicroseconds. See also Scope.
+        void AddSpan(const char* name, const char* category, double start, double end,
+                     const char* argumentName = nullptr, double argumentValue = 0, std::string detail = std::string())
+        {
+            Add({ name, category, 'X', start, end - start, argumentName, argumentValue, std::move(detail) });
+        }
+
+        // Records the value of the counter track name, e.g. the working set in MB.
+        void AddCounter(const char* name, double value)
+        {
+            Add({ name, "counter", 'C', NowMicroseconds(), 0, "value", value, std::string() });
+        }
+
+        // Records the working set and committed memory of the process on their counter tracks.
+        void AddMemoryCounters()
+        {
+            ResourceSampling::ResourceSample sample;
+            if (IsEnabled() && ResourceSampling::ReadProcessCounters(sample))
+            {
+                AddCounter("working set (MB)", sample.WorkingSet);
+                AddCounter("page file usage (MB)", sample.PageFileUsage);
+            }
+        }
+
+        // Adds events read from the trace of another process, see ReadTraceEvents, written along with this one's.
+        void AddExternalEvents(const std::vector<std::string>& events)
+        {
+            std::lock_guard<std::mutex> lock(m_lock);
+            m_externalEvents.insert(m_externalEvents.end(), events.begin(), events.end());
+        }
+
+        size_t GetEventCount() const
+        {
+            std::lock_guard<std::mutex> lock(m_lock);
+            size_t count = 0;
+            for (const auto& buffer : m_buffers)
+            {
+                std::lock_guard<std::mutex> bufferLock(buffer->Lock);
+                count += buffer->Events.size();
+            }
+            return count;
+        }
+
+        size_t GetDroppedCount() const
+        {
+            std::lock_guard<std::mutex> lock(m_lock);
+            size_t dropped = 0;
+            for (const auto& buffer : m_buffers)
+            {
+                std::lock_guard<std::mutex> bufferLock(buffer->Lock);
+                dropped += buffer->Dropped;
+            }
+            return dropped;
+        }
+
+        // Writes the trace as a JSON object with one event per line, which ReadTraceEvents reads back. Threads may
+        // still be recording, their events up to now are written.
+        void Write(std::ostream& output) const
+        {
+            std::lock_guard<std::mutex> lock(m_lock);
+            const uint32_t processId = CurrentProcessId();
+            const char* separator = "";
+            output << "{\"traceEvents\":[\n";
+            if (!m_processName.empty())
+            {
+                PerfReport::JsonWriter json;
+                json.BeginObject().Key("name").String("process_name").Key("ph").String("M");
+                json.Key("pid").Number(processId).Key("tid").Number(0);
+                json.Key("args").BeginObject().Key("name").String(m_processName).EndObject();
+                json.EndObject();
+                output << separator << json.GetString();
+                separator = ",\n";
+            }
+            for (const auto& buffer : m_buffers)
+            {
+                std::lock_guard<std::mutex> bufferLock(buffer->Lock);
+                if (!buffer->Name.empty())
+                {
+                    PerfReport::JsonWriter json;
+                    json.BeginObject().Key("name").String("thread_name").Key("ph").String("M");
+                    json.Key("pid").Number(processId).Key("tid").Number(buffer->ThreadId);
+                    json.Key("args").BeginObject().Key("name").String(buffer->Name).EndObject();
+                    json.EndObject();
+                    output << separator << json.GetString();
+                    separator = ",\n";
+                }
+                for (const Event& event : buffer->Events)
+                {
+                    output << separator << FormatEvent(event, processId, buffer->ThreadId);
+                    separator = ",\n";
+                }
+            }
+            for (const auto& event : m_externalEvents)
+            {
+                output << separator << event;
+                separator = ",\n";
+            }
+            output << "\n],\"displayTimeUnit\":\"ms\"}\n";
+        }
+
+        // Replaces the file at path, unlike the appending -PerfOutput, as a trace holds one JSON object.
+        void WriteToFile(const std::wstring& path) const
+        {
+            std::ofstream output(std::filesystem::path(path), std::ios_base::binary | std::ios_base::trunc);
+            if (output)
+            {
+                Write(output);
+                output.flush();
+            }
+            if (!output)
+            {
+                throw std::runtime_error("TraceTimeline: could not write the trace");
+            }
+        }
+
+    private:
+        struct ThreadBuffer
+        {
+            mutable std::mutex Lock;  // only contended while the trace is written
+            std::thread::id Thread;
+            uint32_t ThreadId = 0;
+            std::string Name;
+            std::deque<Event> Events; // grows without moving the events recorded so far
+            size_t Dropped = 0;
+        };
+
+        static uint64_t NextId()
+        {
+            static std::atomic<uint64_t> nextId(1);
+            return nextId++;
+        }
+
+        void Add(Event&& event)
+        {
+            if (!IsEnabled())
+            {
+                return;
+            }
+            ThreadBuffer& buffer = GetThreadBuffer();
+            std::lock_guard<std::mutex> lock(buffer.Lock);
+            if (buffer.Events.size() < MaxEventsPerThread)
+            {
+                buffer.Events.push_back(std::move(event));
+            }
+            else
+            {
+                buffer.Dropped++;
+            }
+        }
+
+        // The buffer of the calling thread, created on its first event. The last one used is cached per thread.
+        ThreadBuffer& GetThreadBuffer()
+        {
+            thread_local uint64_t cachedRecorder = 0;
+            thread_local ThreadBuffer* cachedBuffer = nullptr;
+            if (cachedRecorder == m_id)
+            {
+                return *cachedBuffer;
+            }
+            std::lock_guard<std::mutex> lock(m_lock);
+            std::thread::id thread = std::this_thread::get_id();
+            ThreadBuffer* buffer = nullptr;
+            for (const auto& existing : m_buffers)
+            {
+                buffer = existing->Thread == thread ? existing.get() : buffer;
+            }
+            if (buffer == nullptr)
+            {
+                m_buffers.push_back(std::make_unique<ThreadBuffer>());
+                buffer = m_buffers.back().get();
+                buffer->Thread = thread;
+                buffer->ThreadId = CurrentThreadId();
+            }
+            cachedRecorder = m_id;
+            cachedBuffer = buffer;
+            return *buffer;
+        }
+
+        static std::string FormatEvent(const Event& event, uint32_t processId, uint32_t threadId)
+        {
+            PerfReport::JsonWriter json;
+            json.BeginObject();
+            json.Key("name").String(event.Name);
+            json.Key("cat").String(event.Category);
+            json.Key("ph").String(std::string(1, event.Phase));
+            json.Key("ts").Number(event.Timestamp);
+            if (event.Phase == 'X')
+            {
+                json.Key("dur").Number(event.Duration);
+            }
+            json.Key("pid").Number(processId);
+            json.Key("tid").Number(threadId);
+            if (event.ArgumentName != nullptr || !event.Detail.empty())
+            {
+                json.Key("args").BeginObject();
+                if (event.ArgumentName != nullptr)
+                {
+                    json.Key(event.ArgumentName).Number(event.ArgumentValue);
+                }
+                if (!event.Detail.empty())
+                {
+                    json.Key("detail").String(event.Detail);
+                }
+                json.EndObject();
+            }
+            json.EndObject();
+            return json.GetString();
+        }
+
+        const uint64_t m_id; // tells the recorders apart in the buffer cache of a thread
+        std::atomic<bool> m_enabled{ false };
+        mutable std::mutex m_lock;
+        std::vector<std::unique_ptr<ThreadBuffer>> m_buffers;
+        std::string m_processName;
+        std::vector<std::string> m_externalEvents;
+    };
+
+    // The recorder of the process, enabled by -TraceOutput.
+    inline Recorder& Global()
+    {
+        static Recorder recorder;
+        return recorder;
+    }
+
+    // Records a span from construction to destruction on the calling thread, if the recorder is enabled.
+    class Scope
+    {
+    public:
+        explicit Scope(const char* name, const char* category = "phase", Recorder& recorder = Global())
+            : m_recorder(recorder.IsEnabled() ? &recorder : nullptr), m_name(name), m_category(category),
+              m_start(m_recorder ? NowMicroseconds() : 0)
+        {
+        }
+
+        ~Scope()
+        {
+            if (m_recorder)
+            {
+                m_recorder->AddSpan(m_name, m_category, m_start, NowMicroseconds(), m_argumentName, m_argumentValue,
+                                    std::move(m_detail));
+            }
+        }
+
+        Scope(const Scope&) = delete;
+        Scope& operator=(const Scope&) = delete;
+
+        bool IsRecording() const { return m_recorder != nullptr; }
+        void SetArgument(const char* name, double value)
+        {
+            m_argumentName = name;
+            m_argumentValue = value;
+        }
+        void SetDetail(std::string detail) { m_detail = std::move(detail); }
+
+    private:
+        Recorder* m_recorder;
+        const char* m_name;
+        const char* m_category;
+        double m_start;
+        const char* m_argumentName = nullptr;
+        double m_argumentValue = 0;
+        std::string m_detail;
+    };
+
+    // The events of a trace written by Recorder::Write, one JSON object each, e.g. to merge the trace of a
+    // -ParallelSweep job into the trace of the sweep. Empty if the file cannot be read.
+    inline std::vector<std::string> ReadTraceEvents(const std::wstring& path)
+    {
+        std::vector<std::string> events;
+        std::ifstream input(std::filesystem::path(path), std::ios_base::binary);
+        std::string line;
+        while (std::getline(input, line))
+        {
+            if (line.empty() || line[0] != '{' || line.compare(0, 15, "{\"traceEvents\":") == 0)
+            {
+                continue;
+            }
+            if (line.back() == ',')
+            {
+                line.pop_back();
+            }
+            events.push_back(line);
+        }
+        return events;
+    }
+} // namespace TraceTimeline